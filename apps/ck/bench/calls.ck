@@ -0,0 +1,206 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    calls.ck
+
+Abstract:
+
+    This module implements a method call benchmark for the Chalk interpreter.
+    It hammers monomorphic, polymorphic, and megamorphic call sites, plus
+    calls into builtin classes. Run it under time to compare interpreters.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    Chalk
+
+--*/
+
+//
+// -------------------------------------------------------------------- Imports
+//
+
+//
+// -------------------------------------------------------------------- Classes
+//
+
+class Counter {
+    function __init() {
+        this.value = 0;
+        return this;
+    }
+
+    function increment() {
+        this.value += 1;
+    }
+
+    function add(amount) {
+        this.value += amount;
+    }
+
+    function get() {
+        return this.value;
+    }
+}
+
+class Shape {
+    function area() {
+        return 0;
+    }
+
+    function scaled(factor) {
+        return this.area() * factor;
+    }
+}
+
+class Square is Shape {
+    function __init(side) {
+        this.side = side;
+        return this;
+    }
+
+    function area() {
+        return this.side * this.side;
+    }
+}
+
+class Rectangle is Shape {
+    function __init(width, height) {
+        this.width = width;
+        this.height = height;
+        return this;
+    }
+
+    function area() {
+        return this.width * this.height;
+    }
+}
+
+class Triangle is Shape {
+    function __init(base, height) {
+        this.base = base;
+        this.height = height;
+        return this;
+    }
+
+    function area() {
+        return this.base * this.height / 2;
+    }
+}
+
+class Circle is Shape {
+    function __init(radius) {
+        this.radius = radius;
+        return this;
+    }
+
+    function area() {
+        return 3 * this.radius * this.radius;
+    }
+}
+
+class Point is Shape {}
+class Line is Shape {}
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+//
+// This routine calls methods on a single class over and over.
+//
+
+function monomorphic(iterations) {
+    var counter = Counter();
+    var index = 0;
+
+    while (index < iterations) {
+        counter.increment();
+        counter.add(2);
+        index += 1;
+    }
+
+    return counter.get();
+}
+
+//
+// This routine calls the same methods on a handful of classes, which all fit
+// in a single call site's cache.
+//
+
+function polymorphic(iterations) {
+    var index = 0;
+    var shapes = [Square(3), Rectangle(2, 5), Triangle(4, 6), Circle(2)];
+    var total = 0;
+
+    while (index < iterations) {
+        total += shapes[index % 4].scaled(2);
+        index += 1;
+    }
+
+    return total;
+}
+
+//
+// This routine calls the same method on more classes than a call site can
+// remember.
+//
+
+function megamorphic(iterations) {
+    var index = 0;
+    var shapes = [Square(3), Rectangle(2, 5), Triangle(4, 6), Circle(2),
+                  Point(), Line()];
+
+    var total = 0;
+
+    while (index < iterations) {
+        total += shapes[index % 6].area();
+        index += 1;
+    }
+
+    return total;
+}
+
+//
+// This routine calls methods on builtin classes, the way build scripts do when
+// shuffling lists and strings around.
+//
+
+function builtins(iterations) {
+    var index = 0;
+    var list = [];
+    var name = "source.c";
+
+    while (index < iterations) {
+        list.append(name.length());
+        if (list.length() > 64) {
+            list = [];
+        }
+
+        index += 1;
+    }
+
+    return list.length();
+}
+
+//
+// Run each part of the benchmark.
+//
+
+var iterations = 1000000;
+
+Core.print("monomorphic: " + monomorphic(iterations).__str());
+Core.print("polymorphic: " + polymorphic(iterations).__str());
+Core.print("megamorphic: " + megamorphic(iterations).__str());
+Core.print("builtins: " + builtins(iterations).__str());
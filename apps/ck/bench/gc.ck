@@ -0,0 +1,111 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    gc.ck
+
+Abstract:
+
+    This module implements a garbage collection benchmark for the Chalk
+    interpreter. It builds a large heap of long lived objects, then churns
+    through short lived temporaries while occasionally updating the long
+    lived ones, and prints the collector's pause statistics.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    Chalk
+
+--*/
+
+//
+// -------------------------------------------------------------------- Imports
+//
+
+//
+// -------------------------------------------------------------------- Classes
+//
+
+class Node {
+    var value;
+    var next;
+
+    function __init(value, next) {
+        this.value = value;
+        this.next = next;
+        return this;
+    }
+}
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+//
+// Build the long lived part of the heap, which every full collection has to
+// wade through.
+//
+
+function build(count) {
+    var index = 0;
+    var list = [];
+
+    while (index < count) {
+        list.append(Node(index, {"name": "node" + index.__str()}));
+        index += 1;
+    }
+
+    return list;
+}
+
+//
+// Allocate temporaries that die young, occasionally hanging one off of an
+// old node so the write barrier gets exercised.
+//
+
+function churn(live, iterations) {
+    var index = 0;
+    var node;
+    var temporary;
+    var total = 0;
+
+    while (index < iterations) {
+        temporary = [index, "temp" + index.__str(), Node(index, null)];
+        if (index % 100 == 0) {
+            node = live[index % live.length()];
+            node.next = Node(index, temporary);
+        }
+
+        total += temporary[0];
+        index += 1;
+    }
+
+    return total;
+}
+
+//
+// Run the benchmark and print the collector statistics.
+//
+
+var live = build(200000);
+var statistics;
+
+Core.print("churn: " + churn(live, 1000000).__str());
+statistics = Core.gcStats();
+for (key in ["collections", "minorCollections", "fullCollections"]) {
+    Core.print(key + ": " + statistics[key].__str());
+}
+
+for (key in ["lastPause", "maxPause", "totalPause"]) {
+    Core.print(key + ": " + statistics[key].__str() + "us");
+}
@@ -1612,6 +1612,7 @@ Return Value:
     Value = *(Fiber->StackTop - 1);
     if (ListIndex == List->Elements.Count) {
         CkpArrayAppend(Vm, &(List->Elements), Value);
+        CK_WRITE_BARRIER(Vm, &(List->Header));
 
     } else if ((ListIndex < List->Elements.Count) ||
                (-ListIndex <= (INTN)List->Elements.Count)) {
@@ -1622,6 +1623,7 @@ Return Value:
         CK_ASSERT(Index < List->Elements.Count);
 
         List->Elements.Data[Index] = Value;
+        CK_WRITE_BARRIER(Vm, &(List->Header));
     }
 
     Fiber->StackTop -= 1;
@@ -2071,6 +2073,7 @@ Return Value:
 {
 
     PCK_FIBER Fiber;
+    PCK_CALL_FRAME Frame;
     PCK_VALUE Value;
 
     Fiber = Vm->Fiber;
@@ -2084,6 +2087,8 @@ Return Value:
     }
 
     *Value = CK_POP(Fiber);
+    Frame = &(Fiber->Frames[Fiber->FrameCount - 1]);
+    CK_WRITE_BARRIER(Vm, CK_AS_OBJECT(Frame->StackStart[0]));
     return;
 }
 
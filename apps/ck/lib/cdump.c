@@ -46,10 +46,11 @@ Module Name:
 //
 
 //
-// Define the current freeze file format version.
+// Define the current freeze file format version. Bump this whenever the
+// bytecode changes, so stale frozen modules get recompiled.
 //
 
-#define CK_FREEZE_VERSION 1
+#define CK_FREEZE_VERSION 3
 
 //
 // ------------------------------------------------------ Data Type Definitions
@@ -111,6 +112,14 @@ CkpFreezeFunction (
     PCK_FUNCTION Function
     );
 
+BOOL
+CkpThawHeader (
+    PCSTR *Contents,
+    PUINTN Size,
+    PCK_INTEGER SourceSize,
+    PCK_INTEGER SourceHash
+    );
+
 PCSTR
 CkpThawElement (
     PCSTR *Contents,
@@ -239,6 +248,10 @@ Return Value:
 
     CkpFreezeAdd(Vm, &String, "{\nVersion: ", 11);
     CkpFreezeInteger(Vm, &String, CK_FREEZE_VERSION);
+    CkpFreezeAdd(Vm, &String, "\nSourceSize: ", 13);
+    CkpFreezeInteger(Vm, &String, Module->SourceSize);
+    CkpFreezeAdd(Vm, &String, "\nSourceHash: ", 13);
+    CkpFreezeInteger(Vm, &String, Module->SourceHash);
     CkpFreezeAdd(Vm, &String, "\nName: ", 6);
     CkpFreezeString(Vm, &String, Module->Name);
     if (Module->Path != NULL) {
@@ -347,52 +360,20 @@ Return Value:
 
     PCK_MODULE CoreModule;
     CK_INTEGER CoreVariableCount;
-    CK_INTEGER Integer;
-    INT Match;
     PCSTR Name;
     UINTN NameSize;
     BOOL Result;
+    CK_INTEGER SourceHash;
+    CK_INTEGER SourceSize;
     PCK_STRING String;
 
     CoreVariableCount = 0;
-    if (Size < sizeof(CkModuleFreezeSignature)) {
-        return FALSE;
-    }
-
-    Match = CkCompareMemory(Contents,
-                            CkModuleFreezeSignature,
-                            sizeof(CkModuleFreezeSignature));
-
-    if (Match != 0) {
-        return FALSE;
-    }
-
-    Contents += sizeof(CkModuleFreezeSignature);
-    Size -= sizeof(CkModuleFreezeSignature);
-    if ((Size < 1) || (*Contents != '{')) {
-        return FALSE;
-    }
-
-    Contents += 1;
-    Size -= 1;
-
-    //
-    // Version needs to be first.
-    //
-
-    Name = CkpThawElement(&Contents, &Size, &NameSize);
-    if ((Name == NULL) ||
-        (NameSize != 7) ||
-        (CkCompareMemory(Name, "Version", 7) != 0)) {
-
+    if (!CkpThawHeader(&Contents, &Size, &SourceSize, &SourceHash)) {
         return FALSE;
     }
 
-    if ((!CkpThawInteger(&Contents, &Size, &Integer)) ||
-        (Integer != CK_FREEZE_VERSION)) {
-
-        return FALSE;
-    }
+    Module->SourceSize = SourceSize;
+    Module->SourceHash = SourceHash;
 
     //
     // The module name needs to be next, and it better match up with what was
@@ -511,6 +492,108 @@ Return Value:
     return Result;
 }
 
+BOOL
+CkpModuleIsFrozenCurrent (
+    PCSTR Contents,
+    UINTN Size,
+    PCSTR Source,
+    UINTN SourceSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether or not a frozen module can be used in
+    place of the given source. The frozen module must have been written by
+    this version of the compiler from exactly the same source.
+
+Arguments:
+
+    Contents - Supplies the frozen module contents.
+
+    Size - Supplies the frozen module size in bytes.
+
+    Source - Supplies a pointer to the module source.
+
+    SourceSize - Supplies the size of the source in bytes, not including a
+        null terminator.
+
+Return Value:
+
+    TRUE if the frozen module is current.
+
+    FALSE if the frozen module is stale and the source should be compiled
+    instead.
+
+--*/
+
+{
+
+    CK_INTEGER FrozenHash;
+    CK_INTEGER FrozenSize;
+
+    if (!CkpThawHeader(&Contents, &Size, &FrozenSize, &FrozenHash)) {
+        return FALSE;
+    }
+
+    //
+    // Compare the size first, since it's free, and only hash the source if
+    // the sizes match.
+    //
+
+    if ((FrozenSize != SourceSize) ||
+        (FrozenHash != CkpModuleHashSource(Source, SourceSize))) {
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+ULONG
+CkpModuleHashSource (
+    PCSTR Source,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine computes the hash of module source that frozen modules use
+    to determine whether or not they are stale.
+
+Arguments:
+
+    Source - Supplies a pointer to the module source.
+
+    Size - Supplies the size of the source in bytes.
+
+Return Value:
+
+    Returns the source hash.
+
+--*/
+
+{
+
+    ULONG Hash;
+    UINTN Index;
+
+    //
+    // Use FNV-1a, the same hash used for strings.
+    //
+
+    Hash = 0x811C9DC5;
+    for (Index = 0; Index < Size; Index += 1) {
+        Hash ^= (UCHAR)(Source[Index]);
+        Hash *= 0x1000193;
+    }
+
+    return Hash;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -553,7 +636,14 @@ Return Value:
         break;
 
     case CkValueInteger:
-        CkpFreezeInteger(Vm, String, CK_AS_INTEGER(Value));
+
+        //
+        // Skip the trailing space that standalone integers get, since list
+        // elements are followed directly by a separator.
+        //
+
+        CkpFreezeAdd(Vm, String, "i", 1);
+        CkpFreezeRawInteger(Vm, String, CK_AS_INTEGER(Value));
         break;
 
     case CkValueObject:
@@ -847,6 +937,8 @@ Return Value:
     CkpFreezeInteger(Vm, String, Function->UpvalueCount);
     CkpFreezeAdd(Vm, String, "\nArity: ", 8);
     CkpFreezeInteger(Vm, String, Function->Arity);
+    CkpFreezeAdd(Vm, String, "\nCallCacheCount: ", 17);
+    CkpFreezeInteger(Vm, String, Function->CallCacheCount);
     CkpFreezeAdd(Vm, String, "\nName: ", 7);
     CkpFreezeString(Vm, String, Function->Debug.Name);
     CkpFreezeAdd(Vm, String, "\nFirstLine: ", 12);
@@ -861,6 +953,109 @@ Return Value:
     return;
 }
 
+BOOL
+CkpThawHeader (
+    PCSTR *Contents,
+    PUINTN Size,
+    PCK_INTEGER SourceSize,
+    PCK_INTEGER SourceHash
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads and validates the start of a frozen module, up to but
+    not including the module name.
+
+Arguments:
+
+    Contents - Supplies a pointer that on input points to the frozen module.
+        This is updated on output.
+
+    Size - Supplies a pointer to the remaining size. This is updated on output.
+
+    SourceSize - Supplies a pointer where the size of the source the module
+        was compiled from will be returned.
+
+    SourceHash - Supplies a pointer where the hash of the source the module
+        was compiled from will be returned.
+
+Return Value:
+
+    TRUE if the header is valid and from this version of the compiler.
+
+    FALSE if the header is invalid or from a different version.
+
+--*/
+
+{
+
+    CK_INTEGER Integer;
+    INT Match;
+    PCSTR Name;
+    UINTN NameSize;
+
+    if (*Size < sizeof(CkModuleFreezeSignature)) {
+        return FALSE;
+    }
+
+    Match = CkCompareMemory(*Contents,
+                            CkModuleFreezeSignature,
+                            sizeof(CkModuleFreezeSignature));
+
+    if (Match != 0) {
+        return FALSE;
+    }
+
+    *Contents += sizeof(CkModuleFreezeSignature);
+    *Size -= sizeof(CkModuleFreezeSignature);
+    if ((*Size < 1) || (**Contents != '{')) {
+        return FALSE;
+    }
+
+    *Contents += 1;
+    *Size -= 1;
+
+    //
+    // Version needs to be first, followed by the source fingerprint.
+    //
+
+    Name = CkpThawElement(Contents, Size, &NameSize);
+    if ((Name == NULL) ||
+        (NameSize != 7) ||
+        (CkCompareMemory(Name, "Version", 7) != 0)) {
+
+        return FALSE;
+    }
+
+    if ((!CkpThawInteger(Contents, Size, &Integer)) ||
+        (Integer != CK_FREEZE_VERSION)) {
+
+        return FALSE;
+    }
+
+    Name = CkpThawElement(Contents, Size, &NameSize);
+    if ((Name == NULL) ||
+        (NameSize != 10) ||
+        (CkCompareMemory(Name, "SourceSize", 10) != 0) ||
+        (!CkpThawInteger(Contents, Size, SourceSize))) {
+
+        return FALSE;
+    }
+
+    Name = CkpThawElement(Contents, Size, &NameSize);
+    if ((Name == NULL) ||
+        (NameSize != 10) ||
+        (CkCompareMemory(Name, "SourceHash", 10) != 0) ||
+        (!CkpThawInteger(Contents, Size, SourceHash))) {
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 PCSTR
 CkpThawElement (
     PCSTR *Contents,
@@ -1224,6 +1419,16 @@ Return Value:
             Result = CkpThawInteger(Contents, Size, &Integer);
             Function->Arity = Integer;
 
+        } else if ((NameSize == 14) &&
+                   (CkCompareMemory(Name, "CallCacheCount", 14) == 0)) {
+
+            Result = CkpThawInteger(Contents, Size, &Integer);
+            if ((Integer < 0) || (Integer > CK_CALL_CACHE_NONE)) {
+                Result = FALSE;
+            }
+
+            Function->CallCacheCount = Integer;
+
         } else if ((NameSize == 4) &&
                    (CkCompareMemory(Name, "Name", 4) == 0)) {
 
@@ -56,6 +56,11 @@ CkpGetInstructionSize (
     UINTN Ip
     );
 
+VOID
+CkpEmitCallCache (
+    PCK_COMPILER Compiler
+    );
+
 VOID
 CkpEmitLineNumberInformation (
     PCK_COMPILER Compiler,
@@ -204,16 +209,16 @@ UCHAR CkCompilerOperandSizes[CkOpcodeCount] = {
     1, // CkOpLoadField
     1, // CkOpStoreField
     0, // CkOpPop
-    2, // CkOpCall0
-    2,
-    2,
-    2,
-    2,
-    2,
-    2,
-    2,
-    2, // CkOpCall8
-    3, // CkOpCall
+    4, // CkOpCall0
+    4,
+    4,
+    4,
+    4,
+    4,
+    4,
+    4,
+    4, // CkOpCall8
+    5, // CkOpCall
     1, // CkOpIndirectCall
     4, // CkOpSuperCall0
     4,
@@ -649,6 +654,7 @@ Return Value:
     Symbol = CkpGetSignatureSymbol(Compiler, Signature);
     if (Signature->Arity <= 8) {
         CkpEmitShortOp(Compiler, Op + Signature->Arity, Symbol);
+        CkpEmitCallCache(Compiler);
 
     } else {
         if (Op == CkOpCall0) {
@@ -666,6 +672,7 @@ Return Value:
         Compiler->StackSlots -= Signature->Arity;
         CkpEmitByteOp(Compiler, Op, Signature->Arity);
         CkpEmitShort(Compiler, Symbol);
+        CkpEmitCallCache(Compiler);
     }
 
     return;
@@ -713,6 +720,7 @@ Return Value:
     Symbol = CkpGetMethodSymbol(Compiler, Name, Length);
     if (ArgumentCount <= 8) {
         CkpEmitShortOp(Compiler, CkOpCall0 + ArgumentCount, Symbol);
+        CkpEmitCallCache(Compiler);
 
     } else {
         if (ArgumentCount >= MAX_UCHAR) {
@@ -722,6 +730,7 @@ Return Value:
 
         CkpEmitByteOp(Compiler, CkOpCall, ArgumentCount);
         CkpEmitShort(Compiler, Symbol);
+        CkpEmitCallCache(Compiler);
 
         //
         // Manually track the stack usage since the instruction itself doesn't
@@ -1422,6 +1431,49 @@ Return Value:
     return Size + 1;
 }
 
+VOID
+CkpEmitCallCache (
+    PCK_COMPILER Compiler
+    )
+
+/*++
+
+Routine Description:
+
+    This routine emits the inline method cache index operand of a call
+    instruction, assigning the call site the next cache in the function.
+
+Arguments:
+
+    Compiler - Supplies a pointer to the compiler.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PCK_FUNCTION Function;
+    CK_SYMBOL_INDEX Index;
+
+    //
+    // Functions with an absurd number of call sites just leave the rest
+    // uncached.
+    //
+
+    Function = Compiler->Function;
+    Index = CK_CALL_CACHE_NONE;
+    if (Function->CallCacheCount < CK_CALL_CACHE_NONE) {
+        Index = Function->CallCacheCount;
+        Function->CallCacheCount += 1;
+    }
+
+    CkpEmitShort(Compiler, Index);
+    return;
+}
+
 VOID
 CkpEmitLineNumberInformation (
     PCK_COMPILER Compiler,
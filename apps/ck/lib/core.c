@@ -38,6 +38,12 @@ Module Name:
 // ---------------------------------------------------------------- Definitions
 //
 
+//
+// Define the number of garbage collector statistics returned to scripts.
+//
+
+#define CK_GC_STATISTIC_COUNT 9
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -183,6 +189,12 @@ CkpCoreGarbageCollect (
     PCK_VALUE Arguments
     );
 
+BOOL
+CkpCoreGarbageStatistics (
+    PCK_VM Vm,
+    PCK_VALUE Arguments
+    );
+
 BOOL
 CkpCoreImportModule (
     PCK_VM Vm,
@@ -220,6 +232,23 @@ CkpCoreRaise (
 extern PVOID _binary_ckcore_ck_start;
 extern PVOID _binary_ckcore_ck_end;
 
+//
+// Define the names of the garbage collector statistics, in the order they're
+// filled in.
+//
+
+PCSTR CkGarbageStatisticNames[CK_GC_STATISTIC_COUNT] = {
+    "collections",
+    "minorCollections",
+    "fullCollections",
+    "freed",
+    "promoted",
+    "heapSize",
+    "lastPause",
+    "maxPause",
+    "totalPause"
+};
+
 CK_PRIMITIVE_DESCRIPTION CkObjectPrimitives[] = {
     {"__init@0", 0, CkpObjectInit},
     {"__lnot@0", 0, CkpObjectLogicalNot},
@@ -263,6 +292,7 @@ CK_PRIMITIVE_DESCRIPTION CkFunctionPrimitives[] = {
 
 CK_PRIMITIVE_DESCRIPTION CkCorePrimitives[] = {
     {"gc@0", 0, CkpCoreGarbageCollect},
+    {"gcStats@0", 0, CkpCoreGarbageStatistics},
     {"importModule@1", 1, CkpCoreImportModule},
     {"_write@1", 1, CkpCoreWrite},
     {"modulePath@0", 0, CkpCoreGetModulePath},
@@ -302,6 +332,7 @@ Return Value:
     PCK_BUILTIN_CLASSES Classes;
     PCK_MODULE CoreModule;
     CK_ERROR_TYPE Error;
+    ULONG Generation;
     PCK_OBJECT Object;
     PCK_CLASS ObjectMeta;
     UINTN Size;
@@ -425,25 +456,32 @@ Return Value:
 
     //
     // Patch up any of the core objects that may have been created before their
-    // associated classes existed.
+    // associated classes existed. A garbage collection may have already
+    // moved some of them to the old generation.
     //
 
-    Object = Vm->FirstObject;
-    while (Object != NULL) {
-        if (Object->Type == CkObjectString) {
-            Object->Class = Classes->String;
+    for (Generation = 0; Generation < 2; Generation += 1) {
+        Object = Vm->FirstObject;
+        if (Generation != 0) {
+            Object = Vm->OldObjects;
+        }
 
-        } else if (Object->Type == CkObjectClosure) {
-            Object->Class = Classes->Function;
+        while (Object != NULL) {
+            if (Object->Type == CkObjectString) {
+                Object->Class = Classes->String;
 
-        } else if (Object->Type == CkObjectDict) {
-            Object->Class = Classes->Dict;
+            } else if (Object->Type == CkObjectClosure) {
+                Object->Class = Classes->Function;
 
-        } else if (Object->Type == CkObjectFiber) {
-            Object->Class = Classes->Fiber;
-        }
+            } else if (Object->Type == CkObjectDict) {
+                Object->Class = Classes->Dict;
 
-        Object = Object->Next;
+            } else if (Object->Type == CkObjectFiber) {
+                Object->Class = Classes->Fiber;
+            }
+
+            Object = Object->Next;
+        }
     }
 
     CoreModule->Header.Class = Classes->Module;
@@ -1156,6 +1194,7 @@ Return Value:
         }
 
         CK_OBJECT_VALUE(Instance->Fields[0], Dict);
+        CK_WRITE_BARRIER(Vm, &(Instance->Header));
 
     } else {
         Dict = CK_AS_DICT(Instance->Fields[0]);
@@ -1625,6 +1664,78 @@ Return Value:
     return TRUE;
 }
 
+BOOL
+CkpCoreGarbageStatistics (
+    PCK_VM Vm,
+    PCK_VALUE Arguments
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the primitive that returns a dictionary of
+    garbage collector statistics. Pause times are in microseconds, and the
+    heap size is an estimate in bytes.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Arguments - Supplies the function arguments.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if execution caused a runtime error.
+
+--*/
+
+{
+
+    PCK_DICT Dict;
+    UINTN Index;
+    CK_VALUE Key;
+    PCK_GC_STATISTICS Statistics;
+    CK_INTEGER Values[CK_GC_STATISTIC_COUNT];
+    CK_VALUE Value;
+
+    Statistics = &(Vm->GarbageStatistics);
+    Values[0] = Vm->GarbageRuns;
+    Values[1] = Statistics->MinorCollections;
+    Values[2] = Statistics->FullCollections;
+    Values[3] = Vm->GarbageFreed;
+    Values[4] = Statistics->Promoted;
+    Values[5] = Vm->BytesAllocated;
+    Values[6] = Statistics->LastPause;
+    Values[7] = Statistics->MaxPause;
+    Values[8] = Statistics->TotalPause;
+    Dict = CkpDictCreate(Vm);
+    if (Dict == NULL) {
+        return FALSE;
+    }
+
+    CkpPushRoot(Vm, &(Dict->Header));
+    for (Index = 0; Index < CK_GC_STATISTIC_COUNT; Index += 1) {
+        Key = CkpStringCreate(Vm,
+                              CkGarbageStatisticNames[Index],
+                              strlen(CkGarbageStatisticNames[Index]));
+
+        if (CK_IS_NULL(Key)) {
+            CkpPopRoot(Vm);
+            return FALSE;
+        }
+
+        CK_INT_VALUE(Value, Values[Index]);
+        CkpDictSet(Vm, Dict, Key, Value);
+    }
+
+    CkpPopRoot(Vm);
+    CK_OBJECT_VALUE(Arguments[0], Dict);
+    return TRUE;
+}
+
 BOOL
 CkpCoreImportModule (
     PCK_VM Vm,
@@ -518,6 +518,17 @@ Return Value:
                      CK_AS_STRING(Function->Module->Strings.List.Data[Symbol]);
 
         CkpDebugPrint(Vm, "%s", StringObject->Value);
+
+        //
+        // Calls are followed by their inline method cache index.
+        //
+
+        if ((Op != CkOpMethod) && (Op != CkOpStaticMethod)) {
+            Symbol = CK_READ16(ByteCode + Offset);
+            Offset += 2;
+            CkpDebugPrint(Vm, " (cache %d)", Symbol);
+        }
+
         break;
 
     case CkOpIndirectCall:
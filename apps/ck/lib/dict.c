@@ -317,6 +317,7 @@ Return Value:
         Dict->Count += 1;
     }
 
+    CK_WRITE_BARRIER(Vm, &(Dict->Header));
     return;
 }
 
@@ -37,11 +37,36 @@ Module Name:
 #include <minoca/lib/yy.h>
 #include "lang.h"
 #include "compsup.h"
+#include "vmsys.h"
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro evaluates to non-zero if objects of the given type stay in the
+// remembered set for as long as they live. Classes, fibers, functions, and
+// modules are mutated by the compiler, module loader, and interpreter stack
+// in too many places to put a write barrier at each store, and there are
+// comparatively few of them, so minor collections simply scan them all.
+//
+
+#define CK_ALWAYS_REMEMBERED(_Type)     \
+    (((_Type) == CkObjectClass) ||      \
+     ((_Type) == CkObjectFiber) ||      \
+     ((_Type) == CkObjectFunction) ||   \
+     ((_Type) == CkObjectModule))
 
 //
 // ---------------------------------------------------------------- Definitions
 //
 
+//
+// Define the initial number of elements in the remembered array.
+//
+
+#define CK_INITIAL_REMEMBERED_CAPACITY 64
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -50,12 +75,30 @@ Module Name:
 // ----------------------------------------------- Internal Function Prototypes
 //
 
+VOID
+CkpCollectGarbage (
+    PCK_VM Vm,
+    BOOL Full
+    );
+
+VOID
+CkpForgetRememberedObjects (
+    PCK_VM Vm,
+    BOOL All
+    );
+
 VOID
 CkpKissCompiler (
     PCK_VM Vm,
     PCK_COMPILER Compiler
     );
 
+VOID
+CkpKissRoot (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    );
+
 VOID
 CkpKissValue (
     PCK_VM Vm,
@@ -74,6 +117,12 @@ CkpDeeplyKiss (
     PCK_OBJECT Head
     );
 
+VOID
+CkpUnkissOldObjects (
+    PCK_VM Vm,
+    PCK_OBJECT Head
+    );
+
 VOID
 CkpCollectUnkissedObjects (
     PCK_VM Vm
@@ -175,8 +224,8 @@ CkCollectGarbage (
 
 Routine Description:
 
-    This routine performs garbage collection on the given Chalk instance,
-    freeing up unused dynamic memory as appropriate.
+    This routine performs a full garbage collection on the given Chalk
+    instance, freeing up unused dynamic memory as appropriate.
 
 Arguments:
 
@@ -184,65 +233,13 @@ Routine Description:
 
 Return Value:
 
-    Returns a pointer to the newly allocated or reallocated memory on success.
-
-    NULL on allocation failure or for free operations.
+    None.
 
 --*/
 
 {
 
-    UINTN Index;
-    CK_OBJECT KissHead;
-
-    //
-    // Reset the number of bytes allocated, and have the kiss functions count
-    // their allocations. This avoids the extra work of having to determine
-    // the size of objects being freed. The tradeoff is that the bytes
-    // allocated won't count non-object allocations, so it will be a bit low.
-    //
-
-    Vm->BytesAllocated = 0;
-    Vm->GarbageRuns += 1;
-    Vm->GarbageFreed = 0;
-
-    //
-    // Set up the head of the kiss list. Make it a circle so that the last
-    // object added does not have a non-null pointer.
-    //
-
-    KissHead.Type = CkObjectInvalid;
-    KissHead.Next = NULL;
-    KissHead.NextKiss = &KissHead;
-    Vm->KissList = &KissHead;
-    CkpKissObject(Vm, &(Vm->Modules->Header));
-    CkpKissObject(Vm, &(Vm->ModulePath->Header));
-    for (Index = 0; Index < Vm->WorkingObjectCount; Index += 1) {
-        CkpKissObject(Vm, Vm->WorkingObjects[Index]);
-    }
-
-    CkpKissObject(Vm, &(Vm->Fiber->Header));
-    if (Vm->Compiler != NULL) {
-        CkpKissCompiler(Vm, Vm->Compiler);
-    }
-
-    CkpKissObject(Vm, &(Vm->UnhandledException->Header));
-    CkpDeeplyKiss(Vm, &KissHead);
-    CkpCollectUnkissedObjects(Vm);
-
-    //
-    // Determine the next garbage collection time, expressed as an additional
-    // percentage growth. Except rather than using percent 100 exactly, use
-    // 1024 to avoid the divide. It looks nearly the same as percent times 10.
-    //
-
-    Vm->NextGarbageCollection = Vm->BytesAllocated *
-                           (1024 + Vm->Configuration.HeapGrowthPercent) / 1024;
-
-    if (Vm->NextGarbageCollection < Vm->Configuration.MinimumHeapSize) {
-        Vm->NextGarbageCollection = Vm->Configuration.MinimumHeapSize;
-    }
-
+    CkpCollectGarbage(Vm, TRUE);
     return;
 }
 
@@ -311,6 +308,72 @@ Return Value:
     return;
 }
 
+VOID
+CkpRememberObject (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds an old object to the remembered set, causing it to be
+    scanned by each minor collection until the next one completes. Callers
+    usually get here through the write barrier.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Object - Supplies a pointer to the old object that may now point at young
+        objects.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN NewCapacity;
+    PCK_OBJECT *NewRemembered;
+
+    CK_ASSERT((Object->Flags & CK_OBJECT_OLD) != 0);
+    CK_ASSERT((Object->Flags & CK_OBJECT_REMEMBERED) == 0);
+
+    //
+    // Expand the array if needed. This cannot use the regular allocator, as
+    // a write barrier must never trigger a garbage collection. If the array
+    // cannot be expanded, the next collection looks at everything instead.
+    //
+
+    if (Vm->RememberedCount == Vm->RememberedCapacity) {
+        NewCapacity = Vm->RememberedCapacity * 2;
+        if (NewCapacity == 0) {
+            NewCapacity = CK_INITIAL_REMEMBERED_CAPACITY;
+        }
+
+        NewRemembered = CkRawReallocate(Vm,
+                                        Vm->Remembered,
+                                        NewCapacity * sizeof(PCK_OBJECT));
+
+        if (NewRemembered == NULL) {
+            Vm->RememberedOverflow = TRUE;
+            return;
+        }
+
+        Vm->Remembered = NewRemembered;
+        Vm->RememberedCapacity = NewCapacity;
+    }
+
+    Vm->Remembered[Vm->RememberedCount] = Object;
+    Vm->RememberedCount += 1;
+    Object->Flags |= CK_OBJECT_REMEMBERED;
+    return;
+}
+
 PVOID
 CkpReallocate (
     PCK_VM Vm,
@@ -354,16 +417,27 @@ Return Value:
     //
 
     Vm->BytesAllocated += NewSize - OldSize;
+    if (NewSize > OldSize) {
+        Vm->YoungBytes += NewSize - OldSize;
+    }
 
     //
-    // Potentially perform garbage collection.
+    // Potentially perform garbage collection. Collect the whole heap if it has
+    // grown enough since the last full collection, otherwise just collect the
+    // young generation if enough has been allocated since the last
+    // collection of any kind.
     //
 
-    if ((NewSize > 0) &&
-        ((Vm->BytesAllocated >= Vm->NextGarbageCollection) ||
-         (CK_VM_FLAG_SET(Vm, CK_CONFIGURATION_GC_STRESS)))) {
+    if (NewSize > 0) {
+        if (Vm->BytesAllocated >= Vm->NextGarbageCollection) {
+            CkpCollectGarbage(Vm, TRUE);
 
-        CkCollectGarbage(Vm);
+        } else if (((Vm->Configuration.YoungHeapSize != 0) &&
+                    (Vm->YoungBytes >= Vm->Configuration.YoungHeapSize)) ||
+                   (CK_VM_FLAG_SET(Vm, CK_CONFIGURATION_GC_STRESS))) {
+
+            CkpCollectGarbage(Vm, FALSE);
+        }
     }
 
     Allocation = CkRawReallocate(Vm, Memory, NewSize);
@@ -391,6 +465,204 @@ Return Value:
 // --------------------------------------------------------- Internal Functions
 //
 
+VOID
+CkpCollectGarbage (
+    PCK_VM Vm,
+    BOOL Full
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs garbage collection on the given Chalk instance. A
+    minor collection only examines objects created since the last collection,
+    treating the remembered set as additional roots. Every object that
+    survives a collection of either kind becomes old.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Full - Supplies a boolean indicating whether to examine the entire heap
+        (TRUE) or just the young generation (FALSE).
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Index;
+    CK_OBJECT KissHead;
+    UINTN OldBytes;
+    ULONGLONG Pause;
+    PCK_GC_STATISTICS Statistics;
+    ULONGLONG Start;
+
+    Start = CkpGetProcessorTime();
+    if ((Vm->Configuration.YoungHeapSize == 0) ||
+        (Vm->RememberedOverflow != FALSE)) {
+
+        Full = TRUE;
+    }
+
+    Statistics = &(Vm->GarbageStatistics);
+    Vm->GarbageRuns += 1;
+    Vm->GarbageFreed = 0;
+
+    //
+    // Reset the number of bytes allocated, and have the kiss functions count
+    // their allocations. This avoids the extra work of having to determine
+    // the size of objects being freed. The tradeoff is that the bytes
+    // allocated won't count non-object allocations, so it will be a bit low.
+    // A minor collection only counts the young survivors, and adds them to
+    // the estimate of the old generation.
+    //
+
+    OldBytes = 0;
+    if (Full != FALSE) {
+        Statistics->FullCollections += 1;
+        CkpForgetRememberedObjects(Vm, TRUE);
+
+    } else {
+        Statistics->MinorCollections += 1;
+        if (Vm->BytesAllocated > Vm->YoungBytes) {
+            OldBytes = Vm->BytesAllocated - Vm->YoungBytes;
+        }
+    }
+
+    Vm->BytesAllocated = 0;
+    Vm->MinorCollection = !Full;
+
+    //
+    // Set up the head of the kiss list. Make it a circle so that the last
+    // object added does not have a non-null pointer.
+    //
+
+    KissHead.Type = CkObjectInvalid;
+    KissHead.Flags = 0;
+    KissHead.Next = NULL;
+    KissHead.NextKiss = &KissHead;
+    Vm->KissList = &KissHead;
+    CkpKissRoot(Vm, &(Vm->Modules->Header));
+    CkpKissRoot(Vm, &(Vm->ModulePath->Header));
+    for (Index = 0; Index < Vm->WorkingObjectCount; Index += 1) {
+        CkpKissRoot(Vm, Vm->WorkingObjects[Index]);
+    }
+
+    CkpKissRoot(Vm, &(Vm->Fiber->Header));
+    if (Vm->Compiler != NULL) {
+        CkpKissCompiler(Vm, Vm->Compiler);
+    }
+
+    CkpKissRoot(Vm, &(Vm->UnhandledException->Header));
+    if (Full == FALSE) {
+        for (Index = 0; Index < Vm->RememberedCount; Index += 1) {
+            CkpKissRoot(Vm, Vm->Remembered[Index]);
+        }
+    }
+
+    CkpDeeplyKiss(Vm, &KissHead);
+    if (Full == FALSE) {
+        CkpUnkissOldObjects(Vm, &KissHead);
+        CkpForgetRememberedObjects(Vm, FALSE);
+    }
+
+    CkpCollectUnkissedObjects(Vm);
+    Vm->MinorCollection = FALSE;
+    Vm->BytesAllocated += OldBytes;
+    Vm->YoungBytes = 0;
+
+    //
+    // After a full collection, determine the next full garbage collection
+    // time, expressed as an additional percentage growth. Except rather than
+    // using percent 100 exactly, use 1024 to avoid the divide. It looks nearly
+    // the same as percent times 10.
+    //
+
+    if (Full != FALSE) {
+        Vm->NextGarbageCollection =
+                         Vm->BytesAllocated *
+                         (1024 + Vm->Configuration.HeapGrowthPercent) / 1024;
+
+        if (Vm->NextGarbageCollection < Vm->Configuration.MinimumHeapSize) {
+            Vm->NextGarbageCollection = Vm->Configuration.MinimumHeapSize;
+        }
+    }
+
+    Pause = CkpGetProcessorTime();
+    if (Pause >= Start) {
+        Pause -= Start;
+
+    } else {
+        Pause = 0;
+    }
+
+    Statistics->LastPause = Pause;
+    Statistics->TotalPause += Pause;
+    if (Pause > Statistics->MaxPause) {
+        Statistics->MaxPause = Pause;
+    }
+
+    return;
+}
+
+VOID
+CkpForgetRememberedObjects (
+    PCK_VM Vm,
+    BOOL All
+    )
+
+/*++
+
+Routine Description:
+
+    This routine empties the remembered set, called once a collection no
+    longer needs it. Every young object has been promoted by then, so there
+    are no more old objects pointing at young ones.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    All - Supplies a boolean indicating whether to remove every object
+        (TRUE), or keep the types that are always remembered (FALSE).
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Count;
+    UINTN Index;
+    PCK_OBJECT Object;
+
+    Count = 0;
+    for (Index = 0; Index < Vm->RememberedCount; Index += 1) {
+        Object = Vm->Remembered[Index];
+        if ((All == FALSE) && (CK_ALWAYS_REMEMBERED(Object->Type))) {
+            Vm->Remembered[Count] = Object;
+            Count += 1;
+
+        } else {
+            Object->Flags &= ~CK_OBJECT_REMEMBERED;
+        }
+    }
+
+    Vm->RememberedCount = Count;
+    if (All != FALSE) {
+        Vm->RememberedOverflow = FALSE;
+    }
+
+    return;
+}
+
 VOID
 CkpKissCompiler (
     PCK_VM Vm,
@@ -423,7 +695,7 @@ Return Value:
     //
 
     if (Compiler->Parser != NULL) {
-        CkpKissObject(Vm, &(Compiler->Parser->Module->Header));
+        CkpKissRoot(Vm, &(Compiler->Parser->Module->Header));
     }
 
     //
@@ -431,10 +703,10 @@ Return Value:
     //
 
     while (Compiler != NULL) {
-        CkpKissObject(Vm, &(Compiler->Function->Header));
+        CkpKissRoot(Vm, &(Compiler->Function->Header));
         if (Compiler->EnclosingClass != NULL) {
             CkpKissValueArray(Vm, &(Compiler->EnclosingClass->Fields.List));
-            CkpKissObject(Vm, &(Compiler->EnclosingClass->Fields.Dict->Header));
+            CkpKissRoot(Vm, &(Compiler->EnclosingClass->Fields.Dict->Header));
         }
 
         //
@@ -453,6 +725,46 @@ Return Value:
     return;
 }
 
+VOID
+CkpKissRoot (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    )
+
+/*++
+
+Routine Description:
+
+    This routine kisses a root object. Unlike regular kisses, roots are
+    scanned even by minor collections when they are old, since nothing else
+    tracks what they point to.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Object - Supplies a pointer to the object to kiss.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PCK_OBJECT End;
+
+    if ((Object != NULL) && (Object->NextKiss == NULL)) {
+        End = Vm->KissList;
+        Object->NextKiss = End->NextKiss;
+        End->NextKiss = Object;
+        Vm->KissList = Object;
+    }
+
+    return;
+}
+
 VOID
 CkpKissValue (
     PCK_VM Vm,
@@ -518,6 +830,17 @@ Return Value:
 
     if ((Object != NULL) && (Object->NextKiss == NULL)) {
 
+        //
+        // Minor collections leave old objects alone. Any young objects they
+        // point to are found through the remembered set.
+        //
+
+        if ((Vm->MinorCollection != FALSE) &&
+            ((Object->Flags & CK_OBJECT_OLD) != 0)) {
+
+            return;
+        }
+
         //
         // Wire the object in after the end of the list, and make it the new
         // end.
@@ -560,6 +883,7 @@ Return Value:
 
 {
 
+    UINTN BytesAllocated;
     PCK_OBJECT Object;
 
     //
@@ -569,6 +893,7 @@ Return Value:
 
     Object = Head->NextKiss;
     while (Object != Head) {
+        BytesAllocated = Vm->BytesAllocated;
         switch (Object->Type) {
         case CkObjectClass:
             CkpKissClass(Vm, (PCK_CLASS)Object);
@@ -625,12 +950,67 @@ Return Value:
             break;
         }
 
+        //
+        // Old roots scanned by a minor collection are already accounted for
+        // in the old generation's size.
+        //
+
+        if ((Vm->MinorCollection != FALSE) &&
+            ((Object->Flags & CK_OBJECT_OLD) != 0)) {
+
+            Vm->BytesAllocated = BytesAllocated;
+        }
+
         Object = Object->NextKiss;
     }
 
     return;
 }
 
+VOID
+CkpUnkissOldObjects (
+    PCK_VM Vm,
+    PCK_OBJECT Head
+    )
+
+/*++
+
+Routine Description:
+
+    This routine resets the kiss state of the old objects a minor collection
+    scanned as roots. The sweep only resets the young objects it traverses.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Head - Supplies a pointer to a dummy object representing the head of the
+        kiss list.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PCK_OBJECT Next;
+    PCK_OBJECT Object;
+
+    Object = Head->NextKiss;
+    while (Object != Head) {
+        Next = Object->NextKiss;
+        if ((Object->Flags & CK_OBJECT_OLD) != 0) {
+            Object->NextKiss = NULL;
+        }
+
+        Object = Next;
+    }
+
+    return;
+}
+
 VOID
 CkpCollectUnkissedObjects (
     PCK_VM Vm
@@ -640,7 +1020,9 @@ CkpCollectUnkissedObjects (
 
 Routine Description:
 
-    This routine garbage collects any objects that have not been kissed.
+    This routine garbage collects any objects that have not been kissed. Full
+    collections sweep both generations, minor collections only sweep the
+    young one. Young survivors are promoted to the old generation.
 
 Arguments:
 
@@ -656,11 +1038,49 @@ Return Value:
 
     PCK_OBJECT DeadAndAlone;
     ULONG DestroyCount;
+    PCK_OBJECT Next;
     PCK_OBJECT *Object;
+    ULONG PromotedCount;
+    PCK_OBJECT Young;
 
     DestroyCount = 0;
-    Object = &(Vm->FirstObject);
-    while (*Object != NULL) {
+    if (Vm->MinorCollection == FALSE) {
+        Object = &(Vm->OldObjects);
+        while (*Object != NULL) {
+
+            CK_ASSERT(((*Object)->Flags & CK_OBJECT_REMEMBERED) == 0);
+
+            //
+            // If the object has been kissed, then reset it for next time.
+            //
+
+            if ((*Object)->NextKiss != NULL) {
+                (*Object)->NextKiss = NULL;
+                if (CK_ALWAYS_REMEMBERED((*Object)->Type)) {
+                    CkpRememberObject(Vm, *Object);
+                }
+
+                Object = &((*Object)->Next);
+
+            //
+            // The object was never kissed. No one loves it, and it serves no
+            // purpose.
+            //
+
+            } else {
+                DeadAndAlone = *Object;
+                *Object = DeadAndAlone->Next;
+                CkpDestroyObject(Vm, DeadAndAlone);
+                DestroyCount += 1;
+            }
+        }
+    }
+
+    PromotedCount = 0;
+    Young = Vm->FirstObject;
+    Vm->FirstObject = NULL;
+    while (Young != NULL) {
+        Next = Young->Next;
 
         //
         // Take this opportunity to ensure that all objects have classes.
@@ -668,33 +1088,38 @@ Return Value:
         // early init.
         //
 
-        CK_ASSERT(((*Object)->Class != NULL) ||
-                  ((*Object)->Type == CkObjectFunction) ||
+        CK_ASSERT((Young->Class != NULL) ||
+                  (Young->Type == CkObjectFunction) ||
                   (Vm->Class.Class == NULL) ||
                   (Vm->Class.Class->Flags == 0));
 
+        CK_ASSERT((Young->Flags & CK_OBJECT_OLD) == 0);
+
         //
-        // If the object has been kissed, then reset it for next time.
+        // Kissed young objects are promoted to the old generation.
         //
 
-        if ((*Object)->NextKiss != NULL) {
-            (*Object)->NextKiss = NULL;
-            Object = &((*Object)->Next);
+        if (Young->NextKiss != NULL) {
+            Young->NextKiss = NULL;
+            Young->Flags |= CK_OBJECT_OLD;
+            Young->Next = Vm->OldObjects;
+            Vm->OldObjects = Young;
+            if (CK_ALWAYS_REMEMBERED(Young->Type)) {
+                CkpRememberObject(Vm, Young);
+            }
 
-        //
-        // The object was never kissed. No one loves it, and it serves no
-        // purpose.
-        //
+            PromotedCount += 1;
 
         } else {
-            DeadAndAlone = *Object;
-            *Object = DeadAndAlone->Next;
-            CkpDestroyObject(Vm, DeadAndAlone);
+            CkpDestroyObject(Vm, Young);
             DestroyCount += 1;
         }
+
+        Young = Next;
     }
 
     Vm->GarbageFreed = DestroyCount;
+    Vm->GarbageStatistics.Promoted = PromotedCount;
     if ((CK_VM_FLAG_SET(Vm, CK_CONFIGURATION_GC_STRESS)) &&
         (DestroyCount != 0)) {
 
@@ -1093,7 +1518,7 @@ Return Value:
     CkpKissObject(Vm, &(Module->Name->Header));
     CkpKissObject(Vm, &(Module->Path->Header));
     CkpKissObject(Vm, &(Module->Closure->Header));
-    Vm->BytesAllocated = sizeof(CK_MODULE);
+    Vm->BytesAllocated += sizeof(CK_MODULE);
     return;
 }
 
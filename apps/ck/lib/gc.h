@@ -26,6 +26,24 @@ Module Name:
 // ------------------------------------------------------------------- Includes
 //
 
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro must be invoked after a reference is stored into a list, dict,
+// instance, closure, or upvalue. If the object is old, it is remembered so
+// that the next minor collection finds any young objects it now points to.
+// There must be no allocations between the store and the barrier.
+//
+
+#define CK_WRITE_BARRIER(_Vm, _Object)                                      \
+    if (((_Object)->Flags & (CK_OBJECT_OLD | CK_OBJECT_REMEMBERED)) ==      \
+        CK_OBJECT_OLD) {                                                    \
+                                                                            \
+        CkpRememberObject((_Vm), (_Object));                                \
+    }
+
 //
 // ---------------------------------------------------------------- Definitions
 //
@@ -34,6 +52,43 @@ Module Name:
 // ------------------------------------------------------ Data Type Definitions
 //
 
+/*++
+
+Structure Description:
+
+    This structure contains statistics about the garbage collector.
+
+Members:
+
+    MinorCollections - Stores the number of collections that examined only
+        the young generation.
+
+    FullCollections - Stores the number of collections that examined the
+        entire heap.
+
+    Promoted - Stores the number of objects promoted to the old generation by
+        the most recent collection.
+
+    LastPause - Stores the duration of the most recent collection, in
+        microseconds.
+
+    MaxPause - Stores the duration of the longest collection, in
+        microseconds.
+
+    TotalPause - Stores the total time spent collecting garbage, in
+        microseconds.
+
+--*/
+
+typedef struct _CK_GC_STATISTICS {
+    ULONG MinorCollections;
+    ULONG FullCollections;
+    ULONG Promoted;
+    ULONGLONG LastPause;
+    ULONGLONG MaxPause;
+    ULONGLONG TotalPause;
+} CK_GC_STATISTICS, *PCK_GC_STATISTICS;
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -89,6 +144,33 @@ Return Value:
 
 --*/
 
+VOID
+CkpRememberObject (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    );
+
+/*++
+
+Routine Description:
+
+    This routine adds an old object to the remembered set, causing it to be
+    scanned by each minor collection until the next one completes. Callers
+    usually get here through the write barrier.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Object - Supplies a pointer to the old object that may now point at young
+        objects.
+
+Return Value:
+
+    None.
+
+--*/
+
 PVOID
 CkpReallocate (
     PCK_VM Vm,
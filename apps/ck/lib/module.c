@@ -421,6 +421,14 @@ Return Value:
             goto ModuleLoadSourceEnd;
         }
 
+        //
+        // Remember what source this came from so that a frozen copy of the
+        // module can be checked against the source later.
+        //
+
+        Module->SourceSize = Length;
+        Module->SourceHash = CkpModuleHashSource(Source, Length);
+
         CkpPushRoot(Vm, &(Function->Header));
         Closure = CkpClosureCreate(Vm, Function, NULL);
         CkpPopRoot(Vm);
@@ -1022,6 +1022,7 @@ Return Value:
     CK_VALUE Value;
 
     FakeStringObject->Header.Type = CkObjectString;
+    FakeStringObject->Header.Flags = 0;
     FakeStringObject->Header.Next = NULL;
     FakeStringObject->Header.Class = NULL;
     FakeStringObject->Length = Length;
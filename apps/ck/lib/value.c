@@ -319,6 +319,11 @@ Return Value:
         CkpClearArray(Vm, &(Function->Constants));
         CkpClearArray(Vm, &(Function->Code));
         CkpClearArray(Vm, &(Function->Debug.LineProgram));
+        if (Function->CallCaches != NULL) {
+            CkFree(Vm, Function->CallCaches);
+            Function->CallCaches = NULL;
+        }
+
         break;
 
     case CkObjectForeign:
@@ -346,7 +351,15 @@ Return Value:
         CkpModuleDestroy(Vm, (PCK_MODULE)Object);
         break;
 
+    //
+    // A new class could be allocated at the same address, so make sure no
+    // inline method cache still refers to this one.
+    //
+
     case CkObjectClass:
+        Vm->MethodCacheEpoch += 1;
+        break;
+
     case CkObjectClosure:
     case CkObjectInstance:
     case CkObjectRange:
@@ -398,6 +411,7 @@ Return Value:
 {
 
     Object->Type = Type;
+    Object->Flags = 0;
     Object->NextKiss = NULL;
     Object->Class = Class;
     Object->Next = Vm->FirstObject;
@@ -722,6 +736,7 @@ Return Value:
 
     CK_OBJECT_VALUE(Value, Closure);
     CkpDictSet(Vm, Class->Methods, Signature, Value);
+    Vm->MethodCacheEpoch += 1;
 
     //
     // Bind the closure to the class, so that when it's run it knows 1) where
@@ -769,6 +784,7 @@ Return Value:
     //
 
     CkpDictCombine(Vm, Class->Methods, Super->Methods);
+    Vm->MethodCacheEpoch += 1;
     return;
 }
 
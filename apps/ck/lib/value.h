@@ -113,6 +113,29 @@ Module Name:
 #define CK_CLASS_SPECIAL_CREATION 0x00000002
 #define CK_CLASS_FOREIGN 0x00000004
 
+//
+// Define the garbage collector flags stored in each object header. Old
+// objects have survived a collection and are only examined by full
+// collections. Remembered objects are old objects that may point at young
+// objects, and are scanned by every minor collection.
+//
+
+#define CK_OBJECT_OLD 0x00000001
+#define CK_OBJECT_REMEMBERED 0x00000002
+
+//
+// Define the number of receiver classes a single call site remembers before
+// it gives up and goes back to looking up the method every time.
+//
+
+#define CK_CALL_CACHE_SIZE 4
+
+//
+// Define the call cache index emitted for call sites that do not get a cache.
+//
+
+#define CK_CALL_CACHE_NONE MAX_USHORT
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -273,11 +296,14 @@ Structure Description:
     Type - Stores the type of the object, which defines the parent type this
         structure is embedded in.
 
+    Flags - Stores a bitfield of garbage collector flags. See CK_OBJECT_*
+        definitions.
+
     NextKiss - Stores a pointer to the next object in the list of kissed
         objects (objects that will not get garbage collected this time).
 
-    Next - Stores a pointer to the next object in the global list of all
-        objects.
+    Next - Stores a pointer to the next object in the list of young or old
+        objects, depending on which generation the object is in.
 
     Class - Stores a pointer to the class this object belongs to.
 
@@ -285,6 +311,7 @@ Structure Description:
 
 struct _CK_OBJECT {
     CK_OBJECT_TYPE Type;
+    ULONG Flags;
     PCK_OBJECT NextKiss;
     PCK_OBJECT Next;
     PCK_CLASS Class;
@@ -462,6 +489,50 @@ typedef struct _CK_FUNCTION_DEBUG {
 
 /*++
 
+Structure Description:
+
+    This structure defines a single remembered method lookup at a call site.
+
+Members:
+
+    Class - Stores a pointer to the receiver class the lookup was done on.
+
+    Closure - Stores a pointer to the method the class resolved to.
+
+--*/
+
+typedef struct _CK_CALL_CACHE_ENTRY {
+    PCK_CLASS Class;
+    struct _CK_CLOSURE *Closure;
+} CK_CALL_CACHE_ENTRY, *PCK_CALL_CACHE_ENTRY;
+
+/*++
+
+Structure Description:
+
+    This structure defines the inline method cache for one call site.
+
+Members:
+
+    Epoch - Stores the VM method cache epoch the entries were filled in
+        during. If this does not match the VM's current epoch, the entries are
+        stale.
+
+    Count - Stores the number of valid entries.
+
+    Entries - Stores the receiver classes seen at this call site and the
+        methods they resolved to.
+
+--*/
+
+typedef struct _CK_CALL_CACHE {
+    ULONG Epoch;
+    ULONG Count;
+    CK_CALL_CACHE_ENTRY Entries[CK_CALL_CACHE_SIZE];
+} CK_CALL_CACHE, *PCK_CALL_CACHE;
+
+/*++
+
 Structure Description:
 
     This structure defines a function object.
@@ -485,6 +556,13 @@ Structure Description:
     Debug - Stores a pointer to the debug information, which translates
         bytecode back to line numbers.
 
+    CallCacheCount - Stores the number of call sites in the bytecode that
+        have an inline method cache.
+
+    CallCaches - Stores an optional pointer to the array of inline method
+        caches, one per call site. This is allocated the first time one of
+        the function's call sites runs.
+
 --*/
 
 typedef struct _CK_FUNCTION {
@@ -496,6 +574,8 @@ typedef struct _CK_FUNCTION {
     CK_SYMBOL_INDEX UpvalueCount;
     CK_ARITY Arity;
     CK_FUNCTION_DEBUG Debug;
+    CK_SYMBOL_INDEX CallCacheCount;
+    PCK_CALL_CACHE CallCaches;
 } CK_FUNCTION, *PCK_FUNCTION;
 
 /*++
@@ -644,6 +724,11 @@ Structure Description:
     CompiledVariableCount - Stores the number of module level variables at the
         time the module was compiled.
 
+    SourceSize - Stores the size of the source the module was compiled from,
+        which is saved with the frozen module.
+
+    SourceHash - Stores the hash of the source the module was compiled from.
+
 --*/
 
 struct _CK_MODULE {
@@ -657,6 +742,8 @@ struct _CK_MODULE {
     PCK_CLOSURE Closure;
     BOOL Run;
     UINTN CompiledVariableCount;
+    UINTN SourceSize;
+    ULONG SourceHash;
 };
 
 /*++
@@ -66,6 +66,7 @@ Module Name:
 #define CKI_READ_ARITY(_Value) CKI_READ_BYTE(_Value)
 #define CKI_READ_SYMBOL(_Value) CKI_READ_SHORT(_Value)
 #define CKI_READ_OFFSET(_Value) CKI_READ_SHORT(_Value)
+#define CKI_READ_CACHE(_Value) CKI_READ_SHORT(_Value)
 
 //
 // These macros sync up the pieces of the VM state that are kept in local
@@ -295,6 +296,7 @@ CkpCaptureUpvalue (
 
 VOID
 CkpCloseUpvalues (
+    PCK_VM Vm,
     PCK_FIBER Fiber,
     PCK_VALUE Last
     );
@@ -400,6 +402,7 @@ Return Value:
     }
 
     Vm->NextGarbageCollection = Vm->Configuration.InitialHeapSize;
+    Vm->MethodCacheEpoch = 1;
     Vm->Modules = CkpDictCreate(Vm);
     if (Vm->Modules == NULL) {
         Status = CkErrorNoMemory;
@@ -466,6 +469,18 @@ Return Value:
     }
 
     Vm->FirstObject = NULL;
+    Object = Vm->OldObjects;
+    while (Object != NULL) {
+        Next = Object->Next;
+        CkpDestroyObject(Vm, Object);
+        Object = Next;
+    }
+
+    Vm->OldObjects = NULL;
+    if (Vm->Remembered != NULL) {
+        CkRawFree(Vm, Vm->Remembered);
+        Vm->Remembered = NULL;
+    }
 
     //
     // Null out the reallocate function to catch double frees.
@@ -857,6 +872,7 @@ Return Value:
 
     PCK_VALUE Arguments;
     CK_ARITY Arity;
+    ULONG CacheIndex;
     PCK_CLASS Class;
     PCK_CLOSURE Closure;
     UCHAR Field;
@@ -976,6 +992,7 @@ Return Value:
 
         Upvalue = Frame->Closure->Upvalues[Local];
         *(Upvalue->Value) = CKI_STACK_TOP();
+        CK_WRITE_BARRIER(Vm, &(Upvalue->Header));
         CKI_DISPATCH();
 
     CKI_CASE(CkOpLoadModuleVariable):
@@ -1020,6 +1037,7 @@ Return Value:
         CK_ASSERT(Symbol < Instance->Header.Class->FieldCount);
 
         Instance->Fields[Symbol] = CKI_STACK_TOP();
+        CK_WRITE_BARRIER(Vm, &(Instance->Header));
         CKI_DISPATCH();
 
     CKI_CASE(CkOpLoadField):
@@ -1048,6 +1066,7 @@ Return Value:
         CK_ASSERT(Symbol < Instance->Header.Class->FieldCount);
 
         Instance->Fields[Symbol] = CKI_STACK_TOP();
+        CK_WRITE_BARRIER(Vm, &(Instance->Header));
         CKI_DISPATCH();
 
     CKI_CASE(CkOpPop):
@@ -1065,11 +1084,11 @@ Return Value:
     CKI_CASE(CkOpCall8):
         Arity = Instruction - CkOpCall0 + 1;
         CKI_READ_SYMBOL(Symbol);
+        CKI_READ_CACHE(CacheIndex);
         Arguments = Fiber->StackTop - Arity;
         Class = CkpGetClass(Vm, Arguments[0]);
-        MethodName = Function->Module->Strings.List.Data[Symbol];
         CKI_STORE_FRAME();
-        CkpCallMethod(Vm, Class, MethodName, Arity);
+        CkpCallCachedMethod(Vm, Function, Class, Symbol, CacheIndex, Arity);
         CKI_LOAD_FIBER();
         CKI_DISPATCH();
 
@@ -1077,11 +1096,11 @@ Return Value:
         CKI_READ_ARITY(Arity);
         Arity += 1;
         CKI_READ_SYMBOL(Symbol);
+        CKI_READ_CACHE(CacheIndex);
         Arguments = Fiber->StackTop - Arity;
         Class = CkpGetClass(Vm, Arguments[0]);
-        MethodName = Function->Module->Strings.List.Data[Symbol];
         CKI_STORE_FRAME();
-        CkpCallMethod(Vm, Class, MethodName, Arity);
+        CkpCallCachedMethod(Vm, Function, Class, Symbol, CacheIndex, Arity);
         CKI_LOAD_FIBER();
         CKI_DISPATCH();
 
@@ -1096,11 +1115,11 @@ Return Value:
     CKI_CASE(CkOpSuperCall8):
         Arity = Instruction - CkOpSuperCall0 + 1;
         CKI_READ_SYMBOL(Symbol);
+        CKI_READ_CACHE(CacheIndex);
         Arguments = Fiber->StackTop - Arity;
         Class = Frame->Closure->Class->Super;
-        MethodName = Function->Module->Strings.List.Data[Symbol];
         CKI_STORE_FRAME();
-        CkpCallMethod(Vm, Class, MethodName, Arity);
+        CkpCallCachedMethod(Vm, Function, Class, Symbol, CacheIndex, Arity);
         CKI_LOAD_FIBER();
         CKI_DISPATCH();
 
@@ -1108,11 +1127,11 @@ Return Value:
         CKI_READ_ARITY(Arity);
         Arity += 1;
         CKI_READ_SYMBOL(Symbol);
+        CKI_READ_CACHE(CacheIndex);
         Arguments = Fiber->StackTop - Arity;
         Class = Frame->Closure->Class->Super;
-        MethodName = Function->Module->Strings.List.Data[Symbol];
         CKI_STORE_FRAME();
-        CkpCallMethod(Vm, Class, MethodName, Arity);
+        CkpCallCachedMethod(Vm, Function, Class, Symbol, CacheIndex, Arity);
         CKI_LOAD_FIBER();
         CKI_DISPATCH();
 
@@ -1191,7 +1210,7 @@ Return Value:
         CKI_DISPATCH();
 
     CKI_CASE(CkOpCloseUpvalue):
-        CkpCloseUpvalues(Fiber, Fiber->StackTop - 1);
+        CkpCloseUpvalues(Vm, Fiber, Fiber->StackTop - 1);
         CKI_DISPATCH();
 
     CKI_CASE(CkOpReturn):
@@ -1202,7 +1221,7 @@ Return Value:
 
         Fiber->FrameCount -= 1;
         Fiber->TryCount = Frame->TryCount;
-        CkpCloseUpvalues(Fiber, Stack);
+        CkpCloseUpvalues(Vm, Fiber, Stack);
 
         //
         // Handle the fiber completing. Either return the value to the C caller,
@@ -1298,6 +1317,8 @@ Return Value:
             } else {
                 Closure->Upvalues[Index] = Frame->Closure->Upvalues[Local];
             }
+
+            CK_WRITE_BARRIER(Vm, &(Closure->Header));
         }
 
         Function = Frame->Closure->U.Block.Function;
@@ -1613,6 +1634,135 @@ Return Value:
     return CkpCallFunction(Vm, Closure, Arity);
 }
 
+BOOL
+CkpCallCachedMethod (
+    PCK_VM Vm,
+    PCK_FUNCTION Function,
+    PCK_CLASS Class,
+    CK_SYMBOL_INDEX Symbol,
+    ULONG CacheIndex,
+    CK_ARITY Arity
+    )
+
+/*++
+
+Routine Description:
+
+    This routine invokes a class instance method from a call site in compiled
+    code, using the call site's inline cache to avoid looking up the method
+    when the receiver class has been seen there before.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Function - Supplies a pointer to the function containing the call site.
+
+    Class - Supplies a pointer to the class of the receiver.
+
+    Symbol - Supplies the index of the method name in the module's string
+        table.
+
+    CacheIndex - Supplies the index of the call site's inline cache, or
+        CK_CALL_CACHE_NONE if the call site has none.
+
+    Arity - Supplies the number of arguments the method was called with in
+        code (plus one for the receiver).
+
+Return Value:
+
+    TRUE if a new frame was pushed onto the stack and needs to be run by the
+    interpreter.
+
+    FALSE if the call completed already (primitive and foreign functions fit
+    this category).
+
+--*/
+
+{
+
+    UINTN AllocationSize;
+    PCK_CALL_CACHE Cache;
+    PCK_CLOSURE Closure;
+    ULONG Index;
+    CK_VALUE Method;
+    CK_VALUE MethodName;
+    PCK_STRING NameString;
+
+    Cache = NULL;
+    if (CacheIndex != CK_CALL_CACHE_NONE) {
+
+        CK_ASSERT(CacheIndex < Function->CallCacheCount);
+
+        //
+        // Allocate the caches for the whole function the first time any of
+        // its call sites run. If that fails, just do the slow lookup.
+        //
+
+        if (Function->CallCaches == NULL) {
+            AllocationSize = Function->CallCacheCount * sizeof(CK_CALL_CACHE);
+            Function->CallCaches = CkAllocate(Vm, AllocationSize);
+            if (Function->CallCaches != NULL) {
+                CkZero(Function->CallCaches, AllocationSize);
+            }
+        }
+
+        if (Function->CallCaches != NULL) {
+            Cache = &(Function->CallCaches[CacheIndex]);
+            if (Cache->Epoch != Vm->MethodCacheEpoch) {
+                Cache->Epoch = Vm->MethodCacheEpoch;
+                Cache->Count = 0;
+            }
+
+            for (Index = 0; Index < Cache->Count; Index += 1) {
+                if (Cache->Entries[Index].Class == Class) {
+                    Closure = Cache->Entries[Index].Closure;
+                    return CkpCallFunction(Vm, Closure, Arity);
+                }
+            }
+        }
+    }
+
+    //
+    // Look up the method in the receiver the slow way.
+    //
+
+    MethodName = Function->Module->Strings.List.Data[Symbol];
+
+    CK_ASSERT(CK_IS_STRING(MethodName));
+
+    Method = CkpDictGet(Class->Methods, MethodName);
+    if (CK_IS_UNDEFINED(Method)) {
+        NameString = CK_AS_STRING(MethodName);
+        CkpRuntimeError(Vm,
+                        "LookupError",
+                        "%s does not implement %s",
+                        Class->Name->Value,
+                        NameString->Value);
+
+        return FALSE;
+    }
+
+    Closure = CK_AS_CLOSURE(Method);
+
+    //
+    // Remember the class and method if there is room. Call sites that see
+    // more classes than that are megamorphic, and keep using the dictionary.
+    // Allocating the caches above may have run a garbage collection, but
+    // that can only have advanced the epoch, which is checked again here.
+    //
+
+    if ((Cache != NULL) && (Cache->Epoch == Vm->MethodCacheEpoch) &&
+        (Cache->Count < CK_CALL_CACHE_SIZE)) {
+
+        Cache->Entries[Cache->Count].Class = Class;
+        Cache->Entries[Cache->Count].Closure = Closure;
+        Cache->Count += 1;
+    }
+
+    return CkpCallFunction(Vm, Closure, Arity);
+}
+
 BOOL
 CkpCallFunction (
     PCK_VM Vm,
@@ -1828,6 +1978,7 @@ Return Value:
 
 VOID
 CkpCloseUpvalues (
+    PCK_VM Vm,
     PCK_FIBER Fiber,
     PCK_VALUE Last
     )
@@ -1842,6 +1993,8 @@ Routine Description:
 
 Arguments:
 
+    Vm - Supplies a pointer to the virtual machine.
+
     Fiber - Supplies a pointer to the current fiber.
 
     Last - Supplies the soon-to-be new top of the stack.
@@ -1868,6 +2021,7 @@ Return Value:
         Upvalue = Fiber->OpenUpvalues;
         Upvalue->Closed = *(Upvalue->Value);
         Upvalue->Value = &(Upvalue->Closed);
+        CK_WRITE_BARRIER(Vm, &(Upvalue->Header));
         Fiber->OpenUpvalues = Upvalue->Next;
     }
 
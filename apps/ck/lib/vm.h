@@ -150,7 +150,9 @@ Enumeration Description:
     CkOpCall0 - Invokes the method with the symbol specified by the next
         instruction word. The opcode number describes the number of arguments
         that have already been pushed (not including the receiver). Subsequent
-        opcodes code for 1-7 arguments, respectively.
+        opcodes code for 1-7 arguments, respectively. The word after the
+        symbol is the index of the call site's inline method cache. This is
+        true of all the direct and super call opcodes.
 
     CkOpCall8 - Invokes the method with the symbol specified by the next
         instruction word, with 8 arguments.
@@ -381,21 +383,47 @@ Structure Description:
         memory that has been freed since the last garbage collection.
 
     NextGarbageCollection - Stores the size that the allocated bytes have to
-        get to in order to trigger the next garbage collection.
+        get to in order to trigger the next full garbage collection.
+
+    YoungBytes - Stores the number of bytes allocated since the last garbage
+        collection. When this reaches the young heap size, a minor collection
+        is triggered.
 
     GarbageRuns - Stores the number of times the garbage collector has run.
 
     GarbageFreed - Stores the number of objects freed during the most recent
         garbage collection run.
 
-    FirstObject - Stores a pointer to the first object in the massive singly
-        linked list of all living objects. This is the list that the garbage
-        collector traverses.
+    FirstObject - Stores a pointer to the first object in the singly linked
+        list of young objects, those created since the last garbage
+        collection. This is the list that minor collections traverse.
+
+    OldObjects - Stores a pointer to the first object in the singly linked
+        list of objects that have survived a garbage collection. Only full
+        collections traverse this list.
 
     KissList - Stores the tail of the list of objects that have been kissed.
         The list is circular to ensure that the last object has a non-null
         next pointer.
 
+    Remembered - Stores the array of old objects that minor collections treat
+        as roots, either because they were written to since the last
+        collection or because they are too frequently mutated to bother.
+
+    RememberedCount - Stores the number of valid elements in the remembered
+        array.
+
+    RememberedCapacity - Stores the number of elements the remembered array
+        can hold before it needs to be reallocated.
+
+    RememberedOverflow - Stores a boolean indicating that the remembered array
+        could not be expanded, so the next collection must be a full one.
+
+    MinorCollection - Stores a boolean indicating whether the garbage
+        collection in progress is only examining the young generation.
+
+    GarbageStatistics - Stores the garbage collector statistics.
+
     WorkingObjects - Stores a fixed stack of objects that should not be
         garbage collected but who are not necessarily linked anywhere else.
 
@@ -422,6 +450,10 @@ Structure Description:
     Context - Stores an opaque user context pointer that can be used by whoever
         is integrating the Chalk library.
 
+    MethodCacheEpoch - Stores the current generation of the inline method
+        caches. This is incremented whenever a class's method table changes
+        or a class is freed, which invalidates every cache at once.
+
 --*/
 
 struct _CK_VM {
@@ -430,10 +462,18 @@ struct _CK_VM {
     PCK_DICT Modules;
     UINTN BytesAllocated;
     UINTN NextGarbageCollection;
+    UINTN YoungBytes;
     ULONG GarbageRuns;
     ULONG GarbageFreed;
     PCK_OBJECT FirstObject;
+    PCK_OBJECT OldObjects;
     PCK_OBJECT KissList;
+    PCK_OBJECT *Remembered;
+    UINTN RememberedCount;
+    UINTN RememberedCapacity;
+    BOOL RememberedOverflow;
+    BOOL MinorCollection;
+    CK_GC_STATISTICS GarbageStatistics;
     PCK_OBJECT WorkingObjects[CK_MAX_WORKING_OBJECTS];
     ULONG WorkingObjectCount;
     PCK_COMPILER Compiler;
@@ -443,6 +483,7 @@ struct _CK_VM {
     INT MemoryException;
     PCK_CLOSURE UnhandledException;
     PVOID Context;
+    ULONG MethodCacheEpoch;
 };
 
 //
@@ -724,6 +765,51 @@ Return Value:
 
 --*/
 
+BOOL
+CkpCallCachedMethod (
+    PCK_VM Vm,
+    PCK_FUNCTION Function,
+    PCK_CLASS Class,
+    CK_SYMBOL_INDEX Symbol,
+    ULONG CacheIndex,
+    CK_ARITY Arity
+    );
+
+/*++
+
+Routine Description:
+
+    This routine invokes a class instance method from a call site in compiled
+    code, using the call site's inline cache to avoid looking up the method
+    when the receiver class has been seen there before.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Function - Supplies a pointer to the function containing the call site.
+
+    Class - Supplies a pointer to the class of the receiver.
+
+    Symbol - Supplies the index of the method name in the module's string
+        table.
+
+    CacheIndex - Supplies the index of the call site's inline cache, or
+        CK_CALL_CACHE_NONE if the call site has none.
+
+    Arity - Supplies the number of arguments the method was called with in
+        code (plus one for the receiver).
+
+Return Value:
+
+    TRUE if a new frame was pushed onto the stack and needs to be run by the
+    interpreter.
+
+    FALSE if the call completed already (primitive and foreign functions fit
+    this category).
+
+--*/
+
 BOOL
 CkpCallFunction (
     PCK_VM Vm,
@@ -1039,3 +1125,64 @@ Return Value:
 
 --*/
 
+BOOL
+CkpModuleIsFrozenCurrent (
+    PCSTR Contents,
+    UINTN Size,
+    PCSTR Source,
+    UINTN SourceSize
+    );
+
+/*++
+
+Routine Description:
+
+    This routine determines whether or not a frozen module can be used in
+    place of the given source. The frozen module must have been written by
+    this version of the compiler from exactly the same source.
+
+Arguments:
+
+    Contents - Supplies the frozen module contents.
+
+    Size - Supplies the frozen module size in bytes.
+
+    Source - Supplies a pointer to the module source.
+
+    SourceSize - Supplies the size of the source in bytes, not including a
+        null terminator.
+
+Return Value:
+
+    TRUE if the frozen module is current.
+
+    FALSE if the frozen module is stale and the source should be compiled
+    instead.
+
+--*/
+
+ULONG
+CkpModuleHashSource (
+    PCSTR Source,
+    UINTN Size
+    );
+
+/*++
+
+Routine Description:
+
+    This routine computes the hash of module source that frozen modules use
+    to determine whether or not they are stale.
+
+Arguments:
+
+    Source - Supplies a pointer to the module source.
+
+    Size - Supplies the size of the source in bytes.
+
+Return Value:
+
+    Returns the source hash.
+
+--*/
+
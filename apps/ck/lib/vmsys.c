@@ -36,6 +36,7 @@ Module Name:
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "chalkp.h"
@@ -52,6 +53,7 @@ Module Name:
 #define CK_INITIAL_HEAP_DEFAULT (1024 * 1024 * 10)
 #define CK_MINIMUM_HEAP_DEFAULT (1024 * 1024)
 #define CK_HEAP_GROWTH_DEFAULT 512
+#define CK_YOUNG_HEAP_DEFAULT (1024 * 1024)
 
 //
 // ------------------------------------------------------ Data Type Definitions
@@ -145,7 +147,9 @@ CK_CONFIGURATION CkDefaultConfiguration = {
     CkpDefaultUnhandledException,
     CK_INITIAL_HEAP_DEFAULT,
     CK_MINIMUM_HEAP_DEFAULT,
-    CK_HEAP_GROWTH_DEFAULT
+    CK_HEAP_GROWTH_DEFAULT,
+    0,
+    CK_YOUNG_HEAP_DEFAULT
 };
 
 //
@@ -543,6 +547,42 @@ Return Value:
     return;
 }
 
+ULONGLONG
+CkpGetProcessorTime (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the processor time used by the current process. It is
+    used to time garbage collection pauses.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the processor time used so far, in microseconds.
+
+    0 if the processor time is not available.
+
+--*/
+
+{
+
+    clock_t Clock;
+
+    Clock = clock();
+    if (Clock == (clock_t)-1) {
+        return 0;
+    }
+
+    return (ULONGLONG)Clock * 1000000ULL / CLOCKS_PER_SEC;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -580,20 +620,23 @@ Return Value:
 
 {
 
+    PSTR Dot;
     FILE *File;
-    off_t FileSize;
     CK_LOAD_MODULE_RESULT LoadStatus;
+    CK_MODULE_SOURCE Object;
     CHAR ObjectPath[PATH_MAX];
     INT ObjectPathLength;
     struct stat ObjectStat;
     INT ObjectStatus;
     CHAR Path[PATH_MAX];
     INT PathLength;
+    PSTR Slash;
     INT SourceStatus;
     struct stat Stat;
 
     File = NULL;
     LoadStatus = CkLoadModuleStaticError;
+    CkZero(&Object, sizeof(CK_MODULE_SOURCE));
 
     //
     // Get the full path to the source file.
@@ -626,11 +669,26 @@ Return Value:
     Path[PATH_MAX - 1] = '\0';
 
     //
-    // Get the path to the pre-compiled object.
+    // Get the path to the pre-compiled object. For a direct path, the object
+    // sits next to the source with the extension replaced, which is where the
+    // default save routine puts it. Don't look for an object next to an
+    // object.
     //
 
+    ObjectPathLength = -1;
     if (Directory == NULL) {
-        ObjectPathLength = -1;
+        Dot = strrchr(Path, '.');
+        Slash = strrchr(Path, '/');
+        if ((Dot != NULL) && ((Slash == NULL) || (Dot > Slash)) &&
+            (strcmp(Dot + 1, CK_OBJECT_EXTENSION) != 0)) {
+
+            ObjectPathLength = snprintf(ObjectPath,
+                                        PATH_MAX,
+                                        "%.*s.%s",
+                                        (INT)(Dot - Path),
+                                        Path,
+                                        CK_OBJECT_EXTENSION);
+        }
 
     } else if (*Directory == '\0') {
         ObjectPathLength = snprintf(ObjectPath,
@@ -683,31 +741,42 @@ Return Value:
     }
 
     //
-    // If the object path exists and is either 1) the only thing that exists or
-    // 2) is newer than the source, then try to open the object file.
+    // Try the object first. File modification times are not trusted, since
+    // version control and copies scramble them. If the source is around too,
+    // the object is only used if it was compiled from exactly that source by
+    // this version of the compiler.
     //
 
-    FileSize = Stat.st_size;
-    if ((ObjectStatus == 0) &&
-        ((SourceStatus != 0) || (ObjectStat.st_mtime >= Stat.st_mtime))) {
-
+    if (ObjectStatus == 0) {
         File = fopen(ObjectPath, "rb");
         if (File != NULL) {
-            FileSize = ObjectStat.st_size;
-            PathLength = ObjectPathLength;
+            LoadStatus = CkpReadSource(Vm,
+                                       ObjectPath,
+                                       ObjectPathLength,
+                                       File,
+                                       ObjectStat.st_size,
+                                       ModuleData);
+
+            fclose(File);
+            File = NULL;
+            if ((LoadStatus == CkLoadModuleNoMemory) ||
+                ((LoadStatus == CkLoadModuleSource) && (SourceStatus != 0))) {
+
+                goto LoadSourceFileEnd;
+            }
+
+            if (LoadStatus == CkLoadModuleSource) {
+                Object = ModuleData->Source;
+            }
         }
-
     }
 
-    //
-    // Try to open the source if opening the object file was not an option or
-    // failed.
-    //
-
-    if ((File == NULL) && (SourceStatus == 0)) {
-        File = fopen(Path, "rb");
+    if (SourceStatus != 0) {
+        LoadStatus = CkLoadModuleStaticError;
+        goto LoadSourceFileEnd;
     }
 
+    File = fopen(Path, "rb");
     if (File == NULL) {
         LoadStatus = CkLoadModuleStaticError;
         goto LoadSourceFileEnd;
@@ -717,10 +786,29 @@ Return Value:
                                Path,
                                PathLength,
                                File,
-                               FileSize,
+                               Stat.st_size,
                                ModuleData);
 
+    if ((LoadStatus == CkLoadModuleSource) && (Object.Text != NULL)) {
+        if (CkpModuleIsFrozenCurrent(Object.Text,
+                                     Object.Length,
+                                     ModuleData->Source.Text,
+                                     ModuleData->Source.Length) != FALSE) {
+
+            CkFree(Vm, ModuleData->Source.Text);
+            CkFree(Vm, ModuleData->Source.Path);
+            ModuleData->Source = Object;
+            Object.Text = NULL;
+            Object.Path = NULL;
+        }
+    }
+
 LoadSourceFileEnd:
+    if (Object.Text != NULL) {
+        CkFree(Vm, Object.Text);
+        CkFree(Vm, Object.Path);
+    }
+
     if (LoadStatus == CkLoadModuleStaticError) {
         if ((errno == ENOENT) || (errno == EACCES) || (errno == EPERM)) {
             return CkLoadModuleNotFound;
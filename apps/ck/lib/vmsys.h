@@ -115,3 +115,27 @@ Return Value:
 
 --*/
 
+ULONGLONG
+CkpGetProcessorTime (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the processor time used by the current process. It is
+    used to time garbage collection pauses.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the processor time used so far, in microseconds.
+
+    0 if the processor time is not available.
+
+--*/
+
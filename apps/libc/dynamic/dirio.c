@@ -120,7 +120,8 @@ CHAR ClDirectoryEntryTypeConversions[IoObjectTypeCount] = {
     DT_CHR,
     DT_CHR,
     DT_REG,
-    DT_LNK
+    DT_LNK,
+    DT_UNKNOWN
 };
 
 //
@@ -417,7 +418,7 @@ Return Value:
     // added.
     //
 
-    assert(IoObjectSymbolicLink + 1 == IoObjectTypeCount);
+    assert(IoObjectInterestSet + 1 == IoObjectTypeCount);
 
     Buffer->d_type = ClDirectoryEntryTypeConversions[Entry->Type];
     RtlStringCopy((PSTR)&(Buffer->d_name), (PSTR)(Entry + 1), NAME_MAX);
@@ -39,6 +39,8 @@ Module Name:
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -81,6 +83,14 @@ Module Name:
 
 #define ASPRINT_INITIAL_BUFFER_SIZE 64
 
+//
+// Define the maximum number of ready events collected by a single epoll wait.
+// Returning fewer events than are ready is allowed, and this keeps the
+// translation buffer on the stack.
+//
+
+#define EPOLL_WAIT_BATCH_SIZE 64
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -3077,6 +3087,502 @@ Return Value:
     return (int)DescriptorsSelected;
 }
 
+LIBC_API
+int
+epoll_create (
+    int Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates a new epoll descriptor.
+
+Arguments:
+
+    Size - Supplies a hint of the number of descriptors to be watched. This
+        is ignored, but must be greater than zero.
+
+Return Value:
+
+    Returns the new epoll file descriptor on success.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+{
+
+    if (Size <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return epoll_create1(0);
+}
+
+LIBC_API
+int
+epoll_create1 (
+    int Flags
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates a new epoll descriptor.
+
+Arguments:
+
+    Flags - Supplies a bitfield of flags. The only valid flag is
+        EPOLL_CLOEXEC.
+
+Return Value:
+
+    Returns the new epoll file descriptor on success.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+{
+
+    HANDLE Handle;
+    ULONG OpenFlags;
+    KSTATUS Status;
+
+    if ((Flags & ~EPOLL_CLOEXEC) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    OpenFlags = 0;
+    if ((Flags & EPOLL_CLOEXEC) != 0) {
+        OpenFlags |= SYS_OPEN_FLAG_CLOSE_ON_EXECUTE;
+    }
+
+    Status = OsCreateInterestSet(OpenFlags, &Handle);
+    if (!KSUCCESS(Status)) {
+        errno = ClConvertKstatusToErrorNumber(Status);
+        return -1;
+    }
+
+    return (int)(UINTN)Handle;
+}
+
+LIBC_API
+int
+epoll_ctl (
+    int EpollDescriptor,
+    int Operation,
+    int FileDescriptor,
+    struct epoll_event *Event
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds, modifies, or removes a file descriptor from the set
+    watched by an epoll descriptor.
+
+Arguments:
+
+    EpollDescriptor - Supplies the epoll file descriptor.
+
+    Operation - Supplies the operation to perform. See EPOLL_CTL_*
+        definitions.
+
+    FileDescriptor - Supplies the file descriptor to add, modify, or remove.
+
+    Event - Supplies a pointer to the events and data for the descriptor.
+        This is ignored for EPOLL_CTL_DEL.
+
+Return Value:
+
+    0 on success.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+{
+
+    INTEREST_SET_EVENT InterestEvent;
+    PINTEREST_SET_EVENT InterestEventPointer;
+    INTEREST_SET_OPERATION InterestOperation;
+    KSTATUS Status;
+
+    ASSERT_POLL_FLAGS_EQUIVALENT();
+
+    switch (Operation) {
+    case EPOLL_CTL_ADD:
+        InterestOperation = InterestSetOperationAdd;
+        break;
+
+    case EPOLL_CTL_MOD:
+        InterestOperation = InterestSetOperationModify;
+        break;
+
+    case EPOLL_CTL_DEL:
+        InterestOperation = InterestSetOperationDelete;
+        break;
+
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (EpollDescriptor == FileDescriptor) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    InterestEventPointer = NULL;
+    if (InterestOperation != InterestSetOperationDelete) {
+        if (Event == NULL) {
+            errno = EFAULT;
+            return -1;
+        }
+
+        InterestEvent.Data = Event->data.u64;
+        InterestEvent.Events = Event->events & ~(EPOLLET | EPOLLONESHOT);
+        InterestEvent.Flags = 0;
+        if ((Event->events & EPOLLET) != 0) {
+            InterestEvent.Flags |= INTEREST_SET_FLAG_EDGE_TRIGGERED;
+        }
+
+        if ((Event->events & EPOLLONESHOT) != 0) {
+            InterestEvent.Flags |= INTEREST_SET_FLAG_ONE_SHOT;
+        }
+
+        InterestEventPointer = &InterestEvent;
+    }
+
+    Status = OsControlInterestSet((HANDLE)(UINTN)EpollDescriptor,
+                                  InterestOperation,
+                                  (HANDLE)(UINTN)FileDescriptor,
+                                  InterestEventPointer);
+
+    if (!KSUCCESS(Status)) {
+
+        //
+        // Descriptors that are always ready (like regular files) cannot be
+        // watched.
+        //
+
+        if (Status == STATUS_NOT_SUPPORTED) {
+            errno = EPERM;
+
+        } else if (Status == STATUS_NOT_FOUND) {
+            errno = ENOENT;
+
+        } else {
+            errno = ClConvertKstatusToErrorNumber(Status);
+        }
+
+        return -1;
+    }
+
+    return 0;
+}
+
+LIBC_API
+int
+epoll_wait (
+    int EpollDescriptor,
+    struct epoll_event *Events,
+    int MaxEvents,
+    int Timeout
+    )
+
+/*++
+
+Routine Description:
+
+    This routine waits for one or more descriptors watched by an epoll
+    descriptor to become ready.
+
+Arguments:
+
+    EpollDescriptor - Supplies the epoll file descriptor.
+
+    Events - Supplies a pointer to an array where the ready events will be
+        returned.
+
+    MaxEvents - Supplies the number of elements in the events array. This
+        must be greater than zero.
+
+    Timeout - Supplies the number of milliseconds to wait. Supply 0 to not
+        block at all, and -1 to wait indefinitely.
+
+Return Value:
+
+    Returns the number of ready events returned in the array.
+
+    0 if the timeout expired.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+{
+
+    return epoll_pwait(EpollDescriptor, Events, MaxEvents, Timeout, NULL);
+}
+
+LIBC_API
+int
+epoll_pwait (
+    int EpollDescriptor,
+    struct epoll_event *Events,
+    int MaxEvents,
+    int Timeout,
+    const sigset_t *SignalMask
+    )
+
+/*++
+
+Routine Description:
+
+    This routine waits for one or more descriptors watched by an epoll
+    descriptor to become ready, with the given signal mask applied
+    atomically for the duration of the wait.
+
+Arguments:
+
+    EpollDescriptor - Supplies the epoll file descriptor.
+
+    Events - Supplies a pointer to an array where the ready events will be
+        returned.
+
+    MaxEvents - Supplies the number of elements in the events array. This
+        must be greater than zero.
+
+    Timeout - Supplies the number of milliseconds to wait. Supply 0 to not
+        block at all, and -1 to wait indefinitely.
+
+    SignalMask - Supplies an optional pointer to the signal mask to set for
+        the duration of the wait.
+
+Return Value:
+
+    Returns the number of ready events returned in the array.
+
+    0 if the timeout expired.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+{
+
+    ULONG Count;
+    ULONG EventCount;
+    ULONG Index;
+    INTEREST_SET_EVENT InterestEvents[EPOLL_WAIT_BATCH_SIZE];
+    KSTATUS Status;
+    ULONG TimeoutInMilliseconds;
+
+    if ((Events == NULL) || (MaxEvents <= 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    EventCount = MaxEvents;
+    if (EventCount > EPOLL_WAIT_BATCH_SIZE) {
+        EventCount = EPOLL_WAIT_BATCH_SIZE;
+    }
+
+    if (Timeout < 0) {
+        TimeoutInMilliseconds = SYS_WAIT_TIME_INDEFINITE;
+
+    } else {
+        TimeoutInMilliseconds = Timeout;
+    }
+
+    Status = OsWaitForInterestSet((HANDLE)(UINTN)EpollDescriptor,
+                                  (PSIGNAL_SET)SignalMask,
+                                  InterestEvents,
+                                  EventCount,
+                                  TimeoutInMilliseconds,
+                                  &Count);
+
+    if (!KSUCCESS(Status)) {
+        if (Status == STATUS_TIMEOUT) {
+            return 0;
+        }
+
+        errno = ClConvertKstatusToErrorNumber(Status);
+        return -1;
+    }
+
+    for (Index = 0; Index < Count; Index += 1) {
+        Events[Index].events = InterestEvents[Index].Events;
+        Events[Index].data.u64 = InterestEvents[Index].Data;
+    }
+
+    return (int)Count;
+}
+
+LIBC_API
+ssize_t
+sendfile (
+    int OutputDescriptor,
+    int InputDescriptor,
+    off_t *Offset,
+    size_t Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine copies data from one file descriptor to another without
+    passing it through a user mode buffer. If the input is a regular file, its
+    cached pages are handed directly to the output.
+
+Arguments:
+
+    OutputDescriptor - Supplies the file descriptor to write to. This is
+        typically a socket, but can be any writable descriptor.
+
+    InputDescriptor - Supplies the file descriptor to read from.
+
+    Offset - Supplies an optional pointer to the offset to start reading
+        from. On return, this is updated to the offset following the last
+        byte sent, and the input's file position is not changed. If NULL, the
+        input's file position is used and updated.
+
+    Count - Supplies the number of bytes to transfer.
+
+Return Value:
+
+    Returns the number of bytes written to the output, which may be less than
+    requested.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+{
+
+    return splice(InputDescriptor, Offset, OutputDescriptor, NULL, Count, 0);
+}
+
+LIBC_API
+ssize_t
+splice (
+    int InputDescriptor,
+    off_t *InputOffset,
+    int OutputDescriptor,
+    off_t *OutputOffset,
+    size_t Length,
+    unsigned int Flags
+    )
+
+/*++
+
+Routine Description:
+
+    This routine moves data from one file descriptor to another without
+    passing it through a user mode buffer. It is typically used with a pipe
+    on one side.
+
+Arguments:
+
+    InputDescriptor - Supplies the file descriptor to read from.
+
+    InputOffset - Supplies an optional pointer to the offset to read from,
+        which is advanced by the number of bytes moved. If NULL, the input's
+        file position is used and updated. This is ignored for pipes.
+
+    OutputDescriptor - Supplies the file descriptor to write to.
+
+    OutputOffset - Supplies an optional pointer to the offset to write to,
+        which is advanced by the number of bytes moved. If NULL, the output's
+        file position is used. This is ignored for pipes and sockets.
+
+    Length - Supplies the number of bytes to move.
+
+    Flags - Supplies a bitfield of flags. See SPLICE_F_* definitions.
+
+Return Value:
+
+    Returns the number of bytes moved, which may be less than requested.
+
+    0 if the input is at the end of the file or has no writers.
+
+    -1 on error, and errno will be set to indicate the error.
+
+--*/
+
+{
+
+    UINTN BytesCompleted;
+    IO_OFFSET DestinationOffset;
+    PIO_OFFSET DestinationOffsetPointer;
+    IO_OFFSET SourceOffset;
+    PIO_OFFSET SourceOffsetPointer;
+    KSTATUS Status;
+
+    if (Length > (size_t)SSIZE_MAX) {
+        Length = (size_t)SSIZE_MAX;
+    }
+
+    DestinationOffsetPointer = NULL;
+    if (OutputOffset != NULL) {
+        if (*OutputOffset < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        DestinationOffset = *OutputOffset;
+        DestinationOffsetPointer = &DestinationOffset;
+    }
+
+    SourceOffsetPointer = NULL;
+    if (InputOffset != NULL) {
+        if (*InputOffset < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        SourceOffset = *InputOffset;
+        SourceOffsetPointer = &SourceOffset;
+    }
+
+    Status = OsSendFile((HANDLE)(UINTN)OutputDescriptor,
+                        (HANDLE)(UINTN)InputDescriptor,
+                        DestinationOffsetPointer,
+                        SourceOffsetPointer,
+                        Length,
+                        &BytesCompleted);
+
+    if (!KSUCCESS(Status)) {
+        if (Status == STATUS_TIMEOUT) {
+            errno = EAGAIN;
+
+        } else {
+            errno = ClConvertKstatusToErrorNumber(Status);
+        }
+
+        return -1;
+    }
+
+    if (OutputOffset != NULL) {
+        *OutputOffset = DestinationOffset;
+    }
+
+    if (InputOffset != NULL) {
+        *InputOffset = SourceOffset;
+    }
+
+    return (ssize_t)BytesCompleted;
+}
+
 LIBC_API
 char *
 ttyname (
@@ -79,6 +79,21 @@ Module Name:
 
 #define REGULAR_EXPRESSION_INITIAL_STRING_SIZE 16
 
+//
+// Define the initial sizes of a compiled program's instruction and character
+// set arrays.
+//
+
+#define REGEX_PROGRAM_INITIAL_INSTRUCTIONS 32
+#define REGEX_PROGRAM_INITIAL_SETS 8
+
+//
+// Define the value that terminates a chain of instructions waiting to have
+// their destination patched.
+//
+
+#define REGEX_PATCH_END MAX_ULONG
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -114,6 +129,34 @@ typedef struct _REGULAR_EXPRESSION_LEXER {
     ULONG ActiveSubexpressionCount;
 } REGULAR_EXPRESSION_LEXER, *PREGULAR_EXPRESSION_LEXER;
 
+/*++
+
+Structure Description:
+
+    This structure defines the state used while compiling a parsed regular
+    expression down to a program.
+
+Members:
+
+    Expression - Stores a pointer to the regular expression being compiled.
+
+    Program - Stores a pointer to the program being built.
+
+    InstructionCapacity - Stores the number of elements allocated in the
+        program's instruction array.
+
+    SetCapacity - Stores the number of elements allocated in the program's
+        character set array.
+
+--*/
+
+typedef struct _REGEX_PROGRAM_BUILDER {
+    PREGULAR_EXPRESSION Expression;
+    PREGEX_PROGRAM Program;
+    ULONG InstructionCapacity;
+    ULONG SetCapacity;
+} REGEX_PROGRAM_BUILDER, *PREGEX_PROGRAM_BUILDER;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -221,6 +264,60 @@ ClpAppendRegularExpressionString (
     ULONG Size
     );
 
+VOID
+ClpBuildRegularExpressionProgram (
+    PREGULAR_EXPRESSION Expression
+    );
+
+VOID
+ClpDestroyRegularExpressionProgram (
+    PREGEX_PROGRAM Program
+    );
+
+BOOL
+ClpEmitRegexEntry (
+    PREGEX_PROGRAM_BUILDER Builder,
+    PREGULAR_EXPRESSION_ENTRY Entry
+    );
+
+BOOL
+ClpEmitRegexEntryBody (
+    PREGEX_PROGRAM_BUILDER Builder,
+    PREGULAR_EXPRESSION_ENTRY Entry
+    );
+
+BOOL
+ClpEmitRegexCharacterSet (
+    PREGEX_PROGRAM_BUILDER Builder,
+    PREGULAR_EXPRESSION_ENTRY Entry,
+    CHAR Character
+    );
+
+BOOL
+ClpEmitRegexInstruction (
+    PREGEX_PROGRAM_BUILDER Builder,
+    REGEX_OPCODE Opcode,
+    ULONG Argument,
+    PULONG Index
+    );
+
+VOID
+ClpPatchRegexInstructions (
+    PREGEX_PROGRAM Program,
+    ULONG Chain,
+    ULONG Destination
+    );
+
+BOOL
+ClpIsRegexEntryNullable (
+    PREGULAR_EXPRESSION_ENTRY Entry
+    );
+
+VOID
+ClpComputeRegexByteClasses (
+    PREGEX_PROGRAM Program
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -531,6 +628,14 @@ Return Value:
         goto CompileRegularExpressionEnd;
     }
 
+    //
+    // Try to compile the expression down to a program that runs in linear
+    // time. It's alright if this doesn't work out, the backtracking matcher
+    // can always take care of it.
+    //
+
+    ClpBuildRegularExpressionProgram(Result);
+
 CompileRegularExpressionEnd:
     if (Status != RegexStatusSuccess) {
         if (Result != NULL) {
@@ -582,6 +687,10 @@ Return Value:
         ClpDestroyRegularExpressionEntry(Entry);
     }
 
+    if (Expression->Program != NULL) {
+        ClpDestroyRegularExpressionProgram(Expression->Program);
+    }
+
     free(Expression);
     return;
 }
@@ -2583,3 +2692,887 @@ Return Value:
     return TRUE;
 }
 
+
+VOID
+ClpBuildRegularExpressionProgram (
+    PREGULAR_EXPRESSION Expression
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compiles a parsed regular expression down to a Thompson NFA
+    program, which can be executed in time linear in the size of the input.
+    No program is built for expressions containing back references (which
+    need backtracking), for expressions whose programs would need more than
+    REGEX_PROGRAM_MAX_INSTRUCTIONS instructions, or if memory runs out.
+
+Arguments:
+
+    Expression - Supplies a pointer to the parsed regular expression. The
+        program is stored in here on success.
+
+Return Value:
+
+    None. Failure is not fatal, the expression simply runs on the backtracking
+    matcher.
+
+--*/
+
+{
+
+    REGEX_PROGRAM_BUILDER Builder;
+    ULONG Index;
+    PREGEX_INSTRUCTION Instruction;
+    PREGEX_PROGRAM Program;
+    BOOL Result;
+
+    Program = malloc(sizeof(REGEX_PROGRAM));
+    if (Program == NULL) {
+        return;
+    }
+
+    memset(Program, 0, sizeof(REGEX_PROGRAM));
+    Program->SlotCount = (Expression->SubexpressionCount + 1) * 2;
+    Builder.Expression = Expression;
+    Builder.Program = Program;
+    Builder.InstructionCapacity = 0;
+    Builder.SetCapacity = 0;
+
+    //
+    // Basic regular expressions keep their anchors as flags on the base entry
+    // rather than as entries of their own.
+    //
+
+    if ((Expression->BaseEntry.Flags & REGULAR_EXPRESSION_ANCHORED_LEFT) != 0) {
+        Result = ClpEmitRegexInstruction(&Builder,
+                                         RegexOpAssert,
+                                         RegexEntryStringBegin,
+                                         &Index);
+
+        if (Result == FALSE) {
+            goto BuildRegularExpressionProgramEnd;
+        }
+    }
+
+    Result = ClpEmitRegexEntry(&Builder, &(Expression->BaseEntry));
+    if (Result == FALSE) {
+        goto BuildRegularExpressionProgramEnd;
+    }
+
+    if ((Expression->BaseEntry.Flags & REGULAR_EXPRESSION_ANCHORED_RIGHT) !=
+        0) {
+
+        Result = ClpEmitRegexInstruction(&Builder,
+                                         RegexOpAssert,
+                                         RegexEntryStringEnd,
+                                         &Index);
+
+        if (Result == FALSE) {
+            goto BuildRegularExpressionProgramEnd;
+        }
+    }
+
+    Result = ClpEmitRegexInstruction(&Builder, RegexOpMatch, 0, &Index);
+    if (Result == FALSE) {
+        goto BuildRegularExpressionProgramEnd;
+    }
+
+    //
+    // If the program starts by asserting the beginning of the string (and
+    // newlines don't count), then there's no use in trying to start a match
+    // anywhere else.
+    //
+
+    if ((Expression->Flags & REG_NEWLINE) == 0) {
+        Instruction = Program->Instructions;
+        while (Instruction->Opcode == RegexOpSave) {
+            Instruction += 1;
+        }
+
+        if ((Instruction->Opcode == RegexOpAssert) &&
+            (Instruction->Argument == RegexEntryStringBegin)) {
+
+            Program->Anchored = TRUE;
+        }
+    }
+
+    ClpComputeRegexByteClasses(Program);
+    Expression->Program = Program;
+    Program = NULL;
+
+BuildRegularExpressionProgramEnd:
+    if (Program != NULL) {
+        ClpDestroyRegularExpressionProgram(Program);
+    }
+
+    return;
+}
+
+VOID
+ClpDestroyRegularExpressionProgram (
+    PREGEX_PROGRAM Program
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys a compiled regular expression program.
+
+Arguments:
+
+    Program - Supplies a pointer to the program to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Program->Instructions != NULL) {
+        free(Program->Instructions);
+    }
+
+    if (Program->Sets != NULL) {
+        free(Program->Sets);
+    }
+
+    if (Program->Dfa != NULL) {
+        ClpDestroyRegularExpressionDfa(Program->Dfa);
+    }
+
+    free(Program);
+    return;
+}
+
+BOOL
+ClpEmitRegexEntry (
+    PREGEX_PROGRAM_BUILDER Builder,
+    PREGULAR_EXPRESSION_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine emits the instructions for a regular expression entry,
+    including its duplicates. Counted duplicates are emitted as copies of the
+    entry, and unbounded ones as a loop.
+
+Arguments:
+
+    Builder - Supplies a pointer to the program builder.
+
+    Entry - Supplies a pointer to the entry to emit.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the entry cannot be compiled or allocation failed.
+
+--*/
+
+{
+
+    BOOL Guard;
+    ULONG Index;
+    ULONG Iteration;
+    ULONG Loop;
+    ULONG Patch;
+    PREGEX_PROGRAM Program;
+    BOOL Result;
+    ULONG Slot;
+
+    Program = Builder->Program;
+    Patch = REGEX_PATCH_END;
+
+    //
+    // The backtracking matcher stops repeating a subexpression once an
+    // iteration matches nothing. Emulate that by remembering where each
+    // iteration started and leaving the repeat if the input didn't move.
+    // This is only needed if the subexpression can match nothing at all.
+    //
+
+    Guard = FALSE;
+    Slot = 0;
+    if ((Entry->Type == RegexEntrySubexpression) &&
+        (Entry->DuplicateMax != 1) &&
+        (ClpIsRegexEntryNullable(Entry) != FALSE)) {
+
+        Guard = TRUE;
+        Slot = Program->SlotCount;
+        Program->SlotCount += 1;
+    }
+
+    Iteration = 0;
+    while ((Entry->DuplicateMax == (ULONG)-1) ||
+           (Iteration < Entry->DuplicateMax)) {
+
+        //
+        // Iterations beyond the minimum are optional. Loop forever on the
+        // last one if there's no maximum.
+        //
+
+        Loop = Program->InstructionCount;
+        if (Iteration >= Entry->DuplicateMin) {
+            Result = ClpEmitRegexInstruction(Builder, RegexOpSplit, 0, &Index);
+            if (Result == FALSE) {
+                return FALSE;
+            }
+
+            Program->Instructions[Index].Target = Index + 1;
+            Program->Instructions[Index].Alternate = Patch;
+            Patch = Index;
+        }
+
+        if (Guard != FALSE) {
+            Result = ClpEmitRegexInstruction(Builder,
+                                             RegexOpSave,
+                                             Slot,
+                                             &Index);
+
+            if (Result == FALSE) {
+                return FALSE;
+            }
+        }
+
+        Result = ClpEmitRegexEntryBody(Builder, Entry);
+        if (Result == FALSE) {
+            return FALSE;
+        }
+
+        if (Guard != FALSE) {
+            Result = ClpEmitRegexInstruction(Builder,
+                                             RegexOpCheckEmpty,
+                                             Slot,
+                                             &Index);
+
+            if (Result == FALSE) {
+                return FALSE;
+            }
+
+            Program->Instructions[Index].Alternate = Patch;
+            Patch = Index;
+        }
+
+        if ((Entry->DuplicateMax == (ULONG)-1) &&
+            (Iteration >= Entry->DuplicateMin)) {
+
+            Result = ClpEmitRegexInstruction(Builder, RegexOpJump, 0, &Index);
+            if (Result == FALSE) {
+                return FALSE;
+            }
+
+            Program->Instructions[Index].Target = Loop;
+            break;
+        }
+
+        Iteration += 1;
+    }
+
+    ClpPatchRegexInstructions(Program, Patch, Program->InstructionCount);
+    return TRUE;
+}
+
+BOOL
+ClpEmitRegexEntryBody (
+    PREGEX_PROGRAM_BUILDER Builder,
+    PREGULAR_EXPRESSION_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine emits the instructions for a single occurrence of a regular
+    expression entry.
+
+Arguments:
+
+    Builder - Supplies a pointer to the program builder.
+
+    Entry - Supplies a pointer to the entry to emit.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the entry cannot be compiled or allocation failed.
+
+--*/
+
+{
+
+    PREGULAR_EXPRESSION_ENTRY Child;
+    ULONG CharacterIndex;
+    PLIST_ENTRY CurrentEntry;
+    PLIST_ENTRY CurrentOption;
+    ULONG Index;
+    PREGULAR_EXPRESSION_ENTRY Option;
+    ULONG Patch;
+    PREGEX_PROGRAM Program;
+    BOOL Result;
+    ULONG Split;
+
+    Program = Builder->Program;
+    switch (Entry->Type) {
+    case RegexEntryOrdinaryCharacters:
+        for (CharacterIndex = 0;
+             CharacterIndex < Entry->U.String.Size;
+             CharacterIndex += 1) {
+
+            Result = ClpEmitRegexCharacterSet(
+                                      Builder,
+                                      Entry,
+                                      Entry->U.String.Data[CharacterIndex]);
+
+            if (Result == FALSE) {
+                return FALSE;
+            }
+        }
+
+        break;
+
+    case RegexEntryAnyCharacter:
+    case RegexEntryBracketExpression:
+        Result = ClpEmitRegexCharacterSet(Builder, Entry, 0);
+        if (Result == FALSE) {
+            return FALSE;
+        }
+
+        break;
+
+    case RegexEntryStringBegin:
+    case RegexEntryStringEnd:
+    case RegexEntryStartOfWord:
+    case RegexEntryEndOfWord:
+        Result = ClpEmitRegexInstruction(Builder,
+                                         RegexOpAssert,
+                                         Entry->Type,
+                                         &Index);
+
+        if (Result == FALSE) {
+            return FALSE;
+        }
+
+        break;
+
+    //
+    // Back references can't be matched by a finite automaton.
+    //
+
+    case RegexEntryBackReference:
+        return FALSE;
+
+    case RegexEntrySubexpression:
+    case RegexEntryBranchOption:
+        if (Entry->Type == RegexEntrySubexpression) {
+            Result = ClpEmitRegexInstruction(Builder,
+                                             RegexOpSave,
+                                             Entry->U.SubexpressionNumber * 2,
+                                             &Index);
+
+            if (Result == FALSE) {
+                return FALSE;
+            }
+        }
+
+        CurrentEntry = Entry->ChildList.Next;
+        while (CurrentEntry != &(Entry->ChildList)) {
+            Child = LIST_VALUE(CurrentEntry,
+                               REGULAR_EXPRESSION_ENTRY,
+                               ListEntry);
+
+            CurrentEntry = CurrentEntry->Next;
+            Result = ClpEmitRegexEntry(Builder, Child);
+            if (Result == FALSE) {
+                return FALSE;
+            }
+        }
+
+        if (Entry->Type == RegexEntrySubexpression) {
+            Result = ClpEmitRegexInstruction(
+                                        Builder,
+                                        RegexOpSave,
+                                        Entry->U.SubexpressionNumber * 2 + 1,
+                                        &Index);
+
+            if (Result == FALSE) {
+                return FALSE;
+            }
+        }
+
+        break;
+
+    //
+    // Branch options are tried in order, so each one but the last prefers
+    // itself over the remaining options.
+    //
+
+    case RegexEntryBranch:
+        Patch = REGEX_PATCH_END;
+        CurrentOption = Entry->ChildList.Next;
+        while (CurrentOption != &(Entry->ChildList)) {
+            Option = LIST_VALUE(CurrentOption,
+                                REGULAR_EXPRESSION_ENTRY,
+                                ListEntry);
+
+            CurrentOption = CurrentOption->Next;
+            Split = REGEX_PATCH_END;
+            if (CurrentOption != &(Entry->ChildList)) {
+                Result = ClpEmitRegexInstruction(Builder,
+                                                 RegexOpSplit,
+                                                 0,
+                                                 &Split);
+
+                if (Result == FALSE) {
+                    return FALSE;
+                }
+
+                Program->Instructions[Split].Target = Split + 1;
+            }
+
+            Result = ClpEmitRegexEntry(Builder, Option);
+            if (Result == FALSE) {
+                return FALSE;
+            }
+
+            if (Split != REGEX_PATCH_END) {
+                Result = ClpEmitRegexInstruction(Builder,
+                                                 RegexOpJump,
+                                                 0,
+                                                 &Index);
+
+                if (Result == FALSE) {
+                    return FALSE;
+                }
+
+                Program->Instructions[Index].Target = Patch;
+                Patch = Index;
+                Program->Instructions[Split].Alternate =
+                                                   Program->InstructionCount;
+            }
+        }
+
+        ClpPatchRegexInstructions(Program, Patch, Program->InstructionCount);
+        break;
+
+    default:
+
+        assert(FALSE);
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+BOOL
+ClpEmitRegexCharacterSet (
+    PREGEX_PROGRAM_BUILDER Builder,
+    PREGULAR_EXPRESSION_ENTRY Entry,
+    CHAR Character
+    )
+
+/*++
+
+Routine Description:
+
+    This routine emits a byte set instruction matching a single character of
+    the given entry. The set is built by asking the same questions the
+    backtracking matcher asks, so the two always agree.
+
+Arguments:
+
+    Builder - Supplies a pointer to the program builder.
+
+    Entry - Supplies a pointer to the ordinary character, any character, or
+        bracket expression entry.
+
+    Character - Supplies the ordinary character to match, for ordinary
+        character entries.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on allocation failure or if the program got too big.
+
+--*/
+
+{
+
+    ULONG Byte;
+    CHAR Candidate;
+    ULONG Flags;
+    ULONG Index;
+    BOOL Matches;
+    PVOID NewBuffer;
+    ULONG NewCapacity;
+    PREGEX_PROGRAM Program;
+    REGEX_CHARACTER_SET Set;
+
+    Program = Builder->Program;
+    Flags = Builder->Expression->Flags;
+    memset(&Set, 0, sizeof(REGEX_CHARACTER_SET));
+
+    //
+    // The null terminator never matches anything.
+    //
+
+    for (Byte = 1; Byte < 256; Byte += 1) {
+        Candidate = (CHAR)Byte;
+        switch (Entry->Type) {
+        case RegexEntryOrdinaryCharacters:
+            Matches = FALSE;
+            if ((Candidate == Character) ||
+                (((Flags & REG_ICASE) != 0) &&
+                 (tolower(Candidate) == tolower(Character)))) {
+
+                Matches = TRUE;
+            }
+
+            break;
+
+        case RegexEntryAnyCharacter:
+            Matches = TRUE;
+            if ((Candidate == '\n') && ((Flags & REG_NEWLINE) != 0)) {
+                Matches = FALSE;
+            }
+
+            break;
+
+        case RegexEntryBracketExpression:
+            Matches = ClpRegularExpressionMatchBracket(Builder->Expression,
+                                                       Entry,
+                                                       Candidate);
+
+            break;
+
+        default:
+
+            assert(FALSE);
+
+            return FALSE;
+        }
+
+        if (Matches != FALSE) {
+            Set.Bits[Byte / 32] |= 1UL << (Byte % 32);
+        }
+    }
+
+    //
+    // Reuse an identical set if there is one.
+    //
+
+    for (Index = 0; Index < Program->SetCount; Index += 1) {
+        if (memcmp(&(Program->Sets[Index]), &Set, sizeof(Set)) == 0) {
+            break;
+        }
+    }
+
+    if (Index == Program->SetCount) {
+        if (Program->SetCount == Builder->SetCapacity) {
+            NewCapacity = Builder->SetCapacity * 2;
+            if (NewCapacity == 0) {
+                NewCapacity = REGEX_PROGRAM_INITIAL_SETS;
+            }
+
+            NewBuffer = realloc(Program->Sets,
+                                NewCapacity * sizeof(REGEX_CHARACTER_SET));
+
+            if (NewBuffer == NULL) {
+                return FALSE;
+            }
+
+            Program->Sets = NewBuffer;
+            Builder->SetCapacity = NewCapacity;
+        }
+
+        memcpy(&(Program->Sets[Index]), &Set, sizeof(Set));
+        Program->SetCount += 1;
+    }
+
+    return ClpEmitRegexInstruction(Builder, RegexOpByteSet, Index, &Index);
+}
+
+BOOL
+ClpEmitRegexInstruction (
+    PREGEX_PROGRAM_BUILDER Builder,
+    REGEX_OPCODE Opcode,
+    ULONG Argument,
+    PULONG Index
+    )
+
+/*++
+
+Routine Description:
+
+    This routine appends an instruction to the program being built. The
+    instruction's targets are zeroed.
+
+Arguments:
+
+    Builder - Supplies a pointer to the program builder.
+
+    Opcode - Supplies the instruction's operation.
+
+    Argument - Supplies the instruction's argument.
+
+    Index - Supplies a pointer where the index of the new instruction will be
+        returned.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on allocation failure or if the program got too big.
+
+--*/
+
+{
+
+    PREGEX_INSTRUCTION Instruction;
+    PVOID NewBuffer;
+    ULONG NewCapacity;
+    PREGEX_PROGRAM Program;
+
+    Program = Builder->Program;
+    if (Program->InstructionCount == Builder->InstructionCapacity) {
+        if (Program->InstructionCount >= REGEX_PROGRAM_MAX_INSTRUCTIONS) {
+            return FALSE;
+        }
+
+        NewCapacity = Builder->InstructionCapacity * 2;
+        if (NewCapacity == 0) {
+            NewCapacity = REGEX_PROGRAM_INITIAL_INSTRUCTIONS;
+        }
+
+        NewBuffer = realloc(Program->Instructions,
+                            NewCapacity * sizeof(REGEX_INSTRUCTION));
+
+        if (NewBuffer == NULL) {
+            return FALSE;
+        }
+
+        Program->Instructions = NewBuffer;
+        Builder->InstructionCapacity = NewCapacity;
+    }
+
+    *Index = Program->InstructionCount;
+    Instruction = &(Program->Instructions[*Index]);
+    Instruction->Opcode = Opcode;
+    Instruction->Argument = Argument;
+    Instruction->Target = 0;
+    Instruction->Alternate = 0;
+    Program->InstructionCount += 1;
+    return TRUE;
+}
+
+VOID
+ClpPatchRegexInstructions (
+    PREGEX_PROGRAM Program,
+    ULONG Chain,
+    ULONG Destination
+    )
+
+/*++
+
+Routine Description:
+
+    This routine points a chain of forward jumps at their destination now
+    that it's known. Jumps are chained through their targets, and splits and
+    check empty instructions through their alternates.
+
+Arguments:
+
+    Program - Supplies a pointer to the program being built.
+
+    Chain - Supplies the index of the first instruction in the chain.
+
+    Destination - Supplies the index of the instruction they should go to.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PREGEX_INSTRUCTION Instruction;
+
+    while (Chain != REGEX_PATCH_END) {
+        Instruction = &(Program->Instructions[Chain]);
+        if (Instruction->Opcode == RegexOpJump) {
+            Chain = Instruction->Target;
+            Instruction->Target = Destination;
+
+        } else {
+
+            assert((Instruction->Opcode == RegexOpSplit) ||
+                   (Instruction->Opcode == RegexOpCheckEmpty));
+
+            Chain = Instruction->Alternate;
+            Instruction->Alternate = Destination;
+        }
+    }
+
+    return;
+}
+
+BOOL
+ClpIsRegexEntryNullable (
+    PREGULAR_EXPRESSION_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether a single occurrence of the given entry
+    can match without consuming any input.
+
+Arguments:
+
+    Entry - Supplies a pointer to the entry.
+
+Return Value:
+
+    TRUE if the entry can match the empty string.
+
+    FALSE if the entry always consumes input.
+
+--*/
+
+{
+
+    PREGULAR_EXPRESSION_ENTRY Child;
+    PLIST_ENTRY CurrentEntry;
+
+    switch (Entry->Type) {
+    case RegexEntryStringBegin:
+    case RegexEntryStringEnd:
+    case RegexEntryStartOfWord:
+    case RegexEntryEndOfWord:
+        return TRUE;
+
+    //
+    // A subexpression is nullable if all its children are, a branch if any
+    // of its options are.
+    //
+
+    case RegexEntrySubexpression:
+    case RegexEntryBranchOption:
+        CurrentEntry = Entry->ChildList.Next;
+        while (CurrentEntry != &(Entry->ChildList)) {
+            Child = LIST_VALUE(CurrentEntry,
+                               REGULAR_EXPRESSION_ENTRY,
+                               ListEntry);
+
+            CurrentEntry = CurrentEntry->Next;
+            if ((Child->DuplicateMin != 0) &&
+                (ClpIsRegexEntryNullable(Child) == FALSE)) {
+
+                return FALSE;
+            }
+        }
+
+        return TRUE;
+
+    case RegexEntryBranch:
+        CurrentEntry = Entry->ChildList.Next;
+        while (CurrentEntry != &(Entry->ChildList)) {
+            Child = LIST_VALUE(CurrentEntry,
+                               REGULAR_EXPRESSION_ENTRY,
+                               ListEntry);
+
+            CurrentEntry = CurrentEntry->Next;
+            if (ClpIsRegexEntryNullable(Child) != FALSE) {
+                return TRUE;
+            }
+        }
+
+        return FALSE;
+
+    default:
+        break;
+    }
+
+    return FALSE;
+}
+
+VOID
+ClpComputeRegexByteClasses (
+    PREGEX_PROGRAM Program
+    )
+
+/*++
+
+Routine Description:
+
+    This routine splits the bytes into classes that the program can't tell
+    apart: bytes in the same class are in exactly the same character sets and
+    look the same to the assertions. The DFA then only needs one transition
+    per class rather than one per byte.
+
+Arguments:
+
+    Program - Supplies a pointer to the program.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Byte;
+    ULONG ClassCount;
+    ULONG Key;
+    BOOL Member;
+    SHORT Remap[512];
+    ULONG SetIndex;
+
+    memset(Program->ByteClass, 0, sizeof(Program->ByteClass));
+    ClassCount = 1;
+
+    //
+    // Refine the classes by each character set, then by the things the
+    // assertions look at: word characters and newlines.
+    //
+
+    for (SetIndex = 0; SetIndex <= Program->SetCount + 1; SetIndex += 1) {
+        memset(Remap, 0xFF, sizeof(Remap));
+        ClassCount = 0;
+        for (Byte = 0; Byte < 256; Byte += 1) {
+            if (SetIndex < Program->SetCount) {
+                Member = REGEX_SET_CONTAINS(&(Program->Sets[SetIndex]), Byte);
+
+            } else if (SetIndex == Program->SetCount) {
+                Member = REGULAR_EXPRESSION_IS_NAME((CHAR)Byte);
+
+            } else {
+                Member = (Byte == '\n');
+            }
+
+            Key = (Program->ByteClass[Byte] * 2) + (Member != FALSE);
+            if (Remap[Key] < 0) {
+                Remap[Key] = ClassCount;
+                ClassCount += 1;
+            }
+
+            Program->ByteClass[Byte] = Remap[Key];
+        }
+    }
+
+    Program->ClassCount = ClassCount;
+    return;
+}
+
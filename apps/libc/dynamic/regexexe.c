@@ -53,6 +53,56 @@ Module Name:
 
 #define REGEX_INTERNAL_MATCH_COUNT 11
 
+//
+// Define the maximum number of states the DFA can build up before it is
+// thrown away, and the maximum number of program counters stored among all
+// the states.
+//
+
+#define REGEX_DFA_MAX_STATES 1024
+#define REGEX_DFA_MAX_PCS (256 * 1024)
+
+//
+// Define the number of times the DFA can fill up before it's abandoned for
+// an expression. Expressions that blow up the DFA run on the Pike VM.
+//
+
+#define REGEX_DFA_MAX_RESETS 8
+
+//
+// Define the initial sizes of the DFA's arrays, and the size of its hash
+// table. The hash table size must be a power of two.
+//
+
+#define REGEX_DFA_INITIAL_STATES 16
+#define REGEX_DFA_INITIAL_PCS 256
+#define REGEX_DFA_HASH_SIZE 1024
+
+//
+// Define the special values found in the DFA's transition table.
+//
+
+#define REGEX_DFA_UNKNOWN (-1)
+#define REGEX_DFA_MATCH (-2)
+#define REGEX_DFA_DEAD (-3)
+
+//
+// Define the flags cached in a DFA state about whether or not the program
+// matches if the input ends in that state.
+//
+
+#define REGEX_DFA_END_KNOWN 0x01
+#define REGEX_DFA_END_MATCH 0x02
+#define REGEX_DFA_NOT_EOL_END_KNOWN 0x04
+#define REGEX_DFA_NOT_EOL_END_MATCH 0x08
+
+//
+// Define the program counter value that marks a Pike VM stack entry as a
+// slot to restore.
+//
+
+#define REGEX_STACK_RESTORE MAX_ULONG
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -160,6 +210,193 @@ typedef struct _REGULAR_EXPRESSION_EXECUTION {
     regmatch_t InternalMatch[REGEX_INTERNAL_MATCH_COUNT];
 } REGULAR_EXPRESSION_EXECUTION, *PREGULAR_EXPRESSION_EXECUTION;
 
+typedef enum _REGEX_DFA_RESULT {
+    RegexDfaNoMatch,
+    RegexDfaMatch,
+    RegexDfaGaveUp
+} REGEX_DFA_RESULT, *PREGEX_DFA_RESULT;
+
+/*++
+
+Structure Description:
+
+    This structure defines a single DFA state, which is the set of NFA
+    threads alive at some point in the input plus the context of that point.
+
+Members:
+
+    Hash - Stores the hash of the state's program counters and context.
+
+    NextInBucket - Stores the index of the next state in the same hash bucket,
+        or -1 if this is the last one.
+
+    PcOffset - Stores the index into the DFA's program counter array where
+        this state's sorted program counters begin.
+
+    PcCount - Stores the number of program counters in the state.
+
+    Context - Stores the context of the position, which is what the
+        assertions need to know about the previous character. See
+        REGEX_CONTEXT_* definitions.
+
+    EndFlags - Stores whether or not the input matches if it ends in this
+        state. See REGEX_DFA_*_END_* definitions.
+
+--*/
+
+typedef struct _REGEX_DFA_STATE {
+    ULONG Hash;
+    LONG NextInBucket;
+    ULONG PcOffset;
+    ULONG PcCount;
+    UCHAR Context;
+    UCHAR EndFlags;
+} REGEX_DFA_STATE, *PREGEX_DFA_STATE;
+
+/*++
+
+Structure Description:
+
+    This structure defines a DFA built lazily from a compiled program. States
+    and transitions are only created as the input calls for them, and then
+    saved for subsequent executions of the same expression.
+
+Members:
+
+    States - Stores the array of states.
+
+    StateCount - Stores the number of valid states.
+
+    StateCapacity - Stores the number of states allocated.
+
+    Transitions - Stores the transition table, with one row per state and one
+        column per byte class. Values are either a state index or one of the
+        REGEX_DFA_* special values.
+
+    Pcs - Stores the array of program counters referenced by the states.
+
+    PcCount - Stores the number of valid program counters.
+
+    PcCapacity - Stores the number of program counters allocated.
+
+    Stack - Stores the work stack used when following the program.
+
+    Visited - Stores the generation in which each instruction was last
+        visited while following the program.
+
+    NextPcs - Stores the scratch list of program counters for the next state.
+
+    Generation - Stores the current visit generation.
+
+    ResetCount - Stores the number of times the DFA has been full.
+
+    Buckets - Stores the hash table of states.
+
+--*/
+
+struct _REGEX_DFA {
+    PREGEX_DFA_STATE States;
+    ULONG StateCount;
+    ULONG StateCapacity;
+    PLONG Transitions;
+    PULONG Pcs;
+    ULONG PcCount;
+    ULONG PcCapacity;
+    PULONG Stack;
+    PULONG Visited;
+    PULONG NextPcs;
+    ULONG Generation;
+    ULONG ResetCount;
+    LONG Buckets[REGEX_DFA_HASH_SIZE];
+};
+
+/*++
+
+Structure Description:
+
+    This structure defines a list of Pike VM threads, kept in priority order.
+    Each program counter appears at most once.
+
+Members:
+
+    Count - Stores the number of threads in the list.
+
+    Pcs - Stores the program counter of each thread, in priority order.
+
+    Sparse - Stores the index into the program counter array for each
+        instruction, which makes checking membership quick.
+
+    Slots - Stores the slot array of each thread.
+
+--*/
+
+typedef struct _REGEX_THREAD_LIST {
+    ULONG Count;
+    PULONG Pcs;
+    PULONG Sparse;
+    regoff_t *Slots;
+} REGEX_THREAD_LIST, *PREGEX_THREAD_LIST;
+
+/*++
+
+Structure Description:
+
+    This structure defines an entry on the Pike VM's work stack, which is
+    either an instruction still to be followed or a slot value to restore.
+
+Members:
+
+    Pc - Stores the instruction to follow, or REGEX_STACK_RESTORE.
+
+    Slot - Stores the slot to restore.
+
+    Value - Stores the value to restore the slot to.
+
+--*/
+
+typedef struct _REGEX_STACK_ENTRY {
+    ULONG Pc;
+    ULONG Slot;
+    regoff_t Value;
+} REGEX_STACK_ENTRY, *PREGEX_STACK_ENTRY;
+
+/*++
+
+Structure Description:
+
+    This structure defines the state of a Pike VM execution, which simulates
+    the program's threads in lock step over the input. Threads are kept in
+    the order the backtracking matcher would try them, so the match found is
+    the same one it would have found.
+
+Members:
+
+    Expression - Stores a pointer to the regular expression.
+
+    Program - Stores a pointer to the program.
+
+    Input - Stores a pointer to the input string.
+
+    Flags - Stores the execution flags. See REG_NOTBOL and REG_NOTEOL.
+
+    Lists - Stores the current and next thread lists.
+
+    Work - Stores the slot array of the thread being followed.
+
+    Stack - Stores the work stack.
+
+--*/
+
+typedef struct _REGEX_PIKE_VM {
+    PREGULAR_EXPRESSION Expression;
+    PREGEX_PROGRAM Program;
+    PUCHAR Input;
+    int Flags;
+    REGEX_THREAD_LIST Lists[2];
+    regoff_t *Work;
+    PREGEX_STACK_ENTRY Stack;
+} REGEX_PIKE_VM, *PREGEX_PIKE_VM;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -224,6 +461,83 @@ ClpRegularExpressionDestroyChoice (
     PREGULAR_EXPRESSION_CHOICE Choice
     );
 
+BOOL
+ClpExecuteRegularExpressionProgram (
+    PREGULAR_EXPRESSION RegularExpression,
+    PSTR String,
+    regmatch_t Match[],
+    size_t MatchArraySize,
+    int Flags,
+    PREGULAR_EXPRESSION_STATUS Status
+    );
+
+REGEX_DFA_RESULT
+ClpSearchRegexDfa (
+    PREGULAR_EXPRESSION RegularExpression,
+    PSTR String,
+    int Flags
+    );
+
+LONG
+ClpComputeRegexDfaTransition (
+    PREGULAR_EXPRESSION RegularExpression,
+    PREGEX_DFA Dfa,
+    ULONG StateIndex,
+    UCHAR Byte,
+    int Flags
+    );
+
+LONG
+ClpAddRegexDfaState (
+    PREGEX_PROGRAM Program,
+    PREGEX_DFA Dfa,
+    PULONG Pcs,
+    ULONG PcCount,
+    ULONG Context
+    );
+
+PREGEX_DFA
+ClpCreateRegexDfa (
+    PREGEX_PROGRAM Program
+    );
+
+VOID
+ClpResetRegexDfa (
+    PREGEX_DFA Dfa
+    );
+
+REGULAR_EXPRESSION_STATUS
+ClpRunRegexPikeVm (
+    PREGULAR_EXPRESSION RegularExpression,
+    PSTR String,
+    regmatch_t Match[],
+    size_t MatchArraySize,
+    int Flags
+    );
+
+VOID
+ClpAddRegexThread (
+    PREGEX_PIKE_VM Vm,
+    PREGEX_THREAD_LIST List,
+    ULONG Pc,
+    regoff_t Position
+    );
+
+BOOL
+ClpCheckRegexAssertion (
+    PREGULAR_EXPRESSION RegularExpression,
+    ULONG Type,
+    ULONG Context,
+    UCHAR Next,
+    int Flags
+    );
+
+ULONG
+ClpGetRegexContext (
+    PREGULAR_EXPRESSION RegularExpression,
+    UCHAR Previous
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -289,1259 +603,2475 @@ Return Value:
     return Status;
 }
 
-//
-// --------------------------------------------------------- Internal Functions
-//
-
-REGULAR_EXPRESSION_STATUS
-ClpExecuteRegularExpression (
-    PREGULAR_EXPRESSION RegularExpression,
-    PSTR String,
-    regmatch_t Match[],
-    size_t MatchArraySize,
-    int Flags
+BOOL
+ClpRegularExpressionMatchBracket (
+    PREGULAR_EXPRESSION Expression,
+    PREGULAR_EXPRESSION_ENTRY Entry,
+    CHAR Character
     )
 
 /*++
 
 Routine Description:
 
-    This routine executes a regular expression, performing a search of the
-    given string to see if it matches the regular expression.
+    This routine determines if the given character matches a bracket
+    expression.
 
 Arguments:
 
-    RegularExpression - Supplies a pointer to the compiled regular expression.
-
-    String - Supplies a pointer to the string to check for a match.
-
-    MatchArraySize - Supplies the number of elements in the match array
-        parameter. Supply zero and the match array parameter will be ignored.
+    Expression - Supplies a pointer to the regular expression.
 
-    Match - Supplies an optional pointer to an array where the string indices of
-        the match and its subexpressions will be returned.
+    Entry - Supplies a pointer to the bracket expression entry.
 
-    Flags - Supplies a bitfield of flags governing the search. See some REG_*
-        definitions (specifically REG_NOTBOL and REG_NOTEOL).
+    Character - Supplies the character to test. This must not be the null
+        terminator.
 
 Return Value:
 
-    Success if there was a match.
+    TRUE if the character is matched by the bracket expression.
 
-    No match if there was no match.
+    FALSE if the character is not matched.
 
 --*/
 
 {
 
-    REGULAR_EXPRESSION_EXECUTION Context;
-    PLIST_ENTRY FreeEntry;
-    size_t MatchIndex;
-    ULONG StartIndex;
+    PREGULAR_BRACKET_ENTRY BracketEntry;
+    PREGULAR_BRACKET_EXPRESSION BracketExpression;
+    ULONG CharacterCount;
+    ULONG CharacterIndex;
+    PLIST_ENTRY CurrentEntry;
+    PSTR RegularCharacters;
     REGULAR_EXPRESSION_STATUS Status;
 
+    assert(Entry->Type == RegexEntryBracketExpression);
+    assert(Character != '\0');
+
     Status = RegexStatusNoMatch;
-    INITIALIZE_LIST_HEAD(&(Context.Choices));
-    INITIALIZE_LIST_HEAD(&(Context.FreeChoices));
-    Context.Expression = RegularExpression;
-    Context.Input = String;
-    Context.InputSize = strlen(String) + 1;
-    Context.Flags = Flags;
-    Context.Match = Match;
-    Context.MatchSize = MatchArraySize;
-    if ((RegularExpression->Flags & REG_NOSUB) == 0) {
-        for (MatchIndex = 0; MatchIndex < MatchArraySize; MatchIndex += 1) {
-            Match[MatchIndex].rm_so = -1;
-            Match[MatchIndex].rm_eo = -1;
-        }
-    }
+    BracketExpression = &(Entry->U.BracketExpression);
+    CharacterCount = BracketExpression->RegularCharacters.Size;
+    RegularCharacters = BracketExpression->RegularCharacters.Data;
 
-    for (MatchIndex = 0;
-         MatchIndex < REGEX_INTERNAL_MATCH_COUNT;
-         MatchIndex += 1) {
+    //
+    // First match against any of the regular characters.
+    //
 
-        Context.InternalMatch[MatchIndex].rm_so = -1;
-        Context.InternalMatch[MatchIndex].rm_eo = -1;
+    for (CharacterIndex = 0;
+         CharacterIndex < CharacterCount;
+         CharacterIndex += 1) {
+
+        if ((Character == RegularCharacters[CharacterIndex]) ||
+            (((Expression->Flags & REG_ICASE) != 0) &&
+              (tolower(Character) ==
+               tolower(RegularCharacters[CharacterIndex])))) {
+
+            Status = RegexStatusSuccess;
+            goto RegularExpressionMatchBracketEnd;
+        }
     }
 
     //
-    // Try to match the expression starting at each index.
+    // Go through the list of other stuff and see if any of that matches.
     //
 
-    for (StartIndex = 0; StartIndex < Context.InputSize; StartIndex += 1) {
+    CurrentEntry = BracketExpression->EntryList.Next;
+    while (CurrentEntry != &(BracketExpression->EntryList)) {
+        BracketEntry = LIST_VALUE(CurrentEntry,
+                                  REGULAR_BRACKET_ENTRY,
+                                  ListEntry);
 
-        //
-        // If the expression is anchored to the left, then this had better be:
-        // 1) Index zero and REG_NOTBOL is clear or
-        // 2) Right after a newline and REG_NEWLINE is set.
-        // If it's not one of these things then it definitely does not match.
-        //
+        CurrentEntry = CurrentEntry->Next;
+        switch (BracketEntry->Type) {
+        case BracketExpressionRange:
+            if ((Character >= BracketEntry->U.Range.Minimum) &&
+                (Character <= BracketEntry->U.Range.Maximum)) {
 
-        if ((RegularExpression->BaseEntry.Flags &
-             REGULAR_EXPRESSION_ANCHORED_LEFT) != 0) {
+                Status = RegexStatusSuccess;
+            }
 
-            if (!(((StartIndex == 0) && ((Flags & REG_NOTBOL) == 0)) ||
-                  (((RegularExpression->Flags & REG_NEWLINE) != 0) &&
-                   (StartIndex != 0) && (String[StartIndex - 1] == '\n')))) {
+            break;
 
-                Status = RegexStatusNoMatch;
-                continue;
+        case BracketExpressionCharacterClassAlphanumeric:
+            if (isalnum(Character)) {
+                Status = RegexStatusSuccess;
             }
-        }
 
-        Context.NextInput = StartIndex;
-        Status = ClpRegularExpressionMatch(&Context,
-                                           &(RegularExpression->BaseEntry));
+            break;
 
-        if (Status == RegexStatusSuccess) {
+        case BracketExpressionCharacterClassAlphabetic:
+            if (isalpha(Character)) {
+                Status = RegexStatusSuccess;
+            }
 
-            //
-            // If the expression is anchored to the right then either:
-            // 1) The index had better be the end and REG_NOTEOL is clear or
-            // 2) REG_NEWLINE is set and it's right before a newline.
-            // If this condition isn't met then it's not a real match.
-            //
+            break;
 
-            if ((RegularExpression->BaseEntry.Flags &
-                 REGULAR_EXPRESSION_ANCHORED_RIGHT) != 0) {
+        case BracketExpressionCharacterClassBlank:
+            if (isblank(Character)) {
+                Status = RegexStatusSuccess;
+            }
 
-                if (!(((Context.NextInput == Context.InputSize - 1) &&
-                      ((Flags & REG_NOTEOL) == 0)) ||
-                      (((RegularExpression->Flags & REG_NEWLINE) != 0) &&
-                       (String[Context.NextInput] == '\n')))) {
+            break;
 
-                    Status = RegexStatusNoMatch;
-                    continue;
-                }
+        case BracketExpressionCharacterClassControl:
+            if (iscntrl(Character)) {
+                Status = RegexStatusSuccess;
             }
 
             break;
-        }
-    }
 
-    //
-    // Save the overall match if found.
-    //
+        case BracketExpressionCharacterClassDigit:
+            if (isdigit(Character)) {
+                Status = RegexStatusSuccess;
+            }
 
-    if (Status == RegexStatusSuccess) {
-        if (((RegularExpression->Flags & REG_NOSUB) == 0) &&
-            (MatchArraySize > 0)) {
+            break;
 
-            Match[0].rm_so = StartIndex;
-            Match[0].rm_eo = Context.NextInput;
-        }
+        case BracketExpressionCharacterClassGraph:
+            if (isgraph(Character)) {
+                Status = RegexStatusSuccess;
+            }
 
-    //
-    // On failure, blank out the matches again.
-    //
+            break;
 
-    } else if ((RegularExpression->Flags & REG_NOSUB) == 0) {
-        for (MatchIndex = 0; MatchIndex < MatchArraySize; MatchIndex += 1) {
-            Match[MatchIndex].rm_so = -1;
-            Match[MatchIndex].rm_eo = -1;
+        case BracketExpressionCharacterClassLowercase:
+            if ((islower(Character)) ||
+                (((Expression->Flags & REG_ICASE) != 0) &&
+                 (isupper(Character)))) {
+
+                Status = RegexStatusSuccess;
+            }
+
+            break;
+
+        case BracketExpressionCharacterClassPrintable:
+            if (isprint(Character)) {
+                Status = RegexStatusSuccess;
+            }
+
+            break;
+
+        case BracketExpressionCharacterClassPunctuation:
+            if (ispunct(Character)) {
+                Status = RegexStatusSuccess;
+            }
+
+            break;
+
+        case BracketExpressionCharacterClassSpace:
+            if (isspace(Character)) {
+                Status = RegexStatusSuccess;
+            }
+
+            break;
+
+        case BracketExpressionCharacterClassUppercase:
+            if ((isupper(Character)) ||
+                (((Expression->Flags & REG_ICASE) != 0) &&
+                 (islower(Character)))) {
+
+                Status = RegexStatusSuccess;
+            }
+
+            break;
+
+        case BracketExpressionCharacterClassHexDigit:
+            if (isxdigit(Character)) {
+                Status = RegexStatusSuccess;
+            }
+
+            break;
+
+        case BracketExpressionCharacterClassName:
+            if (REGULAR_EXPRESSION_IS_NAME(Character)) {
+                Status = RegexStatusSuccess;
+            }
+
+            break;
+
+        default:
+
+            assert(FALSE);
+
+            goto RegularExpressionMatchBracketEnd;
+        }
+
+        if (Status == RegexStatusSuccess) {
+            break;
         }
     }
 
-    //
-    // Destroy any remaining choices.
-    //
+RegularExpressionMatchBracketEnd:
+    if ((Entry->Flags & REGULAR_EXPRESSION_NEGATED) != 0) {
+        if (Status == RegexStatusNoMatch) {
+            Status = RegexStatusSuccess;
 
-    assert(LIST_EMPTY(&(Context.Choices)) != FALSE);
+        } else if (Status == RegexStatusSuccess) {
+            Status = RegexStatusNoMatch;
+        }
+    }
 
-    while (!LIST_EMPTY(&(Context.FreeChoices))) {
-        FreeEntry = Context.FreeChoices.Next;
-        LIST_REMOVE(FreeEntry);
-        free(FreeEntry);
+    if (Status == RegexStatusSuccess) {
+        return TRUE;
     }
 
-    return Status;
+    return FALSE;
 }
 
-REGULAR_EXPRESSION_STATUS
-ClpRegularExpressionMatch (
-    PREGULAR_EXPRESSION_EXECUTION Context,
-    PREGULAR_EXPRESSION_ENTRY Entry
+
+VOID
+ClpDestroyRegularExpressionDfa (
+    PREGEX_DFA Dfa
     )
 
 /*++
 
 Routine Description:
 
-    This routine determines if the given regular expression entry (and all
-    those after it in the list) matches the string contained in the context.
+    This routine destroys the DFA built up while executing a compiled
+    regular expression program.
 
 Arguments:
 
-    Context - Supplies a pointer to the execution context.
-
-    Entry - Supplies the regular expression entry to match.
+    Dfa - Supplies a pointer to the DFA to destroy.
 
 Return Value:
 
-    Success if there was a match.
-
-    No match if there was no match.
+    None.
 
 --*/
 
 {
 
-    PREGULAR_EXPRESSION_ENTRY BranchOption;
-    PREGULAR_EXPRESSION_CHOICE CurrentChoice;
-    ULONG DuplicateMax;
-    ULONG DuplicateMin;
-    ULONG Iteration;
-    regmatch_t *Match;
-    PREGULAR_EXPRESSION_CHOICE NextChoice;
-    PREGULAR_EXPRESSION_ENTRY Parent;
-    REGULAR_EXPRESSION_STATUS Status;
-    ULONG SubexpressionNumber;
-    BOOL UseThisEntry;
-
-    CurrentChoice = NULL;
-    Iteration = 0;
-    Status = RegexStatusSuccess;
-    UseThisEntry = FALSE;
+    if (Dfa->States != NULL) {
+        free(Dfa->States);
+    }
 
-    //
-    // Loop through every entry until none are left (success) or there are no
-    // more possible choices (failure).
-    //
+    if (Dfa->Transitions != NULL) {
+        free(Dfa->Transitions);
+    }
 
-    while (Entry != NULL) {
-        Parent = Entry->Parent;
-        DuplicateMin = Entry->DuplicateMin;
-        DuplicateMax = Entry->DuplicateMax;
+    if (Dfa->Pcs != NULL) {
+        free(Dfa->Pcs);
+    }
 
-        //
-        // Try to match this entry if it needs more iterations.
-        //
+    if (Dfa->Stack != NULL) {
+        free(Dfa->Stack);
+    }
 
-        if ((DuplicateMax == -1) || (Iteration < DuplicateMax)) {
+    if (Dfa->Visited != NULL) {
+        free(Dfa->Visited);
+    }
 
-            //
-            // If this is a subexpression, go inside.
-            //
+    if (Dfa->NextPcs != NULL) {
+        free(Dfa->NextPcs);
+    }
 
-            if (Entry->Type == RegexEntrySubexpression) {
+    free(Dfa);
+    return;
+}
 
-                //
-                // Add a choice entry, even for empty subexpressions, so the
-                // matches can be rebuilt if this choice is jumped to later.
-                //
+//
+// --------------------------------------------------------- Internal Functions
+//
 
-                if (UseThisEntry == FALSE) {
-                    CurrentChoice = ClpRegularExpressionCreateChoice(
-                                                                 Context,
-                                                                 CurrentChoice,
-                                                                 Entry,
-                                                                 Iteration);
+REGULAR_EXPRESSION_STATUS
+ClpExecuteRegularExpression (
+    PREGULAR_EXPRESSION RegularExpression,
+    PSTR String,
+    regmatch_t Match[],
+    size_t MatchArraySize,
+    int Flags
+    )
 
-                    if (CurrentChoice == NULL) {
-                        Status = RegexStatusNoMemory;
-                        goto RegularExpressionMatchEnd;
-                    }
-                }
+/*++
 
-                UseThisEntry = FALSE;
+Routine Description:
 
-                //
-                // Save the original values of the match in the choice in case
-                // this has to be undone, and mark the beginning of the match
-                // for this subexpression.
-                //
+    This routine executes a regular expression, performing a search of the
+    given string to see if it matches the regular expression.
 
-                assert(CurrentChoice->Node == Entry);
+Arguments:
 
-                SubexpressionNumber = Entry->U.SubexpressionNumber;
-                if ((SubexpressionNumber < Context->MatchSize) &&
-                    ((Context->Expression->Flags & REG_NOSUB) == 0)) {
+    RegularExpression - Supplies a pointer to the compiled regular expression.
 
-                    Match = &(Context->Match[SubexpressionNumber]);
-                    CurrentChoice->U.SavedMatchStart = Match->rm_so;
-                    CurrentChoice->U.SavedMatchEnd = Match->rm_eo;
-                    Match->rm_so = Context->NextInput;
-                    Match->rm_eo = Context->NextInput;
-                }
+    String - Supplies a pointer to the string to check for a match.
 
-                if (SubexpressionNumber < REGEX_INTERNAL_MATCH_COUNT) {
-                    Match = &(Context->InternalMatch[SubexpressionNumber]);
-                    CurrentChoice->U.SavedMatchStart = Match->rm_so;
-                    CurrentChoice->U.SavedMatchEnd = Match->rm_eo;
-                    Match->rm_so = Context->NextInput;
-                    Match->rm_eo = Context->NextInput;
-                }
+    MatchArraySize - Supplies the number of elements in the match array
+        parameter. Supply zero and the match array parameter will be ignored.
 
-                if (LIST_EMPTY(&(Entry->ChildList)) != FALSE) {
-                    Status = RegexStatusSuccess;
+    Match - Supplies an optional pointer to an array where the string indices of
+        the match and its subexpressions will be returned.
 
-                } else {
-                    Entry = LIST_VALUE(Entry->ChildList.Next,
-                                       REGULAR_EXPRESSION_ENTRY,
-                                       ListEntry);
+    Flags - Supplies a bitfield of flags governing the search. See some REG_*
+        definitions (specifically REG_NOTBOL and REG_NOTEOL).
 
-                    Iteration = 0;
-                    continue;
-                }
+Return Value:
 
-            //
-            // If this is a branch, take the first choice, push it on the stack,
-            // and loop.
-            //
+    Success if there was a match.
 
-            } else if (Entry->Type == RegexEntryBranch) {
+    No match if there was no match.
 
-                assert(Iteration == 0);
-                assert((Entry->DuplicateMin == 1) &&
-                       (Entry->DuplicateMax == 1));
+--*/
 
-                assert(LIST_EMPTY(&(Entry->ChildList)) == FALSE);
+{
 
-                Entry = LIST_VALUE(Entry->ChildList.Next,
-                                   REGULAR_EXPRESSION_ENTRY,
-                                   ListEntry);
+    REGULAR_EXPRESSION_EXECUTION Context;
+    PLIST_ENTRY FreeEntry;
+    BOOL Handled;
+    size_t MatchIndex;
+    ULONG StartIndex;
+    REGULAR_EXPRESSION_STATUS Status;
 
-                assert(Entry->Type == RegexEntryBranchOption);
-                assert(UseThisEntry == FALSE);
+    //
+    // Run the compiled program if there is one, which takes linear time. The
+    // backtracking matcher below only runs for expressions with no program
+    // (those with back references, those needing more than
+    // REGEX_PROGRAM_MAX_INSTRUCTIONS instructions, and those that ran out of
+    // memory while compiling), or when the Pike VM can't allocate its state.
+    //
 
-                CurrentChoice = ClpRegularExpressionCreateChoice(Context,
-                                                                 CurrentChoice,
-                                                                 Entry->Parent,
-                                                                 Iteration);
+    if (RegularExpression->Program != NULL) {
+        Handled = ClpExecuteRegularExpressionProgram(RegularExpression,
+                                                     String,
+                                                     Match,
+                                                     MatchArraySize,
+                                                     Flags,
+                                                     &Status);
 
-                if (CurrentChoice == NULL) {
-                    Status = RegexStatusNoMemory;
-                    goto RegularExpressionMatchEnd;
-                }
+        if (Handled != FALSE) {
+            return Status;
+        }
+    }
 
-                CurrentChoice->U.Choice = Entry;
-                continue;
+    Status = RegexStatusNoMatch;
+    INITIALIZE_LIST_HEAD(&(Context.Choices));
+    INITIALIZE_LIST_HEAD(&(Context.FreeChoices));
+    Context.Expression = RegularExpression;
+    Context.Input = String;
+    Context.InputSize = strlen(String) + 1;
+    Context.Flags = Flags;
+    Context.Match = Match;
+    Context.MatchSize = MatchArraySize;
+    if ((RegularExpression->Flags & REG_NOSUB) == 0) {
+        for (MatchIndex = 0; MatchIndex < MatchArraySize; MatchIndex += 1) {
+            Match[MatchIndex].rm_so = -1;
+            Match[MatchIndex].rm_eo = -1;
+        }
+    }
 
-            //
-            // If this is a branch option, just move on to the first child, or
-            // success if there are no children.
-            //
+    for (MatchIndex = 0;
+         MatchIndex < REGEX_INTERNAL_MATCH_COUNT;
+         MatchIndex += 1) {
 
-            } else if (Entry->Type == RegexEntryBranchOption) {
+        Context.InternalMatch[MatchIndex].rm_so = -1;
+        Context.InternalMatch[MatchIndex].rm_eo = -1;
+    }
 
-                assert(UseThisEntry == FALSE);
+    //
+    // Try to match the expression starting at each index.
+    //
 
-                if (LIST_EMPTY(&(Entry->ChildList)) != FALSE) {
-                    Status = RegexStatusSuccess;
+    for (StartIndex = 0; StartIndex < Context.InputSize; StartIndex += 1) {
 
-                } else {
-                    Entry = LIST_VALUE(Entry->ChildList.Next,
-                                       REGULAR_EXPRESSION_ENTRY,
-                                       ListEntry);
+        //
+        // If the expression is anchored to the left, then this had better be:
+        // 1) Index zero and REG_NOTBOL is clear or
+        // 2) Right after a newline and REG_NEWLINE is set.
+        // If it's not one of these things then it definitely does not match.
+        //
 
-                    continue;
-                }
+        if ((RegularExpression->BaseEntry.Flags &
+             REGULAR_EXPRESSION_ANCHORED_LEFT) != 0) {
+
+            if (!(((StartIndex == 0) && ((Flags & REG_NOTBOL) == 0)) ||
+                  (((RegularExpression->Flags & REG_NEWLINE) != 0) &&
+                   (StartIndex != 0) && (String[StartIndex - 1] == '\n')))) {
+
+                Status = RegexStatusNoMatch;
+                continue;
+            }
+        }
+
+        Context.NextInput = StartIndex;
+        Status = ClpRegularExpressionMatch(&Context,
+                                           &(RegularExpression->BaseEntry));
+
+        if (Status == RegexStatusSuccess) {
 
             //
-            // If this is neither a subexpression nor a branch, just try to
-            // match it.
+            // If the expression is anchored to the right then either:
+            // 1) The index had better be the end and REG_NOTEOL is clear or
+            // 2) REG_NEWLINE is set and it's right before a newline.
+            // If this condition isn't met then it's not a real match.
             //
 
-            } else {
-
-                //
-                // If there is a choice up in here, create a new entry for it.
-                //
+            if ((RegularExpression->BaseEntry.Flags &
+                 REGULAR_EXPRESSION_ANCHORED_RIGHT) != 0) {
 
-                if ((DuplicateMax == -1) || (DuplicateMin != DuplicateMax)) {
-                    if (UseThisEntry == FALSE) {
-                        CurrentChoice = ClpRegularExpressionCreateChoice(
-                                                                 Context,
-                                                                 CurrentChoice,
-                                                                 Entry,
-                                                                 Iteration);
+                if (!(((Context.NextInput == Context.InputSize - 1) &&
+                      ((Flags & REG_NOTEOL) == 0)) ||
+                      (((RegularExpression->Flags & REG_NEWLINE) != 0) &&
+                       (String[Context.NextInput] == '\n')))) {
 
-                        if (CurrentChoice == NULL) {
-                            Status = RegexStatusNoMemory;
-                            goto RegularExpressionMatchEnd;
-                        }
-                    }
+                    Status = RegexStatusNoMatch;
+                    continue;
                 }
-
-                UseThisEntry = FALSE;
-                Status = ClpRegularExpressionMatchEntry(Context, Entry);
             }
 
-        //
-        // The entry has already got enough iterations.
-        //
-
-        } else {
-            Status = RegexStatusSuccess;
+            break;
         }
+    }
 
-        UseThisEntry = FALSE;
+    //
+    // Save the overall match if found.
+    //
 
-        //
-        // Down here, something must have matched or not. Either an empty
-        // subexpression, empty branch, or something substantive. Now's the time
-        // to deal with that success or failure.
-        //
+    if (Status == RegexStatusSuccess) {
+        if (((RegularExpression->Flags & REG_NOSUB) == 0) &&
+            (MatchArraySize > 0)) {
 
-        if (Status == RegexStatusSuccess) {
+            Match[0].rm_so = StartIndex;
+            Match[0].rm_eo = Context.NextInput;
+        }
 
-            //
-            // Move on to the next node, which may involve popping up several
-            // levels.
-            //
+    //
+    // On failure, blank out the matches again.
+    //
 
-            while (TRUE) {
-                Iteration += 1;
+    } else if ((RegularExpression->Flags & REG_NOSUB) == 0) {
+        for (MatchIndex = 0; MatchIndex < MatchArraySize; MatchIndex += 1) {
+            Match[MatchIndex].rm_so = -1;
+            Match[MatchIndex].rm_eo = -1;
+        }
+    }
 
-                //
-                // If the input didn't move anywhere, this just matched an
-                // empty expression. Prevent that from happening infinitely.
-                //
+    //
+    // Destroy any remaining choices.
+    //
 
-                if ((Context->NextInput == CurrentChoice->SavedNextIndex) &&
-                    (DuplicateMax != 1)) {
+    assert(LIST_EMPTY(&(Context.Choices)) != FALSE);
 
-                    assert(CurrentChoice->Node == Entry);
+    while (!LIST_EMPTY(&(Context.FreeChoices))) {
+        FreeEntry = Context.FreeChoices.Next;
+        LIST_REMOVE(FreeEntry);
+        free(FreeEntry);
+    }
 
-                    DuplicateMax = Iteration;
-                }
+    return Status;
+}
 
-                //
-                // If there are more duplicates of this entry to find, then
-                // gosh darnit go find them.
-                //
+REGULAR_EXPRESSION_STATUS
+ClpRegularExpressionMatch (
+    PREGULAR_EXPRESSION_EXECUTION Context,
+    PREGULAR_EXPRESSION_ENTRY Entry
+    )
 
-                if ((DuplicateMax == -1) || (Iteration < DuplicateMax)) {
-                    break;
-                }
+/*++
 
-                //
-                // Splendid, it's time to move forward. If this was a
-                // subexpression, mark its ending.
-                //
+Routine Description:
 
-                ClpRegularExpressionMarkEnd(Context, Entry);
+    This routine determines if the given regular expression entry (and all
+    those after it in the list) matches the string contained in the context.
 
-                //
-                // Whether the next entry is the sibling or the parent, move the
-                // current choice up if it corresponds to this entry.
-                //
+Arguments:
 
-                if (CurrentChoice->Node == Entry) {
-                    CurrentChoice = CurrentChoice->Parent;
-                }
+    Context - Supplies a pointer to the execution context.
 
-                //
-                // If there's another expression right next to this one,
-                // just move to it.
-                //
+    Entry - Supplies the regular expression entry to match.
 
-                if ((Parent != NULL) &&
-                    (Entry->ListEntry.Next != &(Parent->ChildList))) {
+Return Value:
 
-                    Entry = LIST_VALUE(Entry->ListEntry.Next,
-                                       REGULAR_EXPRESSION_ENTRY,
-                                       ListEntry);
+    Success if there was a match.
 
-                    assert(Entry->Parent == Parent);
+    No match if there was no match.
 
-                    Iteration = 0;
-                    break;
-                }
+--*/
 
-                Entry = Parent;
+{
 
-                //
-                // If there are no more entries, then this entire regular
-                // expression matches.
-                //
+    PREGULAR_EXPRESSION_ENTRY BranchOption;
+    PREGULAR_EXPRESSION_CHOICE CurrentChoice;
+    ULONG DuplicateMax;
+    ULONG DuplicateMin;
+    ULONG Iteration;
+    regmatch_t *Match;
+    PREGULAR_EXPRESSION_CHOICE NextChoice;
+    PREGULAR_EXPRESSION_ENTRY Parent;
+    REGULAR_EXPRESSION_STATUS Status;
+    ULONG SubexpressionNumber;
+    BOOL UseThisEntry;
 
-                if (Entry == NULL) {
-                    goto RegularExpressionMatchEnd;
-                }
+    CurrentChoice = NULL;
+    Iteration = 0;
+    Status = RegexStatusSuccess;
+    UseThisEntry = FALSE;
 
-                if (Entry->Type == RegexEntryBranchOption) {
-                    Entry = Entry->Parent;
+    //
+    // Loop through every entry until none are left (success) or there are no
+    // more possible choices (failure).
+    //
+
+    while (Entry != NULL) {
+        Parent = Entry->Parent;
+        DuplicateMin = Entry->DuplicateMin;
+        DuplicateMax = Entry->DuplicateMax;
+
+        //
+        // Try to match this entry if it needs more iterations.
+        //
+
+        if ((DuplicateMax == -1) || (Iteration < DuplicateMax)) {
+
+            //
+            // If this is a subexpression, go inside.
+            //
+
+            if (Entry->Type == RegexEntrySubexpression) {
+
+                //
+                // Add a choice entry, even for empty subexpressions, so the
+                // matches can be rebuilt if this choice is jumped to later.
+                //
+
+                if (UseThisEntry == FALSE) {
+                    CurrentChoice = ClpRegularExpressionCreateChoice(
+                                                                 Context,
+                                                                 CurrentChoice,
+                                                                 Entry,
+                                                                 Iteration);
+
+                    if (CurrentChoice == NULL) {
+                        Status = RegexStatusNoMemory;
+                        goto RegularExpressionMatchEnd;
+                    }
                 }
 
-                Parent = Entry->Parent;
+                UseThisEntry = FALSE;
+
+                //
+                // Save the original values of the match in the choice in case
+                // this has to be undone, and mark the beginning of the match
+                // for this subexpression.
+                //
 
                 assert(CurrentChoice->Node == Entry);
 
-                if (Entry->Type == RegexEntryBranch) {
-                    Iteration = 0;
-                    DuplicateMax = 1;
+                SubexpressionNumber = Entry->U.SubexpressionNumber;
+                if ((SubexpressionNumber < Context->MatchSize) &&
+                    ((Context->Expression->Flags & REG_NOSUB) == 0)) {
+
+                    Match = &(Context->Match[SubexpressionNumber]);
+                    CurrentChoice->U.SavedMatchStart = Match->rm_so;
+                    CurrentChoice->U.SavedMatchEnd = Match->rm_eo;
+                    Match->rm_so = Context->NextInput;
+                    Match->rm_eo = Context->NextInput;
+                }
+
+                if (SubexpressionNumber < REGEX_INTERNAL_MATCH_COUNT) {
+                    Match = &(Context->InternalMatch[SubexpressionNumber]);
+                    CurrentChoice->U.SavedMatchStart = Match->rm_so;
+                    CurrentChoice->U.SavedMatchEnd = Match->rm_eo;
+                    Match->rm_so = Context->NextInput;
+                    Match->rm_eo = Context->NextInput;
+                }
+
+                if (LIST_EMPTY(&(Entry->ChildList)) != FALSE) {
+                    Status = RegexStatusSuccess;
 
                 } else {
-                    Iteration = CurrentChoice->U.Iteration;
-                    DuplicateMax = Entry->DuplicateMax;
+                    Entry = LIST_VALUE(Entry->ChildList.Next,
+                                       REGULAR_EXPRESSION_ENTRY,
+                                       ListEntry);
+
+                    Iteration = 0;
+                    continue;
                 }
-            }
 
-            continue;
+            //
+            // If this is a branch, take the first choice, push it on the stack,
+            // and loop.
+            //
 
-        //
-        // This didn't match, it's time to re-evaluate one of the previous
-        // decisions.
-        //
+            } else if (Entry->Type == RegexEntryBranch) {
 
-        } else if (Status == RegexStatusNoMatch) {
-            while (CurrentChoice != NULL) {
+                assert(Iteration == 0);
+                assert((Entry->DuplicateMin == 1) &&
+                       (Entry->DuplicateMax == 1));
 
-                //
-                // Find the last decision made, which may not be the current
-                // decision if the current entry is working on a top level
-                // subexpression when the last decision was way down inside the
-                // previous subexpression.
-                //
+                assert(LIST_EMPTY(&(Entry->ChildList)) == FALSE);
 
-                while (LIST_EMPTY(&(CurrentChoice->ChildList)) == FALSE) {
-                    CurrentChoice = LIST_VALUE(
-                                             CurrentChoice->ChildList.Previous,
-                                             REGULAR_EXPRESSION_CHOICE,
-                                             ListEntry);
+                Entry = LIST_VALUE(Entry->ChildList.Next,
+                                   REGULAR_EXPRESSION_ENTRY,
+                                   ListEntry);
+
+                assert(Entry->Type == RegexEntryBranchOption);
+                assert(UseThisEntry == FALSE);
+
+                CurrentChoice = ClpRegularExpressionCreateChoice(Context,
+                                                                 CurrentChoice,
+                                                                 Entry->Parent,
+                                                                 Iteration);
+
+                if (CurrentChoice == NULL) {
+                    Status = RegexStatusNoMemory;
+                    goto RegularExpressionMatchEnd;
                 }
 
-                //
-                // Restore the subexpression match values to what they were
-                // before the choice.
-                //
+                CurrentChoice->U.Choice = Entry;
+                continue;
 
-                Entry = CurrentChoice->Node;
-                if (Entry->Type == RegexEntrySubexpression) {
-                    SubexpressionNumber = Entry->U.SubexpressionNumber;
-                    if ((SubexpressionNumber < Context->MatchSize) &&
-                        ((Context->Expression->Flags & REG_NOSUB) == 0)) {
+            //
+            // If this is a branch option, just move on to the first child, or
+            // success if there are no children.
+            //
 
-                        Match = &(Context->Match[SubexpressionNumber]);
-                        Match->rm_so = CurrentChoice->U.SavedMatchStart;
-                        Match->rm_eo = CurrentChoice->U.SavedMatchEnd;
-                    }
+            } else if (Entry->Type == RegexEntryBranchOption) {
 
-                    if (SubexpressionNumber < REGEX_INTERNAL_MATCH_COUNT) {
-                        Match =
-                            &(Context->InternalMatch[SubexpressionNumber]);
+                assert(UseThisEntry == FALSE);
 
-                        Match->rm_so = CurrentChoice->U.SavedMatchStart;
-                        Match->rm_eo = CurrentChoice->U.SavedMatchEnd;
-                    }
+                if (LIST_EMPTY(&(Entry->ChildList)) != FALSE) {
+                    Status = RegexStatusSuccess;
+
+                } else {
+                    Entry = LIST_VALUE(Entry->ChildList.Next,
+                                       REGULAR_EXPRESSION_ENTRY,
+                                       ListEntry);
+
+                    continue;
                 }
 
-                assert((Entry->Type == RegexEntryBranch) ||
-                       (Entry->Type == RegexEntrySubexpression) ||
-                       (Entry->DuplicateMax != Entry->DuplicateMin));
+            //
+            // If this is neither a subexpression nor a branch, just try to
+            // match it.
+            //
+
+            } else {
 
                 //
-                // If the entry was a branch, try to move on to the next branch
-                // option.
+                // If there is a choice up in here, create a new entry for it.
                 //
 
-                if (Entry->Type == RegexEntryBranch) {
-                    BranchOption = CurrentChoice->U.Choice;
-                    if (BranchOption->ListEntry.Next != &(Entry->ChildList)) {
-                        Entry = LIST_VALUE(BranchOption->ListEntry.Next,
-                                           REGULAR_EXPRESSION_ENTRY,
-                                           ListEntry);
-
-                        CurrentChoice->U.Choice = Entry;
-
-                        assert(Entry->Type == RegexEntryBranchOption);
+                if ((DuplicateMax == -1) || (DuplicateMin != DuplicateMax)) {
+                    if (UseThisEntry == FALSE) {
+                        CurrentChoice = ClpRegularExpressionCreateChoice(
+                                                                 Context,
+                                                                 CurrentChoice,
+                                                                 Entry,
+                                                                 Iteration);
 
-                        Context->NextInput = CurrentChoice->SavedNextIndex;
-                        break;
+                        if (CurrentChoice == NULL) {
+                            Status = RegexStatusNoMemory;
+                            goto RegularExpressionMatchEnd;
+                        }
                     }
+                }
 
-                //
-                // Try to pop the last repeat off and keep going.
-                //
+                UseThisEntry = FALSE;
+                Status = ClpRegularExpressionMatchEntry(Context, Entry);
+            }
 
-                } else {
-                    if (CurrentChoice->U.Iteration + 1 > Entry->DuplicateMin) {
-                        Context->NextInput = CurrentChoice->SavedNextIndex;
-                        NextChoice = CurrentChoice;
+        //
+        // The entry has already got enough iterations.
+        //
 
-                        //
-                        // Move to the next entry.
-                        //
+        } else {
+            Status = RegexStatusSuccess;
+        }
 
-                        while ((Entry->Parent != NULL) &&
-                               ((Entry->Type == RegexEntryBranchOption) ||
-                                (Entry->ListEntry.Next ==
-                                 &(Entry->Parent->ChildList)))) {
+        UseThisEntry = FALSE;
 
-                            if (Entry->Type == RegexEntryBranchOption) {
-                                Entry = Entry->Parent;
-                                continue;
-                            }
+        //
+        // Down here, something must have matched or not. Either an empty
+        // subexpression, empty branch, or something substantive. Now's the time
+        // to deal with that success or failure.
+        //
 
-                            ClpRegularExpressionMarkEnd(Context, Entry);
-                            Entry = Entry->Parent;
-                            NextChoice = NextChoice->Parent;
-                        }
+        if (Status == RegexStatusSuccess) {
 
-                        ClpRegularExpressionMarkEnd(Context, Entry);
+            //
+            // Move on to the next node, which may involve popping up several
+            // levels.
+            //
+
+            while (TRUE) {
+                Iteration += 1;
+
+                //
+                // If the input didn't move anywhere, this just matched an
+                // empty expression. Prevent that from happening infinitely.
+                //
+
+                if ((Context->NextInput == CurrentChoice->SavedNextIndex) &&
+                    (DuplicateMax != 1)) {
+
+                    assert(CurrentChoice->Node == Entry);
+
+                    DuplicateMax = Iteration;
+                }
+
+                //
+                // If there are more duplicates of this entry to find, then
+                // gosh darnit go find them.
+                //
+
+                if ((DuplicateMax == -1) || (Iteration < DuplicateMax)) {
+                    break;
+                }
+
+                //
+                // Splendid, it's time to move forward. If this was a
+                // subexpression, mark its ending.
+                //
+
+                ClpRegularExpressionMarkEnd(Context, Entry);
+
+                //
+                // Whether the next entry is the sibling or the parent, move the
+                // current choice up if it corresponds to this entry.
+                //
+
+                if (CurrentChoice->Node == Entry) {
+                    CurrentChoice = CurrentChoice->Parent;
+                }
+
+                //
+                // If there's another expression right next to this one,
+                // just move to it.
+                //
+
+                if ((Parent != NULL) &&
+                    (Entry->ListEntry.Next != &(Parent->ChildList))) {
+
+                    Entry = LIST_VALUE(Entry->ListEntry.Next,
+                                       REGULAR_EXPRESSION_ENTRY,
+                                       ListEntry);
+
+                    assert(Entry->Parent == Parent);
+
+                    Iteration = 0;
+                    break;
+                }
+
+                Entry = Parent;
+
+                //
+                // If there are no more entries, then this entire regular
+                // expression matches.
+                //
+
+                if (Entry == NULL) {
+                    goto RegularExpressionMatchEnd;
+                }
+
+                if (Entry->Type == RegexEntryBranchOption) {
+                    Entry = Entry->Parent;
+                }
+
+                Parent = Entry->Parent;
+
+                assert(CurrentChoice->Node == Entry);
+
+                if (Entry->Type == RegexEntryBranch) {
+                    Iteration = 0;
+                    DuplicateMax = 1;
+
+                } else {
+                    Iteration = CurrentChoice->U.Iteration;
+                    DuplicateMax = Entry->DuplicateMax;
+                }
+            }
+
+            continue;
+
+        //
+        // This didn't match, it's time to re-evaluate one of the previous
+        // decisions.
+        //
+
+        } else if (Status == RegexStatusNoMatch) {
+            while (CurrentChoice != NULL) {
+
+                //
+                // Find the last decision made, which may not be the current
+                // decision if the current entry is working on a top level
+                // subexpression when the last decision was way down inside the
+                // previous subexpression.
+                //
+
+                while (LIST_EMPTY(&(CurrentChoice->ChildList)) == FALSE) {
+                    CurrentChoice = LIST_VALUE(
+                                             CurrentChoice->ChildList.Previous,
+                                             REGULAR_EXPRESSION_CHOICE,
+                                             ListEntry);
+                }
+
+                //
+                // Restore the subexpression match values to what they were
+                // before the choice.
+                //
+
+                Entry = CurrentChoice->Node;
+                if (Entry->Type == RegexEntrySubexpression) {
+                    SubexpressionNumber = Entry->U.SubexpressionNumber;
+                    if ((SubexpressionNumber < Context->MatchSize) &&
+                        ((Context->Expression->Flags & REG_NOSUB) == 0)) {
+
+                        Match = &(Context->Match[SubexpressionNumber]);
+                        Match->rm_so = CurrentChoice->U.SavedMatchStart;
+                        Match->rm_eo = CurrentChoice->U.SavedMatchEnd;
+                    }
+
+                    if (SubexpressionNumber < REGEX_INTERNAL_MATCH_COUNT) {
+                        Match =
+                            &(Context->InternalMatch[SubexpressionNumber]);
+
+                        Match->rm_so = CurrentChoice->U.SavedMatchStart;
+                        Match->rm_eo = CurrentChoice->U.SavedMatchEnd;
+                    }
+                }
+
+                assert((Entry->Type == RegexEntryBranch) ||
+                       (Entry->Type == RegexEntrySubexpression) ||
+                       (Entry->DuplicateMax != Entry->DuplicateMin));
+
+                //
+                // If the entry was a branch, try to move on to the next branch
+                // option.
+                //
+
+                if (Entry->Type == RegexEntryBranch) {
+                    BranchOption = CurrentChoice->U.Choice;
+                    if (BranchOption->ListEntry.Next != &(Entry->ChildList)) {
+                        Entry = LIST_VALUE(BranchOption->ListEntry.Next,
+                                           REGULAR_EXPRESSION_ENTRY,
+                                           ListEntry);
+
+                        CurrentChoice->U.Choice = Entry;
+
+                        assert(Entry->Type == RegexEntryBranchOption);
+
+                        Context->NextInput = CurrentChoice->SavedNextIndex;
+                        break;
+                    }
+
+                //
+                // Try to pop the last repeat off and keep going.
+                //
+
+                } else {
+                    if (CurrentChoice->U.Iteration + 1 > Entry->DuplicateMin) {
+                        Context->NextInput = CurrentChoice->SavedNextIndex;
+                        NextChoice = CurrentChoice;
+
+                        //
+                        // Move to the next entry.
+                        //
+
+                        while ((Entry->Parent != NULL) &&
+                               ((Entry->Type == RegexEntryBranchOption) ||
+                                (Entry->ListEntry.Next ==
+                                 &(Entry->Parent->ChildList)))) {
+
+                            if (Entry->Type == RegexEntryBranchOption) {
+                                Entry = Entry->Parent;
+                                continue;
+                            }
+
+                            ClpRegularExpressionMarkEnd(Context, Entry);
+                            Entry = Entry->Parent;
+                            NextChoice = NextChoice->Parent;
+                        }
+
+                        ClpRegularExpressionMarkEnd(Context, Entry);
+
+                        //
+                        // If this was the last element, then popping this
+                        // failing iteration causes the expression to pass.
+                        //
+
+                        if (Entry->Parent == NULL) {
+                            Entry = NULL;
+                            Status = RegexStatusSuccess;
+
+                        } else {
+                            Entry = LIST_VALUE(Entry->ListEntry.Next,
+                                               REGULAR_EXPRESSION_ENTRY,
+                                               ListEntry);
+                        }
+
+                        NextChoice = NextChoice->Parent;
+                        LIST_REMOVE(&(CurrentChoice->ListEntry));
+                        ClpRegularExpressionDestroyChoice(Context,
+                                                          CurrentChoice);
+
+                        CurrentChoice = NextChoice;
+                        Iteration = 0;
+                        break;
+                    }
+                }
+
+                //
+                // Figure out what the previous choice is, which is basically
+                // one back and then all the way deep. If that's not available,
+                // then go to the parent.
+                //
+
+                if ((CurrentChoice->Parent != NULL) &&
+                    (CurrentChoice->ListEntry.Previous !=
+                     &(CurrentChoice->Parent->ChildList))) {
+
+                    NextChoice = LIST_VALUE(CurrentChoice->ListEntry.Previous,
+                                            REGULAR_EXPRESSION_CHOICE,
+                                            ListEntry);
+
+                    while (LIST_EMPTY(&(NextChoice->ChildList)) == FALSE) {
+                        NextChoice = LIST_VALUE(NextChoice->ChildList.Previous,
+                                                REGULAR_EXPRESSION_CHOICE,
+                                                ListEntry);
+                    }
+
+                } else {
+                    NextChoice = CurrentChoice->Parent;
+                }
+
+                assert(CurrentChoice != NextChoice);
+
+                //
+                // Pop and destroy this choice, moving back to the previous
+                // choice.
+                //
+
+                LIST_REMOVE(&(CurrentChoice->ListEntry));
+                ClpRegularExpressionDestroyChoice(Context, CurrentChoice);
+                CurrentChoice = NextChoice;
+                if (CurrentChoice != NULL) {
+                    Entry = CurrentChoice->Node;
+
+                } else {
+                    goto RegularExpressionMatchEnd;
+                }
+            }
+
+            continue;
+
+        //
+        // Something bizarre happened, return that failure.
+        //
+
+        } else {
+            goto RegularExpressionMatchEnd;
+        }
+    }
+
+RegularExpressionMatchEnd:
+
+    //
+    // Destroy the choice tree.
+    //
+
+    if (LIST_EMPTY(&(Context->Choices)) == FALSE) {
+        CurrentChoice = LIST_VALUE(Context->Choices.Next,
+                                   REGULAR_EXPRESSION_CHOICE,
+                                   ListEntry);
+
+        LIST_REMOVE(&(CurrentChoice->ListEntry));
+        ClpRegularExpressionDestroyChoice(Context, CurrentChoice);
+    }
+
+    assert(LIST_EMPTY(&(Context->Choices)) != FALSE);
+
+    return Status;
+}
+
+REGULAR_EXPRESSION_STATUS
+ClpRegularExpressionMatchEntry (
+    PREGULAR_EXPRESSION_EXECUTION Context,
+    PREGULAR_EXPRESSION_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines if a single occurrence of the given entry matches
+    the string in the context.
+
+Arguments:
+
+    Context - Supplies a pointer to the execution context.
+
+    Entry - Supplies the regular expression entry to match.
+
+Return Value:
+
+    Success if there was a match.
+
+    No match if there was no match.
+
+--*/
+
+{
+
+    CHAR Character;
+    regmatch_t *Match;
+    REGULAR_EXPRESSION_STATUS Status;
+
+    Status = RegexStatusNoMatch;
+    switch (Entry->Type) {
+    case RegexEntryOrdinaryCharacters:
+        Status = ClpRegularExpressionMatchOrdinaryCharacters(Context, Entry);
+        break;
+
+    case RegexEntryAnyCharacter:
+
+        //
+        // As long as it's not the end of the string or a null terminator then
+        // this matches. If the newline flag is set, then newlines don't match
+        // either.
+        //
+
+        if ((Context->NextInput < Context->InputSize) &&
+            (Context->Input[Context->NextInput] != '\0') &&
+            ((Context->Input[Context->NextInput] != '\n') ||
+             ((Context->Expression->Flags & REG_NEWLINE) == 0))) {
+
+            Status = RegexStatusSuccess;
+            Context->NextInput += 1;
+        }
+
+        break;
+
+    //
+    // Back references match against the value matched in a previous subgroup.
+    //
+
+    case RegexEntryBackReference:
+
+        assert(Entry->U.BackReferenceNumber < REGEX_INTERNAL_MATCH_COUNT);
+
+        Match = &(Context->InternalMatch[Entry->U.BackReferenceNumber]);
+        if ((Match->rm_so != -1) && (Match->rm_eo != -1)) {
+            Status = ClpRegularExpressionMatchString(
+                                                 Context,
+                                                 Context->Input + Match->rm_so,
+                                                 Match->rm_eo - Match->rm_so);
+        }
+
+        break;
+
+    case RegexEntryBracketExpression:
+        Status = ClpRegularExpressionMatchBracketExpression(Context, Entry);
+        break;
+
+    case RegexEntryStringBegin:
+
+        //
+        // The input is said to be at the beginning if either:
+        // 1) It's at the beginning of the input and "not beginning of line" is
+        //    clear. OR
+        // 2) The newline flag is set and the current input is right after a
+        //    newline.
+        //
+
+        if ((((Context->Flags & REG_NOTBOL) == 0) &&
+             (Context->NextInput == 0)) ||
+            (((Context->Expression->Flags & REG_NEWLINE) != 0) &&
+             (Context->NextInput != 0) &&
+             (Context->Input[Context->NextInput - 1] == '\n'))) {
+
+            Status = RegexStatusSuccess;
+        }
+
+        break;
+
+    case RegexEntryStringEnd:
+
+        //
+        // The input is said to be at the end if either:
+        // 1) It's at the end of the input and "not end of line" is clear. OR
+        // 2) The newline flag is set and the current input is right before a
+        //    newline.
+        //
+
+        if ((((Context->Flags & REG_NOTEOL) == 0) &&
+             ((Context->NextInput >= Context->InputSize) ||
+              (Context->Input[Context->NextInput] == '\0'))) ||
+            (((Context->Expression->Flags & REG_NEWLINE) != 0) &&
+             (Context->NextInput < Context->InputSize) &&
+             (Context->Input[Context->NextInput] == '\n'))) {
+
+            Status = RegexStatusSuccess;
+        }
+
+        break;
+
+    case RegexEntryStartOfWord:
+
+        //
+        // Match at a position that is followed by a word character but not
+        // preceded by a word character (the beginning counts as not a word
+        // character). The match is zero in length.
+        //
+
+        if ((Context->NextInput < Context->InputSize) &&
+            (REGULAR_EXPRESSION_IS_NAME(Context->Input[Context->NextInput]))) {
+
+            if (Context->NextInput == 0) {
+                Status = RegexStatusSuccess;
+
+            } else {
+                Character = Context->Input[Context->NextInput - 1];
+                if (!REGULAR_EXPRESSION_IS_NAME(Character)) {
+                    Status = RegexStatusSuccess;
+                }
+            }
+        }
+
+        break;
+
+    case RegexEntryEndOfWord:
+
+        //
+        // Match at a position that is preceded by a word character but is not
+        // followed by a word character. The end counts as not a word
+        // character. The match is zero in length.
+        //
+
+        if (Context->NextInput == 0) {
+            break;
+        }
+
+        Character = Context->Input[Context->NextInput - 1];
+        if (REGULAR_EXPRESSION_IS_NAME(Character)) {
+            if (Context->NextInput >= Context->InputSize) {
+                Status = RegexStatusSuccess;
+
+            } else {
+                Character = Context->Input[Context->NextInput];
+                if (!REGULAR_EXPRESSION_IS_NAME(Character)) {
+                    Status = RegexStatusSuccess;
+                }
+            }
+        }
+
+        break;
+
+    default:
+
+        assert(FALSE);
+
+        break;
+    }
+
+    return Status;
+}
+
+REGULAR_EXPRESSION_STATUS
+ClpRegularExpressionMatchOrdinaryCharacters (
+    PREGULAR_EXPRESSION_EXECUTION Context,
+    PREGULAR_EXPRESSION_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines if the given regular expression entry matches the
+    string contained in the context.
+
+Arguments:
+
+    Context - Supplies a pointer to the execution context.
+
+    Entry - Supplies the regular expression entry to match.
+
+Return Value:
+
+    Success if there was a match.
+
+    No match if there was no match.
+
+--*/
+
+{
+
+    PSTR CompareString;
+    ULONG CompareStringSize;
+    REGULAR_EXPRESSION_STATUS Status;
+
+    assert(Entry->Type == RegexEntryOrdinaryCharacters);
+
+    CompareString = Entry->U.String.Data;
+
+    assert(Entry->U.String.Size != 0);
+
+    CompareStringSize = Entry->U.String.Size;
+    Status = ClpRegularExpressionMatchString(Context,
+                                             CompareString,
+                                             CompareStringSize);
+
+    return Status;
+}
+
+REGULAR_EXPRESSION_STATUS
+ClpRegularExpressionMatchString (
+    PREGULAR_EXPRESSION_EXECUTION Context,
+    PSTR CompareString,
+    ULONG CompareStringSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines if the given regular expression entry matches the
+    string contained in the context.
+
+Arguments:
+
+    Context - Supplies a pointer to the execution context.
+
+    CompareString - Supplies a pointer to the string to compare the input to.
+
+    CompareStringSize - Supplies the size of the compare string in bytes
+        not including the null terminator (unless that's part of what should be
+        compared).
+
+Return Value:
+
+    Success if there was a match.
+
+    No match if there was no match.
+
+--*/
+
+{
+
+    CHAR Character;
+    BOOL IgnoreCase;
+    ULONG Index;
+    PSTR String;
+    ULONG StringSize;
+
+    Index = 0;
+    String = Context->Input + Context->NextInput;
+    StringSize = Context->InputSize - Context->NextInput;
+
+    //
+    // Shortcut if the input isn't even as large as the ordinary characters.
+    //
+
+    if (StringSize < CompareStringSize) {
+        return RegexStatusNoMatch;
+    }
+
+    IgnoreCase = FALSE;
+    if ((Context->Expression->Flags & REG_ICASE) != 0) {
+        IgnoreCase = TRUE;
+    }
+
+    //
+    // Loop comparing characters.
+    //
+
+    while (Index < CompareStringSize) {
+        Character = String[Index];
+
+        //
+        // Things are on ice if the string doesn't exactly match.
+        //
+
+        if (Character != CompareString[Index]) {
+
+            //
+            // If the ignore case flag is not set or the strings don't match
+            // even after converting to lowercase, then the string really
+            // does not match.
+            //
+
+            if ((IgnoreCase == FALSE) ||
+                (tolower(Character) != tolower(CompareString[Index]))) {
+
+                return RegexStatusNoMatch;
+            }
+        }
+
+        Index += 1;
+    }
+
+    //
+    // The loop got all the way through without failing, so this matches.
+    //
+
+    Context->NextInput += Index;
+    return RegexStatusSuccess;
+}
+
+REGULAR_EXPRESSION_STATUS
+ClpRegularExpressionMatchBracketExpression (
+    PREGULAR_EXPRESSION_EXECUTION Context,
+    PREGULAR_EXPRESSION_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines if the given regular expression entry matches the
+    given bracket expression.
+
+Arguments:
+
+    Context - Supplies a pointer to the execution context.
+
+    Entry - Supplies the regular expression entry to match.
+
+Return Value:
+
+    Success if there was a match.
+
+    No match if there was no match.
+
+--*/
+
+{
+
+    CHAR Character;
+    BOOL Matches;
+
+    assert(Entry->Type == RegexEntryBracketExpression);
+
+    if (Context->NextInput >= Context->InputSize) {
+        return RegexStatusNoMatch;
+    }
+
+    Character = Context->Input[Context->NextInput];
+    if (Character == '\0') {
+        return RegexStatusNoMatch;
+    }
+
+    Matches = ClpRegularExpressionMatchBracket(Context->Expression,
+                                               Entry,
+                                               Character);
+
+    if (Matches == FALSE) {
+        return RegexStatusNoMatch;
+    }
+
+    Context->NextInput += 1;
+    return RegexStatusSuccess;
+}
+
+VOID
+ClpRegularExpressionMarkEnd (
+    PREGULAR_EXPRESSION_EXECUTION Context,
+    PREGULAR_EXPRESSION_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks the end of a subexpression match for a subexpression
+    that just finished matching.
+
+Arguments:
+
+    Context - Supplies a pointer to the execution context.
+
+    Entry - Supplies a pointer to the regular expression entry that just
+        finished matching.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    regmatch_t *Match;
+    ULONG SubexpressionNumber;
+
+    if (Entry->Type != RegexEntrySubexpression) {
+        return;
+    }
+
+    SubexpressionNumber = Entry->U.SubexpressionNumber;
+    if ((SubexpressionNumber < Context->MatchSize) &&
+        ((Context->Expression->Flags & REG_NOSUB) == 0)) {
+
+        Match = &(Context->Match[SubexpressionNumber]);
+        Match->rm_eo = Context->NextInput;
+    }
+
+    if (SubexpressionNumber < REGEX_INTERNAL_MATCH_COUNT) {
+        Match = &(Context->InternalMatch[SubexpressionNumber]);
+        Match->rm_eo = Context->NextInput;
+    }
+
+    return;
+}
+
+PREGULAR_EXPRESSION_CHOICE
+ClpRegularExpressionCreateChoice (
+    PREGULAR_EXPRESSION_EXECUTION Context,
+    PREGULAR_EXPRESSION_CHOICE Parent,
+    PREGULAR_EXPRESSION_ENTRY Entry,
+    ULONG Iteration
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates a new regular expression choice structure,
+    initializes it, and adds it to the proper place in the choice tree.
+
+Arguments:
+
+    Context - Supplies a pointer to the execution context.
+
+    Parent - Supplies an optional pointer to the parent to add the choice
+        under. If this is null, the choice will be added directly into the
+        context.
+
+    Entry - Supplies a pointer to the expression corresponding to this choice.
+
+    Iteration - Supplies the iteration (duplicate) count of this entry. If this
+        is not the first iteration, then the choice will be added to the
+        parent of the given parent choice so that dupilcates appear as siblings
+        (presumably the previous duplicate is the previous entry in the list,
+        which is an assumption taken when backtracking).
+
+Return Value:
+
+    Returns a pointer to the choice structure on success.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    PREGULAR_EXPRESSION_CHOICE NewChoice;
+
+    //
+    // Attempt to use one from the free list if there is any, or allocate one
+    // otherwise.
+    //
+
+    if (LIST_EMPTY(&(Context->FreeChoices)) == FALSE) {
+        NewChoice = LIST_VALUE(Context->FreeChoices.Next,
+                               REGULAR_EXPRESSION_CHOICE,
+                               ListEntry);
+
+        LIST_REMOVE(&(NewChoice->ListEntry));
+
+    } else {
+        NewChoice = malloc(sizeof(REGULAR_EXPRESSION_CHOICE));
+        if (NewChoice == NULL) {
+            return NULL;
+        }
+    }
+
+    memset(NewChoice, 0, sizeof(REGULAR_EXPRESSION_CHOICE));
+    INITIALIZE_LIST_HEAD(&(NewChoice->ChildList));
+    NewChoice->Parent = Parent;
+    NewChoice->Node = Entry;
+    NewChoice->SavedNextIndex = Context->NextInput;
+    NewChoice->U.Iteration = Iteration;
+    if (Iteration != 0) {
+
+        //
+        // Make repeats siblings of each other.
+        //
+
+        assert((Parent != NULL) && (Parent->Parent != NULL));
+
+        NewChoice->Parent = Parent->Parent;
+        INSERT_BEFORE(&(NewChoice->ListEntry), &(Parent->Parent->ChildList));
+
+    } else {
+        if (Parent != NULL) {
+            INSERT_BEFORE(&(NewChoice->ListEntry), &(Parent->ChildList));
+
+        } else {
+            INSERT_BEFORE(&(NewChoice->ListEntry), &(Context->Choices));
+        }
+    }
+
+    return NewChoice;
+}
+
+VOID
+ClpRegularExpressionDestroyChoice (
+    PREGULAR_EXPRESSION_EXECUTION Context,
+    PREGULAR_EXPRESSION_CHOICE Choice
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys a regular expression choice and recursively all of
+    its child choices. It is assumed that this choice is already removed from
+    its parent list.
+
+Arguments:
+
+    Context - Supplies a pointer to the execution context.
+
+    Choice - Supplies a pointer to the choice to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PREGULAR_EXPRESSION_CHOICE CurrentChoice;
+    PREGULAR_EXPRESSION_CHOICE NextChoice;
+
+    //
+    // Destroy the choice tree.
+    //
+
+    if (LIST_EMPTY(&(Choice->ChildList)) == FALSE) {
+        CurrentChoice = LIST_VALUE(Choice->ChildList.Next,
+                                   REGULAR_EXPRESSION_CHOICE,
+                                   ListEntry);
+
+        while (CurrentChoice != NULL) {
+
+            assert(CurrentChoice != Choice);
+
+            //
+            // Find the first leaf node.
+            //
+
+            while (LIST_EMPTY(&(CurrentChoice->ChildList)) == FALSE) {
+                CurrentChoice = LIST_VALUE(CurrentChoice->ChildList.Next,
+                                           REGULAR_EXPRESSION_CHOICE,
+                                           ListEntry);
+            }
+
+            //
+            // Get the next entry (the parent of this leaf).
+            //
+
+            if (CurrentChoice->Parent != Choice) {
+                NextChoice = CurrentChoice->Parent;
+
+            //
+            // If the parent is the main, this is a top level choice.
+            //
+
+            } else if (CurrentChoice->ListEntry.Next != &(Choice->ChildList)) {
+                NextChoice = LIST_VALUE(CurrentChoice->ListEntry.Next,
+                                        REGULAR_EXPRESSION_CHOICE,
+                                        ListEntry);
+
+            //
+            // If this was the last top level choice, then be done.
+            //
+
+            } else {
+                NextChoice = NULL;
+            }
+
+            assert(LIST_EMPTY(&(CurrentChoice->ChildList)) != FALSE);
+
+            LIST_REMOVE(&(CurrentChoice->ListEntry));
+
+            //
+            // Stick this on the head of the free list, as it's hottest in the
+            // cache.
+            //
+
+            INSERT_AFTER(&(CurrentChoice->ListEntry), &(Context->FreeChoices));
+            CurrentChoice = NextChoice;
+        }
+    }
+
+    free(Choice);
+    return;
+}
+
+
+BOOL
+ClpExecuteRegularExpressionProgram (
+    PREGULAR_EXPRESSION RegularExpression,
+    PSTR String,
+    regmatch_t Match[],
+    size_t MatchArraySize,
+    int Flags,
+    PREGULAR_EXPRESSION_STATUS Status
+    )
+
+/*++
+
+Routine Description:
 
-                        //
-                        // If this was the last element, then popping this
-                        // failing iteration causes the expression to pass.
-                        //
+    This routine executes a regular expression using its compiled program.
+    The DFA decides whether or not there is a match at all, and the Pike VM
+    finds the subexpression matches if they're wanted.
 
-                        if (Entry->Parent == NULL) {
-                            Entry = NULL;
-                            Status = RegexStatusSuccess;
+Arguments:
 
-                        } else {
-                            Entry = LIST_VALUE(Entry->ListEntry.Next,
-                                               REGULAR_EXPRESSION_ENTRY,
-                                               ListEntry);
-                        }
+    RegularExpression - Supplies a pointer to the compiled regular expression.
 
-                        NextChoice = NextChoice->Parent;
-                        LIST_REMOVE(&(CurrentChoice->ListEntry));
-                        ClpRegularExpressionDestroyChoice(Context,
-                                                          CurrentChoice);
+    String - Supplies a pointer to the string to check for a match.
 
-                        CurrentChoice = NextChoice;
-                        Iteration = 0;
-                        break;
-                    }
-                }
+    MatchArraySize - Supplies the number of elements in the match array
+        parameter.
 
-                //
-                // Figure out what the previous choice is, which is basically
-                // one back and then all the way deep. If that's not available,
-                // then go to the parent.
-                //
+    Match - Supplies an optional pointer to an array where the string indices of
+        the match and its subexpressions will be returned.
 
-                if ((CurrentChoice->Parent != NULL) &&
-                    (CurrentChoice->ListEntry.Previous !=
-                     &(CurrentChoice->Parent->ChildList))) {
+    Flags - Supplies a bitfield of flags governing the search. See some REG_*
+        definitions (specifically REG_NOTBOL and REG_NOTEOL).
 
-                    NextChoice = LIST_VALUE(CurrentChoice->ListEntry.Previous,
-                                            REGULAR_EXPRESSION_CHOICE,
-                                            ListEntry);
+    Status - Supplies a pointer where the result will be returned: success if
+        there was a match or no match if there was not.
 
-                    while (LIST_EMPTY(&(NextChoice->ChildList)) == FALSE) {
-                        NextChoice = LIST_VALUE(NextChoice->ChildList.Previous,
-                                                REGULAR_EXPRESSION_CHOICE,
-                                                ListEntry);
-                    }
+Return Value:
 
-                } else {
-                    NextChoice = CurrentChoice->Parent;
-                }
+    TRUE if the program was run.
 
-                assert(CurrentChoice != NextChoice);
+    FALSE if the Pike VM could not allocate its state, in which case the
+    backtracking matcher should run instead.
 
-                //
-                // Pop and destroy this choice, moving back to the previous
-                // choice.
-                //
+--*/
 
-                LIST_REMOVE(&(CurrentChoice->ListEntry));
-                ClpRegularExpressionDestroyChoice(Context, CurrentChoice);
-                CurrentChoice = NextChoice;
-                if (CurrentChoice != NULL) {
-                    Entry = CurrentChoice->Node;
+{
 
-                } else {
-                    goto RegularExpressionMatchEnd;
-                }
-            }
+    size_t MatchIndex;
+    REGEX_DFA_RESULT Result;
 
-            continue;
+    Result = ClpSearchRegexDfa(RegularExpression, String, Flags);
+    if (Result == RegexDfaNoMatch) {
+        *Status = RegexStatusNoMatch;
+        goto ExecuteRegularExpressionProgramEnd;
+    }
 
-        //
-        // Something bizarre happened, return that failure.
-        //
+    if ((Result == RegexDfaMatch) &&
+        (((RegularExpression->Flags & REG_NOSUB) != 0) ||
+         (MatchArraySize == 0))) {
 
-        } else {
-            goto RegularExpressionMatchEnd;
-        }
+        *Status = RegexStatusSuccess;
+        return TRUE;
     }
 
-RegularExpressionMatchEnd:
+    *Status = ClpRunRegexPikeVm(RegularExpression,
+                                String,
+                                Match,
+                                MatchArraySize,
+                                Flags);
 
     //
-    // Destroy the choice tree.
+    // The DFA and the Pike VM simulate the same program, so they agree on
+    // whether or not there is a match. The differential test in the C library
+    // tests holds them to that. The only reason to hand the search to the
+    // backtracking matcher is a Pike VM that couldn't get its memory.
     //
 
-    if (LIST_EMPTY(&(Context->Choices)) == FALSE) {
-        CurrentChoice = LIST_VALUE(Context->Choices.Next,
-                                   REGULAR_EXPRESSION_CHOICE,
-                                   ListEntry);
+    assert((*Status != RegexStatusNoMatch) || (Result != RegexDfaMatch));
 
-        LIST_REMOVE(&(CurrentChoice->ListEntry));
-        ClpRegularExpressionDestroyChoice(Context, CurrentChoice);
+    if (*Status == RegexStatusNoMemory) {
+        return FALSE;
     }
 
-    assert(LIST_EMPTY(&(Context->Choices)) != FALSE);
+ExecuteRegularExpressionProgramEnd:
+    if ((*Status != RegexStatusSuccess) &&
+        ((RegularExpression->Flags & REG_NOSUB) == 0)) {
 
-    return Status;
+        for (MatchIndex = 0; MatchIndex < MatchArraySize; MatchIndex += 1) {
+            Match[MatchIndex].rm_so = -1;
+            Match[MatchIndex].rm_eo = -1;
+        }
+    }
+
+    return TRUE;
 }
 
-REGULAR_EXPRESSION_STATUS
-ClpRegularExpressionMatchEntry (
-    PREGULAR_EXPRESSION_EXECUTION Context,
-    PREGULAR_EXPRESSION_ENTRY Entry
+REGEX_DFA_RESULT
+ClpSearchRegexDfa (
+    PREGULAR_EXPRESSION RegularExpression,
+    PSTR String,
+    int Flags
     )
 
 /*++
 
 Routine Description:
 
-    This routine determines if a single occurrence of the given entry matches
-    the string in the context.
+    This routine determines whether or not a compiled program matches
+    anywhere in the given string by running its DFA, building states as they
+    are needed.
 
 Arguments:
 
-    Context - Supplies a pointer to the execution context.
+    RegularExpression - Supplies a pointer to the compiled regular expression.
 
-    Entry - Supplies the regular expression entry to match.
+    String - Supplies a pointer to the string to search.
 
-Return Value:
+    Flags - Supplies a bitfield of flags governing the search. See some REG_*
+        definitions (specifically REG_NOTBOL and REG_NOTEOL).
 
-    Success if there was a match.
+Return Value:
 
-    No match if there was no match.
+    Returns the result of the search. The DFA gives up if another thread is
+    using it, if it's too big, or if allocations fail.
 
 --*/
 
 {
 
-    CHAR Character;
-    regmatch_t *Match;
-    REGULAR_EXPRESSION_STATUS Status;
+    ULONG ClassCount;
+    ULONG Context;
+    PREGEX_DFA Dfa;
+    PUCHAR Input;
+    LONG Next;
+    PREGEX_PROGRAM Program;
+    REGEX_DFA_RESULT Result;
+    LONG State;
+    ULONG StartPc;
+
+    Program = RegularExpression->Program;
+    if (REGEX_TRY_LOCK(&(Program->DfaLock)) == FALSE) {
+        return RegexDfaGaveUp;
+    }
 
-    Status = RegexStatusNoMatch;
-    switch (Entry->Type) {
-    case RegexEntryOrdinaryCharacters:
-        Status = ClpRegularExpressionMatchOrdinaryCharacters(Context, Entry);
-        break;
+    Result = RegexDfaGaveUp;
+    Dfa = Program->Dfa;
+    if (Dfa == NULL) {
+        Dfa = ClpCreateRegexDfa(Program);
+        if (Dfa == NULL) {
+            goto SearchRegexDfaEnd;
+        }
 
-    case RegexEntryAnyCharacter:
+        Program->Dfa = Dfa;
+    }
 
-        //
-        // As long as it's not the end of the string or a null terminator then
-        // this matches. If the newline flag is set, then newlines don't match
-        // either.
-        //
+    if (Dfa->ResetCount > REGEX_DFA_MAX_RESETS) {
+        goto SearchRegexDfaEnd;
+    }
 
-        if ((Context->NextInput < Context->InputSize) &&
-            (Context->Input[Context->NextInput] != '\0') &&
-            ((Context->Input[Context->NextInput] != '\n') ||
-             ((Context->Expression->Flags & REG_NEWLINE) == 0))) {
+    Context = REGEX_CONTEXT_START;
+    if ((Flags & REG_NOTBOL) != 0) {
+        Context = REGEX_CONTEXT_START_NOT_BOL;
+    }
 
-            Status = RegexStatusSuccess;
-            Context->NextInput += 1;
-        }
+    StartPc = 0;
+    State = ClpAddRegexDfaState(Program, Dfa, &StartPc, 1, Context);
+    if (State < 0) {
+        goto SearchRegexDfaEnd;
+    }
 
-        break;
+    ClassCount = Program->ClassCount;
+    Input = (PUCHAR)String;
+    while (TRUE) {
+        if (*Input != '\0') {
+            Next = Dfa->Transitions[(State * ClassCount) +
+                                    Program->ByteClass[*Input]];
+
+            if (Next == REGEX_DFA_UNKNOWN) {
+                Next = ClpComputeRegexDfaTransition(RegularExpression,
+                                                    Dfa,
+                                                    State,
+                                                    *Input,
+                                                    Flags);
+
+                if (Next != REGEX_DFA_UNKNOWN) {
+                    Dfa->Transitions[(State * ClassCount) +
+                                     Program->ByteClass[*Input]] = Next;
+                }
+            }
 
-    //
-    // Back references match against the value matched in a previous subgroup.
-    //
+        } else {
+            Next = ClpComputeRegexDfaTransition(RegularExpression,
+                                                Dfa,
+                                                State,
+                                                '\0',
+                                                Flags);
+        }
 
-    case RegexEntryBackReference:
+        if (Next == REGEX_DFA_MATCH) {
+            Result = RegexDfaMatch;
+            break;
 
-        assert(Entry->U.BackReferenceNumber < REGEX_INTERNAL_MATCH_COUNT);
+        } else if (Next == REGEX_DFA_DEAD) {
+            Result = RegexDfaNoMatch;
+            break;
 
-        Match = &(Context->InternalMatch[Entry->U.BackReferenceNumber]);
-        if ((Match->rm_so != -1) && (Match->rm_eo != -1)) {
-            Status = ClpRegularExpressionMatchString(
-                                                 Context,
-                                                 Context->Input + Match->rm_so,
-                                                 Match->rm_eo - Match->rm_so);
+        //
+        // If the DFA is full, throw it away and let the Pike VM handle this
+        // one.
+        //
+
+        } else if (Next == REGEX_DFA_UNKNOWN) {
+            ClpResetRegexDfa(Dfa);
+            Dfa->ResetCount += 1;
+            break;
         }
 
-        break;
+        State = Next;
+        Input += 1;
+    }
 
-    case RegexEntryBracketExpression:
-        Status = ClpRegularExpressionMatchBracketExpression(Context, Entry);
-        break;
+SearchRegexDfaEnd:
+    REGEX_UNLOCK(&(Program->DfaLock));
+    return Result;
+}
 
-    case RegexEntryStringBegin:
+LONG
+ClpComputeRegexDfaTransition (
+    PREGULAR_EXPRESSION RegularExpression,
+    PREGEX_DFA Dfa,
+    ULONG StateIndex,
+    UCHAR Byte,
+    int Flags
+    )
 
-        //
-        // The input is said to be at the beginning if either:
-        // 1) It's at the beginning of the input and "not beginning of line" is
-        //    clear. OR
-        // 2) The newline flag is set and the current input is right after a
-        //    newline.
-        //
+/*++
 
-        if ((((Context->Flags & REG_NOTBOL) == 0) &&
-             (Context->NextInput == 0)) ||
-            (((Context->Expression->Flags & REG_NEWLINE) != 0) &&
-             (Context->NextInput != 0) &&
-             (Context->Input[Context->NextInput - 1] == '\n'))) {
+Routine Description:
 
-            Status = RegexStatusSuccess;
-        }
+    This routine computes where a DFA state goes on the given byte. It
+    follows every thread in the state (plus a new one starting at this
+    position) through the program until they reach an instruction that
+    consumes input, then steps those over the byte.
 
-        break;
+Arguments:
 
-    case RegexEntryStringEnd:
+    RegularExpression - Supplies a pointer to the compiled regular expression.
 
-        //
-        // The input is said to be at the end if either:
-        // 1) It's at the end of the input and "not end of line" is clear. OR
-        // 2) The newline flag is set and the current input is right before a
-        //    newline.
-        //
+    Dfa - Supplies a pointer to the DFA.
 
-        if ((((Context->Flags & REG_NOTEOL) == 0) &&
-             ((Context->NextInput >= Context->InputSize) ||
-              (Context->Input[Context->NextInput] == '\0'))) ||
-            (((Context->Expression->Flags & REG_NEWLINE) != 0) &&
-             (Context->NextInput < Context->InputSize) &&
-             (Context->Input[Context->NextInput] == '\n'))) {
+    StateIndex - Supplies the index of the state to transition from.
 
-            Status = RegexStatusSuccess;
-        }
+    Byte - Supplies the next byte of input, or the null terminator if the
+        input ends here.
 
-        break;
+    Flags - Supplies the execution flags, which matter at the end of input.
 
-    case RegexEntryStartOfWord:
+Return Value:
 
-        //
-        // Match at a position that is followed by a word character but not
-        // preceded by a word character (the beginning counts as not a word
-        // character). The match is zero in length.
-        //
+    Returns the index of the next state, REGEX_DFA_MATCH if a thread matched
+    before consuming the byte, REGEX_DFA_DEAD if no thread survives the byte,
+    or REGEX_DFA_UNKNOWN if the DFA is full.
 
-        if ((Context->NextInput < Context->InputSize) &&
-            (REGULAR_EXPRESSION_IS_NAME(Context->Input[Context->NextInput]))) {
+--*/
 
-            if (Context->NextInput == 0) {
-                Status = RegexStatusSuccess;
+{
 
-            } else {
-                Character = Context->Input[Context->NextInput - 1];
-                if (!REGULAR_EXPRESSION_IS_NAME(Character)) {
-                    Status = RegexStatusSuccess;
-                }
-            }
-        }
+    ULONG Context;
+    ULONG EndKnown;
+    ULONG EndMatch;
+    ULONG Index;
+    PREGEX_INSTRUCTION Instruction;
+    BOOL Matched;
+    ULONG NextCount;
+    ULONG Pc;
+    PREGEX_PROGRAM Program;
+    ULONG StackSize;
+    PREGEX_DFA_STATE State;
 
-        break;
+    Program = RegularExpression->Program;
+    State = &(Dfa->States[StateIndex]);
 
-    case RegexEntryEndOfWord:
+    //
+    // Whether or not the input matches when it ends here depends on
+    // REG_NOTEOL, so cache both answers separately.
+    //
 
-        //
-        // Match at a position that is preceded by a word character but is not
-        // followed by a word character. The end counts as not a word
-        // character. The match is zero in length.
-        //
+    EndKnown = REGEX_DFA_END_KNOWN;
+    EndMatch = REGEX_DFA_END_MATCH;
+    if ((Flags & REG_NOTEOL) != 0) {
+        EndKnown = REGEX_DFA_NOT_EOL_END_KNOWN;
+        EndMatch = REGEX_DFA_NOT_EOL_END_MATCH;
+    }
 
-        if (Context->NextInput == 0) {
-            break;
+    if ((Byte == '\0') && ((State->EndFlags & EndKnown) != 0)) {
+        if ((State->EndFlags & EndMatch) != 0) {
+            return REGEX_DFA_MATCH;
         }
 
-        Character = Context->Input[Context->NextInput - 1];
-        if (REGULAR_EXPRESSION_IS_NAME(Character)) {
-            if (Context->NextInput >= Context->InputSize) {
-                Status = RegexStatusSuccess;
+        return REGEX_DFA_DEAD;
+    }
 
-            } else {
-                Character = Context->Input[Context->NextInput];
-                if (!REGULAR_EXPRESSION_IS_NAME(Character)) {
-                    Status = RegexStatusSuccess;
-                }
-            }
+    //
+    // Start a new visit generation, clearing out the visited array if the
+    // generation number wraps.
+    //
+
+    Dfa->Generation += 1;
+    if (Dfa->Generation == 0) {
+        memset(Dfa->Visited, 0, Program->InstructionCount * sizeof(ULONG));
+        Dfa->Generation = 1;
+    }
+
+    Context = State->Context;
+    StackSize = State->PcCount;
+    for (Index = 0; Index < StackSize; Index += 1) {
+        Dfa->Stack[Index] = Dfa->Pcs[State->PcOffset + StackSize - 1 - Index];
+    }
+
+    Matched = FALSE;
+    NextCount = 0;
+    while (StackSize != 0) {
+        StackSize -= 1;
+        Pc = Dfa->Stack[StackSize];
+        if (Dfa->Visited[Pc] == Dfa->Generation) {
+            continue;
         }
 
-        break;
+        Dfa->Visited[Pc] = Dfa->Generation;
+        Instruction = &(Program->Instructions[Pc]);
+        switch (Instruction->Opcode) {
+        case RegexOpByteSet:
+            if ((Byte != '\0') &&
+                (REGEX_SET_CONTAINS(&(Program->Sets[Instruction->Argument]),
+                                    Byte))) {
 
-    default:
+                Dfa->NextPcs[NextCount] = Pc + 1;
+                NextCount += 1;
+            }
 
-        assert(FALSE);
+            break;
 
-        break;
-    }
+        case RegexOpSplit:
+            Dfa->Stack[StackSize] = Instruction->Alternate;
+            Dfa->Stack[StackSize + 1] = Instruction->Target;
+            StackSize += 2;
+            break;
 
-    return Status;
-}
+        case RegexOpJump:
+            Dfa->Stack[StackSize] = Instruction->Target;
+            StackSize += 1;
+            break;
 
-REGULAR_EXPRESSION_STATUS
-ClpRegularExpressionMatchOrdinaryCharacters (
-    PREGULAR_EXPRESSION_EXECUTION Context,
-    PREGULAR_EXPRESSION_ENTRY Entry
-    )
+        //
+        // Only whether or not there's a match matters here, not where it is.
+        // An empty loop iteration could always have gone around again, so
+        // check empty instructions just fall through.
+        //
 
-/*++
+        case RegexOpSave:
+        case RegexOpCheckEmpty:
+            Dfa->Stack[StackSize] = Pc + 1;
+            StackSize += 1;
+            break;
 
-Routine Description:
+        case RegexOpAssert:
+            if (ClpCheckRegexAssertion(RegularExpression,
+                                       Instruction->Argument,
+                                       Context,
+                                       Byte,
+                                       Flags) != FALSE) {
 
-    This routine determines if the given regular expression entry matches the
-    string contained in the context.
+                Dfa->Stack[StackSize] = Pc + 1;
+                StackSize += 1;
+            }
 
-Arguments:
+            break;
 
-    Context - Supplies a pointer to the execution context.
+        case RegexOpMatch:
+            Matched = TRUE;
+            break;
 
-    Entry - Supplies the regular expression entry to match.
+        default:
 
-Return Value:
+            assert(FALSE);
 
-    Success if there was a match.
+            break;
+        }
+    }
 
-    No match if there was no match.
+    if (Byte == '\0') {
+        State->EndFlags |= EndKnown;
+        if (Matched != FALSE) {
+            State->EndFlags |= EndMatch;
+            return REGEX_DFA_MATCH;
+        }
 
---*/
+        return REGEX_DFA_DEAD;
+    }
 
-{
+    if (Matched != FALSE) {
+        return REGEX_DFA_MATCH;
+    }
 
-    PSTR CompareString;
-    ULONG CompareStringSize;
-    REGULAR_EXPRESSION_STATUS Status;
+    //
+    // Unless the program is anchored, a new thread starts at every position.
+    // Then sort the threads so that equivalent states look the same.
+    //
 
-    assert(Entry->Type == RegexEntryOrdinaryCharacters);
+    if (Program->Anchored == FALSE) {
+        Dfa->NextPcs[NextCount] = 0;
+        NextCount += 1;
+    }
 
-    CompareString = Entry->U.String.Data;
+    if (NextCount == 0) {
+        return REGEX_DFA_DEAD;
+    }
 
-    assert(Entry->U.String.Size != 0);
+    for (Index = 1; Index < NextCount; Index += 1) {
+        Pc = Dfa->NextPcs[Index];
+        StackSize = Index;
+        while ((StackSize != 0) && (Dfa->NextPcs[StackSize - 1] > Pc)) {
+            Dfa->NextPcs[StackSize] = Dfa->NextPcs[StackSize - 1];
+            StackSize -= 1;
+        }
 
-    CompareStringSize = Entry->U.String.Size;
-    Status = ClpRegularExpressionMatchString(Context,
-                                             CompareString,
-                                             CompareStringSize);
+        Dfa->NextPcs[StackSize] = Pc;
+    }
 
-    return Status;
+    return ClpAddRegexDfaState(Program,
+                               Dfa,
+                               Dfa->NextPcs,
+                               NextCount,
+                               ClpGetRegexContext(RegularExpression, Byte));
 }
 
-REGULAR_EXPRESSION_STATUS
-ClpRegularExpressionMatchString (
-    PREGULAR_EXPRESSION_EXECUTION Context,
-    PSTR CompareString,
-    ULONG CompareStringSize
+LONG
+ClpAddRegexDfaState (
+    PREGEX_PROGRAM Program,
+    PREGEX_DFA Dfa,
+    PULONG Pcs,
+    ULONG PcCount,
+    ULONG Context
     )
 
 /*++
 
 Routine Description:
 
-    This routine determines if the given regular expression entry matches the
-    string contained in the context.
+    This routine finds the DFA state with the given program counters and
+    context, creating it if it doesn't exist yet.
 
 Arguments:
 
-    Context - Supplies a pointer to the execution context.
+    Program - Supplies a pointer to the program.
 
-    CompareString - Supplies a pointer to the string to compare the input to.
+    Dfa - Supplies a pointer to the DFA.
 
-    CompareStringSize - Supplies the size of the compare string in bytes
-        not including the null terminator (unless that's part of what should be
-        compared).
+    Pcs - Supplies a pointer to the sorted array of program counters.
+
+    PcCount - Supplies the number of program counters.
+
+    Context - Supplies the context of the state.
 
 Return Value:
 
-    Success if there was a match.
+    Returns the index of the state.
 
-    No match if there was no match.
+    REGEX_DFA_UNKNOWN if the DFA is full or an allocation failed.
 
 --*/
 
 {
 
-    CHAR Character;
-    BOOL IgnoreCase;
+    ULONG Bucket;
+    ULONG Hash;
     ULONG Index;
-    PSTR String;
-    ULONG StringSize;
-
-    Index = 0;
-    String = Context->Input + Context->NextInput;
-    StringSize = Context->InputSize - Context->NextInput;
+    LONG Match;
+    PVOID NewBuffer;
+    ULONG NewCapacity;
+    PREGEX_DFA_STATE State;
+
+    Hash = 2166136261U ^ Context;
+    for (Index = 0; Index < PcCount; Index += 1) {
+        Hash = (Hash ^ Pcs[Index]) * 16777619U;
+    }
 
-    //
-    // Shortcut if the input isn't even as large as the ordinary characters.
-    //
+    Bucket = Hash & (REGEX_DFA_HASH_SIZE - 1);
+    Match = Dfa->Buckets[Bucket];
+    while (Match >= 0) {
+        State = &(Dfa->States[Match]);
+        if ((State->Hash == Hash) && (State->Context == Context) &&
+            (State->PcCount == PcCount) &&
+            (memcmp(&(Dfa->Pcs[State->PcOffset]),
+                    Pcs,
+                    PcCount * sizeof(ULONG)) == 0)) {
+
+            return Match;
+        }
 
-    if (StringSize < CompareStringSize) {
-        return RegexStatusNoMatch;
+        Match = State->NextInBucket;
     }
 
-    IgnoreCase = FALSE;
-    if ((Context->Expression->Flags & REG_ICASE) != 0) {
-        IgnoreCase = TRUE;
+    if ((Dfa->StateCount == REGEX_DFA_MAX_STATES) ||
+        (Dfa->PcCount + PcCount > REGEX_DFA_MAX_PCS)) {
+
+        return REGEX_DFA_UNKNOWN;
     }
 
     //
-    // Loop comparing characters.
+    // Make room for the new state and its row of transitions.
     //
 
-    while (Index < CompareStringSize) {
-        Character = String[Index];
+    if (Dfa->StateCount == Dfa->StateCapacity) {
+        NewCapacity = Dfa->StateCapacity * 2;
+        NewBuffer = realloc(Dfa->States,
+                            NewCapacity * sizeof(REGEX_DFA_STATE));
 
-        //
-        // Things are on ice if the string doesn't exactly match.
-        //
+        if (NewBuffer == NULL) {
+            return REGEX_DFA_UNKNOWN;
+        }
 
-        if (Character != CompareString[Index]) {
+        Dfa->States = NewBuffer;
+        NewBuffer = realloc(Dfa->Transitions,
+                            NewCapacity * Program->ClassCount * sizeof(LONG));
 
-            //
-            // If the ignore case flag is not set or the strings don't match
-            // even after converting to lowercase, then the string really
-            // does not match.
-            //
+        if (NewBuffer == NULL) {
+            return REGEX_DFA_UNKNOWN;
+        }
 
-            if ((IgnoreCase == FALSE) ||
-                (tolower(Character) != tolower(CompareString[Index]))) {
+        Dfa->Transitions = NewBuffer;
+        Dfa->StateCapacity = NewCapacity;
+    }
 
-                return RegexStatusNoMatch;
-            }
+    if (Dfa->PcCount + PcCount > Dfa->PcCapacity) {
+        NewCapacity = Dfa->PcCapacity * 2;
+        while (Dfa->PcCount + PcCount > NewCapacity) {
+            NewCapacity *= 2;
         }
 
-        Index += 1;
+        NewBuffer = realloc(Dfa->Pcs, NewCapacity * sizeof(ULONG));
+        if (NewBuffer == NULL) {
+            return REGEX_DFA_UNKNOWN;
+        }
+
+        Dfa->Pcs = NewBuffer;
+        Dfa->PcCapacity = NewCapacity;
     }
 
-    //
-    // The loop got all the way through without failing, so this matches.
-    //
+    Match = Dfa->StateCount;
+    State = &(Dfa->States[Match]);
+    State->Hash = Hash;
+    State->NextInBucket = Dfa->Buckets[Bucket];
+    State->PcOffset = Dfa->PcCount;
+    State->PcCount = PcCount;
+    State->Context = Context;
+    State->EndFlags = 0;
+    memcpy(&(Dfa->Pcs[Dfa->PcCount]), Pcs, PcCount * sizeof(ULONG));
+    Dfa->PcCount += PcCount;
+    for (Index = 0; Index < Program->ClassCount; Index += 1) {
+        Dfa->Transitions[(Match * Program->ClassCount) + Index] =
+                                                             REGEX_DFA_UNKNOWN;
+    }
 
-    Context->NextInput += Index;
-    return RegexStatusSuccess;
+    Dfa->Buckets[Bucket] = Match;
+    Dfa->StateCount += 1;
+    return Match;
 }
 
-REGULAR_EXPRESSION_STATUS
-ClpRegularExpressionMatchBracketExpression (
-    PREGULAR_EXPRESSION_EXECUTION Context,
-    PREGULAR_EXPRESSION_ENTRY Entry
+PREGEX_DFA
+ClpCreateRegexDfa (
+    PREGEX_PROGRAM Program
     )
 
 /*++
 
 Routine Description:
 
-    This routine determines if the given regular expression entry matches the
-    given bracket expression.
+    This routine creates an empty DFA for the given program.
 
 Arguments:
 
-    Context - Supplies a pointer to the execution context.
-
-    Entry - Supplies the regular expression entry to match.
+    Program - Supplies a pointer to the program.
 
 Return Value:
 
-    Success if there was a match.
+    Returns a pointer to the new DFA on success.
 
-    No match if there was no match.
+    NULL on allocation failure.
 
 --*/
 
 {
 
-    PREGULAR_BRACKET_ENTRY BracketEntry;
-    PREGULAR_BRACKET_EXPRESSION BracketExpression;
-    CHAR Character;
-    ULONG CharacterCount;
-    ULONG CharacterIndex;
-    PLIST_ENTRY CurrentEntry;
-    PSTR RegularCharacters;
-    REGULAR_EXPRESSION_STATUS Status;
-
-    assert(Entry->Type == RegexEntryBracketExpression);
+    PREGEX_DFA Dfa;
+    ULONG InstructionCount;
 
-    if (Context->NextInput >= Context->InputSize) {
-        return RegexStatusNoMatch;
+    InstructionCount = Program->InstructionCount;
+    Dfa = malloc(sizeof(REGEX_DFA));
+    if (Dfa == NULL) {
+        return NULL;
     }
 
-    Character = Context->Input[Context->NextInput];
-    if (Character == '\0') {
-        return RegexStatusNoMatch;
-    }
+    memset(Dfa, 0, sizeof(REGEX_DFA));
+    Dfa->StateCapacity = REGEX_DFA_INITIAL_STATES;
+    Dfa->States = malloc(Dfa->StateCapacity * sizeof(REGEX_DFA_STATE));
+    Dfa->Transitions = malloc(Dfa->StateCapacity * Program->ClassCount *
+                              sizeof(LONG));
 
-    Status = RegexStatusNoMatch;
-    BracketExpression = &(Entry->U.BracketExpression);
-    CharacterCount = BracketExpression->RegularCharacters.Size;
-    RegularCharacters = BracketExpression->RegularCharacters.Data;
+    Dfa->PcCapacity = REGEX_DFA_INITIAL_PCS;
+    Dfa->Pcs = malloc(Dfa->PcCapacity * sizeof(ULONG));
 
     //
-    // First match against any of the regular characters.
+    // Every instruction is visited at most once while following the program,
+    // pushing at most two more, on top of the state's own program counters.
     //
 
-    for (CharacterIndex = 0;
-         CharacterIndex < CharacterCount;
-         CharacterIndex += 1) {
-
-        if ((Character == RegularCharacters[CharacterIndex]) ||
-            (((Context->Expression->Flags & REG_ICASE) != 0) &&
-              (tolower(Character) ==
-               tolower(RegularCharacters[CharacterIndex])))) {
+    Dfa->Stack = malloc(((InstructionCount * 3) + 1) * sizeof(ULONG));
+    Dfa->Visited = malloc(InstructionCount * sizeof(ULONG));
+    Dfa->NextPcs = malloc((InstructionCount + 1) * sizeof(ULONG));
+    if ((Dfa->States == NULL) || (Dfa->Transitions == NULL) ||
+        (Dfa->Pcs == NULL) || (Dfa->Stack == NULL) ||
+        (Dfa->Visited == NULL) || (Dfa->NextPcs == NULL)) {
 
-            Status = RegexStatusSuccess;
-            goto RegularExpressionMatchBracketExpressionEnd;
-        }
+        ClpDestroyRegularExpressionDfa(Dfa);
+        return NULL;
     }
 
-    //
-    // Go through the list of other stuff and see if any of that matches.
-    //
+    memset(Dfa->Visited, 0, InstructionCount * sizeof(ULONG));
+    ClpResetRegexDfa(Dfa);
+    return Dfa;
+}
 
-    CurrentEntry = BracketExpression->EntryList.Next;
-    while (CurrentEntry != &(BracketExpression->EntryList)) {
-        BracketEntry = LIST_VALUE(CurrentEntry,
-                                  REGULAR_BRACKET_ENTRY,
-                                  ListEntry);
+VOID
+ClpResetRegexDfa (
+    PREGEX_DFA Dfa
+    )
 
-        CurrentEntry = CurrentEntry->Next;
-        switch (BracketEntry->Type) {
-        case BracketExpressionRange:
-            if ((Character >= BracketEntry->U.Range.Minimum) &&
-                (Character <= BracketEntry->U.Range.Maximum)) {
+/*++
 
-                Status = RegexStatusSuccess;
-            }
+Routine Description:
 
-            break;
+    This routine throws away all the states in a DFA.
 
-        case BracketExpressionCharacterClassAlphanumeric:
-            if (isalnum(Character)) {
-                Status = RegexStatusSuccess;
-            }
+Arguments:
 
-            break;
+    Dfa - Supplies a pointer to the DFA.
 
-        case BracketExpressionCharacterClassAlphabetic:
-            if (isalpha(Character)) {
-                Status = RegexStatusSuccess;
-            }
+Return Value:
 
-            break;
+    None.
 
-        case BracketExpressionCharacterClassBlank:
-            if (isblank(Character)) {
-                Status = RegexStatusSuccess;
-            }
+--*/
 
-            break;
+{
 
-        case BracketExpressionCharacterClassControl:
-            if (iscntrl(Character)) {
-                Status = RegexStatusSuccess;
-            }
+    Dfa->StateCount = 0;
+    Dfa->PcCount = 0;
+    memset(Dfa->Buckets, 0xFF, sizeof(Dfa->Buckets));
+    return;
+}
 
-            break;
+REGULAR_EXPRESSION_STATUS
+ClpRunRegexPikeVm (
+    PREGULAR_EXPRESSION RegularExpression,
+    PSTR String,
+    regmatch_t Match[],
+    size_t MatchArraySize,
+    int Flags
+    )
 
-        case BracketExpressionCharacterClassDigit:
-            if (isdigit(Character)) {
-                Status = RegexStatusSuccess;
-            }
+/*++
 
-            break;
+Routine Description:
 
-        case BracketExpressionCharacterClassGraph:
-            if (isgraph(Character)) {
-                Status = RegexStatusSuccess;
-            }
+    This routine finds the match of a compiled program and its subexpressions
+    by running all of the program's threads in lock step over the input.
 
-            break;
+Arguments:
 
-        case BracketExpressionCharacterClassLowercase:
-            if ((islower(Character)) ||
-                (((Context->Expression->Flags & REG_ICASE) != 0) &&
-                 (isupper(Character)))) {
+    RegularExpression - Supplies a pointer to the compiled regular expression.
 
-                Status = RegexStatusSuccess;
-            }
+    String - Supplies a pointer to the string to search.
 
-            break;
+    Match - Supplies an optional pointer to an array where the string indices of
+        the match and its subexpressions will be returned.
 
-        case BracketExpressionCharacterClassPrintable:
-            if (isprint(Character)) {
-                Status = RegexStatusSuccess;
-            }
+    MatchArraySize - Supplies the number of elements in the match array.
+
+    Flags - Supplies a bitfield of flags governing the search. See some REG_*
+        definitions (specifically REG_NOTBOL and REG_NOTEOL).
+
+Return Value:
+
+    Success if there was a match.
+
+    No match if there was no match.
+
+    No memory if the Pike VM couldn't allocate its state.
+
+--*/
 
-            break;
+{
 
-        case BracketExpressionCharacterClassPunctuation:
-            if (ispunct(Character)) {
-                Status = RegexStatusSuccess;
-            }
+    PVOID Allocation;
+    UCHAR Byte;
+    PREGEX_THREAD_LIST Current;
+    ULONG Index;
+    PREGEX_INSTRUCTION Instruction;
+    ULONG InstructionCount;
+    BOOL Matched;
+    size_t MatchIndex;
+    PREGEX_THREAD_LIST Next;
+    regoff_t Position;
+    PREGEX_PROGRAM Program;
+    regoff_t *Result;
+    ULONG SlotCount;
+    ULONG SlotIndex;
+    PREGEX_THREAD_LIST Swap;
+    REGEX_PIKE_VM Vm;
+
+    Program = RegularExpression->Program;
+    InstructionCount = Program->InstructionCount;
+    SlotCount = Program->SlotCount;
 
-            break;
+    //
+    // Carve everything out of a single allocation. The slot arrays go first
+    // to keep them aligned.
+    //
 
-        case BracketExpressionCharacterClassSpace:
-            if (isspace(Character)) {
-                Status = RegexStatusSuccess;
-            }
+    Allocation = calloc(1,
+                        (((InstructionCount * 2) + 2) * SlotCount *
+                         sizeof(regoff_t)) +
+                        ((InstructionCount + 1) * sizeof(REGEX_STACK_ENTRY)) +
+                        (InstructionCount * 4 * sizeof(ULONG)));
 
-            break;
+    if (Allocation == NULL) {
+        return RegexStatusNoMemory;
+    }
 
-        case BracketExpressionCharacterClassUppercase:
-            if ((isupper(Character)) ||
-                (((Context->Expression->Flags & REG_ICASE) != 0) &&
-                 (islower(Character)))) {
+    Vm.Expression = RegularExpression;
+    Vm.Program = Program;
+    Vm.Input = (PUCHAR)String;
+    Vm.Flags = Flags;
+    Vm.Lists[0].Slots = Allocation;
+    Vm.Lists[1].Slots = Vm.Lists[0].Slots + (InstructionCount * SlotCount);
+    Vm.Work = Vm.Lists[1].Slots + (InstructionCount * SlotCount);
+    Result = Vm.Work + SlotCount;
+    Vm.Stack = (PREGEX_STACK_ENTRY)(Result + SlotCount);
+    Vm.Lists[0].Pcs = (PULONG)(Vm.Stack + InstructionCount + 1);
+    Vm.Lists[0].Sparse = Vm.Lists[0].Pcs + InstructionCount;
+    Vm.Lists[1].Pcs = Vm.Lists[0].Sparse + InstructionCount;
+    Vm.Lists[1].Sparse = Vm.Lists[1].Pcs + InstructionCount;
+    Vm.Lists[0].Count = 0;
+    Vm.Lists[1].Count = 0;
+    Current = &(Vm.Lists[0]);
+    Next = &(Vm.Lists[1]);
+    Matched = FALSE;
+    Position = 0;
+    while (TRUE) {
+        Byte = Vm.Input[Position];
 
-                Status = RegexStatusSuccess;
-            }
+        //
+        // Start a new thread here if nothing has matched yet. It has the
+        // lowest priority, since it starts the furthest to the right.
+        //
 
-            break;
+        if ((Matched == FALSE) &&
+            ((Position == 0) || (Program->Anchored == FALSE))) {
 
-        case BracketExpressionCharacterClassHexDigit:
-            if (isxdigit(Character)) {
-                Status = RegexStatusSuccess;
+            for (SlotIndex = 0; SlotIndex < SlotCount; SlotIndex += 1) {
+                Vm.Work[SlotIndex] = -1;
             }
 
+            ClpAddRegexThread(&Vm, Current, 0, Position);
+        }
+
+        if (Current->Count == 0) {
             break;
+        }
 
-        case BracketExpressionCharacterClassName:
-            if (REGULAR_EXPRESSION_IS_NAME(Character)) {
-                Status = RegexStatusSuccess;
-            }
+        //
+        // Step each thread over the next byte in priority order. Once a
+        // thread matches, all the lower priority threads are dropped.
+        //
 
-            break;
+        Next->Count = 0;
+        for (Index = 0; Index < Current->Count; Index += 1) {
+            Instruction = &(Program->Instructions[Current->Pcs[Index]]);
+            if (Instruction->Opcode == RegexOpMatch) {
+                memcpy(Result,
+                       Current->Slots + (Index * SlotCount),
+                       SlotCount * sizeof(regoff_t));
 
-        default:
+                Matched = TRUE;
+                break;
+            }
 
-            assert(FALSE);
+            if ((Instruction->Opcode == RegexOpByteSet) && (Byte != '\0') &&
+                (REGEX_SET_CONTAINS(&(Program->Sets[Instruction->Argument]),
+                                    Byte))) {
+
+                memcpy(Vm.Work,
+                       Current->Slots + (Index * SlotCount),
+                       SlotCount * sizeof(regoff_t));
 
-            goto RegularExpressionMatchBracketExpressionEnd;
+                ClpAddRegexThread(&Vm,
+                                  Next,
+                                  Current->Pcs[Index] + 1,
+                                  Position + 1);
+            }
         }
 
-        if (Status == RegexStatusSuccess) {
+        if (Byte == '\0') {
             break;
         }
-    }
 
-RegularExpressionMatchBracketExpressionEnd:
-    if ((Entry->Flags & REGULAR_EXPRESSION_NEGATED) != 0) {
-        if (Status == RegexStatusNoMatch) {
-            Status = RegexStatusSuccess;
+        Swap = Current;
+        Current = Next;
+        Next = Swap;
+        Position += 1;
+    }
 
-        } else if (Status == RegexStatusSuccess) {
-            Status = RegexStatusNoMatch;
+    if (Matched != FALSE) {
+        if ((RegularExpression->Flags & REG_NOSUB) == 0) {
+            for (MatchIndex = 0; MatchIndex < MatchArraySize; MatchIndex += 1) {
+                Match[MatchIndex].rm_so = -1;
+                Match[MatchIndex].rm_eo = -1;
+                if (MatchIndex <= RegularExpression->SubexpressionCount) {
+                    Match[MatchIndex].rm_so = Result[MatchIndex * 2];
+                    Match[MatchIndex].rm_eo = Result[(MatchIndex * 2) + 1];
+                }
+            }
         }
     }
 
-    if (Status == RegexStatusSuccess) {
-        Context->NextInput += 1;
+    free(Allocation);
+    if (Matched != FALSE) {
+        return RegexStatusSuccess;
     }
 
-    return Status;
+    return RegexStatusNoMatch;
 }
 
 VOID
-ClpRegularExpressionMarkEnd (
-    PREGULAR_EXPRESSION_EXECUTION Context,
-    PREGULAR_EXPRESSION_ENTRY Entry
+ClpAddRegexThread (
+    PREGEX_PIKE_VM Vm,
+    PREGEX_THREAD_LIST List,
+    ULONG Pc,
+    regoff_t Position
     )
 
 /*++
 
 Routine Description:
 
-    This routine marks the end of a subexpression match for a subexpression
-    that just finished matching.
+    This routine adds a thread to a Pike VM thread list, following it through
+    any instructions that don't consume input. Threads that reach an
+    instruction already in the list are dropped, since a higher priority
+    thread got there first.
 
 Arguments:
 
-    Context - Supplies a pointer to the execution context.
+    Vm - Supplies a pointer to the Pike VM. Its work slots hold the slots of
+        the thread being added, and are restored before returning.
 
-    Entry - Supplies a pointer to the regular expression entry that just
-        finished matching.
+    List - Supplies a pointer to the list to add to.
+
+    Pc - Supplies the instruction the thread is at.
+
+    Position - Supplies the input position the thread is at.
 
 Return Value:
 
@@ -1551,213 +3081,240 @@ Return Value:
 
 {
 
-    regmatch_t *Match;
-    ULONG SubexpressionNumber;
+    ULONG Context;
+    ULONG Index;
+    PREGEX_INSTRUCTION Instruction;
+    PREGEX_PROGRAM Program;
+    ULONG StackSize;
+    PREGEX_STACK_ENTRY StackEntry;
+
+    Program = Vm->Program;
+    if (Position == 0) {
+        Context = REGEX_CONTEXT_START;
+        if ((Vm->Flags & REG_NOTBOL) != 0) {
+            Context = REGEX_CONTEXT_START_NOT_BOL;
+        }
 
-    if (Entry->Type != RegexEntrySubexpression) {
-        return;
+    } else {
+        Context = ClpGetRegexContext(Vm->Expression, Vm->Input[Position - 1]);
     }
 
-    SubexpressionNumber = Entry->U.SubexpressionNumber;
-    if ((SubexpressionNumber < Context->MatchSize) &&
-        ((Context->Expression->Flags & REG_NOSUB) == 0)) {
+    Vm->Stack[0].Pc = Pc;
+    StackSize = 1;
+    while (StackSize != 0) {
+        StackSize -= 1;
+        StackEntry = &(Vm->Stack[StackSize]);
+        if (StackEntry->Pc == REGEX_STACK_RESTORE) {
+            Vm->Work[StackEntry->Slot] = StackEntry->Value;
+            continue;
+        }
 
-        Match = &(Context->Match[SubexpressionNumber]);
-        Match->rm_eo = Context->NextInput;
-    }
+        Pc = StackEntry->Pc;
+        while (TRUE) {
+            Index = List->Sparse[Pc];
+            if ((Index < List->Count) && (List->Pcs[Index] == Pc)) {
+                break;
+            }
 
-    if (SubexpressionNumber < REGEX_INTERNAL_MATCH_COUNT) {
-        Match = &(Context->InternalMatch[SubexpressionNumber]);
-        Match->rm_eo = Context->NextInput;
+            Index = List->Count;
+            List->Pcs[Index] = Pc;
+            List->Sparse[Pc] = Index;
+            List->Count += 1;
+            Instruction = &(Program->Instructions[Pc]);
+            if (Instruction->Opcode == RegexOpJump) {
+                Pc = Instruction->Target;
+
+            } else if (Instruction->Opcode == RegexOpSplit) {
+                Vm->Stack[StackSize].Pc = Instruction->Alternate;
+                StackSize += 1;
+                Pc = Instruction->Target;
+
+            } else if (Instruction->Opcode == RegexOpSave) {
+                StackEntry = &(Vm->Stack[StackSize]);
+                StackEntry->Pc = REGEX_STACK_RESTORE;
+                StackEntry->Slot = Instruction->Argument;
+                StackEntry->Value = Vm->Work[Instruction->Argument];
+                StackSize += 1;
+                Vm->Work[Instruction->Argument] = Position;
+                Pc += 1;
+
+            //
+            // Leave a loop whose last iteration matched nothing.
+            //
+
+            } else if (Instruction->Opcode == RegexOpCheckEmpty) {
+                if (Vm->Work[Instruction->Argument] == Position) {
+                    Pc = Instruction->Alternate;
+
+                } else {
+                    Pc += 1;
+                }
+
+            } else if (Instruction->Opcode == RegexOpAssert) {
+                if (ClpCheckRegexAssertion(Vm->Expression,
+                                           Instruction->Argument,
+                                           Context,
+                                           Vm->Input[Position],
+                                           Vm->Flags) == FALSE) {
+
+                    break;
+                }
+
+                Pc += 1;
+
+            //
+            // Byte set and match instructions are where threads wait, so
+            // save the thread's slots with it.
+            //
+
+            } else {
+                memcpy(List->Slots + (Index * Program->SlotCount),
+                       Vm->Work,
+                       Program->SlotCount * sizeof(regoff_t));
+
+                break;
+            }
+        }
     }
 
     return;
 }
 
-PREGULAR_EXPRESSION_CHOICE
-ClpRegularExpressionCreateChoice (
-    PREGULAR_EXPRESSION_EXECUTION Context,
-    PREGULAR_EXPRESSION_CHOICE Parent,
-    PREGULAR_EXPRESSION_ENTRY Entry,
-    ULONG Iteration
+BOOL
+ClpCheckRegexAssertion (
+    PREGULAR_EXPRESSION RegularExpression,
+    ULONG Type,
+    ULONG Context,
+    UCHAR Next,
+    int Flags
     )
 
 /*++
 
 Routine Description:
 
-    This routine creates a new regular expression choice structure,
-    initializes it, and adds it to the proper place in the choice tree.
+    This routine evaluates a zero width assertion at a position in the input.
 
 Arguments:
 
-    Context - Supplies a pointer to the execution context.
+    RegularExpression - Supplies a pointer to the compiled regular expression.
 
-    Parent - Supplies an optional pointer to the parent to add the choice
-        under. If this is null, the choice will be added directly into the
-        context.
+    Type - Supplies the type of assertion, which is the type of regular
+        expression entry it came from.
 
-    Entry - Supplies a pointer to the expression corresponding to this choice.
+    Context - Supplies the context of the position. See REGEX_CONTEXT_*
+        definitions.
 
-    Iteration - Supplies the iteration (duplicate) count of this entry. If this
-        is not the first iteration, then the choice will be added to the
-        parent of the given parent choice so that dupilcates appear as siblings
-        (presumably the previous duplicate is the previous entry in the list,
-        which is an assumption taken when backtracking).
+    Next - Supplies the character at the position, which is the null
+        terminator at the end of the input.
+
+    Flags - Supplies the execution flags. See REG_NOTEOL.
 
 Return Value:
 
-    Returns a pointer to the choice structure on success.
+    TRUE if the assertion holds.
 
-    NULL on allocation failure.
+    FALSE if the assertion fails.
 
 --*/
 
 {
 
-    PREGULAR_EXPRESSION_CHOICE NewChoice;
+    switch (Type) {
 
     //
-    // Attempt to use one from the free list if there is any, or allocate one
-    // otherwise.
+    // The beginning of the string (when REG_NOTBOL is clear) and the spot
+    // after a newline (when REG_NEWLINE is set) get their own contexts.
     //
 
-    if (LIST_EMPTY(&(Context->FreeChoices)) == FALSE) {
-        NewChoice = LIST_VALUE(Context->FreeChoices.Next,
-                               REGULAR_EXPRESSION_CHOICE,
-                               ListEntry);
+    case RegexEntryStringBegin:
+        if ((Context == REGEX_CONTEXT_START) ||
+            (Context == REGEX_CONTEXT_NEWLINE)) {
 
-        LIST_REMOVE(&(NewChoice->ListEntry));
+            return TRUE;
+        }
 
-    } else {
-        NewChoice = malloc(sizeof(REGULAR_EXPRESSION_CHOICE));
-        if (NewChoice == NULL) {
-            return NULL;
+        break;
+
+    case RegexEntryStringEnd:
+        if (Next == '\0') {
+            if ((Flags & REG_NOTEOL) == 0) {
+                return TRUE;
+            }
+
+        } else if ((Next == '\n') &&
+                   ((RegularExpression->Flags & REG_NEWLINE) != 0)) {
+
+            return TRUE;
         }
-    }
 
-    memset(NewChoice, 0, sizeof(REGULAR_EXPRESSION_CHOICE));
-    INITIALIZE_LIST_HEAD(&(NewChoice->ChildList));
-    NewChoice->Parent = Parent;
-    NewChoice->Node = Entry;
-    NewChoice->SavedNextIndex = Context->NextInput;
-    NewChoice->U.Iteration = Iteration;
-    if (Iteration != 0) {
+        break;
 
-        //
-        // Make repeats siblings of each other.
-        //
+    case RegexEntryStartOfWord:
+        if ((REGULAR_EXPRESSION_IS_NAME((CHAR)Next)) &&
+            (Context != REGEX_CONTEXT_WORD)) {
 
-        assert((Parent != NULL) && (Parent->Parent != NULL));
+            return TRUE;
+        }
 
-        NewChoice->Parent = Parent->Parent;
-        INSERT_BEFORE(&(NewChoice->ListEntry), &(Parent->Parent->ChildList));
+        break;
 
-    } else {
-        if (Parent != NULL) {
-            INSERT_BEFORE(&(NewChoice->ListEntry), &(Parent->ChildList));
+    case RegexEntryEndOfWord:
+        if ((Context == REGEX_CONTEXT_WORD) &&
+            (!REGULAR_EXPRESSION_IS_NAME((CHAR)Next))) {
 
-        } else {
-            INSERT_BEFORE(&(NewChoice->ListEntry), &(Context->Choices));
+            return TRUE;
         }
+
+        break;
+
+    default:
+
+        assert(FALSE);
+
+        break;
     }
 
-    return NewChoice;
+    return FALSE;
 }
 
-VOID
-ClpRegularExpressionDestroyChoice (
-    PREGULAR_EXPRESSION_EXECUTION Context,
-    PREGULAR_EXPRESSION_CHOICE Choice
+ULONG
+ClpGetRegexContext (
+    PREGULAR_EXPRESSION RegularExpression,
+    UCHAR Previous
     )
 
 /*++
 
 Routine Description:
 
-    This routine destroys a regular expression choice and recursively all of
-    its child choices. It is assumed that this choice is already removed from
-    its parent list.
+    This routine returns the context of the position after the given
+    character.
 
 Arguments:
 
-    Context - Supplies a pointer to the execution context.
+    RegularExpression - Supplies a pointer to the compiled regular expression.
 
-    Choice - Supplies a pointer to the choice to destroy.
+    Previous - Supplies the character before the position.
 
 Return Value:
 
-    None.
+    Returns the context of the position. See REGEX_CONTEXT_* definitions.
 
 --*/
 
 {
 
-    PREGULAR_EXPRESSION_CHOICE CurrentChoice;
-    PREGULAR_EXPRESSION_CHOICE NextChoice;
-
-    //
-    // Destroy the choice tree.
-    //
-
-    if (LIST_EMPTY(&(Choice->ChildList)) == FALSE) {
-        CurrentChoice = LIST_VALUE(Choice->ChildList.Next,
-                                   REGULAR_EXPRESSION_CHOICE,
-                                   ListEntry);
-
-        while (CurrentChoice != NULL) {
-
-            assert(CurrentChoice != Choice);
-
-            //
-            // Find the first leaf node.
-            //
-
-            while (LIST_EMPTY(&(CurrentChoice->ChildList)) == FALSE) {
-                CurrentChoice = LIST_VALUE(CurrentChoice->ChildList.Next,
-                                           REGULAR_EXPRESSION_CHOICE,
-                                           ListEntry);
-            }
-
-            //
-            // Get the next entry (the parent of this leaf).
-            //
-
-            if (CurrentChoice->Parent != Choice) {
-                NextChoice = CurrentChoice->Parent;
-
-            //
-            // If the parent is the main, this is a top level choice.
-            //
-
-            } else if (CurrentChoice->ListEntry.Next != &(Choice->ChildList)) {
-                NextChoice = LIST_VALUE(CurrentChoice->ListEntry.Next,
-                                        REGULAR_EXPRESSION_CHOICE,
-                                        ListEntry);
-
-            //
-            // If this was the last top level choice, then be done.
-            //
-
-            } else {
-                NextChoice = NULL;
-            }
-
-            assert(LIST_EMPTY(&(CurrentChoice->ChildList)) != FALSE);
-
-            LIST_REMOVE(&(CurrentChoice->ListEntry));
+    if ((Previous == '\n') &&
+        ((RegularExpression->Flags & REG_NEWLINE) != 0)) {
 
-            //
-            // Stick this on the head of the free list, as it's hottest in the
-            // cache.
-            //
+        return REGEX_CONTEXT_NEWLINE;
+    }
 
-            INSERT_AFTER(&(CurrentChoice->ListEntry), &(Context->FreeChoices));
-            CurrentChoice = NextChoice;
-        }
+    if (REGULAR_EXPRESSION_IS_NAME((CHAR)Previous)) {
+        return REGEX_CONTEXT_WORD;
     }
 
-    free(Choice);
-    return;
+    return REGEX_CONTEXT_OTHER;
 }
 
@@ -39,6 +39,23 @@ Module Name:
     ((isupper(_Character)) || (islower(_Character)) ||  \
      (isdigit(_Character)) || ((_Character) == '_'))
 
+//
+// These macros guard the lazily built DFA hanging off of a compiled
+// expression. This file is also compiled into the build tools, which don't
+// link against the runtime library, so use the compiler's atomic builtins.
+//
+
+#define REGEX_TRY_LOCK(_Lock) __sync_bool_compare_and_swap((_Lock), 0, 1)
+#define REGEX_UNLOCK(_Lock) __sync_lock_release(_Lock)
+
+//
+// This macro determines whether or not the given byte is in a program's
+// character set.
+//
+
+#define REGEX_SET_CONTAINS(_Set, _Byte) \
+    (((_Set)->Bits[(_Byte) / 32] & (1UL << ((_Byte) % 32))) != 0)
+
 //
 // ---------------------------------------------------------------- Definitions
 //
@@ -51,6 +68,24 @@ Module Name:
 #define REGULAR_EXPRESSION_ANCHORED_RIGHT 0x00000002
 #define REGULAR_EXPRESSION_NEGATED 0x00000004
 
+//
+// Define the maximum number of instructions in a compiled program. Larger
+// expressions (usually big counted repeats) run on the backtracking matcher.
+//
+
+#define REGEX_PROGRAM_MAX_INSTRUCTIONS 4096
+
+//
+// Define the contexts a position can be in, as seen by the assertions. This
+// is determined by the character before the position.
+//
+
+#define REGEX_CONTEXT_START 0
+#define REGEX_CONTEXT_START_NOT_BOL 1
+#define REGEX_CONTEXT_NEWLINE 2
+#define REGEX_CONTEXT_WORD 3
+#define REGEX_CONTEXT_OTHER 4
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -86,6 +121,17 @@ typedef enum _REGEX_ENTRY_TYPE {
     RegexEntryEndOfWord,
 } REGEX_ENTRY_TYPE, *PREGEX_ENTRY_TYPE;
 
+typedef enum _REGEX_OPCODE {
+    RegexOpInvalid,
+    RegexOpByteSet,
+    RegexOpSplit,
+    RegexOpJump,
+    RegexOpSave,
+    RegexOpCheckEmpty,
+    RegexOpAssert,
+    RegexOpMatch
+} REGEX_OPCODE, *PREGEX_OPCODE;
+
 typedef enum _BRACKET_EXPRESSION_TYPE {
     BracketExpressionInvalid,
     BracketExpressionSingleCharacters,
@@ -257,6 +303,105 @@ struct _REGULAR_EXPRESSION_ENTRY {
 
 /*++
 
+Structure Description:
+
+    This structure defines a single instruction in a compiled regular
+    expression program.
+
+Members:
+
+    Opcode - Stores the operation to perform.
+
+    Argument - Stores the character set index for byte set instructions, the
+        slot index for save and check empty instructions, or the entry type
+        for assertions.
+
+    Target - Stores the preferred next instruction for splits, and the
+        destination of jumps.
+
+    Alternate - Stores the less preferred next instruction for splits, and
+        the instruction to go to from a check empty instruction if the loop
+        iteration matched nothing.
+
+--*/
+
+typedef struct _REGEX_INSTRUCTION {
+    REGEX_OPCODE Opcode;
+    ULONG Argument;
+    ULONG Target;
+    ULONG Alternate;
+} REGEX_INSTRUCTION, *PREGEX_INSTRUCTION;
+
+/*++
+
+Structure Description:
+
+    This structure defines the set of bytes a byte set instruction accepts.
+
+Members:
+
+    Bits - Stores the bitmap of accepted bytes.
+
+--*/
+
+typedef struct _REGEX_CHARACTER_SET {
+    ULONG Bits[256 / 32];
+} REGEX_CHARACTER_SET, *PREGEX_CHARACTER_SET;
+
+typedef struct _REGEX_DFA REGEX_DFA, *PREGEX_DFA;
+
+/*++
+
+Structure Description:
+
+    This structure defines a regular expression compiled down to a Thompson
+    NFA program. Expressions without back references are run on this rather
+    than on the backtracking matcher, which can take exponential time.
+
+Members:
+
+    Instructions - Stores the array of instructions. Execution starts at zero.
+
+    InstructionCount - Stores the number of instructions in the program.
+
+    Sets - Stores the array of character sets used by byte set instructions.
+
+    SetCount - Stores the number of character sets.
+
+    SlotCount - Stores the number of position slots a thread needs. The first
+        two per subexpression (including the whole match) hold captures, the
+        rest remember where loop iterations started.
+
+    Anchored - Stores a boolean indicating if the program can only match at
+        the beginning of the string.
+
+    ClassCount - Stores the number of distinct byte classes.
+
+    ByteClass - Stores the class of each byte. Bytes in the same class are
+        indistinguishable to the program, so the DFA only needs a transition
+        per class.
+
+    DfaLock - Stores the lock serializing use of the DFA.
+
+    Dfa - Stores a pointer to the lazily built DFA, if it has been created.
+
+--*/
+
+typedef struct _REGEX_PROGRAM {
+    PREGEX_INSTRUCTION Instructions;
+    ULONG InstructionCount;
+    PREGEX_CHARACTER_SET Sets;
+    ULONG SetCount;
+    ULONG SlotCount;
+    BOOL Anchored;
+    ULONG ClassCount;
+    UCHAR ByteClass[256];
+    volatile ULONG DfaLock;
+    PREGEX_DFA Dfa;
+} REGEX_PROGRAM, *PREGEX_PROGRAM;
+
+/*++
+
 Structure Description:
 
     This structure defines the internal regular expression representation.
@@ -270,12 +415,16 @@ Structure Description:
     BaseEntry - Stores the initial subexpression entry, a slightly modified
         subexpression.
 
+    Program - Stores an optional pointer to the compiled program, which is
+        not built for expressions with back references or that are too large.
+
 --*/
 
 typedef struct _REGULAR_EXPRESSION {
     ULONG SubexpressionCount;
     ULONG Flags;
     REGULAR_EXPRESSION_ENTRY BaseEntry;
+    PREGEX_PROGRAM Program;
 } REGULAR_EXPRESSION, *PREGULAR_EXPRESSION;
 
 //
@@ -285,3 +434,57 @@ typedef struct _REGULAR_EXPRESSION {
 //
 // -------------------------------------------------------- Function Prototypes
 //
+
+BOOL
+ClpRegularExpressionMatchBracket (
+    PREGULAR_EXPRESSION Expression,
+    PREGULAR_EXPRESSION_ENTRY Entry,
+    CHAR Character
+    );
+
+/*++
+
+Routine Description:
+
+    This routine determines if the given character matches a bracket
+    expression.
+
+Arguments:
+
+    Expression - Supplies a pointer to the regular expression.
+
+    Entry - Supplies a pointer to the bracket expression entry.
+
+    Character - Supplies the character to test. This must not be the null
+        terminator.
+
+Return Value:
+
+    TRUE if the character is matched by the bracket expression.
+
+    FALSE if the character is not matched.
+
+--*/
+
+VOID
+ClpDestroyRegularExpressionDfa (
+    PREGEX_DFA Dfa
+    );
+
+/*++
+
+Routine Description:
+
+    This routine destroys the DFA built up while executing a compiled
+    regular expression program.
+
+Arguments:
+
+    Dfa - Supplies a pointer to the DFA to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
@@ -119,11 +119,17 @@ Module Name:
            (IPV6_UNICAST_HOPS == SocketIp6OptionUnicastHops) &&       \
            (IPV6_V6ONLY == SocketIp6OptionIpv6Only))
 
-#define ASSERT_SOCKET_TCP_OPTIONS_EQUIVALENT()                  \
-    ASSERT((TCP_NODELAY == SocketTcpOptionNoDelay) &&           \
-           (TCP_KEEPIDLE == SocketTcpOptionKeepAliveTimeout) && \
-           (TCP_KEEPINTVL == SocketTcpOptionKeepAlivePeriod) && \
-           (TCP_KEEPCNT == SocketTcpOptionKeepAliveProbeLimit))
+#define ASSERT_SOCKET_TCP_OPTIONS_EQUIVALENT()                        \
+    ASSERT((TCP_NODELAY == SocketTcpOptionNoDelay) &&                 \
+           (TCP_KEEPIDLE == SocketTcpOptionKeepAliveTimeout) &&       \
+           (TCP_KEEPINTVL == SocketTcpOptionKeepAlivePeriod) &&       \
+           (TCP_KEEPCNT == SocketTcpOptionKeepAliveProbeLimit) &&     \
+           (TCP_CONGESTION_CONTROL ==                                 \
+            SocketTcpOptionCongestionControl) &&                      \
+           (TCP_DEFAULT_CONGESTION_CONTROL ==                         \
+            SocketTcpOptionDefaultCongestionControl) &&               \
+           (TCP_CONGESTION_NEW_RENO == SocketTcpCongestionNewReno) && \
+           (TCP_CONGESTION_CUBIC == SocketTcpCongestionCubic))
 
 //
 // ---------------------------------------------------------------- Definitions
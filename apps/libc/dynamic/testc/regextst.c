@@ -35,6 +35,7 @@ Module Name:
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 //
 // ---------------------------------------------------------------- Definitions
@@ -46,6 +47,29 @@ Module Name:
 
 #define REGEX_TEST_MATCH_COUNT 5
 
+//
+// Define the parameters of the timing test. It searches generated lines that
+// look like source code, the way grep would, and times a pattern that is
+// exponential for a backtracking matcher. With 40 a's, a backtracker takes
+// minutes to fail where the linear matchers take microseconds.
+//
+
+#define REGEX_TIMING_LINE_COUNT 20000
+#define REGEX_TIMING_LINE_SIZE 128
+#define REGEX_TIMING_PATHOLOGICAL_LENGTH 40
+#define REGEX_TIMING_PATHOLOGICAL_LIMIT CLOCKS_PER_SEC
+
+//
+// Define the parameters of the differential test, which builds random
+// patterns out of a handful of tokens and runs them against short random
+// input drawn from a small alphabet, so that matches are common.
+//
+
+#define REGEX_DIFFERENTIAL_ITERATIONS 20000
+#define REGEX_DIFFERENTIAL_MAX_TOKENS 10
+#define REGEX_DIFFERENTIAL_PATTERN_SIZE 128
+#define REGEX_DIFFERENTIAL_MAX_INPUT 10
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -71,6 +95,11 @@ typedef struct _REGEX_ERROR_STRING {
     PSTR String;
 } REGEX_ERROR_STRING, *PREGEX_ERROR_STRING;
 
+typedef struct _REGEX_TIMING_CASE {
+    PSTR Pattern;
+    INT CompileFlags;
+} REGEX_TIMING_CASE, *PREGEX_TIMING_CASE;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -87,6 +116,22 @@ TestRegularExpressionCompileCase (
     PREGEX_COMPILE_TEST_CASE Case
     );
 
+ULONG
+TestRegularExpressionTiming (
+    VOID
+    );
+
+BOOL
+TestRegularExpressionTimingCase (
+    PREGEX_TIMING_CASE Case,
+    PSTR Lines
+    );
+
+ULONG
+TestRegularExpressionDifferential (
+    VOID
+    );
+
 PSTR
 TestRegexGetErrorCodeString (
     INT Code
@@ -644,6 +689,55 @@ REGEX_EXECUTION_TEST_CASE RegexExecutionTestCases[] = {
         REG_NOMATCH,
         {{-1, -1}, {-1, -1}, {-1, -1}, {-1, -1}, {-1, -1}},
     },
+
+    //
+    // Try some nested repeats that would take exponential time to fail with
+    // a backtracking matcher.
+    //
+
+    {
+        "\\(a*\\)*b", 0,
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", 0,
+        REG_NOMATCH,
+        {{-1, -1}, {-1, -1}, {-1, -1}, {-1, -1}, {-1, -1}},
+    },
+
+    {
+        "(a|aa)*c", REG_EXTENDED,
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", 0,
+        REG_NOMATCH,
+        {{-1, -1}, {-1, -1}, {-1, -1}, {-1, -1}, {-1, -1}},
+    },
+
+    {
+        "(a|aa)*c", REG_EXTENDED,
+        "aaaac", 0,
+        0,
+        {{0, 5}, {3, 4}, {-1, -1}, {-1, -1}, {-1, -1}},
+    },
+
+    //
+    // Alternatives are tried in order, so the first one that leads to a match
+    // wins even if a later one would be longer.
+    //
+
+    {
+        "(a|ab)(c|bcd)", REG_EXTENDED,
+        "abcd", 0,
+        0,
+        {{0, 4}, {0, 1}, {1, 4}, {-1, -1}, {-1, -1}},
+    },
+
+    //
+    // Test that a trailing anchor backs up into the repeats before it.
+    //
+
+    {
+        "\\(a*\\)\\(ab\\)*$", 0,
+        "aab", 0,
+        0,
+        {{0, 3}, {0, 1}, {1, 3}, {-1, -1}, {-1, -1}},
+    },
 };
 
 //
@@ -749,6 +843,94 @@ REGEX_ERROR_STRING RegexErrorStrings[] = {
     {REG_BADRPT, "REG_BADRPT"}
 };
 
+//
+// Define the patterns searched for in the timing test.
+//
+
+REGEX_TIMING_CASE RegexTimingCases[] = {
+    {"Status", 0},
+    {"goto [A-Za-z]*End", 0},
+    {"^static.*Result", 0},
+    {"(error|Buffer).*0x[0-9a-f]+", REG_EXTENDED},
+    {"[A-Z][a-z]+_?[a-z]+ = ", REG_EXTENDED},
+    {"\\(a*\\)*b", 0},
+};
+
+//
+// Define the words the timing test builds its lines out of.
+//
+
+PSTR RegexTimingWords[] = {
+    "static",
+    "int",
+    "ULONG",
+    "Status",
+    "return",
+    "goto",
+    "Buffer",
+    "error",
+    "Result",
+    "0x1234",
+    "(",
+    ")",
+    ";",
+    "=",
+    "foo_bar",
+    "if"
+};
+
+//
+// Define the tokens the differential test builds its patterns out of, and
+// the characters its input is made of.
+//
+
+PSTR RegexDifferentialExtendedTokens[] = {
+    "a",
+    "b",
+    ".",
+    "[ab]",
+    "[^a]",
+    "(",
+    ")",
+    "|",
+    "*",
+    "+",
+    "?",
+    "{0,2}",
+    "{2}",
+    "{1,}",
+    "^",
+    "$",
+    "\\<",
+    "\\>",
+    "A",
+    "[[:upper:]]",
+    "x",
+    "()"
+};
+
+PSTR RegexDifferentialBasicTokens[] = {
+    "a",
+    "b",
+    ".",
+    "[ab]",
+    "[^a]",
+    "\\(",
+    "\\)",
+    "*",
+    "\\{0,2\\}",
+    "\\{2\\}",
+    "\\{1,\\}",
+    "^",
+    "$",
+    "\\<",
+    "\\>",
+    "A",
+    "x"
+};
+
+char RegexDifferentialAlphabet[] = "abAx\n _b";
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -818,6 +1000,8 @@ Return Value:
         }
     }
 
+    Failures += TestRegularExpressionTiming();
+    Failures += TestRegularExpressionDifferential();
     return Failures;
 }
 
@@ -1003,6 +1187,365 @@ Return Value:
     return Status;
 }
 
+ULONG
+TestRegularExpressionTiming (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine times regular expression searches over a set of generated
+    lines, reporting how long each pattern takes with and without match
+    positions. It fails if the two disagree, or if a pattern that is
+    exponential for a backtracking matcher takes too long.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the count of test failures.
+
+--*/
+
+{
+
+    clock_t Elapsed;
+    regex_t Expression;
+    ULONG Failures;
+    PSTR Line;
+    ULONG LineIndex;
+    PSTR Lines;
+    ULONG Random;
+    int Result;
+    ULONG Size;
+    char String[REGEX_TIMING_PATHOLOGICAL_LENGTH + 2];
+    ULONG TestCount;
+    ULONG TestIndex;
+    PSTR Word;
+    ULONG WordCount;
+    ULONG WordIndex;
+
+    Failures = 0;
+    Lines = malloc(REGEX_TIMING_LINE_COUNT * REGEX_TIMING_LINE_SIZE);
+    if (Lines == NULL) {
+        printf("Error: Failed to allocate regex timing lines.\n");
+        return 1;
+    }
+
+    //
+    // Build the lines with a fixed pseudo-random sequence so that every run
+    // searches the same input.
+    //
+
+    Random = 1;
+    for (LineIndex = 0; LineIndex < REGEX_TIMING_LINE_COUNT; LineIndex += 1) {
+        Line = Lines + (LineIndex * REGEX_TIMING_LINE_SIZE);
+        Size = 0;
+        Random = (Random * 1103515245) + 12345;
+        WordCount = 4 + ((Random >> 16) % 12);
+        for (WordIndex = 0; WordIndex < WordCount; WordIndex += 1) {
+            Random = (Random * 1103515245) + 12345;
+            Word = RegexTimingWords[(Random >> 16) %
+                                    (sizeof(RegexTimingWords) /
+                                     sizeof(RegexTimingWords[0]))];
+
+            if (Size + strlen(Word) + 2 > REGEX_TIMING_LINE_SIZE) {
+                break;
+            }
+
+            strcpy(Line + Size, Word);
+            Size += strlen(Word);
+            Line[Size] = ' ';
+            Size += 1;
+        }
+
+        Line[Size] = '\0';
+    }
+
+    TestCount = sizeof(RegexTimingCases) / sizeof(RegexTimingCases[0]);
+    for (TestIndex = 0; TestIndex < TestCount; TestIndex += 1) {
+        if (TestRegularExpressionTimingCase(&(RegexTimingCases[TestIndex]),
+                                            Lines) == FALSE) {
+
+            Failures += 1;
+        }
+    }
+
+    free(Lines);
+
+    //
+    // Time a pattern that a backtracking matcher takes exponential time to
+    // reject.
+    //
+
+    Result = regcomp(&Expression, "(a|aa)*c", REG_EXTENDED);
+    if (Result != 0) {
+        printf("Error: Failed to compile pathological regex: %d.\n", Result);
+        return Failures + 1;
+    }
+
+    memset(String, 'a', REGEX_TIMING_PATHOLOGICAL_LENGTH);
+    String[REGEX_TIMING_PATHOLOGICAL_LENGTH] = 'b';
+    String[REGEX_TIMING_PATHOLOGICAL_LENGTH + 1] = '\0';
+    Elapsed = clock();
+    Result = regexec(&Expression, String, 0, NULL, 0);
+    Elapsed = clock() - Elapsed;
+    regfree(&Expression);
+    printf("Regex timing: (a|aa)*c against %d a's: %ld us.\n",
+           REGEX_TIMING_PATHOLOGICAL_LENGTH,
+           (long)((Elapsed * 1000000LL) / CLOCKS_PER_SEC));
+
+    if (Result != REG_NOMATCH) {
+        printf("Error: Pathological regex returned %d.\n", Result);
+        Failures += 1;
+    }
+
+    if (Elapsed > REGEX_TIMING_PATHOLOGICAL_LIMIT) {
+        printf("Error: Pathological regex took too long.\n");
+        Failures += 1;
+    }
+
+    return Failures;
+}
+
+BOOL
+TestRegularExpressionTimingCase (
+    PREGEX_TIMING_CASE Case,
+    PSTR Lines
+    )
+
+/*++
+
+Routine Description:
+
+    This routine searches every timing line for the given pattern, once
+    asking for match positions and once without, and prints how long each
+    took.
+
+Arguments:
+
+    Case - Supplies a pointer to the timing case.
+
+    Lines - Supplies a pointer to the array of timing lines.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the searches disagree.
+
+--*/
+
+{
+
+    regex_t Expression;
+    PSTR Line;
+    ULONG LineIndex;
+    regmatch_t Match[REGEX_TEST_MATCH_COUNT];
+    ULONG MatchCount;
+    clock_t MatchTime;
+    ULONG PlainCount;
+    clock_t PlainTime;
+    int Result;
+
+    Result = regcomp(&Expression, Case->Pattern, Case->CompileFlags);
+    if (Result != 0) {
+        printf("Error: Failed to compile timing regex \"%s\": %d.\n",
+               Case->Pattern,
+               Result);
+
+        return FALSE;
+    }
+
+    //
+    // Time the search the way grep -c would run it, without positions, and
+    // then the way grep -o would, with them.
+    //
+
+    PlainCount = 0;
+    PlainTime = clock();
+    for (LineIndex = 0; LineIndex < REGEX_TIMING_LINE_COUNT; LineIndex += 1) {
+        Line = Lines + (LineIndex * REGEX_TIMING_LINE_SIZE);
+        if (regexec(&Expression, Line, 0, NULL, 0) == 0) {
+            PlainCount += 1;
+        }
+    }
+
+    PlainTime = clock() - PlainTime;
+    MatchCount = 0;
+    MatchTime = clock();
+    for (LineIndex = 0; LineIndex < REGEX_TIMING_LINE_COUNT; LineIndex += 1) {
+        Line = Lines + (LineIndex * REGEX_TIMING_LINE_SIZE);
+        Result = regexec(&Expression, Line, REGEX_TEST_MATCH_COUNT, Match, 0);
+        if (Result == 0) {
+            MatchCount += 1;
+        }
+    }
+
+    MatchTime = clock() - MatchTime;
+    regfree(&Expression);
+    printf("Regex timing: \"%s\" on %d lines, %d matches: %ld ms, "
+           "%ld ms with positions.\n",
+           Case->Pattern,
+           REGEX_TIMING_LINE_COUNT,
+           PlainCount,
+           (long)((PlainTime * 1000LL) / CLOCKS_PER_SEC),
+           (long)((MatchTime * 1000LL) / CLOCKS_PER_SEC));
+
+    if (PlainCount != MatchCount) {
+        printf("Error: Regex \"%s\" matched %d lines without positions "
+               "but %d with them.\n",
+               Case->Pattern,
+               PlainCount,
+               MatchCount);
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+ULONG
+TestRegularExpressionDifferential (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine runs random patterns against random input, once asking for
+    match positions and once without, and fails if the two answers differ.
+    Without positions the DFA decides on its own, and with them the Pike VM
+    does, so this holds the two engines to agreeing on every search.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the count of test failures.
+
+--*/
+
+{
+
+    ULONG CompileFlags;
+    ULONG ExecuteFlags;
+    regex_t Expression;
+    ULONG Failures;
+    char Input[REGEX_DIFFERENTIAL_MAX_INPUT + 1];
+    ULONG InputIndex;
+    ULONG InputSize;
+    ULONG Iteration;
+    regmatch_t Match[REGEX_TEST_MATCH_COUNT];
+    char Pattern[REGEX_DIFFERENTIAL_PATTERN_SIZE];
+    ULONG Random;
+    int Result;
+    int SearchResult;
+    ULONG TokenCount;
+    ULONG TokenIndex;
+    PSTR *Tokens;
+    ULONG TokenTableSize;
+
+    Failures = 0;
+    Random = 1;
+    for (Iteration = 0;
+         Iteration < REGEX_DIFFERENTIAL_ITERATIONS;
+         Iteration += 1) {
+
+        //
+        // Pick the syntax and flags, then build the pattern.
+        //
+
+        Random = (Random * 1103515245) + 12345;
+        CompileFlags = 0;
+        ExecuteFlags = 0;
+        Tokens = RegexDifferentialBasicTokens;
+        TokenTableSize = sizeof(RegexDifferentialBasicTokens) /
+                         sizeof(RegexDifferentialBasicTokens[0]);
+
+        if (((Random >> 16) & 0x1) != 0) {
+            CompileFlags |= REG_EXTENDED;
+            Tokens = RegexDifferentialExtendedTokens;
+            TokenTableSize = sizeof(RegexDifferentialExtendedTokens) /
+                             sizeof(RegexDifferentialExtendedTokens[0]);
+        }
+
+        if (((Random >> 16) & 0x6) == 0) {
+            CompileFlags |= REG_ICASE;
+        }
+
+        if (((Random >> 16) & 0x18) == 0) {
+            CompileFlags |= REG_NEWLINE;
+        }
+
+        if (((Random >> 16) & 0xE0) == 0) {
+            ExecuteFlags |= REG_NOTBOL;
+        }
+
+        if (((Random >> 16) & 0x700) == 0) {
+            ExecuteFlags |= REG_NOTEOL;
+        }
+
+        Random = (Random * 1103515245) + 12345;
+        TokenCount = 1 + ((Random >> 16) % REGEX_DIFFERENTIAL_MAX_TOKENS);
+        Pattern[0] = '\0';
+        for (TokenIndex = 0; TokenIndex < TokenCount; TokenIndex += 1) {
+            Random = (Random * 1103515245) + 12345;
+            strcat(Pattern, Tokens[(Random >> 16) % TokenTableSize]);
+        }
+
+        Random = (Random * 1103515245) + 12345;
+        InputSize = (Random >> 16) % (REGEX_DIFFERENTIAL_MAX_INPUT + 1);
+        for (InputIndex = 0; InputIndex < InputSize; InputIndex += 1) {
+            Random = (Random * 1103515245) + 12345;
+            Input[InputIndex] = RegexDifferentialAlphabet[
+                                    (Random >> 16) %
+                                    (sizeof(RegexDifferentialAlphabet) - 1)];
+        }
+
+        Input[InputSize] = '\0';
+
+        //
+        // Plenty of random patterns are malformed. Just skip those.
+        //
+
+        if (regcomp(&Expression, Pattern, CompileFlags) != 0) {
+            continue;
+        }
+
+        SearchResult = regexec(&Expression,
+                               Input,
+                               REGEX_TEST_MATCH_COUNT,
+                               Match,
+                               ExecuteFlags);
+
+        Result = regexec(&Expression, Input, 0, NULL, ExecuteFlags);
+        regfree(&Expression);
+        if (Result != SearchResult) {
+            printf("Error: Regex \"%s\" (flags 0x%x) against \"%s\" "
+                   "(flags 0x%x) returned %d with match positions but %d "
+                   "without.\n",
+                   Pattern,
+                   CompileFlags,
+                   Input,
+                   ExecuteFlags,
+                   SearchResult,
+                   Result);
+
+            Failures += 1;
+        }
+    }
+
+    return Failures;
+}
+
 PSTR
 TestRegexGetErrorCodeString (
     INT Code
@@ -1038,4 +1581,3 @@ Return Value:
 
     return "Unknown Error";
 }
-
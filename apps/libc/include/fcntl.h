@@ -333,6 +333,16 @@ extern "C" {
 
 #define AT_REMOVEDIR 0x00000008
 
+//
+// Define the flags that can be passed to splice. These are accepted as hints
+// and currently have no effect.
+//
+
+#define SPLICE_F_MOVE     0x00000001
+#define SPLICE_F_NONBLOCK 0x00000002
+#define SPLICE_F_MORE     0x00000004
+#define SPLICE_F_GIFT     0x00000008
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -479,6 +489,53 @@ Return Value:
 
 --*/
 
+LIBC_API
+ssize_t
+splice (
+    int InputDescriptor,
+    off_t *InputOffset,
+    int OutputDescriptor,
+    off_t *OutputOffset,
+    size_t Length,
+    unsigned int Flags
+    );
+
+/*++
+
+Routine Description:
+
+    This routine moves data from one file descriptor to another without
+    passing it through a user mode buffer. It is typically used with a pipe
+    on one side.
+
+Arguments:
+
+    InputDescriptor - Supplies the file descriptor to read from.
+
+    InputOffset - Supplies an optional pointer to the offset to read from,
+        which is advanced by the number of bytes moved. If NULL, the input's
+        file position is used and updated. This is ignored for pipes.
+
+    OutputDescriptor - Supplies the file descriptor to write to.
+
+    OutputOffset - Supplies an optional pointer to the offset to write to,
+        which is advanced by the number of bytes moved. If NULL, the output's
+        file position is used. This is ignored for pipes and sockets.
+
+    Length - Supplies the number of bytes to move.
+
+    Flags - Supplies a bitfield of flags. See SPLICE_F_* definitions.
+
+Return Value:
+
+    Returns the number of bytes moved, which may be less than requested.
+
+    0 if the input is at the end of the file or has no writers.
+
+    -1 on error, and errno will be set to indicate the error.
+
+--*/
+
 #ifdef __cplusplus
 
 }
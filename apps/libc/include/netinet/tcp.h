@@ -67,6 +67,29 @@ Module Name:
 
 #define TCP_KEEPCNT 4
 
+//
+// Set this option to select the congestion control algorithm used by the
+// socket. This option takes an integer, one of the TCP_CONGESTION_* values.
+//
+
+#define TCP_CONGESTION_CONTROL 6
+
+//
+// Set this option to select the congestion control algorithm given to TCP
+// sockets created from now on, system-wide. Setting it requires network
+// administrator permission. This option takes an integer, one of the
+// TCP_CONGESTION_* values.
+//
+
+#define TCP_DEFAULT_CONGESTION_CONTROL 7
+
+//
+// Define the congestion control algorithms.
+//
+
+#define TCP_CONGESTION_NEW_RENO 0
+#define TCP_CONGESTION_CUBIC 1
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -0,0 +1,324 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    epoll.h
+
+Abstract:
+
+    This header contains definitions for the epoll interface, which waits on
+    a persistent set of file descriptors and returns only those that are
+    ready.
+
+Author:
+
+    agent 16-Oct-2026
+
+--*/
+
+#ifndef _SYS_EPOLL_H
+#define _SYS_EPOLL_H
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#ifdef __cplusplus
+
+extern "C" {
+
+#endif
+
+//
+// Define the events that can be watched for and returned. These match the
+// poll events.
+//
+
+#define EPOLLIN POLLIN
+#define EPOLLRDNORM POLLRDNORM
+#define EPOLLPRI POLLPRI
+#define EPOLLRDBAND POLLRDBAND
+#define EPOLLOUT POLLOUT
+#define EPOLLWRNORM POLLWRNORM
+#define EPOLLWRBAND POLLWRBAND
+#define EPOLLERR POLLERR
+#define EPOLLHUP POLLHUP
+
+//
+// Set this flag to disable the descriptor after a single event is reported.
+// It can be re-armed with EPOLL_CTL_MOD.
+//
+
+#define EPOLLONESHOT (1U << 30)
+
+//
+// Set this flag to report the descriptor only when an event transitions from
+// clear to set, rather than whenever it is set.
+//
+
+#define EPOLLET (1U << 31)
+
+//
+// Define the operations for epoll_ctl.
+//
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+//
+// Define the flags that can be passed to epoll_create1.
+//
+
+#define EPOLL_CLOEXEC O_CLOEXEC
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This union defines the caller data associated with an epoll registration.
+
+Members:
+
+    ptr - Stores a pointer value.
+
+    fd - Stores a file descriptor.
+
+    u32 - Stores a 32-bit value.
+
+    u64 - Stores a 64-bit value.
+
+--*/
+
+typedef union epoll_data {
+    void *ptr;
+    int fd;
+    uint32_t u32;
+    uint64_t u64;
+} epoll_data_t;
+
+/*++
+
+Structure Description:
+
+    This structure defines an epoll registration or ready event.
+
+Members:
+
+    events - Stores the mask of events to watch for, or the events that
+        occurred. See EPOLL* definitions.
+
+    data - Stores the caller data, returned verbatim when the descriptor is
+        ready.
+
+--*/
+
+struct epoll_event {
+    uint32_t events;
+    epoll_data_t data;
+};
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
+LIBC_API
+int
+epoll_create (
+    int Size
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates a new epoll descriptor.
+
+Arguments:
+
+    Size - Supplies a hint of the number of descriptors to be watched. This
+        is ignored, but must be greater than zero.
+
+Return Value:
+
+    Returns the new epoll file descriptor on success.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+LIBC_API
+int
+epoll_create1 (
+    int Flags
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates a new epoll descriptor.
+
+Arguments:
+
+    Flags - Supplies a bitfield of flags. The only valid flag is
+        EPOLL_CLOEXEC.
+
+Return Value:
+
+    Returns the new epoll file descriptor on success.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+LIBC_API
+int
+epoll_ctl (
+    int EpollDescriptor,
+    int Operation,
+    int FileDescriptor,
+    struct epoll_event *Event
+    );
+
+/*++
+
+Routine Description:
+
+    This routine adds, modifies, or removes a file descriptor from the set
+    watched by an epoll descriptor.
+
+Arguments:
+
+    EpollDescriptor - Supplies the epoll file descriptor.
+
+    Operation - Supplies the operation to perform. See EPOLL_CTL_*
+        definitions.
+
+    FileDescriptor - Supplies the file descriptor to add, modify, or remove.
+
+    Event - Supplies a pointer to the events and data for the descriptor.
+        This is ignored for EPOLL_CTL_DEL.
+
+Return Value:
+
+    0 on success.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+LIBC_API
+int
+epoll_wait (
+    int EpollDescriptor,
+    struct epoll_event *Events,
+    int MaxEvents,
+    int Timeout
+    );
+
+/*++
+
+Routine Description:
+
+    This routine waits for one or more descriptors watched by an epoll
+    descriptor to become ready.
+
+Arguments:
+
+    EpollDescriptor - Supplies the epoll file descriptor.
+
+    Events - Supplies a pointer to an array where the ready events will be
+        returned.
+
+    MaxEvents - Supplies the number of elements in the events array. This
+        must be greater than zero.
+
+    Timeout - Supplies the number of milliseconds to wait. Supply 0 to not
+        block at all, and -1 to wait indefinitely.
+
+Return Value:
+
+    Returns the number of ready events returned in the array.
+
+    0 if the timeout expired.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+LIBC_API
+int
+epoll_pwait (
+    int EpollDescriptor,
+    struct epoll_event *Events,
+    int MaxEvents,
+    int Timeout,
+    const sigset_t *SignalMask
+    );
+
+/*++
+
+Routine Description:
+
+    This routine waits for one or more descriptors watched by an epoll
+    descriptor to become ready, with the given signal mask applied
+    atomically for the duration of the wait.
+
+Arguments:
+
+    EpollDescriptor - Supplies the epoll file descriptor.
+
+    Events - Supplies a pointer to an array where the ready events will be
+        returned.
+
+    MaxEvents - Supplies the number of elements in the events array. This
+        must be greater than zero.
+
+    Timeout - Supplies the number of milliseconds to wait. Supply 0 to not
+        block at all, and -1 to wait indefinitely.
+
+    SignalMask - Supplies an optional pointer to the signal mask to set for
+        the duration of the wait.
+
+Return Value:
+
+    Returns the number of ready events returned in the array.
+
+    0 if the timeout expired.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+#ifdef __cplusplus
+
+}
+
+#endif
+#endif
+
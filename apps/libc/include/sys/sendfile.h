@@ -0,0 +1,102 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    sendfile.h
+
+Abstract:
+
+    This header contains definitions for transferring data between file
+    descriptors within the kernel.
+
+Author:
+
+    agent 16-Oct-2026
+
+--*/
+
+#ifndef _SYS_SENDFILE_H
+#define _SYS_SENDFILE_H
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <sys/types.h>
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#ifdef __cplusplus
+
+extern "C" {
+
+#endif
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
+LIBC_API
+ssize_t
+sendfile (
+    int OutputDescriptor,
+    int InputDescriptor,
+    off_t *Offset,
+    size_t Count
+    );
+
+/*++
+
+Routine Description:
+
+    This routine copies data from one file descriptor to another without
+    passing it through a user mode buffer. If the input is a regular file, its
+    cached pages are handed directly to the output.
+
+Arguments:
+
+    OutputDescriptor - Supplies the file descriptor to write to. This is
+        typically a socket, but can be any writable descriptor.
+
+    InputDescriptor - Supplies the file descriptor to read from.
+
+    Offset - Supplies an optional pointer to the offset to start reading
+        from. On return, this is updated to the offset following the last
+        byte sent, and the input's file position is not changed. If NULL, the
+        input's file position is used and updated.
+
+    Count - Supplies the number of bytes to transfer.
+
+Return Value:
+
+    Returns the number of bytes written to the output, which may be less than
+    requested.
+
+    -1 on failure, and errno will be set to contain more information.
+
+--*/
+
+#ifdef __cplusplus
+
+}
+
+#endif
+#endif
+
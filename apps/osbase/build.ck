@@ -65,6 +65,7 @@ function build() {
     } else if (arch == "x64") {
         text_base = "0x200000";
         arch_sources = [
+            "x64/features.c",
             "x64/osbasea.S",
             "x64/syscall.c"
         ];
@@ -13,7 +13,11 @@ Module Name:
 
 Abstract:
 
-    This module implements the memory heap for the C library.
+    This module implements the memory heap for the C library. Allocations are
+    spread across several arenas, each a separately locked memory heap. Small
+    allocations are additionally served out of per-thread caches of size
+    classes, which are refilled from and drained back to the arenas in
+    batches so that most small allocations and frees take no lock at all.
 
 Author:
 
@@ -35,6 +39,16 @@ Module Name:
 // --------------------------------------------------------------------- Macros
 //
 
+//
+// This macro evaluates to non-zero if blocks from the given arena may be held
+// in thread caches. Caching is skipped while the arena collects tag
+// statistics, since a cached block stays charged to the tag it was first
+// allocated under no matter who frees or reuses it.
+//
+
+#define OS_HEAP_ARENA_CACHEABLE(_Arena) \
+    (((_Arena)->Heap.Flags & MEMORY_HEAP_FLAG_COLLECT_TAG_STATISTICS) == 0)
+
 //
 // ---------------------------------------------------------------- Definitions
 //
@@ -47,10 +61,111 @@ Module Name:
 #define SYSTEM_HEAP_MAGIC 0x6C6F6F50 // 'looP'
 #define SYSTEM_HEAP_DIRECT_ALLOCATION_THRESHOLD (256 * _1MB)
 
+//
+// Define the number of arenas backing the heap. Threads are assigned to an
+// arena round-robin when they first allocate.
+//
+
+#define OS_HEAP_ARENA_COUNT 4
+
+//
+// Define the thread cache size classes. Each class is a multiple of the
+// granularity, up to the maximum cached size.
+//
+
+#define OS_HEAP_CACHE_GRANULARITY_SHIFT 4
+#define OS_HEAP_CACHE_CLASS_COUNT 16
+#define OS_HEAP_CACHE_MAX_SIZE \
+    (OS_HEAP_CACHE_CLASS_COUNT << OS_HEAP_CACHE_GRANULARITY_SHIFT)
+
+//
+// Define the number of free blocks a thread cache bin can hold before half
+// of them are returned to the arenas, and the number of blocks allocated at
+// once when a bin is empty.
+//
+
+#define OS_HEAP_CACHE_BIN_LIMIT 32
+#define OS_HEAP_CACHE_BATCH_SIZE 8
+
+//
+// Define the allocation tag used for the thread cache structures: HepC.
+//
+
+#define OS_HEAP_CACHE_ALLOCATION_TAG 0x43706548
+
+//
+// Define the value stored in the second word of each block sitting in a
+// thread cache bin, used to catch blocks freed twice.
+//
+
+#define OS_HEAP_CACHE_FREE_MAGIC ((PVOID)(UINTN)0x65657246) // 'eerF'
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
 
+/*++
+
+Structure Description:
+
+    This structure stores a heap arena, one of several independently locked
+    heaps that back the process heap.
+
+Members:
+
+    Heap - Stores the memory heap itself.
+
+    Lock - Stores the lock serializing access to the heap.
+
+--*/
+
+typedef struct _OS_HEAP_ARENA {
+    MEMORY_HEAP Heap;
+    OS_LOCK Lock;
+} OS_HEAP_ARENA, *POS_HEAP_ARENA;
+
+/*++
+
+Structure Description:
+
+    This structure stores a list of free blocks of one size class held by a
+    thread cache.
+
+Members:
+
+    Head - Stores a pointer to the first free block. The first pointer of each
+        free block points to the next free block, and the second holds the
+        cache free magic.
+
+    Count - Stores the number of blocks on the list.
+
+--*/
+
+typedef struct _OS_HEAP_CACHE_BIN {
+    PVOID *Head;
+    UINTN Count;
+} OS_HEAP_CACHE_BIN, *POS_HEAP_CACHE_BIN;
+
+/*++
+
+Structure Description:
+
+    This structure stores the per-thread heap cache. It is only ever touched
+    by its owning thread, so it requires no synchronization.
+
+Members:
+
+    Arena - Stores a pointer to the arena this thread allocates from.
+
+    Bins - Stores the array of free block lists, one for each size class.
+
+--*/
+
+typedef struct _OS_HEAP_THREAD_CACHE {
+    POS_HEAP_ARENA Arena;
+    OS_HEAP_CACHE_BIN Bins[OS_HEAP_CACHE_CLASS_COUNT];
+} OS_HEAP_THREAD_CACHE, *POS_HEAP_THREAD_CACHE;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -76,16 +191,60 @@ OspHeapCorruption (
     PVOID Parameter
     );
 
+POS_HEAP_THREAD_CACHE
+OspHeapGetThreadCache (
+    BOOL Create
+    );
+
+PVOID
+OspHeapRefillCacheBin (
+    POS_HEAP_THREAD_CACHE Cache,
+    ULONG Class,
+    UINTN Tag
+    );
+
+VOID
+OspHeapDrainCacheBin (
+    POS_HEAP_CACHE_BIN Bin,
+    UINTN Target
+    );
+
+BOOL
+OspHeapCheckCachedFree (
+    POS_HEAP_ARENA Arena,
+    POS_HEAP_CACHE_BIN Bin,
+    PVOID Memory
+    );
+
+POS_HEAP_ARENA
+OspHeapFindArena (
+    PVOID Memory,
+    PUINTN Size
+    );
+
+VOID
+OspHeapAcquireArena (
+    POS_HEAP_ARENA Arena
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
 
 //
-// Store the primary heap.
+// Store the heap arenas. The first arena is used by threads that have no
+// thread cache.
+//
+
+OS_HEAP_ARENA OsHeapArenas[OS_HEAP_ARENA_COUNT];
+ULONG OsHeapNextArena;
+
+//
+// Store whether or not threads can have heap caches. This is not set until
+// the initial thread has a thread control block.
 //
 
-MEMORY_HEAP OsHeap;
-OS_LOCK OsHeapLock;
+BOOL OsHeapThreadCachesEnabled;
 
 //
 // Store the native page shift and mask.
@@ -128,10 +287,45 @@ Return Value:
 {
 
     PVOID Allocation;
+    POS_HEAP_ARENA Arena;
+    POS_HEAP_CACHE_BIN Bin;
+    PVOID *Block;
+    POS_HEAP_THREAD_CACHE Cache;
+    ULONG Class;
+
+    Cache = OspHeapGetThreadCache(TRUE);
+    if (Cache == NULL) {
+        Arena = &(OsHeapArenas[0]);
+
+    } else {
+
+        //
+        // Small allocations come straight out of the thread cache, refilling
+        // it in a batch if it's empty.
+        //
+
+        if ((Size != 0) && (Size <= OS_HEAP_CACHE_MAX_SIZE) &&
+            (OS_HEAP_ARENA_CACHEABLE(Cache->Arena))) {
+
+            Class = (Size - 1) >> OS_HEAP_CACHE_GRANULARITY_SHIFT;
+            Bin = &(Cache->Bins[Class]);
+            Block = Bin->Head;
+            if (Block != NULL) {
+                Bin->Head = Block[0];
+                Bin->Count -= 1;
+                Block[1] = NULL;
+                return Block;
+            }
+
+            return OspHeapRefillCacheBin(Cache, Class, Tag);
+        }
+
+        Arena = Cache->Arena;
+    }
 
-    OsAcquireLock(&OsHeapLock);
-    Allocation = RtlHeapAllocate(&OsHeap, Size, Tag);
-    OsReleaseLock(&OsHeapLock);
+    OspHeapAcquireArena(Arena);
+    Allocation = RtlHeapAllocate(&(Arena->Heap), Size, Tag);
+    OsReleaseLock(&(Arena->Lock));
     return Allocation;
 }
 
@@ -159,9 +353,63 @@ Return Value:
 
 {
 
-    OsAcquireLock(&OsHeapLock);
-    RtlHeapFree(&OsHeap, Memory);
-    OsReleaseLock(&OsHeapLock);
+    POS_HEAP_ARENA Arena;
+    POS_HEAP_CACHE_BIN Bin;
+    PVOID *Block;
+    POS_HEAP_THREAD_CACHE Cache;
+    ULONG Class;
+    UINTN Size;
+
+    if (Memory == NULL) {
+        return;
+    }
+
+    //
+    // If no arena claims the allocation, let the first arena report the
+    // corruption.
+    //
+
+    Arena = OspHeapFindArena(Memory, &Size);
+    if (Arena == NULL) {
+        Arena = &(OsHeapArenas[0]);
+
+    } else {
+
+        //
+        // Stash small blocks in the thread cache, returning half the bin to
+        // the arenas if it gets too full. The block may have come from any
+        // arena. It gets checked first, since the arena won't see this free.
+        //
+
+        Class = (Size >> OS_HEAP_CACHE_GRANULARITY_SHIFT) - 1;
+        if ((Size >= (1 << OS_HEAP_CACHE_GRANULARITY_SHIFT)) &&
+            (Class < OS_HEAP_CACHE_CLASS_COUNT) &&
+            (OS_HEAP_ARENA_CACHEABLE(Arena))) {
+
+            Cache = OspHeapGetThreadCache(FALSE);
+            if (Cache != NULL) {
+                Bin = &(Cache->Bins[Class]);
+                if (OspHeapCheckCachedFree(Arena, Bin, Memory) == FALSE) {
+                    return;
+                }
+
+                Block = Memory;
+                Block[0] = Bin->Head;
+                Block[1] = OS_HEAP_CACHE_FREE_MAGIC;
+                Bin->Head = Block;
+                Bin->Count += 1;
+                if (Bin->Count > OS_HEAP_CACHE_BIN_LIMIT) {
+                    OspHeapDrainCacheBin(Bin, OS_HEAP_CACHE_BIN_LIMIT / 2);
+                }
+
+                return;
+            }
+        }
+    }
+
+    OspHeapAcquireArena(Arena);
+    RtlHeapFree(&(Arena->Heap), Memory);
+    OsReleaseLock(&(Arena->Lock));
     return;
 }
 
@@ -203,10 +451,34 @@ Return Value:
 {
 
     PVOID Allocation;
+    POS_HEAP_ARENA Arena;
+    UINTN Size;
+
+    if (Memory == NULL) {
+        return OsHeapAllocate(NewSize, Tag);
+
+    } else if (NewSize == 0) {
+        OsHeapFree(Memory);
+        return NULL;
+    }
 
-    OsAcquireLock(&OsHeapLock);
-    Allocation = RtlHeapReallocate(&OsHeap, Memory, NewSize, Tag);
-    OsReleaseLock(&OsHeapLock);
+    //
+    // Small allocations that already fit don't need to touch the arena at
+    // all. Otherwise the allocation must be resized within the arena that
+    // owns it.
+    //
+
+    Arena = OspHeapFindArena(Memory, &Size);
+    if (Arena == NULL) {
+        Arena = &(OsHeapArenas[0]);
+
+    } else if ((NewSize <= Size) && (Size <= OS_HEAP_CACHE_MAX_SIZE)) {
+        return Memory;
+    }
+
+    OspHeapAcquireArena(Arena);
+    Allocation = RtlHeapReallocate(&(Arena->Heap), Memory, NewSize, Tag);
+    OsReleaseLock(&(Arena->Lock));
     return Allocation;
 }
 
@@ -244,11 +516,24 @@ Return Value:
 
 {
 
+    POS_HEAP_ARENA Arena;
+    POS_HEAP_THREAD_CACHE Cache;
     KSTATUS Status;
 
-    OsAcquireLock(&OsHeapLock);
-    Status = RtlHeapAlignedAllocate(&OsHeap, Memory, Alignment, Size, Tag);
-    OsReleaseLock(&OsHeapLock);
+    Arena = &(OsHeapArenas[0]);
+    Cache = OspHeapGetThreadCache(TRUE);
+    if (Cache != NULL) {
+        Arena = Cache->Arena;
+    }
+
+    OspHeapAcquireArena(Arena);
+    Status = RtlHeapAlignedAllocate(&(Arena->Heap),
+                                    Memory,
+                                    Alignment,
+                                    Size,
+                                    Tag);
+
+    OsReleaseLock(&(Arena->Lock));
     return Status;
 }
 
@@ -277,9 +562,69 @@ Return Value:
 
 {
 
-    OsAcquireLock(&OsHeapLock);
-    RtlValidateHeap(&OsHeap, NULL);
-    OsReleaseLock(&OsHeapLock);
+    POS_HEAP_ARENA Arena;
+    ULONG Index;
+
+    for (Index = 0; Index < OS_HEAP_ARENA_COUNT; Index += 1) {
+        Arena = &(OsHeapArenas[Index]);
+        OsAcquireLock(&(Arena->Lock));
+        RtlValidateHeap(&(Arena->Heap), NULL);
+        OsReleaseLock(&(Arena->Lock));
+    }
+
+    return;
+}
+
+OS_API
+VOID
+OsGetHeapStatistics (
+    PMEMORY_HEAP_STATISTICS Statistics
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the statistics for the heap, summed across all heap
+    arenas. Blocks held in thread caches are counted as allocated.
+
+Arguments:
+
+    Statistics - Supplies a pointer where the heap statistics will be returned.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    POS_HEAP_ARENA Arena;
+    PMEMORY_HEAP_STATISTICS ArenaStatistics;
+    ULONG Index;
+
+    RtlZeroMemory(Statistics, sizeof(MEMORY_HEAP_STATISTICS));
+    for (Index = 0; Index < OS_HEAP_ARENA_COUNT; Index += 1) {
+        Arena = &(OsHeapArenas[Index]);
+        ArenaStatistics = &(Arena->Heap.Statistics);
+        OsAcquireLock(&(Arena->Lock));
+        Statistics->TotalHeapSize += ArenaStatistics->TotalHeapSize;
+        Statistics->MaxHeapSize += ArenaStatistics->MaxHeapSize;
+        Statistics->FreeListSize += ArenaStatistics->FreeListSize;
+        Statistics->DirectAllocationSize +=
+                                         ArenaStatistics->DirectAllocationSize;
+
+        Statistics->Allocations += ArenaStatistics->Allocations;
+        Statistics->TotalAllocationCalls +=
+                                         ArenaStatistics->TotalAllocationCalls;
+
+        Statistics->FailedAllocations += ArenaStatistics->FailedAllocations;
+        Statistics->TotalFreeCalls += ArenaStatistics->TotalFreeCalls;
+        Statistics->LockContentions += ArenaStatistics->LockContentions;
+        OsReleaseLock(&(Arena->Lock));
+    }
+
     return;
 }
 
@@ -306,22 +651,98 @@ Return Value:
 
 {
 
+    POS_HEAP_ARENA Arena;
     ULONG Flags;
+    ULONG Index;
 
-    OsInitializeLockDefault(&OsHeapLock);
     OsPageSize = OsEnvironment->StartData->PageSize;
     OsPageShift = RtlCountTrailingZeros(OsPageSize);
     Flags = MEMORY_HEAP_FLAG_NO_PARTIAL_FREES;
-    RtlHeapInitialize(&OsHeap,
-                      OspHeapExpand,
-                      OspHeapContract,
-                      OspHeapCorruption,
-                      SYSTEM_HEAP_MINIMUM_EXPANSION_PAGES << OsPageShift,
-                      OsPageSize,
-                      SYSTEM_HEAP_MAGIC,
-                      Flags);
-
-    OsHeap.DirectAllocationThreshold = SYSTEM_HEAP_DIRECT_ALLOCATION_THRESHOLD;
+    for (Index = 0; Index < OS_HEAP_ARENA_COUNT; Index += 1) {
+        Arena = &(OsHeapArenas[Index]);
+        OsInitializeLockDefault(&(Arena->Lock));
+        RtlHeapInitialize(&(Arena->Heap),
+                          OspHeapExpand,
+                          OspHeapContract,
+                          OspHeapCorruption,
+                          SYSTEM_HEAP_MINIMUM_EXPANSION_PAGES << OsPageShift,
+                          OsPageSize,
+                          SYSTEM_HEAP_MAGIC,
+                          Flags);
+
+        Arena->Heap.DirectAllocationThreshold =
+                                       SYSTEM_HEAP_DIRECT_ALLOCATION_THRESHOLD;
+    }
+
+    return;
+}
+
+VOID
+OspEnableHeapThreadCaches (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine enables per-thread heap caches. It is called once the initial
+    thread has a thread control block in which to store its cache.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    OsHeapThreadCachesEnabled = TRUE;
+    return;
+}
+
+VOID
+OspDestroyHeapThreadCache (
+    PVOID ThreadCache
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns all blocks held by a thread heap cache back to the
+    heap arenas and frees the cache itself. The owning thread must not use the
+    cache again.
+
+Arguments:
+
+    ThreadCache - Supplies a pointer to the thread cache to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    POS_HEAP_ARENA Arena;
+    POS_HEAP_THREAD_CACHE Cache;
+    ULONG Class;
+
+    Cache = ThreadCache;
+    for (Class = 0; Class < OS_HEAP_CACHE_CLASS_COUNT; Class += 1) {
+        OspHeapDrainCacheBin(&(Cache->Bins[Class]), 0);
+    }
+
+    Arena = Cache->Arena;
+    OspHeapAcquireArena(Arena);
+    RtlHeapFree(&(Arena->Heap), Cache);
+    OsReleaseLock(&(Arena->Lock));
     return;
 }
 
@@ -473,3 +894,348 @@ Return Value:
     return;
 }
 
+POS_HEAP_THREAD_CACHE
+OspHeapGetThreadCache (
+    BOOL Create
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the heap cache for the current thread.
+
+Arguments:
+
+    Create - Supplies a boolean indicating whether or not to create the thread
+        cache if the current thread does not yet have one.
+
+Return Value:
+
+    Returns a pointer to the current thread's heap cache.
+
+    NULL if thread caches are not yet enabled, the thread has no cache and
+    creation was not requested, or the cache could not be allocated.
+
+--*/
+
+{
+
+    POS_HEAP_ARENA Arena;
+    POS_HEAP_THREAD_CACHE Cache;
+    PVOID *CacheSlot;
+    ULONG Index;
+
+    if (OsHeapThreadCachesEnabled == FALSE) {
+        return NULL;
+    }
+
+    CacheSlot = OspTlsGetHeapCache();
+    if (CacheSlot == NULL) {
+        return NULL;
+    }
+
+    Cache = *CacheSlot;
+    if ((Cache != NULL) || (Create == FALSE)) {
+        return Cache;
+    }
+
+    //
+    // Pick an arena for this thread and carve the cache out of it.
+    //
+
+    Index = RtlAtomicAdd32(&OsHeapNextArena, 1) % OS_HEAP_ARENA_COUNT;
+    Arena = &(OsHeapArenas[Index]);
+    OspHeapAcquireArena(Arena);
+    Cache = RtlHeapAllocate(&(Arena->Heap),
+                            sizeof(OS_HEAP_THREAD_CACHE),
+                            OS_HEAP_CACHE_ALLOCATION_TAG);
+
+    OsReleaseLock(&(Arena->Lock));
+    if (Cache == NULL) {
+        return NULL;
+    }
+
+    RtlZeroMemory(Cache, sizeof(OS_HEAP_THREAD_CACHE));
+    Cache->Arena = Arena;
+    *CacheSlot = Cache;
+    return Cache;
+}
+
+PVOID
+OspHeapRefillCacheBin (
+    POS_HEAP_THREAD_CACHE Cache,
+    ULONG Class,
+    UINTN Tag
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates a batch of blocks for an empty thread cache bin
+    from the thread's arena, acquiring the arena lock only once.
+
+Arguments:
+
+    Cache - Supplies a pointer to the current thread's heap cache.
+
+    Class - Supplies the size class to refill.
+
+    Tag - Supplies the tag to mark the allocations with.
+
+Return Value:
+
+    Returns a pointer to a block to hand back to the caller, with the rest of
+    the batch placed in the bin.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    PVOID Allocation;
+    POS_HEAP_ARENA Arena;
+    POS_HEAP_CACHE_BIN Bin;
+    PVOID *Block;
+    ULONG Count;
+    UINTN Size;
+
+    Arena = Cache->Arena;
+    Bin = &(Cache->Bins[Class]);
+    Size = (Class + 1) << OS_HEAP_CACHE_GRANULARITY_SHIFT;
+    OspHeapAcquireArena(Arena);
+    Allocation = RtlHeapAllocate(&(Arena->Heap), Size, Tag);
+    if (Allocation != NULL) {
+        for (Count = 1; Count < OS_HEAP_CACHE_BATCH_SIZE; Count += 1) {
+            Block = RtlHeapAllocate(&(Arena->Heap), Size, Tag);
+            if (Block == NULL) {
+                break;
+            }
+
+            Block[0] = Bin->Head;
+            Block[1] = OS_HEAP_CACHE_FREE_MAGIC;
+            Bin->Head = Block;
+            Bin->Count += 1;
+        }
+    }
+
+    OsReleaseLock(&(Arena->Lock));
+    return Allocation;
+}
+
+VOID
+OspHeapDrainCacheBin (
+    POS_HEAP_CACHE_BIN Bin,
+    UINTN Target
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns blocks from a thread cache bin to the arenas that own
+    them. Runs of blocks belonging to the same arena are freed under a single
+    acquisition of that arena's lock.
+
+Arguments:
+
+    Bin - Supplies a pointer to the bin to drain.
+
+    Target - Supplies the number of blocks to leave in the bin.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    POS_HEAP_ARENA Arena;
+    PVOID *Block;
+    POS_HEAP_ARENA LockedArena;
+
+    LockedArena = NULL;
+    while (Bin->Count > Target) {
+        Block = Bin->Head;
+        Bin->Head = *Block;
+        Bin->Count -= 1;
+        Arena = OspHeapFindArena(Block, NULL);
+
+        ASSERT(Arena != NULL);
+
+        if (Arena != LockedArena) {
+            if (LockedArena != NULL) {
+                OsReleaseLock(&(LockedArena->Lock));
+            }
+
+            OspHeapAcquireArena(Arena);
+            LockedArena = Arena;
+        }
+
+        RtlHeapFree(&(Arena->Heap), Block);
+    }
+
+    if (LockedArena != NULL) {
+        OsReleaseLock(&(LockedArena->Lock));
+    }
+
+    return;
+}
+
+BOOL
+OspHeapCheckCachedFree (
+    POS_HEAP_ARENA Arena,
+    POS_HEAP_CACHE_BIN Bin,
+    PVOID Memory
+    )
+
+/*++
+
+Routine Description:
+
+    This routine checks a block that is about to be freed into a thread cache
+    bin, standing in for the checks the arena would have made had the block
+    been freed to it.
+
+Arguments:
+
+    Arena - Supplies a pointer to the arena that owns the block.
+
+    Bin - Supplies a pointer to the bin the block is going into.
+
+    Memory - Supplies the allocation being freed.
+
+Return Value:
+
+    TRUE if the block can be cached.
+
+    FALSE if the block was already free or is corrupt. The heap corruption
+    routine will have been called.
+
+--*/
+
+{
+
+    PVOID *Block;
+    BOOL Valid;
+
+    //
+    // A block carrying the free magic may just hold data that happens to
+    // match, so only call it a double free if it's really in the bin. A block
+    // already sitting in another thread's cache isn't caught here.
+    //
+
+    if (((PVOID *)Memory)[1] == OS_HEAP_CACHE_FREE_MAGIC) {
+        for (Block = Bin->Head; Block != NULL; Block = *Block) {
+            if (Block == Memory) {
+                OspHeapCorruption(&(Arena->Heap),
+                                  HeapCorruptionDoubleFree,
+                                  Memory);
+
+                return FALSE;
+            }
+        }
+    }
+
+    Valid = TRUE;
+
+    //
+    // Checked builds also run the arena's full free-time validation. This
+    // looks at the neighboring chunks, so it needs the arena lock.
+    //
+
+#if DEBUG
+
+    OspHeapAcquireArena(Arena);
+    Valid = RtlHeapValidateAllocation(&(Arena->Heap), Memory);
+    OsReleaseLock(&(Arena->Lock));
+
+#endif
+
+    return Valid;
+}
+
+POS_HEAP_ARENA
+OspHeapFindArena (
+    PVOID Memory,
+    PUINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines which arena an allocation came from. No locks are
+    needed since the caller owns the allocation.
+
+Arguments:
+
+    Memory - Supplies the allocation to look up.
+
+    Size - Supplies an optional pointer where the usable size of the
+        allocation will be returned.
+
+Return Value:
+
+    Returns a pointer to the arena that owns the allocation.
+
+    NULL if no arena owns the allocation, which indicates heap corruption.
+
+--*/
+
+{
+
+    POS_HEAP_ARENA Arena;
+    ULONG Index;
+    UINTN UsableSize;
+
+    for (Index = 0; Index < OS_HEAP_ARENA_COUNT; Index += 1) {
+        Arena = &(OsHeapArenas[Index]);
+        UsableSize = RtlHeapGetAllocationSize(&(Arena->Heap), Memory);
+        if (UsableSize != 0) {
+            if (Size != NULL) {
+                *Size = UsableSize;
+            }
+
+            return Arena;
+        }
+    }
+
+    return NULL;
+}
+
+VOID
+OspHeapAcquireArena (
+    POS_HEAP_ARENA Arena
+    )
+
+/*++
+
+Routine Description:
+
+    This routine acquires the lock for the given heap arena, counting the
+    acquisition as contended if the lock could not be taken immediately.
+
+Arguments:
+
+    Arena - Supplies a pointer to the arena to lock.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (OsTryToAcquireLock(&(Arena->Lock)) == FALSE) {
+        OsAcquireLock(&(Arena->Lock));
+        Arena->Heap.Statistics.LockContentions += 1;
+    }
+
+    return;
+}
+
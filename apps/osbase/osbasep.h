@@ -202,6 +202,28 @@ Return Value:
 
 --*/
 
+VOID
+OspSetUpProcessorFeatures (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine enables any optional processor features the OS base library
+    takes advantage of.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
 VOID
 OspSignalHandler (
     PSIGNAL_PARAMETERS Parameters,
@@ -250,6 +272,51 @@ Return Value:
 
 --*/
 
+VOID
+OspEnableHeapThreadCaches (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine enables per-thread heap caches. It is called once the initial
+    thread has a thread control block in which to store its cache.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+OspDestroyHeapThreadCache (
+    PVOID ThreadCache
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns all blocks held by a thread heap cache back to the
+    heap arenas and frees the cache itself. The owning thread must not use the
+    cache again.
+
+Arguments:
+
+    ThreadCache - Supplies a pointer to the thread cache to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
 VOID
 OspInitializeImageSupport (
     VOID
@@ -412,6 +479,30 @@ Return Value:
 
 --*/
 
+PVOID *
+OspTlsGetHeapCache (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the location where the current thread's heap cache
+    pointer is stored.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns a pointer to the current thread's heap cache pointer.
+
+    NULL if the current thread has no thread control block.
+
+--*/
+
 VOID
 OspTlsTearDownModule (
     PLOADED_IMAGE Image
@@ -430,6 +430,7 @@ Return Value:
 
     OspTlsAllocate(&OsLoadedImagesHead, &ThreadData);
     OsSetThreadPointer(ThreadData);
+    OspEnableHeapThreadCaches();
 
     //
     // Now that TLS offsets are settled, relocate the images.
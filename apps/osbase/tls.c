@@ -76,6 +76,9 @@ Structure Description:
     ListEntry - Stores pointers to the next and previous threads in the OS
         Library thread list.
 
+    HeapCache - Stores a pointer to the thread's heap cache, or NULL if the
+        thread has not allocated yet.
+
 --*/
 
 typedef struct _THREAD_CONTROL_BLOCK {
@@ -86,6 +89,7 @@ typedef struct _THREAD_CONTROL_BLOCK {
     UINTN StackGuard;
     UINTN BaseAllocationSize;
     LIST_ENTRY ListEntry;
+    PVOID HeapCache;
 } THREAD_CONTROL_BLOCK, *PTHREAD_CONTROL_BLOCK;
 
 //
@@ -634,6 +638,15 @@ Return Value:
         OsHeapFree(ThreadControlBlock->TlsVector);
     }
 
+    //
+    // Give any blocks cached by the thread back to the heap.
+    //
+
+    if (ThreadControlBlock->HeapCache != NULL) {
+        OspDestroyHeapThreadCache(ThreadControlBlock->HeapCache);
+        ThreadControlBlock->HeapCache = NULL;
+    }
+
     OsAcquireLock(&OsThreadListLock);
     LIST_REMOVE(&(ThreadControlBlock->ListEntry));
     OsReleaseLock(&OsThreadListLock);
@@ -644,6 +657,42 @@ Return Value:
     return;
 }
 
+PVOID *
+OspTlsGetHeapCache (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the location where the current thread's heap cache
+    pointer is stored.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns a pointer to the current thread's heap cache pointer.
+
+    NULL if the current thread has no thread control block.
+
+--*/
+
+{
+
+    PTHREAD_CONTROL_BLOCK ThreadControlBlock;
+
+    ThreadControlBlock = OspGetThreadControlBlock();
+    if (ThreadControlBlock == NULL) {
+        return NULL;
+    }
+
+    return &(ThreadControlBlock->HeapCache);
+}
+
 VOID
 OspTlsTearDownModule (
     PLOADED_IMAGE Image
@@ -0,0 +1,89 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    features.c
+
+Abstract:
+
+    This module implements support for processor features on x64.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    User mode
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "../osbasep.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+VOID
+OspSetUpProcessorFeatures (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine enables any optional processor features the OS base library
+    takes advantage of.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    //
+    // SSE2 is architectural on x64.
+    //
+
+    RtlSetMemoryFeatures(RTL_MEMORY_FEATURE_SSE2);
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
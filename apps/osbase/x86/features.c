@@ -51,7 +51,8 @@ ULONG OsProcessorFeatureMasks[OsX86FeatureCount] = {
     0,
     X86_FEATURE_SYSENTER,
     X86_FEATURE_I686,
-    X86_FEATURE_FXSAVE
+    X86_FEATURE_FXSAVE,
+    X86_FEATURE_SSE2
 };
 
 //
@@ -101,6 +102,45 @@ Return Value:
     return FALSE;
 }
 
+VOID
+OspSetUpProcessorFeatures (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine enables any optional processor features the OS base library
+    takes advantage of.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PUSER_SHARED_DATA Data;
+
+    //
+    // The kernel preserves the vector registers for user mode threads, so
+    // let the memory routines use them if they're there.
+    //
+
+    Data = OspGetUserSharedData();
+    if ((Data->ProcessorFeatures & X86_FEATURE_SSE2) != 0) {
+        RtlSetMemoryFeatures(RTL_MEMORY_FEATURE_SSE2);
+    }
+
+    return;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -45,6 +45,8 @@ function build() {
         "read.c",
         "rename.c",
         "stat.c",
+        "tcpidle.c",
+        "tcpio.c",
         "write.c"
     ];
 
@@ -392,6 +392,27 @@ PT_TEST_INFORMATION PerformanceTests[PtTestTypeCount] = {
      PtTestFstat,
      PtResultIterations,
      FSTAT_TEST_DEFAULT_DURATION},
+
+    {TCP_IO_NEW_RENO_TEST_NAME,
+     TCP_IO_NEW_RENO_TEST_DESCRIPTION,
+     TcpIoMain,
+     PtTestTcpIoNewReno,
+     PtResultBytes,
+     TCP_IO_NEW_RENO_TEST_DEFAULT_DURATION},
+
+    {TCP_IO_CUBIC_TEST_NAME,
+     TCP_IO_CUBIC_TEST_DESCRIPTION,
+     TcpIoMain,
+     PtTestTcpIoCubic,
+     PtResultBytes,
+     TCP_IO_CUBIC_TEST_DEFAULT_DURATION},
+
+    {TCP_IDLE_TEST_NAME,
+     TCP_IDLE_TEST_DESCRIPTION,
+     TcpIdleMain,
+     PtTestTcpIdle,
+     PtResultIterations,
+     TCP_IDLE_TEST_DEFAULT_DURATION},
 };
 
 //
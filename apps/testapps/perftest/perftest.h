@@ -133,6 +133,21 @@ Module Name:
 #define FSTAT_TEST_DESCRIPTION \
     "Benchmarks the fstat() C library routine."
 
+#define TCP_IO_NEW_RENO_TEST_NAME "tcp_io_new_reno"
+#define TCP_IO_NEW_RENO_TEST_DESCRIPTION \
+    "Benchmarks TCP throughput with New Reno congestion control. Needs a " \
+    "real interface, whose address is given in PT_TCP_IO_ADDRESS."
+
+#define TCP_IO_CUBIC_TEST_NAME "tcp_io_cubic"
+#define TCP_IO_CUBIC_TEST_DESCRIPTION \
+    "Benchmarks TCP throughput with CUBIC congestion control. Needs a " \
+    "real interface, whose address is given in PT_TCP_IO_ADDRESS."
+
+#define TCP_IDLE_TEST_NAME "tcp_idle"
+#define TCP_IDLE_TEST_DESCRIPTION \
+    "Benchmarks TCP round trips alongside many idle connections. Needs a " \
+    "real interface, whose address is given in PT_TCP_IO_ADDRESS."
+
 //
 // Default test durations, in seconds.
 //
@@ -165,6 +180,9 @@ Module Name:
 #define MUTEX_CONTENDED_TEST_DEFAULT_DURATION 30
 #define STAT_TEST_DEFAULT_DURATION 30
 #define FSTAT_TEST_DEFAULT_DURATION 30
+#define TCP_IO_NEW_RENO_TEST_DEFAULT_DURATION 30
+#define TCP_IO_CUBIC_TEST_DEFAULT_DURATION 30
+#define TCP_IDLE_TEST_DEFAULT_DURATION 30
 
 //
 // Define the number of variables supplied to an iteration of the execute test
@@ -207,6 +225,9 @@ typedef enum _PT_TEST_TYPE {
     PtTestMutexContended,
     PtTestStat,
     PtTestFstat,
+    PtTestTcpIoNewReno,
+    PtTestTcpIoCubic,
+    PtTestTcpIdle,
     PtTestTypeCount
 } PT_TEST_TYPE, *PPT_TEST_TYPE;
 
@@ -978,3 +999,53 @@ Return Value:
 
 --*/
 
+void
+TcpIoMain (
+    PPT_TEST_INFORMATION Test,
+    PPT_TEST_RESULT Result
+    );
+
+/*++
+
+Routine Description:
+
+    This routine performs the TCP I/O performance benchmark tests.
+
+Arguments:
+
+    Test - Supplies a pointer to the performance test being executed.
+
+    Result - Supplies a pointer to a performance test result structure that
+        receives the tests results.
+
+Return Value:
+
+    None.
+
+--*/
+
+void
+TcpIdleMain (
+    PPT_TEST_INFORMATION Test,
+    PPT_TEST_RESULT Result
+    );
+
+/*++
+
+Routine Description:
+
+    This routine performs the TCP idle connection performance benchmark test.
+
+Arguments:
+
+    Test - Supplies a pointer to the performance test being executed.
+
+    Result - Supplies a pointer to a performance test result structure that
+        receives the tests results.
+
+Return Value:
+
+    None.
+
+--*/
+
@@ -0,0 +1,441 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    tcpidle.c
+
+Abstract:
+
+    This module implements the performance benchmark test that measures TCP
+    round trip latency on one busy connection while many other connections
+    sit idle.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    User
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "perftest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the number of idle connections held open during the test. Each one
+// costs a descriptor on both ends, so keep this under the default limit.
+//
+
+#define PT_TCP_IDLE_CONNECTION_COUNT 128
+
+//
+// Define the environment variable that holds the address the test connects
+// to. It must be the address of a local network interface the test can listen
+// on. There is no loopback interface, so the test cannot run without it.
+//
+
+#define PT_TCP_IDLE_ADDRESS_VARIABLE "PT_TCP_IO_ADDRESS"
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+void
+PtpTcpIdleEcho (
+    int ListeningSocket
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+void
+TcpIdleMain (
+    PPT_TEST_INFORMATION Test,
+    PPT_TEST_RESULT Result
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs the TCP idle connection performance benchmark test.
+    The parent opens a set of connections to a child process and leaves them
+    idle with keep alive enabled, then counts how many one byte round trips
+    it can complete on one more connection.
+
+Arguments:
+
+    Test - Supplies a pointer to the performance test being executed.
+
+    Result - Supplies a pointer to a performance test result structure that
+        receives the tests results.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    struct sockaddr_in Address;
+    socklen_t AddressLength;
+    char *AddressString;
+    int Busy;
+    char Byte;
+    ssize_t ByteCount;
+    pid_t Child;
+    int ChildStatus;
+    int IdleSockets[PT_TCP_IDLE_CONNECTION_COUNT];
+    int Index;
+    unsigned long long Iterations;
+    int ListeningSocket;
+    int Option;
+    int Status;
+
+    Busy = -1;
+    Child = -1;
+    ChildStatus = 0;
+    Iterations = 0;
+    ListeningSocket = -1;
+    for (Index = 0; Index < PT_TCP_IDLE_CONNECTION_COUNT; Index += 1) {
+        IdleSockets[Index] = -1;
+    }
+
+    Result->Type = PtResultIterations;
+    Result->Status = 0;
+
+    //
+    // Create a listening socket on an ephemeral port of the test address.
+    //
+
+    AddressString = getenv(PT_TCP_IDLE_ADDRESS_VARIABLE);
+    if (AddressString == NULL) {
+        fprintf(stderr,
+                "%s: Set %s to the IPv4 address of a local network "
+                "interface.\n",
+                Test->Name,
+                PT_TCP_IDLE_ADDRESS_VARIABLE);
+
+        Result->Status = EDESTADDRREQ;
+        goto MainEnd;
+    }
+
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family = AF_INET;
+    if (inet_pton(AF_INET, AddressString, &(Address.sin_addr)) != 1) {
+        fprintf(stderr,
+                "%s: Invalid %s address: %s.\n",
+                Test->Name,
+                PT_TCP_IDLE_ADDRESS_VARIABLE,
+                AddressString);
+
+        Result->Status = EINVAL;
+        goto MainEnd;
+    }
+
+    ListeningSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (ListeningSocket < 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    AddressLength = sizeof(Address);
+    Status = bind(ListeningSocket, (struct sockaddr *)&Address, AddressLength);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    Status = getsockname(ListeningSocket,
+                         (struct sockaddr *)&Address,
+                         &AddressLength);
+
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    Status = listen(ListeningSocket, PT_TCP_IDLE_CONNECTION_COUNT + 1);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    //
+    // Fork off the child, which accepts every connection and echoes on the
+    // last one.
+    //
+
+    Child = fork();
+    if (Child < 0) {
+        Result->Status = errno;
+        goto MainEnd;
+
+    } else if (Child == 0) {
+        PtpTcpIdleEcho(ListeningSocket);
+    }
+
+    close(ListeningSocket);
+    ListeningSocket = -1;
+
+    //
+    // Open the idle connections. Keep alive gives each of them a pending
+    // deadline in the TCP stack, as a busy server's idle clients would have.
+    //
+
+    Option = 1;
+    for (Index = 0; Index < PT_TCP_IDLE_CONNECTION_COUNT; Index += 1) {
+        IdleSockets[Index] = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (IdleSockets[Index] < 0) {
+            Result->Status = errno;
+            goto MainEnd;
+        }
+
+        Status = setsockopt(IdleSockets[Index],
+                            SOL_SOCKET,
+                            SO_KEEPALIVE,
+                            &Option,
+                            sizeof(Option));
+
+        if (Status != 0) {
+            Result->Status = errno;
+            goto MainEnd;
+        }
+
+        Status = connect(IdleSockets[Index],
+                         (struct sockaddr *)&Address,
+                         AddressLength);
+
+        if (Status != 0) {
+            Result->Status = errno;
+            goto MainEnd;
+        }
+    }
+
+    Busy = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Busy < 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    Status = setsockopt(Busy,
+                        IPPROTO_TCP,
+                        TCP_NODELAY,
+                        &Option,
+                        sizeof(Option));
+
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    Status = connect(Busy, (struct sockaddr *)&Address, AddressLength);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    //
+    // Start the test. This snaps resource usage and starts the clock ticking.
+    //
+
+    Status = PtStartTimedTest(Test->Duration);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    Byte = 0;
+    while (PtIsTimedTestRunning() != 0) {
+        ByteCount = send(Busy, &Byte, 1, 0);
+        if (ByteCount < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            Result->Status = errno;
+            break;
+        }
+
+        do {
+            ByteCount = recv(Busy, &Byte, 1, 0);
+
+        } while ((ByteCount < 0) && (errno == EINTR));
+
+        if (ByteCount <= 0) {
+            Result->Status = errno;
+            if (ByteCount == 0) {
+                Result->Status = ECONNRESET;
+            }
+
+            break;
+        }
+
+        Iterations += 1;
+    }
+
+    Status = PtFinishTimedTest(Result);
+    if ((Status != 0) && (Result->Status == 0)) {
+        Result->Status = errno;
+    }
+
+MainEnd:
+    if (Busy >= 0) {
+        close(Busy);
+    }
+
+    for (Index = 0; Index < PT_TCP_IDLE_CONNECTION_COUNT; Index += 1) {
+        if (IdleSockets[Index] >= 0) {
+            close(IdleSockets[Index]);
+        }
+    }
+
+    if (ListeningSocket >= 0) {
+        close(ListeningSocket);
+    }
+
+    if (Child > 0) {
+        if (Result->Status != 0) {
+            kill(Child, SIGKILL);
+        }
+
+        while ((waitpid(Child, &ChildStatus, 0) < 0) && (errno == EINTR)) {
+            continue;
+        }
+
+        if ((Result->Status == 0) && (WIFEXITED(ChildStatus)) &&
+            (WEXITSTATUS(ChildStatus) != 0)) {
+
+            Result->Status = WEXITSTATUS(ChildStatus);
+        }
+    }
+
+    Result->Data.Iterations = Iterations;
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+void
+PtpTcpIdleEcho (
+    int ListeningSocket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the child of the TCP idle connection test. It
+    accepts all the idle connections and the busy one, then echoes every byte
+    received on the busy connection until the parent closes it. This routine
+    does not return.
+
+Arguments:
+
+    ListeningSocket - Supplies the listening socket to accept from.
+
+Return Value:
+
+    None. The process exits with zero on success or an error number on
+    failure.
+
+--*/
+
+{
+
+    int Busy;
+    char Byte;
+    ssize_t ByteCount;
+    int Connections[PT_TCP_IDLE_CONNECTION_COUNT + 1];
+    int Index;
+
+    for (Index = 0; Index <= PT_TCP_IDLE_CONNECTION_COUNT; Index += 1) {
+        do {
+            Connections[Index] = accept(ListeningSocket, NULL, NULL);
+
+        } while ((Connections[Index] < 0) && (errno == EINTR));
+
+        if (Connections[Index] < 0) {
+            exit(errno);
+        }
+    }
+
+    close(ListeningSocket);
+
+    //
+    // The parent connects the busy socket last, and the listen backlog keeps
+    // connections in order.
+    //
+
+    Busy = Connections[PT_TCP_IDLE_CONNECTION_COUNT];
+    while (1) {
+        ByteCount = recv(Busy, &Byte, 1, 0);
+        if (ByteCount == 0) {
+            break;
+        }
+
+        if (ByteCount < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            exit(errno);
+        }
+
+        do {
+            ByteCount = send(Busy, &Byte, 1, 0);
+
+        } while ((ByteCount < 0) && (errno == EINTR));
+
+        if (ByteCount < 0) {
+            exit(errno);
+        }
+    }
+
+    for (Index = 0; Index <= PT_TCP_IDLE_CONNECTION_COUNT; Index += 1) {
+        close(Connections[Index]);
+    }
+
+    exit(0);
+}
+
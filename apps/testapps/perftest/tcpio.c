@@ -0,0 +1,384 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    tcpio.c
+
+Abstract:
+
+    This module implements the performance benchmark tests for TCP
+    throughput under each congestion control algorithm.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    User
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "perftest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define PT_TCP_IO_BUFFER_SIZE (64 * 1024)
+
+//
+// Define the environment variable that holds the address the test connects
+// to. It must be the address of a local network interface the test can listen
+// on. There is no loopback interface, so the test cannot run without it.
+//
+
+#define PT_TCP_IO_ADDRESS_VARIABLE "PT_TCP_IO_ADDRESS"
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+void
+PtpTcpIoReceive (
+    int ListeningSocket
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+void
+TcpIoMain (
+    PPT_TEST_INFORMATION Test,
+    PPT_TEST_RESULT Result
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs the TCP I/O performance benchmark tests. A child
+    process accepts a connection and drains it while the parent sends as fast
+    as it can.
+
+Arguments:
+
+    Test - Supplies a pointer to the performance test being executed.
+
+    Result - Supplies a pointer to a performance test result structure that
+        receives the tests results.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    struct sockaddr_in Address;
+    socklen_t AddressLength;
+    char *AddressString;
+    int Algorithm;
+    char *Buffer;
+    ssize_t BytesWritten;
+    pid_t Child;
+    int ChildStatus;
+    int ListeningSocket;
+    int Sender;
+    int Status;
+    unsigned long long TotalBytes;
+
+    Buffer = NULL;
+    Child = -1;
+    ChildStatus = 0;
+    ListeningSocket = -1;
+    Sender = -1;
+    TotalBytes = 0;
+    Result->Type = PtResultBytes;
+    Result->Status = 0;
+    switch (Test->TestType) {
+    case PtTestTcpIoNewReno:
+        Algorithm = TCP_CONGESTION_NEW_RENO;
+        break;
+
+    case PtTestTcpIoCubic:
+        Algorithm = TCP_CONGESTION_CUBIC;
+        break;
+
+    default:
+        Result->Status = EINVAL;
+        goto MainEnd;
+    }
+
+    Buffer = malloc(PT_TCP_IO_BUFFER_SIZE);
+    if (Buffer == NULL) {
+        Result->Status = ENOMEM;
+        goto MainEnd;
+    }
+
+    memset(Buffer, 0xA5, PT_TCP_IO_BUFFER_SIZE);
+
+    //
+    // Create a listening socket on an ephemeral port of the test address.
+    //
+
+    AddressString = getenv(PT_TCP_IO_ADDRESS_VARIABLE);
+    if (AddressString == NULL) {
+        fprintf(stderr,
+                "%s: Set %s to the IPv4 address of a local network "
+                "interface.\n",
+                Test->Name,
+                PT_TCP_IO_ADDRESS_VARIABLE);
+
+        Result->Status = EDESTADDRREQ;
+        goto MainEnd;
+    }
+
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family = AF_INET;
+    if (inet_pton(AF_INET, AddressString, &(Address.sin_addr)) != 1) {
+        fprintf(stderr,
+                "%s: Invalid %s address: %s.\n",
+                Test->Name,
+                PT_TCP_IO_ADDRESS_VARIABLE,
+                AddressString);
+
+        Result->Status = EINVAL;
+        goto MainEnd;
+    }
+
+    ListeningSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (ListeningSocket < 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    AddressLength = sizeof(Address);
+    Status = bind(ListeningSocket, (struct sockaddr *)&Address, AddressLength);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    Status = getsockname(ListeningSocket,
+                         (struct sockaddr *)&Address,
+                         &AddressLength);
+
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    Status = listen(ListeningSocket, 1);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    //
+    // Fork off the receiver, which drains the connection until it closes.
+    //
+
+    Child = fork();
+    if (Child < 0) {
+        Result->Status = errno;
+        goto MainEnd;
+
+    } else if (Child == 0) {
+        PtpTcpIoReceive(ListeningSocket);
+    }
+
+    close(ListeningSocket);
+    ListeningSocket = -1;
+
+    //
+    // Connect the sender, which is the side whose congestion window matters.
+    //
+
+    Sender = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Sender < 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    Status = setsockopt(Sender,
+                        IPPROTO_TCP,
+                        TCP_CONGESTION_CONTROL,
+                        &Algorithm,
+                        sizeof(Algorithm));
+
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    Status = connect(Sender, (struct sockaddr *)&Address, AddressLength);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    //
+    // Start the test. This snaps resource usage and starts the clock ticking.
+    //
+
+    Status = PtStartTimedTest(Test->Duration);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    while (PtIsTimedTestRunning() != 0) {
+        BytesWritten = send(Sender, Buffer, PT_TCP_IO_BUFFER_SIZE, 0);
+        if (BytesWritten < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            Result->Status = errno;
+            break;
+        }
+
+        TotalBytes += BytesWritten;
+    }
+
+    Status = PtFinishTimedTest(Result);
+    if ((Status != 0) && (Result->Status == 0)) {
+        Result->Status = errno;
+    }
+
+MainEnd:
+    if (Sender >= 0) {
+        close(Sender);
+    }
+
+    if (ListeningSocket >= 0) {
+        close(ListeningSocket);
+    }
+
+    if (Child > 0) {
+        if (Result->Status != 0) {
+            kill(Child, SIGKILL);
+        }
+
+        while ((waitpid(Child, &ChildStatus, 0) < 0) && (errno == EINTR)) {
+            continue;
+        }
+
+        if ((Result->Status == 0) && (WIFEXITED(ChildStatus)) &&
+            (WEXITSTATUS(ChildStatus) != 0)) {
+
+            Result->Status = WEXITSTATUS(ChildStatus);
+        }
+    }
+
+    if (Buffer != NULL) {
+        free(Buffer);
+    }
+
+    Result->Data.Bytes = TotalBytes;
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+void
+PtpTcpIoReceive (
+    int ListeningSocket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the receiving child of the TCP I/O test. It
+    accepts a single connection and reads from it until the sender closes it.
+    This routine does not return.
+
+Arguments:
+
+    ListeningSocket - Supplies the listening socket to accept from.
+
+Return Value:
+
+    None. The process exits with zero on success or an error number on
+    failure.
+
+--*/
+
+{
+
+    char *Buffer;
+    ssize_t BytesRead;
+    int Connection;
+
+    Buffer = malloc(PT_TCP_IO_BUFFER_SIZE);
+    if (Buffer == NULL) {
+        exit(ENOMEM);
+    }
+
+    do {
+        Connection = accept(ListeningSocket, NULL, NULL);
+
+    } while ((Connection < 0) && (errno == EINTR));
+
+    if (Connection < 0) {
+        exit(errno);
+    }
+
+    close(ListeningSocket);
+    while (1) {
+        BytesRead = recv(Connection, Buffer, PT_TCP_IO_BUFFER_SIZE, 0);
+        if (BytesRead == 0) {
+            break;
+        }
+
+        if (BytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            exit(errno);
+        }
+    }
+
+    close(Connection);
+    free(Buffer);
+    exit(0);
+}
+
@@ -186,9 +186,16 @@ AtapIdentifyDevice (
     PATA_CHILD Device
     );
 
+KSTATUS
+AtapStartBlockRequest (
+    PIO_BLOCK_QUEUE Queue,
+    PIO_BLOCK_REQUEST Request,
+    PVOID Context
+    );
+
 KSTATUS
 AtapPerformDmaIo (
-    PIRP Irp,
+    PIO_BLOCK_REQUEST Request,
     PATA_CHILD Device,
     BOOL HaveDpcLock
     );
@@ -747,37 +754,32 @@ Return Value:
     }
 
     //
-    // If the IRP is on the way up, then clean up after the DMA as this IRP is
-    // still sitting in the channel. An IRP going up is already complete.
+    // If the IRP is on the way up, then the block queue has already completed
+    // it. Clean up after the DMA and let the queue start whatever is waiting
+    // behind it.
     //
 
     if (Irp->Direction == IrpUp) {
         CompleteIrp = FALSE;
-
-        ASSERT(Irp == Device->Channel->Irp);
-        ASSERT(Device == Device->Channel->OwningChild);
-        ASSERT(KeIsQueuedLockHeld(Device->Channel->Lock) != FALSE);
-
-        Device->Channel->OwningChild = NULL;
-        Device->Channel->Irp = NULL;
-        KeReleaseQueuedLock(Device->Channel->Lock);
         PmDeviceReleaseReference(Device->OsDevice);
         Status = IoCompleteReadWriteIrp(&(Irp->U.ReadWrite), IrpReadWriteFlags);
         if (!KSUCCESS(Status)) {
             IoUpdateIrpStatus(Irp, Status);
         }
 
+        IoPumpBlockQueue(Device->BlockQueue);
+
     //
-    // Start the DMA on the way down.
+    // Queue the DMA on the way down.
     //
 
     } else {
         Irp->U.ReadWrite.NewIoOffset = Irp->U.ReadWrite.IoOffset;
 
         //
-        // Before acquiring the channel's lock and starting the DMA, prepare
-        // the I/O context for ATA (i.e. it must use physical addresses that
-        // are less than 4GB and be sector size aligned).
+        // Before queuing the DMA, prepare the I/O context for ATA (i.e. it
+        // must use physical addresses that are less than 4GB and be sector
+        // size aligned).
         //
 
         Status = IoPrepareReadWriteIrp(&(Irp->U.ReadWrite),
@@ -791,22 +793,18 @@ Return Value:
         }
 
         //
-        // Fire off the DMA. If this succeeds, it will have pended the IRP.
-        // Return with the lock held.
+        // Hand the IRP to the block queue. If this succeeds, the queue will
+        // have pended the IRP, and will start it on the channel once it is
+        // chosen.
         //
 
-        KeAcquireQueuedLock(Device->Channel->Lock);
-        Device->Channel->Irp = Irp;
-        Device->Channel->OwningChild = Device;
-        CompleteIrp = FALSE;
-        Status = AtapPerformDmaIo(Irp, Device, FALSE);
+        Status = IoSubmitBlockQueueIrp(Device->BlockQueue, Irp);
         if (!KSUCCESS(Status)) {
-            Device->Channel->OwningChild = NULL;
-            Device->Channel->Irp = NULL;
-            KeReleaseQueuedLock(Device->Channel->Lock);
             IoCompleteReadWriteIrp(&(Irp->U.ReadWrite), IrpReadWriteFlags);
-            CompleteIrp = TRUE;
+            goto DispatchIoEnd;
         }
+
+        CompleteIrp = FALSE;
     }
 
 DispatchIoEnd:
@@ -1040,18 +1038,22 @@ Return Value:
 
 {
 
-    BOOL CompleteIrp;
-    UINTN IoSize;
+    BOOL CompleteRequest;
+    PATA_CHILD Device;
     PIRP Irp;
+    UINTN IoSize;
+    PIO_BLOCK_REQUEST Request;
+    PIO_BLOCK_REQUEST Segment;
     KSTATUS Status;
     UCHAR StatusRegister;
 
-    Irp = Channel->Irp;
-    if ((Irp != NULL) && (PendingBits != 0) && (Channel->IoSize != 0)) {
+    Request = Channel->Request;
+    if ((Request != NULL) && (PendingBits != 0) && (Channel->IoSize != 0)) {
+        Device = Channel->OwningChild;
         IoSize = Channel->IoSize;
         Channel->IoSize = 0;
         Status = STATUS_SUCCESS;
-        CompleteIrp = FALSE;
+        CompleteRequest = TRUE;
         StatusRegister = AtapReadRegister(Channel, AtaRegisterStatus);
         if (((PendingBits & IDE_STATUS_ERROR) != 0) ||
             ((StatusRegister & ATA_STATUS_ERROR_MASK) != 0)) {
@@ -1061,43 +1063,43 @@ Return Value:
                           PendingBits);
 
             Status = STATUS_DEVICE_IO_ERROR;
-            CompleteIrp = FALSE;
 
         } else if ((PendingBits & IDE_STATUS_INTERRUPT) != 0) {
-            CompleteIrp = TRUE;
-
-            ASSERT(Irp->MajorCode == IrpMajorIo);
+            Request->BytesCompleted += IoSize;
 
-            Irp->U.ReadWrite.IoBytesCompleted += IoSize;
-            Irp->U.ReadWrite.NewIoOffset += IoSize;
+            ASSERT(Request->BytesCompleted <= Request->TransferSize);
 
-            ASSERT(Irp->U.ReadWrite.IoBytesCompleted <=
-                   Irp->U.ReadWrite.IoSizeInBytes);
-
-            if (Irp->U.ReadWrite.IoBytesCompleted !=
-                Irp->U.ReadWrite.IoSizeInBytes) {
-
-                Status = AtapPerformDmaIo(Irp, Channel->OwningChild, TRUE);
+            if (Request->BytesCompleted != Request->TransferSize) {
+                Status = AtapPerformDmaIo(Request, Device, TRUE);
                 if (KSUCCESS(Status)) {
-                    CompleteIrp = FALSE;
+                    CompleteRequest = FALSE;
                 }
             }
         }
 
-        if (CompleteIrp != FALSE) {
+        if (CompleteRequest != FALSE) {
 
             //
-            // If this is a synchronized write, then send a cache flush
-            // command along with it.
+            // If any write in the request is synchronized, then send a cache
+            // flush command along with it.
             //
 
-            if ((Status == STATUS_SUCCESS) &&
-                (Irp->MinorCode == IrpMinorIoWrite) &&
-                ((Irp->U.ReadWrite.IoFlags & IO_FLAG_DATA_SYNCHRONIZED) != 0)) {
+            if ((Status == STATUS_SUCCESS) && (Request->Write != FALSE)) {
+                Segment = Request;
+                while (Segment != NULL) {
+                    Irp = Segment->Irp;
+                    if ((Irp->U.ReadWrite.IoFlags &
+                         IO_FLAG_DATA_SYNCHRONIZED) != 0) {
 
-                Status = AtapExecuteCacheFlush(Channel->OwningChild, FALSE);
+                        Status = AtapExecuteCacheFlush(Device, FALSE);
 
-                ASSERT(KSUCCESS(Status));
+                        ASSERT(KSUCCESS(Status));
+
+                        break;
+                    }
+
+                    Segment = Segment->NextSegment;
+                }
             }
 
             //
@@ -1105,16 +1107,18 @@ Return Value:
             //
 
             ASSERT((!KSUCCESS(Status)) ||
-                   (Irp->U.ReadWrite.IoBytesCompleted ==
-                    Irp->U.ReadWrite.IoSizeInBytes));
+                   (Request->BytesCompleted == Request->TransferSize));
 
             //
-            // Complete the IRP but do not release the lock as the channel is
-            // cleaned up by this driver after the IRP is reversed to the up
-            // direction. This allows it to perform said clean up at low level.
+            // Give up the channel and hand the request back to the queue,
+            // which completes each IRP in it. The next request is started by
+            // this driver at low level once the IRPs head back up.
             //
 
-            IoCompleteIrp(AtaDriver, Irp, Status);
+            Channel->OwningChild = NULL;
+            Channel->Request = NULL;
+            KeReleaseQueuedLock(Channel->Lock);
+            IoCompleteBlockQueueRequest(Device->BlockQueue, Request, Status);
         }
     }
 
@@ -1212,6 +1216,7 @@ Return Value:
 
 {
 
+    IO_BLOCK_QUEUE_PARAMETERS Parameters;
     KSTATUS Status;
 
     if (Irp->Direction == IrpDown) {
@@ -1224,6 +1229,36 @@ Return Value:
                 break;
             }
 
+            //
+            // Create the queue that DMA requests funnel through. It only runs
+            // one request at a time, since that is all the channel can do,
+            // but it sorts and merges whatever piles up behind it.
+            //
+
+            if ((Child->DmaSupported != FALSE) && (Child->BlockQueue == NULL)) {
+                RtlZeroMemory(&Parameters, sizeof(IO_BLOCK_QUEUE_PARAMETERS));
+                Parameters.Version = IO_BLOCK_QUEUE_PARAMETERS_VERSION;
+                Parameters.Driver = AtaDriver;
+                Parameters.StartRequest = AtapStartBlockRequest;
+                Parameters.Context = Child;
+                Parameters.QueueDepth = 1;
+                Parameters.BlockSize = ATA_SECTOR_SIZE;
+                Parameters.MaxTransferSize =
+                                   ATA_MAX_LBA28_SECTOR_COUNT * ATA_SECTOR_SIZE;
+
+                if (Child->Lba48Supported != FALSE) {
+                    Parameters.MaxTransferSize =
+                                   ATA_MAX_LBA48_SECTOR_COUNT * ATA_SECTOR_SIZE;
+                }
+
+                Parameters.MaxSegments = ATA_BLOCK_QUEUE_MAX_SEGMENTS;
+                Status = IoCreateBlockQueue(&Parameters, &(Child->BlockQueue));
+                if (!KSUCCESS(Status)) {
+                    IoCompleteIrp(AtaDriver, Irp, Status);
+                    break;
+                }
+            }
+
             //
             // Publish the disk interface.
             //
@@ -2219,9 +2254,62 @@ Return Value:
     return Status;
 }
 
+KSTATUS
+AtapStartBlockRequest (
+    PIO_BLOCK_QUEUE Queue,
+    PIO_BLOCK_REQUEST Request,
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called by the block queue to start a request on the disk.
+    It acquires the channel and fires off the DMA. The channel stays locked
+    until the interrupt for the final transfer comes in.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+    Request - Supplies a pointer to the request to start.
+
+    Context - Supplies a pointer to the ATA child device.
+
+Return Value:
+
+    Status code. On failure the queue completes the request.
+
+--*/
+
+{
+
+    PATA_CHILD Device;
+    KSTATUS Status;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    Device = Context;
+
+    ASSERT(Device->BlockQueue == Queue);
+
+    KeAcquireQueuedLock(Device->Channel->Lock);
+    Device->Channel->Request = Request;
+    Device->Channel->OwningChild = Device;
+    Status = AtapPerformDmaIo(Request, Device, FALSE);
+    if (!KSUCCESS(Status)) {
+        Device->Channel->OwningChild = NULL;
+        Device->Channel->Request = NULL;
+        KeReleaseQueuedLock(Device->Channel->Lock);
+    }
+
+    return Status;
+}
+
 KSTATUS
 AtapPerformDmaIo (
-    PIRP Irp,
+    PIO_BLOCK_REQUEST Request,
     PATA_CHILD Device,
     BOOL HaveDpcLock
     )
@@ -2235,7 +2323,8 @@ Routine Description:
 
 Arguments:
 
-    Irp - Supplies a pointer to the I/O request packet.
+    Request - Supplies a pointer to the block queue request, which may be made
+        up of several merged IRPs.
 
     Device - Supplies a pointer to the ATA child device.
 
@@ -2271,31 +2360,26 @@ Return Value:
     USHORT PrdtAddressRegister;
     UINTN PrdtIndex;
     UINTN SectorCount;
+    PIO_BLOCK_REQUEST Segment;
+    UINTN SegmentOffset;
     KSTATUS Status;
     UINTN TransferSize;
     UINTN TransferSizeRemaining;
     BOOL Write;
 
-    ASSERT(Device->Channel->Irp == Irp);
+    ASSERT(Device->Channel->Request == Request);
     ASSERT(Device->Channel->OwningChild == Device);
-    ASSERT(Irp->U.ReadWrite.IoBuffer != NULL);
 
-    IoBuffer = Irp->U.ReadWrite.IoBuffer;
-    BytesPreviouslyCompleted = Irp->U.ReadWrite.IoBytesCompleted;
-    BytesToComplete = Irp->U.ReadWrite.IoSizeInBytes;
-    IoOffset = Irp->U.ReadWrite.NewIoOffset;
+    BytesPreviouslyCompleted = Request->BytesCompleted;
+    BytesToComplete = Request->TransferSize;
+    IoOffset = Request->Offset + BytesPreviouslyCompleted;
+    Write = Request->Write;
 
     ASSERT(BytesPreviouslyCompleted < BytesToComplete);
-    ASSERT(IoOffset == (Irp->U.ReadWrite.IoOffset + BytesPreviouslyCompleted));
     ASSERT(Device->Channel->BusMasterBase != (USHORT)-1);
     ASSERT(IS_ALIGNED(IoOffset, ATA_SECTOR_SIZE) != FALSE);
     ASSERT(IS_ALIGNED(BytesToComplete, ATA_SECTOR_SIZE) != FALSE);
 
-    Write = FALSE;
-    if (Irp->MinorCode == IrpMinorIoWrite) {
-        Write = TRUE;
-    }
-
     //
     // Determine the bytes to complete this round.
     //
@@ -2311,37 +2395,60 @@ Return Value:
     }
 
     //
-    // Get to the currect spot in the I/O buffer.
+    // Find the segment (merged IRP) where this round picks up.
     //
 
-    IoBufferOffset = MmGetIoBufferCurrentOffset(IoBuffer);
-    IoBufferOffset += BytesPreviouslyCompleted;
-    FragmentIndex = 0;
-    FragmentOffset = 0;
-    while (IoBufferOffset != 0) {
+    Segment = Request;
+    SegmentOffset = BytesPreviouslyCompleted;
+    while (SegmentOffset >= Segment->Size) {
+        SegmentOffset -= Segment->Size;
+        Segment = Segment->NextSegment;
 
-        ASSERT(FragmentIndex < IoBuffer->FragmentCount);
-
-        Fragment = &(IoBuffer->Fragment[FragmentIndex]);
-        if (IoBufferOffset < Fragment->Size) {
-            FragmentOffset = IoBufferOffset;
-            break;
-        }
-
-        IoBufferOffset -= Fragment->Size;
-        FragmentIndex += 1;
+        ASSERT(Segment != NULL);
     }
 
     //
-    // Loop over every fragment in the I/O buffer setting up PRDT entries.
+    // Loop over every fragment in each segment's I/O buffer setting up PRDT
+    // entries.
     //
 
+    FragmentIndex = 0;
+    FragmentOffset = 0;
+    IoBuffer = NULL;
     Prdt = Device->Channel->Prdt;
     PrdtIndex = 0;
     TransferSizeRemaining = TransferSize;
     while ((TransferSizeRemaining != 0) &&
            (PrdtIndex < (ATA_PRDT_DISK_SIZE / sizeof(ATA_PRDT)))) {
 
+        //
+        // Get to the current spot in the segment's I/O buffer.
+        //
+
+        if (IoBuffer == NULL) {
+            IoBuffer = Segment->Irp->U.ReadWrite.IoBuffer;
+
+            ASSERT(IoBuffer != NULL);
+
+            IoBufferOffset = MmGetIoBufferCurrentOffset(IoBuffer);
+            IoBufferOffset += SegmentOffset;
+            FragmentIndex = 0;
+            FragmentOffset = 0;
+            while (IoBufferOffset != 0) {
+
+                ASSERT(FragmentIndex < IoBuffer->FragmentCount);
+
+                Fragment = &(IoBuffer->Fragment[FragmentIndex]);
+                if (IoBufferOffset < Fragment->Size) {
+                    FragmentOffset = IoBufferOffset;
+                    break;
+                }
+
+                IoBufferOffset -= Fragment->Size;
+                FragmentIndex += 1;
+            }
+        }
+
         ASSERT(FragmentIndex < IoBuffer->FragmentCount);
 
         Fragment = &(IoBuffer->Fragment[FragmentIndex]);
@@ -2358,6 +2465,10 @@ Return Value:
             EntrySize = Fragment->Size - FragmentOffset;
         }
 
+        if (EntrySize > (Segment->Size - SegmentOffset)) {
+            EntrySize = Segment->Size - SegmentOffset;
+        }
+
         PhysicalAddress = Fragment->PhysicalAddress + FragmentOffset;
         EndBoundary = ALIGN_RANGE_DOWN(PhysicalAddress + EntrySize - 1,
                                        ATA_DMA_BOUNDARY);
@@ -2397,6 +2508,17 @@ Return Value:
             FragmentIndex += 1;
             FragmentOffset = 0;
         }
+
+        //
+        // Move on to the next IRP once this one's buffer is used up.
+        //
+
+        SegmentOffset += EntrySize;
+        if (SegmentOffset == Segment->Size) {
+            Segment = Segment->NextSegment;
+            SegmentOffset = 0;
+            IoBuffer = NULL;
+        }
     }
 
     ASSERT(PrdtIndex != 0);
@@ -2482,14 +2604,6 @@ Return Value:
         DmaCommand |= ATA_BUS_MASTER_COMMAND_DMA_READ;
     }
 
-    //
-    // If this is the first set of DMA for the IRP, pend it.
-    //
-
-    if (BytesPreviouslyCompleted == 0) {
-        IoPendIrp(AtaDriver, Irp);
-    }
-
     AtapWriteRegister(Device->Channel,
                       AtaRegisterBusMasterStatus,
                       IDE_STATUS_INTERRUPT | IDE_STATUS_ERROR);
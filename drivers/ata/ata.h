@@ -110,6 +110,13 @@ Module Name:
 
 #define ATA_DMA_BOUNDARY 0x10000
 
+//
+// Define the maximum number of IRPs the block queue may merge into a single
+// DMA transfer. Each one needs at least one PRDT entry.
+//
+
+#define ATA_BLOCK_QUEUE_MAX_SEGMENTS 32
+
 //
 // Define the flag set in the PRDT entry for the last descriptor.
 //
@@ -330,7 +337,8 @@ Structure Description:
 
     Lock - Stores a pointer to the lock used to synchronize this channel.
 
-    Irp - Stores a pointer to the I/O IRP actively running on the channel.
+    Request - Stores a pointer to the block queue request actively running on
+        the channel.
 
     IoSize - Stores the size of this I/O operation.
 
@@ -350,7 +358,7 @@ typedef struct _ATA_CHANNEL {
     UCHAR InterruptDisable;
     UCHAR SelectedDevice;
     PQUEUED_LOCK Lock;
-    PIRP Irp;
+    PIO_BLOCK_REQUEST Request;
     UINTN IoSize;
     PATA_CHILD OwningChild;
     PATA_PRDT Prdt;
@@ -387,6 +395,9 @@ Structure Description:
 
     DiskInterface - Stores the disk interface.
 
+    BlockQueue - Stores a pointer to the queue that sorts, merges, and
+        dispatches DMA requests to the disk.
+
 --*/
 
 struct _ATA_CHILD {
@@ -399,6 +410,7 @@ struct _ATA_CHILD {
     BOOL Lba48Supported;
     ULONGLONG TotalSectors;
     DISK_INTERFACE DiskInterface;
+    PIO_BLOCK_QUEUE BlockQueue;
 };
 
 /*++
@@ -517,6 +517,7 @@ Return Value:
                                NET_LINK_CHECKSUM_FLAG_RECEIVE_TCP_OFFLOAD |
                                NET_LINK_CHECKSUM_FLAG_RECEIVE_UDP_OFFLOAD;
 
+    Properties.OffloadFlags = NET_LINK_OFFLOAD_FLAG_RECEIVE_COALESCING;
     Device->ChecksumFlags = Properties.ChecksumFlags;
     Status = NetAddLink(&Properties, &(Device->NetworkLink));
     if (!KSUCCESS(Status)) {
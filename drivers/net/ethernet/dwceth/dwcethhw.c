@@ -1486,6 +1486,12 @@ Return Value:
     }
 
     KeReleaseQueuedLock(Device->ReceiveLock);
+
+    //
+    // Let the networking core finish off any packets it merged together.
+    //
+
+    NetFlushReceivedPackets(Device->NetworkLink);
     return;
 }
 
@@ -495,6 +495,7 @@ Return Value:
     Properties.Device = Device->OsDevice;
     Properties.DeviceContext = Device;
     Properties.PacketSizeInformation.MaxPacketSize = RECEIVE_FRAME_DATA_SIZE;
+    Properties.OffloadFlags = NET_LINK_OFFLOAD_FLAG_RECEIVE_COALESCING;
     Properties.DataLinkType = NetDomainEthernet;
     Properties.MaxPhysicalAddress = MAX_ULONG;
     Properties.PhysicalAddress.Domain = NetDomainEthernet;
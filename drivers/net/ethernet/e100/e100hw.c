@@ -1369,6 +1369,12 @@ Return Value:
     }
 
     KeReleaseQueuedLock(Device->ReceiveListLock);
+
+    //
+    // Let the networking core finish off any packets it merged together.
+    //
+
+    NetFlushReceivedPackets(Device->NetworkLink);
     return;
 }
 
@@ -88,6 +88,31 @@ Module Name:
 #define NET_EPHEMERAL_PORT_COUNT \
     (NET_EPHEMERAL_PORT_END - NET_EPHEMERAL_PORT_START)
 
+//
+// Define the number of buckets in the hash table of fully bound sockets.
+// Stream sockets get a bigger table as servers can have a great many
+// connections. These must be powers of two.
+//
+
+#define NET_SOCKET_HASH_STREAM_BUCKET_COUNT 2048
+#define NET_SOCKET_HASH_BUCKET_COUNT 256
+
+//
+// Define the number of locks the hash buckets are spread across. Sockets live
+// in paged pool, so the buckets need real locks rather than spin locks, and
+// one per bucket would be a lot of locks. This must be a power of two no
+// larger than the smallest bucket count.
+//
+
+#define NET_SOCKET_HASH_LOCK_COUNT 64
+
+//
+// Define the multiplier used to mix the socket hash, which is the golden
+// ratio in 32-bit fixed point.
+//
+
+#define NET_SOCKET_HASH_MULTIPLIER 0x9E3779B1
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -117,6 +142,62 @@ typedef struct _ADDRESS_TRANSLATION_ENTRY {
     NETWORK_ADDRESS PhysicalAddress;
 } ADDRESS_TRANSLATION_ENTRY, *PADDRESS_TRANSLATION_ENTRY;
 
+/*++
+
+Structure Description:
+
+    This structure defines a lock covering a set of socket hash buckets,
+    along with the lookup statistics for those buckets.
+
+Members:
+
+    Lock - Stores a pointer to the shared exclusive lock. Lookups acquire it
+        shared. Insertions and removals acquire it exclusive, while also
+        holding the protocol's socket lock exclusive.
+
+    LookupCount - Stores the number of lookups in these buckets.
+
+    HitCount - Stores the number of lookups in these buckets that found a
+        socket.
+
+    CompareCount - Stores the number of sockets compared during lookups in
+        these buckets.
+
+--*/
+
+typedef struct _NET_SOCKET_HASH_LOCK {
+    PSHARED_EXCLUSIVE_LOCK Lock;
+    volatile ULONG LookupCount;
+    volatile ULONG HitCount;
+    volatile ULONG CompareCount;
+} NET_SOCKET_HASH_LOCK, *PNET_SOCKET_HASH_LOCK;
+
+/*++
+
+Structure Description:
+
+    This structure defines a protocol's hash table of fully bound sockets.
+
+Members:
+
+    Seed - Stores a random value mixed into every hash so that remote hosts
+        cannot easily aim all their connections at one bucket.
+
+    BucketCount - Stores the number of buckets. This is a power of two.
+
+    Locks - Stores a pointer to the array of locks covering the buckets.
+
+    Buckets - Stores a pointer to the array of bucket list heads.
+
+--*/
+
+struct _NET_SOCKET_HASH_TABLE {
+    ULONG Seed;
+    ULONG BucketCount;
+    PNET_SOCKET_HASH_LOCK Locks;
+    PLIST_ENTRY Buckets;
+};
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -209,6 +290,30 @@ NetpCheckLocalAddressAvailability (
     PNETWORK_ADDRESS LocalAddress
     );
 
+ULONG
+NetpHashSocketAddresses (
+    PNET_SOCKET_HASH_TABLE Table,
+    PNETWORK_ADDRESS LocalAddress,
+    PNETWORK_ADDRESS RemoteAddress
+    );
+
+VOID
+NetpInsertHashedSocket (
+    PNET_SOCKET Socket
+    );
+
+VOID
+NetpRemoveHashedSocket (
+    PNET_SOCKET Socket
+    );
+
+PNET_SOCKET
+NetpLookupHashedSocket (
+    PNET_PROTOCOL_ENTRY Protocol,
+    PNETWORK_ADDRESS LocalAddress,
+    PNETWORK_ADDRESS RemoteAddress
+    );
+
 VOID
 NetpGetPacketSizeInformation (
     PNET_LINK Link,
@@ -1968,6 +2073,10 @@ Return Value:
         RtlRedBlackTreeRemove(&(Protocol->SocketTree[Socket->BindingType]),
                               &(Socket->U.TreeEntry));
 
+        if (Socket->BindingType == SocketFullyBound) {
+            NetpRemoveHashedSocket(Socket);
+        }
+
         SkipValidation = TRUE;
         Reinsert = TRUE;
 
@@ -2254,6 +2363,9 @@ Return Value:
                           &(Socket->U.TreeEntry));
 
     Socket->BindingType = BindingType;
+    if (BindingType == SocketFullyBound) {
+        NetpInsertHashedSocket(Socket);
+    }
 
     //
     // Increment the reference count on the socket so that it cannot disappear
@@ -2271,6 +2383,9 @@ Return Value:
 
             Tree = &(Protocol->SocketTree[Socket->BindingType]);
             RtlRedBlackTreeInsert(Tree, &(Socket->U.TreeEntry));
+            if (Socket->BindingType == SocketFullyBound) {
+                NetpInsertHashedSocket(Socket);
+            }
         }
     }
 
@@ -2361,6 +2476,13 @@ Return Value:
             goto DisconnectSocketEnd;
         }
 
+        //
+        // Pull the socket out of the hash table while the remote address that
+        // it is hashed by is still intact.
+        //
+
+        NetpRemoveHashedSocket(Socket);
+
         //
         // The disconnect just wipes out the remote address. The socket may
         // have been implicitly bound on the connect. So be it. It stays
@@ -2371,15 +2493,11 @@ Return Value:
 
         //
         // If the socket was previously inactive before becoming fully bound,
-        // return it to the inactive state and clear it from the last found
-        // cache of one.
+        // return it to the inactive state.
         //
 
         if ((Socket->Flags & NET_SOCKET_FLAG_PREVIOUSLY_ACTIVE) == 0) {
             RtlAtomicAnd32(&(Socket->Flags), ~NET_SOCKET_FLAG_ACTIVE);
-            if (Socket == Protocol->LastSocket) {
-                Protocol->LastSocket = NULL;
-            }
         }
 
         //
@@ -2503,36 +2621,22 @@ Return Value:
 
     PRED_BLACK_TREE_NODE FoundNode;
     PNET_SOCKET FoundSocket;
-    PNET_SOCKET LastSocket;
-    COMPARISON_RESULT Result;
     NET_SOCKET SearchEntry;
     PRED_BLACK_TREE Tree;
 
     ASSERT(KeGetRunLevel() == RunLevelLow);
 
-    FoundSocket = NULL;
-
     //
-    // Check to see if the given remote and local addresses match the last
-    // fully bound socket found. This speeds up the search process when there
-    // isn't a whole lot of activity.
+    // Most packets belong to an established connection, so try the hash
+    // table of fully bound sockets first. This does not need the socket lock.
     //
 
-    KeAcquireSharedExclusiveLockShared(ProtocolEntry->SocketLock);
-    LastSocket = ProtocolEntry->LastSocket;
-    if (LastSocket != NULL) {
-
-        ASSERT(LastSocket->BindingType == SocketFullyBound);
-
-        Result = NetpMatchFullyBoundSocket(LastSocket,
-                                           LocalAddress,
-                                           RemoteAddress);
+    FoundSocket = NetpLookupHashedSocket(ProtocolEntry,
+                                         LocalAddress,
+                                         RemoteAddress);
 
-        if (Result == ComparisonResultSame) {
-            FoundNode = NULL;
-            FoundSocket = LastSocket;
-            goto FindSocketEnd;
-        }
+    if (FoundSocket != NULL) {
+        return FoundSocket;
     }
 
     //
@@ -2550,9 +2654,12 @@ Return Value:
     //
     // Loop through each tree looking for a match, starting with the most
     // specified parameters (local and remote address), and working towards the
-    // most generic parameters (local port only).
+    // most generic parameters (local port only). The fully bound tree is
+    // searched again under the lock in case the socket was bound after the
+    // hash lookup, or is inactive and should hide the less specific sockets.
     //
 
+    KeAcquireSharedExclusiveLockShared(ProtocolEntry->SocketLock);
     Tree = &(ProtocolEntry->SocketTree[SocketFullyBound]);
     FoundNode = RtlRedBlackTreeSearch(Tree, &(SearchEntry.U.TreeEntry));
     if (FoundNode != NULL) {
@@ -2574,37 +2681,116 @@ Return Value:
 FindSocketEnd:
     if (FoundNode != NULL) {
         FoundSocket = RED_BLACK_TREE_VALUE(FoundNode, NET_SOCKET, U.TreeEntry);
-    }
-
-    if (FoundSocket != NULL) {
 
         //
-        // If the socket is not active, act as if it were never seen. The
-        // cached socket should never be found as inactive. Deactivating the
-        // cached socket clears the cache.
+        // If the socket is not active, act as if it were never seen.
+        // Otherwise, increment the reference count so the socket cannot
+        // disappear once the lock is released.
         //
 
         if ((FoundSocket->Flags & NET_SOCKET_FLAG_ACTIVE) == 0) {
+            FoundSocket = NULL;
 
-            ASSERT(FoundSocket != ProtocolEntry->LastSocket);
+        } else {
+            IoSocketAddReference(&(FoundSocket->KernelSocket));
+        }
+    }
 
-            FoundSocket = NULL;
+    KeReleaseSharedExclusiveLockShared(ProtocolEntry->SocketLock);
+    return FoundSocket;
+}
+
+NET_API
+KSTATUS
+NetGetSocketLookupStatistics (
+    PNET_PROTOCOL_ENTRY ProtocolEntry,
+    PNET_SOCKET_LOOKUP_STATISTICS Statistics
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns statistics about how packets have been matched to
+    sockets for the given protocol.
+
+Arguments:
+
+    ProtocolEntry - Supplies the protocol to get statistics for.
+
+    Statistics - Supplies a pointer where the statistics will be returned. The
+        caller must initialize the version field.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_VERSION_MISMATCH if the structure version is not supported.
+
+    STATUS_NOT_SUPPORTED if the protocol does not hash its sockets.
+
+--*/
+
+{
+
+    ULONG Bucket;
+    ULONG ChainLength;
+    PLIST_ENTRY CurrentEntry;
+    PLIST_ENTRY Head;
+    PNET_SOCKET_HASH_LOCK HashLock;
+    ULONG LockIndex;
+    PNET_SOCKET_HASH_TABLE Table;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    if (Statistics->Version < NET_SOCKET_LOOKUP_STATISTICS_VERSION) {
+        return STATUS_VERSION_MISMATCH;
+    }
+
+    Table = ProtocolEntry->SocketHashTable;
+    if (Table == NULL) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    RtlZeroMemory(Statistics, sizeof(NET_SOCKET_LOOKUP_STATISTICS));
+    Statistics->Version = NET_SOCKET_LOOKUP_STATISTICS_VERSION;
+    Statistics->BucketCount = Table->BucketCount;
+    for (LockIndex = 0;
+         LockIndex < NET_SOCKET_HASH_LOCK_COUNT;
+         LockIndex += 1) {
+
+        HashLock = &(Table->Locks[LockIndex]);
+        Statistics->Lookups += HashLock->LookupCount;
+        Statistics->HashHits += HashLock->HitCount;
+        Statistics->Comparisons += HashLock->CompareCount;
 
         //
-        // Otherwise, increment the reference count so the socket cannot
-        // disappear once the lock is released.
+        // Walk each bucket covered by this lock to count the sockets.
         //
 
-        } else {
-            IoSocketAddReference(&(FoundSocket->KernelSocket));
-            if (FoundSocket->BindingType == SocketFullyBound) {
-                ProtocolEntry->LastSocket = FoundSocket;
+        KeAcquireSharedExclusiveLockShared(HashLock->Lock);
+        for (Bucket = LockIndex;
+             Bucket < Table->BucketCount;
+             Bucket += NET_SOCKET_HASH_LOCK_COUNT) {
+
+            ChainLength = 0;
+            Head = &(Table->Buckets[Bucket]);
+            CurrentEntry = Head->Next;
+            while (CurrentEntry != Head) {
+                ChainLength += 1;
+                CurrentEntry = CurrentEntry->Next;
+            }
+
+            Statistics->SocketCount += ChainLength;
+            if (ChainLength > Statistics->LongestChain) {
+                Statistics->LongestChain = ChainLength;
             }
         }
+
+        KeReleaseSharedExclusiveLockShared(HashLock->Lock);
     }
 
-    KeReleaseSharedExclusiveLockShared(ProtocolEntry->SocketLock);
-    return FoundSocket;
+    return STATUS_SUCCESS;
 }
 
 NET_API
@@ -3436,6 +3622,126 @@ Return Value:
     return ComparisonResultSame;
 }
 
+KSTATUS
+NetpCreateSocketHashTable (
+    PNET_PROTOCOL_ENTRY Protocol
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates the hash table of fully bound sockets for the given
+    protocol.
+
+Arguments:
+
+    Protocol - Supplies a pointer to the protocol being registered.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    UINTN AllocationSize;
+    ULONG BucketCount;
+    ULONG Index;
+    KSTATUS Status;
+    PNET_SOCKET_HASH_TABLE Table;
+
+    ASSERT(Protocol->SocketHashTable == NULL);
+
+    BucketCount = NET_SOCKET_HASH_BUCKET_COUNT;
+    if (Protocol->Type == NetSocketStream) {
+        BucketCount = NET_SOCKET_HASH_STREAM_BUCKET_COUNT;
+    }
+
+    ASSERT((BucketCount & (BucketCount - 1)) == 0);
+    ASSERT(BucketCount >= NET_SOCKET_HASH_LOCK_COUNT);
+
+    AllocationSize = sizeof(NET_SOCKET_HASH_TABLE) +
+                     (sizeof(NET_SOCKET_HASH_LOCK) *
+                      NET_SOCKET_HASH_LOCK_COUNT) +
+                     (sizeof(LIST_ENTRY) * BucketCount);
+
+    Table = MmAllocatePagedPool(AllocationSize, NET_CORE_ALLOCATION_TAG);
+    if (Table == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CreateSocketHashTableEnd;
+    }
+
+    RtlZeroMemory(Table, AllocationSize);
+    Table->Seed = (ULONG)HlQueryTimeCounter();
+    Table->BucketCount = BucketCount;
+    Table->Locks = (PNET_SOCKET_HASH_LOCK)(Table + 1);
+    Table->Buckets = (PLIST_ENTRY)(Table->Locks + NET_SOCKET_HASH_LOCK_COUNT);
+    Protocol->SocketHashTable = Table;
+    for (Index = 0; Index < NET_SOCKET_HASH_LOCK_COUNT; Index += 1) {
+        Table->Locks[Index].Lock = KeCreateSharedExclusiveLock();
+        if (Table->Locks[Index].Lock == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto CreateSocketHashTableEnd;
+        }
+    }
+
+    for (Index = 0; Index < BucketCount; Index += 1) {
+        INITIALIZE_LIST_HEAD(&(Table->Buckets[Index]));
+    }
+
+    Status = STATUS_SUCCESS;
+
+CreateSocketHashTableEnd:
+    if (!KSUCCESS(Status)) {
+        if (Protocol->SocketHashTable != NULL) {
+            NetpDestroySocketHashTable(Protocol);
+        }
+    }
+
+    return Status;
+}
+
+VOID
+NetpDestroySocketHashTable (
+    PNET_PROTOCOL_ENTRY Protocol
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys the hash table of fully bound sockets for the given
+    protocol. The table must be empty.
+
+Arguments:
+
+    Protocol - Supplies a pointer to the protocol being destroyed.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+    PNET_SOCKET_HASH_TABLE Table;
+
+    Table = Protocol->SocketHashTable;
+    for (Index = 0; Index < NET_SOCKET_HASH_LOCK_COUNT; Index += 1) {
+        if (Table->Locks[Index].Lock != NULL) {
+            KeDestroySharedExclusiveLock(Table->Locks[Index].Lock);
+        }
+    }
+
+    Protocol->SocketHashTable = NULL;
+    MmFreePagedPool(Table);
+    return;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -3540,8 +3846,6 @@ Return Value:
     if (((Socket->Flags & NET_SOCKET_FLAG_ACTIVE) == 0) &&
         (Socket->BindingType == SocketBindingInvalid)) {
 
-        ASSERT(Socket != Protocol->LastSocket);
-
         return;
     }
 
@@ -3556,16 +3860,12 @@ Return Value:
     //
 
     RtlRedBlackTreeRemove(Tree, &(Socket->U.TreeEntry));
-    Socket->BindingType = SocketBindingInvalid;
-
-    //
-    // If it was in the socket "cache", then remove it.
-    //
-
-    if (Socket == Protocol->LastSocket) {
-        Protocol->LastSocket = NULL;
+    if (Socket->BindingType == SocketFullyBound) {
+        NetpRemoveHashedSocket(Socket);
     }
 
+    Socket->BindingType = SocketBindingInvalid;
+
     //
     // Release that reference that was added when the socket was added to the
     // tree. This should not be the last reference on the kernel socket.
@@ -4714,6 +5014,257 @@ Return Value:
     return AvailableAddress;
 }
 
+ULONG
+NetpHashSocketAddresses (
+    PNET_SOCKET_HASH_TABLE Table,
+    PNETWORK_ADDRESS LocalAddress,
+    PNETWORK_ADDRESS RemoteAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine computes the hash bucket index for a fully bound socket.
+
+Arguments:
+
+    Table - Supplies a pointer to the hash table.
+
+    LocalAddress - Supplies a pointer to the local address of the socket.
+
+    RemoteAddress - Supplies a pointer to the remote address of the socket.
+
+Return Value:
+
+    Returns the index of the bucket the socket belongs in.
+
+--*/
+
+{
+
+    ULONG Hash;
+    ULONG Index;
+    PULONG LocalWords;
+    PULONG RemoteWords;
+
+    //
+    // Everything that makes two fully bound sockets the same must be in the
+    // hash, and nothing else.
+    //
+
+    LocalWords = (PULONG)(LocalAddress->Address);
+    RemoteWords = (PULONG)(RemoteAddress->Address);
+    Hash = Table->Seed ^ LocalAddress->Domain;
+    Hash = (Hash ^ (LocalAddress->Port << 16) ^ RemoteAddress->Port) *
+           NET_SOCKET_HASH_MULTIPLIER;
+
+    for (Index = 0;
+         Index < MAX_NETWORK_ADDRESS_SIZE / sizeof(ULONG);
+         Index += 1) {
+
+        Hash = (Hash ^ RemoteWords[Index]) * NET_SOCKET_HASH_MULTIPLIER;
+        Hash = (Hash ^ LocalWords[Index]) * NET_SOCKET_HASH_MULTIPLIER;
+    }
+
+    //
+    // The multiply pushes the best bits to the top, so fold them back down
+    // before masking off the bucket.
+    //
+
+    Hash ^= Hash >> 16;
+    return Hash & (Table->BucketCount - 1);
+}
+
+VOID
+NetpInsertHashedSocket (
+    PNET_SOCKET Socket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a newly fully bound socket to its protocol's hash table.
+    The caller must hold the protocol's socket lock exclusively.
+
+Arguments:
+
+    Socket - Supplies a pointer to the fully bound socket.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Bucket;
+    PSHARED_EXCLUSIVE_LOCK Lock;
+    PNET_PROTOCOL_ENTRY Protocol;
+    PNET_SOCKET_HASH_TABLE Table;
+
+    Protocol = Socket->Protocol;
+    Table = Protocol->SocketHashTable;
+
+    ASSERT(KeIsSharedExclusiveLockHeldExclusive(Protocol->SocketLock) != FALSE);
+    ASSERT(Socket->BindingType == SocketFullyBound);
+
+    if (Table == NULL) {
+        return;
+    }
+
+    Bucket = NetpHashSocketAddresses(Table,
+                                     &(Socket->LocalAddress),
+                                     &(Socket->RemoteAddress));
+
+    Lock = Table->Locks[Bucket & (NET_SOCKET_HASH_LOCK_COUNT - 1)].Lock;
+    KeAcquireSharedExclusiveLockExclusive(Lock);
+    INSERT_BEFORE(&(Socket->HashEntry), &(Table->Buckets[Bucket]));
+    KeReleaseSharedExclusiveLockExclusive(Lock);
+    return;
+}
+
+VOID
+NetpRemoveHashedSocket (
+    PNET_SOCKET Socket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes a fully bound socket from its protocol's hash table.
+    It is safe to call this on a socket that has already been removed. The
+    caller must hold the protocol's socket lock exclusively, and the socket's
+    addresses must not have changed since it was inserted.
+
+Arguments:
+
+    Socket - Supplies a pointer to the fully bound socket.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Bucket;
+    PSHARED_EXCLUSIVE_LOCK Lock;
+    PNET_PROTOCOL_ENTRY Protocol;
+    PNET_SOCKET_HASH_TABLE Table;
+
+    Protocol = Socket->Protocol;
+    Table = Protocol->SocketHashTable;
+
+    ASSERT(KeIsSharedExclusiveLockHeldExclusive(Protocol->SocketLock) != FALSE);
+
+    if ((Table == NULL) || (Socket->HashEntry.Next == NULL)) {
+        return;
+    }
+
+    Bucket = NetpHashSocketAddresses(Table,
+                                     &(Socket->LocalAddress),
+                                     &(Socket->RemoteAddress));
+
+    Lock = Table->Locks[Bucket & (NET_SOCKET_HASH_LOCK_COUNT - 1)].Lock;
+    KeAcquireSharedExclusiveLockExclusive(Lock);
+    LIST_REMOVE(&(Socket->HashEntry));
+    Socket->HashEntry.Next = NULL;
+    KeReleaseSharedExclusiveLockExclusive(Lock);
+    return;
+}
+
+PNET_SOCKET
+NetpLookupHashedSocket (
+    PNET_PROTOCOL_ENTRY Protocol,
+    PNETWORK_ADDRESS LocalAddress,
+    PNETWORK_ADDRESS RemoteAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to find an active fully bound socket in the
+    protocol's hash table. This does not acquire the protocol's socket lock.
+
+Arguments:
+
+    Protocol - Supplies a pointer to the protocol to search.
+
+    LocalAddress - Supplies a pointer to the local address of the socket.
+
+    RemoteAddress - Supplies a pointer to the remote address of the socket.
+
+Return Value:
+
+    Returns a pointer to the matching socket with an increased reference
+    count.
+
+    NULL if no active fully bound socket matches.
+
+--*/
+
+{
+
+    ULONG Bucket;
+    ULONG CompareCount;
+    PLIST_ENTRY CurrentEntry;
+    PNET_SOCKET FoundSocket;
+    PLIST_ENTRY Head;
+    PNET_SOCKET_HASH_LOCK HashLock;
+    COMPARISON_RESULT Result;
+    PNET_SOCKET Socket;
+    PNET_SOCKET_HASH_TABLE Table;
+
+    Table = Protocol->SocketHashTable;
+    if (Table == NULL) {
+        return NULL;
+    }
+
+    Bucket = NetpHashSocketAddresses(Table, LocalAddress, RemoteAddress);
+    Head = &(Table->Buckets[Bucket]);
+    HashLock = &(Table->Locks[Bucket & (NET_SOCKET_HASH_LOCK_COUNT - 1)]);
+    CompareCount = 0;
+    FoundSocket = NULL;
+    KeAcquireSharedExclusiveLockShared(HashLock->Lock);
+    CurrentEntry = Head->Next;
+    while (CurrentEntry != Head) {
+        Socket = LIST_VALUE(CurrentEntry, NET_SOCKET, HashEntry);
+        CurrentEntry = CurrentEntry->Next;
+        CompareCount += 1;
+        Result = NetpMatchFullyBoundSocket(Socket, LocalAddress, RemoteAddress);
+        if (Result != ComparisonResultSame) {
+            continue;
+        }
+
+        //
+        // Fully bound sockets are unique, so stop looking either way. An
+        // inactive socket acts as if it were never seen.
+        //
+
+        if ((Socket->Flags & NET_SOCKET_FLAG_ACTIVE) != 0) {
+            IoSocketAddReference(&(Socket->KernelSocket));
+            FoundSocket = Socket;
+        }
+
+        break;
+    }
+
+    KeReleaseSharedExclusiveLockShared(HashLock->Lock);
+    RtlAtomicAdd32(&(HashLock->LookupCount), 1);
+    RtlAtomicAdd32(&(HashLock->CompareCount), CompareCount);
+    if (FoundSocket != NULL) {
+        RtlAtomicAdd32(&(HashLock->HitCount), 1);
+    }
+
+    return FoundSocket;
+}
+
 VOID
 NetpGetPacketSizeInformation (
     PNET_LINK Link,
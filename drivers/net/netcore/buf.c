@@ -37,24 +37,172 @@ Module Name:
 // ---------------------------------------------------------------- Definitions
 //
 
+//
+// Define the size classes of cached packet buffers. Each class is a power of
+// two, from 256 bytes up to the largest cached size. Buffers bigger than
+// that come straight from and go straight back to the pools.
+//
+
+#define NET_BUFFER_CLASS_SHIFT 8
+#define NET_BUFFER_CLASS_COUNT 7
+#define NET_BUFFER_CLASS_SIZE(_Class) \
+    (1UL << (NET_BUFFER_CLASS_SHIFT + (_Class)))
+
+//
+// Define the kinds of cached buffers: those backed by paged pool, which are
+// allocated when there is no link, and those backed by physically contiguous
+// non-paged pages for a link's hardware.
+//
+
+#define NET_BUFFER_KIND_PAGED 0
+#define NET_BUFFER_KIND_CONTIGUOUS 1
+#define NET_BUFFER_KIND_COUNT 2
+
+//
+// Define the number of buffers a magazine can hold, and the number of buffers
+// moved between a magazine and the depot at once.
+//
+
+#define NET_BUFFER_MAGAZINE_CAPACITY 32
+#define NET_BUFFER_MAGAZINE_BATCH_SIZE 16
+
+//
+// Define the maximum number of free buffers the depot holds per kind and
+// size class. Anything beyond this is released back to the pools.
+//
+
+#define NET_BUFFER_DEPOT_LIMIT 256
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
 
+/*++
+
+Structure Description:
+
+    This structure stores a magazine, a small stack of free packet buffers of
+    a single kind and size class.
+
+Members:
+
+    Count - Stores the number of buffers in the magazine.
+
+    Rounds - Stores the array of free buffers. The buffers themselves live in
+        paged pool and are never touched while in the magazine, so the
+        magazine can be accessed at dispatch level.
+
+--*/
+
+typedef struct _NET_BUFFER_MAGAZINE {
+    ULONG Count;
+    PNET_PACKET_BUFFER Rounds[NET_BUFFER_MAGAZINE_CAPACITY];
+} NET_BUFFER_MAGAZINE, *PNET_BUFFER_MAGAZINE;
+
+/*++
+
+Structure Description:
+
+    This structure stores the per-processor packet buffer cache. It is only
+    ever accessed by its own processor at dispatch level, except during
+    teardown.
+
+Members:
+
+    Magazines - Stores the array of magazines for each kind and size class.
+
+--*/
+
+typedef struct _NET_BUFFER_PROCESSOR_CACHE {
+    NET_BUFFER_MAGAZINE
+        Magazines[NET_BUFFER_KIND_COUNT][NET_BUFFER_CLASS_COUNT];
+} NET_BUFFER_PROCESSOR_CACHE, *PNET_BUFFER_PROCESSOR_CACHE;
+
+/*++
+
+Structure Description:
+
+    This structure stores the global list of free packet buffers of a single
+    kind and size class, which refills and absorbs the spill from the
+    processor magazines.
+
+Members:
+
+    FreeList - Stores the head of the list of free buffers.
+
+    Count - Stores the number of buffers on the list.
+
+--*/
+
+typedef struct _NET_BUFFER_DEPOT {
+    LIST_ENTRY FreeList;
+    ULONG Count;
+} NET_BUFFER_DEPOT, *PNET_BUFFER_DEPOT;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
 
+PNET_PACKET_BUFFER
+NetpCreatePacketBuffer (
+    ULONG Size,
+    BOOL PhysicallyContiguous,
+    PHYSICAL_ADDRESS MaximumPhysicalAddress,
+    ULONG Alignment
+    );
+
+VOID
+NetpDestroyPacketBuffer (
+    PNET_PACKET_BUFFER Buffer
+    );
+
+PNET_PACKET_BUFFER
+NetpGetFromBufferMagazine (
+    ULONG Kind,
+    ULONG Class
+    );
+
+PNET_PACKET_BUFFER
+NetpRefillBufferMagazine (
+    ULONG Kind,
+    ULONG Class
+    );
+
+VOID
+NetpPutInBufferMagazine (
+    ULONG Kind,
+    ULONG Class,
+    PNET_PACKET_BUFFER *Buffers,
+    ULONG Count
+    );
+
+VOID
+NetpFreeBuffersToDepot (
+    ULONG Kind,
+    ULONG Class,
+    PNET_PACKET_BUFFER *Buffers,
+    ULONG Count
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
 
 //
-// Store a pointer to the global list of network buffers.
+// Store the depots of free network buffers, and the lock that protects them.
 //
 
-LIST_ENTRY NetFreeBufferList;
-PQUEUED_LOCK NetBufferListLock;
+NET_BUFFER_DEPOT
+    NetBufferDepots[NET_BUFFER_KIND_COUNT][NET_BUFFER_CLASS_COUNT];
+PQUEUED_LOCK NetBufferDepotLock;
+
+//
+// Store the array of per-processor buffer caches, indexed by processor
+// number.
+//
+
+PNET_BUFFER_PROCESSOR_CACHE NetBufferCaches;
+ULONG NetBufferCacheCount;
 
 //
 // ------------------------------------------------------------------ Functions
@@ -110,15 +258,15 @@ Return Value:
 {
 
     ULONG Alignment;
+    ULONG AllocationSize;
     PNET_PACKET_BUFFER Buffer;
     PHYSICAL_ADDRESS BufferPhysical;
     ULONGLONG BufferSize;
-    PLIST_ENTRY CurrentEntry;
+    ULONG Class;
     PNET_DATA_LINK_ENTRY DataLinkEntry;
     ULONG DataLinkMask;
     ULONG DataSize;
-    ULONG IoBufferFlags;
-    BOOL LockHeld;
+    ULONG Kind;
     PHYSICAL_ADDRESS MaximumPhysicalAddress;
     ULONG MinPacketSize;
     ULONG PacketSizeFlags;
@@ -199,104 +347,77 @@ Return Value:
     TotalSize = ALIGN_RANGE_UP(TotalSize, Alignment);
 
     //
-    // Loop through the list looking for the first buffer that fits.
+    // Round the size up to its class so that the buffer can be recycled.
+    // Physically contiguous buffers are made of whole pages anyway, so they
+    // start at the page size.
     //
 
-    KeAcquireQueuedLock(NetBufferListLock);
-    LockHeld = TRUE;
-    CurrentEntry = NetFreeBufferList.Next;
-    while (CurrentEntry != &NetFreeBufferList) {
-        Buffer = LIST_VALUE(CurrentEntry, NET_PACKET_BUFFER, ListEntry);
-        CurrentEntry = CurrentEntry->Next;
-        BufferSize = Buffer->IoBuffer->Fragment[0].Size;
-        if (BufferSize < TotalSize) {
-            continue;
+    AllocationSize = TotalSize;
+    Kind = NET_BUFFER_KIND_PAGED;
+    if (Link != NULL) {
+        Kind = NET_BUFFER_KIND_CONTIGUOUS;
+        if (AllocationSize < MmPageSize()) {
+            AllocationSize = MmPageSize();
         }
+    }
 
-        BufferPhysical = Buffer->IoBuffer->Fragment[0].PhysicalAddress;
-        if (Link == NULL) {
-            if (BufferPhysical != INVALID_PHYSICAL_ADDRESS) {
-                continue;
-            }
-
-        } else {
-            if ((BufferPhysical == INVALID_PHYSICAL_ADDRESS) ||
-                ((BufferPhysical + BufferSize) > MaximumPhysicalAddress) ||
-                (ALIGN_RANGE_DOWN(BufferPhysical, Alignment) !=
-                 BufferPhysical)) {
-
-                continue;
-            }
+    Buffer = NULL;
+    for (Class = 0; Class < NET_BUFFER_CLASS_COUNT; Class += 1) {
+        if (AllocationSize <= NET_BUFFER_CLASS_SIZE(Class)) {
+            AllocationSize = NET_BUFFER_CLASS_SIZE(Class);
+            break;
         }
-
-        LIST_REMOVE(&(Buffer->ListEntry));
-        Status = STATUS_SUCCESS;
-        goto AllocateBufferEnd;
     }
 
-    KeReleaseQueuedLock(NetBufferListLock);
-    LockHeld = FALSE;
-
     //
-    // Allocate a network packet buffer, but do not bother to zero it. This
-    // routine takes care to initialize all the necessary fields before it is
-    // used.
+    // Try this processor's magazine, and then the depot.
     //
 
-    Buffer = MmAllocatePagedPool(sizeof(NET_PACKET_BUFFER),
-                                 NET_CORE_ALLOCATION_TAG);
-
-    if (Buffer == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto AllocateBufferEnd;
-    }
+    if (Class < NET_BUFFER_CLASS_COUNT) {
+        Buffer = NetpGetFromBufferMagazine(Kind, Class);
+        if (Buffer == NULL) {
+            Buffer = NetpRefillBufferMagazine(Kind, Class);
+        }
 
-    //
-    // A buffer will need to be allocated.
-    //
+        //
+        // A cached buffer may have been created for a link with different
+        // constraints. If it does not work for this link, release it and
+        // allocate a fresh one.
+        //
 
-    if (Link != NULL) {
-        IoBufferFlags = IO_BUFFER_FLAG_PHYSICALLY_CONTIGUOUS;
-        Buffer->IoBuffer = MmAllocateNonPagedIoBuffer(0,
-                                                      MaximumPhysicalAddress,
-                                                      Alignment,
-                                                      TotalSize,
-                                                      IoBufferFlags);
+        if ((Buffer != NULL) && (Link != NULL)) {
+            BufferPhysical = Buffer->IoBuffer->Fragment[0].PhysicalAddress;
+            BufferSize = Buffer->IoBuffer->Fragment[0].Size;
+            if (((BufferPhysical + BufferSize) > MaximumPhysicalAddress) ||
+                (ALIGN_RANGE_DOWN(BufferPhysical, Alignment) !=
+                 BufferPhysical)) {
 
-    } else {
-        Buffer->IoBuffer = MmAllocatePagedIoBuffer(TotalSize, 0);
+                NetpDestroyPacketBuffer(Buffer);
+                Buffer = NULL;
+            }
+        }
     }
 
-    if (Buffer->IoBuffer == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto AllocateBufferEnd;
+    if (Buffer == NULL) {
+        Buffer = NetpCreatePacketBuffer(AllocationSize,
+                                        (Link != NULL),
+                                        MaximumPhysicalAddress,
+                                        Alignment);
+
+        if (Buffer == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto AllocateBufferEnd;
+        }
     }
 
-    ASSERT(Buffer->IoBuffer->FragmentCount == 1);
-
-    Buffer->BufferPhysicalAddress =
-                                 Buffer->IoBuffer->Fragment[0].PhysicalAddress;
+    ASSERT(Buffer->IoBuffer->Fragment[0].Size >= TotalSize);
 
-    Buffer->Buffer = Buffer->IoBuffer->Fragment[0].VirtualAddress;
     Status = STATUS_SUCCESS;
 
 AllocateBufferEnd:
-    if (LockHeld != FALSE) {
-        KeReleaseQueuedLock(NetBufferListLock);
-    }
-
-    if (!KSUCCESS(Status)) {
-        if (Buffer != NULL) {
-            if (Buffer->IoBuffer != NULL) {
-                MmFreeIoBuffer(Buffer->IoBuffer);
-            }
-
-            MmFreePagedPool(Buffer);
-            Buffer = NULL;
-        }
-
-    } else {
+    if (KSUCCESS(Status)) {
         Buffer->Flags = 0;
+        Buffer->SegmentSize = 0;
         if ((Flags & NET_ALLOCATE_BUFFER_FLAG_UNENCRYPTED) != 0) {
             Buffer->Flags |= NET_PACKET_FLAG_UNENCRYPTED;
         }
@@ -344,9 +465,40 @@ Return Value:
 
 {
 
-    KeAcquireQueuedLock(NetBufferListLock);
-    INSERT_AFTER(&(Buffer->ListEntry), &NetFreeBufferList);
-    KeReleaseQueuedLock(NetBufferListLock);
+    ULONG Class;
+    PIO_BUFFER_FRAGMENT Fragment;
+    ULONG Kind;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    //
+    // The size class comes from the size of the backing buffer, rounded down,
+    // so that the buffer is big enough for anything handed out of the class.
+    // Buffers well beyond the largest class go straight back to the pools
+    // rather than tying up memory in the caches.
+    //
+
+    Fragment = &(Buffer->IoBuffer->Fragment[0]);
+    if (Fragment->Size >= NET_BUFFER_CLASS_SIZE(NET_BUFFER_CLASS_COUNT)) {
+        NetpDestroyPacketBuffer(Buffer);
+        return;
+    }
+
+    Kind = NET_BUFFER_KIND_CONTIGUOUS;
+    if (Fragment->PhysicalAddress == INVALID_PHYSICAL_ADDRESS) {
+        Kind = NET_BUFFER_KIND_PAGED;
+    }
+
+    Class = NET_BUFFER_CLASS_COUNT;
+    while (Class != 0) {
+        Class -= 1;
+        if (Fragment->Size >= NET_BUFFER_CLASS_SIZE(Class)) {
+            NetpPutInBufferMagazine(Kind, Class, &Buffer, 1);
+            return;
+        }
+    }
+
+    NetpDestroyPacketBuffer(Buffer);
     return;
 }
 
@@ -412,12 +564,40 @@ Return Value:
 
 {
 
-    INITIALIZE_LIST_HEAD(&NetFreeBufferList);
-    NetBufferListLock = KeCreateQueuedLock();
-    if (NetBufferListLock == NULL) {
+    ULONG AllocationSize;
+    ULONG Class;
+    ULONG Kind;
+
+    for (Kind = 0; Kind < NET_BUFFER_KIND_COUNT; Kind += 1) {
+        for (Class = 0; Class < NET_BUFFER_CLASS_COUNT; Class += 1) {
+            INITIALIZE_LIST_HEAD(&(NetBufferDepots[Kind][Class].FreeList));
+            NetBufferDepots[Kind][Class].Count = 0;
+        }
+    }
+
+    NetBufferDepotLock = KeCreateQueuedLock();
+    if (NetBufferDepotLock == NULL) {
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
+    //
+    // The processor caches are touched at dispatch level, so they must come
+    // from non-paged pool. If they cannot be allocated, buffers simply go
+    // through the depot.
+    //
+
+    NetBufferCacheCount = KeGetActiveProcessorCount();
+    AllocationSize = NetBufferCacheCount * sizeof(NET_BUFFER_PROCESSOR_CACHE);
+    NetBufferCaches = MmAllocateNonPagedPool(AllocationSize,
+                                             NET_CORE_ALLOCATION_TAG);
+
+    if (NetBufferCaches == NULL) {
+        NetBufferCacheCount = 0;
+
+    } else {
+        RtlZeroMemory(NetBufferCaches, AllocationSize);
+    }
+
     return STATUS_SUCCESS;
 }
 
@@ -445,8 +625,62 @@ Return Value:
 
 {
 
-    if (NetBufferListLock != NULL) {
-        KeDestroyQueuedLock(NetBufferListLock);
+    PNET_PACKET_BUFFER Buffer;
+    PNET_BUFFER_PROCESSOR_CACHE Cache;
+    ULONG Class;
+    PNET_BUFFER_DEPOT Depot;
+    ULONG Index;
+    ULONG Kind;
+    PNET_BUFFER_MAGAZINE Magazine;
+    ULONG ProcessorNumber;
+
+    //
+    // Nothing else is using buffers anymore, so the processor caches can be
+    // emptied from here.
+    //
+
+    for (ProcessorNumber = 0;
+         ProcessorNumber < NetBufferCacheCount;
+         ProcessorNumber += 1) {
+
+        Cache = &(NetBufferCaches[ProcessorNumber]);
+        for (Kind = 0; Kind < NET_BUFFER_KIND_COUNT; Kind += 1) {
+            for (Class = 0; Class < NET_BUFFER_CLASS_COUNT; Class += 1) {
+                Magazine = &(Cache->Magazines[Kind][Class]);
+                for (Index = 0; Index < Magazine->Count; Index += 1) {
+                    NetpDestroyPacketBuffer(Magazine->Rounds[Index]);
+                }
+
+                Magazine->Count = 0;
+            }
+        }
+    }
+
+    if (NetBufferCaches != NULL) {
+        MmFreeNonPagedPool(NetBufferCaches);
+        NetBufferCaches = NULL;
+        NetBufferCacheCount = 0;
+    }
+
+    for (Kind = 0; Kind < NET_BUFFER_KIND_COUNT; Kind += 1) {
+        for (Class = 0; Class < NET_BUFFER_CLASS_COUNT; Class += 1) {
+            Depot = &(NetBufferDepots[Kind][Class]);
+            while (LIST_EMPTY(&(Depot->FreeList)) == FALSE) {
+                Buffer = LIST_VALUE(Depot->FreeList.Next,
+                                    NET_PACKET_BUFFER,
+                                    ListEntry);
+
+                LIST_REMOVE(&(Buffer->ListEntry));
+                NetpDestroyPacketBuffer(Buffer);
+            }
+
+            Depot->Count = 0;
+        }
+    }
+
+    if (NetBufferDepotLock != NULL) {
+        KeDestroyQueuedLock(NetBufferDepotLock);
+        NetBufferDepotLock = NULL;
     }
 
     return;
@@ -456,3 +690,374 @@ Return Value:
 // --------------------------------------------------------- Internal Functions
 //
 
+PNET_PACKET_BUFFER
+NetpCreatePacketBuffer (
+    ULONG Size,
+    BOOL PhysicallyContiguous,
+    PHYSICAL_ADDRESS MaximumPhysicalAddress,
+    ULONG Alignment
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates a new network packet buffer from the pools.
+
+Arguments:
+
+    Size - Supplies the size of the buffer to allocate, in bytes.
+
+    PhysicallyContiguous - Supplies a boolean indicating whether the buffer
+        should be backed by physically contiguous non-paged pages (TRUE) or
+        by paged pool (FALSE).
+
+    MaximumPhysicalAddress - Supplies the maximum physical address of a
+        physically contiguous buffer.
+
+    Alignment - Supplies the required physical alignment of a physically
+        contiguous buffer.
+
+Return Value:
+
+    Returns a pointer to the new buffer on success. Only the buffer pointer
+    fields are initialized.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    PNET_PACKET_BUFFER Buffer;
+    ULONG IoBufferFlags;
+
+    //
+    // Allocate a network packet buffer, but do not bother to zero it. The
+    // allocation routine takes care to initialize all the necessary fields
+    // before it is used.
+    //
+
+    Buffer = MmAllocatePagedPool(sizeof(NET_PACKET_BUFFER),
+                                 NET_CORE_ALLOCATION_TAG);
+
+    if (Buffer == NULL) {
+        return NULL;
+    }
+
+    if (PhysicallyContiguous != FALSE) {
+        IoBufferFlags = IO_BUFFER_FLAG_PHYSICALLY_CONTIGUOUS;
+        Buffer->IoBuffer = MmAllocateNonPagedIoBuffer(0,
+                                                      MaximumPhysicalAddress,
+                                                      Alignment,
+                                                      Size,
+                                                      IoBufferFlags);
+
+    } else {
+        Buffer->IoBuffer = MmAllocatePagedIoBuffer(Size, 0);
+    }
+
+    if (Buffer->IoBuffer == NULL) {
+        MmFreePagedPool(Buffer);
+        return NULL;
+    }
+
+    ASSERT(Buffer->IoBuffer->FragmentCount == 1);
+
+    Buffer->BufferPhysicalAddress =
+                                 Buffer->IoBuffer->Fragment[0].PhysicalAddress;
+
+    Buffer->Buffer = Buffer->IoBuffer->Fragment[0].VirtualAddress;
+    return Buffer;
+}
+
+VOID
+NetpDestroyPacketBuffer (
+    PNET_PACKET_BUFFER Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine releases a network packet buffer back to the pools.
+
+Arguments:
+
+    Buffer - Supplies a pointer to the buffer to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    MmFreeIoBuffer(Buffer->IoBuffer);
+    MmFreePagedPool(Buffer);
+    return;
+}
+
+PNET_PACKET_BUFFER
+NetpGetFromBufferMagazine (
+    ULONG Kind,
+    ULONG Class
+    )
+
+/*++
+
+Routine Description:
+
+    This routine pops a buffer off of the current processor's magazine.
+
+Arguments:
+
+    Kind - Supplies the kind of buffer. See NET_BUFFER_KIND_* definitions.
+
+    Class - Supplies the size class of the buffer.
+
+Return Value:
+
+    Returns a pointer to the buffer on success.
+
+    NULL if the magazine is empty.
+
+--*/
+
+{
+
+    PNET_PACKET_BUFFER Buffer;
+    PNET_BUFFER_MAGAZINE Magazine;
+    RUNLEVEL OldRunLevel;
+    ULONG ProcessorNumber;
+
+    ASSERT((Kind < NET_BUFFER_KIND_COUNT) &&
+           (Class < NET_BUFFER_CLASS_COUNT));
+
+    Buffer = NULL;
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    ProcessorNumber = KeGetCurrentProcessorNumber();
+    if (ProcessorNumber < NetBufferCacheCount) {
+        Magazine = &(NetBufferCaches[ProcessorNumber].Magazines[Kind][Class]);
+        if (Magazine->Count != 0) {
+            Magazine->Count -= 1;
+            Buffer = Magazine->Rounds[Magazine->Count];
+        }
+    }
+
+    KeLowerRunLevel(OldRunLevel);
+    return Buffer;
+}
+
+PNET_PACKET_BUFFER
+NetpRefillBufferMagazine (
+    ULONG Kind,
+    ULONG Class
+    )
+
+/*++
+
+Routine Description:
+
+    This routine takes a batch of free buffers from the depot with a single
+    lock acquisition, returning one and putting the rest in the current
+    processor's magazine.
+
+Arguments:
+
+    Kind - Supplies the kind of buffer. See NET_BUFFER_KIND_* definitions.
+
+    Class - Supplies the size class of the buffers.
+
+Return Value:
+
+    Returns a pointer to a buffer on success.
+
+    NULL if the depot is empty.
+
+--*/
+
+{
+
+    PNET_PACKET_BUFFER Batch[NET_BUFFER_MAGAZINE_BATCH_SIZE];
+    PNET_PACKET_BUFFER Buffer;
+    ULONG Count;
+    PNET_BUFFER_DEPOT Depot;
+
+    Count = 0;
+    Depot = &(NetBufferDepots[Kind][Class]);
+    KeAcquireQueuedLock(NetBufferDepotLock);
+    while ((Count < NET_BUFFER_MAGAZINE_BATCH_SIZE) &&
+           (LIST_EMPTY(&(Depot->FreeList)) == FALSE)) {
+
+        Buffer = LIST_VALUE(Depot->FreeList.Next, NET_PACKET_BUFFER, ListEntry);
+        LIST_REMOVE(&(Buffer->ListEntry));
+        Batch[Count] = Buffer;
+        Count += 1;
+    }
+
+    Depot->Count -= Count;
+    KeReleaseQueuedLock(NetBufferDepotLock);
+    if (Count == 0) {
+        return NULL;
+    }
+
+    if (Count > 1) {
+        NetpPutInBufferMagazine(Kind, Class, &(Batch[1]), Count - 1);
+    }
+
+    return Batch[0];
+}
+
+VOID
+NetpPutInBufferMagazine (
+    ULONG Kind,
+    ULONG Class,
+    PNET_PACKET_BUFFER *Buffers,
+    ULONG Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine pushes free buffers onto the current processor's magazine.
+    If the magazine is full, a batch of buffers is sent back to the depot
+    with a single lock acquisition.
+
+Arguments:
+
+    Kind - Supplies the kind of the buffers. See NET_BUFFER_KIND_*
+        definitions.
+
+    Class - Supplies the size class of the buffers. Each buffer must be at
+        least as big as the class size.
+
+    Buffers - Supplies an array of buffers to put in the magazine.
+
+    Count - Supplies the number of elements in the array. This must be less
+        than the batch size.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+    PNET_BUFFER_MAGAZINE Magazine;
+    RUNLEVEL OldRunLevel;
+    PNET_PACKET_BUFFER Overflow[NET_BUFFER_MAGAZINE_BATCH_SIZE];
+    ULONG OverflowCount;
+    ULONG ProcessorNumber;
+
+    ASSERT((Kind < NET_BUFFER_KIND_COUNT) &&
+           (Class < NET_BUFFER_CLASS_COUNT) &&
+           (Count < NET_BUFFER_MAGAZINE_BATCH_SIZE));
+
+    OverflowCount = 0;
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    ProcessorNumber = KeGetCurrentProcessorNumber();
+    if (ProcessorNumber >= NetBufferCacheCount) {
+        for (Index = 0; Index < Count; Index += 1) {
+            Overflow[Index] = Buffers[Index];
+        }
+
+        OverflowCount = Count;
+
+    } else {
+        Magazine = &(NetBufferCaches[ProcessorNumber].Magazines[Kind][Class]);
+        for (Index = 0; Index < Count; Index += 1) {
+
+            //
+            // Spill a batch off the top when the magazine fills up. Since
+            // fewer than a batch of buffers are being added, this happens at
+            // most once.
+            //
+
+            if (Magazine->Count == NET_BUFFER_MAGAZINE_CAPACITY) {
+
+                ASSERT(OverflowCount == 0);
+
+                Magazine->Count -= NET_BUFFER_MAGAZINE_BATCH_SIZE;
+                RtlCopyMemory(Overflow,
+                              &(Magazine->Rounds[Magazine->Count]),
+                              sizeof(Overflow));
+
+                OverflowCount = NET_BUFFER_MAGAZINE_BATCH_SIZE;
+            }
+
+            Magazine->Rounds[Magazine->Count] = Buffers[Index];
+            Magazine->Count += 1;
+        }
+    }
+
+    KeLowerRunLevel(OldRunLevel);
+    if (OverflowCount != 0) {
+        NetpFreeBuffersToDepot(Kind, Class, Overflow, OverflowCount);
+    }
+
+    return;
+}
+
+VOID
+NetpFreeBuffersToDepot (
+    ULONG Kind,
+    ULONG Class,
+    PNET_PACKET_BUFFER *Buffers,
+    ULONG Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns free buffers to the depot with a single lock
+    acquisition. Buffers that do not fit under the depot limit are released
+    back to the pools.
+
+Arguments:
+
+    Kind - Supplies the kind of the buffers. See NET_BUFFER_KIND_*
+        definitions.
+
+    Class - Supplies the size class of the buffers.
+
+    Buffers - Supplies an array of buffers to free.
+
+    Count - Supplies the number of elements in the array.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PNET_BUFFER_DEPOT Depot;
+    ULONG Index;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    Depot = &(NetBufferDepots[Kind][Class]);
+    Index = 0;
+    KeAcquireQueuedLock(NetBufferDepotLock);
+    while ((Index < Count) && (Depot->Count < NET_BUFFER_DEPOT_LIMIT)) {
+        INSERT_AFTER(&(Buffers[Index]->ListEntry), &(Depot->FreeList));
+        Depot->Count += 1;
+        Index += 1;
+    }
+
+    KeReleaseQueuedLock(NetBufferDepotLock);
+    while (Index < Count) {
+        NetpDestroyPacketBuffer(Buffers[Index]);
+        Index += 1;
+    }
+
+    return;
+}
+
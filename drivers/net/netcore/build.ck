@@ -43,6 +43,8 @@ function build() {
         "raw.c",
         "tcp.c",
         "tcpcong.c",
+        "tcpcubic.c",
+        "tcptimer.c",
         "udp.c"
     ];
 
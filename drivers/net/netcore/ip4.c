@@ -1001,10 +1001,13 @@ Return Value:
         //
         // If the current packet's total data size (including all headers and
         // footers) is larger than the socket's/link's maximum size, then the
-        // IP layer needs to break it into multiple fragments.
+        // IP layer needs to break it into multiple fragments. Packets marked
+        // for segmentation are split into properly sized segments by the
+        // link instead.
         //
 
-        } else if (Packet->DataSize > MaxPacketSize) {
+        } else if ((Packet->DataSize > MaxPacketSize) &&
+                   ((Packet->Flags & NET_PACKET_FLAG_TCP_SEGMENTATION) == 0)) {
 
             //
             // Determine the size of the remaining headers and footers that
@@ -498,6 +498,19 @@ Return Value:
                               0,
                               NetpCompareFullyBoundSockets);
 
+    //
+    // Raw sockets live on their own list, so only the other protocols need a
+    // hash table for quickly finding fully bound sockets.
+    //
+
+    NewProtocolCopy->SocketHashTable = NULL;
+    if (NewProtocolCopy->Type != NetSocketRaw) {
+        Status = NetpCreateSocketHashTable(NewProtocolCopy);
+        if (!KSUCCESS(Status)) {
+            goto RegisterProtocolEnd;
+        }
+    }
+
     KeAcquireSharedExclusiveLockExclusive(NetPluginListLock);
     LockHeld = TRUE;
 
@@ -1206,6 +1219,53 @@ Return Value:
     return;
 }
 
+NET_API
+VOID
+NetFlushReceivedPackets (
+    PNET_LINK Link
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called by low level NIC drivers that set the receive
+    coalescing offload flag after they have passed a batch of received packets
+    to the core networking library. It gives protocols that held on to
+    packets to merge them a chance to finish processing them.
+
+Arguments:
+
+    Link - Supplies a pointer to the link that received the packets.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PNET_PROTOCOL_ENTRY Protocol;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    KeAcquireSharedExclusiveLockShared(NetPluginListLock);
+    CurrentEntry = NetProtocolList.Next;
+    while (CurrentEntry != &NetProtocolList) {
+        Protocol = LIST_VALUE(CurrentEntry, NET_PROTOCOL_ENTRY, ListEntry);
+        if (Protocol->Interface.FlushReceivedData != NULL) {
+            Protocol->Interface.FlushReceivedData(Link);
+        }
+
+        CurrentEntry = CurrentEntry->Next;
+    }
+
+    KeReleaseSharedExclusiveLockShared(NetPluginListLock);
+    return;
+}
+
 NET_API
 BOOL
 NetGetGlobalDebugFlag (
@@ -2449,6 +2509,10 @@ Return Value:
 
 {
 
+    if (Protocol->SocketHashTable != NULL) {
+        NetpDestroySocketHashTable(Protocol);
+    }
+
     if (Protocol->SocketLock != NULL) {
         KeDestroySharedExclusiveLock(Protocol->SocketLock);
     }
@@ -275,6 +275,50 @@ Return Value:
 
 --*/
 
+KSTATUS
+NetpCreateSocketHashTable (
+    PNET_PROTOCOL_ENTRY Protocol
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates the hash table of fully bound sockets for the given
+    protocol.
+
+Arguments:
+
+    Protocol - Supplies a pointer to the protocol being registered.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VOID
+NetpDestroySocketHashTable (
+    PNET_PROTOCOL_ENTRY Protocol
+    );
+
+/*++
+
+Routine Description:
+
+    This routine destroys the hash table of fully bound sockets for the given
+    protocol. The table must be empty.
+
+Arguments:
+
+    Protocol - Supplies a pointer to the protocol being destroyed.
+
+Return Value:
+
+    None.
+
+--*/
+
 //
 // Prototypes to the entry points for built in protocols.
 //
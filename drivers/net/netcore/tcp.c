@@ -189,6 +189,11 @@ NetpTcpUserControl (
     UINTN ContextBufferSize
     );
 
+VOID
+NetpTcpFlushReceivedData (
+    PNET_LINK Link
+    );
+
 VOID
 NetpTcpWorkerThread (
     PVOID Parameter
@@ -204,6 +209,19 @@ NetpTcpProcessPacket (
     PNETWORK_ADDRESS DestinationAddress
     );
 
+BOOL
+NetpTcpCoalescePacket (
+    PTCP_SOCKET Socket,
+    PNET_LINK Link,
+    PTCP_HEADER Header,
+    PNET_PACKET_BUFFER Packet
+    );
+
+VOID
+NetpTcpFlushCoalescedPacket (
+    PTCP_SOCKET Socket
+    );
+
 VOID
 NetpTcpHandleUnconnectedPacket (
     PNET_LINK Link,
@@ -245,14 +263,41 @@ NetpTcpProcessAcknowledge (
     ULONG AcknowledgeNumber,
     ULONG SequenceNumber,
     ULONG DataLength,
-    USHORT WindowSize
+    USHORT WindowSize,
+    PTCP_PACKET_OPTIONS Options
     );
 
 VOID
 NetpTcpProcessPacketOptions (
     PTCP_SOCKET Socket,
     PTCP_HEADER Header,
-    PNET_PACKET_BUFFER Packet
+    PNET_PACKET_BUFFER Packet,
+    PTCP_PACKET_OPTIONS Options
+    );
+
+VOID
+NetpTcpProcessSelectiveAcknowledgments (
+    PTCP_SOCKET Socket,
+    PTCP_PACKET_OPTIONS Options
+    );
+
+VOID
+NetpTcpClearScoreboard (
+    PTCP_SOCKET Socket,
+    BOOL ClearAcknowledged
+    );
+
+ULONG
+NetpTcpGatherTransmitOptions (
+    PTCP_SOCKET Socket,
+    BOOL Control,
+    PTCP_PACKET_OPTIONS Options
+    );
+
+VOID
+NetpTcpWriteTransmitOptions (
+    PTCP_PACKET_OPTIONS Options,
+    PUCHAR Buffer
     );
 
 VOID
@@ -300,6 +345,14 @@ NetpTcpCreatePacket (
     PTCP_SEND_SEGMENT Segment
     );
 
+PNET_PACKET_BUFFER
+NetpTcpCreateSegmentationPacket (
+    PTCP_SOCKET Socket,
+    PTCP_SEND_SEGMENT FirstSegment,
+    ULONG WindowEnd,
+    PTCP_SEND_SEGMENT *LastSegment
+    );
+
 VOID
 NetpTcpFreeSentSegments (
     PTCP_SOCKET Socket,
@@ -361,19 +414,14 @@ NetpTcpTimerAddReference (
     PTCP_SOCKET Socket
     );
 
-ULONG
+VOID
 NetpTcpTimerReleaseReference (
     PTCP_SOCKET Socket
     );
 
-VOID
-NetpTcpQueueTcpTimer (
-    VOID
-    );
-
-VOID
-NetpTcpArmKeepAliveTimer (
-    ULONGLONG DueTime
+ULONGLONG
+NetpTcpGetTimerDueTime (
+    PTCP_SOCKET Socket
     );
 
 KSTATUS
@@ -401,26 +449,20 @@ NetpTcpFreeSegment (
 //
 
 //
-// Store a pointer to the global TCP timer.
-//
-
-PKTIMER NetTcpTimer;
-ULONGLONG NetTcpTimerPeriod;
-volatile ULONG NetTcpTimerReferenceCount;
-
-//
-// Store a pointer to the global TCP keep alive timer.
+// Store the global list of sockets.
 //
 
-PQUEUED_LOCK NetTcpKeepAliveTimerLock;
-PKTIMER NetTcpKeepAliveTimer;
+LIST_ENTRY NetTcpSocketList;
+PQUEUED_LOCK NetTcpSocketListLock;
 
 //
-// Store the global list of sockets.
+// Store the global list of sockets holding a coalesced received packet that
+// must be processed when the current receive batch ends. Sockets are pushed
+// on and the whole list is taken off with atomic operations, so the only lock
+// involved in coalescing is the socket's own.
 //
 
-LIST_ENTRY NetTcpSocketList;
-PQUEUED_LOCK NetTcpSocketListLock;
+PTCP_SOCKET NetTcpCoalesceList;
 
 //
 // Store the TCP debug flags, which print out a bunch more information.
@@ -437,6 +479,13 @@ BOOL NetTcpDebugPrintCongestionControl = FALSE;
 
 BOOL NetTcpDebugPrintLocalAddress = FALSE;
 
+//
+// Store the number of time counter ticks in a millisecond, which is the
+// granularity of the TCP timestamp clock.
+//
+
+ULONGLONG NetTcpTimestampTicksPerMillisecond;
+
 NET_PROTOCOL_ENTRY NetTcpProtocol = {
     {NULL, NULL},
     NetSocketStream,
@@ -458,7 +507,8 @@ NET_PROTOCOL_ENTRY NetTcpProtocol = {
         NetpTcpProcessReceivedSocketData,
         NetpTcpReceive,
         NetpTcpGetSetInformation,
-        NetpTcpUserControl
+        NetpTcpUserControl,
+        NetpTcpFlushReceivedData
     }
 };
 
@@ -560,6 +610,27 @@ TCP_SOCKET_OPTION NetTcpSocketOptions[] = {
         sizeof(ULONG),
         TRUE
     },
+
+    {
+        SocketInformationTcp,
+        SocketTcpOptionInformation,
+        sizeof(SOCKET_TCP_INFORMATION),
+        FALSE
+    },
+
+    {
+        SocketInformationTcp,
+        SocketTcpOptionCongestionControl,
+        sizeof(ULONG),
+        TRUE
+    },
+
+    {
+        SocketInformationTcp,
+        SocketTcpOptionDefaultCongestionControl,
+        sizeof(ULONG),
+        TRUE
+    },
 };
 
 //
@@ -607,7 +678,7 @@ Return Value:
     INITIALIZE_LIST_HEAD(&NetTcpSocketList);
 
     //
-    // Create the global periodic timer and list lock.
+    // Create the global list lock and the timing wheel.
     //
 
     ASSERT(NetTcpSocketListLock == NULL);
@@ -618,30 +689,16 @@ Return Value:
         goto TcpInitializeEnd;
     }
 
-    ASSERT(NetTcpTimer == NULL);
-
-    NetTcpTimer = KeCreateTimer(TCP_ALLOCATION_TAG);
-    if (NetTcpTimer == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto TcpInitializeEnd;
-    }
-
-    ASSERT(NetTcpKeepAliveTimerLock == NULL);
-
-    NetTcpKeepAliveTimerLock = KeCreateQueuedLock();
-    if (NetTcpKeepAliveTimerLock == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
+    Status = NetpTcpInitializeTimers();
+    if (!KSUCCESS(Status)) {
         goto TcpInitializeEnd;
     }
 
-    NetTcpTimerPeriod = KeConvertMicrosecondsToTimeTicks(TCP_TIMER_PERIOD);
+    NetTcpTimestampTicksPerMillisecond = HlQueryTimeCounterFrequency() /
+                                         MILLISECONDS_PER_SECOND;
 
-    ASSERT(NetTcpKeepAliveTimer == NULL);
-
-    NetTcpKeepAliveTimer = KeCreateTimer(TCP_ALLOCATION_TAG);
-    if (NetTcpKeepAliveTimer == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto TcpInitializeEnd;
+    if (NetTcpTimestampTicksPerMillisecond == 0) {
+        NetTcpTimestampTicksPerMillisecond = 1;
     }
 
     //
@@ -672,20 +729,7 @@ Return Value:
             NetTcpSocketListLock = NULL;
         }
 
-        if (NetTcpTimer != NULL) {
-            KeDestroyTimer(NetTcpTimer);
-            NetTcpTimer = NULL;
-        }
-
-        if (NetTcpKeepAliveTimerLock != NULL) {
-            KeDestroyQueuedLock(NetTcpKeepAliveTimerLock);
-            NetTcpKeepAliveTimerLock = NULL;
-        }
-
-        if (NetTcpKeepAliveTimer != NULL) {
-            KeDestroyTimer(NetTcpKeepAliveTimer);
-            NetTcpKeepAliveTimer = NULL;
-        }
+        NetpTcpDestroyTimers();
     }
 
     return;
@@ -793,7 +837,11 @@ Return Value:
     // Start by assuming the remote supports the desired options.
     //
 
-    TcpSocket->Flags |= TCP_SOCKET_FLAG_WINDOW_SCALING;
+    TcpSocket->Flags |= TCP_SOCKET_FLAG_WINDOW_SCALING |
+                        TCP_SOCKET_FLAG_SELECTIVE_ACKNOWLEDGE |
+                        TCP_SOCKET_FLAG_TIMESTAMPS;
+
+    TcpSocket->SendSelectiveAcknowledgeHigh = TcpSocket->SendInitialSequence;
 
     //
     // Initialize the socket on the lower layers.
@@ -897,6 +945,9 @@ Return Value:
     ASSERT(TcpSocket->ListEntry.Next == NULL);
     ASSERT(LIST_EMPTY(&(TcpSocket->ReceivedSegmentList)) != FALSE);
     ASSERT(LIST_EMPTY(&(TcpSocket->OutgoingSegmentList)) != FALSE);
+    ASSERT((TcpSocket->CoalescedPacket == NULL) &&
+           (TcpSocket->CoalescePending == FALSE));
+    ASSERT(TcpSocket->TimerListEntry.Next == NULL);
 
     KeDestroyQueuedLock(TcpSocket->Lock);
     TcpSocket->Lock = NULL;
@@ -2318,12 +2369,19 @@ Return Value:
                       Length - HeaderLength);
     }
 
-    NetpTcpProcessPacket(TcpSocket,
-                         Link,
-                         Header,
-                         Packet,
-                         SourceAddress,
-                         DestinationAddress);
+    //
+    // Links that deliver packets in batches allow consecutive data segments
+    // to be merged and processed once at the end of the batch.
+    //
+
+    if (NetpTcpCoalescePacket(TcpSocket, Link, Header, Packet) == FALSE) {
+        NetpTcpProcessPacket(TcpSocket,
+                             Link,
+                             Header,
+                             Packet,
+                             SourceAddress,
+                             DestinationAddress);
+    }
 
     KeReleaseQueuedLock(TcpSocket->Lock);
 
@@ -2884,12 +2942,16 @@ Return Value:
     STATUS_NOT_HANDLED if the protocol does not override the default behavior
         for a basic socket option.
 
+    STATUS_PERMISSION_DENIED if the caller does not have permission to set
+        the requested option.
+
 --*/
 
 {
 
     SOCKET_BASIC_OPTION BasicOption;
     ULONG BooleanOption;
+    ULONG CongestionOption;
     ULONG Count;
     ULONGLONG DueTime;
     ULONG Index;
@@ -2906,10 +2968,12 @@ Return Value:
     SOCKET_TIME SocketTimeBuffer;
     PVOID Source;
     KSTATUS Status;
+    SOCKET_TCP_INFORMATION TcpInformation;
     SOCKET_TCP_OPTION TcpOption;
     PTCP_SOCKET TcpSocket;
     PTCP_SOCKET_OPTION TcpSocketOption;
     PULONG TcpTimeout;
+    ULONGLONG TimeCounterFrequency;
     ULONG WindowScale;
     ULONG WindowSize;
 
@@ -3300,7 +3364,7 @@ Return Value:
 
                             TcpSocket->KeepAliveTime = DueTime;
                             TcpSocket->KeepAliveProbeCount = 0;
-                            NetpTcpArmKeepAliveTimer(DueTime);
+                            NetpTcpScheduleTimer(TcpSocket, DueTime);
                         }
 
                         TcpSocket->Flags |= TCP_SOCKET_FLAG_KEEP_ALIVE;
@@ -3430,6 +3494,121 @@ Return Value:
 
             break;
 
+        case SocketTcpOptionInformation:
+
+            ASSERT(Set == FALSE);
+
+            Source = &TcpInformation;
+            RtlZeroMemory(&TcpInformation, sizeof(SOCKET_TCP_INFORMATION));
+            TcpInformation.Version = SOCKET_TCP_INFORMATION_VERSION;
+            TimeCounterFrequency = HlQueryTimeCounterFrequency();
+            KeAcquireQueuedLock(TcpSocket->Lock);
+            if ((TcpSocket->Flags & TCP_SOCKET_FLAG_WINDOW_SCALING) != 0) {
+                TcpInformation.Flags |=
+                                    SOCKET_TCP_INFORMATION_FLAG_WINDOW_SCALING;
+            }
+
+            if ((TcpSocket->Flags &
+                 TCP_SOCKET_FLAG_SELECTIVE_ACKNOWLEDGE) != 0) {
+
+                TcpInformation.Flags |=
+                             SOCKET_TCP_INFORMATION_FLAG_SELECTIVE_ACKNOWLEDGE;
+            }
+
+            if ((TcpSocket->Flags & TCP_SOCKET_FLAG_TIMESTAMPS) != 0) {
+                TcpInformation.Flags |= SOCKET_TCP_INFORMATION_FLAG_TIMESTAMPS;
+            }
+
+            if ((TcpSocket->Flags & TCP_SOCKET_FLAG_IN_FAST_RECOVERY) != 0) {
+                TcpInformation.Flags |=
+                                     SOCKET_TCP_INFORMATION_FLAG_FAST_RECOVERY;
+            }
+
+            TcpInformation.SendMaxSegmentSize = TcpSocket->SendMaxSegmentSize;
+            TcpInformation.ReceiveMaxSegmentSize =
+                                              TcpSocket->ReceiveMaxSegmentSize;
+
+            TcpInformation.CongestionWindowSize =
+                                               TcpSocket->CongestionWindowSize;
+
+            TcpInformation.SlowStartThreshold = TcpSocket->SlowStartThreshold;
+            TcpInformation.SendWindowSize = TcpSocket->SendWindowSize;
+
+            //
+            // The round trip time is stored scaled up by the sample
+            // denominator.
+            //
+
+            TcpInformation.RoundTripTime =
+                           ((TcpSocket->RoundTripTime *
+                             MICROSECONDS_PER_SECOND) /
+                            TCP_ROUND_TRIP_SAMPLE_DENOMINATOR) /
+                           TimeCounterFrequency;
+
+            TcpInformation.RetransmitCount = TcpSocket->RetransmitCount;
+            TcpInformation.SelectiveRetransmitCount =
+                                           TcpSocket->SelectiveRetransmitCount;
+
+            TcpInformation.TimeoutCount = TcpSocket->TimeoutCount;
+            TcpInformation.SelectiveAcknowledgeBlocksReceived =
+                                 TcpSocket->SelectiveAcknowledgeBlocksReceived;
+
+            TcpInformation.SelectiveAcknowledgeBlocksSent =
+                                     TcpSocket->SelectiveAcknowledgeBlocksSent;
+
+            TcpInformation.TimestampSampleCount =
+                                               TcpSocket->TimestampSampleCount;
+
+            KeReleaseQueuedLock(TcpSocket->Lock);
+            break;
+
+        case SocketTcpOptionCongestionControl:
+            if (Set != FALSE) {
+                CongestionOption = *((PULONG)Data);
+                if (CongestionOption >= SocketTcpCongestionAlgorithmCount) {
+                    Status = STATUS_INVALID_PARAMETER;
+                    break;
+                }
+
+                KeAcquireQueuedLock(TcpSocket->Lock);
+                NetpTcpCongestionSetAlgorithm(TcpSocket, CongestionOption);
+                KeReleaseQueuedLock(TcpSocket->Lock);
+
+            } else {
+                Source = &CongestionOption;
+                CongestionOption = TcpSocket->CongestionAlgorithm;
+            }
+
+            break;
+
+        //
+        // The default algorithm is system wide, so it is only reachable
+        // through a socket for convenience. Changing it requires network
+        // administrator privileges, and only affects sockets created later.
+        //
+
+        case SocketTcpOptionDefaultCongestionControl:
+            if (Set != FALSE) {
+                CongestionOption = *((PULONG)Data);
+                if (CongestionOption >= SocketTcpCongestionAlgorithmCount) {
+                    Status = STATUS_INVALID_PARAMETER;
+                    break;
+                }
+
+                Status = PsCheckPermission(PERMISSION_NET_ADMINISTRATOR);
+                if (!KSUCCESS(Status)) {
+                    break;
+                }
+
+                NetTcpDefaultCongestionAlgorithm = CongestionOption;
+
+            } else {
+                Source = &CongestionOption;
+                CongestionOption = NetTcpDefaultCongestionAlgorithm;
+            }
+
+            break;
+
         default:
 
             ASSERT(FALSE);
@@ -3576,6 +3755,76 @@ Return Value:
     return Status;
 }
 
+VOID
+NetpTcpFlushReceivedData (
+    PNET_LINK Link
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when a link that coalesces received packets has
+    finished delivering a batch. It processes the packets TCP sockets are
+    holding on to.
+
+Arguments:
+
+    Link - Supplies a pointer to the link that finished the batch.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PTCP_SOCKET NextSocket;
+    PTCP_SOCKET Socket;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    //
+    // Flush every socket rather than just those fed by this link. A socket
+    // held by another link's batch is just processed a little early, and it
+    // keeps the list free of per-link bookkeeping.
+    //
+
+    if (NetTcpCoalesceList == NULL) {
+        return;
+    }
+
+    Socket = (PTCP_SOCKET)RtlAtomicExchange(
+                                        (volatile UINTN *)&NetTcpCoalesceList,
+                                        (UINTN)NULL);
+
+    while (Socket != NULL) {
+
+        //
+        // The next pointer is stable until the socket is marked as no longer
+        // pending, since it cannot be pushed on again until then.
+        //
+
+        NextSocket = Socket->CoalesceNext;
+
+        //
+        // Process the held packet and release the reference taken when the
+        // socket was put on the list.
+        //
+
+        KeAcquireQueuedLock(Socket->Lock);
+        Socket->CoalesceNext = NULL;
+        Socket->CoalescePending = FALSE;
+        NetpTcpFlushCoalescedPacket(Socket);
+        KeReleaseQueuedLock(Socket->Lock);
+        IoSocketReleaseReference(&(Socket->NetSocket.KernelSocket));
+        Socket = NextSocket;
+    }
+
+    return;
+}
+
 VOID
 NetpTcpPrintSocketEndpoints (
     PTCP_SOCKET Socket,
@@ -3636,7 +3885,9 @@ NetpTcpRetransmit (
 
 Routine Description:
 
-    This routine immediately transmits the oldest pending packet. This routine
+    This routine immediately transmits the oldest pending packet. During fast
+    recovery with selective acknowledgments, it instead transmits the oldest
+    hole in the scoreboard that has not yet been retransmitted. This routine
     assumes the socket lock is already held.
 
 Arguments:
@@ -3652,7 +3903,11 @@ Return Value:
 
 {
 
+    PLIST_ENTRY CurrentEntry;
+    ULONG Flags;
+    ULONG HighSequence;
     PTCP_SEND_SEGMENT Segment;
+    ULONG SegmentBegin;
 
     if (LIST_EMPTY(&(Socket->OutgoingSegmentList)) != FALSE) {
         return;
@@ -3662,6 +3917,48 @@ Return Value:
                          TCP_SEND_SEGMENT,
                          Header.ListEntry);
 
+    //
+    // If the remote host has reported data beyond the acknowledge number,
+    // everything unacknowledged below the highest reported sequence is
+    // presumed lost. Send the first such segment not already resent during
+    // this recovery.
+    //
+
+    Flags = Socket->Flags;
+    HighSequence = Socket->SendSelectiveAcknowledgeHigh;
+    if (((Flags & TCP_SOCKET_FLAG_IN_FAST_RECOVERY) != 0) &&
+        ((Flags & TCP_SOCKET_FLAG_SELECTIVE_ACKNOWLEDGE) != 0) &&
+        (TCP_SEQUENCE_GREATER_THAN(HighSequence,
+                                   Socket->SendUnacknowledgedSequence))) {
+
+        CurrentEntry = Socket->OutgoingSegmentList.Next;
+        while (CurrentEntry != &(Socket->OutgoingSegmentList)) {
+            Segment = LIST_VALUE(CurrentEntry,
+                                 TCP_SEND_SEGMENT,
+                                 Header.ListEntry);
+
+            CurrentEntry = CurrentEntry->Next;
+            SegmentBegin = Segment->SequenceNumber + Segment->Offset;
+            if ((Segment->SendAttemptCount == 0) ||
+                (!TCP_SEQUENCE_LESS_THAN(SegmentBegin, HighSequence))) {
+
+                return;
+            }
+
+            if ((Segment->Flags &
+                 (TCP_SEND_SEGMENT_FLAG_SELECTIVELY_ACKNOWLEDGED |
+                  TCP_SEND_SEGMENT_FLAG_RECOVERY_RETRANSMIT)) == 0) {
+
+                Segment->Flags |= TCP_SEND_SEGMENT_FLAG_RECOVERY_RETRANSMIT;
+                Socket->SelectiveRetransmitCount += 1;
+                NetpTcpSendSegment(Socket, Segment);
+                return;
+            }
+        }
+
+        return;
+    }
+
     NetpTcpSendSegment(Socket, Segment);
     return;
 }
@@ -3693,84 +3990,44 @@ Return Value:
 
 {
 
-    PLIST_ENTRY CurrentEntry;
     PTCP_SOCKET CurrentSocket;
     ULONGLONG CurrentTime;
+    ULONGLONG DueTime;
     PULONG Flags;
     PIO_OBJECT_STATE IoState;
-    ULONGLONG KeepAliveTime;
-    BOOL KeepAliveTimeout;
     PSOCKET KernelSocket;
     BOOL LinkUp;
-    ULONG OldReferenceCount;
     ULONGLONG RecentTime;
-    PVOID SignalingObject;
-    PVOID WaitObjectArray[2];
     BOOL WithAcknowledge;
 
-    ASSERT(2 < BUILTIN_WAIT_BLOCK_ENTRY_COUNT);
-
-    KeepAliveTime = MAX_ULONGLONG;
-    WaitObjectArray[0] = NetTcpTimer;
-    WaitObjectArray[1] = NetTcpKeepAliveTimer;
-    while ((NetTcpTimer != NULL) && (NetTcpKeepAliveTimer != NULL)) {
-
-        //
-        // Sleep until the periodic or keep alive timer fires again.
-        //
-
-        ObWaitOnObjects(WaitObjectArray,
-                        2,
-                        0,
-                        WAIT_TIME_INDEFINITE,
-                        NULL,
-                        &SignalingObject);
+    while (NetTcpTimer != NULL) {
 
         //
-        // If the keep alive timer signaled, then check the keep alive states.
+        // Sleep until the earliest socket deadline comes due.
         //
 
-        KeepAliveTimeout = FALSE;
-        if (SignalingObject == NetTcpKeepAliveTimer) {
-            KeepAliveTimeout = TRUE;
-            KeepAliveTime = MAX_ULONGLONG;
-            KeSignalTimer(NetTcpKeepAliveTimer, SignalOptionUnsignal);
-
-        //
-        // If the TCP time signaled, determine whether or not work needs to be
-        // done. Start by decrementing a reference for the now expired timer.
-        // If the old reference count is 1 then none of the sockets need
-        // processing. If there is still more than 1 reference, however, at
-        // least one socket is hanging around. Queue the timer and process the
-        // sockets.
-        //
-
-        } else {
-
-            ASSERT(SignalingObject == NetTcpTimer);
-
-            KeSignalTimer(NetTcpTimer, SignalOptionUnsignal);
-            OldReferenceCount = NetpTcpTimerReleaseReference(NULL);
-            if (OldReferenceCount == 1) {
-                continue;
-            }
-
-            NetpTcpQueueTcpTimer();
-        }
+        ObWaitOnObject(NetTcpTimer, 0, WAIT_TIME_INDEFINITE);
+        KeSignalTimer(NetTcpTimer, SignalOptionUnsignal);
 
         //
-        // Loop through every socket.
+        // Advance the timing wheel and service only the sockets whose
+        // deadlines have passed. Holding the socket list lock keeps expired
+        // sockets from being destroyed out from under the loop.
         //
 
         CurrentTime = 0;
         KeAcquireQueuedLock(NetTcpSocketListLock);
-        CurrentEntry = NetTcpSocketList.Next;
-        while (CurrentEntry != &NetTcpSocketList) {
-            CurrentSocket = LIST_VALUE(CurrentEntry, TCP_SOCKET, ListEntry);
-            CurrentEntry = CurrentEntry->Next;
+        NetpTcpExpireTimers();
+        while (TRUE) {
+            CurrentSocket = NetpTcpGetExpiredTimer();
+            if (CurrentSocket == NULL) {
+                break;
+            }
+
             KernelSocket = &(CurrentSocket->NetSocket.KernelSocket);
 
             ASSERT(KernelSocket->ReferenceCount >= 1);
+            ASSERT(CurrentSocket->ListEntry.Next != NULL);
 
             //
             // Check the link state for all bound sockets. If the link is down,
@@ -3789,28 +4046,7 @@ Return Value:
                 }
             }
 
-            //
-            // If the socket is not waiting on anything, move on. Manipulation
-            // of any of these criteria require manipulating the TCP timer
-            // reference count.
-            //
-
             Flags = &(CurrentSocket->Flags);
-            if ((LIST_EMPTY(&(CurrentSocket->OutgoingSegmentList))) &&
-                ((*Flags & TCP_SOCKET_FLAG_SEND_ACKNOWLEDGE) == 0) &&
-                (((*Flags & TCP_SOCKET_FLAG_SEND_FINAL_SEQUENCE_VALID) == 0) ||
-                 ((*Flags & TCP_SOCKET_FLAG_SEND_FIN_WITH_DATA) != 0)) &&
-                (CurrentSocket->State != TcpStateTimeWait) &&
-                (TCP_IS_SYN_RETRY_STATE(CurrentSocket->State) == FALSE) &&
-                (((*Flags & TCP_SOCKET_FLAG_SEND_FIN_WITH_DATA) != 0) ||
-                 (TCP_IS_FIN_RETRY_STATE(CurrentSocket->State) == FALSE)) &&
-                ((KeepAliveTimeout == FALSE) ||
-                 ((*Flags & TCP_SOCKET_FLAG_KEEP_ALIVE) == 0) ||
-                 (TCP_IS_KEEP_ALIVE_STATE(CurrentSocket->State) == FALSE))) {
-
-                continue;
-            }
-
             IoSocketAddReference(KernelSocket);
             KeAcquireQueuedLock(CurrentSocket->Lock);
             NetpTcpSendPendingSegments(CurrentSocket, &CurrentTime);
@@ -3902,13 +4138,14 @@ Return Value:
                 }
 
             //
-            // If the socket is in the keep alive state and the keep alive
-            // timer woke up the thread, then check on that timeout.
+            // If the socket is in the keep alive state and its keep alive
+            // time has been reached, then check on the remote host.
             //
 
-            } else if ((KeepAliveTimeout != FALSE) &&
-                       ((*Flags & TCP_SOCKET_FLAG_KEEP_ALIVE) != 0) &&
-                       TCP_IS_KEEP_ALIVE_STATE(CurrentSocket->State)) {
+            } else if (((*Flags & TCP_SOCKET_FLAG_KEEP_ALIVE) != 0) &&
+                       TCP_IS_KEEP_ALIVE_STATE(CurrentSocket->State) &&
+                       (KeGetRecentTimeCounter() >=
+                        CurrentSocket->KeepAliveTime)) {
 
                 //
                 // If too many probes have been sent without a response then
@@ -3930,26 +4167,19 @@ Return Value:
                     NetpTcpCloseOutSocket(CurrentSocket, TRUE);
 
                 //
-                // Otherwise, if the keep alive time has been reached, then
-                // send another ping and then re-arm the keep alive time.
+                // Otherwise send another ping and then re-arm the keep alive
+                // time.
                 //
 
                 } else {
-                    RecentTime = KeGetRecentTimeCounter();
-                    if (RecentTime >= CurrentSocket->KeepAliveTime) {
-                        NetpTcpSendControlPacket(CurrentSocket,
-                                                 TCP_HEADER_FLAG_KEEP_ALIVE);
-
-                        CurrentSocket->KeepAliveProbeCount += 1;
-                        CurrentSocket->KeepAliveTime = RecentTime;
-                        CurrentSocket->KeepAliveTime +=
-                                               CurrentSocket->KeepAlivePeriod *
-                                               HlQueryTimeCounterFrequency();
-                    }
+                    NetpTcpSendControlPacket(CurrentSocket,
+                                             TCP_HEADER_FLAG_KEEP_ALIVE);
 
-                    if (CurrentSocket->KeepAliveTime < KeepAliveTime) {
-                        KeepAliveTime = CurrentSocket->KeepAliveTime;
-                    }
+                    CurrentSocket->KeepAliveProbeCount += 1;
+                    CurrentSocket->KeepAliveTime = KeGetRecentTimeCounter();
+                    CurrentSocket->KeepAliveTime +=
+                                               CurrentSocket->KeepAlivePeriod *
+                                               HlQueryTimeCounterFrequency();
                 }
             }
 
@@ -3964,20 +4194,22 @@ Return Value:
                 NetpTcpSendControlPacket(CurrentSocket, 0);
             }
 
+            //
+            // Put the socket back in the timing wheel for whenever it next
+            // needs attention. Sockets that were closed out above are no
+            // longer on the socket list and will not be scheduled.
+            //
+
+            DueTime = NetpTcpGetTimerDueTime(CurrentSocket);
+            if (DueTime != MAX_ULONGLONG) {
+                NetpTcpScheduleTimer(CurrentSocket, DueTime);
+            }
+
             KeReleaseQueuedLock(CurrentSocket->Lock);
             IoSocketReleaseReference(KernelSocket);
         }
 
         KeReleaseQueuedLock(NetTcpSocketListLock);
-
-        //
-        // If the keep alive timer needs to be re-armed, then do so with the
-        // next lowest time.
-        //
-
-        if ((KeepAliveTimeout != FALSE) && (KeepAliveTime != MAX_ULONGLONG)) {
-            NetpTcpArmKeepAliveTimer(KeepAliveTime);
-        }
     }
 
     return;
@@ -4029,6 +4261,7 @@ Return Value:
     ULONG AcknowledgeNumber;
     ULONGLONG DueTime;
     PIO_OBJECT_STATE IoState;
+    TCP_PACKET_OPTIONS Options;
     ULONG RemoteFinalSequence;
     ULONG RemoteSequence;
     ULONG ResetFlags;
@@ -4042,6 +4275,8 @@ Return Value:
     ASSERT(Socket->NetSocket.KernelSocket.ReferenceCount >= 1);
 
     IoState = Socket->NetSocket.KernelSocket.IoState;
+    Options.Flags = 0;
+    Options.SelectiveAcknowledgeCount = 0;
     SynHandled = FALSE;
 
     ASSERT(Socket->State > TcpStateInitialized);
@@ -4227,7 +4462,7 @@ Return Value:
             // that likely came with the SYN.
             //
 
-            NetpTcpProcessPacketOptions(Socket, Header, Packet);
+            NetpTcpProcessPacketOptions(Socket, Header, Packet, &Options);
 
             //
             // If the local unacknowledged number is not equal to the initial
@@ -4337,6 +4572,34 @@ Return Value:
         return;
     }
 
+    //
+    // Parse the timestamp and selective acknowledgment options if either was
+    // negotiated. The SYN path above already parsed them.
+    //
+
+    if ((SynHandled == FALSE) &&
+        ((Socket->Flags & (TCP_SOCKET_FLAG_TIMESTAMPS |
+                           TCP_SOCKET_FLAG_SELECTIVE_ACKNOWLEDGE)) != 0)) {
+
+        NetpTcpProcessPacketOptions(Socket, Header, Packet, &Options);
+    }
+
+    //
+    // Remember the remote timestamp to echo back, but only from segments that
+    // do not lie beyond the data received so far and whose timestamp has not
+    // gone backwards. This keeps out-of-order segments from skewing the
+    // remote host's round trip time measurements.
+    //
+
+    if (((Options.Flags & TCP_PACKET_OPTION_FLAG_TIMESTAMP) != 0) &&
+        (!TCP_SEQUENCE_GREATER_THAN(RemoteSequence,
+                                    Socket->ReceiveNextSequence)) &&
+        (!TCP_SEQUENCE_LESS_THAN(Options.TimestampValue,
+                                 Socket->TimestampRecent))) {
+
+        Socket->TimestampRecent = Options.TimestampValue;
+    }
+
     //
     // The ACK bit is definitely sent, process the acknowledge number. If this
     // fails, it is because the socket was closed via reset or the last ACK was
@@ -4347,7 +4610,8 @@ Return Value:
                                        AcknowledgeNumber,
                                        RemoteSequence,
                                        SegmentLength,
-                                       Header->WindowSize);
+                                       Header->WindowSize,
+                                       &Options);
 
     if (!KSUCCESS(Status)) {
 
@@ -4554,7 +4818,7 @@ Return Value:
 
     //
     // If the socket is in a keep alive state then update the keep alive time
-    // and arm the keep alive timer. The remote side is still alive!
+    // and schedule the socket's timer. The remote side is still alive!
     //
 
     if (((Socket->Flags & TCP_SOCKET_FLAG_KEEP_ALIVE) != 0) &&
@@ -4566,12 +4830,261 @@ Return Value:
 
         Socket->KeepAliveTime = DueTime;
         Socket->KeepAliveProbeCount = 0;
-        NetpTcpArmKeepAliveTimer(DueTime);
+        NetpTcpScheduleTimer(Socket, DueTime);
     }
 
     return;
 }
 
+BOOL
+NetpTcpCoalescePacket (
+    PTCP_SOCKET Socket,
+    PNET_LINK Link,
+    PTCP_HEADER Header,
+    PNET_PACKET_BUFFER Packet
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to merge a received packet into the packet the
+    socket is holding until the end of the current receive batch. Packets that
+    cannot be merged cause any held packet to be processed first so that
+    packets are still processed in the order they arrived. This routine
+    assumes the socket lock is already held.
+
+Arguments:
+
+    Socket - Supplies a pointer to the TCP socket.
+
+    Link - Supplies a pointer to the link the packet was received on.
+
+    Header - Supplies a pointer to the TCP header.
+
+    Packet - Supplies a pointer to the received packet, whose data offset
+        points just past the TCP header and its options.
+
+Return Value:
+
+    TRUE if the packet was absorbed and will be processed later.
+
+    FALSE if the caller must process the packet now.
+
+--*/
+
+{
+
+    PNET_PACKET_BUFFER Coalesced;
+    PTCP_HEADER CoalescedHeader;
+    ULONG CoalescedLength;
+    ULONG CoalescedSequence;
+    ULONG DataLength;
+    BOOL Eligible;
+    PTCP_SOCKET Head;
+    ULONG HeaderLength;
+    UINTN PreviousHead;
+    ULONG SequenceNumber;
+    KSTATUS Status;
+
+    ASSERT(KeIsQueuedLockHeld(Socket->Lock) != FALSE);
+
+    if ((Link->Properties.OffloadFlags &
+         NET_LINK_OFFLOAD_FLAG_RECEIVE_COALESCING) == 0) {
+
+        NetpTcpFlushCoalescedPacket(Socket);
+        return FALSE;
+    }
+
+    //
+    // Only plain data segments on an established connection are merged.
+    //
+
+    HeaderLength = Packet->DataOffset -
+                   ((UINTN)Header - (UINTN)(Packet->Buffer));
+
+    DataLength = Packet->FooterOffset - Packet->DataOffset;
+    SequenceNumber = NETWORK_TO_CPU32(Header->SequenceNumber);
+    Eligible = FALSE;
+    if ((Socket->State == TcpStateEstablished) &&
+        ((Header->Flags & ~TCP_HEADER_FLAG_PUSH) ==
+         TCP_HEADER_FLAG_ACKNOWLEDGE) &&
+        (DataLength != 0)) {
+
+        Eligible = TRUE;
+    }
+
+    //
+    // Append the packet to the held one if it continues the held data and
+    // carries exactly the same acknowledgment, window, and options. Anything
+    // else processes the held packet now.
+    //
+
+    Coalesced = Socket->CoalescedPacket;
+    if (Coalesced != NULL) {
+        CoalescedHeader = (PTCP_HEADER)(Coalesced->Buffer);
+        CoalescedLength = Coalesced->FooterOffset - Coalesced->DataOffset;
+        CoalescedSequence = NETWORK_TO_CPU32(CoalescedHeader->SequenceNumber);
+        if ((Eligible == FALSE) ||
+            (Link != Socket->CoalescedLink) ||
+            (SequenceNumber != CoalescedSequence + CoalescedLength) ||
+            (HeaderLength != Coalesced->DataOffset) ||
+            (Header->AcknowledgmentNumber !=
+             CoalescedHeader->AcknowledgmentNumber) ||
+            (Header->WindowSize != CoalescedHeader->WindowSize) ||
+            (RtlCompareMemory(Header + 1,
+                              CoalescedHeader + 1,
+                              HeaderLength - sizeof(TCP_HEADER)) == FALSE) ||
+            ((Coalesced->FooterOffset + DataLength) > Coalesced->BufferSize) ||
+            ((CoalescedLength + DataLength) > Socket->ReceiveWindowFreeSize)) {
+
+            NetpTcpFlushCoalescedPacket(Socket);
+
+        } else {
+            RtlCopyMemory(Coalesced->Buffer + Coalesced->FooterOffset,
+                          Packet->Buffer + Packet->DataOffset,
+                          DataLength);
+
+            Coalesced->FooterOffset += DataLength;
+
+            //
+            // A push means the sender has nothing more to say for now, so
+            // don't make it wait for the end of the batch.
+            //
+
+            if ((Header->Flags & TCP_HEADER_FLAG_PUSH) != 0) {
+                CoalescedHeader->Flags |= TCP_HEADER_FLAG_PUSH;
+                NetpTcpFlushCoalescedPacket(Socket);
+            }
+
+            return TRUE;
+        }
+    }
+
+    //
+    // Start holding the packet if more data is likely to follow it in this
+    // batch. Only data landing right at the next expected sequence with
+    // nothing missing is held, so that the merged packet always lands at the
+    // end of the received data.
+    //
+
+    if ((Eligible == FALSE) ||
+        ((Header->Flags & TCP_HEADER_FLAG_PUSH) != 0) ||
+        (SequenceNumber != Socket->ReceiveNextSequence) ||
+        ((Socket->Flags & TCP_SOCKET_FLAG_RECEIVE_MISSING_SEGMENTS) != 0) ||
+        (HeaderLength + DataLength > TCP_COALESCE_MAX_SIZE) ||
+        (DataLength > Socket->ReceiveWindowFreeSize)) {
+
+        return FALSE;
+    }
+
+    Status = NetAllocateBuffer(HeaderLength,
+                               TCP_COALESCE_MAX_SIZE - HeaderLength,
+                               0,
+                               NULL,
+                               0,
+                               &Coalesced);
+
+    if (!KSUCCESS(Status)) {
+        return FALSE;
+    }
+
+    RtlCopyMemory(Coalesced->Buffer, Header, HeaderLength + DataLength);
+    Coalesced->DataOffset = HeaderLength;
+    Coalesced->FooterOffset = HeaderLength + DataLength;
+    Socket->CoalescedPacket = Coalesced;
+    Socket->CoalescedLink = Link;
+
+    //
+    // Push the socket on the list to be flushed at the end of the batch if it
+    // is not already there. The list holds a reference on the socket.
+    //
+
+    if (Socket->CoalescePending == FALSE) {
+        Socket->CoalescePending = TRUE;
+        IoSocketAddReference(&(Socket->NetSocket.KernelSocket));
+        do {
+            Head = NetTcpCoalesceList;
+            Socket->CoalesceNext = Head;
+            PreviousHead = RtlAtomicCompareExchange(
+                                        (volatile UINTN *)&NetTcpCoalesceList,
+                                        (UINTN)Socket,
+                                        (UINTN)Head);
+
+        } while (PreviousHead != (UINTN)Head);
+    }
+
+    return TRUE;
+}
+
+VOID
+NetpTcpFlushCoalescedPacket (
+    PTCP_SOCKET Socket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine processes and releases the packet a socket is holding for
+    coalescing, if any. The socket stays on the coalesce list until the end of
+    the batch. This routine assumes the socket lock is already held.
+
+Arguments:
+
+    Socket - Supplies a pointer to the TCP socket.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PTCP_HEADER Header;
+    PNET_LINK Link;
+    NETWORK_ADDRESS LocalAddress;
+    PNET_PACKET_BUFFER Packet;
+    NETWORK_ADDRESS RemoteAddress;
+
+    ASSERT(KeIsQueuedLockHeld(Socket->Lock) != FALSE);
+
+    Packet = Socket->CoalescedPacket;
+    if (Packet == NULL) {
+        return;
+    }
+
+    Link = Socket->CoalescedLink;
+    Socket->CoalescedPacket = NULL;
+    Socket->CoalescedLink = NULL;
+
+    //
+    // Only fully bound sockets receive data, so the socket's addresses are
+    // the ones the packet was sent between. Use copies since processing the
+    // packet may change the socket.
+    //
+
+    RtlCopyMemory(&LocalAddress,
+                  &(Socket->NetSocket.LocalAddress),
+                  sizeof(NETWORK_ADDRESS));
+
+    RtlCopyMemory(&RemoteAddress,
+                  &(Socket->NetSocket.RemoteAddress),
+                  sizeof(NETWORK_ADDRESS));
+
+    Header = (PTCP_HEADER)(Packet->Buffer);
+    NetpTcpProcessPacket(Socket,
+                         Link,
+                         Header,
+                         Packet,
+                         &RemoteAddress,
+                         &LocalAddress);
+
+    NetFreeBuffer(Packet);
+    return;
+}
+
 VOID
 NetpTcpHandleUnconnectedPacket (
     PNET_LINK Link,
@@ -5234,7 +5747,8 @@ NetpTcpProcessAcknowledge (
     ULONG AcknowledgeNumber,
     ULONG SequenceNumber,
     ULONG DataLength,
-    USHORT WindowSize
+    USHORT WindowSize,
+    PTCP_PACKET_OPTIONS Options
     )
 
 /*++
@@ -5261,6 +5775,9 @@ Routine Description:
         which may or may not get saved as the new send window. This value is
         expected to be straight from the header, in network order.
 
+    Options - Supplies a pointer to the timestamp and selective acknowledgment
+        options parsed from the packet.
+
 Return Value:
 
     Status code.
@@ -5271,10 +5788,12 @@ Return Value:
 
     BOOL AcknowledgeValid;
     ULONGLONG CurrentTime;
+    BOOL InFastRecovery;
     PIO_OBJECT_STATE IoState;
     ULONG ReceiveWindowEnd;
     ULONG RelativeAcknowledgeNumber;
     ULONG ResetFlags;
+    ULONG RoundTripMilliseconds;
     ULONG ScaledWindowSize;
     BOOL UpdateValid;
 
@@ -5369,6 +5888,31 @@ Return Value:
             }
         }
 
+        //
+        // If this acknowledgment moves the window forward, the echoed
+        // timestamp provides a round trip time sample. Unlike timing
+        // individual segments, this is valid even for retransmitted data.
+        //
+
+        if ((AcknowledgeNumber != Socket->SendUnacknowledgedSequence) &&
+            ((Socket->Flags & TCP_SOCKET_FLAG_TIMESTAMPS) != 0) &&
+            ((Options->Flags & TCP_PACKET_OPTION_FLAG_TIMESTAMP) != 0) &&
+            (Options->TimestampEcho != 0)) {
+
+            RoundTripMilliseconds = NetpTcpGetTimestamp() -
+                                    Options->TimestampEcho;
+
+            if (RoundTripMilliseconds == 0) {
+                RoundTripMilliseconds = 1;
+            }
+
+            NetpTcpProcessNewRoundTripTimeSample(
+                   Socket,
+                   RoundTripMilliseconds * NetTcpTimestampTicksPerMillisecond);
+
+            Socket->TimestampSampleCount += 1;
+        }
+
         Socket->SendUnacknowledgedSequence = AcknowledgeNumber;
         ReceiveWindowEnd = Socket->ReceiveNextSequence +
                            Socket->ReceiveWindowFreeSize;
@@ -5431,10 +5975,20 @@ Return Value:
         }
 
         //
-        // Clean up the send buffer based on this new acknowledgment.
+        // Clean up the send buffer based on this new acknowledgment, and then
+        // mark anything the remote host has selectively acknowledged.
         //
 
         NetpTcpFreeSentSegments(Socket, &CurrentTime);
+        if (TCP_SEQUENCE_LESS_THAN(Socket->SendSelectiveAcknowledgeHigh,
+                                   AcknowledgeNumber)) {
+
+            Socket->SendSelectiveAcknowledgeHigh = AcknowledgeNumber;
+        }
+
+        if (Options->SelectiveAcknowledgeCount != 0) {
+            NetpTcpProcessSelectiveAcknowledgments(Socket, Options);
+        }
 
     //
     // If the ACK is ahead of schedule, take note and send a response.
@@ -5502,11 +6056,22 @@ Return Value:
     }
 
     //
-    // Allow congestion control to process the acknowledgment.
+    // Allow congestion control to process the acknowledgment. If that ends
+    // fast recovery, forget which segments were retransmitted during it.
     //
 
+    InFastRecovery = FALSE;
+    if ((Socket->Flags & TCP_SOCKET_FLAG_IN_FAST_RECOVERY) != 0) {
+        InFastRecovery = TRUE;
+    }
+
     NetpTcpCongestionAcknowledgeReceived(Socket, AcknowledgeNumber);
     Socket->PreviousAcknowledgeNumber = AcknowledgeNumber;
+    if ((InFastRecovery != FALSE) &&
+        ((Socket->Flags & TCP_SOCKET_FLAG_IN_FAST_RECOVERY) == 0)) {
+
+        NetpTcpClearScoreboard(Socket, FALSE);
+    }
 
     //
     // Try to send more data immediately. Do this after the congenstion control
@@ -5593,7 +6158,8 @@ VOID
 NetpTcpProcessPacketOptions (
     PTCP_SOCKET Socket,
     PTCP_HEADER Header,
-    PNET_PACKET_BUFFER Packet
+    PNET_PACKET_BUFFER Packet,
+    PTCP_PACKET_OPTIONS PacketOptions
     )
 
 /*++
@@ -5610,9 +6176,8 @@ Routine Description:
 
     Packet - Supplies a pointer to the received packet information.
 
-    SourceAddress - Supplies a pointer to the source (remote) address that the
-        packet originated from. This memory will not be referenced once the
-        function returns, it can be stack allocated.
+    PacketOptions - Supplies a pointer where the timestamp and selective
+        acknowledgment options found in the packet will be returned.
 
 Return Value:
 
@@ -5622,6 +6187,9 @@ Return Value:
 
 {
 
+    ULONG BlockCount;
+    ULONG BlockIndex;
+    PULONG BlockValues;
     ULONG LocalMaxSegmentSize;
     ULONG OptionIndex;
     UCHAR OptionLength;
@@ -5631,6 +6199,8 @@ Return Value:
     PNET_PACKET_SIZE_INFORMATION SizeInformation;
     BOOL WindowScaleSupported;
 
+    PacketOptions->Flags = 0;
+    PacketOptions->SelectiveAcknowledgeCount = 0;
     WindowScaleSupported = FALSE;
 
     //
@@ -5700,6 +6270,55 @@ Return Value:
                 Socket->SendWindowScale = Options[OptionIndex];
                 WindowScaleSupported = TRUE;
             }
+
+        //
+        // The selective acknowledgment permitted option is only valid on a
+        // SYN.
+        //
+
+        } else if (OptionType == TCP_OPTION_SELECTIVE_ACKNOWLEDGE_PERMITTED) {
+            if (((Header->Flags & TCP_HEADER_FLAG_SYN) != 0) &&
+                (OptionLength == 0)) {
+
+                PacketOptions->Flags |=
+                        TCP_PACKET_OPTION_FLAG_SELECTIVE_ACKNOWLEDGE_PERMITTED;
+            }
+
+        } else if (OptionType == TCP_OPTION_TIMESTAMP) {
+            if (OptionLength == TCP_OPTION_TIMESTAMP_SIZE - 2) {
+                BlockValues = (PULONG)&(Options[OptionIndex]);
+                PacketOptions->TimestampValue =
+                                              NETWORK_TO_CPU32(BlockValues[0]);
+
+                PacketOptions->TimestampEcho = NETWORK_TO_CPU32(BlockValues[1]);
+
+                PacketOptions->Flags |= TCP_PACKET_OPTION_FLAG_TIMESTAMP;
+            }
+
+        //
+        // Collect the selective acknowledgment blocks. They are validated
+        // against the send window when the acknowledgment is processed.
+        //
+
+        } else if (OptionType == TCP_OPTION_SELECTIVE_ACKNOWLEDGE) {
+            BlockCount = OptionLength /
+                         TCP_OPTION_SELECTIVE_ACKNOWLEDGE_BLOCK_SIZE;
+
+            if ((BlockCount * TCP_OPTION_SELECTIVE_ACKNOWLEDGE_BLOCK_SIZE ==
+                 OptionLength) &&
+                (BlockCount <= TCP_MAXIMUM_SELECTIVE_ACKNOWLEDGE_BLOCKS)) {
+
+                BlockValues = (PULONG)&(Options[OptionIndex]);
+                for (BlockIndex = 0; BlockIndex < BlockCount; BlockIndex += 1) {
+                    PacketOptions->Blocks[BlockIndex].LeftEdge =
+                                NETWORK_TO_CPU32(BlockValues[BlockIndex * 2]);
+
+                    PacketOptions->Blocks[BlockIndex].RightEdge =
+                          NETWORK_TO_CPU32(BlockValues[(BlockIndex * 2) + 1]);
+                }
+
+                PacketOptions->SelectiveAcknowledgeCount = BlockCount;
+            }
         }
 
         //
@@ -5732,11 +6351,439 @@ Return Value:
 
             Socket->ReceiveWindowScale = 0;
         }
+
+        //
+        // Selective acknowledgments and timestamps are only used if both
+        // sides asked for them in their SYNs.
+        //
+
+        if ((PacketOptions->Flags &
+             TCP_PACKET_OPTION_FLAG_SELECTIVE_ACKNOWLEDGE_PERMITTED) == 0) {
+
+            Socket->Flags &= ~TCP_SOCKET_FLAG_SELECTIVE_ACKNOWLEDGE;
+        }
+
+        if ((PacketOptions->Flags & TCP_PACKET_OPTION_FLAG_TIMESTAMP) == 0) {
+            Socket->Flags &= ~TCP_SOCKET_FLAG_TIMESTAMPS;
+
+        //
+        // Every segment now carries a timestamp option, so shrink the
+        // segment size to leave room for it.
+        //
+
+        } else if ((Socket->Flags & TCP_SOCKET_FLAG_TIMESTAMPS) != 0) {
+            Socket->TimestampRecent = PacketOptions->TimestampValue;
+            if (Socket->SendMaxSegmentSize > TCP_TIMESTAMP_OPTION_LENGTH) {
+                Socket->SendMaxSegmentSize -= TCP_TIMESTAMP_OPTION_LENGTH;
+            }
+        }
     }
 
     return;
 }
 
+VOID
+NetpTcpProcessSelectiveAcknowledgments (
+    PTCP_SOCKET Socket,
+    PTCP_PACKET_OPTIONS Options
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks the segments covered by the selective acknowledgment
+    blocks of an incoming packet on the send scoreboard. This routine assumes
+    the socket lock is already held.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+    Options - Supplies a pointer to the options parsed from the packet.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PTCP_SELECTIVE_ACKNOWLEDGE_BLOCK Block;
+    ULONG BlockIndex;
+    PLIST_ENTRY CurrentEntry;
+    PTCP_SEND_SEGMENT Segment;
+    ULONG SegmentBegin;
+    ULONG SegmentEnd;
+
+    if ((Socket->Flags & TCP_SOCKET_FLAG_SELECTIVE_ACKNOWLEDGE) == 0) {
+        return;
+    }
+
+    for (BlockIndex = 0;
+         BlockIndex < Options->SelectiveAcknowledgeCount;
+         BlockIndex += 1) {
+
+        Block = &(Options->Blocks[BlockIndex]);
+
+        //
+        // Ignore blocks that are empty, already acknowledged, or cover data
+        // that was never sent.
+        //
+
+        if ((!TCP_SEQUENCE_GREATER_THAN(Block->RightEdge, Block->LeftEdge)) ||
+            (!TCP_SEQUENCE_GREATER_THAN(Block->LeftEdge,
+                                        Socket->SendUnacknowledgedSequence)) ||
+            (TCP_SEQUENCE_GREATER_THAN(Block->RightEdge,
+                                       Socket->SendNextNetworkSequence))) {
+
+            continue;
+        }
+
+        Socket->SelectiveAcknowledgeBlocksReceived += 1;
+        if (TCP_SEQUENCE_GREATER_THAN(Block->RightEdge,
+                                      Socket->SendSelectiveAcknowledgeHigh)) {
+
+            Socket->SendSelectiveAcknowledgeHigh = Block->RightEdge;
+        }
+
+        //
+        // Mark every segment that lies entirely within the block.
+        //
+
+        CurrentEntry = Socket->OutgoingSegmentList.Next;
+        while (CurrentEntry != &(Socket->OutgoingSegmentList)) {
+            Segment = LIST_VALUE(CurrentEntry,
+                                 TCP_SEND_SEGMENT,
+                                 Header.ListEntry);
+
+            CurrentEntry = CurrentEntry->Next;
+            SegmentBegin = Segment->SequenceNumber + Segment->Offset;
+            SegmentEnd = Segment->SequenceNumber + Segment->Length;
+            if (!TCP_SEQUENCE_LESS_THAN(SegmentBegin, Block->RightEdge)) {
+                break;
+            }
+
+            if ((!TCP_SEQUENCE_LESS_THAN(SegmentBegin, Block->LeftEdge)) &&
+                (!TCP_SEQUENCE_GREATER_THAN(SegmentEnd, Block->RightEdge))) {
+
+                Segment->Flags |=
+                                TCP_SEND_SEGMENT_FLAG_SELECTIVELY_ACKNOWLEDGED;
+            }
+        }
+    }
+
+    return;
+}
+
+VOID
+NetpTcpClearScoreboard (
+    PTCP_SOCKET Socket,
+    BOOL ClearAcknowledged
+    )
+
+/*++
+
+Routine Description:
+
+    This routine resets the selective acknowledgment state of the segments
+    waiting to be acknowledged. This routine assumes the socket lock is
+    already held.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+    ClearAcknowledged - Supplies a boolean indicating whether to also forget
+        which segments the remote host selectively acknowledged (TRUE) or only
+        which were retransmitted during fast recovery (FALSE). The remote host
+        is allowed to discard data it selectively acknowledged, so the whole
+        scoreboard is cleared after a retransmission timeout.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    ULONG Mask;
+    PTCP_SEND_SEGMENT Segment;
+
+    Mask = TCP_SEND_SEGMENT_FLAG_RECOVERY_RETRANSMIT;
+    if (ClearAcknowledged != FALSE) {
+        Mask |= TCP_SEND_SEGMENT_FLAG_SELECTIVELY_ACKNOWLEDGED;
+        Socket->SendSelectiveAcknowledgeHigh =
+                                            Socket->SendUnacknowledgedSequence;
+    }
+
+    CurrentEntry = Socket->OutgoingSegmentList.Next;
+    while (CurrentEntry != &(Socket->OutgoingSegmentList)) {
+        Segment = LIST_VALUE(CurrentEntry, TCP_SEND_SEGMENT, Header.ListEntry);
+        CurrentEntry = CurrentEntry->Next;
+        Segment->Flags &= ~Mask;
+    }
+
+    return;
+}
+
+ULONG
+NetpTcpGatherTransmitOptions (
+    PTCP_SOCKET Socket,
+    BOOL Control,
+    PTCP_PACKET_OPTIONS Options
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines which timestamp and selective acknowledgment
+    options should go out on the next packet. This routine assumes the socket
+    lock is already held.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+    Control - Supplies a boolean indicating whether the packet is a control
+        packet (TRUE) or carries data (FALSE). Selective acknowledgment blocks
+        are only sent on control packets.
+
+    Options - Supplies a pointer where the options will be returned.
+
+Return Value:
+
+    Returns the number of bytes the options will take up in the header.
+
+--*/
+
+{
+
+    PTCP_SELECTIVE_ACKNOWLEDGE_BLOCK Block;
+    ULONG BlockIndex;
+    PLIST_ENTRY CurrentEntry;
+    ULONG Index;
+    ULONG LeftEdge;
+    ULONG MaxBlocks;
+    PTCP_RECEIVED_SEGMENT NextSegment;
+    BOOL RecentFound;
+    ULONG RecentSequence;
+    ULONG RightEdge;
+    BOOL RunStarted;
+    PTCP_RECEIVED_SEGMENT Segment;
+    ULONG Size;
+
+    Options->Flags = 0;
+    Options->SelectiveAcknowledgeCount = 0;
+    Size = 0;
+    MaxBlocks = TCP_MAXIMUM_SELECTIVE_ACKNOWLEDGE_BLOCKS;
+    if ((Socket->Flags & TCP_SOCKET_FLAG_TIMESTAMPS) != 0) {
+        Options->Flags |= TCP_PACKET_OPTION_FLAG_TIMESTAMP;
+        Options->TimestampValue = NetpTcpGetTimestamp();
+        Options->TimestampEcho = Socket->TimestampRecent;
+        Size += TCP_TIMESTAMP_OPTION_LENGTH;
+        MaxBlocks -= 1;
+    }
+
+    if ((Control == FALSE) ||
+        ((Socket->Flags & TCP_SOCKET_FLAG_SELECTIVE_ACKNOWLEDGE) == 0) ||
+        ((Socket->Flags & TCP_SOCKET_FLAG_RECEIVE_MISSING_SEGMENTS) == 0)) {
+
+        return Size;
+    }
+
+    //
+    // Describe each contiguous run of data received beyond the next expected
+    // sequence. The first block must be the one containing the most recently
+    // received segment, so slot zero is held for it. The rest go out in
+    // sequence order.
+    //
+
+    RecentFound = FALSE;
+    RecentSequence = Socket->ReceiveRecentSequence;
+    BlockIndex = 1;
+    LeftEdge = 0;
+    RunStarted = FALSE;
+    CurrentEntry = Socket->ReceivedSegmentList.Next;
+    while (CurrentEntry != &(Socket->ReceivedSegmentList)) {
+        Segment = LIST_VALUE(CurrentEntry,
+                             TCP_RECEIVED_SEGMENT,
+                             Header.ListEntry);
+
+        CurrentEntry = CurrentEntry->Next;
+        if (!TCP_SEQUENCE_GREATER_THAN(Segment->SequenceNumber,
+                                       Socket->ReceiveNextSequence)) {
+
+            continue;
+        }
+
+        if (RunStarted == FALSE) {
+            LeftEdge = Segment->SequenceNumber;
+            RunStarted = TRUE;
+        }
+
+        RightEdge = Segment->NextSequence;
+        if (CurrentEntry != &(Socket->ReceivedSegmentList)) {
+            NextSegment = LIST_VALUE(CurrentEntry,
+                                     TCP_RECEIVED_SEGMENT,
+                                     Header.ListEntry);
+
+            if (NextSegment->SequenceNumber == RightEdge) {
+                continue;
+            }
+        }
+
+        //
+        // The run ends here.
+        //
+
+        RunStarted = FALSE;
+        if ((RecentFound == FALSE) &&
+            (!TCP_SEQUENCE_LESS_THAN(RecentSequence, LeftEdge)) &&
+            (TCP_SEQUENCE_LESS_THAN(RecentSequence, RightEdge))) {
+
+            Block = &(Options->Blocks[0]);
+            RecentFound = TRUE;
+
+        } else if (BlockIndex < MaxBlocks) {
+            Block = &(Options->Blocks[BlockIndex]);
+            BlockIndex += 1;
+
+        } else {
+            continue;
+        }
+
+        Block->LeftEdge = LeftEdge;
+        Block->RightEdge = RightEdge;
+    }
+
+    //
+    // If no run contained the recent segment, slide the others down into the
+    // held slot.
+    //
+
+    if (RecentFound == FALSE) {
+        BlockIndex -= 1;
+        for (Index = 0; Index < BlockIndex; Index += 1) {
+            Options->Blocks[Index] = Options->Blocks[Index + 1];
+        }
+    }
+
+    if (BlockIndex != 0) {
+        Options->SelectiveAcknowledgeCount = BlockIndex;
+        Socket->SelectiveAcknowledgeBlocksSent += BlockIndex;
+        Size += TCP_SELECTIVE_ACKNOWLEDGE_OPTION_LENGTH +
+                (BlockIndex * TCP_OPTION_SELECTIVE_ACKNOWLEDGE_BLOCK_SIZE);
+    }
+
+    return Size;
+}
+
+VOID
+NetpTcpWriteTransmitOptions (
+    PTCP_PACKET_OPTIONS Options,
+    PUCHAR Buffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes the timestamp and selective acknowledgment options into
+    an outgoing packet. Each option is preceded by two NOPs to keep its values
+    32-bit aligned.
+
+Arguments:
+
+    Options - Supplies a pointer to the options to write.
+
+    Buffer - Supplies a pointer to the header options area of the packet.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG BlockIndex;
+    PULONG Values;
+
+    if ((Options->Flags & TCP_PACKET_OPTION_FLAG_TIMESTAMP) != 0) {
+        *Buffer = TCP_OPTION_NOP;
+        Buffer += 1;
+        *Buffer = TCP_OPTION_NOP;
+        Buffer += 1;
+        *Buffer = TCP_OPTION_TIMESTAMP;
+        Buffer += 1;
+        *Buffer = TCP_OPTION_TIMESTAMP_SIZE;
+        Buffer += 1;
+        Values = (PULONG)Buffer;
+        Values[0] = CPU_TO_NETWORK32(Options->TimestampValue);
+        Values[1] = CPU_TO_NETWORK32(Options->TimestampEcho);
+        Buffer += 2 * sizeof(ULONG);
+    }
+
+    if (Options->SelectiveAcknowledgeCount != 0) {
+        *Buffer = TCP_OPTION_NOP;
+        Buffer += 1;
+        *Buffer = TCP_OPTION_NOP;
+        Buffer += 1;
+        *Buffer = TCP_OPTION_SELECTIVE_ACKNOWLEDGE;
+        Buffer += 1;
+        *Buffer = TCP_OPTION_SELECTIVE_ACKNOWLEDGE_HEADER_SIZE +
+                  (Options->SelectiveAcknowledgeCount *
+                   TCP_OPTION_SELECTIVE_ACKNOWLEDGE_BLOCK_SIZE);
+
+        Buffer += 1;
+        Values = (PULONG)Buffer;
+        for (BlockIndex = 0;
+             BlockIndex < Options->SelectiveAcknowledgeCount;
+             BlockIndex += 1) {
+
+            Values[BlockIndex * 2] =
+                      CPU_TO_NETWORK32(Options->Blocks[BlockIndex].LeftEdge);
+
+            Values[(BlockIndex * 2) + 1] =
+                      CPU_TO_NETWORK32(Options->Blocks[BlockIndex].RightEdge);
+        }
+    }
+
+    return;
+}
+
+ULONG
+NetpTcpGetTimestamp (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the current value of the TCP timestamp clock, which
+    ticks once per millisecond.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the current timestamp value.
+
+--*/
+
+{
+
+    return (ULONG)(HlQueryTimeCounter() / NetTcpTimestampTicksPerMillisecond);
+}
+
 VOID
 NetpTcpSendControlPacket (
     PTCP_SOCKET Socket,
@@ -5766,6 +6813,8 @@ Return Value:
 
 {
 
+    TCP_PACKET_OPTIONS Options;
+    ULONG OptionsLength;
     PNET_PACKET_BUFFER Packet;
     NET_PACKET_LIST PacketList;
     ULONG SequenceNumber;
@@ -5791,9 +6840,19 @@ Return Value:
         return;
     }
 
+    //
+    // Resets go out bare. Everything else carries a timestamp and, if data
+    // is missing, the selective acknowledgment blocks.
+    //
+
+    OptionsLength = 0;
+    if ((Flags & TCP_HEADER_FLAG_RESET) == 0) {
+        OptionsLength = NetpTcpGatherTransmitOptions(Socket, TRUE, &Options);
+    }
+
     Packet = NULL;
     SizeInformation = &(Socket->NetSocket.PacketSizeInformation);
-    Status = NetAllocateBuffer(SizeInformation->HeaderSize,
+    Status = NetAllocateBuffer(SizeInformation->HeaderSize + OptionsLength,
                                0,
                                SizeInformation->FooterSize,
                                Socket->NetSocket.Link,
@@ -5806,7 +6865,13 @@ Return Value:
 
     NET_ADD_PACKET_TO_LIST(Packet, &PacketList);
 
-    ASSERT(Packet->DataOffset >= sizeof(TCP_HEADER));
+    ASSERT(Packet->DataOffset >= sizeof(TCP_HEADER) + OptionsLength);
+
+    Packet->DataOffset -= OptionsLength;
+    if (OptionsLength != 0) {
+        NetpTcpWriteTransmitOptions(&Options,
+                                    Packet->Buffer + Packet->DataOffset);
+    }
 
     Packet->DataOffset -= sizeof(TCP_HEADER);
 
@@ -5821,7 +6886,13 @@ Return Value:
         Flags &= ~TCP_HEADER_FLAG_KEEP_ALIVE;
     }
 
-    NetpTcpFillOutHeader(Socket, Packet, SequenceNumber, Flags, 0, 0, 0);
+    NetpTcpFillOutHeader(Socket,
+                         Packet,
+                         SequenceNumber,
+                         Flags,
+                         OptionsLength,
+                         0,
+                         0);
 
     //
     // Send this control packet off down the network.
@@ -5885,6 +6956,7 @@ Return Value:
     PLIST_ENTRY CurrentEntry;
     PTCP_RECEIVED_SEGMENT CurrentSegment;
     BOOL DataMissing;
+    ULONG FullSegmentSize;
     BOOL InsertedSegment;
     PIO_OBJECT_STATE IoState;
     ULONG NextSequence;
@@ -5892,6 +6964,7 @@ Return Value:
     ULONG RemainingLength;
     KSTATUS Status;
     BOOL UpdateReceiveNextSequence;
+    ULONG WindowEnd;
 
     IoState = Socket->NetSocket.KernelSocket.IoState;
 
@@ -5903,6 +6976,13 @@ Return Value:
         return;
     }
 
+    //
+    // Remember this segment so the selective acknowledgment block covering
+    // it can be reported first.
+    //
+
+    Socket->ReceiveRecentSequence = SequenceNumber;
+
     if (NetTcpDebugPrintSequenceNumbers != FALSE) {
         NetpTcpPrintSocketEndpoints(Socket, FALSE);
         RtlDebugPrint(" RX Segment %d size %d.\n",
@@ -5993,26 +7073,49 @@ Return Value:
            (&(PreviousSegment->Header.ListEntry) ==
             Socket->ReceivedSegmentList.Previous));
 
-    Status = NetpTcpInsertReceivedDataSegment(Socket,
-                                              PreviousSegment,
-                                              NULL,
-                                              Header,
-                                              &Buffer,
-                                              &SequenceNumber,
-                                              &RemainingLength,
-                                              &InsertedSegment);
+    //
+    // Coalesced packets can carry more data than fits in one segment, so keep
+    // appending segments to the end of the list until it is all in or the
+    // receive window is full. Urgent data is never coalesced, and may leave a
+    // remainder on purpose.
+    //
+
+    WindowEnd = Socket->ReceiveNextSequence + Socket->ReceiveWindowFreeSize;
+
+    while (TRUE) {
+        Status = NetpTcpInsertReceivedDataSegment(Socket,
+                                                  PreviousSegment,
+                                                  NULL,
+                                                  Header,
+                                                  &Buffer,
+                                                  &SequenceNumber,
+                                                  &RemainingLength,
+                                                  &InsertedSegment);
+
+        if (!KSUCCESS(Status)) {
+            goto TcpProcessReceivedDataSegmentEnd;
+        }
 
-    if (!KSUCCESS(Status)) {
-        goto TcpProcessReceivedDataSegmentEnd;
-    }
+        //
+        // Record if something was inserted, indicating that the next sequence
+        // may need to be updated.
+        //
 
-    //
-    // Record if something was inserted, indicating that the next sequence may
-    // need to be updated.
-    //
+        if (InsertedSegment == FALSE) {
+            break;
+        }
 
-    if (InsertedSegment != FALSE) {
         UpdateReceiveNextSequence = TRUE;
+        if ((RemainingLength == 0) ||
+            (!TCP_SEQUENCE_LESS_THAN(SequenceNumber, WindowEnd)) ||
+            ((Header->Flags & TCP_HEADER_FLAG_URGENT) != 0)) {
+
+            break;
+        }
+
+        PreviousSegment = LIST_VALUE(Socket->ReceivedSegmentList.Previous,
+                                     TCP_RECEIVED_SEGMENT,
+                                     Header.ListEntry);
     }
 
 TcpProcessReceivedDataSegmentEnd:
@@ -6099,16 +7202,30 @@ Return Value:
     // The exception is if a FIN came in with this data packet and all the
     // expected data has been seen; the caller will handle sending an ACK in
     // response to the FIN. If the received data came with a PUSH, then always
-    // acknowledge right away, as there's probably not more data coming.
+    // acknowledge right away, as there's probably not more data coming. The
+    // same goes for coalesced packets that already cover two full segments.
     //
 
     if ((DataMissing != FALSE) ||
         ((Header->Flags & TCP_HEADER_FLAG_FIN) == 0) ||
         (Socket->ReceiveNextSequence != (SequenceNumber + RemainingLength))) {
 
+        //
+        // A full-sized segment from a host sending timestamps is smaller by
+        // the size of the option.
+        //
+
+        FullSegmentSize = Socket->ReceiveMaxSegmentSize;
+        if (((Socket->Flags & TCP_SOCKET_FLAG_TIMESTAMPS) != 0) &&
+            (FullSegmentSize > TCP_TIMESTAMP_OPTION_LENGTH)) {
+
+            FullSegmentSize -= TCP_TIMESTAMP_OPTION_LENGTH;
+        }
+
         if ((DataMissing == FALSE) &&
             ((Header->Flags & TCP_HEADER_FLAG_PUSH) == 0) &&
-            (Length >= Socket->ReceiveMaxSegmentSize) &&
+            (Length >= FullSegmentSize) &&
+            (Length < (2 * FullSegmentSize)) &&
             ((Socket->Flags & TCP_SOCKET_FLAG_SEND_ACKNOWLEDGE) == 0)) {
 
             Socket->Flags |= TCP_SOCKET_FLAG_SEND_ACKNOWLEDGE;
@@ -6366,6 +7483,17 @@ Return Value:
         InsertLength = Socket->ReceiveWindowFreeSize;
     }
 
+    //
+    // A single received segment only has room for a maximum sized segment's
+    // worth of data. Coalesced packets can be bigger, and the caller inserts
+    // the rest with further calls.
+    //
+
+    if (InsertLength > Socket->ReceiveMaxSegmentSize) {
+        InsertEnd = InsertBegin + Socket->ReceiveMaxSegmentSize;
+        InsertLength = Socket->ReceiveMaxSegmentSize;
+    }
+
     ASSERT(InsertEnd == (InsertBegin + InsertLength));
 
     if (PreviousSegment != NULL) {
@@ -6577,6 +7705,7 @@ Return Value:
     ULONGLONG LocalCurrentTime;
     PNET_PACKET_BUFFER Packet;
     NET_PACKET_LIST PacketList;
+    PTCP_SEND_SEGMENT RunEndSegment;
     PTCP_SEND_SEGMENT Segment;
     ULONG SegmentBegin;
     KSTATUS Status;
@@ -6694,9 +7823,23 @@ Return Value:
 
             ASSERT(Segment->Offset == 0);
 
-            Packet = NetpTcpCreatePacket(Socket, Segment);
+            //
+            // Try to hand a run of new segments to the link as a single
+            // packet for it to split up. Fall back to a packet per segment.
+            //
+
+            Packet = NetpTcpCreateSegmentationPacket(Socket,
+                                                     Segment,
+                                                     WindowEnd,
+                                                     &RunEndSegment);
+
             if (Packet == NULL) {
-                break;
+                Packet = NetpTcpCreatePacket(Socket, Segment);
+                if (Packet == NULL) {
+                    break;
+                }
+
+                RunEndSegment = Segment;
             }
 
             NET_ADD_PACKET_TO_LIST(Packet, &PacketList);
@@ -6704,27 +7847,38 @@ Return Value:
                 FirstSegment = Segment;
             }
 
-            LastSegment = Segment;
+            LastSegment = RunEndSegment;
+            CurrentEntry = RunEndSegment->Header.ListEntry.Next;
 
             //
-            // Update the next pointer and record the send time.
+            // Update the next pointer and record the send time of each
+            // segment in the packet.
             //
 
-            Socket->SendNextNetworkSequence = Segment->SequenceNumber +
-                                              Segment->Length;
+            while (TRUE) {
+                Socket->SendNextNetworkSequence = Segment->SequenceNumber +
+                                                  Segment->Length;
 
-            if ((Segment->Flags & TCP_SEND_SEGMENT_FLAG_FIN) != 0) {
-                Socket->SendNextNetworkSequence += 1;
-                if (Socket->State == TcpStateCloseWait) {
-                    NetpTcpSetState(Socket, TcpStateLastAcknowledge);
+                if ((Segment->Flags & TCP_SEND_SEGMENT_FLAG_FIN) != 0) {
+                    Socket->SendNextNetworkSequence += 1;
+                    if (Socket->State == TcpStateCloseWait) {
+                        NetpTcpSetState(Socket, TcpStateLastAcknowledge);
 
-                } else {
-                    NetpTcpSetState(Socket, TcpStateFinWait1);
+                    } else {
+                        NetpTcpSetState(Socket, TcpStateFinWait1);
+                    }
+                }
+
+                NetpTcpGetTransmitTimeoutInterval(Socket, Segment);
+                Segment->SendAttemptCount += 1;
+                if (Segment == RunEndSegment) {
+                    break;
                 }
-            }
 
-            NetpTcpGetTransmitTimeoutInterval(Socket, Segment);
-            Segment->SendAttemptCount += 1;
+                Segment = LIST_VALUE(Segment->Header.ListEntry.Next,
+                                     TCP_SEND_SEGMENT,
+                                     Header.ListEntry);
+            }
 
         //
         // This segment has been sent before. Check to see if enough
@@ -6737,6 +7891,18 @@ Return Value:
                 LocalCurrentTime = HlQueryTimeCounter();
             }
 
+            //
+            // Segments the remote host has selectively acknowledged do not
+            // need to be resent. If the remote host reneges on them, the
+            // segments before them will time out and reset the scoreboard.
+            //
+
+            if ((Segment->Flags &
+                 TCP_SEND_SEGMENT_FLAG_SELECTIVELY_ACKNOWLEDGED) != 0) {
+
+                continue;
+            }
+
             if (LocalCurrentTime >=
                 Segment->LastSendTime + Segment->TimeoutInterval) {
 
@@ -6751,6 +7917,9 @@ Return Value:
                 }
 
                 LastSegment = Segment;
+                Socket->TimeoutCount += 1;
+                Socket->RetransmitCount += 1;
+                NetpTcpClearScoreboard(Socket, TRUE);
                 NetpTcpTransmissionTimeout(Socket, Segment);
                 NetpTcpGetTransmitTimeoutInterval(Socket, Segment);
                 Segment->SendAttemptCount += 1;
@@ -6884,6 +8053,9 @@ Return Value:
                 NetpTcpSetState(Socket, TcpStateFinWait1);
             }
         }
+
+    } else {
+        Socket->RetransmitCount += 1;
     }
 
     LastSendTime = Segment->LastSendTime;
@@ -6939,22 +8111,25 @@ Return Value:
 {
 
     USHORT HeaderFlags;
+    TCP_PACKET_OPTIONS Options;
+    ULONG OptionsLength;
     PNET_PACKET_BUFFER Packet;
     ULONG SegmentLength;
     PNET_PACKET_SIZE_INFORMATION SizeInformation;
     KSTATUS Status;
 
     //
-    // Allocate the network buffer.
+    // Allocate the network buffer, leaving room for any options.
     //
 
     SegmentLength = Segment->Length - Segment->Offset;
 
     ASSERT(SegmentLength != 0);
 
+    OptionsLength = NetpTcpGatherTransmitOptions(Socket, FALSE, &Options);
     Packet = NULL;
     SizeInformation = &(Socket->NetSocket.PacketSizeInformation);
-    Status = NetAllocateBuffer(SizeInformation->HeaderSize,
+    Status = NetAllocateBuffer(SizeInformation->HeaderSize + OptionsLength,
                                SegmentLength,
                                SizeInformation->FooterSize,
                                Socket->NetSocket.Link,
@@ -6982,14 +8157,20 @@ Return Value:
                   (PUCHAR)(Segment + 1) + Segment->Offset,
                   SegmentLength);
 
-    ASSERT(Packet->DataOffset >= sizeof(TCP_HEADER));
+    ASSERT(Packet->DataOffset >= sizeof(TCP_HEADER) + OptionsLength);
+
+    Packet->DataOffset -= OptionsLength;
+    if (OptionsLength != 0) {
+        NetpTcpWriteTransmitOptions(&Options,
+                                    Packet->Buffer + Packet->DataOffset);
+    }
 
     Packet->DataOffset -= sizeof(TCP_HEADER);
     NetpTcpFillOutHeader(Socket,
                          Packet,
                          Segment->SequenceNumber + Segment->Offset,
                          HeaderFlags,
-                         0,
+                         OptionsLength,
                          0,
                          SegmentLength);
 
@@ -6997,6 +8178,180 @@ Return Value:
     return Packet;
 }
 
+PNET_PACKET_BUFFER
+NetpTcpCreateSegmentationPacket (
+    PTCP_SOCKET Socket,
+    PTCP_SEND_SEGMENT FirstSegment,
+    ULONG WindowEnd,
+    PTCP_SEND_SEGMENT *LastSegment
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates a single large network packet out of a run of
+    consecutive, never sent TCP segments, which the link splits back into
+    maximum sized segments on the way out. This is only done if the link
+    supports both TCP segmentation and transmit checksum offload.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket involved.
+
+    FirstSegment - Supplies a pointer to the first segment of the run.
+
+    WindowEnd - Supplies the first sequence number beyond the send window.
+        Segments starting at or after this sequence are not included.
+
+    LastSegment - Supplies a pointer where the last segment included in the
+        packet will be returned.
+
+Return Value:
+
+    Returns a pointer to the newly allocated packet buffer on success.
+
+    NULL if the link cannot segment packets, the run only has one segment in
+    it, or the allocation failed. The caller should fall back to creating a
+    packet for the first segment alone.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PUCHAR Data;
+    USHORT HeaderFlags;
+    PNET_LINK Link;
+    ULONG MaxDataSize;
+    PTCP_SEND_SEGMENT NextSegment;
+    TCP_PACKET_OPTIONS Options;
+    ULONG OptionsLength;
+    PNET_PACKET_BUFFER Packet;
+    PTCP_SEND_SEGMENT Segment;
+    ULONG SegmentCount;
+    ULONG Size;
+    PNET_PACKET_SIZE_INFORMATION SizeInformation;
+    KSTATUS Status;
+
+    *LastSegment = FirstSegment;
+    Link = Socket->NetSocket.Link;
+    if (((Link->Properties.OffloadFlags &
+          NET_LINK_OFFLOAD_FLAG_TRANSMIT_TCP_SEGMENTATION) == 0) ||
+        ((Link->Properties.ChecksumFlags &
+          NET_LINK_CHECKSUM_FLAG_TRANSMIT_TCP_OFFLOAD) == 0)) {
+
+        return NULL;
+    }
+
+    ASSERT((FirstSegment->SendAttemptCount == 0) &&
+           (FirstSegment->Offset == 0));
+
+    OptionsLength = NetpTcpGatherTransmitOptions(Socket, FALSE, &Options);
+    SizeInformation = &(Socket->NetSocket.PacketSizeInformation);
+    MaxDataSize = NET_SEGMENTATION_MAX_SIZE - SizeInformation->HeaderSize -
+                  OptionsLength;
+
+    //
+    // Gather up the run. Every segment but the last must be full sized, since
+    // the link cuts the data at fixed intervals, and only the last one may
+    // carry a FIN. Urgent data is left to go out on its own.
+    //
+
+    Segment = FirstSegment;
+    Size = Segment->Length;
+    SegmentCount = 1;
+    CurrentEntry = Segment->Header.ListEntry.Next;
+    while (CurrentEntry != &(Socket->OutgoingSegmentList)) {
+        if ((Segment->Length != Socket->SendMaxSegmentSize) ||
+            ((Segment->Flags & TCP_SEND_SEGMENT_FLAG_FIN) != 0) ||
+            ((Segment->Flags & TCP_SEND_SEGMENT_FLAG_URGENT) != 0)) {
+
+            break;
+        }
+
+        NextSegment = LIST_VALUE(CurrentEntry,
+                                 TCP_SEND_SEGMENT,
+                                 Header.ListEntry);
+
+        if ((NextSegment->SendAttemptCount != 0) ||
+            (NextSegment->SequenceNumber !=
+             Segment->SequenceNumber + Segment->Length) ||
+            (!TCP_SEQUENCE_LESS_THAN(NextSegment->SequenceNumber, WindowEnd)) ||
+            ((NextSegment->Flags & TCP_SEND_SEGMENT_FLAG_URGENT) != 0) ||
+            ((Size + NextSegment->Length) > MaxDataSize)) {
+
+            break;
+        }
+
+        Segment = NextSegment;
+        Size += Segment->Length;
+        SegmentCount += 1;
+        CurrentEntry = CurrentEntry->Next;
+    }
+
+    if (SegmentCount == 1) {
+        return NULL;
+    }
+
+    Packet = NULL;
+    Status = NetAllocateBuffer(SizeInformation->HeaderSize + OptionsLength,
+                               Size,
+                               SizeInformation->FooterSize,
+                               Link,
+                               0,
+                               &Packet);
+
+    if (!KSUCCESS(Status)) {
+
+        ASSERT(Packet == NULL);
+
+        return NULL;
+    }
+
+    //
+    // Copy the data from each segment. The header takes its flags from the
+    // last segment, as the link only puts FIN and PUSH on the final piece.
+    //
+
+    *LastSegment = Segment;
+    HeaderFlags = Segment->Flags & TCP_SEND_SEGMENT_HEADER_FLAG_MASK;
+    Data = Packet->Buffer + Packet->DataOffset;
+    Segment = FirstSegment;
+    while (TRUE) {
+        RtlCopyMemory(Data, Segment + 1, Segment->Length);
+        Data += Segment->Length;
+        if (Segment == *LastSegment) {
+            break;
+        }
+
+        Segment = LIST_VALUE(Segment->Header.ListEntry.Next,
+                             TCP_SEND_SEGMENT,
+                             Header.ListEntry);
+    }
+
+    ASSERT(Packet->DataOffset >= sizeof(TCP_HEADER) + OptionsLength);
+
+    Packet->DataOffset -= OptionsLength;
+    if (OptionsLength != 0) {
+        NetpTcpWriteTransmitOptions(&Options,
+                                    Packet->Buffer + Packet->DataOffset);
+    }
+
+    Packet->DataOffset -= sizeof(TCP_HEADER);
+    NetpTcpFillOutHeader(Socket,
+                         Packet,
+                         FirstSegment->SequenceNumber,
+                         HeaderFlags,
+                         OptionsLength,
+                         0,
+                         Size);
+
+    Packet->Flags |= NET_PACKET_FLAG_TCP_SEGMENTATION;
+    Packet->SegmentSize = Socket->SendMaxSegmentSize;
+    return Packet;
+}
+
 VOID
 NetpTcpFreeSentSegments (
     PTCP_SOCKET Socket,
@@ -7055,11 +8410,13 @@ Return Value:
             //
             // If the remote host is acknowledging exactly this segment, then
             // let congestion control know that there's a new round trip time
-            // in the house.
+            // in the house. Sockets using timestamps take their samples from
+            // the echoed timestamps instead.
             //
 
             if ((AcknowledgeNumber == SegmentEnd) &&
-                (Segment->SendAttemptCount == 1)) {
+                (Segment->SendAttemptCount == 1) &&
+                ((Socket->Flags & TCP_SOCKET_FLAG_TIMESTAMPS) == 0)) {
 
                 if (*CurrentTime == 0) {
                     *CurrentTime = HlQueryTimeCounter();
@@ -7613,6 +8970,7 @@ Return Value:
             } else {
                 LIST_REMOVE(&(Socket->ListEntry));
                 Socket->ListEntry.Next = NULL;
+                NetpTcpCancelTimer(Socket);
             }
 
             KeReleaseQueuedLock(NetTcpSocketListLock);
@@ -7640,6 +8998,7 @@ Return Value:
 
             LIST_REMOVE(&(Socket->ListEntry));
             Socket->ListEntry.Next = NULL;
+            NetpTcpCancelTimer(Socket);
         }
 
         //
@@ -7720,6 +9079,7 @@ Return Value:
     ULONG NetworkProtocol;
     PIO_HANDLE NewIoHandle;
     PTCP_SOCKET NewTcpSocket;
+    TCP_PACKET_OPTIONS Options;
     ULONG RemoteSequence;
     ULONG ResetFlags;
     ULONG ResetSequenceNumber;
@@ -7830,13 +9190,15 @@ Return Value:
     }
 
     NewTcpSocket->LingerTimeout = ListeningSocket->LingerTimeout;
+    NetpTcpCongestionSetAlgorithm(NewTcpSocket,
+                                  ListeningSocket->CongestionAlgorithm);
 
     //
     // Re-parse any options coming from the SYN packet and set up the sequence
     // numbers.
     //
 
-    NetpTcpProcessPacketOptions(NewTcpSocket, Header, Packet);
+    NetpTcpProcessPacketOptions(NewTcpSocket, Header, Packet, &Options);
     RemoteSequence = NETWORK_TO_CPU32(Header->SequenceNumber);
     NewTcpSocket->ReceiveInitialSequence = RemoteSequence;
     NewTcpSocket->ReceiveNextSequence = RemoteSequence + 1;
@@ -8206,6 +9568,7 @@ Return Value:
     ULONG DataSize;
     ULONG MaximumSegmentSize;
     PNET_SOCKET NetSocket;
+    TCP_PACKET_OPTIONS Options;
     PNET_PACKET_BUFFER Packet;
     PUCHAR PacketBuffer;
     NET_PACKET_LIST PacketList;
@@ -8218,6 +9581,15 @@ Return Value:
         DataSize += TCP_OPTION_WINDOW_SCALE_SIZE + TCP_OPTION_NOP_SIZE;
     }
 
+    if ((Socket->Flags & TCP_SOCKET_FLAG_SELECTIVE_ACKNOWLEDGE) != 0) {
+        DataSize += (2 * TCP_OPTION_NOP_SIZE) +
+                    TCP_OPTION_SELECTIVE_ACKNOWLEDGE_PERMITTED_SIZE;
+    }
+
+    if ((Socket->Flags & TCP_SOCKET_FLAG_TIMESTAMPS) != 0) {
+        DataSize += TCP_TIMESTAMP_OPTION_LENGTH;
+    }
+
     //
     // Allocate the SYN packet that will kick things off with the remote host.
     //
@@ -8283,6 +9655,34 @@ Return Value:
         PacketBuffer += 1;
     }
 
+    //
+    // Offer selective acknowledgments, padded out to a 32-bit boundary.
+    //
+
+    if ((Socket->Flags & TCP_SOCKET_FLAG_SELECTIVE_ACKNOWLEDGE) != 0) {
+        *PacketBuffer = TCP_OPTION_NOP;
+        PacketBuffer += 1;
+        *PacketBuffer = TCP_OPTION_NOP;
+        PacketBuffer += 1;
+        *PacketBuffer = TCP_OPTION_SELECTIVE_ACKNOWLEDGE_PERMITTED;
+        PacketBuffer += 1;
+        *PacketBuffer = TCP_OPTION_SELECTIVE_ACKNOWLEDGE_PERMITTED_SIZE;
+        PacketBuffer += 1;
+    }
+
+    //
+    // Offer timestamps. On a SYN+ACK this echoes the remote host's value.
+    //
+
+    if ((Socket->Flags & TCP_SOCKET_FLAG_TIMESTAMPS) != 0) {
+        Options.Flags = TCP_PACKET_OPTION_FLAG_TIMESTAMP;
+        Options.TimestampValue = NetpTcpGetTimestamp();
+        Options.TimestampEcho = Socket->TimestampRecent;
+        Options.SelectiveAcknowledgeCount = 0;
+        NetpTcpWriteTransmitOptions(&Options, PacketBuffer);
+        PacketBuffer += TCP_TIMESTAMP_OPTION_LENGTH;
+    }
+
     //
     // Add the TCP header and send this packet down the wire. Remember that the
     // semantics of the ACK flag are different for the function below, so by
@@ -8332,8 +9732,9 @@ NetpTcpTimerAddReference (
 
 Routine Description:
 
-    This routine increments the reference count on the TCP timer, ensuring that
-    it runs.
+    This routine increments the socket's reference count on the TCP timer,
+    ensuring the TCP worker looks at the socket on every timer tick until the
+    reference is released.
 
 Arguments:
 
@@ -8348,43 +9749,25 @@ Return Value:
 
 {
 
-    ULONG OldReferenceCount;
-
-    //
-    // Increment the reference count in the socket. If it's already got
-    // references, no action is needed on the global count.
-    //
-
     Socket->TimerReferenceCount += 1;
 
     ASSERT((Socket->TimerReferenceCount > 0) &&
            (Socket->TimerReferenceCount < TCP_TIMER_MAX_REFERENCE));
 
-    if (Socket->TimerReferenceCount > 1) {
-        return;
-    }
-
     //
-    // This is the first reference the socket is taking on the global timer.
-    // Incremement the reference count of the global timer, and maybe queue it.
+    // Make sure the worker gets to the socket on the next tick, even if it
+    // already holds a reference and is scheduled for a later deadline, such
+    // as a retransmit timeout. Whatever this reference is for (a delayed
+    // acknowledge or a FIN, for instance) needs to go out promptly. From then
+    // on the worker keeps rescheduling the socket while the reference is
+    // held.
     //
 
-    OldReferenceCount = RtlAtomicAdd32(&NetTcpTimerReferenceCount, 1);
-
-    ASSERT(OldReferenceCount < TCP_TIMER_MAX_REFERENCE);
-
-    if (OldReferenceCount == 0) {
-        if (NetTcpDebugPrintSequenceNumbers != FALSE) {
-            RtlDebugPrint("TCP: Enabled periodic timer.\n");
-        }
-
-        NetpTcpQueueTcpTimer();
-    }
-
+    NetpTcpScheduleTimer(Socket, 0);
     return;
 }
 
-ULONG
+VOID
 NetpTcpTimerReleaseReference (
     PTCP_SOCKET Socket
     )
@@ -8393,151 +9776,130 @@ NetpTcpTimerReleaseReference (
 
 Routine Description:
 
-    This routine decrements the reference count on the TCP timer, canceling it
-    if no one else is using it.
+    This routine decrements the socket's reference count on the TCP timer. The
+    socket stays in the timing wheel until its current deadline, at which
+    point the worker works out whether it still needs attention.
 
 Arguments:
 
-    Socket - Supplies an optional pointer to the socket that is releasing the
-        timer reference.
+    Socket - Supplies a pointer to the socket that is releasing the timer
+        reference. This routine assumes the TCP lock is already held.
 
 Return Value:
 
-    Returns the old reference count on the TCP timer. The return value should
-    only be observed if the socket parameter is NULL.
+    None.
 
 --*/
 
 {
 
-    ULONG OldReferenceCount;
-
-    if (Socket != NULL) {
-
-        ASSERT((Socket->TimerReferenceCount > 0) &&
-               (Socket->TimerReferenceCount < TCP_TIMER_MAX_REFERENCE));
-
-        Socket->TimerReferenceCount -= 1;
-        if (Socket->TimerReferenceCount != 0) {
-            return Socket->TimerReferenceCount;
-        }
-    }
-
-    OldReferenceCount = RtlAtomicAdd32(&NetTcpTimerReferenceCount, (ULONG)-1);
-
-    ASSERT((OldReferenceCount != 0) &&
-           (OldReferenceCount < TCP_TIMER_MAX_REFERENCE));
+    ASSERT((Socket->TimerReferenceCount > 0) &&
+           (Socket->TimerReferenceCount < TCP_TIMER_MAX_REFERENCE));
 
-    return OldReferenceCount;
+    Socket->TimerReferenceCount -= 1;
+    return;
 }
 
-VOID
-NetpTcpQueueTcpTimer (
-    VOID
+ULONGLONG
+NetpTcpGetTimerDueTime (
+    PTCP_SOCKET Socket
     )
 
 /*++
 
 Routine Description:
 
-    This routine queues the TCP timer.
+    This routine determines when the TCP worker next needs to look at the
+    given socket.
 
 Arguments:
 
-    None.
+    Socket - Supplies a pointer to the socket. This routine assumes the TCP
+        lock is already held.
 
 Return Value:
 
-    None.
+    Returns the time counter value at which the socket next needs attention.
+    Zero means the next timer tick.
+
+    MAX_ULONGLONG if the socket does not need the timer.
 
 --*/
 
 {
 
+    PLIST_ENTRY CurrentEntry;
     ULONGLONG DueTime;
-    KSTATUS Status;
-
-    ASSERT(KeGetRunLevel() == RunLevelLow);
+    ULONG Flags;
+    PTCP_SEND_SEGMENT Segment;
+    ULONGLONG SegmentDueTime;
 
     //
-    // Add a reference for the TCP worker and queue the timer.
+    // A pending acknowledge or FIN goes out on the next tick.
     //
 
-    RtlAtomicAdd32(&NetTcpTimerReferenceCount, 1);
-    DueTime = KeGetRecentTimeCounter();
-    DueTime += NetTcpTimerPeriod;
-    Status = KeQueueTimer(NetTcpTimer,
-                          TimerQueueSoftWake,
-                          DueTime,
-                          0,
-                          0,
-                          NULL);
+    Flags = Socket->Flags;
+    if (((Flags & TCP_SOCKET_FLAG_SEND_ACKNOWLEDGE) != 0) ||
+        (((Flags & TCP_SOCKET_FLAG_SEND_FINAL_SEQUENCE_VALID) != 0) &&
+         ((Flags & TCP_SOCKET_FLAG_SEND_FIN_WITH_DATA) == 0))) {
 
-    if (!KSUCCESS(Status)) {
-        RtlDebugPrint("Error: Failed to queue TCP timer: %d\n", Status);
+        return 0;
     }
 
-    return;
-}
-
-VOID
-NetpTcpArmKeepAliveTimer (
-    ULONGLONG DueTime
-    )
-
-/*++
-
-Routine Description:
+    DueTime = MAX_ULONGLONG;
+    if (Socket->State == TcpStateTimeWait) {
+        DueTime = Socket->TimeoutEnd + 1;
 
-    This routine arms or re-arms the keep alive timer to the given due time if
-    it is less than the current due time.
+    } else if (TCP_IS_SYN_RETRY_STATE(Socket->State) ||
+               (((Flags & TCP_SOCKET_FLAG_SEND_FIN_WITH_DATA) == 0) &&
+                TCP_IS_FIN_RETRY_STATE(Socket->State))) {
 
-Arguments:
+        DueTime = Socket->TimeoutEnd + 1;
+        if (Socket->RetryTime < DueTime) {
+            DueTime = Socket->RetryTime;
+        }
 
-    DueTime - Supplies the value of the time tick counter when the keep alive
-        timer should expire.
+    } else if (((Flags & TCP_SOCKET_FLAG_KEEP_ALIVE) != 0) &&
+               TCP_IS_KEEP_ALIVE_STATE(Socket->State)) {
 
-Return Value:
+        DueTime = Socket->KeepAliveTime;
+    }
 
-    None.
+    //
+    // Sent segments need attention when their retransmit timeouts expire.
+    // Segments that have never been sent are waiting on the send window, so
+    // poll those every tick.
+    //
 
---*/
+    CurrentEntry = Socket->OutgoingSegmentList.Next;
+    while (CurrentEntry != &(Socket->OutgoingSegmentList)) {
+        Segment = LIST_VALUE(CurrentEntry, TCP_SEND_SEGMENT, Header.ListEntry);
+        CurrentEntry = CurrentEntry->Next;
+        if (Segment->SendAttemptCount == 0) {
+            return 0;
+        }
 
-{
+        if ((Segment->Flags &
+             TCP_SEND_SEGMENT_FLAG_SELECTIVELY_ACKNOWLEDGED) != 0) {
 
-    ULONGLONG CurrentDueTime;
-    KSTATUS Status;
+            continue;
+        }
 
-    ASSERT(KeGetRunLevel() == RunLevelLow);
+        SegmentDueTime = Segment->LastSendTime + Segment->TimeoutInterval;
+        if (SegmentDueTime < DueTime) {
+            DueTime = SegmentDueTime;
+        }
+    }
 
     //
-    // If the timer's current due time is 0 (not queued) or greater than the
-    // requested due time, cancel the timer and re-queue it.
+    // Any other holder of a timer reference expects to be polled.
     //
 
-    KeAcquireQueuedLock(NetTcpKeepAliveTimerLock);
-    CurrentDueTime = KeGetTimerDueTime(NetTcpKeepAliveTimer);
-    if ((CurrentDueTime == 0) || (CurrentDueTime > DueTime)) {
-        if (NetTcpDebugPrintSequenceNumbers != FALSE) {
-            RtlDebugPrint("TCP: Arming keep alive timer.\n");
-        }
-
-        KeCancelTimer(NetTcpKeepAliveTimer);
-        Status = KeQueueTimer(NetTcpKeepAliveTimer,
-                              TimerQueueSoftWake,
-                              DueTime,
-                              0,
-                              0,
-                              NULL);
-
-        if (!KSUCCESS(Status)) {
-            RtlDebugPrint("Error: Failed to queue TCP keep alive timer: %d\n",
-                          Status);
-        }
+    if ((DueTime == MAX_ULONGLONG) && (Socket->TimerReferenceCount != 0)) {
+        DueTime = 0;
     }
 
-    KeReleaseQueuedLock(NetTcpKeepAliveTimerLock);
-    return;
+    return DueTime;
 }
 
 KSTATUS
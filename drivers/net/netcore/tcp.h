@@ -127,7 +127,7 @@ Module Name:
 #define TCP_ROUND_TRIP_SAMPLE_DENOMINATOR 16
 
 //
-// Define TCP's periodic timer interval, in microseconds.
+// Define the length of a TCP timing wheel tick, in microseconds.
 //
 
 #define TCP_TIMER_PERIOD (250 * MICROSECONDS_PER_MILLISECOND)
@@ -160,6 +160,21 @@ Module Name:
 
 #define TCP_DUPLICATE_ACK_THRESHOLD 3
 
+//
+// Define the congestion control algorithm new sockets use unless the default
+// is changed.
+//
+
+#define TCP_DEFAULT_CONGESTION_ALGORITHM SocketTcpCongestionCubic
+
+//
+// Define the CUBIC multiplicative decrease factor and scaling constant, both
+// expressed in tenths.
+//
+
+#define TCP_CUBIC_BETA_TENTHS 7
+#define TCP_CUBIC_C_TENTHS 4
+
 //
 // Define the default receive minimum size, in bytes.
 //
@@ -184,6 +199,14 @@ Module Name:
 
 #define TCP_DEFAULT_WINDOW_SIZE (64 * _1KB)
 
+//
+// Define the maximum size of a packet assembled by merging received segments,
+// including its header. This keeps the held packet within the largest size
+// the packet buffer cache recycles.
+//
+
+#define TCP_COALESCE_MAX_SIZE (16 * _1KB)
+
 //
 // Define the default window scale.
 //
@@ -273,10 +296,13 @@ Module Name:
 // Define the TCP option types.
 //
 
-#define TCP_OPTION_END                  0
-#define TCP_OPTION_NOP                  1
-#define TCP_OPTION_MAXIMUM_SEGMENT_SIZE 2
-#define TCP_OPTION_WINDOW_SCALE         3
+#define TCP_OPTION_END                               0
+#define TCP_OPTION_NOP                               1
+#define TCP_OPTION_MAXIMUM_SEGMENT_SIZE              2
+#define TCP_OPTION_WINDOW_SCALE                      3
+#define TCP_OPTION_SELECTIVE_ACKNOWLEDGE_PERMITTED   4
+#define TCP_OPTION_SELECTIVE_ACKNOWLEDGE             5
+#define TCP_OPTION_TIMESTAMP                         8
 
 //
 // Define TCP option sizes.
@@ -285,6 +311,29 @@ Module Name:
 #define TCP_OPTION_NOP_SIZE 1
 #define TCP_OPTION_MSS_SIZE 4
 #define TCP_OPTION_WINDOW_SCALE_SIZE 3
+#define TCP_OPTION_SELECTIVE_ACKNOWLEDGE_PERMITTED_SIZE 2
+#define TCP_OPTION_SELECTIVE_ACKNOWLEDGE_HEADER_SIZE 2
+#define TCP_OPTION_SELECTIVE_ACKNOWLEDGE_BLOCK_SIZE 8
+#define TCP_OPTION_TIMESTAMP_SIZE 10
+
+//
+// Define the space taken up by the timestamp option and by the header of the
+// selective acknowledgment option, each of which is preceded by two NOPs to
+// keep the fields 32-bit aligned.
+//
+
+#define TCP_TIMESTAMP_OPTION_LENGTH \
+    ((2 * TCP_OPTION_NOP_SIZE) + TCP_OPTION_TIMESTAMP_SIZE)
+
+#define TCP_SELECTIVE_ACKNOWLEDGE_OPTION_LENGTH \
+    ((2 * TCP_OPTION_NOP_SIZE) + TCP_OPTION_SELECTIVE_ACKNOWLEDGE_HEADER_SIZE)
+
+//
+// Define the maximum number of selective acknowledgment blocks that fit in a
+// header. Only three fit if timestamps are also in use.
+//
+
+#define TCP_MAXIMUM_SELECTIVE_ACKNOWLEDGE_BLOCKS 4
 
 //
 // Define the TCP receive segment flags. The first six bits matche up with the
@@ -325,6 +374,16 @@ Module Name:
      TCP_SEND_SEGMENT_FLAG_ACKNOWLEDGE |        \
      TCP_SEND_SEGMENT_FLAG_URGENT)
 
+//
+// The remaining send segment flags track the segment on the selective
+// acknowledgment scoreboard. One marks a segment the remote host reported as
+// received, the other a segment retransmitted during the current fast
+// recovery.
+//
+
+#define TCP_SEND_SEGMENT_FLAG_SELECTIVELY_ACKNOWLEDGED 0x00000100
+#define TCP_SEND_SEGMENT_FLAG_RECOVERY_RETRANSMIT      0x00000200
+
 //
 // Define the TCP socket flags.
 //
@@ -341,6 +400,15 @@ Module Name:
 #define TCP_SOCKET_FLAG_RECEIVE_MISSING_SEGMENTS     0x00000200
 #define TCP_SOCKET_FLAG_NO_DELAY                     0x00000400
 #define TCP_SOCKET_FLAG_WINDOW_SCALING               0x00000800
+#define TCP_SOCKET_FLAG_SELECTIVE_ACKNOWLEDGE        0x00001000
+#define TCP_SOCKET_FLAG_TIMESTAMPS                   0x00002000
+
+//
+// Define the flags for parsed TCP packet options.
+//
+
+#define TCP_PACKET_OPTION_FLAG_TIMESTAMP                     0x00000001
+#define TCP_PACKET_OPTION_FLAG_SELECTIVE_ACKNOWLEDGE_PERMITTED 0x00000002
 
 //
 // ------------------------------------------------------ Data Type Definitions
@@ -417,6 +485,53 @@ typedef enum _TCP_STATE {
 
 /*++
 
+Structure Description:
+
+    This structure stores the per-socket state of the CUBIC congestion control
+    algorithm. Times are in milliseconds on the TCP timestamp clock.
+
+Members:
+
+    WindowMax - Stores the congestion window, in bytes, just before the last
+        window reduction.
+
+    EpochWindow - Stores the congestion window, in bytes, at the start of the
+        current congestion avoidance epoch.
+
+    EpochStart - Stores the time the current congestion avoidance epoch began,
+        or zero if no epoch is in progress.
+
+    PeakTime - Stores the time, relative to the epoch start, at which the
+        cubic function reaches the maximum window again.
+
+--*/
+
+typedef struct _TCP_CUBIC_STATE {
+    ULONG WindowMax;
+    ULONG EpochWindow;
+    ULONG EpochStart;
+    ULONG PeakTime;
+} TCP_CUBIC_STATE, *PTCP_CUBIC_STATE;
+
+/*++
+
+Structure Description:
+
+    This union stores the per-socket state of whichever congestion control
+    algorithm the socket uses.
+
+Members:
+
+    Cubic - Stores the CUBIC state.
+
+--*/
+
+typedef union _TCP_CONGESTION_STATE {
+    TCP_CUBIC_STATE Cubic;
+} TCP_CONGESTION_STATE, *PTCP_CONGESTION_STATE;
+
+/*++
+
 Structure Description:
 
     This structure defines a TCP data socket.
@@ -433,9 +548,8 @@ Structure Description:
     Flags - Stores a bitmask of TCP flags. See TCP_SOCKET_FLAG_* for
         definitions.
 
-    TimerReferenceCount - Supplies the reference count on the global TCP timer.
-        If this value is non-zero, there is a single reference on the global
-        TCP timer.
+    TimerReferenceCount - Supplies the number of reasons the socket needs
+        the TCP worker to look at it on every timer tick.
 
     SendInitialSequence - Stores the random offset that the sequence numbers
         started at for this socket.
@@ -532,6 +646,11 @@ Structure Description:
     IncomingConnectionCount - Stores the number of elements that are on the
         incoming connection list.
 
+    CongestionAlgorithm - Stores the congestion control algorithm in use by
+        the socket.
+
+    CongestionState - Stores the algorithm specific congestion control state.
+
     SlowStartThreshold - Stores the threshold value for the congestion window.
         If the congestion window size is less than or equal to this value, then
         Slow Start is used. Otherwise, Congestion Avoidance is used.
@@ -595,6 +714,56 @@ Structure Description:
     SegmentAllocationSize - Stores the allocation size for each of the send and
         receive TCP segments, including enough size for the header and data.
 
+    TimestampRecent - Stores the most recent timestamp value received from the
+        remote host, which is echoed back in outgoing timestamp options.
+
+    SendSelectiveAcknowledgeHigh - Stores the highest sequence number the
+        remote host has reported as received via a selective acknowledgment
+        block.
+
+    ReceiveRecentSequence - Stores the starting sequence number of the most
+        recently received data segment. This is used to order the outgoing
+        selective acknowledgment blocks.
+
+    RetransmitCount - Stores the total number of segments retransmitted.
+
+    SelectiveRetransmitCount - Stores the number of retransmissions chosen
+        using the selective acknowledgment scoreboard.
+
+    TimeoutCount - Stores the number of retransmission timeouts that have
+        expired.
+
+    SelectiveAcknowledgeBlocksReceived - Stores the number of valid selective
+        acknowledgment blocks received from the remote host.
+
+    SelectiveAcknowledgeBlocksSent - Stores the number of selective
+        acknowledgment blocks sent to the remote host.
+
+    TimestampSampleCount - Stores the number of round trip time samples taken
+        from echoed timestamps.
+
+    CoalescedPacket - Stores an optional pointer to a received packet being
+        held while consecutive in-order segments from the same batch are
+        merged into it. The TCP header sits at the beginning of the buffer.
+
+    CoalescedLink - Stores a pointer to the link the coalesced packet was
+        received on.
+
+    CoalesceNext - Stores a pointer to the next socket on the global list of
+        sockets to flush at the end of the receive batch.
+
+    CoalescePending - Stores a boolean indicating whether the socket is on
+        the global list of sockets to flush. This is protected by the socket
+        lock.
+
+    TimerListEntry - Stores pointers to the next and previous sockets in the
+        same slot of the TCP timing wheel, or on its expired list. The next
+        pointer is NULL if the socket is not scheduled.
+
+    TimerTick - Stores the timing wheel tick at which the socket next needs
+        attention from the TCP worker. This is only valid while the socket is
+        scheduled.
+
 --*/
 
 typedef struct _TCP_SOCKET {
@@ -633,6 +802,8 @@ typedef struct _TCP_SOCKET {
     LIST_ENTRY FreeSegmentList;
     LIST_ENTRY IncomingConnectionList;
     ULONG IncomingConnectionCount;
+    SOCKET_TCP_CONGESTION_ALGORITHM CongestionAlgorithm;
+    TCP_CONGESTION_STATE CongestionState;
     ULONG SlowStartThreshold;
     ULONG CongestionWindowSize;
     ULONG FastRecoveryEndSequence;
@@ -651,6 +822,21 @@ typedef struct _TCP_SOCKET {
     ULONG ShutdownTypes;
     LONG OutOfBandData;
     ULONG SegmentAllocationSize;
+    ULONG TimestampRecent;
+    ULONG SendSelectiveAcknowledgeHigh;
+    ULONG ReceiveRecentSequence;
+    ULONGLONG RetransmitCount;
+    ULONGLONG SelectiveRetransmitCount;
+    ULONGLONG TimeoutCount;
+    ULONGLONG SelectiveAcknowledgeBlocksReceived;
+    ULONGLONG SelectiveAcknowledgeBlocksSent;
+    ULONGLONG TimestampSampleCount;
+    PNET_PACKET_BUFFER CoalescedPacket;
+    PNET_LINK CoalescedLink;
+    struct _TCP_SOCKET *CoalesceNext;
+    BOOL CoalescePending;
+    LIST_ENTRY TimerListEntry;
+    ULONGLONG TimerTick;
 } TCP_SOCKET, *PTCP_SOCKET;
 
 /*++
@@ -769,6 +955,169 @@ typedef struct _TCP_SEND_SEGMENT {
 
 /*++
 
+Structure Description:
+
+    This structure stores a single selective acknowledgment block, describing
+    a contiguous range of data received by the remote host.
+
+Members:
+
+    LeftEdge - Stores the first sequence number of the block.
+
+    RightEdge - Stores the sequence number immediately following the last
+        sequence number of the block.
+
+--*/
+
+typedef struct _TCP_SELECTIVE_ACKNOWLEDGE_BLOCK {
+    ULONG LeftEdge;
+    ULONG RightEdge;
+} TCP_SELECTIVE_ACKNOWLEDGE_BLOCK, *PTCP_SELECTIVE_ACKNOWLEDGE_BLOCK;
+
+/*++
+
+Structure Description:
+
+    This structure stores the timestamp and selective acknowledgment options
+    parsed out of an incoming packet, or gathered for an outgoing one.
+
+Members:
+
+    Flags - Stores a bitmask of flags. See TCP_PACKET_OPTION_FLAG_* for
+        definitions.
+
+    TimestampValue - Stores the timestamp value of the sender. This is only
+        valid if the timestamp flag is set.
+
+    TimestampEcho - Stores the timestamp value being echoed back to its
+        original sender. This is only valid if the timestamp flag is set.
+
+    SelectiveAcknowledgeCount - Stores the number of valid elements in the
+        blocks array.
+
+    Blocks - Stores the selective acknowledgment blocks, in host order.
+
+--*/
+
+typedef struct _TCP_PACKET_OPTIONS {
+    ULONG Flags;
+    ULONG TimestampValue;
+    ULONG TimestampEcho;
+    ULONG SelectiveAcknowledgeCount;
+    TCP_SELECTIVE_ACKNOWLEDGE_BLOCK
+                              Blocks[TCP_MAXIMUM_SELECTIVE_ACKNOWLEDGE_BLOCKS];
+} TCP_PACKET_OPTIONS, *PTCP_PACKET_OPTIONS;
+
+typedef
+VOID
+(*PTCP_CONGESTION_INITIALIZE) (
+    PTCP_SOCKET Socket
+    );
+
+/*++
+
+Routine Description:
+
+    This routine resets the algorithm specific congestion control state of a
+    socket.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+Return Value:
+
+    None.
+
+--*/
+
+typedef
+VOID
+(*PTCP_CONGESTION_AVOIDANCE) (
+    PTCP_SOCKET Socket
+    );
+
+/*++
+
+Routine Description:
+
+    This routine grows the congestion window in response to a new
+    acknowledgment received during congestion avoidance. This routine assumes
+    the socket lock is already held.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+Return Value:
+
+    None.
+
+--*/
+
+typedef
+ULONG
+(*PTCP_CONGESTION_LOSS) (
+    PTCP_SOCKET Socket,
+    BOOL Timeout
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called when packet loss is detected, either by duplicate
+    acknowledgments or by a retransmission timeout. This routine assumes the
+    socket lock is already held.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+    Timeout - Supplies a boolean indicating whether the loss was detected by
+        a retransmission timeout (TRUE) or duplicate acknowledgments (FALSE).
+
+Return Value:
+
+    Returns the new slow start threshold, in bytes.
+
+--*/
+
+/*++
+
+Structure Description:
+
+    This structure describes a TCP congestion control algorithm. The common
+    code handles slow start and fast recovery, and calls out to the algorithm
+    for growth during congestion avoidance and for the response to loss.
+
+Members:
+
+    Algorithm - Stores the algorithm identifier.
+
+    Name - Stores the name of the algorithm, used for debug printing.
+
+    Initialize - Stores a pointer to a function that resets the socket's
+        algorithm state.
+
+    Avoidance - Stores a pointer to a function that grows the congestion
+        window during congestion avoidance.
+
+    Loss - Stores a pointer to a function that computes the slow start
+        threshold when loss is detected.
+
+--*/
+
+typedef struct _TCP_CONGESTION_ALGORITHM {
+    SOCKET_TCP_CONGESTION_ALGORITHM Algorithm;
+    PSTR Name;
+    PTCP_CONGESTION_INITIALIZE Initialize;
+    PTCP_CONGESTION_AVOIDANCE Avoidance;
+    PTCP_CONGESTION_LOSS Loss;
+} TCP_CONGESTION_ALGORITHM, *PTCP_CONGESTION_ALGORITHM;
+
+/*++
+
 Structure Description:
 
     This structure defines a TCP packet protocol header.
@@ -822,6 +1171,10 @@ typedef struct _TCP_HEADER {
 //
 
 extern BOOL NetTcpDebugPrintCongestionControl;
+extern SOCKET_TCP_CONGESTION_ALGORITHM NetTcpDefaultCongestionAlgorithm;
+extern TCP_CONGESTION_ALGORITHM NetTcpNewReno;
+extern TCP_CONGESTION_ALGORITHM NetTcpCubic;
+extern PKTIMER NetTcpTimer;
 
 //
 // -------------------------------------------------------- Function Prototypes
@@ -861,7 +1214,9 @@ NetpTcpRetransmit (
 
 Routine Description:
 
-    This routine immediately transmits the oldest pending packet. This routine
+    This routine immediately transmits the oldest pending packet. During fast
+    recovery with selective acknowledgments, it instead transmits the oldest
+    hole in the scoreboard that has not yet been retransmitted. This routine
     assumes the socket lock is already held.
 
 Arguments:
@@ -875,10 +1230,60 @@ Return Value:
 
 --*/
 
+ULONG
+NetpTcpGetTimestamp (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the current value of the TCP timestamp clock, which
+    ticks once per millisecond.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the current timestamp value.
+
+--*/
+
 //
 // Congestion control routines
 //
 
+VOID
+NetpTcpCongestionSetAlgorithm (
+    PTCP_SOCKET Socket,
+    SOCKET_TCP_CONGESTION_ALGORITHM Algorithm
+    );
+
+/*++
+
+Routine Description:
+
+    This routine switches the congestion control algorithm used by the given
+    socket. The current congestion window and slow start threshold are kept,
+    but the new algorithm starts with fresh state. This routine assumes the
+    socket lock is already held.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+    Algorithm - Supplies the new congestion control algorithm. The caller is
+        expected to have validated this value.
+
+Return Value:
+
+    None.
+
+--*/
+
 VOID
 NetpTcpCongestionInitializeSocket (
     PTCP_SOCKET Socket
@@ -1046,3 +1451,148 @@ Return Value:
 
 --*/
 
+//
+// Timer routines
+//
+
+KSTATUS
+NetpTcpInitializeTimers (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine initializes the TCP timer and timing wheel.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VOID
+NetpTcpDestroyTimers (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine tears down the TCP timer and timing wheel. The wheel must be
+    empty.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+NetpTcpScheduleTimer (
+    PTCP_SOCKET Socket,
+    ULONGLONG DueTime
+    );
+
+/*++
+
+Routine Description:
+
+    This routine makes sure the TCP worker services the given socket no later
+    than the given time. If the socket is already scheduled to be serviced
+    earlier, this routine has no effect. Sockets that have been removed from
+    the global socket list are never scheduled.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket to schedule. This routine
+        assumes the socket lock is held.
+
+    DueTime - Supplies the time counter value at which the socket needs
+        attention. Times that have already passed, including zero, schedule
+        the socket for the next timer tick.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+NetpTcpCancelTimer (
+    PTCP_SOCKET Socket
+    );
+
+/*++
+
+Routine Description:
+
+    This routine removes the given socket from the timing wheel.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket whose timer should be canceled.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+NetpTcpExpireTimers (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine advances the timing wheel to the current time, moving every
+    socket whose deadline has passed onto the expired list. It then re-arms
+    the TCP timer for the earliest deadline still in the wheel.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+PTCP_SOCKET
+NetpTcpGetExpiredTimer (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine removes the next socket from the list of sockets whose
+    deadlines have passed.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns a pointer to a socket that needs servicing, or NULL if there are
+    no more expired sockets. The caller must hold the socket list lock, which
+    keeps the socket from being destroyed.
+
+--*/
+
@@ -13,10 +13,11 @@ Module Name:
 
 Abstract:
 
-    This module implements support for TCP congestion control. Specifically
-    this module implements the New Reno algorithm, however this set of functions
-    could easily be interfaced to include alternate congestion control
-    algorithms.
+    This module implements support for TCP congestion control. The common
+    slow start, fast retransmit, and fast recovery logic lives here, and the
+    congestion avoidance behavior is delegated to one of a set of registered
+    algorithms selectable per socket. This module also implements the New Reno
+    algorithm.
 
 Author:
 
@@ -57,12 +58,55 @@ Module Name:
 // ----------------------------------------------- Internal Function Prototypes
 //
 
+VOID
+NetpTcpNewRenoInitialize (
+    PTCP_SOCKET Socket
+    );
+
+VOID
+NetpTcpNewRenoAvoidance (
+    PTCP_SOCKET Socket
+    );
+
+ULONG
+NetpTcpNewRenoLoss (
+    PTCP_SOCKET Socket,
+    BOOL Timeout
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
 
 ULONGLONG NetDefaultRoundTripTicks = 0;
 
+//
+// Store the congestion control algorithm assigned to newly created sockets.
+//
+
+SOCKET_TCP_CONGESTION_ALGORITHM NetTcpDefaultCongestionAlgorithm =
+    TCP_DEFAULT_CONGESTION_ALGORITHM;
+
+TCP_CONGESTION_ALGORITHM NetTcpNewReno = {
+    SocketTcpCongestionNewReno,
+    "NewReno",
+    NetpTcpNewRenoInitialize,
+    NetpTcpNewRenoAvoidance,
+    NetpTcpNewRenoLoss
+};
+
+//
+// Define the table of registered congestion control algorithms, indexed by
+// algorithm identifier.
+//
+
+PTCP_CONGESTION_ALGORITHM
+    NetTcpCongestionAlgorithms[SocketTcpCongestionAlgorithmCount] = {
+
+    &NetTcpNewReno,
+    &NetTcpCubic
+};
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -90,6 +134,7 @@ Return Value:
 
 {
 
+    PTCP_CONGESTION_ALGORITHM Algorithm;
     ULONGLONG Ticks;
 
     if (NetDefaultRoundTripTicks == 0) {
@@ -104,6 +149,58 @@ Return Value:
     Socket->CongestionWindowSize = 2 * TCP_DEFAULT_MAX_SEGMENT_SIZE;
     Socket->FastRecoveryEndSequence = 0;
     Socket->RoundTripTime = NetDefaultRoundTripTicks;
+    Socket->CongestionAlgorithm = NetTcpDefaultCongestionAlgorithm;
+    Algorithm = NetTcpCongestionAlgorithms[Socket->CongestionAlgorithm];
+    Algorithm->Initialize(Socket);
+    return;
+}
+
+VOID
+NetpTcpCongestionSetAlgorithm (
+    PTCP_SOCKET Socket,
+    SOCKET_TCP_CONGESTION_ALGORITHM Algorithm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine switches the congestion control algorithm used by the given
+    socket. The current congestion window and slow start threshold are kept,
+    but the new algorithm starts with fresh state. This routine assumes the
+    socket lock is already held.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+    Algorithm - Supplies the new congestion control algorithm. The caller is
+        expected to have validated this value.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PTCP_CONGESTION_ALGORITHM NewAlgorithm;
+
+    ASSERT(Algorithm < SocketTcpCongestionAlgorithmCount);
+
+    if (Socket->CongestionAlgorithm == Algorithm) {
+        return;
+    }
+
+    NewAlgorithm = NetTcpCongestionAlgorithms[Algorithm];
+    Socket->CongestionAlgorithm = Algorithm;
+    NewAlgorithm->Initialize(Socket);
+    if (NetTcpDebugPrintCongestionControl != FALSE) {
+        NetpTcpPrintSocketEndpoints(Socket, FALSE);
+        RtlDebugPrint(" Congestion control now %s.\n", NewAlgorithm->Name);
+    }
+
     return;
 }
 
@@ -130,17 +227,22 @@ Return Value:
 
 {
 
+    PTCP_CONGESTION_ALGORITHM Algorithm;
+
     Socket->SlowStartThreshold = Socket->SendWindowSize;
 
     ASSERT(Socket->SendMaxSegmentSize != 0);
 
     Socket->CongestionWindowSize = 2 * Socket->SendMaxSegmentSize;
+    Algorithm = NetTcpCongestionAlgorithms[Socket->CongestionAlgorithm];
+    Algorithm->Initialize(Socket);
     if (NetTcpDebugPrintCongestionControl != FALSE) {
         NetpTcpPrintSocketEndpoints(Socket, FALSE);
         RtlDebugPrint(" Initial SlowStartThreshold %d, "
-                      "CongestionWindowSize %d.\n",
+                      "CongestionWindowSize %d, %s.\n",
                       Socket->SlowStartThreshold,
-                      Socket->CongestionWindowSize);
+                      Socket->CongestionWindowSize,
+                      Algorithm->Name);
     }
 
     return;
@@ -247,14 +349,15 @@ Return Value:
 
 {
 
+    PTCP_CONGESTION_ALGORITHM Algorithm;
     ULONG Flags;
     ULONG SegmentSize;
-    ULONG WindowIncrease;
 
     //
     // Process an ACK that made progress.
     //
 
+    Algorithm = NetTcpCongestionAlgorithms[Socket->CongestionAlgorithm];
     SegmentSize = Socket->SendMaxSegmentSize;
     if (Socket->DuplicateAcknowledgeCount == 0) {
 
@@ -320,24 +423,11 @@ Return Value:
                 }
 
             //
-            // Perform congestion avoidance.
+            // Perform congestion avoidance, which is up to the algorithm.
             //
 
             } else {
-                WindowIncrease = SegmentSize * SegmentSize /
-                                 Socket->CongestionWindowSize;
-
-                if (WindowIncrease == 0) {
-                    WindowIncrease = 1;
-                }
-
-                Socket->CongestionWindowSize += WindowIncrease;
-                if (NetTcpDebugPrintCongestionControl != FALSE) {
-                    NetpTcpPrintSocketEndpoints(Socket, FALSE);
-                    RtlDebugPrint(" CongestionAvoid Window up by %d to %d.\n",
-                                  WindowIncrease,
-                                  Socket->CongestionWindowSize);
-                }
+                Algorithm->Avoidance(Socket);
             }
         }
 
@@ -355,15 +445,15 @@ Return Value:
         if (Socket->DuplicateAcknowledgeCount == TCP_DUPLICATE_ACK_THRESHOLD) {
 
             //
-            // Set the slow start threshold to half the congestion window. The
-            // congestion window is also halved, but three segment sizes are
-            // added to it to represent the packets after the hole that are
-            // presumably buffered on the other side. This is called "inflating"
-            // the window.
+            // Let the algorithm pick the new slow start threshold. The
+            // congestion window is cut to that threshold, but three segment
+            // sizes are added to it to represent the packets after the hole
+            // that are presumably buffered on the other side. This is called
+            // "inflating" the window.
             //
 
-            Socket->SlowStartThreshold = Socket->CongestionWindowSize / 2;
-            Socket->CongestionWindowSize = (Socket->CongestionWindowSize / 2) +
+            Socket->SlowStartThreshold = Algorithm->Loss(Socket, FALSE);
+            Socket->CongestionWindowSize = Socket->SlowStartThreshold +
                                    (TCP_DUPLICATE_ACK_THRESHOLD * SegmentSize);
 
             Socket->Flags |= TCP_SOCKET_FLAG_IN_FAST_RECOVERY;
@@ -576,16 +666,19 @@ Return Value:
 
 {
 
+    PTCP_CONGESTION_ALGORITHM Algorithm;
     ULONG RelativeSequenceNumber;
     ULONGLONG SentTime;
     ULONGLONG TimeoutTime;
 
     //
-    // Set the slow start threshold to half of what the congestion window was
-    // before the loss. Move all the way back to slow start for a loss.
+    // Let the algorithm set the slow start threshold based on what the
+    // congestion window was before the loss. Move all the way back to slow
+    // start for a loss.
     //
 
-    Socket->SlowStartThreshold = Socket->CongestionWindowSize / 2;
+    Algorithm = NetTcpCongestionAlgorithms[Socket->CongestionAlgorithm];
+    Socket->SlowStartThreshold = Algorithm->Loss(Socket, TRUE);
     Socket->CongestionWindowSize = Socket->SendMaxSegmentSize;
     if (NetTcpDebugPrintCongestionControl != FALSE) {
         NetpTcpPrintSocketEndpoints(Socket, TRUE);
@@ -614,3 +707,106 @@ Return Value:
 // --------------------------------------------------------- Internal Functions
 //
 
+VOID
+NetpTcpNewRenoInitialize (
+    PTCP_SOCKET Socket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine resets the New Reno congestion control state of a socket.
+    New Reno keeps no state beyond the congestion window itself.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    return;
+}
+
+VOID
+NetpTcpNewRenoAvoidance (
+    PTCP_SOCKET Socket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine grows the congestion window in response to a new
+    acknowledgment received during congestion avoidance. New Reno grows the
+    window by about one maximum segment size per round trip.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG SegmentSize;
+    ULONG WindowIncrease;
+
+    SegmentSize = Socket->SendMaxSegmentSize;
+    WindowIncrease = SegmentSize * SegmentSize / Socket->CongestionWindowSize;
+    if (WindowIncrease == 0) {
+        WindowIncrease = 1;
+    }
+
+    Socket->CongestionWindowSize += WindowIncrease;
+    if (NetTcpDebugPrintCongestionControl != FALSE) {
+        NetpTcpPrintSocketEndpoints(Socket, FALSE);
+        RtlDebugPrint(" CongestionAvoid Window up by %d to %d.\n",
+                      WindowIncrease,
+                      Socket->CongestionWindowSize);
+    }
+
+    return;
+}
+
+ULONG
+NetpTcpNewRenoLoss (
+    PTCP_SOCKET Socket,
+    BOOL Timeout
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when packet loss is detected. New Reno halves the
+    congestion window.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+    Timeout - Supplies a boolean indicating whether the loss was detected by
+        a retransmission timeout (TRUE) or duplicate acknowledgments (FALSE).
+
+Return Value:
+
+    Returns the new slow start threshold, in bytes.
+
+--*/
+
+{
+
+    return Socket->CongestionWindowSize / 2;
+}
+
@@ -0,0 +1,512 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    tcpcubic.c
+
+Abstract:
+
+    This module implements the CUBIC TCP congestion control algorithm, as
+    described in RFC 8312. CUBIC grows the congestion window as a cubic
+    function of the time since the last loss, centered on the window size at
+    which that loss occurred, which makes window growth independent of the
+    round trip time.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+//
+// Protocol drivers are supposed to be able to stand on their own (ie be able to
+// be implemented outside the core net library). For the builtin ones, avoid
+// including netcore.h, but still redefine those functions that would otherwise
+// generate imports.
+//
+
+#define NET_API __DLLEXPORT
+
+#include <minoca/kernel/driver.h>
+#include <minoca/net/netdrv.h>
+#include "tcp.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the largest distance from the cubic inflection point, in
+// milliseconds, that is evaluated. This keeps the cube within 64 bits.
+//
+
+#define TCP_CUBIC_MAX_TIME_OFFSET 1000000LL
+
+//
+// Define the number of milli-segments in a segment. Windows are converted to
+// this unit for the cubic math to preserve some fractional precision.
+//
+
+#define TCP_CUBIC_MILLI_SEGMENTS 1000ULL
+
+//
+// Define the fraction of a segment the window grows per acknowledgment when
+// it is already at or above the cubic target.
+//
+
+#define TCP_CUBIC_MINIMUM_GROWTH_DIVISOR 100
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+VOID
+NetpTcpCubicInitialize (
+    PTCP_SOCKET Socket
+    );
+
+VOID
+NetpTcpCubicAvoidance (
+    PTCP_SOCKET Socket
+    );
+
+ULONG
+NetpTcpCubicLoss (
+    PTCP_SOCKET Socket,
+    BOOL Timeout
+    );
+
+VOID
+NetpTcpCubicStartEpoch (
+    PTCP_SOCKET Socket,
+    ULONG CurrentTime
+    );
+
+ULONG
+NetpTcpCubicGetRoundTripMilliseconds (
+    PTCP_SOCKET Socket
+    );
+
+ULONG
+NetpTcpCubeRoot (
+    ULONGLONG Value
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+TCP_CONGESTION_ALGORITHM NetTcpCubic = {
+    SocketTcpCongestionCubic,
+    "CUBIC",
+    NetpTcpCubicInitialize,
+    NetpTcpCubicAvoidance,
+    NetpTcpCubicLoss
+};
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+VOID
+NetpTcpCubicInitialize (
+    PTCP_SOCKET Socket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine resets the CUBIC congestion control state of a socket.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RtlZeroMemory(&(Socket->CongestionState.Cubic), sizeof(TCP_CUBIC_STATE));
+    return;
+}
+
+VOID
+NetpTcpCubicAvoidance (
+    PTCP_SOCKET Socket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine grows the congestion window in response to a new
+    acknowledgment received during congestion avoidance. The window moves
+    toward the value of the cubic function one round trip from now, or
+    toward the window standard TCP would have reached if that is larger.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONGLONG Cube;
+    PTCP_CUBIC_STATE Cubic;
+    ULONG CurrentTime;
+    ULONGLONG FriendlyWindow;
+    LONGLONG Offset;
+    ULONG RoundTripMilliseconds;
+    ULONG SegmentSize;
+    LONGLONG Target;
+    ULONGLONG TargetLimit;
+    LONGLONG TimeOffset;
+    ULONG WindowIncrease;
+    ULONG WindowSize;
+
+    Cubic = &(Socket->CongestionState.Cubic);
+    CurrentTime = NetpTcpGetTimestamp();
+    SegmentSize = Socket->SendMaxSegmentSize;
+    WindowSize = Socket->CongestionWindowSize;
+    if (Cubic->EpochStart == 0) {
+        NetpTcpCubicStartEpoch(Socket, CurrentTime);
+    }
+
+    //
+    // Evaluate W(t) = C * (t - K)^3 + WindowMax at one round trip from now.
+    // With t in milliseconds and C in tenths, the cube divided by 10^7 and
+    // multiplied by C comes out in milli-segments.
+    //
+
+    RoundTripMilliseconds = NetpTcpCubicGetRoundTripMilliseconds(Socket);
+    TimeOffset = (LONGLONG)(ULONG)(CurrentTime - Cubic->EpochStart) +
+                 RoundTripMilliseconds - Cubic->PeakTime;
+
+    if (TimeOffset > TCP_CUBIC_MAX_TIME_OFFSET) {
+        TimeOffset = TCP_CUBIC_MAX_TIME_OFFSET;
+
+    } else if (TimeOffset < -TCP_CUBIC_MAX_TIME_OFFSET) {
+        TimeOffset = -TCP_CUBIC_MAX_TIME_OFFSET;
+    }
+
+    if (TimeOffset < 0) {
+        Cube = (ULONGLONG)(-TimeOffset) * (-TimeOffset) * (-TimeOffset);
+        Offset = -(LONGLONG)((Cube / 10000000ULL) * TCP_CUBIC_C_TENTHS);
+
+    } else {
+        Cube = (ULONGLONG)TimeOffset * TimeOffset * TimeOffset;
+        Offset = (Cube / 10000000ULL) * TCP_CUBIC_C_TENTHS;
+    }
+
+    Target = Cubic->WindowMax +
+             ((Offset * SegmentSize) / (LONGLONG)TCP_CUBIC_MILLI_SEGMENTS);
+
+    //
+    // Estimate the window standard TCP would have reached since the epoch
+    // began, growing 3 * (1 - Beta) / (1 + Beta) segments per round trip.
+    // Use that instead if it is larger, so CUBIC is never less aggressive
+    // than New Reno on short round trip paths.
+    //
+
+    FriendlyWindow = (ULONGLONG)(ULONG)(CurrentTime - Cubic->EpochStart) *
+                     3 * (10 - TCP_CUBIC_BETA_TENTHS) * SegmentSize;
+
+    FriendlyWindow /= (ULONGLONG)(10 + TCP_CUBIC_BETA_TENTHS) *
+                      RoundTripMilliseconds;
+
+    FriendlyWindow += Cubic->EpochWindow;
+    if ((LONGLONG)FriendlyWindow > Target) {
+        Target = FriendlyWindow;
+    }
+
+    //
+    // Grow by (Target - Window) / Window segments per acknowledgment, which
+    // reaches the target in about a round trip. Never more than one and a
+    // half times the window per round trip, and only a little when already
+    // at or beyond the target.
+    //
+
+    if (Target > WindowSize) {
+        TargetLimit = (ULONGLONG)WindowSize + (WindowSize / 2);
+        if ((ULONGLONG)Target > TargetLimit) {
+            Target = TargetLimit;
+        }
+
+        WindowIncrease = ((ULONGLONG)(Target - WindowSize) * SegmentSize) /
+                         WindowSize;
+
+    } else {
+        WindowIncrease = (SegmentSize * SegmentSize) /
+                         (TCP_CUBIC_MINIMUM_GROWTH_DIVISOR * WindowSize);
+    }
+
+    if (WindowIncrease == 0) {
+        WindowIncrease = 1;
+    }
+
+    if (WindowSize + WindowIncrease < WindowSize) {
+        WindowIncrease = MAX_ULONG - WindowSize;
+    }
+
+    Socket->CongestionWindowSize += WindowIncrease;
+    if (NetTcpDebugPrintCongestionControl != FALSE) {
+        NetpTcpPrintSocketEndpoints(Socket, FALSE);
+        RtlDebugPrint(" CUBIC Window up by %d to %d, target %I64d.\n",
+                      WindowIncrease,
+                      Socket->CongestionWindowSize,
+                      Target);
+    }
+
+    return;
+}
+
+ULONG
+NetpTcpCubicLoss (
+    PTCP_SOCKET Socket,
+    BOOL Timeout
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when packet loss is detected. CUBIC remembers the
+    window at which the loss occurred as the new plateau, and reduces the
+    window by the Beta factor rather than halving it.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+    Timeout - Supplies a boolean indicating whether the loss was detected by
+        a retransmission timeout (TRUE) or duplicate acknowledgments (FALSE).
+
+Return Value:
+
+    Returns the new slow start threshold, in bytes.
+
+--*/
+
+{
+
+    PTCP_CUBIC_STATE Cubic;
+    ULONG MinimumThreshold;
+    ULONG Threshold;
+    ULONG WindowSize;
+
+    Cubic = &(Socket->CongestionState.Cubic);
+    WindowSize = Socket->CongestionWindowSize;
+
+    //
+    // Perform fast convergence: if the loss happened before the previous
+    // plateau was reached, another flow is likely competing for bandwidth, so
+    // release some by lowering the plateau further.
+    //
+
+    if (WindowSize < Cubic->WindowMax) {
+        Cubic->WindowMax = ((ULONGLONG)WindowSize *
+                            (10 + TCP_CUBIC_BETA_TENTHS)) / 20;
+
+    } else {
+        Cubic->WindowMax = WindowSize;
+    }
+
+    Cubic->EpochStart = 0;
+    Threshold = ((ULONGLONG)WindowSize * TCP_CUBIC_BETA_TENTHS) / 10;
+    MinimumThreshold = 2 * Socket->SendMaxSegmentSize;
+    if (Threshold < MinimumThreshold) {
+        Threshold = MinimumThreshold;
+    }
+
+    if (NetTcpDebugPrintCongestionControl != FALSE) {
+        NetpTcpPrintSocketEndpoints(Socket, FALSE);
+        RtlDebugPrint(" CUBIC %s loss, WindowMax %d, threshold %d.\n",
+                      (Timeout != FALSE) ? "timeout" : "duplicate ACK",
+                      Cubic->WindowMax,
+                      Threshold);
+    }
+
+    return Threshold;
+}
+
+VOID
+NetpTcpCubicStartEpoch (
+    PTCP_SOCKET Socket,
+    ULONG CurrentTime
+    )
+
+/*++
+
+Routine Description:
+
+    This routine starts a new CUBIC congestion avoidance epoch, computing the
+    time it will take the cubic function to climb back to the plateau.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+    CurrentTime - Supplies the current TCP timestamp clock value.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PTCP_CUBIC_STATE Cubic;
+    ULONGLONG MilliSegments;
+    ULONG WindowSize;
+
+    Cubic = &(Socket->CongestionState.Cubic);
+    WindowSize = Socket->CongestionWindowSize;
+
+    //
+    // Zero is reserved to mean no epoch is in progress.
+    //
+
+    if (CurrentTime == 0) {
+        CurrentTime = 1;
+    }
+
+    Cubic->EpochStart = CurrentTime;
+    Cubic->EpochWindow = WindowSize;
+
+    //
+    // K = cbrt((WindowMax - Window) / C), in seconds when the window is in
+    // segments. Scaled to milliseconds and milli-segments, the value under the
+    // root is the difference times 10^7 divided by C in tenths.
+    //
+
+    if (WindowSize < Cubic->WindowMax) {
+        MilliSegments = ((ULONGLONG)(Cubic->WindowMax - WindowSize) *
+                         TCP_CUBIC_MILLI_SEGMENTS) /
+                        Socket->SendMaxSegmentSize;
+
+        Cubic->PeakTime = NetpTcpCubeRoot((MilliSegments * 10000000ULL) /
+                                          TCP_CUBIC_C_TENTHS);
+
+    } else {
+        Cubic->WindowMax = WindowSize;
+        Cubic->PeakTime = 0;
+    }
+
+    return;
+}
+
+ULONG
+NetpTcpCubicGetRoundTripMilliseconds (
+    PTCP_SOCKET Socket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the socket's smoothed round trip time estimate in
+    milliseconds.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket.
+
+Return Value:
+
+    Returns the round trip time in milliseconds, which is at least one.
+
+--*/
+
+{
+
+    ULONGLONG Milliseconds;
+
+    Milliseconds = (Socket->RoundTripTime * MILLISECONDS_PER_SECOND) /
+                   TCP_ROUND_TRIP_SAMPLE_DENOMINATOR;
+
+    Milliseconds /= HlQueryTimeCounterFrequency();
+    if (Milliseconds == 0) {
+        Milliseconds = 1;
+
+    } else if (Milliseconds > MAX_ULONG) {
+        Milliseconds = MAX_ULONG;
+    }
+
+    return (ULONG)Milliseconds;
+}
+
+ULONG
+NetpTcpCubeRoot (
+    ULONGLONG Value
+    )
+
+/*++
+
+Routine Description:
+
+    This routine computes the integer cube root of the given value, rounded
+    down, using a bitwise digit-by-digit method.
+
+Arguments:
+
+    Value - Supplies the value to take the cube root of.
+
+Return Value:
+
+    Returns the largest integer whose cube is not greater than the value.
+
+--*/
+
+{
+
+    ULONGLONG Increment;
+    ULONGLONG Root;
+    LONG Shift;
+
+    Root = 0;
+    for (Shift = 63; Shift >= 0; Shift -= 3) {
+        Root <<= 1;
+        Increment = (3 * Root * (Root + 1)) + 1;
+        if ((Value >> Shift) >= Increment) {
+            Value -= Increment << Shift;
+            Root += 1;
+        }
+    }
+
+    return (ULONG)Root;
+}
+
@@ -0,0 +1,778 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    tcptimer.c
+
+Abstract:
+
+    This module implements the hierarchical timing wheel that tracks when each
+    TCP socket next needs attention from the TCP worker thread. Only sockets
+    whose deadlines have passed are handed to the worker, so the cost of a
+    timer tick does not grow with the number of idle connections.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+//
+// Protocol drivers are supposed to be able to stand on their own (ie be able
+// to be implemented outside the core net library). For the builtin ones,
+// avoid including netcore.h, but still redefine those functions that would
+// otherwise generate imports.
+//
+
+#define NET_API __DLLEXPORT
+
+#include <minoca/kernel/driver.h>
+#include <minoca/net/netdrv.h>
+#include "tcp.h"
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro returns the slot index within the given level for the given
+// tick.
+//
+
+#define TCP_TIMER_WHEEL_SLOT_INDEX(_Tick, _Level)                   \
+    (((_Tick) >> (TCP_TIMER_WHEEL_SLOT_SHIFT * (_Level))) &         \
+     TCP_TIMER_WHEEL_SLOT_MASK)
+
+//
+// This macro returns the number of ticks covered by a single slot of the
+// given level.
+//
+
+#define TCP_TIMER_WHEEL_SLOT_SPAN(_Level) \
+    (1ULL << (TCP_TIMER_WHEEL_SLOT_SHIFT * (_Level)))
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the shape of the timing wheel. Each level has 64 slots, and each
+// slot of a level covers an entire turn of the level below it. With a 250ms
+// tick, three levels cover 64 * 64 * 64 ticks, or about 18 hours. Deadlines
+// beyond that are parked in the farthest slot and re-filed when it comes due.
+//
+
+#define TCP_TIMER_WHEEL_LEVELS 3
+#define TCP_TIMER_WHEEL_SLOT_SHIFT 6
+#define TCP_TIMER_WHEEL_SLOTS (1 << TCP_TIMER_WHEEL_SLOT_SHIFT)
+#define TCP_TIMER_WHEEL_SLOT_MASK (TCP_TIMER_WHEEL_SLOTS - 1)
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure defines the TCP timing wheel.
+
+Members:
+
+    CurrentTick - Stores the tick the wheel has been advanced to. Every socket
+        in a slot has a deadline tick after this one.
+
+    ArmedTick - Stores the tick the TCP timer is currently queued to expire
+        at, or 0 if it is not queued.
+
+    Count - Stores the number of sockets filed in the wheel's slots. Sockets
+        on the expired list are not counted.
+
+    ExpiredList - Stores the list of sockets whose deadlines have passed and
+        that are waiting to be serviced by the TCP worker.
+
+    Slots - Stores the head of the socket list for each slot of each level.
+
+--*/
+
+typedef struct _TCP_TIMER_WHEEL {
+    ULONGLONG CurrentTick;
+    ULONGLONG ArmedTick;
+    ULONG Count;
+    LIST_ENTRY ExpiredList;
+    LIST_ENTRY Slots[TCP_TIMER_WHEEL_LEVELS][TCP_TIMER_WHEEL_SLOTS];
+} TCP_TIMER_WHEEL, *PTCP_TIMER_WHEEL;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+VOID
+NetpTcpTimerWheelInsert (
+    PTCP_SOCKET Socket
+    );
+
+VOID
+NetpTcpTimerWheelCascade (
+    ULONG Level
+    );
+
+ULONGLONG
+NetpTcpTimerWheelGetNextTick (
+    VOID
+    );
+
+VOID
+NetpTcpTimerWheelArm (
+    ULONGLONG Tick
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Store the timer that wakes the TCP worker thread, along with the length of
+// a wheel tick in time counter ticks.
+//
+
+PKTIMER NetTcpTimer;
+ULONGLONG NetTcpTimerPeriod;
+
+//
+// Store the timing wheel and the lock that protects it. This lock is always
+// acquired last, after the socket list lock and any socket lock.
+//
+
+TCP_TIMER_WHEEL NetTcpTimerWheel;
+PQUEUED_LOCK NetTcpTimerLock;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+KSTATUS
+NetpTcpInitializeTimers (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes the TCP timer and timing wheel.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG Level;
+    ULONG Slot;
+    KSTATUS Status;
+
+    ASSERT((NetTcpTimer == NULL) && (NetTcpTimerLock == NULL));
+
+    NetTcpTimerLock = KeCreateQueuedLock();
+    if (NetTcpTimerLock == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto InitializeTimersEnd;
+    }
+
+    NetTcpTimer = KeCreateTimer(TCP_ALLOCATION_TAG);
+    if (NetTcpTimer == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto InitializeTimersEnd;
+    }
+
+    NetTcpTimerPeriod = KeConvertMicrosecondsToTimeTicks(TCP_TIMER_PERIOD);
+
+    ASSERT(NetTcpTimerPeriod != 0);
+
+    NetTcpTimerWheel.CurrentTick = KeGetRecentTimeCounter() /
+                                   NetTcpTimerPeriod;
+
+    NetTcpTimerWheel.ArmedTick = 0;
+    NetTcpTimerWheel.Count = 0;
+    INITIALIZE_LIST_HEAD(&(NetTcpTimerWheel.ExpiredList));
+    for (Level = 0; Level < TCP_TIMER_WHEEL_LEVELS; Level += 1) {
+        for (Slot = 0; Slot < TCP_TIMER_WHEEL_SLOTS; Slot += 1) {
+            INITIALIZE_LIST_HEAD(&(NetTcpTimerWheel.Slots[Level][Slot]));
+        }
+    }
+
+    Status = STATUS_SUCCESS;
+
+InitializeTimersEnd:
+    if (!KSUCCESS(Status)) {
+        NetpTcpDestroyTimers();
+    }
+
+    return Status;
+}
+
+VOID
+NetpTcpDestroyTimers (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tears down the TCP timer and timing wheel. The wheel must be
+    empty.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ASSERT(NetTcpTimerWheel.Count == 0);
+
+    if (NetTcpTimer != NULL) {
+        KeDestroyTimer(NetTcpTimer);
+        NetTcpTimer = NULL;
+    }
+
+    if (NetTcpTimerLock != NULL) {
+        KeDestroyQueuedLock(NetTcpTimerLock);
+        NetTcpTimerLock = NULL;
+    }
+
+    return;
+}
+
+VOID
+NetpTcpScheduleTimer (
+    PTCP_SOCKET Socket,
+    ULONGLONG DueTime
+    )
+
+/*++
+
+Routine Description:
+
+    This routine makes sure the TCP worker services the given socket no later
+    than the given time. If the socket is already scheduled to be serviced
+    earlier, this routine has no effect. Sockets that have been removed from
+    the global socket list are never scheduled.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket to schedule. This routine
+        assumes the socket lock is held.
+
+    DueTime - Supplies the time counter value at which the socket needs
+        attention. Times that have already passed, including zero, schedule
+        the socket for the next timer tick.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONGLONG Tick;
+
+    //
+    // Round up so that the socket is never serviced before its deadline.
+    //
+
+    Tick = (DueTime + NetTcpTimerPeriod - 1) / NetTcpTimerPeriod;
+
+    //
+    // Skip the global lock if the socket is already due by then, which is
+    // the common case for keep alive updates on every received packet. The
+    // socket lock keeps the tick from changing underneath this check. The
+    // worker may pull the socket off the wheel at any time, but it then
+    // services the socket under the socket lock, after this change is made.
+    //
+
+    if ((Socket->TimerListEntry.Next != NULL) && (Socket->TimerTick <= Tick)) {
+        return;
+    }
+
+    KeAcquireQueuedLock(NetTcpTimerLock);
+
+    //
+    // A socket that is no longer on the global list is being closed out, and
+    // the worker would never find it anyway.
+    //
+
+    if (Socket->ListEntry.Next == NULL) {
+        goto ScheduleTimerEnd;
+    }
+
+    if (Tick <= NetTcpTimerWheel.CurrentTick) {
+        Tick = NetTcpTimerWheel.CurrentTick + 1;
+    }
+
+    //
+    // Leave the socket alone if it is going to be looked at sooner anyway.
+    // Sockets on the expired list always have a tick at or before the
+    // current one, so anything that makes it past this check is in a slot.
+    //
+
+    if (Socket->TimerListEntry.Next != NULL) {
+        if (Socket->TimerTick <= Tick) {
+            goto ScheduleTimerEnd;
+        }
+
+        ASSERT(NetTcpTimerWheel.Count != 0);
+
+        LIST_REMOVE(&(Socket->TimerListEntry));
+        NetTcpTimerWheel.Count -= 1;
+    }
+
+    Socket->TimerTick = Tick;
+    NetpTcpTimerWheelInsert(Socket);
+    NetpTcpTimerWheelArm(Tick);
+
+ScheduleTimerEnd:
+    KeReleaseQueuedLock(NetTcpTimerLock);
+    return;
+}
+
+VOID
+NetpTcpCancelTimer (
+    PTCP_SOCKET Socket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes the given socket from the timing wheel.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket whose timer should be canceled.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    KeAcquireQueuedLock(NetTcpTimerLock);
+    if (Socket->TimerListEntry.Next != NULL) {
+        if (Socket->TimerTick > NetTcpTimerWheel.CurrentTick) {
+
+            ASSERT(NetTcpTimerWheel.Count != 0);
+
+            NetTcpTimerWheel.Count -= 1;
+        }
+
+        LIST_REMOVE(&(Socket->TimerListEntry));
+        Socket->TimerListEntry.Next = NULL;
+    }
+
+    KeReleaseQueuedLock(NetTcpTimerLock);
+    return;
+}
+
+VOID
+NetpTcpExpireTimers (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine advances the timing wheel to the current time, moving every
+    socket whose deadline has passed onto the expired list. It then re-arms
+    the TCP timer for the earliest deadline still in the wheel.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    ULONG Level;
+    ULONGLONG NextTick;
+    ULONGLONG NowTick;
+    PLIST_ENTRY SlotHead;
+    PTCP_SOCKET Socket;
+
+    NowTick = KeGetRecentTimeCounter() / NetTcpTimerPeriod;
+    KeAcquireQueuedLock(NetTcpTimerLock);
+
+    //
+    // The timer that woke the worker has fired, so it is no longer armed.
+    //
+
+    NetTcpTimerWheel.ArmedTick = 0;
+    while (NetTcpTimerWheel.CurrentTick < NowTick) {
+        if (NetTcpTimerWheel.Count == 0) {
+            NetTcpTimerWheel.CurrentTick = NowTick;
+            break;
+        }
+
+        NetTcpTimerWheel.CurrentTick += 1;
+
+        //
+        // When a lower level wraps around, re-file the next slot of the
+        // level above it. Go from the top down so that sockets can cascade
+        // all the way to the bottom level in one tick.
+        //
+
+        for (Level = TCP_TIMER_WHEEL_LEVELS - 1; Level > 0; Level -= 1) {
+            if ((NetTcpTimerWheel.CurrentTick &
+                 (TCP_TIMER_WHEEL_SLOT_SPAN(Level) - 1)) == 0) {
+
+                NetpTcpTimerWheelCascade(Level);
+            }
+        }
+
+        SlotHead = &(NetTcpTimerWheel.Slots[0][NetTcpTimerWheel.CurrentTick &
+                                              TCP_TIMER_WHEEL_SLOT_MASK]);
+
+        while (LIST_EMPTY(SlotHead) == FALSE) {
+            CurrentEntry = SlotHead->Next;
+            Socket = LIST_VALUE(CurrentEntry, TCP_SOCKET, TimerListEntry);
+
+            ASSERT(Socket->TimerTick == NetTcpTimerWheel.CurrentTick);
+
+            LIST_REMOVE(CurrentEntry);
+            INSERT_BEFORE(CurrentEntry, &(NetTcpTimerWheel.ExpiredList));
+            NetTcpTimerWheel.Count -= 1;
+        }
+    }
+
+    NextTick = NetpTcpTimerWheelGetNextTick();
+    if (NextTick != 0) {
+        NetpTcpTimerWheelArm(NextTick);
+    }
+
+    KeReleaseQueuedLock(NetTcpTimerLock);
+    return;
+}
+
+PTCP_SOCKET
+NetpTcpGetExpiredTimer (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes the next socket from the list of sockets whose
+    deadlines have passed.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns a pointer to a socket that needs servicing, or NULL if there are
+    no more expired sockets. The caller must hold the socket list lock, which
+    keeps the socket from being destroyed.
+
+--*/
+
+{
+
+    PTCP_SOCKET Socket;
+
+    Socket = NULL;
+    KeAcquireQueuedLock(NetTcpTimerLock);
+    if (LIST_EMPTY(&(NetTcpTimerWheel.ExpiredList)) == FALSE) {
+        Socket = LIST_VALUE(NetTcpTimerWheel.ExpiredList.Next,
+                            TCP_SOCKET,
+                            TimerListEntry);
+
+        LIST_REMOVE(&(Socket->TimerListEntry));
+        Socket->TimerListEntry.Next = NULL;
+    }
+
+    KeReleaseQueuedLock(NetTcpTimerLock);
+    return Socket;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+VOID
+NetpTcpTimerWheelInsert (
+    PTCP_SOCKET Socket
+    )
+
+/*++
+
+Routine Description:
+
+    This routine files a socket into the slot that covers its deadline tick.
+    This routine assumes the timer lock is held.
+
+Arguments:
+
+    Socket - Supplies a pointer to the socket to insert. Its deadline tick
+        must be after the wheel's current tick.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONGLONG Delta;
+    ULONG Level;
+    ULONGLONG Tick;
+
+    ASSERT(Socket->TimerTick > NetTcpTimerWheel.CurrentTick);
+
+    //
+    // Pick the lowest level whose turn still reaches the deadline. Deadlines
+    // beyond the top level are parked in its farthest slot, and get re-filed
+    // when that slot cascades.
+    //
+
+    Tick = Socket->TimerTick;
+    Delta = Tick - NetTcpTimerWheel.CurrentTick;
+    for (Level = 0; Level < TCP_TIMER_WHEEL_LEVELS - 1; Level += 1) {
+        if (Delta < TCP_TIMER_WHEEL_SLOT_SPAN(Level + 1)) {
+            break;
+        }
+    }
+
+    if (Delta >= TCP_TIMER_WHEEL_SLOT_SPAN(TCP_TIMER_WHEEL_LEVELS)) {
+        Tick = NetTcpTimerWheel.CurrentTick +
+               TCP_TIMER_WHEEL_SLOT_SPAN(TCP_TIMER_WHEEL_LEVELS) -
+               TCP_TIMER_WHEEL_SLOT_SPAN(Level);
+    }
+
+    INSERT_BEFORE(&(Socket->TimerListEntry),
+                  &(NetTcpTimerWheel.Slots[Level][
+                                 TCP_TIMER_WHEEL_SLOT_INDEX(Tick, Level)]));
+
+    NetTcpTimerWheel.Count += 1;
+    return;
+}
+
+VOID
+NetpTcpTimerWheelCascade (
+    ULONG Level
+    )
+
+/*++
+
+Routine Description:
+
+    This routine re-files every socket in the slot of the given level that
+    the current tick has just entered into the levels below. This routine
+    assumes the timer lock is held.
+
+Arguments:
+
+    Level - Supplies the level whose slot should be emptied.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    LIST_ENTRY Cascade;
+    PLIST_ENTRY SlotHead;
+    PTCP_SOCKET Socket;
+
+    SlotHead = &(NetTcpTimerWheel.Slots[Level][
+                 TCP_TIMER_WHEEL_SLOT_INDEX(NetTcpTimerWheel.CurrentTick,
+                                            Level)]);
+
+    if (LIST_EMPTY(SlotHead) != FALSE) {
+        return;
+    }
+
+    MOVE_LIST(SlotHead, &Cascade);
+    INITIALIZE_LIST_HEAD(SlotHead);
+    while (LIST_EMPTY(&Cascade) == FALSE) {
+        Socket = LIST_VALUE(Cascade.Next, TCP_SOCKET, TimerListEntry);
+        LIST_REMOVE(&(Socket->TimerListEntry));
+        NetTcpTimerWheel.Count -= 1;
+
+        //
+        // A socket due this very tick goes straight to the bottom level,
+        // where the caller will expire it.
+        //
+
+        if (Socket->TimerTick == NetTcpTimerWheel.CurrentTick) {
+            INSERT_BEFORE(&(Socket->TimerListEntry),
+                          &(NetTcpTimerWheel.Slots[0][
+                                         Socket->TimerTick &
+                                         TCP_TIMER_WHEEL_SLOT_MASK]));
+
+            NetTcpTimerWheel.Count += 1;
+
+        } else {
+            NetpTcpTimerWheelInsert(Socket);
+        }
+    }
+
+    return;
+}
+
+ULONGLONG
+NetpTcpTimerWheelGetNextTick (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines the earliest tick at which the wheel needs to be
+    advanced, either to expire a socket or to cascade a slot. This routine
+    assumes the timer lock is held.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the next tick of interest, or 0 if the wheel is empty.
+
+--*/
+
+{
+
+    ULONGLONG Base;
+    ULONGLONG Candidate;
+    ULONG Index;
+    ULONG Level;
+    ULONGLONG NextTick;
+    ULONG Shift;
+
+    if (NetTcpTimerWheel.Count == 0) {
+        return 0;
+    }
+
+    //
+    // For each level, find the first non-empty slot after the current one.
+    // A bottom level slot comes due at its own tick, and a higher level slot
+    // needs attention when the wheel reaches the start of it.
+    //
+
+    NextTick = 0;
+    for (Level = 0; Level < TCP_TIMER_WHEEL_LEVELS; Level += 1) {
+        Shift = TCP_TIMER_WHEEL_SLOT_SHIFT * Level;
+        Base = NetTcpTimerWheel.CurrentTick >> Shift;
+        for (Index = 1; Index <= TCP_TIMER_WHEEL_SLOTS; Index += 1) {
+            if (LIST_EMPTY(&(NetTcpTimerWheel.Slots[Level][
+                      (Base + Index) & TCP_TIMER_WHEEL_SLOT_MASK])) == FALSE) {
+
+                Candidate = (Base + Index) << Shift;
+                if ((NextTick == 0) || (Candidate < NextTick)) {
+                    NextTick = Candidate;
+                }
+
+                break;
+            }
+        }
+    }
+
+    ASSERT(NextTick > NetTcpTimerWheel.CurrentTick);
+
+    return NextTick;
+}
+
+VOID
+NetpTcpTimerWheelArm (
+    ULONGLONG Tick
+    )
+
+/*++
+
+Routine Description:
+
+    This routine queues the TCP timer to expire at the given tick, unless it
+    is already queued to expire at or before it. This routine assumes the
+    timer lock is held.
+
+Arguments:
+
+    Tick - Supplies the wheel tick at which the worker needs to run.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    if ((NetTcpTimerWheel.ArmedTick != 0) &&
+        (NetTcpTimerWheel.ArmedTick <= Tick)) {
+
+        return;
+    }
+
+    KeCancelTimer(NetTcpTimer);
+    Status = KeQueueTimer(NetTcpTimer,
+                          TimerQueueSoftWake,
+                          Tick * NetTcpTimerPeriod,
+                          0,
+                          0,
+                          NULL);
+
+    if (!KSUCCESS(Status)) {
+        RtlDebugPrint("Error: Failed to queue TCP timer: %d\n", Status);
+        return;
+    }
+
+    NetTcpTimerWheel.ArmedTick = Tick;
+    return;
+}
@@ -909,6 +909,14 @@ Module Name:
 
 #define IRP_IO_BUFFER_STATE_FLAG_LOCKED_COPY 0x00000001
 
+//
+// Define the current versions of the block request queue parameters and
+// statistics structures.
+//
+
+#define IO_BLOCK_QUEUE_PARAMETERS_VERSION 1
+#define IO_BLOCK_QUEUE_STATISTICS_VERSION 1
+
 //
 // Define the current loaded file structure version.
 //
@@ -930,6 +938,8 @@ typedef struct _IRP IRP, *PIRP;
 typedef struct _STREAM_BUFFER STREAM_BUFFER, *PSTREAM_BUFFER;
 typedef struct _IO_HANDLE IO_HANDLE, *PIO_HANDLE;
 typedef struct _PAGE_CACHE_ENTRY PAGE_CACHE_ENTRY, *PPAGE_CACHE_ENTRY;
+typedef struct _IO_BLOCK_QUEUE IO_BLOCK_QUEUE, *PIO_BLOCK_QUEUE;
+typedef struct _IO_BLOCK_REQUEST IO_BLOCK_REQUEST, *PIO_BLOCK_REQUEST;
 
 typedef enum _SEEK_COMMAND {
     SeekCommandInvalid,
@@ -1485,6 +1495,7 @@ typedef enum _IO_OBJECT_TYPE {
     IoObjectTerminalSlave,
     IoObjectSharedMemoryObject,
     IoObjectSymbolicLink,
+    IoObjectInterestSet,
     IoObjectTypeCount
 } IO_OBJECT_TYPE, *PIO_OBJECT_TYPE;
 
@@ -1693,6 +1704,11 @@ Structure Description:
 
     Async - Stores an optional pointer to the asynchronous object state.
 
+    WatcherList - Stores the head of the list of interest set registrations
+        watching this object for events.
+
+    WatcherLock - Stores a pointer to the lock protecting the watcher list.
+
 --*/
 
 typedef struct _IO_OBJECT_STATE {
@@ -1703,6 +1719,8 @@ typedef struct _IO_OBJECT_STATE {
     PKEVENT ErrorEvent;
     volatile ULONG Events;
     PIO_ASYNC_STATE Async;
+    LIST_ENTRY WatcherList;
+    PQUEUED_LOCK WatcherLock;
 } IO_OBJECT_STATE, *PIO_OBJECT_STATE;
 
 typedef enum _IRP_MAJOR_CODE {
@@ -2116,6 +2134,237 @@ struct _IRP {
 
 /*++
 
+Structure Description:
+
+    This structure describes a request in a block request queue. A request
+    starts out as a single read or write IRP. When the queue dispatches a
+    request it may merge in requests for the adjacent blocks, in which case
+    the first request heads a chain of segments that the driver should
+    transfer as one operation.
+
+Members:
+
+    ListEntry - Stores pointers to the next and previous requests in the
+        queue's list of pending requests, sorted by offset. This is internal
+        to the queue.
+
+    FifoListEntry - Stores pointers to the next and previous requests in the
+        queue's list of pending requests in arrival order. This is internal
+        to the queue.
+
+    Irp - Stores a pointer to the read or write IRP this segment carries.
+
+    NextSegment - Stores a pointer to the next segment merged into this
+        request, or NULL if this is the last segment.
+
+    Offset - Stores the device offset, in bytes, where this segment begins.
+
+    Size - Stores the size of this segment, in bytes.
+
+    Write - Stores a boolean indicating whether this is a write (TRUE) or a
+        read (FALSE).
+
+    SegmentCount - Stores the number of segments in the request. This is only
+        valid in the first segment.
+
+    TransferSize - Stores the total size of the request in bytes, including
+        all merged segments. This is only valid in the first segment.
+
+    BytesCompleted - Stores the number of bytes of the request that the
+        driver has transferred. The queue zeroes this before starting the
+        request, and uses it at completion to fill in the number of bytes
+        completed for each IRP. This is only valid in the first segment.
+
+    DriverContext - Stores a pointer's worth of context the driver can use
+        while the request is in flight.
+
+    SubmitTime - Stores the time counter value when the IRP was submitted to
+        the queue.
+
+    Deadline - Stores the time counter value after which the request should
+        be dispatched ahead of the elevator order.
+
+--*/
+
+struct _IO_BLOCK_REQUEST {
+    LIST_ENTRY ListEntry;
+    LIST_ENTRY FifoListEntry;
+    PIRP Irp;
+    PIO_BLOCK_REQUEST NextSegment;
+    IO_OFFSET Offset;
+    UINTN Size;
+    BOOL Write;
+    ULONG SegmentCount;
+    UINTN TransferSize;
+    UINTN BytesCompleted;
+    PVOID DriverContext;
+    ULONGLONG SubmitTime;
+    ULONGLONG Deadline;
+};
+
+typedef
+KSTATUS
+(*PIO_BLOCK_QUEUE_START_REQUEST) (
+    PIO_BLOCK_QUEUE Queue,
+    PIO_BLOCK_REQUEST Request,
+    PVOID Context
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called by a block request queue to start a request on the
+    hardware. It is called at low level, and not from within any queue lock.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+    Request - Supplies a pointer to the first segment of the request to start.
+
+    Context - Supplies the context pointer the driver supplied when creating
+        the queue.
+
+Return Value:
+
+    STATUS_SUCCESS if the request was started. The driver must call
+    IoCompleteBlockQueueRequest once the request finishes.
+
+    Error code if the request could not be started. The queue will complete
+    the request's IRPs with this status.
+
+--*/
+
+/*++
+
+Structure Description:
+
+    This structure describes the parameters for creating a block request
+    queue.
+
+Members:
+
+    Version - Stores the structure version number. Set this to
+        IO_BLOCK_QUEUE_PARAMETERS_VERSION.
+
+    Driver - Stores a pointer to the driver that owns the queue. The queue
+        pends and completes IRPs on behalf of this driver.
+
+    StartRequest - Stores a pointer to the routine called to start a request.
+
+    Context - Stores a context pointer passed to the start request routine.
+
+    QueueDepth - Stores the maximum number of requests the device can have in
+        flight at once.
+
+    BlockSize - Stores the device block size, in bytes. Every IRP submitted
+        to the queue must be aligned to this size.
+
+    MaxTransferSize - Stores the maximum size of a merged request, in bytes.
+        Supply zero if there is no limit.
+
+    MaxSegments - Stores the maximum number of IRPs that can be merged into
+        one request. Supply zero or one to disable merging.
+
+    ReadDeadline - Stores the number of milliseconds a read can wait before
+        it is dispatched ahead of the elevator order. Supply zero to use the
+        default.
+
+    WriteDeadline - Stores the number of milliseconds a write can wait before
+        it is dispatched ahead of the elevator order. Supply zero to use the
+        default.
+
+--*/
+
+typedef struct _IO_BLOCK_QUEUE_PARAMETERS {
+    ULONG Version;
+    PDRIVER Driver;
+    PIO_BLOCK_QUEUE_START_REQUEST StartRequest;
+    PVOID Context;
+    ULONG QueueDepth;
+    ULONG BlockSize;
+    UINTN MaxTransferSize;
+    ULONG MaxSegments;
+    ULONG ReadDeadline;
+    ULONG WriteDeadline;
+} IO_BLOCK_QUEUE_PARAMETERS, *PIO_BLOCK_QUEUE_PARAMETERS;
+
+/*++
+
+Structure Description:
+
+    This structure describes the statistics kept by a block request queue.
+
+Members:
+
+    Version - Stores the structure version number. Set this to
+        IO_BLOCK_QUEUE_STATISTICS_VERSION.
+
+    QueueDepth - Stores the maximum number of requests the device can have in
+        flight at once.
+
+    InFlight - Stores the number of requests currently on the device.
+
+    Pending - Stores the number of IRPs waiting in the queue.
+
+    MaxInFlight - Stores the largest number of requests that have been on the
+        device at once.
+
+    MaxPending - Stores the largest number of IRPs that have waited in the
+        queue at once.
+
+    Requests - Stores the number of requests started on the device.
+
+    Reads - Stores the number of read IRPs completed.
+
+    Writes - Stores the number of write IRPs completed.
+
+    BytesRead - Stores the number of bytes read.
+
+    BytesWritten - Stores the number of bytes written.
+
+    Merges - Stores the number of IRPs that were merged into a request headed
+        by another IRP.
+
+    DeadlineDispatches - Stores the number of requests started because their
+        deadline expired.
+
+    Errors - Stores the number of IRPs completed with a failing status.
+
+    TotalWaitTime - Stores the total time IRPs spent waiting in the queue,
+        in microseconds.
+
+    TotalLatency - Stores the total time from submission to completion of
+        all completed IRPs, in microseconds.
+
+    MaxLatency - Stores the longest time from submission to completion of
+        any IRP, in microseconds.
+
+--*/
+
+typedef struct _IO_BLOCK_QUEUE_STATISTICS {
+    ULONG Version;
+    ULONG QueueDepth;
+    ULONG InFlight;
+    ULONG Pending;
+    ULONG MaxInFlight;
+    ULONG MaxPending;
+    ULONGLONG Requests;
+    ULONGLONG Reads;
+    ULONGLONG Writes;
+    ULONGLONG BytesRead;
+    ULONGLONG BytesWritten;
+    ULONGLONG Merges;
+    ULONGLONG DeadlineDispatches;
+    ULONGLONG Errors;
+    ULONGLONG TotalWaitTime;
+    ULONGLONG TotalLatency;
+    ULONGLONG MaxLatency;
+} IO_BLOCK_QUEUE_STATISTICS, *PIO_BLOCK_QUEUE_STATISTICS;
+
+/*++
+
 Structure Description:
 
     This structure describes a block I/O device.
@@ -3719,6 +3968,180 @@ Return Value:
 
 --*/
 
+KERNEL_API
+KSTATUS
+IoCreateBlockQueue (
+    PIO_BLOCK_QUEUE_PARAMETERS Parameters,
+    PIO_BLOCK_QUEUE *Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates a block request queue, which sits between a block
+    device driver and its hardware. The queue holds read and write IRPs while
+    the device is busy, sorts them by offset, merges requests for adjacent
+    blocks, and keeps up to the device's queue depth of requests in flight.
+
+Arguments:
+
+    Parameters - Supplies a pointer to the queue parameters.
+
+    Queue - Supplies a pointer where a pointer to the new queue will be
+        returned on success.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_PARAMETER if the parameters are invalid.
+
+    STATUS_INSUFFICIENT_RESOURCES on allocation failure.
+
+--*/
+
+KERNEL_API
+VOID
+IoDestroyBlockQueue (
+    PIO_BLOCK_QUEUE Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine destroys a block request queue. Any IRPs still waiting in the
+    queue are completed with STATUS_DEVICE_NOT_CONNECTED. There must be no
+    requests in flight.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+KERNEL_API
+KSTATUS
+IoSubmitBlockQueueIrp (
+    PIO_BLOCK_QUEUE Queue,
+    PIRP Irp
+    );
+
+/*++
+
+Routine Description:
+
+    This routine submits a read or write IRP to a block request queue. The
+    driver should call this from its dispatch I/O routine on the way down,
+    after preparing the IRP's I/O buffer. On success the IRP is pended, and
+    the queue completes it once the device has finished with it. This routine
+    must be called at low level.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+    Irp - Supplies a pointer to the read or write IRP to submit.
+
+Return Value:
+
+    STATUS_SUCCESS if the IRP was queued.
+
+    STATUS_INSUFFICIENT_RESOURCES on allocation failure. The caller still
+    owns the IRP and should complete it.
+
+--*/
+
+KERNEL_API
+VOID
+IoCompleteBlockQueueRequest (
+    PIO_BLOCK_QUEUE Queue,
+    PIO_BLOCK_REQUEST Request,
+    KSTATUS Status
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called by a driver when a request started by the block
+    request queue has finished. It completes every IRP in the request. This
+    routine can be called at or below dispatch level. The queue does not
+    start the next request from here; the driver should call
+    IoPumpBlockQueue from its dispatch I/O routine as the IRPs head back up.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+    Request - Supplies a pointer to the first segment of the finished request.
+        The request's bytes completed field should be filled in. The request
+        is freed by this routine.
+
+    Status - Supplies the completion status of the request.
+
+Return Value:
+
+    None.
+
+--*/
+
+KERNEL_API
+VOID
+IoPumpBlockQueue (
+    PIO_BLOCK_QUEUE Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine starts as many waiting requests as the device's queue depth
+    allows. This routine must be called at low level.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+Return Value:
+
+    None.
+
+--*/
+
+KERNEL_API
+KSTATUS
+IoGetBlockQueueStatistics (
+    PIO_BLOCK_QUEUE Queue,
+    PIO_BLOCK_QUEUE_STATISTICS Statistics
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns a snapshot of a block request queue's statistics.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+    Statistics - Supplies a pointer where the statistics will be returned.
+        The caller should set the version field.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_VERSION_MISMATCH if the statistics version is not supported.
+
+--*/
+
 KERNEL_API
 KSTATUS
 IoCreateInterface (
@@ -5645,6 +6068,111 @@ Return Value:
 
 --*/
 
+INTN
+IoSysCreateInterestSet (
+    PVOID SystemCallParameter
+    );
+
+/*++
+
+Routine Description:
+
+    This routine handles the system call that creates a new interest set.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or positive integer on success.
+
+    Error status code on failure.
+
+--*/
+
+INTN
+IoSysControlInterestSet (
+    PVOID SystemCallParameter
+    );
+
+/*++
+
+Routine Description:
+
+    This routine handles the system call that adds, modifies, or removes a
+    handle registration in an interest set.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or positive integer on success.
+
+    Error status code on failure.
+
+--*/
+
+INTN
+IoSysWaitForInterestSet (
+    PVOID SystemCallParameter
+    );
+
+/*++
+
+Routine Description:
+
+    This routine handles the system call that waits for registered handles in
+    an interest set to become ready.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or the number of events returned (a positive integer) on
+    success.
+
+    Error status code (a negative integer) on failure.
+
+--*/
+
+INTN
+IoSysSendFile (
+    PVOID SystemCallParameter
+    );
+
+/*++
+
+Routine Description:
+
+    This routine implements the system call for transferring data from one
+    handle to another entirely within the kernel.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or the number of bytes transferred (a positive integer) on
+    success.
+
+    Error status code (a negative integer) on failure.
+
+--*/
+
 INTN
 IoSysDuplicateHandle (
     PVOID SystemCallParameter
@@ -140,6 +140,13 @@ Module Name:
 
 #define X86_FEATURE_FXSAVE   0x00000008
 
+//
+// This bit is set if the processor supports SSE2 instructions and the kernel
+// has enabled them.
+//
+
+#define X86_FEATURE_SSE2     0x00000010
+
 //
 // This bit is set if the kernel is ARMv7.
 //
@@ -246,6 +253,7 @@ typedef enum _KE_INFORMATION_TYPE {
     KeInformationProcessorUsage,
     KeInformationProcessorCount,
     KeInformationKernelCommandLine,
+    KeInformationSchedulerStatistics,
 } KE_INFORMATION_TYPE, *PKE_INFORMATION_TYPE;
 
 typedef enum _SYSTEM_RESET_TYPE {
@@ -441,6 +449,44 @@ struct _SCHEDULER_GROUP_ENTRY {
 
 /*++
 
+Structure Description:
+
+    This structure contains counts of threads moved between processors by the
+    scheduler.
+
+Members:
+
+    MigrationsIn - Stores the total number of ready threads moved onto this
+        processor from another processor.
+
+    MigrationsOut - Stores the total number of ready threads moved off of this
+        processor onto another processor.
+
+    IdleSteals - Stores the number of threads this processor pulled from
+        another processor because it had nothing to run.
+
+    BalancePulls - Stores the number of threads this processor pulled from a
+        busier processor during periodic load balancing.
+
+    BalancePushes - Stores the number of threads this processor pushed to an
+        idle processor during periodic load balancing.
+
+    WakeMigrations - Stores the number of threads moved onto this processor
+        because this processor woke them.
+
+--*/
+
+typedef struct _SCHEDULER_STATISTICS {
+    ULONGLONG MigrationsIn;
+    ULONGLONG MigrationsOut;
+    ULONGLONG IdleSteals;
+    ULONGLONG BalancePulls;
+    ULONGLONG BalancePushes;
+    ULONGLONG WakeMigrations;
+} SCHEDULER_STATISTICS, *PSCHEDULER_STATISTICS;
+
+/*++
+
 Structure Description:
 
     This structure contains the scheduler context for a specific processor.
@@ -451,11 +497,20 @@ Structure Description:
 
     Group - Stores the fixed head scheduling group for this processor.
 
+    NextBalanceTime - Stores the time counter value at which this processor
+        next performs periodic load balancing. This is only touched by the
+        owning processor.
+
+    Statistics - Stores the thread migration counters for this processor.
+        These are modified with atomic operations.
+
 --*/
 
 struct _SCHEDULER_DATA {
     KSPIN_LOCK Lock;
     SCHEDULER_GROUP_ENTRY Group;
+    ULONGLONG NextBalanceTime;
+    SCHEDULER_STATISTICS Statistics;
 };
 
 /*++
@@ -647,6 +702,9 @@ Structure Description:
     SwapPage - Stores a pointer to a virtual address that can be used for
         temporary mappings.
 
+    PoolCache - Stores a pointer to the processor's magazines of recently
+        freed pool allocations. This is owned by the memory manager.
+
     NmiCount - Stores a count of nested NMIs this processor has taken.
 
     CpuVersion - Stores the processor identification information for this CPU.
@@ -684,6 +742,7 @@ struct _PROCESSOR_BLOCK {
     volatile ULONGLONG InterruptCycles;
     volatile ULONGLONG IdleCycles;
     PVOID SwapPage;
+    PVOID PoolCache;
     UINTN NmiCount;
     PROCESSOR_IDENTIFICATION CpuVersion;
 };
@@ -736,6 +795,26 @@ typedef struct _PROCESSOR_COUNT_INFORMATION {
 
 /*++
 
+Structure Description:
+
+    This structure defines scheduler statistics for one or more processors.
+
+Members:
+
+    ProcessorNumber - Stores the processor number corresponding to the
+        statistics, or -1 if this data represents all processors.
+
+    Statistics - Stores the scheduler statistics.
+
+--*/
+
+typedef struct _SCHEDULER_STATISTICS_INFORMATION {
+    UINTN ProcessorNumber;
+    SCHEDULER_STATISTICS Statistics;
+} SCHEDULER_STATISTICS_INFORMATION, *PSCHEDULER_STATISTICS_INFORMATION;
+
+/*++
+
 Structure Description:
 
     This structure defines a queued lock. These locks can be used at or below
@@ -3284,6 +3363,35 @@ Return Value:
 
 --*/
 
+KERNEL_API
+KSTATUS
+KeGetSchedulerStatistics (
+    ULONG ProcessorNumber,
+    PSCHEDULER_STATISTICS Statistics
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns a snapshot of the given processor's scheduler
+    statistics.
+
+Arguments:
+
+    ProcessorNumber - Supplies the processor number to query, or -1 to get the
+        sum of all processors' statistics.
+
+    Statistics - Supplies a pointer where the statistics will be returned.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_PARAMETER if an invalid processor number was supplied.
+
+--*/
+
 VOID
 KeSchedulerEntry (
     SCHEDULER_REASON Reason
@@ -276,6 +276,21 @@ Module Name:
 #define SOCKET_FLAG_SEND_TIMEOUT_SET    0x00000001
 #define SOCKET_FLAG_RECEIVE_TIMEOUT_SET 0x00000002
 
+//
+// Define the current version of the TCP socket information structure.
+//
+
+#define SOCKET_TCP_INFORMATION_VERSION 1
+
+//
+// Define the TCP socket information flags.
+//
+
+#define SOCKET_TCP_INFORMATION_FLAG_WINDOW_SCALING       0x00000001
+#define SOCKET_TCP_INFORMATION_FLAG_SELECTIVE_ACKNOWLEDGE 0x00000002
+#define SOCKET_TCP_INFORMATION_FLAG_TIMESTAMPS           0x00000004
+#define SOCKET_TCP_INFORMATION_FLAG_FAST_RECOVERY        0x00000008
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -686,6 +701,19 @@ Enumeration Description:
         probes to be sent, without response, before the connection is aborted.
         This option takes a ULONG.
 
+    SocketTcpOptionInformation - Indicates that the negotiated options and
+        loss recovery counters of the connection should be retrieved. This
+        option is read only and takes a SOCKET_TCP_INFORMATION structure.
+
+    SocketTcpOptionCongestionControl - Indicates the congestion control
+        algorithm used by the socket. This option takes a ULONG, which is one
+        of the SOCKET_TCP_CONGESTION_ALGORITHM values.
+
+    SocketTcpOptionDefaultCongestionControl - Indicates the congestion control
+        algorithm given to new TCP sockets system-wide. This option takes a
+        ULONG, which is one of the SOCKET_TCP_CONGESTION_ALGORITHM values.
+        Setting it requires the network administrator permission.
+
     SocketTcpOptionCount - Indicates the number of TCP socket options.
 
 --*/
@@ -695,11 +723,106 @@ typedef enum _SOCKET_TCP_OPTION {
     SocketTcpOptionNoDelay,
     SocketTcpOptionKeepAliveTimeout,
     SocketTcpOptionKeepAlivePeriod,
-    SocketTcpOptionKeepAliveProbeLimit
+    SocketTcpOptionKeepAliveProbeLimit,
+    SocketTcpOptionInformation,
+    SocketTcpOptionCongestionControl,
+    SocketTcpOptionDefaultCongestionControl
 } SOCKET_TCP_OPTION, *PSOCKET_TCP_OPTION;
 
 /*++
 
+Enumeration Description:
+
+    This enumeration describes the TCP congestion control algorithms.
+
+Values:
+
+    SocketTcpCongestionNewReno - Indicates the New Reno algorithm, which grows
+        the congestion window by about one segment per round trip and halves
+        it on loss.
+
+    SocketTcpCongestionCubic - Indicates the CUBIC algorithm, which grows the
+        congestion window as a cubic function of the time since the last loss.
+        This suits paths with a large bandwidth-delay product.
+
+    SocketTcpCongestionAlgorithmCount - Indicates the number of congestion
+        control algorithms.
+
+--*/
+
+typedef enum _SOCKET_TCP_CONGESTION_ALGORITHM {
+    SocketTcpCongestionNewReno,
+    SocketTcpCongestionCubic,
+    SocketTcpCongestionAlgorithmCount
+} SOCKET_TCP_CONGESTION_ALGORITHM, *PSOCKET_TCP_CONGESTION_ALGORITHM;
+
+/*++
+
+Structure Description:
+
+    This structure defines the information returned for a TCP socket.
+
+Members:
+
+    Version - Stores the version of the structure. Set this to
+        SOCKET_TCP_INFORMATION_VERSION.
+
+    Flags - Stores a bitmask of options in effect on the connection. See
+        SOCKET_TCP_INFORMATION_FLAG_* definitions.
+
+    SendMaxSegmentSize - Stores the maximum number of data bytes sent in a
+        single segment.
+
+    ReceiveMaxSegmentSize - Stores the maximum segment size advertised to the
+        remote host.
+
+    CongestionWindowSize - Stores the current congestion window, in bytes.
+
+    SlowStartThreshold - Stores the current slow start threshold, in bytes.
+
+    SendWindowSize - Stores the window most recently advertised by the remote
+        host, in bytes.
+
+    RoundTripTime - Stores the smoothed round trip time estimate, in
+        microseconds.
+
+    RetransmitCount - Stores the number of segments sent more than once.
+
+    SelectiveRetransmitCount - Stores the number of retransmissions chosen
+        from the selective acknowledgment scoreboard.
+
+    TimeoutCount - Stores the number of retransmission timeouts.
+
+    SelectiveAcknowledgeBlocksReceived - Stores the number of selective
+        acknowledgment blocks received from the remote host.
+
+    SelectiveAcknowledgeBlocksSent - Stores the number of selective
+        acknowledgment blocks sent to the remote host.
+
+    TimestampSampleCount - Stores the number of round trip time samples
+        taken from echoed timestamps.
+
+--*/
+
+typedef struct _SOCKET_TCP_INFORMATION {
+    ULONG Version;
+    ULONG Flags;
+    ULONG SendMaxSegmentSize;
+    ULONG ReceiveMaxSegmentSize;
+    ULONG CongestionWindowSize;
+    ULONG SlowStartThreshold;
+    ULONG SendWindowSize;
+    ULONG RoundTripTime;
+    ULONGLONG RetransmitCount;
+    ULONGLONG SelectiveRetransmitCount;
+    ULONGLONG TimeoutCount;
+    ULONGLONG SelectiveAcknowledgeBlocksReceived;
+    ULONGLONG SelectiveAcknowledgeBlocksSent;
+    ULONGLONG TimestampSampleCount;
+} SOCKET_TCP_INFORMATION, *PSOCKET_TCP_INFORMATION;
+
+/*++
+
 Structure Description:
 
     This structure defines the common portion of a socket that must be at the
@@ -127,6 +127,7 @@ typedef enum _OBJECT_TYPE {
     ObjectTerminalMaster,
     ObjectTerminalSlave,
     ObjectSharedMemoryObject,
+    ObjectInterestSet,
     ObjectMaxTypes
 } OBJECT_TYPE, *POBJECT_TYPE;
 
@@ -259,6 +259,33 @@ Module Name:
     (POLL_EVENT_IN | POLL_EVENT_IN_HIGH_PRIORITY | POLL_EVENT_OUT | \
      POLL_EVENT_OUT_HIGH_PRIORITY)
 
+//
+// Define interest set registration flags.
+//
+
+//
+// Set this flag to report a registration only when one of its events
+// transitions from clear to set, rather than whenever the events are set.
+//
+
+#define INTEREST_SET_FLAG_EDGE_TRIGGERED 0x00000001
+
+//
+// Set this flag to disable the registration after it is reported once. It can
+// be re-armed with a modify operation.
+//
+
+#define INTEREST_SET_FLAG_ONE_SHOT       0x00000002
+
+#define INTEREST_SET_FLAG_MASK \
+    (INTEREST_SET_FLAG_EDGE_TRIGGERED | INTEREST_SET_FLAG_ONE_SHOT)
+
+//
+// Define the maximum number of events returned by a single interest set wait.
+//
+
+#define INTEREST_SET_MAX_EVENTS 1024
+
 //
 // Define the effective access permission flags.
 //
@@ -351,6 +378,10 @@ typedef enum _SYSTEM_CALL_NUMBER {
     SystemCallSetITimer,
     SystemCallSetResourceLimit,
     SystemCallSetBreak,
+    SystemCallCreateInterestSet,
+    SystemCallControlInterestSet,
+    SystemCallWaitForInterestSet,
+    SystemCallSendFile,
     SystemCallCount
 } SYSTEM_CALL_NUMBER, *PSYSTEM_CALL_NUMBER;
 
@@ -437,6 +468,13 @@ typedef enum _RESOURCE_USAGE_REQUEST {
     ResourceUsageRequestThread,
 } RESOURCE_USAGE_REQUEST, *PRESOURCE_USAGE_REQUEST;
 
+typedef enum _INTEREST_SET_OPERATION {
+    InterestSetOperationInvalid,
+    InterestSetOperationAdd,
+    InterestSetOperationModify,
+    InterestSetOperationDelete
+} INTEREST_SET_OPERATION, *PINTEREST_SET_OPERATION;
+
 //
 // System call parameter structures
 //
@@ -954,6 +992,150 @@ typedef struct _SYSTEM_CALL_POLL {
 
 /*++
 
+Structure Description:
+
+    This structure defines a registration or ready event in an interest set.
+
+Members:
+
+    Data - Stores the caller-defined data associated with the registration.
+        This is handed back verbatim when the registration is ready.
+
+    Events - Stores the bitmask of poll events. When registering, this is the
+        set of events to watch for. When returned from a wait, this is the set
+        of events that are currently signaled. See POLL_EVENT_* definitions.
+
+    Flags - Stores a bitmask of flags governing the registration. See
+        INTEREST_SET_FLAG_* definitions. This is ignored on return.
+
+--*/
+
+typedef struct _INTEREST_SET_EVENT {
+    ULONGLONG Data;
+    ULONG Events;
+    ULONG Flags;
+} INTEREST_SET_EVENT, *PINTEREST_SET_EVENT;
+
+/*++
+
+Structure Description:
+
+    This structure defines the system call parameters for creating a new
+    interest set.
+
+Members:
+
+    OpenFlags - Stores an optional bitfield of open flags for the new set.
+        Only SYS_OPEN_FLAG_CLOSE_ON_EXECUTE is accepted.
+
+    Handle - Stores the returned interest set handle on success.
+
+--*/
+
+typedef struct _SYSTEM_CALL_CREATE_INTEREST_SET {
+    ULONG OpenFlags;
+    HANDLE Handle;
+} SYSCALL_STRUCT SYSTEM_CALL_CREATE_INTEREST_SET,
+    *PSYSTEM_CALL_CREATE_INTEREST_SET;
+
+/*++
+
+Structure Description:
+
+    This structure defines the system call parameters for changing the set of
+    handles registered with an interest set.
+
+Members:
+
+    InterestSet - Stores the handle to the interest set to modify.
+
+    Operation - Stores the operation to perform.
+
+    Handle - Stores the I/O handle whose registration is being changed.
+
+    Event - Stores the events, flags, and data for the registration. This is
+        ignored for delete operations.
+
+--*/
+
+typedef struct _SYSTEM_CALL_CONTROL_INTEREST_SET {
+    HANDLE InterestSet;
+    INTEREST_SET_OPERATION Operation;
+    HANDLE Handle;
+    INTEREST_SET_EVENT Event;
+} SYSCALL_STRUCT SYSTEM_CALL_CONTROL_INTEREST_SET,
+    *PSYSTEM_CALL_CONTROL_INTEREST_SET;
+
+/*++
+
+Structure Description:
+
+    This structure defines the system call parameters for waiting on an
+    interest set.
+
+Members:
+
+    InterestSet - Stores the handle to the interest set to wait on.
+
+    SignalMask - Stores an optional pointer to a signal mask to set for the
+        duration of the wait.
+
+    Events - Stores a pointer to a buffer where the ready registrations will
+        be returned.
+
+    EventCount - Stores the number of elements in the events array.
+
+    TimeoutInMilliseconds - Stores the number of milliseconds to wait for a
+        registration to become ready before giving up.
+
+--*/
+
+typedef struct _SYSTEM_CALL_WAIT_FOR_INTEREST_SET {
+    HANDLE InterestSet;
+    PSIGNAL_SET SignalMask;
+    PINTEREST_SET_EVENT Events;
+    LONG EventCount;
+    ULONG TimeoutInMilliseconds;
+} SYSCALL_STRUCT SYSTEM_CALL_WAIT_FOR_INTEREST_SET,
+    *PSYSTEM_CALL_WAIT_FOR_INTEREST_SET;
+
+/*++
+
+Structure Description:
+
+    This structure defines the system call parameters for transferring data
+    directly from one handle to another.
+
+Members:
+
+    Destination - Stores the handle to write the data to.
+
+    Source - Stores the handle to read the data from. If this is a cached
+        file, its page cache pages are passed directly to the destination.
+
+    DestinationOffset - Stores the offset to write to. Supply IO_OFFSET_NONE
+        to use the destination's current file position. An explicit offset is
+        advanced by the number of bytes written. This is ignored for sockets.
+
+    SourceOffset - Stores the offset to read from. Supply IO_OFFSET_NONE to
+        use and advance the source's current file position. An explicit offset
+        is advanced by the number of bytes transferred, and the file position
+        is left alone.
+
+    Size - Stores the number of bytes to transfer.
+
+--*/
+
+typedef struct _SYSTEM_CALL_SEND_FILE {
+    HANDLE Destination;
+    HANDLE Source;
+    IO_OFFSET DestinationOffset;
+    IO_OFFSET SourceOffset;
+    INTN Size;
+} SYSCALL_STRUCT SYSTEM_CALL_SEND_FILE, *PSYSTEM_CALL_SEND_FILE;
+
+/*++
+
 Structure Description:
 
     This structure defines the system call parameters for creating a new
@@ -2608,6 +2790,10 @@ typedef union _SYSTEM_CALL_PARAMETER_UNION {
     SYSTEM_CALL_SET_ITIMER SetITimer;
     SYSTEM_CALL_SET_RESOURCE_LIMIT SetResourceLimit;
     SYSTEM_CALL_SET_BREAK SetBreak;
+    SYSTEM_CALL_CREATE_INTEREST_SET CreateInterestSet;
+    SYSTEM_CALL_CONTROL_INTEREST_SET ControlInterestSet;
+    SYSTEM_CALL_WAIT_FOR_INTEREST_SET WaitForInterestSet;
+    SYSTEM_CALL_SEND_FILE SendFile;
 } SYSCALL_STRUCT SYSTEM_CALL_PARAMETER_UNION, *PSYSTEM_CALL_PARAMETER_UNION;
 
 typedef
@@ -472,6 +472,11 @@ Structure Description:
     Flags - Stores a bitfield of flags governing the operation of the
         interpreter See CK_CONFIGURATION_* definitions.
 
+    YoungHeapSize - Stores the number of bytes that can be allocated since
+        the last collection before a minor collection is triggered. Minor
+        collections only examine objects created since the previous
+        collection. Set this to zero to make every collection a full one.
+
 --*/
 
 typedef struct _CK_CONFIGURATION {
@@ -486,6 +491,7 @@ typedef struct _CK_CONFIGURATION {
     UINTN MinimumHeapSize;
     ULONG HeapGrowthPercent;
     ULONG Flags;
+    UINTN YoungHeapSize;
 } CK_CONFIGURATION, *PCK_CONFIGURATION;
 
 /*++
@@ -642,8 +648,8 @@ CkCollectGarbage (
 
 Routine Description:
 
-    This routine performs garbage collection on the given Chalk instance,
-    freeing up unused dynamic memory as appropriate.
+    This routine performs a full garbage collection on the given Chalk
+    instance, freeing up unused dynamic memory as appropriate.
 
 Arguments:
 
@@ -651,9 +657,7 @@ Routine Description:
 
 Return Value:
 
-    Returns a pointer to the newly allocated or reallocated memory on success.
-
-    NULL on allocation failure or for free operations.
+    None.
 
 --*/
 
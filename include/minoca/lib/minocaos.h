@@ -106,6 +106,7 @@ typedef enum _OS_X86_PROCESSOR_FEATURE {
     OsX86Sysenter,
     OsX86I686,
     OsX86FxSave,
+    OsX86Sse2,
     OsX86FeatureCount
 } OS_X86_PROCESSOR_FEATURE, *POS_X86_PROCESSOR_FEATURE;
 
@@ -894,6 +895,169 @@ Return Value:
 
 --*/
 
+OS_API
+KSTATUS
+OsCreateInterestSet (
+    ULONG OpenFlags,
+    PHANDLE Handle
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates a new interest set, a persistent collection of I/O
+    handles that can be waited on together.
+
+Arguments:
+
+    OpenFlags - Supplies an optional bitfield of open flags for the new set.
+        Only SYS_OPEN_FLAG_CLOSE_ON_EXECUTE is accepted.
+
+    Handle - Supplies a pointer where the new interest set handle will be
+        returned on success.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+OS_API
+KSTATUS
+OsControlInterestSet (
+    HANDLE InterestSet,
+    INTEREST_SET_OPERATION Operation,
+    HANDLE Handle,
+    PINTEREST_SET_EVENT Event
+    );
+
+/*++
+
+Routine Description:
+
+    This routine adds, modifies, or removes the registration of an I/O handle
+    in an interest set.
+
+Arguments:
+
+    InterestSet - Supplies the handle to the interest set.
+
+    Operation - Supplies the operation to perform.
+
+    Handle - Supplies the I/O handle whose registration is being changed.
+
+    Event - Supplies an optional pointer to the events to watch, registration
+        flags, and caller data. This is required for add and modify
+        operations, and ignored for delete operations.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_FILE_EXISTS if the handle is already registered.
+
+    STATUS_NOT_FOUND if the handle is not registered for modify or delete.
+
+    STATUS_NOT_SUPPORTED if the handle cannot be watched.
+
+    Other error codes on failure.
+
+--*/
+
+OS_API
+KSTATUS
+OsWaitForInterestSet (
+    HANDLE InterestSet,
+    PSIGNAL_SET SignalMask,
+    PINTEREST_SET_EVENT Events,
+    ULONG EventCount,
+    ULONG TimeoutInMilliseconds,
+    PULONG EventsReturned
+    );
+
+/*++
+
+Routine Description:
+
+    This routine waits for one or more handles registered in an interest set
+    to become ready, and returns only the ready registrations.
+
+Arguments:
+
+    InterestSet - Supplies the handle to the interest set to wait on.
+
+    SignalMask - Supplies an optional pointer to a mask to set for the
+        duration of the wait.
+
+    Events - Supplies a pointer to an array where the ready registrations will
+        be returned.
+
+    EventCount - Supplies the number of elements in the events array.
+
+    TimeoutInMilliseconds - Supplies the number of milliseconds to wait before
+        giving up.
+
+    EventsReturned - Supplies a pointer where the number of ready events
+        returned will be stored on success.
+
+Return Value:
+
+    STATUS_SUCCESS if one or more registrations are ready.
+
+    STATUS_INTERRUPTED if a signal was caught during the wait.
+
+    STATUS_TIMEOUT if nothing became ready in the given amount of time.
+
+    STATUS_INVALID_PARAMETER if the event count is zero or more than MAX_LONG.
+
+--*/
+
+OS_API
+KSTATUS
+OsSendFile (
+    HANDLE Destination,
+    HANDLE Source,
+    PIO_OFFSET DestinationOffset,
+    PIO_OFFSET SourceOffset,
+    UINTN Size,
+    PUINTN BytesCompleted
+    );
+
+/*++
+
+Routine Description:
+
+    This routine transfers data from one handle to another without copying it
+    through user mode. If the source is a cached file, its page cache pages
+    are handed to the destination directly.
+
+Arguments:
+
+    Destination - Supplies the handle to write the data to.
+
+    Source - Supplies the handle to read the data from.
+
+    DestinationOffset - Supplies an optional pointer to the offset to write
+        to. On output, this is advanced by the number of bytes written. Supply
+        NULL to use the destination's current file position.
+
+    SourceOffset - Supplies an optional pointer to the offset to read from.
+        On output, this is advanced by the number of bytes transferred, and
+        the source's file position is not changed. Supply NULL to use and
+        advance the source's current file position.
+
+    Size - Supplies the number of bytes to transfer.
+
+    BytesCompleted - Supplies a pointer where the number of bytes transferred
+        will be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
 OS_API
 PSIGNAL_HANDLER_ROUTINE
 OsSetSignalHandler (
@@ -2623,6 +2787,29 @@ Return Value:
 
 --*/
 
+OS_API
+VOID
+OsGetHeapStatistics (
+    PMEMORY_HEAP_STATISTICS Statistics
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the statistics for the heap, summed across all heap
+    arenas. Blocks held in thread caches are counted as allocated.
+
+Arguments:
+
+    Statistics - Supplies a pointer where the heap statistics will be returned.
+
+Return Value:
+
+    None.
+
+--*/
+
 OS_API
 PPROCESS_ENVIRONMENT
 OsCreateEnvironment (
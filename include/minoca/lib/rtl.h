@@ -461,6 +461,24 @@ Module Name:
 
 #define SYSTEM_TIME_TO_EPOCH_DELTA (978307200LL)
 
+//
+// Define the vector features the memory routines (RtlCopyMemory,
+// RtlZeroMemory, RtlCompareMemory, etc.) may use. These are off by default,
+// since kernel mode does not preserve the vector registers.
+//
+
+//
+// Set this flag to allow the x86 and x64 memory routines to use SSE2.
+//
+
+#define RTL_MEMORY_FEATURE_SSE2 0x00000001
+
+//
+// Set this flag to allow the ARM memory routines to use NEON.
+//
+
+#define RTL_MEMORY_FEATURE_NEON 0x00000002
+
 //
 // Define memory heap flags.
 //
@@ -1269,6 +1287,10 @@ Structure Description:
     TotalFreeCalls - Stores the number of calls to free memory since the heap's
         initialization.
 
+    LockContentions - Stores the number of times a caller had to wait for the
+        lock protecting the heap. The heap itself is not synchronized, so this
+        is maintained by the owner of the heap.
+
 --*/
 
 typedef struct _MEMORY_HEAP_STATISTICS {
@@ -1280,6 +1302,7 @@ typedef struct _MEMORY_HEAP_STATISTICS {
     UINTN TotalAllocationCalls;
     UINTN FailedAllocations;
     UINTN TotalFreeCalls;
+    UINTN LockContentions;
 } MEMORY_HEAP_STATISTICS, *PMEMORY_HEAP_STATISTICS;
 
 /*++
@@ -3249,6 +3272,31 @@ Return Value:
 
 --*/
 
+RTL_API
+ULONG
+RtlSetMemoryFeatures (
+    ULONG Features
+    );
+
+/*++
+
+Routine Description:
+
+    This routine sets the vector features the memory routines are allowed to
+    use. The caller is responsible for making sure the processor supports
+    them and that the environment preserves the vector registers.
+
+Arguments:
+
+    Features - Supplies the new bitfield of allowed features. See
+        RTL_MEMORY_FEATURE_* definitions.
+
+Return Value:
+
+    Returns the previous bitfield of allowed features.
+
+--*/
+
 RTL_API
 BOOL
 RtlAreUuidsEqual (
@@ -5734,6 +5782,65 @@ Return Value:
 
 --*/
 
+RTL_API
+UINTN
+RtlHeapGetAllocationSize (
+    PMEMORY_HEAP Heap,
+    PVOID Memory
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the usable size of an allocation made from the given
+    heap. The heap is not modified, so this routine may be called without
+    synchronizing with the heap as long as the caller owns the allocation.
+
+Arguments:
+
+    Heap - Supplies the heap to check the allocation against.
+
+    Memory - Supplies the allocation created by the heap allocation routine.
+
+Return Value:
+
+    Returns the number of bytes usable in the allocation, which is at least as
+    large as the size originally requested.
+
+    0 if the allocation was not made from the given heap.
+
+--*/
+
+RTL_API
+BOOL
+RtlHeapValidateAllocation (
+    PMEMORY_HEAP Heap,
+    PVOID Memory
+    );
+
+/*++
+
+Routine Description:
+
+    This routine performs the same checks on an allocation that freeing it
+    would, without freeing it. The heap's corruption routine is called if the
+    allocation is bad. This routine assumes the heap lock is already held.
+
+Arguments:
+
+    Heap - Supplies the heap the allocation was made from.
+
+    Memory - Supplies the allocation created by the heap allocation routine.
+
+Return Value:
+
+    TRUE if the allocation is in use and intact.
+
+    FALSE if the allocation is corrupt or has already been freed.
+
+--*/
+
 RTL_API
 VOID
 RtlHeapProfilerGetStatistics (
@@ -134,7 +134,14 @@ Module Name:
 // Define the current version number of the net link properties structure.
 //
 
-#define NET_LINK_PROPERTIES_VERSION 1
+#define NET_LINK_PROPERTIES_VERSION 2
+
+//
+// Define the current version number of the socket lookup statistics
+// structure.
+//
+
+#define NET_SOCKET_LOOKUP_STATISTICS_VERSION 1
 
 //
 // Define some common network link speeds.
@@ -205,6 +212,7 @@ Module Name:
 #define NET_PACKET_FLAG_FORCE_TRANSMIT       0x00000040
 #define NET_PACKET_FLAG_UNENCRYPTED          0x00000080
 #define NET_PACKET_FLAG_MULTICAST            0x00000100
+#define NET_PACKET_FLAG_TCP_SEGMENTATION     0x00000200
 
 //
 // Define the network link feature flags.
@@ -227,6 +235,27 @@ Module Name:
      NET_LINK_CHECKSUM_FLAG_RECEIVE_UDP_OFFLOAD |   \
      NET_LINK_CHECKSUM_FLAG_RECEIVE_TCP_OFFLOAD)
 
+//
+// Define the network link offload flags. A link that can segment TCP packets
+// is handed packets marked with NET_PACKET_FLAG_TCP_SEGMENTATION, whose
+// payload it must split into segments of the packet's segment size. Each
+// segment gets a copy of the network and TCP headers with the lengths,
+// sequence number, and checksums adjusted, and only the last one keeps the
+// FIN and PUSH flags. Links that set the receive coalescing flag promise to
+// call NetFlushReceivedPackets after each batch of received packets, which
+// lets protocols merge consecutive packets of a batch before processing them.
+//
+
+#define NET_LINK_OFFLOAD_FLAG_TRANSMIT_TCP_SEGMENTATION 0x00000001
+#define NET_LINK_OFFLOAD_FLAG_RECEIVE_COALESCING        0x00000002
+
+//
+// Define the largest packet, from the network header through the end of the
+// payload, that can be handed to a link for segmentation.
+//
+
+#define NET_SEGMENTATION_MAX_SIZE 0xFFFF
+
 //
 // Define the network packet size information flags.
 //
@@ -374,6 +403,10 @@ Structure Description:
         beginning of the footer data (ie the location to store the first byte
         of new footer).
 
+    SegmentSize - Stores the maximum payload size of each segment the packet
+        is split into by the link. This is only valid if the TCP segmentation
+        flag is set.
+
 --*/
 
 typedef struct _NET_PACKET_BUFFER {
@@ -386,6 +419,7 @@ typedef struct _NET_PACKET_BUFFER {
     ULONG DataSize;
     ULONG DataOffset;
     ULONG FooterOffset;
+    ULONG SegmentSize;
 } NET_PACKET_BUFFER, *PNET_PACKET_BUFFER;
 
 /*++
@@ -556,6 +590,10 @@ Structure Description:
         checksum features are enabled. See NET_LINK_CHECKSUM_FLAG_* for
         definitions.
 
+    OffloadFlags - Stores a bitmask of flags indicating which segmentation and
+        coalescing features the link supports. See NET_LINK_OFFLOAD_FLAG_* for
+        definitions.
+
     DataLinkType - Stores the type of the data link layer used by the network
         link.
 
@@ -576,6 +614,7 @@ typedef struct _NET_LINK_PROPERTIES {
     PVOID DeviceContext;
     NET_PACKET_SIZE_INFORMATION PacketSizeInformation;
     ULONG ChecksumFlags;
+    ULONG OffloadFlags;
     NET_DOMAIN_TYPE DataLinkType;
     PHYSICAL_ADDRESS MaxPhysicalAddress;
     NETWORK_ADDRESS PhysicalAddress;
@@ -938,6 +977,8 @@ typedef struct _NET_LINK_LOCAL_ADDRESS {
 
 typedef struct _NET_PROTOCOL_ENTRY NET_PROTOCOL_ENTRY, *PNET_PROTOCOL_ENTRY;
 typedef struct _NET_NETWORK_ENTRY NET_NETWORK_ENTRY, *PNET_NETWORK_ENTRY;
+typedef struct _NET_SOCKET_HASH_TABLE
+    NET_SOCKET_HASH_TABLE, *PNET_SOCKET_HASH_TABLE;
 
 /*++
 
@@ -968,6 +1009,9 @@ Structure Description:
     ListEntry - Stores the information about this socket in the list of sockets.
         This is only used for raw sockets; they do not get inserted in a tree.
 
+    HashEntry - Stores pointers to the next and previous sockets in the
+        protocol's hash bucket. This is only used for fully bound sockets.
+
     BindingType - Stores the type of binding for this socket (unbound, locally
         bound, or fully bound).
 
@@ -1011,6 +1055,7 @@ typedef struct _NET_SOCKET {
         LIST_ENTRY ListEntry;
     } U;
 
+    LIST_ENTRY HashEntry;
     NET_SOCKET_BINDING_TYPE BindingType;
     volatile ULONG Flags;
     NET_PACKET_SIZE_INFORMATION PacketSizeInformation;
@@ -1025,6 +1070,46 @@ typedef struct _NET_SOCKET {
 
 /*++
 
+Structure Description:
+
+    This structure defines the statistics for finding the socket that an
+    incoming packet belongs to.
+
+Members:
+
+    Version - Stores the version of the structure. The caller should set this
+        to NET_SOCKET_LOOKUP_STATISTICS_VERSION.
+
+    BucketCount - Stores the number of buckets in the protocol's hash table of
+        fully bound sockets.
+
+    SocketCount - Stores the number of fully bound sockets in the hash table.
+
+    LongestChain - Stores the number of sockets in the fullest bucket.
+
+    Lookups - Stores the number of socket lookups performed.
+
+    HashHits - Stores the number of lookups satisfied by the hash table. The
+        remaining lookups fell back to searching the socket trees.
+
+    Comparisons - Stores the total number of hashed sockets compared against
+        the lookup address. Divide by the number of lookups to get the average
+        chain walk.
+
+--*/
+
+typedef struct _NET_SOCKET_LOOKUP_STATISTICS {
+    ULONG Version;
+    ULONG BucketCount;
+    ULONG SocketCount;
+    ULONG LongestChain;
+    ULONGLONG Lookups;
+    ULONGLONG HashHits;
+    ULONGLONG Comparisons;
+} NET_SOCKET_LOOKUP_STATISTICS, *PNET_SOCKET_LOOKUP_STATISTICS;
+
+/*++
+
 Structure Description:
 
     This structure defines a core networking socket link override. This stores
@@ -1523,6 +1608,30 @@ Return Value:
 
 --*/
 
+typedef
+VOID
+(*PNET_PROTOCOL_FLUSH_RECEIVED_DATA) (
+    PNET_LINK Link
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called when a link that coalesces received packets has
+    finished delivering a batch. The protocol must process any received
+    packets it is still holding on to.
+
+Arguments:
+
+    Link - Supplies a pointer to the link that finished the batch.
+
+Return Value:
+
+    None.
+
+--*/
+
 /*++
 
 Structure Description:
@@ -1572,6 +1681,10 @@ Structure Description:
     UserControl - Stores a pointer to a function used to respond to user
         control (ioctl) requests.
 
+    FlushReceivedData - Stores an optional pointer to a function called at the
+        end of each batch of packets received on a link that coalesces
+        received packets.
+
 --*/
 
 typedef struct _NET_PROTOCOL_INTERFACE {
@@ -1589,6 +1702,7 @@ typedef struct _NET_PROTOCOL_INTERFACE {
     PNET_PROTOCOL_RECEIVE Receive;
     PNET_PROTOCOL_GET_SET_INFORMATION GetSetInformation;
     PNET_PROTOCOL_USER_CONTROL UserControl;
+    PNET_PROTOCOL_FLUSH_RECEIVED_DATA FlushReceivedData;
 } NET_PROTOCOL_INTERFACE, *PNET_PROTOCOL_INTERFACE;
 
 /*++
@@ -1607,10 +1721,13 @@ Structure Description:
     ParentProtocolNumber - Stores the protocol number in the parent layer's
         protocol.
 
-    LastSocket - Stores a pointer to the last socket that received a packet.
+    SocketHashTable - Stores a pointer to the hash table of fully bound
+        sockets, keyed by the local and remote address. This is owned by the
+        core networking library; protocols should initialize it to NULL.
 
     SocketLock - Stores a pointer to a shared exclusive lock that protects the
-        socket trees.
+        socket trees. It must also be held exclusively to add or remove
+        sockets from the hash table.
 
     SocketTree - Stores an array of Red Black Trees, one each for fully bound,
         locally bound, and unbound sockets.
@@ -1624,7 +1741,7 @@ struct _NET_PROTOCOL_ENTRY {
     LIST_ENTRY ListEntry;
     NET_SOCKET_TYPE Type;
     ULONG ParentProtocolNumber;
-    volatile PNET_SOCKET LastSocket;
+    PNET_SOCKET_HASH_TABLE SocketHashTable;
     PSHARED_EXCLUSIVE_LOCK SocketLock;
     RED_BLACK_TREE SocketTree[SocketBindingTypeCount];
     NET_PROTOCOL_INTERFACE Interface;
@@ -2331,6 +2448,31 @@ Return Value:
 
 --*/
 
+NET_API
+VOID
+NetFlushReceivedPackets (
+    PNET_LINK Link
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called by low level NIC drivers that set the receive
+    coalescing offload flag after they have passed a batch of received packets
+    to the core networking library. It gives protocols that held on to
+    packets to merge them a chance to finish processing them.
+
+Arguments:
+
+    Link - Supplies a pointer to the link that received the packets.
+
+Return Value:
+
+    None.
+
+--*/
+
 NET_API
 BOOL
 NetGetGlobalDebugFlag (
@@ -3038,6 +3180,37 @@ Return Value:
 
 --*/
 
+NET_API
+KSTATUS
+NetGetSocketLookupStatistics (
+    PNET_PROTOCOL_ENTRY ProtocolEntry,
+    PNET_SOCKET_LOOKUP_STATISTICS Statistics
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns statistics about how packets have been matched to
+    sockets for the given protocol.
+
+Arguments:
+
+    ProtocolEntry - Supplies the protocol to get statistics for.
+
+    Statistics - Supplies a pointer where the statistics will be returned. The
+        caller must initialize the version field.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_VERSION_MISMATCH if the structure version is not supported.
+
+    STATUS_NOT_SUPPORTED if the protocol does not hash its sockets.
+
+--*/
+
 NET_API
 KSTATUS
 NetGetSetNetworkDeviceInformation (
@@ -0,0 +1,950 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    blkqueue.c
+
+Abstract:
+
+    This module implements the block request queue, which block device
+    drivers can put between themselves and their hardware. The queue holds
+    read and write IRPs while the device is busy, hands them to the driver in
+    elevator order (with deadlines so nothing starves), merges requests for
+    adjacent blocks, and keeps statistics on queue depth and latency.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/kernel/kernel.h>
+#include "iop.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define BLOCK_QUEUE_ALLOCATION_TAG 0x516B6C42 // 'QklB'
+
+//
+// Define the default number of milliseconds a read or write can wait in the
+// queue before it is dispatched ahead of the elevator. Reads get a shorter
+// deadline since a thread is usually blocked waiting on them, whereas most
+// writes come from the page cache flushing in the background.
+//
+
+#define BLOCK_QUEUE_DEFAULT_READ_DEADLINE 500
+#define BLOCK_QUEUE_DEFAULT_WRITE_DEADLINE 5000
+
+#define MICROSECONDS_PER_MILLISECOND 1000ULL
+#define MICROSECONDS_PER_SECOND 1000000ULL
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure defines a block request queue.
+
+Members:
+
+    Lock - Stores the spin lock protecting the queue. It is acquired at
+        dispatch level since requests complete from DPCs.
+
+    Driver - Stores a pointer to the driver that owns the queue.
+
+    StartRequest - Stores a pointer to the driver's start request routine.
+
+    Context - Stores the driver's context pointer.
+
+    QueueDepth - Stores the maximum number of requests in flight at once.
+
+    BlockSize - Stores the block size of the device, in bytes.
+
+    MaxTransferSize - Stores the maximum size of a merged request, in bytes,
+        or zero for no limit.
+
+    MaxSegments - Stores the maximum number of IRPs in a merged request.
+
+    ReadDeadline - Stores the read deadline, in time counter ticks.
+
+    WriteDeadline - Stores the write deadline, in time counter ticks.
+
+    SortedListHead - Stores the head of the list of pending requests, sorted
+        by offset.
+
+    ReadFifoListHead - Stores the head of the list of pending reads in arrival
+        order.
+
+    WriteFifoListHead - Stores the head of the list of pending writes in
+        arrival order.
+
+    HeadPosition - Stores the device offset just past the last request that
+        was started. The elevator sweeps upwards from here.
+
+    Statistics - Stores the queue statistics. The times are kept in time
+        counter ticks and converted when queried.
+
+--*/
+
+struct _IO_BLOCK_QUEUE {
+    KSPIN_LOCK Lock;
+    PDRIVER Driver;
+    PIO_BLOCK_QUEUE_START_REQUEST StartRequest;
+    PVOID Context;
+    ULONG QueueDepth;
+    ULONG BlockSize;
+    UINTN MaxTransferSize;
+    ULONG MaxSegments;
+    ULONGLONG ReadDeadline;
+    ULONGLONG WriteDeadline;
+    LIST_ENTRY SortedListHead;
+    LIST_ENTRY ReadFifoListHead;
+    LIST_ENTRY WriteFifoListHead;
+    IO_OFFSET HeadPosition;
+    IO_BLOCK_QUEUE_STATISTICS Statistics;
+};
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+PIO_BLOCK_REQUEST
+IopSelectBlockRequest (
+    PIO_BLOCK_QUEUE Queue,
+    ULONGLONG CurrentTime
+    );
+
+BOOL
+IopCanMergeBlockRequests (
+    PIO_BLOCK_QUEUE Queue,
+    PIO_BLOCK_REQUEST Lower,
+    PIO_BLOCK_REQUEST Upper,
+    UINTN TransferSize,
+    ULONG SegmentCount
+    );
+
+ULONGLONG
+IopConvertTimeCounterToMicroseconds (
+    ULONGLONG TimeCounter,
+    ULONGLONG Frequency
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+KERNEL_API
+KSTATUS
+IoCreateBlockQueue (
+    PIO_BLOCK_QUEUE_PARAMETERS Parameters,
+    PIO_BLOCK_QUEUE *Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates a block request queue, which sits between a block
+    device driver and its hardware. The queue holds read and write IRPs while
+    the device is busy, sorts them by offset, merges requests for adjacent
+    blocks, and keeps up to the device's queue depth of requests in flight.
+
+Arguments:
+
+    Parameters - Supplies a pointer to the queue parameters.
+
+    Queue - Supplies a pointer where a pointer to the new queue will be
+        returned on success.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_PARAMETER if the parameters are invalid.
+
+    STATUS_INSUFFICIENT_RESOURCES on allocation failure.
+
+--*/
+
+{
+
+    ULONG Deadline;
+    PIO_BLOCK_QUEUE NewQueue;
+
+    *Queue = NULL;
+    if ((Parameters->Version < IO_BLOCK_QUEUE_PARAMETERS_VERSION) ||
+        (Parameters->Driver == NULL) ||
+        (Parameters->StartRequest == NULL) ||
+        (Parameters->QueueDepth == 0) ||
+        (Parameters->BlockSize == 0)) {
+
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    NewQueue = MmAllocateNonPagedPool(sizeof(IO_BLOCK_QUEUE),
+                                      BLOCK_QUEUE_ALLOCATION_TAG);
+
+    if (NewQueue == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(NewQueue, sizeof(IO_BLOCK_QUEUE));
+    KeInitializeSpinLock(&(NewQueue->Lock));
+    NewQueue->Driver = Parameters->Driver;
+    NewQueue->StartRequest = Parameters->StartRequest;
+    NewQueue->Context = Parameters->Context;
+    NewQueue->QueueDepth = Parameters->QueueDepth;
+    NewQueue->BlockSize = Parameters->BlockSize;
+    NewQueue->MaxTransferSize = Parameters->MaxTransferSize;
+    NewQueue->MaxSegments = Parameters->MaxSegments;
+    if (NewQueue->MaxSegments == 0) {
+        NewQueue->MaxSegments = 1;
+    }
+
+    Deadline = Parameters->ReadDeadline;
+    if (Deadline == 0) {
+        Deadline = BLOCK_QUEUE_DEFAULT_READ_DEADLINE;
+    }
+
+    NewQueue->ReadDeadline = KeConvertMicrosecondsToTimeTicks(
+                                   Deadline * MICROSECONDS_PER_MILLISECOND);
+
+    Deadline = Parameters->WriteDeadline;
+    if (Deadline == 0) {
+        Deadline = BLOCK_QUEUE_DEFAULT_WRITE_DEADLINE;
+    }
+
+    NewQueue->WriteDeadline = KeConvertMicrosecondsToTimeTicks(
+                                   Deadline * MICROSECONDS_PER_MILLISECOND);
+
+    INITIALIZE_LIST_HEAD(&(NewQueue->SortedListHead));
+    INITIALIZE_LIST_HEAD(&(NewQueue->ReadFifoListHead));
+    INITIALIZE_LIST_HEAD(&(NewQueue->WriteFifoListHead));
+    NewQueue->Statistics.Version = IO_BLOCK_QUEUE_STATISTICS_VERSION;
+    NewQueue->Statistics.QueueDepth = NewQueue->QueueDepth;
+    *Queue = NewQueue;
+    return STATUS_SUCCESS;
+}
+
+KERNEL_API
+VOID
+IoDestroyBlockQueue (
+    PIO_BLOCK_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys a block request queue. Any IRPs still waiting in the
+    queue are completed with STATUS_DEVICE_NOT_CONNECTED. There must be no
+    requests in flight.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PIRP Irp;
+    LIST_ENTRY ListHead;
+    RUNLEVEL OldRunLevel;
+    PIO_BLOCK_REQUEST Request;
+
+    //
+    // Pull everything off the queue under the lock, then complete the IRPs
+    // outside of it.
+    //
+
+    INITIALIZE_LIST_HEAD(&ListHead);
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Queue->Lock));
+
+    ASSERT(Queue->Statistics.InFlight == 0);
+
+    if (!LIST_EMPTY(&(Queue->SortedListHead))) {
+        MOVE_LIST(&(Queue->SortedListHead), &ListHead);
+        INITIALIZE_LIST_HEAD(&(Queue->SortedListHead));
+    }
+
+    INITIALIZE_LIST_HEAD(&(Queue->ReadFifoListHead));
+    INITIALIZE_LIST_HEAD(&(Queue->WriteFifoListHead));
+    Queue->Statistics.Pending = 0;
+    KeReleaseSpinLock(&(Queue->Lock));
+    KeLowerRunLevel(OldRunLevel);
+    while (!LIST_EMPTY(&ListHead)) {
+        Request = LIST_VALUE(ListHead.Next, IO_BLOCK_REQUEST, ListEntry);
+        LIST_REMOVE(&(Request->ListEntry));
+        Irp = Request->Irp;
+        MmFreeNonPagedPool(Request);
+        IoCompleteIrp(Queue->Driver, Irp, STATUS_DEVICE_NOT_CONNECTED);
+    }
+
+    MmFreeNonPagedPool(Queue);
+    return;
+}
+
+KERNEL_API
+KSTATUS
+IoSubmitBlockQueueIrp (
+    PIO_BLOCK_QUEUE Queue,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine submits a read or write IRP to a block request queue. The
+    driver should call this from its dispatch I/O routine on the way down,
+    after preparing the IRP's I/O buffer. On success the IRP is pended, and
+    the queue completes it once the device has finished with it. This routine
+    must be called at low level.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+    Irp - Supplies a pointer to the read or write IRP to submit.
+
+Return Value:
+
+    STATUS_SUCCESS if the IRP was queued.
+
+    STATUS_INSUFFICIENT_RESOURCES on allocation failure. The caller still
+    owns the IRP and should complete it.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PIO_BLOCK_REQUEST Existing;
+    RUNLEVEL OldRunLevel;
+    PIO_BLOCK_REQUEST Request;
+    PIO_BLOCK_QUEUE_STATISTICS Statistics;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+    ASSERT(Irp->MajorCode == IrpMajorIo);
+    ASSERT(Irp->Direction == IrpDown);
+    ASSERT(Irp->U.ReadWrite.IoBytesCompleted == 0);
+    ASSERT(Irp->U.ReadWrite.IoSizeInBytes != 0);
+    ASSERT(IS_ALIGNED(Irp->U.ReadWrite.IoOffset, Queue->BlockSize) != FALSE);
+    ASSERT(IS_ALIGNED(Irp->U.ReadWrite.IoSizeInBytes, Queue->BlockSize) !=
+           FALSE);
+
+    Request = MmAllocateNonPagedPool(sizeof(IO_BLOCK_REQUEST),
+                                     BLOCK_QUEUE_ALLOCATION_TAG);
+
+    if (Request == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(Request, sizeof(IO_BLOCK_REQUEST));
+    Request->Irp = Irp;
+    Request->Offset = Irp->U.ReadWrite.IoOffset;
+    Request->Size = Irp->U.ReadWrite.IoSizeInBytes;
+    Request->Write = FALSE;
+    if (Irp->MinorCode == IrpMinorIoWrite) {
+        Request->Write = TRUE;
+    }
+
+    IoPendIrp(Queue->Driver, Irp);
+    Request->SubmitTime = HlQueryTimeCounter();
+    if (Request->Write != FALSE) {
+        Request->Deadline = Request->SubmitTime + Queue->WriteDeadline;
+
+    } else {
+        Request->Deadline = Request->SubmitTime + Queue->ReadDeadline;
+    }
+
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Queue->Lock));
+
+    //
+    // Insert the request in offset order. Sequential I/O usually lands at the
+    // end, so search backwards.
+    //
+
+    CurrentEntry = Queue->SortedListHead.Previous;
+    while (CurrentEntry != &(Queue->SortedListHead)) {
+        Existing = LIST_VALUE(CurrentEntry, IO_BLOCK_REQUEST, ListEntry);
+        if (Existing->Offset <= Request->Offset) {
+            break;
+        }
+
+        CurrentEntry = CurrentEntry->Previous;
+    }
+
+    INSERT_AFTER(&(Request->ListEntry), CurrentEntry);
+    if (Request->Write != FALSE) {
+        INSERT_BEFORE(&(Request->FifoListEntry),
+                      &(Queue->WriteFifoListHead));
+
+    } else {
+        INSERT_BEFORE(&(Request->FifoListEntry), &(Queue->ReadFifoListHead));
+    }
+
+    Statistics = &(Queue->Statistics);
+    Statistics->Pending += 1;
+    if (Statistics->Pending > Statistics->MaxPending) {
+        Statistics->MaxPending = Statistics->Pending;
+    }
+
+    KeReleaseSpinLock(&(Queue->Lock));
+    KeLowerRunLevel(OldRunLevel);
+    IoPumpBlockQueue(Queue);
+    return STATUS_SUCCESS;
+}
+
+KERNEL_API
+VOID
+IoCompleteBlockQueueRequest (
+    PIO_BLOCK_QUEUE Queue,
+    PIO_BLOCK_REQUEST Request,
+    KSTATUS Status
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called by a driver when a request started by the block
+    request queue has finished. It completes every IRP in the request. This
+    routine can be called at or below dispatch level. The queue does not
+    start the next request from here; the driver should call
+    IoPumpBlockQueue from its dispatch I/O routine as the IRPs head back up.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+    Request - Supplies a pointer to the first segment of the finished request.
+        The request's bytes completed field should be filled in. The request
+        is freed by this routine.
+
+    Status - Supplies the completion status of the request.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN BytesCompleted;
+    ULONGLONG CurrentTime;
+    PIRP Irp;
+    ULONGLONG Latency;
+    PIO_BLOCK_REQUEST NextSegment;
+    RUNLEVEL OldRunLevel;
+    PIO_BLOCK_REQUEST Segment;
+    UINTN SegmentBytes;
+    PIO_BLOCK_QUEUE_STATISTICS Statistics;
+
+    ASSERT(KeGetRunLevel() <= RunLevelDispatch);
+    ASSERT(Request->BytesCompleted <= Request->TransferSize);
+
+    CurrentTime = HlQueryTimeCounter();
+    Statistics = &(Queue->Statistics);
+    BytesCompleted = Request->BytesCompleted;
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Queue->Lock));
+
+    ASSERT(Statistics->InFlight != 0);
+
+    Statistics->InFlight -= 1;
+    Segment = Request;
+    while (Segment != NULL) {
+        SegmentBytes = Segment->Size;
+        if (SegmentBytes > BytesCompleted) {
+            SegmentBytes = BytesCompleted;
+        }
+
+        BytesCompleted -= SegmentBytes;
+        Segment->Irp->U.ReadWrite.IoBytesCompleted = SegmentBytes;
+        Segment->Irp->U.ReadWrite.NewIoOffset = Segment->Offset + SegmentBytes;
+        if (Segment->Write != FALSE) {
+            Statistics->Writes += 1;
+            Statistics->BytesWritten += SegmentBytes;
+
+        } else {
+            Statistics->Reads += 1;
+            Statistics->BytesRead += SegmentBytes;
+        }
+
+        if (!KSUCCESS(Status)) {
+            Statistics->Errors += 1;
+        }
+
+        Latency = CurrentTime - Segment->SubmitTime;
+        Statistics->TotalLatency += Latency;
+        if (Latency > Statistics->MaxLatency) {
+            Statistics->MaxLatency = Latency;
+        }
+
+        Segment = Segment->NextSegment;
+    }
+
+    KeReleaseSpinLock(&(Queue->Lock));
+    KeLowerRunLevel(OldRunLevel);
+
+    //
+    // Complete the IRPs. Each one wakes the thread that sent it, which drives
+    // it back up through the driver at low level.
+    //
+
+    Segment = Request;
+    while (Segment != NULL) {
+        NextSegment = Segment->NextSegment;
+        Irp = Segment->Irp;
+        MmFreeNonPagedPool(Segment);
+        IoCompleteIrp(Queue->Driver, Irp, Status);
+        Segment = NextSegment;
+    }
+
+    return;
+}
+
+KERNEL_API
+VOID
+IoPumpBlockQueue (
+    PIO_BLOCK_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine starts as many waiting requests as the device's queue depth
+    allows. This routine must be called at low level.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RUNLEVEL OldRunLevel;
+    PIO_BLOCK_REQUEST Request;
+    PIO_BLOCK_QUEUE_STATISTICS Statistics;
+    KSTATUS Status;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    Statistics = &(Queue->Statistics);
+    while (TRUE) {
+        OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+        KeAcquireSpinLock(&(Queue->Lock));
+        Request = NULL;
+        if ((Statistics->InFlight < Queue->QueueDepth) &&
+            (!LIST_EMPTY(&(Queue->SortedListHead)))) {
+
+            Request = IopSelectBlockRequest(Queue, HlQueryTimeCounter());
+            Statistics->InFlight += 1;
+            if (Statistics->InFlight > Statistics->MaxInFlight) {
+                Statistics->MaxInFlight = Statistics->InFlight;
+            }
+        }
+
+        KeReleaseSpinLock(&(Queue->Lock));
+        KeLowerRunLevel(OldRunLevel);
+        if (Request == NULL) {
+            break;
+        }
+
+        Status = Queue->StartRequest(Queue, Request, Queue->Context);
+        if (!KSUCCESS(Status)) {
+            IoCompleteBlockQueueRequest(Queue, Request, Status);
+        }
+    }
+
+    return;
+}
+
+KERNEL_API
+KSTATUS
+IoGetBlockQueueStatistics (
+    PIO_BLOCK_QUEUE Queue,
+    PIO_BLOCK_QUEUE_STATISTICS Statistics
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns a snapshot of a block request queue's statistics.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+    Statistics - Supplies a pointer where the statistics will be returned.
+        The caller should set the version field.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_VERSION_MISMATCH if the statistics version is not supported.
+
+--*/
+
+{
+
+    ULONGLONG Frequency;
+    RUNLEVEL OldRunLevel;
+
+    if (Statistics->Version < IO_BLOCK_QUEUE_STATISTICS_VERSION) {
+        return STATUS_VERSION_MISMATCH;
+    }
+
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Queue->Lock));
+    RtlCopyMemory(Statistics,
+                  &(Queue->Statistics),
+                  sizeof(IO_BLOCK_QUEUE_STATISTICS));
+
+    KeReleaseSpinLock(&(Queue->Lock));
+    KeLowerRunLevel(OldRunLevel);
+    Frequency = HlQueryTimeCounterFrequency();
+    Statistics->TotalWaitTime =
+           IopConvertTimeCounterToMicroseconds(Statistics->TotalWaitTime,
+                                               Frequency);
+
+    Statistics->TotalLatency =
+            IopConvertTimeCounterToMicroseconds(Statistics->TotalLatency,
+                                                Frequency);
+
+    Statistics->MaxLatency =
+              IopConvertTimeCounterToMicroseconds(Statistics->MaxLatency,
+                                                  Frequency);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+PIO_BLOCK_REQUEST
+IopSelectBlockRequest (
+    PIO_BLOCK_QUEUE Queue,
+    ULONGLONG CurrentTime
+    )
+
+/*++
+
+Routine Description:
+
+    This routine picks the next request to start, removes it from the queue,
+    and merges any adjacent requests into it. Normally this sweeps upward
+    through the device in offset order, wrapping back to the lowest offset at
+    the end. If the oldest read or write has passed its deadline, that one
+    goes first instead. This routine assumes the queue lock is held.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+    CurrentTime - Supplies the current time counter value.
+
+Return Value:
+
+    Returns a pointer to the first segment of the request to start.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PIO_BLOCK_REQUEST First;
+    PIO_BLOCK_REQUEST Last;
+    PIO_BLOCK_REQUEST Neighbor;
+    PIO_BLOCK_REQUEST OldestRead;
+    PIO_BLOCK_REQUEST OldestWrite;
+    PIO_BLOCK_REQUEST Request;
+    PIO_BLOCK_REQUEST Segment;
+    ULONG SegmentCount;
+    PIO_BLOCK_QUEUE_STATISTICS Statistics;
+    UINTN TransferSize;
+
+    ASSERT(!LIST_EMPTY(&(Queue->SortedListHead)));
+
+    Statistics = &(Queue->Statistics);
+
+    //
+    // Check the deadlines first. The lists are in arrival order, so only the
+    // oldest of each kind needs a look.
+    //
+
+    Request = NULL;
+    OldestRead = NULL;
+    OldestWrite = NULL;
+    if (!LIST_EMPTY(&(Queue->ReadFifoListHead))) {
+        OldestRead = LIST_VALUE(Queue->ReadFifoListHead.Next,
+                                IO_BLOCK_REQUEST,
+                                FifoListEntry);
+
+        if (OldestRead->Deadline <= CurrentTime) {
+            Request = OldestRead;
+        }
+    }
+
+    if (!LIST_EMPTY(&(Queue->WriteFifoListHead))) {
+        OldestWrite = LIST_VALUE(Queue->WriteFifoListHead.Next,
+                                 IO_BLOCK_REQUEST,
+                                 FifoListEntry);
+
+        if ((OldestWrite->Deadline <= CurrentTime) &&
+            ((Request == NULL) ||
+             (OldestWrite->Deadline < Request->Deadline))) {
+
+            Request = OldestWrite;
+        }
+    }
+
+    if (Request != NULL) {
+        Statistics->DeadlineDispatches += 1;
+
+    //
+    // Otherwise take the first request at or above the head position, or
+    // wrap around to the lowest one.
+    //
+
+    } else {
+        CurrentEntry = Queue->SortedListHead.Next;
+        while (CurrentEntry != &(Queue->SortedListHead)) {
+            Request = LIST_VALUE(CurrentEntry, IO_BLOCK_REQUEST, ListEntry);
+            if (Request->Offset >= Queue->HeadPosition) {
+                break;
+            }
+
+            CurrentEntry = CurrentEntry->Next;
+        }
+
+        if (CurrentEntry == &(Queue->SortedListHead)) {
+            Request = LIST_VALUE(Queue->SortedListHead.Next,
+                                 IO_BLOCK_REQUEST,
+                                 ListEntry);
+        }
+    }
+
+    //
+    // Grow the request backwards and then forwards over neighbors that pick
+    // up right where it leaves off. The sorted list keeps them adjacent.
+    //
+
+    First = Request;
+    Last = Request;
+    TransferSize = Request->Size;
+    SegmentCount = 1;
+    while (First->ListEntry.Previous != &(Queue->SortedListHead)) {
+        Neighbor = LIST_VALUE(First->ListEntry.Previous,
+                              IO_BLOCK_REQUEST,
+                              ListEntry);
+
+        if (IopCanMergeBlockRequests(Queue,
+                                     Neighbor,
+                                     First,
+                                     TransferSize + Neighbor->Size,
+                                     SegmentCount) == FALSE) {
+
+            break;
+        }
+
+        First = Neighbor;
+        TransferSize += Neighbor->Size;
+        SegmentCount += 1;
+    }
+
+    while (Last->ListEntry.Next != &(Queue->SortedListHead)) {
+        Neighbor = LIST_VALUE(Last->ListEntry.Next,
+                              IO_BLOCK_REQUEST,
+                              ListEntry);
+
+        if (IopCanMergeBlockRequests(Queue,
+                                     Last,
+                                     Neighbor,
+                                     TransferSize + Neighbor->Size,
+                                     SegmentCount) == FALSE) {
+
+            break;
+        }
+
+        Last = Neighbor;
+        TransferSize += Neighbor->Size;
+        SegmentCount += 1;
+    }
+
+    //
+    // Pull the segments out of the queue and chain them together.
+    //
+
+    Segment = First;
+    while (TRUE) {
+        LIST_REMOVE(&(Segment->FifoListEntry));
+        Statistics->TotalWaitTime += CurrentTime - Segment->SubmitTime;
+        if (Segment == Last) {
+            LIST_REMOVE(&(Segment->ListEntry));
+            Segment->NextSegment = NULL;
+            break;
+        }
+
+        Segment->NextSegment = LIST_VALUE(Segment->ListEntry.Next,
+                                          IO_BLOCK_REQUEST,
+                                          ListEntry);
+
+        LIST_REMOVE(&(Segment->ListEntry));
+        Segment = Segment->NextSegment;
+    }
+
+    First->SegmentCount = SegmentCount;
+    First->TransferSize = TransferSize;
+    First->BytesCompleted = 0;
+    Queue->HeadPosition = First->Offset + TransferSize;
+
+    ASSERT(Statistics->Pending >= SegmentCount);
+
+    Statistics->Pending -= SegmentCount;
+    Statistics->Requests += 1;
+    Statistics->Merges += SegmentCount - 1;
+    return First;
+}
+
+BOOL
+IopCanMergeBlockRequests (
+    PIO_BLOCK_QUEUE Queue,
+    PIO_BLOCK_REQUEST Lower,
+    PIO_BLOCK_REQUEST Upper,
+    UINTN TransferSize,
+    ULONG SegmentCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether two neighboring requests can be merged
+    into one transfer.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block request queue.
+
+    Lower - Supplies a pointer to the request with the lower offset.
+
+    Upper - Supplies a pointer to the request with the higher offset.
+
+    TransferSize - Supplies the size the request being built would be with
+        the new neighbor merged in.
+
+    SegmentCount - Supplies the number of segments in the request being built
+        so far.
+
+Return Value:
+
+    TRUE if the requests can be merged.
+
+    FALSE if they cannot.
+
+--*/
+
+{
+
+    if (SegmentCount >= Queue->MaxSegments) {
+        return FALSE;
+    }
+
+    if ((Queue->MaxTransferSize != 0) &&
+        (TransferSize > Queue->MaxTransferSize)) {
+
+        return FALSE;
+    }
+
+    if ((Lower->Write != Upper->Write) ||
+        ((Lower->Offset + Lower->Size) != Upper->Offset)) {
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+ULONGLONG
+IopConvertTimeCounterToMicroseconds (
+    ULONGLONG TimeCounter,
+    ULONGLONG Frequency
+    )
+
+/*++
+
+Routine Description:
+
+    This routine converts a time counter duration into microseconds without
+    overflowing for large values.
+
+Arguments:
+
+    TimeCounter - Supplies the duration in time counter ticks.
+
+    Frequency - Supplies the time counter frequency, in Hertz.
+
+Return Value:
+
+    Returns the duration in microseconds.
+
+--*/
+
+{
+
+    ULONGLONG Microseconds;
+
+    if (Frequency == 0) {
+        return 0;
+    }
+
+    Microseconds = (TimeCounter / Frequency) * MICROSECONDS_PER_SECOND;
+    Microseconds += ((TimeCounter % Frequency) * MICROSECONDS_PER_SECOND) /
+                    Frequency;
+
+    return Microseconds;
+}
+
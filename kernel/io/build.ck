@@ -31,6 +31,7 @@ Module Name:
 function build() {
     base_sources = [
         "arb.c",
+        "blkqueue.c",
         "cachedio.c",
         "cstate.c",
         "device.c",
@@ -44,6 +45,7 @@ function build() {
         "info.c",
         "init.c",
         "intrface.c",
+        "intrset.c",
         "intrupt.c",
         "iobase.c",
         "iohandle.c",
@@ -59,6 +61,7 @@ function build() {
         "pstate.c",
         "pty.c",
         "pwropt.c",
+        "sendfile.c",
         "shmemobj.c",
         "socket.c",
         "stream.c",
@@ -96,6 +96,30 @@ typedef struct _IO_WRITE_CONTEXT {
     ULONG IoFlags;
 } IO_WRITE_CONTEXT, *PIO_WRITE_CONTEXT;
 
+/*++
+
+Structure Description:
+
+    This structure defines the context for an asynchronous read-ahead into the
+    page cache.
+
+Members:
+
+    FileObject - Stores a pointer to the file object to read ahead. A reference
+        is held on it until the read-ahead completes.
+
+    Offset - Stores the page-aligned offset to start reading at.
+
+    Size - Stores the page-aligned number of bytes to read.
+
+--*/
+
+typedef struct _IO_READ_AHEAD_CONTEXT {
+    PFILE_OBJECT FileObject;
+    IO_OFFSET Offset;
+    UINTN Size;
+} IO_READ_AHEAD_CONTEXT, *PIO_READ_AHEAD_CONTEXT;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -139,6 +163,18 @@ IopPerformCachedIoBufferWrite (
     BOOL WriteOutNow
     );
 
+VOID
+IopUpdateReadAhead (
+    PFILE_OBJECT FileObject,
+    IO_OFFSET Offset,
+    UINTN Size
+    );
+
+VOID
+IopReadAheadWorker (
+    PVOID Parameter
+    );
+
 KSTATUS
 IopPerformDefaultNonCachedRead (
     PFILE_OBJECT FileObject,
@@ -317,6 +353,12 @@ Return Value:
                                           IoContext,
                                           &LockHeldExclusive);
 
+            if (IoContext->BytesCompleted != 0) {
+                IopUpdateReadAhead(FileObject,
+                                   IoContext->Offset,
+                                   IoContext->BytesCompleted);
+            }
+
         } else {
             Status = IopPerformNonCachedRead(FileObject,
                                              IoContext,
@@ -463,6 +505,7 @@ Return Value:
         return STATUS_NOT_SUPPORTED;
     }
 
+    RtlAtomicAdd32(&(FileObject->DataGeneration), 1);
     switch (IoObjectType) {
     case IoObjectSharedMemoryObject:
         Status = IopPerformSharedMemoryIoOperation(FileObject, IoContext);
@@ -2424,3 +2467,318 @@ Return Value:
     return Status;
 }
 
+VOID
+IopUpdateReadAhead (
+    PFILE_OBJECT FileObject,
+    IO_OFFSET Offset,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine updates the sequential access state of a file object after a
+    cached read. If the file is being read sequentially, the read-ahead window
+    grows, and once the reader gets within half a window of the end of the
+    region already read ahead, an asynchronous read of the next window into the
+    page cache is queued. The file object lock must be held, either shared or
+    exclusive. Concurrent shared readers may race on the state, which only
+    makes the heuristic less accurate.
+
+Arguments:
+
+    FileObject - Supplies a pointer to the file object that was read.
+
+    Offset - Supplies the offset the read started at.
+
+    Size - Supplies the number of bytes that were read.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PIO_READ_AHEAD_CONTEXT Context;
+    ULONGLONG FileSize;
+    ULONG OldFlags;
+    ULONG PageSize;
+    IO_OFFSET ReadAheadEnd;
+    UINTN ReadAheadSize;
+    IO_OFFSET ReadEnd;
+    KSTATUS Status;
+    ULONG Window;
+
+    ReadEnd = Offset + Size;
+
+    //
+    // A read that doesn't pick up where the last one left off ends any
+    // sequential run. Reads from the start of the file begin a new one.
+    //
+
+    Window = FileObject->ReadAheadWindow;
+    if ((Offset != FileObject->ReadAheadNextOffset) && (Offset != 0)) {
+        FileObject->ReadAheadNextOffset = ReadEnd;
+        FileObject->ReadAheadWindow = 0;
+        return;
+    }
+
+    if ((Window == 0) || (Offset == 0)) {
+        Window = IO_READ_AHEAD_MIN_WINDOW;
+        FileObject->ReadAheadEnd = ReadEnd;
+
+    } else if (Window < IO_READ_AHEAD_MAX_WINDOW) {
+        Window <<= 1;
+    }
+
+    FileObject->ReadAheadNextOffset = ReadEnd;
+    FileObject->ReadAheadWindow = Window;
+
+    //
+    // Do nothing if the reader is still comfortably behind the data already
+    // read ahead.
+    //
+
+    PageSize = MmPageSize();
+    ReadAheadEnd = ALIGN_RANGE_UP(FileObject->ReadAheadEnd, PageSize);
+    if (ReadAheadEnd < ReadEnd) {
+        ReadAheadEnd = ALIGN_RANGE_UP(ReadEnd, PageSize);
+    }
+
+    if ((ReadAheadEnd - ReadEnd) >= (Window / 2)) {
+        return;
+    }
+
+    READ_INT64_SYNC(&(FileObject->Properties.FileSize), &FileSize);
+    if ((ReadAheadEnd >= FileSize) ||
+        (MmGetPhysicalMemoryWarningLevel() != MemoryWarningLevelNone)) {
+
+        return;
+    }
+
+    //
+    // Only allow one read-ahead at a time per file object. If one is already
+    // in flight, try again on the next read.
+    //
+
+    OldFlags = RtlAtomicOr32(&(FileObject->Flags),
+                             FILE_OBJECT_FLAG_READ_AHEAD_PENDING);
+
+    if ((OldFlags & FILE_OBJECT_FLAG_READ_AHEAD_PENDING) != 0) {
+        return;
+    }
+
+    ReadAheadSize = Window;
+    if ((ReadAheadEnd + ReadAheadSize) > FileSize) {
+        ReadAheadSize = ALIGN_RANGE_UP(FileSize - ReadAheadEnd, PageSize);
+    }
+
+    Context = MmAllocatePagedPool(sizeof(IO_READ_AHEAD_CONTEXT),
+                                  IO_ALLOCATION_TAG);
+
+    if (Context == NULL) {
+        goto UpdateReadAheadEnd;
+    }
+
+    Context->FileObject = FileObject;
+    Context->Offset = ReadAheadEnd;
+    Context->Size = ReadAheadSize;
+    IopFileObjectAddReference(FileObject);
+    Status = KeCreateAndQueueWorkItem(NULL,
+                                      WorkPriorityNormal,
+                                      IopReadAheadWorker,
+                                      Context);
+
+    if (!KSUCCESS(Status)) {
+        IopFileObjectReleaseReference(FileObject);
+        MmFreePagedPool(Context);
+        goto UpdateReadAheadEnd;
+    }
+
+    FileObject->ReadAheadEnd = ReadAheadEnd + ReadAheadSize;
+    return;
+
+UpdateReadAheadEnd:
+    RtlAtomicAnd32(&(FileObject->Flags), ~FILE_OBJECT_FLAG_READ_AHEAD_PENDING);
+    return;
+}
+
+VOID
+IopReadAheadWorker (
+    PVOID Parameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads a region of a file object into the page cache on behalf
+    of a sequential reader. Cached pages at either end of the region are
+    skipped, and the rest is read with a single request. The file object lock
+    is only held shared during the read, so that readers hitting the cache are
+    not held up by it, and is only held exclusive to insert the new pages.
+
+Arguments:
+
+    Parameter - Supplies a pointer to the read-ahead context, which this
+        routine frees.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG BlockSize;
+    UINTN BytesCopied;
+    PIO_READ_AHEAD_CONTEXT Context;
+    IO_OFFSET End;
+    PFILE_OBJECT FileObject;
+    ULONGLONG FileSize;
+    ULONG Generation;
+    PIO_BUFFER IoBuffer;
+    IO_CONTEXT IoContext;
+    BOOL LockHeldExclusive;
+    IO_OFFSET Offset;
+    PPAGE_CACHE_ENTRY PageCacheEntry;
+    ULONG PageSize;
+    UINTN ReadSize;
+    KSTATUS Status;
+
+    Context = Parameter;
+    FileObject = Context->FileObject;
+    IoBuffer = NULL;
+    PageSize = MmPageSize();
+    KeAcquireSharedExclusiveLockShared(FileObject->Lock);
+    LockHeldExclusive = FALSE;
+    if (IO_IS_FILE_OBJECT_CACHEABLE(FileObject) == FALSE) {
+        goto ReadAheadWorkerEnd;
+    }
+
+    //
+    // Trim the region down to the file and then past any pages that are
+    // already cached at either end. Pages cached in the middle are read
+    // again, but the existing entries win when the new pages are inserted.
+    //
+
+    READ_INT64_SYNC(&(FileObject->Properties.FileSize), &FileSize);
+    Offset = Context->Offset;
+    End = Offset + Context->Size;
+    if (End > ALIGN_RANGE_UP(FileSize, PageSize)) {
+        End = ALIGN_RANGE_UP(FileSize, PageSize);
+    }
+
+    while (Offset < End) {
+        PageCacheEntry = IopLookupPageCacheEntry(FileObject, Offset);
+        if (PageCacheEntry == NULL) {
+            break;
+        }
+
+        IoPageCacheEntryReleaseReference(PageCacheEntry);
+        Offset += PageSize;
+    }
+
+    while (End > Offset) {
+        PageCacheEntry = IopLookupPageCacheEntry(FileObject, End - PageSize);
+        if (PageCacheEntry == NULL) {
+            break;
+        }
+
+        IoPageCacheEntryReleaseReference(PageCacheEntry);
+        End -= PageSize;
+    }
+
+    if (Offset >= End) {
+        goto ReadAheadWorkerEnd;
+    }
+
+    //
+    // The block size is either a power of two smaller than a page or a
+    // multiple of it, so aligning the offset down to a block keeps it page
+    // aligned.
+    //
+
+    BlockSize = FileObject->Properties.BlockSize;
+    Offset = ALIGN_RANGE_DOWN(Offset, BlockSize);
+    ReadSize = ALIGN_RANGE_UP(End - Offset, BlockSize);
+    ReadSize = ALIGN_RANGE_UP(ReadSize, PageSize);
+
+    ASSERT(IS_ALIGNED(Offset, PageSize) != FALSE);
+
+    //
+    // Note the data generation before reading. A truncate or non-cached
+    // write can only happen once the lock is dropped to convert it below,
+    // and either one makes the data read here out of date.
+    //
+
+    Generation = FileObject->DataGeneration;
+    IoBuffer = MmAllocateUninitializedIoBuffer(ReadSize, 0);
+    if (IoBuffer == NULL) {
+        goto ReadAheadWorkerEnd;
+    }
+
+    IoContext.IoBuffer = IoBuffer;
+    IoContext.Offset = Offset;
+    IoContext.SizeInBytes = ReadSize;
+    IoContext.BytesCompleted = 0;
+    IoContext.Flags = 0;
+    IoContext.TimeoutInMilliseconds = WAIT_TIME_INDEFINITE;
+    IoContext.Write = FALSE;
+    Status = IopPerformNonCachedRead(FileObject, &IoContext, NULL);
+    if ((!KSUCCESS(Status)) &&
+        ((Status != STATUS_END_OF_FILE) || (IoContext.BytesCompleted == 0))) {
+
+        goto ReadAheadWorkerEnd;
+    }
+
+    if (IoContext.BytesCompleted != ReadSize) {
+        Status = MmZeroIoBuffer(IoBuffer,
+                                IoContext.BytesCompleted,
+                                ReadSize - IoContext.BytesCompleted);
+
+        if (!KSUCCESS(Status)) {
+            goto ReadAheadWorkerEnd;
+        }
+    }
+
+    //
+    // Inserting into the page cache needs the lock exclusive. Converting may
+    // drop the lock entirely, so throw the data away if it changed.
+    //
+
+    KeSharedExclusiveLockConvertToExclusive(FileObject->Lock);
+    LockHeldExclusive = TRUE;
+    if (FileObject->DataGeneration == Generation) {
+        IopCopyAndCacheIoBuffer(FileObject,
+                                Offset,
+                                NULL,
+                                0,
+                                IoBuffer,
+                                ReadSize,
+                                0,
+                                &BytesCopied);
+    }
+
+ReadAheadWorkerEnd:
+    if (LockHeldExclusive != FALSE) {
+        KeReleaseSharedExclusiveLockExclusive(FileObject->Lock);
+
+    } else {
+        KeReleaseSharedExclusiveLockShared(FileObject->Lock);
+    }
+
+    if (IoBuffer != NULL) {
+        MmFreeIoBuffer(IoBuffer);
+    }
+
+    RtlAtomicAnd32(&(FileObject->Flags), ~FILE_OBJECT_FLAG_READ_AHEAD_PENDING);
+    IopFileObjectReleaseReference(FileObject);
+    MmFreePagedPool(Context);
+    return;
+}
+
@@ -163,13 +163,15 @@ Return Value:
     // event is signaled as it may immediately be read by a waiter.
     //
 
+    RisingEdge = 0;
     if (Set != FALSE) {
         SignalOption = SignalOptionSignalAll;
         PreviousEvents = RtlAtomicOr32(&(IoState->Events), Events);
+        RisingEdge = (PreviousEvents ^ Events) & Events;
 
     } else {
         SignalOption = SignalOptionUnsignal;
-        PreviousEvents = RtlAtomicAnd32(&(IoState->Events), ~Events);
+        RtlAtomicAnd32(&(IoState->Events), ~Events);
     }
 
     if ((Events & POLL_EVENT_IN) != 0) {
@@ -204,7 +206,6 @@ Return Value:
         (IoState->Async != NULL) &&
         (IoState->Async->Owner != 0)) {
 
-        RisingEdge = (PreviousEvents ^ Events) & Events;
         if ((RisingEdge & POLL_EVENT_IN) != 0) {
             IopSendIoSignal(IoState->Async, POLL_CODE_IN, POLL_EVENT_IN);
         }
@@ -214,6 +215,16 @@ Return Value:
         }
     }
 
+    //
+    // Let any interest sets watching this object know about the new events.
+    // The events mask was updated above, so a registration being added
+    // concurrently will either be seen here or see the events itself.
+    //
+
+    if ((Set != FALSE) && (LIST_EMPTY(&(IoState->WatcherList)) == FALSE)) {
+        IopNotifyInterestSets(IoState, Events, RisingEdge);
+    }
+
     return;
 }
 
@@ -403,11 +414,17 @@ Return Value:
     }
 
     RtlZeroMemory(NewState, sizeof(IO_OBJECT_STATE));
+    INITIALIZE_LIST_HEAD(&(NewState->WatcherList));
 
     //
     // Create the events and lock.
     //
 
+    NewState->WatcherLock = KeCreateQueuedLock();
+    if (NewState->WatcherLock == NULL) {
+        goto CreateIoObjectStateEnd;
+    }
+
     NewState->ReadEvent = KeCreateEvent(NULL);
     if (NewState->ReadEvent == NULL) {
         goto CreateIoObjectStateEnd;
@@ -496,6 +513,13 @@ Return Value:
         KeDestroyEvent(State->ErrorEvent);
     }
 
+    if (State->WatcherLock != NULL) {
+
+        ASSERT(LIST_EMPTY(&(State->WatcherList)) != FALSE);
+
+        KeDestroyQueuedLock(State->WatcherLock);
+    }
+
     MmFreePagedPool(State);
     return;
 }
@@ -831,6 +855,7 @@ Return Value:
                 case IoObjectTerminalMaster:
                 case IoObjectTerminalSlave:
                 case IoObjectSharedMemoryObject:
+                case IoObjectInterestSet:
                     break;
 
                 default:
@@ -1198,6 +1223,7 @@ Return Value:
             case IoObjectTerminalMaster:
             case IoObjectTerminalSlave:
             case IoObjectSharedMemoryObject:
+            case IoObjectInterestSet:
                 ObReleaseReference(Object->SpecialIo);
                 break;
 
@@ -2078,6 +2104,7 @@ Return Value:
     //
 
     if (NewFileSize < FileSize) {
+        RtlAtomicAdd32(&(FileObject->DataGeneration), 1);
         Offset = ALIGN_RANGE_UP(NewFileSize, IoGetCacheEntryDataSize());
         IopEvictFileObject(FileObject, Offset, EVICTION_FLAG_TRUNCATE);
     }
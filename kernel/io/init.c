@@ -334,6 +334,15 @@ Return Value:
         goto InitializeEnd;
     }
 
+    //
+    // Initialize support for interest sets.
+    //
+
+    Status = IopInitializeInterestSetSupport();
+    if (!KSUCCESS(Status)) {
+        goto InitializeEnd;
+    }
+
     //
     // Initialize shared memory object support.
     //
@@ -0,0 +1,1503 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    intrset.c
+
+Abstract:
+
+    This module implements interest sets, persistent collections of I/O
+    handles that can be waited on together. Unlike poll, the set of handles
+    is registered once, and each wait returns only the registrations that are
+    ready rather than scanning every handle.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/kernel/kernel.h>
+#include "iop.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the allocation tag used by interest sets: IntS.
+//
+
+#define INTEREST_SET_ALLOCATION_TAG 0x53746E49
+
+//
+// This internal registration flag is set when a one-shot registration has
+// been reported and is waiting to be re-armed.
+//
+
+#define INTEREST_SET_REGISTRATION_DISABLED 0x80000000
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure defines an interest set.
+
+Members:
+
+    Header - Stores the standard object header.
+
+    Lock - Stores a pointer to the lock serializing changes to the
+        registration list.
+
+    ReadyLock - Stores a pointer to the lock protecting the ready list.
+
+    RegistrationList - Stores the head of the list of registrations in the
+        set.
+
+    ReadyList - Stores the head of the list of registrations that may be
+        ready.
+
+    IoState - Stores a pointer to the I/O object state of the interest set's
+        file object. The in event is set whenever the ready list is not empty.
+
+--*/
+
+typedef struct _INTEREST_SET {
+    OBJECT_HEADER Header;
+    PQUEUED_LOCK Lock;
+    PQUEUED_LOCK ReadyLock;
+    LIST_ENTRY RegistrationList;
+    LIST_ENTRY ReadyList;
+    PIO_OBJECT_STATE IoState;
+} INTEREST_SET, *PINTEREST_SET;
+
+/*++
+
+Structure Description:
+
+    This structure defines a single handle registered with an interest set.
+
+Members:
+
+    ListEntry - Stores pointers to the next and previous registrations in the
+        interest set.
+
+    WatcherListEntry - Stores pointers to the next and previous watchers of
+        the registered object's I/O state.
+
+    ReadyListEntry - Stores pointers to the next and previous registrations
+        on the interest set's ready list. The next pointer is NULL if the
+        registration is not on the ready list.
+
+    HandleListEntry - Stores pointers to the next and previous registrations
+        made through the same I/O handle.
+
+    InterestSet - Stores a pointer to the interest set that owns the
+        registration.
+
+    IoHandle - Stores a pointer to the registered I/O handle. No reference is
+        held; the registration is destroyed when the I/O handle is closed.
+
+    IoState - Stores a pointer to the watched I/O object state.
+
+    Handle - Stores the user mode handle the registration was made with.
+        Together with the I/O handle, this is the key used to modify or
+        delete the registration.
+
+    Events - Stores the mask of poll events the registration is interested in.
+
+    Flags - Stores the registration flags. See INTEREST_SET_FLAG_* definitions.
+
+    Data - Stores the caller's data, returned when the registration is ready.
+
+--*/
+
+typedef struct _INTEREST_SET_REGISTRATION {
+    LIST_ENTRY ListEntry;
+    LIST_ENTRY WatcherListEntry;
+    LIST_ENTRY ReadyListEntry;
+    LIST_ENTRY HandleListEntry;
+    PINTEREST_SET InterestSet;
+    PIO_HANDLE IoHandle;
+    PIO_OBJECT_STATE IoState;
+    HANDLE Handle;
+    volatile ULONG Events;
+    volatile ULONG Flags;
+    ULONGLONG Data;
+} INTEREST_SET_REGISTRATION, *PINTEREST_SET_REGISTRATION;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+VOID
+IopDestroyInterestSet (
+    PVOID InterestSetObject
+    );
+
+KSTATUS
+IopAddInterestSetRegistration (
+    PINTEREST_SET InterestSet,
+    HANDLE Handle,
+    PIO_HANDLE IoHandle,
+    PINTEREST_SET_EVENT Event
+    );
+
+KSTATUS
+IopModifyInterestSetRegistration (
+    PINTEREST_SET InterestSet,
+    HANDLE Handle,
+    PIO_HANDLE IoHandle,
+    PINTEREST_SET_EVENT Event
+    );
+
+KSTATUS
+IopDeleteInterestSetRegistration (
+    PINTEREST_SET InterestSet,
+    HANDLE Handle,
+    PIO_HANDLE IoHandle
+    );
+
+PINTEREST_SET_REGISTRATION
+IopFindInterestSetRegistration (
+    PINTEREST_SET InterestSet,
+    HANDLE Handle,
+    PIO_HANDLE IoHandle
+    );
+
+VOID
+IopRemoveInterestSetRegistration (
+    PINTEREST_SET_REGISTRATION Registration
+    );
+
+VOID
+IopQueueInterestSetRegistration (
+    PINTEREST_SET_REGISTRATION Registration
+    );
+
+ULONG
+IopCollectInterestSetEvents (
+    PINTEREST_SET InterestSet,
+    PINTEREST_SET_EVENT Events,
+    ULONG EventCount
+    );
+
+KSTATUS
+IopGetInterestSetFromHandle (
+    HANDLE Handle,
+    PIO_HANDLE *IoHandle,
+    PINTEREST_SET *InterestSet
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Store the lock protecting the lists of registrations hanging off of each
+// I/O handle. This lock is always acquired before an interest set's lock.
+//
+
+PQUEUED_LOCK IoInterestSetHandleLock;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+INTN
+IoSysCreateInterestSet (
+    PVOID SystemCallParameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles the system call that creates a new interest set.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or positive integer on success.
+
+    Error status code on failure.
+
+--*/
+
+{
+
+    ULONG HandleFlags;
+    PIO_HANDLE IoHandle;
+    PSYSTEM_CALL_CREATE_INTEREST_SET Parameters;
+    FILE_PERMISSIONS Permissions;
+    PKPROCESS Process;
+    KSTATUS Status;
+
+    Parameters = (PSYSTEM_CALL_CREATE_INTEREST_SET)SystemCallParameter;
+    Parameters->Handle = INVALID_HANDLE;
+    Process = PsGetCurrentProcess();
+
+    ASSERT(Process != PsGetKernelProcess());
+
+    HandleFlags = 0;
+    if ((Parameters->OpenFlags & SYS_OPEN_FLAG_CLOSE_ON_EXECUTE) != 0) {
+        HandleFlags |= FILE_DESCRIPTOR_CLOSE_ON_EXECUTE;
+    }
+
+    IoHandle = NULL;
+    Permissions = FILE_PERMISSION_USER_READ | FILE_PERMISSION_USER_WRITE;
+    Status = IopOpen(FALSE,
+                     NULL,
+                     NULL,
+                     0,
+                     IO_ACCESS_READ,
+                     OPEN_FLAG_CREATE,
+                     IoObjectInterestSet,
+                     NULL,
+                     Permissions,
+                     &IoHandle);
+
+    if (!KSUCCESS(Status)) {
+        goto CreateInterestSetEnd;
+    }
+
+    Status = ObCreateHandle(Process->HandleTable,
+                            IoHandle,
+                            HandleFlags,
+                            &(Parameters->Handle));
+
+    if (!KSUCCESS(Status)) {
+        goto CreateInterestSetEnd;
+    }
+
+CreateInterestSetEnd:
+    if (!KSUCCESS(Status)) {
+        if (IoHandle != NULL) {
+            IoIoHandleReleaseReference(IoHandle);
+        }
+
+        Parameters->Handle = INVALID_HANDLE;
+    }
+
+    return Status;
+}
+
+INTN
+IoSysControlInterestSet (
+    PVOID SystemCallParameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles the system call that adds, modifies, or removes a
+    handle registration in an interest set.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or positive integer on success.
+
+    Error status code on failure.
+
+--*/
+
+{
+
+    PIO_HANDLE InterestSetHandle;
+    PINTEREST_SET InterestSet;
+    PIO_HANDLE IoHandle;
+    BOOL LockHandles;
+    PSYSTEM_CALL_CONTROL_INTEREST_SET Parameters;
+    PKPROCESS Process;
+    KSTATUS Status;
+
+    IoHandle = NULL;
+    LockHandles = FALSE;
+    Parameters = (PSYSTEM_CALL_CONTROL_INTEREST_SET)SystemCallParameter;
+    Process = PsGetCurrentProcess();
+    Status = IopGetInterestSetFromHandle(Parameters->InterestSet,
+                                         &InterestSetHandle,
+                                         &InterestSet);
+
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    //
+    // A registration can be deleted after its handle was closed, so only add
+    // and modify require the handle to still be valid.
+    //
+
+    IoHandle = ObGetHandleValue(Process->HandleTable, Parameters->Handle, NULL);
+    if ((IoHandle == NULL) &&
+        (Parameters->Operation != InterestSetOperationDelete)) {
+
+        Status = STATUS_INVALID_HANDLE;
+        goto ControlInterestSetEnd;
+    }
+
+    //
+    // Adding and deleting change the I/O handle's list of registrations.
+    //
+
+    if ((Parameters->Operation == InterestSetOperationAdd) ||
+        (Parameters->Operation == InterestSetOperationDelete)) {
+
+        LockHandles = TRUE;
+        KeAcquireQueuedLock(IoInterestSetHandleLock);
+    }
+
+    KeAcquireQueuedLock(InterestSet->Lock);
+    switch (Parameters->Operation) {
+    case InterestSetOperationAdd:
+        Status = IopAddInterestSetRegistration(InterestSet,
+                                               Parameters->Handle,
+                                               IoHandle,
+                                               &(Parameters->Event));
+
+        break;
+
+    case InterestSetOperationModify:
+        Status = IopModifyInterestSetRegistration(InterestSet,
+                                                  Parameters->Handle,
+                                                  IoHandle,
+                                                  &(Parameters->Event));
+
+        break;
+
+    case InterestSetOperationDelete:
+        Status = IopDeleteInterestSetRegistration(InterestSet,
+                                                  Parameters->Handle,
+                                                  IoHandle);
+
+        break;
+
+    default:
+        Status = STATUS_INVALID_PARAMETER;
+        break;
+    }
+
+    KeReleaseQueuedLock(InterestSet->Lock);
+    if (LockHandles != FALSE) {
+        KeReleaseQueuedLock(IoInterestSetHandleLock);
+    }
+
+ControlInterestSetEnd:
+    if (IoHandle != NULL) {
+        IoIoHandleReleaseReference(IoHandle);
+    }
+
+    IoIoHandleReleaseReference(InterestSetHandle);
+    return Status;
+}
+
+INTN
+IoSysWaitForInterestSet (
+    PVOID SystemCallParameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles the system call that waits for registered handles in
+    an interest set to become ready.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or the number of events returned (a positive integer) on
+    success.
+
+    Error status code (a negative integer) on failure.
+
+--*/
+
+{
+
+    ULONGLONG CurrentTime;
+    ULONGLONG EndTime;
+    ULONG EventCount;
+    PINTEREST_SET_EVENT Events;
+    PIO_HANDLE InterestSetHandle;
+    PINTEREST_SET InterestSet;
+    SIGNAL_SET OldSignalSet;
+    PSYSTEM_CALL_WAIT_FOR_INTEREST_SET Parameters;
+    INTN Result;
+    BOOL RestoreSignalMask;
+    ULONG ReturnedCount;
+    SIGNAL_SET SignalMask;
+    KSTATUS Status;
+    PKTHREAD Thread;
+    ULONGLONG TimeCounterFrequency;
+    ULONG Timeout;
+    ULONG WaitTime;
+
+    EndTime = 0;
+    Events = NULL;
+    InterestSetHandle = NULL;
+    Parameters = (PSYSTEM_CALL_WAIT_FOR_INTEREST_SET)SystemCallParameter;
+    RestoreSignalMask = FALSE;
+    ReturnedCount = 0;
+    Thread = KeGetCurrentThread();
+    TimeCounterFrequency = 0;
+    if ((Parameters->Events == NULL) || (Parameters->EventCount <= 0)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto WaitForInterestSetEnd;
+    }
+
+    EventCount = Parameters->EventCount;
+    if (EventCount > INTEREST_SET_MAX_EVENTS) {
+        EventCount = INTEREST_SET_MAX_EVENTS;
+    }
+
+    Status = IopGetInterestSetFromHandle(Parameters->InterestSet,
+                                         &InterestSetHandle,
+                                         &InterestSet);
+
+    if (!KSUCCESS(Status)) {
+        goto WaitForInterestSetEnd;
+    }
+
+    Events = MmAllocatePagedPool(EventCount * sizeof(INTEREST_SET_EVENT),
+                                 INTEREST_SET_ALLOCATION_TAG);
+
+    if (Events == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto WaitForInterestSetEnd;
+    }
+
+    //
+    // Set the signal mask if supplied.
+    //
+
+    if (Parameters->SignalMask != NULL) {
+        Status = MmCopyFromUserMode(&SignalMask,
+                                    Parameters->SignalMask,
+                                    sizeof(SIGNAL_SET));
+
+        if (!KSUCCESS(Status)) {
+            goto WaitForInterestSetEnd;
+        }
+
+        PsSetSignalMask(&SignalMask, &OldSignalSet);
+        RestoreSignalMask = TRUE;
+    }
+
+    Timeout = Parameters->TimeoutInMilliseconds;
+    if ((Timeout != 0) && (Timeout != WAIT_TIME_INDEFINITE)) {
+        EndTime = KeGetRecentTimeCounter();
+        EndTime += KeConvertMicrosecondsToTimeTicks(
+                                       Timeout * MICROSECONDS_PER_MILLISECOND);
+
+        TimeCounterFrequency = HlQueryTimeCounterFrequency();
+    }
+
+    //
+    // Wait for the ready list to become non-empty, then harvest it. Entries
+    // on the ready list may have gone stale by the time they are examined, so
+    // loop until something is actually returned or the time runs out.
+    //
+
+    while (TRUE) {
+        if (Timeout == 0) {
+            WaitTime = 0;
+
+        } else if (Timeout != WAIT_TIME_INDEFINITE) {
+            CurrentTime = KeGetRecentTimeCounter();
+            if (CurrentTime >= EndTime) {
+                WaitTime = 0;
+
+            } else {
+                WaitTime = (EndTime - CurrentTime) * MILLISECONDS_PER_SECOND /
+                           TimeCounterFrequency;
+            }
+
+        } else {
+            WaitTime = WAIT_TIME_INDEFINITE;
+        }
+
+        Status = IoWaitForIoObjectState(InterestSet->IoState,
+                                        POLL_EVENT_IN,
+                                        TRUE,
+                                        WaitTime,
+                                        NULL);
+
+        if (!KSUCCESS(Status)) {
+            goto WaitForInterestSetEnd;
+        }
+
+        ReturnedCount = IopCollectInterestSetEvents(InterestSet,
+                                                    Events,
+                                                    EventCount);
+
+        if (ReturnedCount != 0) {
+            break;
+        }
+
+        if (WaitTime == 0) {
+            Status = STATUS_TIMEOUT;
+            goto WaitForInterestSetEnd;
+        }
+    }
+
+    Status = MmCopyToUserMode(Parameters->Events,
+                              Events,
+                              ReturnedCount * sizeof(INTEREST_SET_EVENT));
+
+WaitForInterestSetEnd:
+    if (RestoreSignalMask != FALSE) {
+
+        //
+        // If a signal arrived during the wait, then do not restore the
+        // blocked mask until it gets a chance to be dispatched.
+        //
+
+        PsCheckRuntimeTimers(Thread);
+        if (Thread->SignalPending == ThreadSignalPending) {
+            Thread->RestoreSignals = OldSignalSet;
+            Thread->Flags |= THREAD_FLAG_RESTORE_SIGNALS;
+
+        } else {
+            PsSetSignalMask(&OldSignalSet, NULL);
+        }
+    }
+
+    if (Events != NULL) {
+        MmFreePagedPool(Events);
+    }
+
+    if (InterestSetHandle != NULL) {
+        IoIoHandleReleaseReference(InterestSetHandle);
+    }
+
+    Result = Status;
+    if (KSUCCESS(Result)) {
+        Result = ReturnedCount;
+    }
+
+    return Result;
+}
+
+KSTATUS
+IopCreateInterestSet (
+    FILE_PERMISSIONS Permissions,
+    PFILE_OBJECT *FileObject
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates a new interest set and its file object.
+
+Arguments:
+
+    Permissions - Supplies the permissions to give to the file object.
+
+    FileObject - Supplies a pointer where a pointer to the newly created
+        interest set file object will be returned on success.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    BOOL Created;
+    FILE_PROPERTIES FileProperties;
+    PINTEREST_SET NewInterestSet;
+    PFILE_OBJECT NewFileObject;
+    KSTATUS Status;
+    PKTHREAD Thread;
+
+    ASSERT(*FileObject == NULL);
+
+    NewFileObject = NULL;
+    NewInterestSet = ObCreateObject(ObjectInterestSet,
+                                    NULL,
+                                    NULL,
+                                    0,
+                                    sizeof(INTEREST_SET),
+                                    IopDestroyInterestSet,
+                                    0,
+                                    INTEREST_SET_ALLOCATION_TAG);
+
+    if (NewInterestSet == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CreateInterestSetEnd;
+    }
+
+    INITIALIZE_LIST_HEAD(&(NewInterestSet->RegistrationList));
+    INITIALIZE_LIST_HEAD(&(NewInterestSet->ReadyList));
+    NewInterestSet->Lock = KeCreateQueuedLock();
+    NewInterestSet->ReadyLock = KeCreateQueuedLock();
+    if ((NewInterestSet->Lock == NULL) ||
+        (NewInterestSet->ReadyLock == NULL)) {
+
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CreateInterestSetEnd;
+    }
+
+    Thread = KeGetCurrentThread();
+    IopFillOutFilePropertiesForObject(&FileProperties,
+                                      &(NewInterestSet->Header));
+
+    FileProperties.Permissions = Permissions;
+    FileProperties.Type = IoObjectInterestSet;
+    FileProperties.UserId = Thread->Identity.EffectiveUserId;
+    FileProperties.GroupId = Thread->Identity.EffectiveGroupId;
+    Status = IopCreateOrLookupFileObject(&FileProperties,
+                                         ObGetRootObject(),
+                                         0,
+                                         &NewFileObject,
+                                         &Created);
+
+    if (!KSUCCESS(Status)) {
+
+        //
+        // Release the reference added by filling out the file properties.
+        //
+
+        ObReleaseReference(NewInterestSet);
+        goto CreateInterestSetEnd;
+    }
+
+    ASSERT((Created != FALSE) && (NewFileObject->IoState != NULL));
+
+    //
+    // Hand the initial reference on the interest set to the file object, and
+    // release anyone else waiting on the file object.
+    //
+
+    NewInterestSet->IoState = NewFileObject->IoState;
+    NewFileObject->SpecialIo = NewInterestSet;
+    NewInterestSet = NULL;
+    *FileObject = NewFileObject;
+    Status = STATUS_SUCCESS;
+
+CreateInterestSetEnd:
+    if (NewFileObject != NULL) {
+        KeSignalEvent(NewFileObject->ReadyEvent, SignalOptionSignalAll);
+    }
+
+    if (!KSUCCESS(Status)) {
+        if (NewFileObject != NULL) {
+            IopFileObjectReleaseReference(NewFileObject);
+        }
+
+        if (NewInterestSet != NULL) {
+            ObReleaseReference(NewInterestSet);
+        }
+    }
+
+    return Status;
+}
+
+KSTATUS
+IopPerformInterestSetIoOperation (
+    PIO_HANDLE Handle,
+    PIO_CONTEXT IoContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads from or writes to an interest set, which is not
+    supported.
+
+Arguments:
+
+    Handle - Supplies a pointer to the interest set I/O handle.
+
+    IoContext - Supplies a pointer to the I/O context.
+
+Return Value:
+
+    STATUS_NOT_SUPPORTED always.
+
+--*/
+
+{
+
+    return STATUS_NOT_SUPPORTED;
+}
+
+VOID
+IopNotifyInterestSets (
+    PIO_OBJECT_STATE IoState,
+    ULONG Events,
+    ULONG RisingEdge
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when events are set on an I/O object state that
+    is being watched by one or more interest sets. It queues the interested
+    registrations onto their set's ready list.
+
+Arguments:
+
+    IoState - Supplies a pointer to the I/O object state whose events were
+        just set.
+
+    Events - Supplies the mask of events that were set.
+
+    RisingEdge - Supplies the mask of events that transitioned from clear to
+        set.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    ULONG Mask;
+    PINTEREST_SET_REGISTRATION Registration;
+    ULONG Triggers;
+
+    KeAcquireQueuedLock(IoState->WatcherLock);
+    CurrentEntry = IoState->WatcherList.Next;
+    while (CurrentEntry != &(IoState->WatcherList)) {
+        Registration = LIST_VALUE(CurrentEntry,
+                                  INTEREST_SET_REGISTRATION,
+                                  WatcherListEntry);
+
+        CurrentEntry = CurrentEntry->Next;
+        if ((Registration->Flags & INTEREST_SET_REGISTRATION_DISABLED) != 0) {
+            continue;
+        }
+
+        //
+        // Edge-triggered registrations only fire on a transition, whereas
+        // level-triggered registrations fire any time the event is set.
+        //
+
+        Triggers = Events;
+        if ((Registration->Flags & INTEREST_SET_FLAG_EDGE_TRIGGERED) != 0) {
+            Triggers = RisingEdge;
+        }
+
+        Mask = Registration->Events | POLL_NONMASKABLE_EVENTS;
+        if ((Triggers & Mask) != 0) {
+            IopQueueInterestSetRegistration(Registration);
+        }
+    }
+
+    KeReleaseQueuedLock(IoState->WatcherLock);
+    return;
+}
+
+VOID
+IopCloseInterestSetRegistrations (
+    PIO_HANDLE IoHandle
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes every interest set registration made through the
+    given I/O handle. It is called when the I/O handle is being closed.
+
+Arguments:
+
+    IoHandle - Supplies a pointer to the I/O handle being closed.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PINTEREST_SET InterestSet;
+    PINTEREST_SET_REGISTRATION Registration;
+
+    //
+    // Registrations are only added while a reference on the I/O handle is
+    // held, so the list cannot gain new entries now. Avoid the global lock in
+    // the common case of a handle that was never registered.
+    //
+
+    if (LIST_EMPTY(&(IoHandle->InterestSetList)) != FALSE) {
+        return;
+    }
+
+    KeAcquireQueuedLock(IoInterestSetHandleLock);
+    while (LIST_EMPTY(&(IoHandle->InterestSetList)) == FALSE) {
+        Registration = LIST_VALUE(IoHandle->InterestSetList.Next,
+                                  INTEREST_SET_REGISTRATION,
+                                  HandleListEntry);
+
+        InterestSet = Registration->InterestSet;
+        KeAcquireQueuedLock(InterestSet->Lock);
+        IopRemoveInterestSetRegistration(Registration);
+        KeReleaseQueuedLock(InterestSet->Lock);
+    }
+
+    KeReleaseQueuedLock(IoInterestSetHandleLock);
+    return;
+}
+
+KSTATUS
+IopInitializeInterestSetSupport (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called during system initialization to set up support for
+    interest sets.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    IoInterestSetHandleLock = KeCreateQueuedLock();
+    if (IoInterestSetHandleLock == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+VOID
+IopDestroyInterestSet (
+    PVOID InterestSetObject
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys an interest set object, tearing down all of its
+    registrations.
+
+Arguments:
+
+    InterestSetObject - Supplies a pointer to the interest set being
+        destroyed.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PINTEREST_SET InterestSet;
+    PINTEREST_SET_REGISTRATION Registration;
+
+    InterestSet = InterestSetObject;
+    KeAcquireQueuedLock(IoInterestSetHandleLock);
+    while (LIST_EMPTY(&(InterestSet->RegistrationList)) == FALSE) {
+        Registration = LIST_VALUE(InterestSet->RegistrationList.Next,
+                                  INTEREST_SET_REGISTRATION,
+                                  ListEntry);
+
+        IopRemoveInterestSetRegistration(Registration);
+    }
+
+    KeReleaseQueuedLock(IoInterestSetHandleLock);
+
+    ASSERT(LIST_EMPTY(&(InterestSet->ReadyList)) != FALSE);
+
+    if (InterestSet->Lock != NULL) {
+        KeDestroyQueuedLock(InterestSet->Lock);
+    }
+
+    if (InterestSet->ReadyLock != NULL) {
+        KeDestroyQueuedLock(InterestSet->ReadyLock);
+    }
+
+    return;
+}
+
+KSTATUS
+IopAddInterestSetRegistration (
+    PINTEREST_SET InterestSet,
+    HANDLE Handle,
+    PIO_HANDLE IoHandle,
+    PINTEREST_SET_EVENT Event
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a new registration to an interest set. This routine
+    assumes the global handle lock and the interest set lock are held.
+
+Arguments:
+
+    InterestSet - Supplies a pointer to the interest set.
+
+    Handle - Supplies the user mode handle being registered.
+
+    IoHandle - Supplies a pointer to the I/O handle being registered.
+
+    Event - Supplies a pointer to the requested events, flags, and data.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PFILE_OBJECT FileObject;
+    PIO_OBJECT_STATE IoState;
+    PINTEREST_SET_REGISTRATION Registration;
+
+    if ((Event->Flags & ~INTEREST_SET_FLAG_MASK) != 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    //
+    // Interest sets cannot watch other interest sets, and objects without an
+    // I/O state (such as regular files) are always ready, so watching them
+    // makes no sense.
+    //
+
+    FileObject = IoHandle->FileObject;
+    IoState = FileObject->IoState;
+    if ((IoState == NULL) ||
+        (FileObject->Properties.Type == IoObjectInterestSet)) {
+
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    Registration = IopFindInterestSetRegistration(InterestSet,
+                                                  Handle,
+                                                  IoHandle);
+
+    if (Registration != NULL) {
+        return STATUS_FILE_EXISTS;
+    }
+
+    Registration = MmAllocatePagedPool(sizeof(INTEREST_SET_REGISTRATION),
+                                       INTEREST_SET_ALLOCATION_TAG);
+
+    if (Registration == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(Registration, sizeof(INTEREST_SET_REGISTRATION));
+    Registration->InterestSet = InterestSet;
+    Registration->IoHandle = IoHandle;
+    Registration->IoState = IoState;
+    Registration->Handle = Handle;
+    Registration->Events = Event->Events;
+    Registration->Flags = Event->Flags;
+    Registration->Data = Event->Data;
+    INSERT_BEFORE(&(Registration->ListEntry), &(InterestSet->RegistrationList));
+    INSERT_BEFORE(&(Registration->HandleListEntry),
+                  &(IoHandle->InterestSetList));
+
+    //
+    // Start watching the I/O state, and then check to see if the object is
+    // already ready. Doing it in this order means no event can be missed.
+    //
+
+    KeAcquireQueuedLock(IoState->WatcherLock);
+    INSERT_BEFORE(&(Registration->WatcherListEntry), &(IoState->WatcherList));
+    if ((IoState->Events & (Event->Events | POLL_NONMASKABLE_EVENTS)) != 0) {
+        IopQueueInterestSetRegistration(Registration);
+    }
+
+    KeReleaseQueuedLock(IoState->WatcherLock);
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+IopModifyInterestSetRegistration (
+    PINTEREST_SET InterestSet,
+    HANDLE Handle,
+    PIO_HANDLE IoHandle,
+    PINTEREST_SET_EVENT Event
+    )
+
+/*++
+
+Routine Description:
+
+    This routine changes the events, flags, and data of an existing interest
+    set registration. This also re-arms a disabled one-shot registration.
+    This routine assumes the interest set lock is held.
+
+Arguments:
+
+    InterestSet - Supplies a pointer to the interest set.
+
+    Handle - Supplies the user mode handle whose registration is changing.
+
+    IoHandle - Supplies a pointer to the I/O handle for the given handle.
+
+    Event - Supplies a pointer to the new events, flags, and data.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PIO_OBJECT_STATE IoState;
+    PINTEREST_SET_REGISTRATION Registration;
+
+    if ((Event->Flags & ~INTEREST_SET_FLAG_MASK) != 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Registration = IopFindInterestSetRegistration(InterestSet,
+                                                  Handle,
+                                                  IoHandle);
+
+    if (Registration == NULL) {
+        return STATUS_NOT_FOUND;
+    }
+
+    IoState = Registration->IoState;
+    KeAcquireQueuedLock(IoState->WatcherLock);
+    KeAcquireQueuedLock(InterestSet->ReadyLock);
+    Registration->Events = Event->Events;
+    Registration->Flags = Event->Flags;
+    Registration->Data = Event->Data;
+    KeReleaseQueuedLock(InterestSet->ReadyLock);
+    if ((IoState->Events & (Event->Events | POLL_NONMASKABLE_EVENTS)) != 0) {
+        IopQueueInterestSetRegistration(Registration);
+    }
+
+    KeReleaseQueuedLock(IoState->WatcherLock);
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+IopDeleteInterestSetRegistration (
+    PINTEREST_SET InterestSet,
+    HANDLE Handle,
+    PIO_HANDLE IoHandle
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes a registration from an interest set. This routine
+    assumes the global handle lock and the interest set lock are held.
+
+Arguments:
+
+    InterestSet - Supplies a pointer to the interest set.
+
+    Handle - Supplies the user mode handle whose registration is being
+        removed.
+
+    IoHandle - Supplies an optional pointer to the I/O handle for the given
+        handle. Supply NULL if the handle has already been closed.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PINTEREST_SET_REGISTRATION Registration;
+
+    Registration = IopFindInterestSetRegistration(InterestSet,
+                                                  Handle,
+                                                  IoHandle);
+
+    if (IoHandle != NULL) {
+        if (Registration == NULL) {
+            return STATUS_NOT_FOUND;
+        }
+
+        IopRemoveInterestSetRegistration(Registration);
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // The handle is closed. Closing the last handle to an I/O handle already
+    // removed its registrations, so anything left under this handle number
+    // was made through an I/O handle that is still open elsewhere (via dup,
+    // for instance). The caller asked for the number to be removed, so remove
+    // all of those, and succeed even if there was nothing left to remove.
+    //
+
+    while (Registration != NULL) {
+        IopRemoveInterestSetRegistration(Registration);
+        Registration = IopFindInterestSetRegistration(InterestSet,
+                                                      Handle,
+                                                      NULL);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+PINTEREST_SET_REGISTRATION
+IopFindInterestSetRegistration (
+    PINTEREST_SET InterestSet,
+    HANDLE Handle,
+    PIO_HANDLE IoHandle
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the registration for the given handle. This routine
+    assumes the interest set lock is held.
+
+Arguments:
+
+    InterestSet - Supplies a pointer to the interest set to search.
+
+    Handle - Supplies the user mode handle to look up.
+
+    IoHandle - Supplies an optional pointer to the I/O handle the
+        registration must have been made through. Supply NULL to match any
+        registration with the given handle number.
+
+Return Value:
+
+    Returns a pointer to the registration on success.
+
+    NULL if the handle is not registered with the interest set.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PINTEREST_SET_REGISTRATION Registration;
+
+    CurrentEntry = InterestSet->RegistrationList.Next;
+    while (CurrentEntry != &(InterestSet->RegistrationList)) {
+        Registration = LIST_VALUE(CurrentEntry,
+                                  INTEREST_SET_REGISTRATION,
+                                  ListEntry);
+
+        if ((Registration->Handle == Handle) &&
+            ((IoHandle == NULL) || (Registration->IoHandle == IoHandle))) {
+
+            return Registration;
+        }
+
+        CurrentEntry = CurrentEntry->Next;
+    }
+
+    return NULL;
+}
+
+VOID
+IopRemoveInterestSetRegistration (
+    PINTEREST_SET_REGISTRATION Registration
+    )
+
+/*++
+
+Routine Description:
+
+    This routine unlinks and destroys an interest set registration. This
+    routine assumes the global handle lock is held, and that either the
+    interest set lock is held or the interest set is being destroyed.
+
+Arguments:
+
+    Registration - Supplies a pointer to the registration to remove.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PINTEREST_SET InterestSet;
+    PIO_OBJECT_STATE IoState;
+
+    InterestSet = Registration->InterestSet;
+    IoState = Registration->IoState;
+
+    //
+    // Stop watching first so that no new notifications can queue the
+    // registration, then pull it off the ready list.
+    //
+
+    KeAcquireQueuedLock(IoState->WatcherLock);
+    LIST_REMOVE(&(Registration->WatcherListEntry));
+    KeReleaseQueuedLock(IoState->WatcherLock);
+    KeAcquireQueuedLock(InterestSet->ReadyLock);
+    if (Registration->ReadyListEntry.Next != NULL) {
+        LIST_REMOVE(&(Registration->ReadyListEntry));
+        Registration->ReadyListEntry.Next = NULL;
+    }
+
+    KeReleaseQueuedLock(InterestSet->ReadyLock);
+    LIST_REMOVE(&(Registration->ListEntry));
+    LIST_REMOVE(&(Registration->HandleListEntry));
+    MmFreePagedPool(Registration);
+    return;
+}
+
+VOID
+IopQueueInterestSetRegistration (
+    PINTEREST_SET_REGISTRATION Registration
+    )
+
+/*++
+
+Routine Description:
+
+    This routine puts a registration on its interest set's ready list if it
+    is not already there, and signals the interest set. This routine assumes
+    the watcher lock of the registration's I/O state is held.
+
+Arguments:
+
+    Registration - Supplies a pointer to the registration that may be ready.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PINTEREST_SET InterestSet;
+
+    InterestSet = Registration->InterestSet;
+    KeAcquireQueuedLock(InterestSet->ReadyLock);
+    if (Registration->ReadyListEntry.Next == NULL) {
+        INSERT_BEFORE(&(Registration->ReadyListEntry),
+                      &(InterestSet->ReadyList));
+
+        IoSetIoObjectState(InterestSet->IoState, POLL_EVENT_IN, TRUE);
+    }
+
+    KeReleaseQueuedLock(InterestSet->ReadyLock);
+    return;
+}
+
+ULONG
+IopCollectInterestSetEvents (
+    PINTEREST_SET InterestSet,
+    PINTEREST_SET_EVENT Events,
+    ULONG EventCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine harvests ready registrations off of an interest set's ready
+    list.
+
+Arguments:
+
+    InterestSet - Supplies a pointer to the interest set.
+
+    Events - Supplies a pointer to an array where the ready events will be
+        returned.
+
+    EventCount - Supplies the number of elements in the events array.
+
+Return Value:
+
+    Returns the number of events returned in the array.
+
+--*/
+
+{
+
+    ULONG Count;
+    PLIST_ENTRY CurrentEntry;
+    ULONG Flags;
+    PLIST_ENTRY LastEntry;
+    PINTEREST_SET_REGISTRATION Registration;
+    ULONG Ready;
+
+    Count = 0;
+    KeAcquireQueuedLock(InterestSet->ReadyLock);
+
+    //
+    // Level-triggered registrations that are still ready get put back on the
+    // end of the list, so only go as far as the current last entry. This also
+    // gives other registrations a fair shot on the next wait.
+    //
+
+    LastEntry = InterestSet->ReadyList.Previous;
+    CurrentEntry = InterestSet->ReadyList.Next;
+    while ((CurrentEntry != &(InterestSet->ReadyList)) &&
+           (Count < EventCount)) {
+
+        Registration = LIST_VALUE(CurrentEntry,
+                                  INTEREST_SET_REGISTRATION,
+                                  ReadyListEntry);
+
+        CurrentEntry = CurrentEntry->Next;
+        LIST_REMOVE(&(Registration->ReadyListEntry));
+        Registration->ReadyListEntry.Next = NULL;
+        Flags = Registration->Flags;
+        Ready = Registration->IoState->Events &
+                (Registration->Events | POLL_NONMASKABLE_EVENTS);
+
+        if ((Ready != 0) &&
+            ((Flags & INTEREST_SET_REGISTRATION_DISABLED) == 0)) {
+
+            Events[Count].Data = Registration->Data;
+            Events[Count].Events = Ready;
+            Events[Count].Flags = 0;
+            Count += 1;
+            if ((Flags & INTEREST_SET_FLAG_ONE_SHOT) != 0) {
+                Registration->Flags = Flags |
+                                      INTEREST_SET_REGISTRATION_DISABLED;
+
+            } else if ((Flags & INTEREST_SET_FLAG_EDGE_TRIGGERED) == 0) {
+                INSERT_BEFORE(&(Registration->ReadyListEntry),
+                              &(InterestSet->ReadyList));
+            }
+        }
+
+        if (&(Registration->ReadyListEntry) == LastEntry) {
+            break;
+        }
+    }
+
+    if (LIST_EMPTY(&(InterestSet->ReadyList)) != FALSE) {
+        IoSetIoObjectState(InterestSet->IoState, POLL_EVENT_IN, FALSE);
+    }
+
+    KeReleaseQueuedLock(InterestSet->ReadyLock);
+    return Count;
+}
+
+KSTATUS
+IopGetInterestSetFromHandle (
+    HANDLE Handle,
+    PIO_HANDLE *IoHandle,
+    PINTEREST_SET *InterestSet
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up an interest set from a user mode handle.
+
+Arguments:
+
+    Handle - Supplies the user mode handle to look up.
+
+    IoHandle - Supplies a pointer where the I/O handle will be returned on
+        success. The caller is responsible for releasing the reference on
+        this handle.
+
+    InterestSet - Supplies a pointer where a pointer to the interest set will
+        be returned on success.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_HANDLE if the handle is not valid.
+
+    STATUS_INVALID_PARAMETER if the handle is not an interest set.
+
+--*/
+
+{
+
+    PFILE_OBJECT FileObject;
+    PIO_HANDLE NewHandle;
+    PKPROCESS Process;
+
+    *IoHandle = NULL;
+    *InterestSet = NULL;
+    Process = PsGetCurrentProcess();
+    NewHandle = ObGetHandleValue(Process->HandleTable, Handle, NULL);
+    if (NewHandle == NULL) {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    FileObject = NewHandle->FileObject;
+    if (FileObject->Properties.Type != IoObjectInterestSet) {
+        IoIoHandleReleaseReference(NewHandle);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ASSERT(FileObject->SpecialIo != NULL);
+
+    *IoHandle = NewHandle;
+    *InterestSet = FileObject->SpecialIo;
+    return STATUS_SUCCESS;
+}
@@ -2299,10 +2299,7 @@ Return Value:
                                        SourceFileObject);
 
             if (NewPathEntry != NULL) {
-                INSERT_BEFORE(
-                        &(NewPathEntry->SiblingListEntry),
-                        &(DestinationDirectoryPathPoint.PathEntry->ChildList));
-
+                IopPathLink(NewPathEntry);
                 IopFileObjectAddReference(SourceFileObject);
             }
         }
@@ -3446,10 +3443,11 @@ Return Value:
         break;
 
     //
-    // Object directories don't need anything to be opened.
+    // Object directories and interest sets don't need anything to be opened.
     //
 
     case IoObjectObjectDirectory:
+    case IoObjectInterestSet:
         Status = STATUS_SUCCESS;
         break;
 
@@ -3672,6 +3670,10 @@ Return Value:
 
         break;
 
+    case IoObjectInterestSet:
+        Status = IopCreateInterestSet(CreatePermissions, FileObject);
+        break;
+
     default:
 
         ASSERT(FALSE);
@@ -3772,6 +3774,12 @@ Return Value:
         }
     }
 
+    //
+    // Drop any interest set registrations made through this handle.
+    //
+
+    IopCloseInterestSetRegistrations(IoHandle);
+
     //
     // Clear the asynchronous receiver information from this handle.
     //
@@ -5355,6 +5363,10 @@ Return Value:
         Status = IopPerformObjectIoOperation(Handle, Context);
         break;
 
+    case IoObjectInterestSet:
+        Status = IopPerformInterestSetIoOperation(Handle, Context);
+        break;
+
     default:
 
         ASSERT(FALSE);
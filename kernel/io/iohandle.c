@@ -301,6 +301,7 @@ Return Value:
     RtlZeroMemory(NewHandle, sizeof(IO_HANDLE));
     NewHandle->HandleType = IoHandleTypeDefault;
     NewHandle->ReferenceCount = 1;
+    INITIALIZE_LIST_HEAD(&(NewHandle->InterestSetList));
 
     ASSERT(NewHandle->DeviceContext == NULL);
 
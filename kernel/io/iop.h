@@ -213,6 +213,13 @@ Module Name:
 
 #define FILE_OBJECT_FLAG_DIRTY_DATA 0x00000040
 
+//
+// This flag is set if the file object has an asynchronous read-ahead queued
+// or in progress.
+//
+
+#define FILE_OBJECT_FLAG_READ_AHEAD_PENDING 0x00000080
+
 //
 // The resource allocation work is currently assigned to the system work queue.
 //
@@ -225,6 +232,14 @@ Module Name:
 
 #define IO_READ_AHEAD_SIZE _128KB
 
+//
+// Define the initial and maximum sizes of the adaptive read-ahead window used
+// for sequential reads of cacheable file objects.
+//
+
+#define IO_READ_AHEAD_MIN_WINDOW _64KB
+#define IO_READ_AHEAD_MAX_WINDOW _1MB
+
 //
 // This flag is set to indicate that the eviction operation is executing as a
 // result of a truncate. All image sections should be unmapped and all page
@@ -391,6 +406,20 @@ Structure Description:
     FileLockEvent - Stores a pointer to the event that's signalled when a file
         object lock is released.
 
+    ReadAheadNextOffset - Stores the offset a read would start at if it
+        continued the last read sequentially.
+
+    ReadAheadEnd - Stores the end of the region that has been read ahead (or
+        queued for reading ahead) into the page cache.
+
+    ReadAheadWindow - Stores the current size of the read-ahead window in
+        bytes, or zero if the file is not being read sequentially.
+
+    DataGeneration - Stores a counter that is incremented whenever the data
+        backing the file changes without going through the page cache, either
+        by a truncate or by a non-cached write. Read-ahead reads without the
+        lock held exclusive, and uses this to avoid caching stale data.
+
 --*/
 
 typedef struct _FILE_OBJECT FILE_OBJECT, *PFILE_OBJECT;
@@ -412,6 +441,10 @@ struct _FILE_OBJECT {
     FILE_PROPERTIES Properties;
     LIST_ENTRY FileLockList;
     PKEVENT FileLockEvent;
+    IO_OFFSET ReadAheadNextOffset;
+    IO_OFFSET ReadAheadEnd;
+    ULONG ReadAheadWindow;
+    volatile ULONG DataGeneration;
 };
 
 /*++
@@ -458,6 +491,25 @@ Structure Description:
 
     FileObject - Stores a pointer to the file object backing this path entry.
 
+    HashListEntry - Stores pointers to the next and previous entries in the
+        parent's child hash table bucket, if the parent has a hash table.
+
+    ChildCount - Stores the number of entries on the child list.
+
+    ChildHashTableSize - Stores the number of buckets in the child hash table.
+        This is always a power of two.
+
+    ChildHashTable - Stores an optional pointer to an array of hash table
+        buckets indexing the child list by name hash. This is only created
+        once a directory accumulates enough children to make a linear search
+        expensive. It is protected by the file object lock, same as the child
+        list.
+
+    ChildSequence - Stores a sequence count that is incremented before and
+        after every change to the child list, child hash table, or a child's
+        identity. It is odd while a change is in progress. Lockless lookups use
+        it to detect that they raced with a modification.
+
 --*/
 
 struct _PATH_ENTRY {
@@ -473,6 +525,11 @@ struct _PATH_ENTRY {
     PPATH_ENTRY Parent;
     LIST_ENTRY ChildList;
     PFILE_OBJECT FileObject;
+    LIST_ENTRY HashListEntry;
+    ULONG ChildCount;
+    ULONG ChildHashTableSize;
+    PLIST_ENTRY ChildHashTable;
+    volatile ULONG ChildSequence;
 };
 
 /*++
@@ -574,6 +631,9 @@ Structure Description:
 
     Async - Stores an optional pointer to the asynchronous receiver state.
 
+    InterestSetList - Stores the head of the list of interest set
+        registrations made through this handle.
+
 --*/
 
 struct _IO_HANDLE {
@@ -586,6 +646,7 @@ struct _IO_HANDLE {
     PFILE_OBJECT FileObject;
     IO_OFFSET CurrentOffset;
     PASYNC_IO_RECEIVER Async;
+    LIST_ENTRY InterestSetList;
 };
 
 /*++
@@ -3194,6 +3255,131 @@ Return Value:
 
 --*/
 
+KSTATUS
+IopCreateInterestSet (
+    FILE_PERMISSIONS Permissions,
+    PFILE_OBJECT *FileObject
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates a new interest set and its file object.
+
+Arguments:
+
+    Permissions - Supplies the permissions to give to the file object.
+
+    FileObject - Supplies a pointer where a pointer to the newly created
+        interest set file object will be returned on success.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+KSTATUS
+IopPerformInterestSetIoOperation (
+    PIO_HANDLE Handle,
+    PIO_CONTEXT IoContext
+    );
+
+/*++
+
+Routine Description:
+
+    This routine reads from or writes to an interest set, which is not
+    supported.
+
+Arguments:
+
+    Handle - Supplies a pointer to the interest set I/O handle.
+
+    IoContext - Supplies a pointer to the I/O context.
+
+Return Value:
+
+    STATUS_NOT_SUPPORTED always.
+
+--*/
+
+VOID
+IopNotifyInterestSets (
+    PIO_OBJECT_STATE IoState,
+    ULONG Events,
+    ULONG RisingEdge
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called when events are set on an I/O object state that
+    is being watched by one or more interest sets. It queues the interested
+    registrations onto their set's ready list.
+
+Arguments:
+
+    IoState - Supplies a pointer to the I/O object state whose events were
+        just set.
+
+    Events - Supplies the mask of events that were set.
+
+    RisingEdge - Supplies the mask of events that transitioned from clear to
+        set.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+IopCloseInterestSetRegistrations (
+    PIO_HANDLE IoHandle
+    );
+
+/*++
+
+Routine Description:
+
+    This routine removes every interest set registration made through the
+    given I/O handle. It is called when the I/O handle is being closed.
+
+Arguments:
+
+    IoHandle - Supplies a pointer to the I/O handle being closed.
+
+Return Value:
+
+    None.
+
+--*/
+
+KSTATUS
+IopInitializeInterestSetSupport (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called during system initialization to set up support for
+    interest sets.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Status code.
+
+--*/
+
 KSTATUS
 IopInitializeTerminalSupport (
     VOID
@@ -4071,6 +4257,30 @@ Return Value:
 
 --*/
 
+VOID
+IopPathLink (
+    PPATH_ENTRY Entry
+    );
+
+/*++
+
+Routine Description:
+
+    This routine links the given path entry into its parent's list of
+    children, making it visible to path walks. This assumes the caller holds
+    the parent path entry's file object lock exclusively.
+
+Arguments:
+
+    Entry - Supplies a pointer to the path entry that is to be linked into the
+        path hierarchy. It must have a parent and must not already be linked.
+
+Return Value:
+
+    None.
+
+--*/
+
 VOID
 IopPathUnlink (
     PPATH_ENTRY Entry
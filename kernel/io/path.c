@@ -58,10 +58,59 @@ Module Name:
 
 #define PATH_UNREACHABLE_PATH_PREFIX "(unreachable)/"
 
+//
+// Define the number of children a path entry must have before its children
+// are indexed by a hash table, the initial number of buckets in that table,
+// and the average number of entries per bucket at which the table is grown.
+//
+
+#define PATH_ENTRY_HASH_THRESHOLD 16
+#define PATH_ENTRY_HASH_INITIAL_SIZE 32
+#define PATH_ENTRY_HASH_MAX_LOAD 2
+
+//
+// Define the size each processor's lockless lookup reader counts are padded
+// out to, to keep processors from sharing cache lines.
+//
+
+#define PATH_WALK_READERS_SIZE 64
+
+//
+// Define the number of path entries and hash tables that pile up waiting for
+// lockless lookups to drain before a work item is queued to free them.
+//
+
+#define PATH_DEFERRED_FREE_BATCH_SIZE 64
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
 
+/*++
+
+Structure Description:
+
+    This structure defines the counts of lockless path lookups entered and
+    exited on a processor for each of the two reader epochs. The counts only
+    ever increase. A thread may exit on a different processor than the one it
+    entered on, so only the sums across all processors are meaningful.
+
+Members:
+
+    Enter - Stores the number of lockless lookups started in each epoch.
+
+    Exit - Stores the number of lockless lookups finished in each epoch.
+
+    Padding - Stores padding out to the size of a cache line.
+
+--*/
+
+typedef struct _PATH_WALK_READERS {
+    volatile ULONG Enter[2];
+    volatile ULONG Exit[2];
+    UCHAR Padding[PATH_WALK_READERS_SIZE - (4 * sizeof(ULONG))];
+} PATH_WALK_READERS, *PPATH_WALK_READERS;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -121,6 +170,30 @@ IopFindPathPoint (
     PPATH_POINT Result
     );
 
+BOOL
+IopFindPathPointLockless (
+    PPATH_POINT Parent,
+    ULONG OpenFlags,
+    PCSTR Name,
+    ULONG NameSize,
+    ULONG Hash,
+    PPATH_POINT Result
+    );
+
+PPATH_ENTRY
+IopFindChildPathEntry (
+    PPATH_ENTRY Parent,
+    PCSTR Name,
+    ULONG NameSize,
+    ULONG Hash
+    );
+
+VOID
+IopResizeChildHashTable (
+    PPATH_ENTRY Parent,
+    ULONG NewSize
+    );
+
 VOID
 IopPathEntryReleaseReference (
     PPATH_ENTRY Entry,
@@ -138,6 +211,42 @@ IopGetPathEntryCacheTargetSize (
     VOID
     );
 
+VOID
+IopPathBeginChildUpdate (
+    PPATH_ENTRY Parent
+    );
+
+VOID
+IopPathEndChildUpdate (
+    PPATH_ENTRY Parent
+    );
+
+ULONG
+IopPathWalkEnter (
+    VOID
+    );
+
+VOID
+IopPathWalkExit (
+    ULONG Epoch
+    );
+
+VOID
+IopPathWalkSynchronize (
+    VOID
+    );
+
+VOID
+IopPathDeferFree (
+    PLIST_ENTRY ListEntry,
+    PLIST_ENTRY ListHead
+    );
+
+VOID
+IopPathReclaimDeferredFrees (
+    PVOID Parameter
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -163,6 +272,30 @@ LIST_ENTRY IoPathEntryList;
 UINTN IoPathEntryListSize;
 UINTN IoPathEntryListMaxSize;
 
+//
+// Store the lists of destroyed path entries and replaced child hash tables
+// that cannot be freed until every lockless lookup that might still be
+// looking at them has finished, the number of things on them, and whether
+// the work item freeing them has been queued. These are protected by the
+// path entry list lock.
+//
+
+LIST_ENTRY IoPathDeferredEntryList;
+LIST_ENTRY IoPathDeferredTableList;
+UINTN IoPathDeferredCount;
+BOOL IoPathDeferredWorkQueued;
+PWORK_ITEM IoPathDeferredWorkItem;
+
+//
+// Store the per-processor lockless lookup counts, the current reader epoch,
+// and the lock serializing threads waiting for readers to drain.
+//
+
+PPATH_WALK_READERS IoPathWalkReaders;
+ULONG IoPathWalkReaderCount;
+volatile ULONG IoPathWalkEpoch;
+PQUEUED_LOCK IoPathWalkSynchronizeLock;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -468,6 +601,46 @@ Return Value:
 
     INITIALIZE_LIST_HEAD(&IoPathEntryList);
     IoPathEntryListSize = 0;
+    INITIALIZE_LIST_HEAD(&IoPathDeferredEntryList);
+    INITIALIZE_LIST_HEAD(&IoPathDeferredTableList);
+    IoPathDeferredCount = 0;
+    IoPathDeferredWorkQueued = FALSE;
+    IoPathDeferredWorkItem = KeCreateWorkItem(
+                                        NULL,
+                                        WorkPriorityNormal,
+                                        IopPathReclaimDeferredFrees,
+                                        NULL,
+                                        PATH_ALLOCATION_TAG);
+
+    if (IoPathDeferredWorkItem == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto InitializePathSupportEnd;
+    }
+
+    IoPathWalkSynchronizeLock = KeCreateQueuedLock();
+    if (IoPathWalkSynchronizeLock == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto InitializePathSupportEnd;
+    }
+
+    //
+    // Processors beyond the ones active now share the first slot, which is
+    // correct if slower.
+    //
+
+    IoPathWalkReaderCount = KeGetActiveProcessorCount();
+    IoPathWalkReaders = MmAllocateNonPagedPool(
+                           sizeof(PATH_WALK_READERS) * IoPathWalkReaderCount,
+                           PATH_ALLOCATION_TAG);
+
+    if (IoPathWalkReaders == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto InitializePathSupportEnd;
+    }
+
+    RtlZeroMemory(IoPathWalkReaders,
+                  sizeof(PATH_WALK_READERS) * IoPathWalkReaderCount);
+
     MaxMemory = MmGetTotalPhysicalPages() * MmPageSize();
     if (MaxMemory > (MAX_UINTN - (UINTN)KERNEL_VA_START + 1)) {
         MaxMemory = MAX_UINTN - (UINTN)KERNEL_VA_START + 1;
@@ -507,6 +680,16 @@ Return Value:
             IoPathEntryListLock = NULL;
         }
 
+        if (IoPathWalkSynchronizeLock != NULL) {
+            KeDestroyQueuedLock(IoPathWalkSynchronizeLock);
+            IoPathWalkSynchronizeLock = NULL;
+        }
+
+        if (IoPathWalkReaders != NULL) {
+            MmFreeNonPagedPool(IoPathWalkReaders);
+            IoPathWalkReaders = NULL;
+        }
+
         if (RootObject != NULL) {
             ObReleaseReference(RootObject);
         }
@@ -1040,6 +1223,71 @@ Return Value:
     return FALSE;
 }
 
+VOID
+IopPathLink (
+    PPATH_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine links the given path entry into its parent's list of
+    children, making it visible to path walks. This assumes the caller holds
+    the parent path entry's file object lock exclusively.
+
+Arguments:
+
+    Entry - Supplies a pointer to the path entry that is to be linked into the
+        path hierarchy. It must have a parent and must not already be linked.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+    PPATH_ENTRY Parent;
+
+    Parent = Entry->Parent;
+
+    ASSERT(Parent != NULL);
+    ASSERT(Entry->SiblingListEntry.Next == NULL);
+    ASSERT(Entry->HashListEntry.Next == NULL);
+
+    IopPathBeginChildUpdate(Parent);
+    INSERT_BEFORE(&(Entry->SiblingListEntry), &(Parent->ChildList));
+    Parent->ChildCount += 1;
+
+    //
+    // Once a directory has enough children, index them by hash so lookups
+    // don't have to walk the whole list. Grow the table as the directory
+    // grows. If the allocation fails, the old table (or the list alone) is
+    // still correct, just slower.
+    //
+
+    if (Parent->ChildHashTable != NULL) {
+        Index = Entry->Hash & (Parent->ChildHashTableSize - 1);
+        INSERT_BEFORE(&(Entry->HashListEntry),
+                      &(Parent->ChildHashTable[Index]));
+
+        if (Parent->ChildCount >
+            (Parent->ChildHashTableSize * PATH_ENTRY_HASH_MAX_LOAD)) {
+
+            IopResizeChildHashTable(Parent, Parent->ChildHashTableSize << 1);
+        }
+
+    } else if (Parent->ChildCount >= PATH_ENTRY_HASH_THRESHOLD) {
+        IopResizeChildHashTable(Parent, PATH_ENTRY_HASH_INITIAL_SIZE);
+    }
+
+    IopPathEndChildUpdate(Parent);
+    return;
+}
+
 VOID
 IopPathUnlink (
     PPATH_ENTRY Entry
@@ -1075,8 +1323,19 @@ Return Value:
     //
 
     if (Entry->SiblingListEntry.Next != NULL) {
+        IopPathBeginChildUpdate(Entry->Parent);
         LIST_REMOVE(&(Entry->SiblingListEntry));
         Entry->SiblingListEntry.Next = NULL;
+
+        ASSERT(Entry->Parent->ChildCount != 0);
+
+        Entry->Parent->ChildCount -= 1;
+        if (Entry->HashListEntry.Next != NULL) {
+            LIST_REMOVE(&(Entry->HashListEntry));
+            Entry->HashListEntry.Next = NULL;
+        }
+
+        IopPathEndChildUpdate(Entry->Parent);
     }
 
     return;
@@ -1498,23 +1757,37 @@ Return Value:
 
     //
     // First cruise through the cached list looking for this entry. Successful
-    // return adds a reference to the found entry.
+    // return adds a reference to the found entry. Try without the directory
+    // lock first, falling back to the lock if the lockless search misses or
+    // races with a change to the directory.
     //
 
+    Hash = IopHashPathString(Name, NameSize);
+    FoundPathPoint = FALSE;
     if (DirectoryLockHeld == FALSE) {
-        KeAcquireSharedExclusiveLockShared(DirectoryFileObject->Lock);
+        FoundPathPoint = IopFindPathPointLockless(Directory,
+                                                  OpenFlags,
+                                                  Name,
+                                                  NameSize,
+                                                  Hash,
+                                                  Result);
     }
 
-    Hash = IopHashPathString(Name, NameSize);
-    FoundPathPoint = IopFindPathPoint(Directory,
-                                      OpenFlags,
-                                      Name,
-                                      NameSize,
-                                      Hash,
-                                      Result);
+    if (FoundPathPoint == FALSE) {
+        if (DirectoryLockHeld == FALSE) {
+            KeAcquireSharedExclusiveLockShared(DirectoryFileObject->Lock);
+        }
 
-    if (DirectoryLockHeld == FALSE) {
-        KeReleaseSharedExclusiveLockShared(DirectoryFileObject->Lock);
+        FoundPathPoint = IopFindPathPoint(Directory,
+                                          OpenFlags,
+                                          Name,
+                                          NameSize,
+                                          Hash,
+                                          Result);
+
+        if (DirectoryLockHeld == FALSE) {
+            KeReleaseSharedExclusiveLockShared(DirectoryFileObject->Lock);
+        }
     }
 
     if (FoundPathPoint != FALSE) {
@@ -2946,19 +3219,17 @@ Return Value:
                (FileObject->Device == PathRoot) &&
                (Result->MountPoint == Directory->MountPoint));
 
-        Result->PathEntry->Negative = FALSE;
-        Result->PathEntry->DoNotCache = DoNotCache;
-
         ASSERT(FileObject != NULL);
         ASSERT(FileObject->ReferenceCount >= 2);
 
+        IopPathBeginChildUpdate(DirectoryEntry);
         Result->PathEntry->FileObject = FileObject;
+        Result->PathEntry->Negative = FALSE;
+        Result->PathEntry->DoNotCache = DoNotCache;
+        IopPathEndChildUpdate(DirectoryEntry);
         IopFileObjectAddPathEntryReference(Result->PathEntry->FileObject);
         if ((OpenFlags & OPEN_FLAG_UNLINK_ON_CREATE) != 0) {
-            if (Result->PathEntry->SiblingListEntry.Next != NULL) {
-                LIST_REMOVE(&(Result->PathEntry->SiblingListEntry));
-                Result->PathEntry->SiblingListEntry.Next = NULL;
-            }
+            IopPathUnlink(Result->PathEntry);
         }
 
     //
@@ -2993,8 +3264,7 @@ Return Value:
             ASSERT((FileObject == NULL) ||
                    (FileObject->Properties.HardLinkCount != 0));
 
-            INSERT_BEFORE(&(PathEntry->SiblingListEntry),
-                          &(DirectoryEntry->ChildList));
+            IopPathLink(PathEntry);
         }
 
         Result->PathEntry = PathEntry;
@@ -3240,144 +3510,452 @@ Return Value:
 
 {
 
-    PLIST_ENTRY CurrentEntry;
     PPATH_ENTRY Entry;
     PMOUNT_POINT FoundMountPoint;
     PPATH_ENTRY FoundPathEntry;
     PFILE_OBJECT ParentFileObject;
-    BOOL ResultValid;
 
-    ResultValid = FALSE;
     ParentFileObject = Parent->PathEntry->FileObject;
 
     ASSERT(NameSize != 0);
     ASSERT(KeIsSharedExclusiveLockHeld(ParentFileObject->Lock) != FALSE);
 
+    Entry = IopFindChildPathEntry(Parent->PathEntry, Name, NameSize, Hash);
+    if (Entry == NULL) {
+        return FALSE;
+    }
+
     //
-    // Cruise through the cached list looking for this entry.
+    // If the found entry is a mount point, then the parent mount point's
+    // children are searched for a matching mount point. Note that this search
+    // may fail as the path entry is not necessarily a mount point under the
+    // current mount tree. It takes a reference on success. Skip this if the
+    // open flags dictate that the final mount point should not be followed.
     //
 
-    CurrentEntry = Parent->PathEntry->ChildList.Next;
-    while (CurrentEntry != &(Parent->PathEntry->ChildList)) {
-        Entry = LIST_VALUE(CurrentEntry, PATH_ENTRY, SiblingListEntry);
-        CurrentEntry = CurrentEntry->Next;
-
-        //
-        // Quickly skip entries without a name or with the wrong hash.
-        //
-
-        if ((Entry->Hash != Hash) || (Entry->Name == NULL)) {
-            continue;
-        }
-
-        //
-        // If the names are not equal, this isn't the winner.
-        //
-
-        if (IopArePathsEqual(Entry->Name, Name, NameSize) == FALSE) {
-            continue;
-        }
-
-        //
-        // If the found entry is a mount point, then the parent mount point's
-        // children are searched for a matching mount point. Note that this
-        // search may fail as the path entry is not necessarily a mount point
-        // under the current mount tree. It takes a reference on success. Skip
-        // this if the open flags dictate that the final mount point should not
-        // be followed.
-        //
-
-        FoundMountPoint = NULL;
-        if ((Entry->MountCount != 0) &&
-            ((OpenFlags & OPEN_FLAG_NO_MOUNT_POINT) == 0)) {
+    FoundMountPoint = NULL;
+    if ((Entry->MountCount != 0) &&
+        ((OpenFlags & OPEN_FLAG_NO_MOUNT_POINT) == 0)) {
 
-            FoundMountPoint = IopFindMountPoint(Parent->MountPoint, Entry);
-            if (FoundMountPoint != NULL) {
-                FoundPathEntry = FoundMountPoint->TargetEntry;
-            }
+        FoundMountPoint = IopFindMountPoint(Parent->MountPoint, Entry);
+        if (FoundMountPoint != NULL) {
+            FoundPathEntry = FoundMountPoint->TargetEntry;
         }
+    }
 
-        //
-        // Use the found entry and the same mount point as the parent if the
-        // entry was found to not be a mount point.
-        //
-
-        if (FoundMountPoint == NULL) {
-            FoundPathEntry = Entry;
-            FoundMountPoint = Parent->MountPoint;
-            IoMountPointAddReference(FoundMountPoint);
-        }
+    //
+    // Use the found entry and the same mount point as the parent if the entry
+    // was found to not be a mount point.
+    //
 
-        IoPathEntryAddReference(FoundPathEntry);
-        Result->PathEntry = FoundPathEntry;
-        Result->MountPoint = FoundMountPoint;
-        ResultValid = TRUE;
-        break;
+    if (FoundMountPoint == NULL) {
+        FoundPathEntry = Entry;
+        FoundMountPoint = Parent->MountPoint;
+        IoMountPointAddReference(FoundMountPoint);
     }
 
-    return ResultValid;
+    IoPathEntryAddReference(FoundPathEntry);
+    Result->PathEntry = FoundPathEntry;
+    Result->MountPoint = FoundMountPoint;
+    return TRUE;
 }
 
-VOID
-IopPathEntryReleaseReference (
-    PPATH_ENTRY Entry,
-    BOOL EnforceCacheSize,
-    BOOL Destroy
+BOOL
+IopFindPathPointLockless (
+    PPATH_POINT Parent,
+    ULONG OpenFlags,
+    PCSTR Name,
+    ULONG NameSize,
+    ULONG Hash,
+    PPATH_POINT Result
     )
 
 /*++
 
 Routine Description:
 
-    This routine decrements the reference count of the given path entry.
+    This routine attempts to find a cached child of the given path point
+    without acquiring the parent's file object lock. The parent's sequence
+    count is checked after every read, and the search gives up as soon as the
+    parent's children are seen to change. Entries found this way are only
+    returned if they already have references, since resurrecting an entry
+    from the path entry cache requires locks. Mount points are also left to
+    the locked search.
 
 Arguments:
 
-    Entry - Supplies a pointer to the path entry.
+    Parent - Supplies a pointer to the parent path point to search. The
+        caller must hold a reference on it.
 
-    EnforceCacheSize - Supplies a boolean indicating whether or not to destroy
-        extra path entries if the cache is too large. This is used to prevent
-        recursion of releasing references.
+    OpenFlags - Supplies a bitfield of flags governing the behavior of the
+        handle. See OPEN_FLAG_* definitions.
 
-    Destroy - Supplies a boolean indicating this path entry should be destroyed
-        regardless of the path entry cache. It is used by the path entry cache
-        to clean out entries.
+    Name - Supplies a pointer the query string, which may not be null
+        terminated.
+
+    NameSize - Supplies the size of the string including the assumed null
+        terminator that is never checked.
+
+    Hash - Supplies the hash of the name query string.
+
+    Result - Supplies a pointer to a path point that receives the found path
+        entry and mount point, with a reference added to each.
 
 Return Value:
 
-    None.
+    TRUE if a match was found.
+
+    FALSE if the locked search should be performed instead, either because
+    there was no match or because the lockless search could not be completed.
 
 --*/
 
 {
 
-    UINTN CacheTarget;
     PLIST_ENTRY CurrentEntry;
-    PPATH_ENTRY DestroyEntry;
-    LIST_ENTRY DestroyList;
-    BOOL Inserted;
-    PPATH_ENTRY NextEntry;
-    PFILE_OBJECT NextFileObject;
+    PPATH_ENTRY Entry;
+    ULONG Epoch;
+    PPATH_ENTRY FoundEntry;
+    PLIST_ENTRY ListHead;
     ULONG OldReferenceCount;
-    PPATH_ENTRY Parent;
+    PPATH_ENTRY ParentEntry;
+    ULONG ReferenceCount;
+    BOOL ResultValid;
+    ULONG Sequence;
+    PLIST_ENTRY Table;
+    ULONG TableSize;
 
-    ASSERT(KeGetRunLevel() == RunLevelLow);
+    FoundEntry = NULL;
+    ResultValid = FALSE;
+    ParentEntry = Parent->PathEntry;
+    Epoch = IopPathWalkEnter();
+    Sequence = ParentEntry->ChildSequence;
+    if ((Sequence & 0x1) != 0) {
+        goto FindPathPointLocklessEnd;
+    }
 
-    Inserted = FALSE;
-    NextFileObject = NULL;
-    while (Entry != NULL) {
+    RtlMemoryBarrier();
+    Table = ParentEntry->ChildHashTable;
+    TableSize = ParentEntry->ChildHashTableSize;
+    RtlMemoryBarrier();
+    if (ParentEntry->ChildSequence != Sequence) {
+        goto FindPathPointLocklessEnd;
+    }
 
-        //
-        // Acquire the parent's lock to avoid a situation where this routine
-        // decrements the reference count to zero, but before removing it
-        // someone else increments, decrements, removes and frees the object.
-        //
+    if (Table != NULL) {
+        ListHead = &(Table[Hash & (TableSize - 1)]);
 
-        NextEntry = Entry->Parent;
-        if (NextEntry != NULL) {
-            NextFileObject = NextEntry->FileObject;
-            KeAcquireSharedExclusiveLockExclusive(NextFileObject->Lock);
-        }
+    } else {
+        ListHead = &(ParentEntry->ChildList);
+    }
+
+    //
+    // Make sure the parent's children haven't changed before following each
+    // link, as a concurrent change can leave the list inconsistent. Memory
+    // stays valid even if the entry is destroyed, as freeing is deferred until
+    // lockless lookups have finished.
+    //
+
+    CurrentEntry = ListHead->Next;
+    while (TRUE) {
+        RtlMemoryBarrier();
+        if (ParentEntry->ChildSequence != Sequence) {
+            goto FindPathPointLocklessEnd;
+        }
+
+        if ((CurrentEntry == ListHead) || (CurrentEntry == NULL)) {
+            goto FindPathPointLocklessEnd;
+        }
+
+        if (Table != NULL) {
+            Entry = LIST_VALUE(CurrentEntry, PATH_ENTRY, HashListEntry);
+
+        } else {
+            Entry = LIST_VALUE(CurrentEntry, PATH_ENTRY, SiblingListEntry);
+        }
+
+        if ((Entry->Hash == Hash) &&
+            (Entry->Name != NULL) &&
+            (IopArePathsEqual(Entry->Name, Name, NameSize) != FALSE)) {
+
+            break;
+        }
+
+        CurrentEntry = CurrentEntry->Next;
+    }
+
+    if ((Entry->MountCount != 0) &&
+        ((OpenFlags & OPEN_FLAG_NO_MOUNT_POINT) == 0)) {
+
+        goto FindPathPointLocklessEnd;
+    }
+
+    //
+    // Add a reference only if the entry already has one. An entry with no
+    // references is either sitting in the cache or being destroyed.
+    //
+
+    ReferenceCount = Entry->ReferenceCount;
+    while (TRUE) {
+        if (ReferenceCount == 0) {
+            goto FindPathPointLocklessEnd;
+        }
+
+        ASSERT(ReferenceCount < 0x10000000);
+
+        OldReferenceCount = RtlAtomicCompareExchange32(
+                                                     &(Entry->ReferenceCount),
+                                                     ReferenceCount + 1,
+                                                     ReferenceCount);
+
+        if (OldReferenceCount == ReferenceCount) {
+            break;
+        }
+
+        ReferenceCount = OldReferenceCount;
+    }
+
+    //
+    // With the reference held, make sure the entry is still the parent's
+    // child by this name.
+    //
+
+    FoundEntry = Entry;
+    RtlMemoryBarrier();
+    if (ParentEntry->ChildSequence == Sequence) {
+        ResultValid = TRUE;
+    }
+
+FindPathPointLocklessEnd:
+    IopPathWalkExit(Epoch);
+    if (ResultValid != FALSE) {
+        Result->PathEntry = FoundEntry;
+        Result->MountPoint = Parent->MountPoint;
+        IoMountPointAddReference(Result->MountPoint);
+
+    } else if (FoundEntry != NULL) {
+        IoPathEntryReleaseReference(FoundEntry);
+    }
+
+    return ResultValid;
+}
+
+PPATH_ENTRY
+IopFindChildPathEntry (
+    PPATH_ENTRY Parent,
+    PCSTR Name,
+    ULONG NameSize,
+    ULONG Hash
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the cached child path entry with the given name. It
+    uses the parent's child hash table if there is one, or searches the child
+    list otherwise. This routine assumes the parent's file object lock is
+    held.
+
+Arguments:
+
+    Parent - Supplies a pointer to the parent path entry whose children should
+        be searched.
+
+    Name - Supplies a pointer the query string, which may not be null
+        terminated.
+
+    NameSize - Supplies the size of the string including the assumed null
+        terminator that is never checked.
+
+    Hash - Supplies the hash of the name query string.
+
+Return Value:
+
+    Returns a pointer to the matching child path entry, positive or negative.
+    No reference is added.
+
+    NULL if no cached child has the given name.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PPATH_ENTRY Entry;
+    PLIST_ENTRY ListHead;
+
+    if (Parent->ChildHashTable != NULL) {
+        ListHead = &(Parent->ChildHashTable[Hash &
+                                            (Parent->ChildHashTableSize - 1)]);
+
+    } else {
+        ListHead = &(Parent->ChildList);
+    }
+
+    CurrentEntry = ListHead->Next;
+    while (CurrentEntry != ListHead) {
+        if (Parent->ChildHashTable != NULL) {
+            Entry = LIST_VALUE(CurrentEntry, PATH_ENTRY, HashListEntry);
+
+        } else {
+            Entry = LIST_VALUE(CurrentEntry, PATH_ENTRY, SiblingListEntry);
+        }
+
+        CurrentEntry = CurrentEntry->Next;
+
+        //
+        // Quickly skip entries without a name or with the wrong hash.
+        //
+
+        if ((Entry->Hash != Hash) || (Entry->Name == NULL)) {
+            continue;
+        }
+
+        //
+        // If the names are equal, this is the winner.
+        //
+
+        if (IopArePathsEqual(Entry->Name, Name, NameSize) != FALSE) {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+VOID
+IopResizeChildHashTable (
+    PPATH_ENTRY Parent,
+    ULONG NewSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates or grows the hash table indexing a path entry's
+    children, rehashing every child into it. This routine assumes the parent's
+    file object lock is held exclusively and a child update is in progress. On
+    allocation failure, the existing table (if any) is left in place.
+
+Arguments:
+
+    Parent - Supplies a pointer to the parent path entry.
+
+    NewSize - Supplies the new number of buckets. This must be a power of two.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PPATH_ENTRY Entry;
+    ULONG Index;
+    PLIST_ENTRY NewTable;
+
+    ASSERT(POWER_OF_2(NewSize) != FALSE);
+    ASSERT((Parent->ChildSequence & 0x1) != 0);
+
+    //
+    // The table is preceded by a list entry used to queue it for deferred
+    // freeing once it is replaced, since lockless lookups may still be
+    // walking it.
+    //
+
+    NewTable = MmAllocatePagedPool(sizeof(LIST_ENTRY) * (NewSize + 1),
+                                   PATH_ALLOCATION_TAG);
+
+    if (NewTable == NULL) {
+        return;
+    }
+
+    NewTable += 1;
+    for (Index = 0; Index < NewSize; Index += 1) {
+        INITIALIZE_LIST_HEAD(&(NewTable[Index]));
+    }
+
+    CurrentEntry = Parent->ChildList.Next;
+    while (CurrentEntry != &(Parent->ChildList)) {
+        Entry = LIST_VALUE(CurrentEntry, PATH_ENTRY, SiblingListEntry);
+        CurrentEntry = CurrentEntry->Next;
+        Index = Entry->Hash & (NewSize - 1);
+        INSERT_BEFORE(&(Entry->HashListEntry), &(NewTable[Index]));
+    }
+
+    if (Parent->ChildHashTable != NULL) {
+        IopPathDeferFree(Parent->ChildHashTable - 1, &IoPathDeferredTableList);
+    }
+
+    Parent->ChildHashTable = NewTable;
+    Parent->ChildHashTableSize = NewSize;
+    return;
+}
+
+VOID
+IopPathEntryReleaseReference (
+    PPATH_ENTRY Entry,
+    BOOL EnforceCacheSize,
+    BOOL Destroy
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decrements the reference count of the given path entry.
+
+Arguments:
+
+    Entry - Supplies a pointer to the path entry.
+
+    EnforceCacheSize - Supplies a boolean indicating whether or not to destroy
+        extra path entries if the cache is too large. This is used to prevent
+        recursion of releasing references.
+
+    Destroy - Supplies a boolean indicating this path entry should be destroyed
+        regardless of the path entry cache. It is used by the path entry cache
+        to clean out entries.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN CacheTarget;
+    PLIST_ENTRY CurrentEntry;
+    PPATH_ENTRY DestroyEntry;
+    LIST_ENTRY DestroyList;
+    BOOL Inserted;
+    PPATH_ENTRY NextEntry;
+    PFILE_OBJECT NextFileObject;
+    ULONG OldReferenceCount;
+    PPATH_ENTRY Parent;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    Inserted = FALSE;
+    NextFileObject = NULL;
+    while (Entry != NULL) {
+
+        //
+        // Acquire the parent's lock to avoid a situation where this routine
+        // decrements the reference count to zero, but before removing it
+        // someone else increments, decrements, removes and frees the object.
+        //
+
+        NextEntry = Entry->Parent;
+        if (NextEntry != NULL) {
+            NextFileObject = NextEntry->FileObject;
+            KeAcquireSharedExclusiveLockExclusive(NextFileObject->Lock);
+        }
 
         OldReferenceCount = RtlAtomicAdd32(&(Entry->ReferenceCount), -1);
 
@@ -3576,9 +4154,20 @@ Return Value:
     //
 
     ASSERT(LIST_EMPTY(&(Entry->ChildList)) != FALSE);
+    ASSERT(Entry->ChildCount == 0);
     ASSERT(Entry->CacheListEntry.Next == NULL);
     ASSERT(Entry != IoPathPointRoot.PathEntry);
 
+    //
+    // The child hash table can be freed right away, as lockless lookups only
+    // search directories they hold a reference on.
+    //
+
+    if (Entry->ChildHashTable != NULL) {
+        MmFreePagedPool(Entry->ChildHashTable - 1);
+        Entry->ChildHashTable = NULL;
+    }
+
     if (Parent != NULL) {
 
         //
@@ -3589,10 +4178,7 @@ Return Value:
         // entries.
         //
 
-        if (Entry->SiblingListEntry.Next != NULL) {
-            LIST_REMOVE(&(Entry->SiblingListEntry));
-            Entry->SiblingListEntry.Next = NULL;
-        }
+        IopPathUnlink(Entry);
 
         ASSERT(ParentFileObject != NULL);
 
@@ -3621,7 +4207,13 @@ Return Value:
         IopFileObjectReleaseReference(Entry->FileObject);
     }
 
-    MmFreePagedPool(Entry);
+    //
+    // A lockless lookup may still be looking at the entry, so defer freeing
+    // it until they have all finished. The cache list entry is free for use,
+    // and is not something lockless lookups read.
+    //
+
+    IopPathDeferFree(&(Entry->CacheListEntry), &IoPathDeferredEntryList);
     return Parent;
 }
 
@@ -3679,3 +4271,332 @@ Return Value:
     return 0;
 }
 
+VOID
+IopPathBeginChildUpdate (
+    PPATH_ENTRY Parent
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks the start of a change to a path entry's children,
+    causing lockless lookups in the directory to fall back to the locked
+    search. This routine assumes the parent's file object lock is held
+    exclusively.
+
+Arguments:
+
+    Parent - Supplies a pointer to the path entry whose children are changing.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ASSERT((Parent->ChildSequence & 0x1) == 0);
+
+    Parent->ChildSequence += 1;
+    RtlMemoryBarrier();
+    return;
+}
+
+VOID
+IopPathEndChildUpdate (
+    PPATH_ENTRY Parent
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks the end of a change to a path entry's children.
+
+Arguments:
+
+    Parent - Supplies a pointer to the path entry whose children changed.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ASSERT((Parent->ChildSequence & 0x1) != 0);
+
+    RtlMemoryBarrier();
+    Parent->ChildSequence += 1;
+    return;
+}
+
+ULONG
+IopPathWalkEnter (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks the start of a lockless path lookup. Path entries and
+    child hash tables freed after this point will not actually be released
+    until the matching exit.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the epoch the lookup was counted in, which must be passed to the
+    exit routine.
+
+--*/
+
+{
+
+    ULONG Epoch;
+    ULONG Processor;
+
+    Epoch = IoPathWalkEpoch & 0x1;
+    Processor = KeGetCurrentProcessorNumber();
+    if (Processor >= IoPathWalkReaderCount) {
+        Processor = 0;
+    }
+
+    RtlAtomicAdd32(&(IoPathWalkReaders[Processor].Enter[Epoch]), 1);
+    return Epoch;
+}
+
+VOID
+IopPathWalkExit (
+    ULONG Epoch
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks the end of a lockless path lookup.
+
+Arguments:
+
+    Epoch - Supplies the epoch returned when the lookup was entered.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Processor;
+
+    Processor = KeGetCurrentProcessorNumber();
+    if (Processor >= IoPathWalkReaderCount) {
+        Processor = 0;
+    }
+
+    RtlAtomicAdd32(&(IoPathWalkReaders[Processor].Exit[Epoch]), 1);
+    return;
+}
+
+VOID
+IopPathWalkSynchronize (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine waits for every lockless path lookup that was in progress
+    when it was called to finish. Lookups started afterwards are not waited
+    on.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Enters;
+    ULONG Epoch;
+    ULONG Exits;
+    ULONG Pass;
+    ULONG Processor;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    //
+    // Flip the epoch so new lookups are counted separately, then wait for the
+    // old epoch to drain. Exits are summed before enters so that every exit
+    // counted has its enter counted too. This is done for both epochs because
+    // a lookup may read the epoch just before the flip and only count itself
+    // after the wait.
+    //
+
+    KeAcquireQueuedLock(IoPathWalkSynchronizeLock);
+    for (Pass = 0; Pass < 2; Pass += 1) {
+        Epoch = IoPathWalkEpoch & 0x1;
+        IoPathWalkEpoch = Epoch ^ 0x1;
+        RtlMemoryBarrier();
+        while (TRUE) {
+            Exits = 0;
+            for (Processor = 0;
+                 Processor < IoPathWalkReaderCount;
+                 Processor += 1) {
+
+                Exits += IoPathWalkReaders[Processor].Exit[Epoch];
+            }
+
+            RtlMemoryBarrier();
+            Enters = 0;
+            for (Processor = 0;
+                 Processor < IoPathWalkReaderCount;
+                 Processor += 1) {
+
+                Enters += IoPathWalkReaders[Processor].Enter[Epoch];
+            }
+
+            if (Enters == Exits) {
+                break;
+            }
+
+            KeYield();
+        }
+    }
+
+    KeReleaseQueuedLock(IoPathWalkSynchronizeLock);
+    return;
+}
+
+VOID
+IopPathDeferFree (
+    PLIST_ENTRY ListEntry,
+    PLIST_ENTRY ListHead
+    )
+
+/*++
+
+Routine Description:
+
+    This routine puts a path entry or child hash table that lockless lookups
+    may still be looking at on a list to be freed later. Once enough have
+    piled up, a work item is queued to wait out the lookups and free them.
+
+Arguments:
+
+    ListEntry - Supplies a pointer to the list entry of the thing to free.
+
+    ListHead - Supplies a pointer to the deferred list to put it on.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    BOOL QueueWorkItem;
+    KSTATUS Status;
+
+    QueueWorkItem = FALSE;
+    KeAcquireQueuedLock(IoPathEntryListLock);
+    INSERT_BEFORE(ListEntry, ListHead);
+    IoPathDeferredCount += 1;
+    if ((IoPathDeferredCount >= PATH_DEFERRED_FREE_BATCH_SIZE) &&
+        (IoPathDeferredWorkQueued == FALSE)) {
+
+        IoPathDeferredWorkQueued = TRUE;
+        QueueWorkItem = TRUE;
+    }
+
+    KeReleaseQueuedLock(IoPathEntryListLock);
+    if (QueueWorkItem != FALSE) {
+        Status = KeQueueWorkItem(IoPathDeferredWorkItem);
+
+        ASSERT(KSUCCESS(Status));
+    }
+
+    return;
+}
+
+VOID
+IopPathReclaimDeferredFrees (
+    PVOID Parameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is the work item that frees the path entries and child hash
+    tables that were released while lockless lookups may have been looking at
+    them.
+
+Arguments:
+
+    Parameter - Supplies an unused parameter.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PPATH_ENTRY Entry;
+    LIST_ENTRY EntryList;
+    LIST_ENTRY TableList;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    INITIALIZE_LIST_HEAD(&EntryList);
+    INITIALIZE_LIST_HEAD(&TableList);
+    KeAcquireQueuedLock(IoPathEntryListLock);
+    if (LIST_EMPTY(&IoPathDeferredEntryList) == FALSE) {
+        MOVE_LIST(&IoPathDeferredEntryList, &EntryList);
+        INITIALIZE_LIST_HEAD(&IoPathDeferredEntryList);
+    }
+
+    if (LIST_EMPTY(&IoPathDeferredTableList) == FALSE) {
+        MOVE_LIST(&IoPathDeferredTableList, &TableList);
+        INITIALIZE_LIST_HEAD(&IoPathDeferredTableList);
+    }
+
+    IoPathDeferredCount = 0;
+    IoPathDeferredWorkQueued = FALSE;
+    KeReleaseQueuedLock(IoPathEntryListLock);
+    IopPathWalkSynchronize();
+    while (LIST_EMPTY(&EntryList) == FALSE) {
+        CurrentEntry = EntryList.Next;
+        LIST_REMOVE(CurrentEntry);
+        Entry = LIST_VALUE(CurrentEntry, PATH_ENTRY, CacheListEntry);
+        MmFreePagedPool(Entry);
+    }
+
+    while (LIST_EMPTY(&TableList) == FALSE) {
+        CurrentEntry = TableList.Next;
+        LIST_REMOVE(CurrentEntry);
+        MmFreePagedPool(CurrentEntry);
+    }
+
+    return;
+}
+
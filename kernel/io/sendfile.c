@@ -0,0 +1,678 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    sendfile.c
+
+Abstract:
+
+    This module implements support for transferring data directly from one
+    I/O handle to another without bouncing it through a user mode buffer.
+    When the source is a cached file, the page cache pages themselves are
+    handed to the destination.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/kernel/kernel.h>
+#include "iop.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the maximum number of bytes moved in each iteration of a transfer.
+// This bounds the number of page cache entries pinned at once, and the size
+// of the bounce buffer for sources that are not cached.
+//
+
+#define SEND_FILE_CHUNK_SIZE (256 * _1KB)
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+KSTATUS
+IopSendFile (
+    PIO_HANDLE Destination,
+    PIO_HANDLE Source,
+    PIO_OFFSET DestinationOffset,
+    PIO_OFFSET SourceOffset,
+    UINTN Size,
+    PUINTN BytesCompleted,
+    PBOOL DataDropped
+    );
+
+KSTATUS
+IopSendFileReadCached (
+    PIO_HANDLE Source,
+    IO_OFFSET Offset,
+    UINTN Size,
+    ULONG TimeoutInMilliseconds,
+    PIO_BUFFER *IoBuffer,
+    PUINTN BytesRead
+    );
+
+KSTATUS
+IopSendFileWrite (
+    PIO_HANDLE Destination,
+    PIO_BUFFER IoBuffer,
+    IO_OFFSET Offset,
+    UINTN Size,
+    ULONG TimeoutInMilliseconds,
+    PUINTN BytesWritten
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+INTN
+IoSysSendFile (
+    PVOID SystemCallParameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the system call for transferring data from one
+    handle to another entirely within the kernel.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or the number of bytes transferred (a positive integer) on
+    success.
+
+    Error status code (a negative integer) on failure.
+
+--*/
+
+{
+
+    UINTN BytesCompleted;
+    PKPROCESS CurrentProcess;
+    BOOL DataDropped;
+    PIO_HANDLE Destination;
+    PSYSTEM_CALL_SEND_FILE Parameters;
+    INTN Result;
+    PIO_HANDLE Source;
+    KSTATUS Status;
+
+    BytesCompleted = 0;
+    CurrentProcess = PsGetCurrentProcess();
+    DataDropped = FALSE;
+    Parameters = (PSYSTEM_CALL_SEND_FILE)SystemCallParameter;
+    Source = NULL;
+    Destination = ObGetHandleValue(CurrentProcess->HandleTable,
+                                   Parameters->Destination,
+                                   NULL);
+
+    if (Destination == NULL) {
+        Status = STATUS_INVALID_HANDLE;
+        goto SysSendFileEnd;
+    }
+
+    Source = ObGetHandleValue(CurrentProcess->HandleTable,
+                              Parameters->Source,
+                              NULL);
+
+    if (Source == NULL) {
+        Status = STATUS_INVALID_HANDLE;
+        goto SysSendFileEnd;
+    }
+
+    //
+    // Treat negative sizes the same as zero, as perform I/O does.
+    //
+
+    if (Parameters->Size <= 0) {
+        Status = STATUS_SUCCESS;
+        goto SysSendFileEnd;
+    }
+
+    Status = IopSendFile(Destination,
+                         Source,
+                         &(Parameters->DestinationOffset),
+                         &(Parameters->SourceOffset),
+                         Parameters->Size,
+                         &BytesCompleted,
+                         &DataDropped);
+
+    if (Status == STATUS_BROKEN_PIPE) {
+
+        ASSERT(CurrentProcess != PsGetKernelProcess());
+
+        PsSignalProcess(CurrentProcess, SIGNAL_BROKEN_PIPE, NULL);
+    }
+
+SysSendFileEnd:
+    if (Destination != NULL) {
+        IoIoHandleReleaseReference(Destination);
+    }
+
+    if (Source != NULL) {
+        IoIoHandleReleaseReference(Source);
+    }
+
+    //
+    // If some bytes made it across, report them. The next call will pick up
+    // the error if it persists. If bytes were consumed from the source but
+    // never written, the caller has to hear about the failure now.
+    //
+
+    if ((BytesCompleted != 0) && (DataDropped == FALSE)) {
+        Status = STATUS_SUCCESS;
+
+    } else if (Status == STATUS_INTERRUPTED) {
+        Status = STATUS_RESTART_AFTER_SIGNAL;
+    }
+
+    Result = Status;
+    if (KSUCCESS(Status)) {
+
+        ASSERT(BytesCompleted <= (UINTN)MAX_INTN);
+
+        Result = (INTN)BytesCompleted;
+    }
+
+    return Result;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+KSTATUS
+IopSendFile (
+    PIO_HANDLE Destination,
+    PIO_HANDLE Source,
+    PIO_OFFSET DestinationOffset,
+    PIO_OFFSET SourceOffset,
+    UINTN Size,
+    PUINTN BytesCompleted,
+    PBOOL DataDropped
+    )
+
+/*++
+
+Routine Description:
+
+    This routine transfers data from one I/O handle to another. If the source
+    is a cached file, the page cache entries are passed directly to the
+    destination. Otherwise the data is staged through a kernel buffer.
+
+    Seekable sources are only advanced by what the destination accepted.
+    Data read from a pipe, socket, or terminal cannot be put back, so the
+    transfer keeps writing it until the destination takes all of it or fails.
+
+Arguments:
+
+    Destination - Supplies a pointer to the handle to write to.
+
+    Source - Supplies a pointer to the handle to read from.
+
+    DestinationOffset - Supplies a pointer that on input contains the offset
+        to write to, or IO_OFFSET_NONE to use and update the destination's
+        current file position. On output, an explicit offset is advanced by
+        the number of bytes written. This is ignored for sockets.
+
+    SourceOffset - Supplies a pointer that on input contains the offset to
+        read from, or IO_OFFSET_NONE to use and update the source's current
+        file position. On output, an explicit offset is advanced by the number
+        of bytes transferred.
+
+    Size - Supplies the number of bytes to transfer.
+
+    BytesCompleted - Supplies a pointer where the number of bytes transferred
+        will be returned.
+
+    DataDropped - Supplies a pointer to a boolean that is set to TRUE if data
+        was consumed from a source that cannot seek but could not be written
+        to the destination. The returned status says why.
+
+Return Value:
+
+    Status code. A failing status code does not necessarily mean no bytes
+    were transferred.
+
+--*/
+
+{
+
+    UINTN BytesRead;
+    UINTN BytesWritten;
+    BOOL Cached;
+    UINTN ChunkSize;
+    UINTN ChunkWritten;
+    PIO_OBJECT_STATE DestinationState;
+    ULONG DestinationTimeout;
+    PIO_BUFFER IoBuffer;
+    IO_OFFSET Offset;
+    ULONG PageSize;
+    BOOL Seekable;
+    PIO_BUFFER StagingBuffer;
+    KSTATUS Status;
+    ULONG SourceTimeout;
+    UINTN TotalBytes;
+    BOOL UpdateFilePointer;
+    IO_OFFSET WriteOffset;
+
+    *DataDropped = FALSE;
+    IoBuffer = NULL;
+    Offset = *SourceOffset;
+    StagingBuffer = NULL;
+    TotalBytes = 0;
+    UpdateFilePointer = FALSE;
+    if ((Destination->HandleType != IoHandleTypeDefault) ||
+        (Source->HandleType != IoHandleTypeDefault)) {
+
+        Status = STATUS_INVALID_HANDLE;
+        goto SendFileEnd;
+    }
+
+    if (((Source->Access & IO_ACCESS_READ) == 0) ||
+        ((Destination->Access & IO_ACCESS_WRITE) == 0)) {
+
+        Status = STATUS_INVALID_HANDLE;
+        goto SendFileEnd;
+    }
+
+    DestinationTimeout = WAIT_TIME_INDEFINITE;
+    if ((Destination->OpenFlags & OPEN_FLAG_NON_BLOCKING) != 0) {
+        DestinationTimeout = 0;
+    }
+
+    SourceTimeout = WAIT_TIME_INDEFINITE;
+    if ((Source->OpenFlags & OPEN_FLAG_NON_BLOCKING) != 0) {
+        SourceTimeout = 0;
+    }
+
+    DestinationState = Destination->FileObject->IoState;
+    PageSize = MmPageSize();
+
+    //
+    // Seekable sources are read by explicit offset so that the file position
+    // only moves by what the destination actually accepted.
+    //
+
+    Cached = FALSE;
+    Seekable = IO_IS_CACHEABLE_TYPE(Source->FileObject->Properties.Type);
+    if (Seekable != FALSE) {
+        if (Offset == IO_OFFSET_NONE) {
+            Offset = RtlAtomicOr64((PULONGLONG)&(Source->CurrentOffset), 0);
+            UpdateFilePointer = TRUE;
+        }
+
+        if ((IO_IS_CACHEABLE_FILE(Source->FileObject->Properties.Type) !=
+             FALSE) &&
+            (IO_IS_FILE_OBJECT_CACHEABLE(Source->FileObject) != FALSE)) {
+
+            Cached = TRUE;
+        }
+    }
+
+    if (Cached == FALSE) {
+        StagingBuffer = MmAllocatePagedIoBuffer(SEND_FILE_CHUNK_SIZE, 0);
+        if (StagingBuffer == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto SendFileEnd;
+        }
+    }
+
+    Status = STATUS_SUCCESS;
+    while (TotalBytes < Size) {
+        ChunkSize = Size - TotalBytes;
+        if (ChunkSize > SEND_FILE_CHUNK_SIZE) {
+            ChunkSize = SEND_FILE_CHUNK_SIZE;
+        }
+
+        //
+        // Whatever is read from a source that cannot seek has to be written
+        // out, even if that means waiting. For a non-blocking destination,
+        // only read once it has room, and only a page at a time, so that wait
+        // stays short.
+        //
+
+        if ((Seekable == FALSE) && (DestinationTimeout == 0)) {
+            if (DestinationState != NULL) {
+                Status = IoWaitForIoObjectState(DestinationState,
+                                                POLL_EVENT_OUT,
+                                                TRUE,
+                                                0,
+                                                NULL);
+
+                if (!KSUCCESS(Status)) {
+                    if (Status == STATUS_TIMEOUT) {
+                        Status = STATUS_TRY_AGAIN;
+                    }
+
+                    break;
+                }
+            }
+
+            if (ChunkSize > PageSize) {
+                ChunkSize = PageSize;
+            }
+        }
+
+        if (Cached != FALSE) {
+            Status = IopSendFileReadCached(Source,
+                                           Offset,
+                                           ChunkSize,
+                                           SourceTimeout,
+                                           &IoBuffer,
+                                           &BytesRead);
+
+        } else {
+            IoBuffer = StagingBuffer;
+            MmSetIoBufferCurrentOffset(IoBuffer, 0);
+            Status = IoReadAtOffset(Source,
+                                    IoBuffer,
+                                    Offset,
+                                    ChunkSize,
+                                    0,
+                                    SourceTimeout,
+                                    &BytesRead,
+                                    NULL);
+        }
+
+        if (BytesRead == 0) {
+            if (Status == STATUS_END_OF_FILE) {
+                Status = STATUS_SUCCESS;
+            }
+
+            break;
+        }
+
+        //
+        // Write out what was read. A seekable source simply stops at whatever
+        // the destination accepted, and the rest is read again next time. For
+        // other sources, keep writing the remainder, waiting for the
+        // destination to drain if it is full.
+        //
+
+        BytesWritten = 0;
+        while (TRUE) {
+            WriteOffset = *DestinationOffset;
+            if (WriteOffset != IO_OFFSET_NONE) {
+                WriteOffset += BytesWritten;
+            }
+
+            Status = IopSendFileWrite(Destination,
+                                      IoBuffer,
+                                      WriteOffset,
+                                      BytesRead - BytesWritten,
+                                      DestinationTimeout,
+                                      &ChunkWritten);
+
+            BytesWritten += ChunkWritten;
+            if ((Seekable != FALSE) || (BytesWritten == BytesRead)) {
+                break;
+            }
+
+            MmIoBufferIncrementOffset(IoBuffer, ChunkWritten);
+            if ((KSUCCESS(Status)) && (ChunkWritten == 0)) {
+                Status = STATUS_TRY_AGAIN;
+            }
+
+            if (((Status == STATUS_TRY_AGAIN) || (Status == STATUS_TIMEOUT)) &&
+                (DestinationState != NULL)) {
+
+                Status = IoWaitForIoObjectState(DestinationState,
+                                                POLL_EVENT_OUT,
+                                                TRUE,
+                                                WAIT_TIME_INDEFINITE,
+                                                NULL);
+            }
+
+            if (!KSUCCESS(Status)) {
+                *DataDropped = TRUE;
+                break;
+            }
+        }
+
+        if (Cached != FALSE) {
+            MmFreeIoBuffer(IoBuffer);
+        }
+
+        IoBuffer = NULL;
+        if (Offset != IO_OFFSET_NONE) {
+            Offset += BytesWritten;
+        }
+
+        if (*DestinationOffset != IO_OFFSET_NONE) {
+            *DestinationOffset += BytesWritten;
+        }
+
+        TotalBytes += BytesWritten;
+        if ((!KSUCCESS(Status)) || (BytesWritten != BytesRead)) {
+            break;
+        }
+
+        //
+        // A short read means the end of the file or an empty pipe. Don't wait
+        // around for more.
+        //
+
+        if (BytesRead != ChunkSize) {
+            break;
+        }
+    }
+
+SendFileEnd:
+    if (UpdateFilePointer != FALSE) {
+        RtlAtomicExchange64((PULONGLONG)&(Source->CurrentOffset), Offset);
+
+    } else {
+        *SourceOffset = Offset;
+    }
+
+    if (StagingBuffer != NULL) {
+        MmFreeIoBuffer(StagingBuffer);
+    }
+
+    *BytesCompleted = TotalBytes;
+    return Status;
+}
+
+KSTATUS
+IopSendFileReadCached (
+    PIO_HANDLE Source,
+    IO_OFFSET Offset,
+    UINTN Size,
+    ULONG TimeoutInMilliseconds,
+    PIO_BUFFER *IoBuffer,
+    PUINTN BytesRead
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads a region of a cached file into an I/O buffer made up
+    of the file's page cache entries, without copying any data.
+
+Arguments:
+
+    Source - Supplies a pointer to the handle of the cached file.
+
+    Offset - Supplies the file offset to read from.
+
+    Size - Supplies the number of bytes to read.
+
+    TimeoutInMilliseconds - Supplies the number of milliseconds to wait for
+        the read to complete.
+
+    IoBuffer - Supplies a pointer where the I/O buffer will be returned on
+        success. The buffer's current offset is set to the requested offset.
+        The caller is responsible for freeing this buffer.
+
+    BytesRead - Supplies a pointer where the number of bytes available in the
+        buffer, starting at its current offset, will be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    IO_OFFSET AlignedOffset;
+    PIO_BUFFER Buffer;
+    UINTN BytesCompleted;
+    UINTN PageOffset;
+    ULONG PageSize;
+    UINTN ReadSize;
+    KSTATUS Status;
+
+    *BytesRead = 0;
+    *IoBuffer = NULL;
+
+    //
+    // The cache only hands out its pages if the request is page aligned in
+    // both offset and size. Read the whole pages and then skip past the part
+    // of the first page that was not requested.
+    //
+
+    PageSize = MmPageSize();
+    AlignedOffset = ALIGN_RANGE_DOWN(Offset, PageSize);
+    PageOffset = (UINTN)(Offset - AlignedOffset);
+    ReadSize = ALIGN_RANGE_UP(PageOffset + Size, PageSize);
+    Buffer = MmAllocateUninitializedIoBuffer(ReadSize, 0);
+    if (Buffer == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Status = IoReadAtOffset(Source,
+                            Buffer,
+                            AlignedOffset,
+                            ReadSize,
+                            0,
+                            TimeoutInMilliseconds,
+                            &BytesCompleted,
+                            NULL);
+
+    if (BytesCompleted <= PageOffset) {
+        MmFreeIoBuffer(Buffer);
+        if (KSUCCESS(Status)) {
+            Status = STATUS_END_OF_FILE;
+        }
+
+        return Status;
+    }
+
+    BytesCompleted -= PageOffset;
+    if (BytesCompleted > Size) {
+        BytesCompleted = Size;
+    }
+
+    MmIoBufferIncrementOffset(Buffer, PageOffset);
+    *IoBuffer = Buffer;
+    *BytesRead = BytesCompleted;
+    return Status;
+}
+
+KSTATUS
+IopSendFileWrite (
+    PIO_HANDLE Destination,
+    PIO_BUFFER IoBuffer,
+    IO_OFFSET Offset,
+    UINTN Size,
+    ULONG TimeoutInMilliseconds,
+    PUINTN BytesWritten
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes a buffer to the destination of a transfer. Sockets are
+    handed the buffer directly, and all other handles go through the normal
+    write path.
+
+Arguments:
+
+    Destination - Supplies a pointer to the handle to write to.
+
+    IoBuffer - Supplies a pointer to the I/O buffer containing the data,
+        starting at its current offset.
+
+    Offset - Supplies the offset to write to, or IO_OFFSET_NONE to use the
+        current file position. This is ignored for sockets.
+
+    Size - Supplies the number of bytes to write.
+
+    TimeoutInMilliseconds - Supplies the number of milliseconds to wait for
+        the write to complete.
+
+    BytesWritten - Supplies a pointer where the number of bytes written will
+        be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    SOCKET_IO_PARAMETERS Parameters;
+    KSTATUS Status;
+
+    if (Destination->FileObject->Properties.Type == IoObjectSocket) {
+        RtlZeroMemory(&Parameters, sizeof(SOCKET_IO_PARAMETERS));
+        Parameters.Size = Size;
+        Parameters.IoFlags = SYS_IO_FLAG_WRITE;
+        Parameters.TimeoutInMilliseconds = TimeoutInMilliseconds;
+        Status = IoSocketSendData(TRUE, Destination, &Parameters, IoBuffer);
+        *BytesWritten = Parameters.BytesCompleted;
+        return Status;
+    }
+
+    Status = IoWriteAtOffset(Destination,
+                             IoBuffer,
+                             Offset,
+                             Size,
+                             0,
+                             TimeoutInMilliseconds,
+                             BytesWritten,
+                             NULL);
+
+    return Status;
+}
+
@@ -43,6 +43,20 @@ Module Name:
 
 #define SCHEDULER_REBALANCE_MINIMUM_THREADS 2
 
+//
+// Define how many more ready threads another scheduler must have than this
+// one before periodic balancing pulls a thread from it.
+//
+
+#define SCHEDULER_BALANCE_IMBALANCE 2
+
+//
+// Define the interval between periodic load balancing passes on each
+// processor, in microseconds.
+//
+
+#define SCHEDULER_BALANCE_INTERVAL 20000
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -61,6 +75,28 @@ KepBalanceIdleScheduler (
     VOID
     );
 
+VOID
+KepBalanceScheduler (
+    PPROCESSOR_BLOCK Processor
+    );
+
+ULONG
+KepFindBusiestScheduler (
+    ULONG CurrentNumber,
+    UINTN MinimumReadyCount
+    );
+
+ULONG
+KepFindIdleScheduler (
+    ULONG CurrentNumber
+    );
+
+BOOL
+KepMigrateReadyThread (
+    ULONG SourceNumber,
+    ULONG DestinationNumber
+    );
+
 BOOL
 KepEnqueueSchedulerEntry (
     PSCHEDULER_ENTRY Entry,
@@ -111,6 +147,20 @@ KSPIN_LOCK KeSchedulerGroupLock;
 
 BOOL KeSchedulerStealReadyThreads = FALSE;
 
+//
+// Set this to FALSE to disable periodic load balancing between processors.
+// Idle processors still try to steal work.
+//
+
+BOOL KeSchedulerPeriodicBalance = TRUE;
+
+//
+// Store the number of time counter ticks between periodic load balancing
+// passes. This is computed on first use.
+//
+
+ULONGLONG KeSchedulerBalanceInterval;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -206,6 +256,18 @@ Return Value:
                       0);
     }
 
+    //
+    // Every so often on a clock tick, even out the load with other processors.
+    // This needs to happen before this processor's scheduler lock is acquired,
+    // since it acquires other processors' scheduler locks.
+    //
+
+    if ((Reason == SchedulerReasonDispatchInterrupt) &&
+        (KeSchedulerPeriodicBalance != FALSE)) {
+
+        KepBalanceScheduler(Processor);
+    }
+
     OldThread = Processor->RunningThread;
     KeAcquireSpinLock(&(Processor->Scheduler.Lock));
 
@@ -497,6 +559,18 @@ Return Value:
             NewGroupEntry = &(Group->Entries[ProcessorBlock->ProcessorNumber]);
         }
 
+        if (NewGroupEntry->Scheduler != GroupEntry->Scheduler) {
+            RtlAtomicAdd64(&(GroupEntry->Scheduler->Statistics.MigrationsOut),
+                           1);
+
+            RtlAtomicAdd64(&(ProcessorBlock->Scheduler.Statistics.MigrationsIn),
+                           1);
+
+            RtlAtomicAdd64(
+                        &(ProcessorBlock->Scheduler.Statistics.WakeMigrations),
+                        1);
+        }
+
         Thread->SchedulerEntry.Parent = &(NewGroupEntry->Entry);
         KepEnqueueSchedulerEntry(&(Thread->SchedulerEntry), FALSE);
 
@@ -702,6 +776,72 @@ Return Value:
     return;
 }
 
+KERNEL_API
+KSTATUS
+KeGetSchedulerStatistics (
+    ULONG ProcessorNumber,
+    PSCHEDULER_STATISTICS Statistics
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns a snapshot of the given processor's scheduler
+    statistics.
+
+Arguments:
+
+    ProcessorNumber - Supplies the processor number to query, or -1 to get the
+        sum of all processors' statistics.
+
+    Statistics - Supplies a pointer where the statistics will be returned.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_PARAMETER if an invalid processor number was supplied.
+
+--*/
+
+{
+
+    ULONG ProcessorCount;
+    ULONG ProcessorIndex;
+    PSCHEDULER_STATISTICS Source;
+
+    ProcessorCount = KeGetActiveProcessorCount();
+    if ((ProcessorNumber != MAX_ULONG) && (ProcessorNumber >= ProcessorCount)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    RtlZeroMemory(Statistics, sizeof(SCHEDULER_STATISTICS));
+    for (ProcessorIndex = 0;
+         ProcessorIndex < ProcessorCount;
+         ProcessorIndex += 1) {
+
+        if ((ProcessorNumber != MAX_ULONG) &&
+            (ProcessorIndex != ProcessorNumber)) {
+
+            continue;
+        }
+
+        Source = &(KeProcessorBlocks[ProcessorIndex]->Scheduler.Statistics);
+        Statistics->MigrationsIn += RtlAtomicOr64(&(Source->MigrationsIn), 0);
+        Statistics->MigrationsOut += RtlAtomicOr64(&(Source->MigrationsOut), 0);
+        Statistics->IdleSteals += RtlAtomicOr64(&(Source->IdleSteals), 0);
+        Statistics->BalancePulls += RtlAtomicOr64(&(Source->BalancePulls), 0);
+        Statistics->BalancePushes += RtlAtomicOr64(&(Source->BalancePushes),
+                                                   0);
+
+        Statistics->WakeMigrations += RtlAtomicOr64(&(Source->WakeMigrations),
+                                                    0);
+    }
+
+    return STATUS_SUCCESS;
+}
+
 VOID
 KepInitializeScheduler (
     PPROCESSOR_BLOCK ProcessorBlock
@@ -802,20 +942,11 @@ Return Value:
 
 {
 
-    ULONG ActiveCount;
     ULONG CurrentNumber;
-    PSCHEDULER_GROUP_ENTRY DestinationGroupEntry;
-    BOOL FirstThread;
-    PSCHEDULER_GROUP Group;
-    ULONG Number;
     RUNLEVEL OldRunLevel;
-    PPROCESSOR_BLOCK ProcessorBlock;
-    PSCHEDULER_GROUP_ENTRY SourceGroupEntry;
-    PSCHEDULER_DATA VictimScheduler;
-    PKTHREAD VictimThread;
+    ULONG VictimNumber;
 
-    ActiveCount = KeGetActiveProcessorCount();
-    if (ActiveCount == 1) {
+    if (KeGetActiveProcessorCount() == 1) {
         return;
     }
 
@@ -824,89 +955,327 @@ Return Value:
     ASSERT(OldRunLevel == RunLevelLow);
 
     CurrentNumber = KeGetCurrentProcessorNumber();
-    VictimThread = NULL;
+    VictimNumber = KepFindBusiestScheduler(CurrentNumber,
+                                           SCHEDULER_REBALANCE_MINIMUM_THREADS);
+
+    if (VictimNumber != MAX_ULONG) {
+        if (KepMigrateReadyThread(VictimNumber, CurrentNumber) != FALSE) {
+            RtlAtomicAdd64(
+                &(KeProcessorBlocks[CurrentNumber]->Scheduler.Statistics.
+                  IdleSteals),
+                1);
+        }
+    }
 
-    //
-    // Try to steal from another processor, starting with the next neighbor.
-    //
+    KeLowerRunLevel(OldRunLevel);
+    return;
+}
 
-    Number = CurrentNumber + 1;
-    while (TRUE) {
-        if (Number == ActiveCount) {
-            Number = 0;
+VOID
+KepBalanceScheduler (
+    PPROCESSOR_BLOCK Processor
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs periodic load balancing for the current processor
+    if it's time to do so. If this processor has threads waiting while another
+    processor sits idle, one of the waiting threads is pushed over to the idle
+    processor (waking it up). Otherwise, if another processor is sufficiently
+    busier than this one, a thread is pulled over from it. This routine
+    assumes the current runlevel is dispatch, and that no scheduler locks are
+    held.
+
+Arguments:
+
+    Processor - Supplies a pointer to the current processor block.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG CurrentNumber;
+    ULONGLONG CurrentTime;
+    UINTN ReadyCount;
+    ULONG TargetNumber;
+
+    ASSERT(KeGetRunLevel() == RunLevelDispatch);
+
+    if (KeGetActiveProcessorCount() == 1) {
+        return;
+    }
+
+    CurrentTime = KeGetRecentTimeCounter();
+    if (CurrentTime < Processor->Scheduler.NextBalanceTime) {
+        return;
+    }
+
+    if (KeSchedulerBalanceInterval == 0) {
+        KeSchedulerBalanceInterval =
+                  KeConvertMicrosecondsToTimeTicks(SCHEDULER_BALANCE_INTERVAL);
+    }
+
+    Processor->Scheduler.NextBalanceTime = CurrentTime +
+                                           KeSchedulerBalanceInterval;
+
+    CurrentNumber = Processor->ProcessorNumber;
+    ReadyCount = Processor->Scheduler.Group.ReadyThreadCount;
+    if (ReadyCount >= SCHEDULER_REBALANCE_MINIMUM_THREADS) {
+        TargetNumber = KepFindIdleScheduler(CurrentNumber);
+        if (TargetNumber != MAX_ULONG) {
+            if (KepMigrateReadyThread(CurrentNumber, TargetNumber) != FALSE) {
+                RtlAtomicAdd64(&(Processor->Scheduler.Statistics.BalancePushes),
+                               1);
+            }
+
+            return;
         }
+    }
+
+    TargetNumber = KepFindBusiestScheduler(
+                                     CurrentNumber,
+                                     ReadyCount + SCHEDULER_BALANCE_IMBALANCE);
 
-        if (Number == CurrentNumber) {
-            break;
+    if (TargetNumber != MAX_ULONG) {
+        if (KepMigrateReadyThread(TargetNumber, CurrentNumber) != FALSE) {
+            RtlAtomicAdd64(&(Processor->Scheduler.Statistics.BalancePulls), 1);
         }
+    }
 
-        ProcessorBlock = KeProcessorBlocks[Number];
-        VictimScheduler = &(ProcessorBlock->Scheduler);
-        if (VictimScheduler->Group.ReadyThreadCount >=
-            SCHEDULER_REBALANCE_MINIMUM_THREADS) {
+    return;
+}
 
-            KeAcquireSpinLock(&(VictimScheduler->Lock));
-            VictimThread = KepGetNextThread(VictimScheduler, TRUE);
-            if (VictimThread != NULL) {
+ULONG
+KepFindBusiestScheduler (
+    ULONG CurrentNumber,
+    UINTN MinimumReadyCount
+    )
 
-                ASSERT((VictimThread->State == ThreadStateReady) ||
-                       (VictimThread->State == ThreadStateFirstTime));
+/*++
 
-                //
-                // Pull the thread out of the ready queue.
-                //
+Routine Description:
 
-                KepDequeueSchedulerEntry(&(VictimThread->SchedulerEntry), TRUE);
-            }
+    This routine finds the processor with the most ready threads, for the
+    purposes of taking work from it. Processors are visited in order of
+    distance from the current processor number, since neighboring processors
+    are usually enumerated next to each other in the cache hierarchy (sharing
+    a core or a cluster). Ties go to the nearer processor. The ready counts
+    are read without locks, so the result is only a hint.
 
-            KeReleaseSpinLock(&(VictimScheduler->Lock));
-            if (VictimThread != NULL) {
+Arguments:
 
-                //
-                // Move the entry to this processor's queue.
-                //
+    CurrentNumber - Supplies the current processor number, which is excluded.
 
-                SourceGroupEntry = PARENT_STRUCTURE(
-                                           VictimThread->SchedulerEntry.Parent,
-                                           SCHEDULER_GROUP_ENTRY,
-                                           Entry);
+    MinimumReadyCount - Supplies the minimum number of ready threads a
+        processor must have to be considered.
 
-                Group = SourceGroupEntry->Group;
-                if (Group == &KeRootSchedulerGroup) {
-                    DestinationGroupEntry =
-                          &(KeProcessorBlocks[CurrentNumber]->Scheduler.Group);
+Return Value:
 
-                } else {
+    Returns the number of the busiest processor.
 
-                    ASSERT(Group->EntryCount > CurrentNumber);
+    MAX_ULONG if no processor has at least the minimum number of ready
+    threads.
 
-                    DestinationGroupEntry = &(Group->Entries[CurrentNumber]);
-                }
+--*/
 
-                VictimThread->SchedulerEntry.Parent =
-                                               &(DestinationGroupEntry->Entry);
+{
+
+    ULONG ActiveCount;
+    UINTN BusiestCount;
+    ULONG BusiestNumber;
+    ULONG Candidate;
+    ULONG Distance;
+    ULONG Pass;
+    UINTN ReadyCount;
+    PSCHEDULER_DATA Scheduler;
+
+    ActiveCount = KeGetActiveProcessorCount();
+    BusiestCount = 0;
+    BusiestNumber = MAX_ULONG;
+    for (Distance = 1; Distance <= (ActiveCount / 2); Distance += 1) {
+        for (Pass = 0; Pass < 2; Pass += 1) {
+            if (Pass == 0) {
+                Candidate = (CurrentNumber + Distance) % ActiveCount;
+
+            } else {
+                Candidate = (CurrentNumber + ActiveCount - Distance) %
+                            ActiveCount;
 
                 //
-                // Enqueue the thread on this processor.
+                // With an even processor count, the farthest processor is the
+                // same in both directions.
                 //
 
-                FirstThread =
-                      KepEnqueueSchedulerEntry(&(VictimThread->SchedulerEntry),
-                                               FALSE);
-
-                if (FirstThread != FALSE) {
-                    KepSetClockToPeriodic(KeProcessorBlocks[CurrentNumber]);
+                if (Candidate == ((CurrentNumber + Distance) % ActiveCount)) {
+                    break;
                 }
+            }
 
-                break;
+            Scheduler = &(KeProcessorBlocks[Candidate]->Scheduler);
+            ReadyCount = Scheduler->Group.ReadyThreadCount;
+
+            if ((ReadyCount >= MinimumReadyCount) &&
+                (ReadyCount > BusiestCount)) {
+
+                BusiestCount = ReadyCount;
+                BusiestNumber = Candidate;
             }
         }
+    }
+
+    return BusiestNumber;
+}
+
+ULONG
+KepFindIdleScheduler (
+    ULONG CurrentNumber
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the nearest processor that has no threads to run. The
+    ready counts are read without locks, so the result is only a hint.
+
+Arguments:
+
+    CurrentNumber - Supplies the current processor number, which is excluded.
+
+Return Value:
+
+    Returns the number of the nearest idle processor.
+
+    MAX_ULONG if no processor is idle.
+
+--*/
+
+{
+
+    ULONG ActiveCount;
+    ULONG Candidate;
+    ULONG Distance;
+
+    ActiveCount = KeGetActiveProcessorCount();
+    for (Distance = 1; Distance <= (ActiveCount / 2); Distance += 1) {
+        Candidate = (CurrentNumber + Distance) % ActiveCount;
+        if (KeProcessorBlocks[Candidate]->Scheduler.Group.ReadyThreadCount ==
+            0) {
+
+            return Candidate;
+        }
+
+        Candidate = (CurrentNumber + ActiveCount - Distance) % ActiveCount;
+        if (KeProcessorBlocks[Candidate]->Scheduler.Group.ReadyThreadCount ==
+            0) {
 
-        Number += 1;
+            return Candidate;
+        }
     }
 
-    KeLowerRunLevel(OldRunLevel);
-    return;
+    return MAX_ULONG;
+}
+
+BOOL
+KepMigrateReadyThread (
+    ULONG SourceNumber,
+    ULONG DestinationNumber
+    )
+
+/*++
+
+Routine Description:
+
+    This routine moves a ready thread that is not currently running from one
+    processor's scheduler to another's. If the destination processor had
+    nothing to run, its clock is started to wake it up. This routine assumes
+    the current runlevel is dispatch, and that no scheduler locks are held.
+
+Arguments:
+
+    SourceNumber - Supplies the number of the processor to take a thread from.
+
+    DestinationNumber - Supplies the number of the processor to give the
+        thread to.
+
+Return Value:
+
+    TRUE if a thread was moved.
+
+    FALSE if the source processor had no threads that could be moved.
+
+--*/
+
+{
+
+    PSCHEDULER_GROUP_ENTRY DestinationGroupEntry;
+    PPROCESSOR_BLOCK DestinationProcessor;
+    BOOL FirstThread;
+    PSCHEDULER_GROUP Group;
+    PSCHEDULER_GROUP_ENTRY SourceGroupEntry;
+    PSCHEDULER_DATA SourceScheduler;
+    PKTHREAD Thread;
+
+    ASSERT(KeGetRunLevel() == RunLevelDispatch);
+    ASSERT(SourceNumber != DestinationNumber);
+
+    SourceScheduler = &(KeProcessorBlocks[SourceNumber]->Scheduler);
+    DestinationProcessor = KeProcessorBlocks[DestinationNumber];
+    KeAcquireSpinLock(&(SourceScheduler->Lock));
+    Thread = KepGetNextThread(SourceScheduler, TRUE);
+    if (Thread != NULL) {
+
+        ASSERT((Thread->State == ThreadStateReady) ||
+               (Thread->State == ThreadStateFirstTime));
+
+        //
+        // Pull the thread out of the ready queue.
+        //
+
+        KepDequeueSchedulerEntry(&(Thread->SchedulerEntry), TRUE);
+    }
+
+    KeReleaseSpinLock(&(SourceScheduler->Lock));
+    if (Thread == NULL) {
+        return FALSE;
+    }
+
+    //
+    // Move the entry to the destination processor's queue.
+    //
+
+    SourceGroupEntry = PARENT_STRUCTURE(Thread->SchedulerEntry.Parent,
+                                        SCHEDULER_GROUP_ENTRY,
+                                        Entry);
+
+    Group = SourceGroupEntry->Group;
+    if (Group == &KeRootSchedulerGroup) {
+        DestinationGroupEntry = &(DestinationProcessor->Scheduler.Group);
+
+    } else {
+
+        ASSERT(Group->EntryCount > DestinationNumber);
+
+        DestinationGroupEntry = &(Group->Entries[DestinationNumber]);
+    }
+
+    Thread->SchedulerEntry.Parent = &(DestinationGroupEntry->Entry);
+    FirstThread = KepEnqueueSchedulerEntry(&(Thread->SchedulerEntry), FALSE);
+    if (FirstThread != FALSE) {
+        KepSetClockToPeriodic(DestinationProcessor);
+    }
+
+    RtlAtomicAdd64(&(SourceScheduler->Statistics.MigrationsOut), 1);
+    RtlAtomicAdd64(&(DestinationProcessor->Scheduler.Statistics.MigrationsIn),
+                   1);
+
+    return TRUE;
 }
 
 BOOL
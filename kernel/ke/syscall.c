@@ -224,6 +224,14 @@ SYSTEM_CALL_TABLE_ENTRY KeSystemCallTable[SystemCallCount] = {
     {MmSysSetBreak,
         sizeof(SYSTEM_CALL_SET_BREAK),
         sizeof(SYSTEM_CALL_SET_BREAK)},
+    {IoSysCreateInterestSet,
+        sizeof(SYSTEM_CALL_CREATE_INTEREST_SET),
+        sizeof(SYSTEM_CALL_CREATE_INTEREST_SET)},
+    {IoSysControlInterestSet, sizeof(SYSTEM_CALL_CONTROL_INTEREST_SET), 0},
+    {IoSysWaitForInterestSet, sizeof(SYSTEM_CALL_WAIT_FOR_INTEREST_SET), 0},
+    {IoSysSendFile,
+        sizeof(SYSTEM_CALL_SEND_FILE),
+        sizeof(SYSTEM_CALL_SEND_FILE)},
 };
 
 //
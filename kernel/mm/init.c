@@ -259,6 +259,15 @@ Return Value:
             MmpInitializePagedPool();
         }
 
+        //
+        // Create this processor's pool magazines now that the pools are up.
+        //
+
+        Status = MmpInitializePoolMagazines();
+        if (!KSUCCESS(Status)) {
+            goto InitializeEnd;
+        }
+
     //
     // In phase 2, lock down memory structures in preparation for
     // multi-threaded access. This is only executed on processor 0.
@@ -357,6 +366,16 @@ Return Value:
         if (MmPhysicalPageZeroAvailable != FALSE) {
             MmpAddPageZeroDescriptorsToMdl(&MmKernelVirtualSpace);
         }
+
+        //
+        // Start zeroing free pages in the background so that anonymous page
+        // faults can skip zeroing.
+        //
+
+        Status = MmpInitializeZeroedPageList();
+        if (!KSUCCESS(Status)) {
+            goto InitializeEnd;
+        }
     }
 
 InitializeEnd:
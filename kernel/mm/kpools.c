@@ -52,6 +52,31 @@ Module Name:
 
 #define KERNEL_STACK_CACHE_SIZE 10
 
+//
+// Define the size classes cached in the per-processor pool magazines. Each
+// class is a multiple of the granularity, up to the maximum cached size.
+//
+
+#define POOL_MAGAZINE_GRANULARITY_SHIFT 5
+#define POOL_MAGAZINE_GRANULARITY (1 << POOL_MAGAZINE_GRANULARITY_SHIFT)
+#define POOL_MAGAZINE_CLASS_COUNT 16
+#define POOL_MAGAZINE_MAX_SIZE \
+    (POOL_MAGAZINE_CLASS_COUNT << POOL_MAGAZINE_GRANULARITY_SHIFT)
+
+//
+// Define the number of allocations a magazine can hold, and the number of
+// allocations moved between a magazine and its pool at once.
+//
+
+#define POOL_MAGAZINE_CAPACITY 16
+#define POOL_MAGAZINE_BATCH_SIZE 8
+
+//
+// Define the number of pools fronted by magazines: non-paged and paged.
+//
+
+#define POOL_MAGAZINE_POOL_COUNT 2
+
 //
 // Do not collect pool tag statistics on non-debug builds.
 //
@@ -115,10 +140,100 @@ MmpHandlePoolCorruption (
     PVOID Parameter
     );
 
+BOOL
+MmpPoolUsesMagazines (
+    POOL_TYPE PoolType
+    );
+
+PVOID
+MmpGetFromPoolMagazine (
+    POOL_TYPE PoolType,
+    ULONG Class
+    );
+
+PVOID
+MmpRefillPoolMagazine (
+    POOL_TYPE PoolType,
+    ULONG Class,
+    ULONG Tag
+    );
+
+VOID
+MmpPutInPoolMagazine (
+    POOL_TYPE PoolType,
+    ULONG Class,
+    PVOID *Allocations,
+    ULONG Count
+    );
+
+VOID
+MmpDrainPoolMagazines (
+    VOID
+    );
+
+ULONG
+MmpAllocateFromPool (
+    POOL_TYPE PoolType,
+    UINTN Size,
+    ULONG Tag,
+    PVOID *Allocations,
+    ULONG Count
+    );
+
+VOID
+MmpFreeToPool (
+    POOL_TYPE PoolType,
+    PVOID *Allocations,
+    ULONG Count
+    );
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
 
+/*++
+
+Structure Description:
+
+    This structure stores a magazine, a small stack of free pool allocations
+    of a single size class.
+
+Members:
+
+    Count - Stores the number of allocations in the magazine.
+
+    Rounds - Stores the array of free allocations. The allocations themselves
+        are never touched while in the magazine, so paged pool allocations
+        can be cached at dispatch level.
+
+--*/
+
+typedef struct _POOL_MAGAZINE {
+    ULONG Count;
+    PVOID Rounds[POOL_MAGAZINE_CAPACITY];
+} POOL_MAGAZINE, *PPOOL_MAGAZINE;
+
+/*++
+
+Structure Description:
+
+    This structure stores the per-processor pool cache.
+
+Members:
+
+    Lock - Stores the spin lock protecting the magazines. This is only ever
+        contended when the magazines are being drained for statistics.
+
+    Magazines - Stores the array of magazines for each pool and size class.
+
+--*/
+
+typedef struct _POOL_PROCESSOR_CACHE {
+    KSPIN_LOCK Lock;
+    POOL_MAGAZINE
+        Magazines[POOL_MAGAZINE_POOL_COUNT][POOL_MAGAZINE_CLASS_COUNT];
+} POOL_PROCESSOR_CACHE, *PPOOL_PROCESSOR_CACHE;
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -134,6 +249,12 @@ RUNLEVEL MmNonPagedPoolOldRunLevel;
 MEMORY_HEAP MmPagedPool;
 PQUEUED_LOCK MmPagedPoolLock = NULL;
 
+//
+// Store whether or not the per-processor pool magazines have been set up.
+//
+
+BOOL MmPoolMagazinesInitialized = FALSE;
+
 //
 // Keep a little cache of kernel stacks to avoid the constant mapping and
 // unmapping associated with thread creation.
@@ -190,36 +311,37 @@ Return Value:
 {
 
     PVOID Allocation;
-    RUNLEVEL OldRunLevel;
+    ULONG Class;
 
     ASSERT((Size != 0) && (Tag != 0) && (Tag != 0xFFFFFFFF));
 
-    if (PoolType == PoolTypeNonPaged) {
-        OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
-        KeAcquireSpinLock(&MmNonPagedPoolLock);
-        MmNonPagedPoolOldRunLevel = OldRunLevel;
-        Allocation = RtlHeapAllocate(&MmNonPagedPool, Size, Tag);
-        KeReleaseSpinLock(&MmNonPagedPoolLock);
-        KeLowerRunLevel(OldRunLevel);
+    if ((PoolType != PoolTypeNonPaged) && (PoolType != PoolTypePaged)) {
+        RtlDebugPrint("Unsupported pool type %d.\n", PoolType);
+        return NULL;
+    }
 
-    } else if (PoolType == PoolTypePaged) {
+    ASSERT((PoolType == PoolTypeNonPaged) ||
+           (KeGetRunLevel() == RunLevelLow));
 
-        ASSERT(KeGetRunLevel() == RunLevelLow);
+    //
+    // Small allocations come out of this processor's magazine if possible,
+    // avoiding the pool lock entirely.
+    //
 
-        if (MmPagedPoolLock != NULL) {
-            KeAcquireQueuedLock(MmPagedPoolLock);
-        }
+    if ((Size <= POOL_MAGAZINE_MAX_SIZE) &&
+        (MmpPoolUsesMagazines(PoolType) != FALSE)) {
 
-        Allocation = RtlHeapAllocate(&MmPagedPool, Size, Tag);
-        if (MmPagedPoolLock != NULL) {
-            KeReleaseQueuedLock(MmPagedPoolLock);
+        Class = (Size - 1) >> POOL_MAGAZINE_GRANULARITY_SHIFT;
+        Allocation = MmpGetFromPoolMagazine(PoolType, Class);
+        if (Allocation == NULL) {
+            Allocation = MmpRefillPoolMagazine(PoolType, Class, Tag);
         }
 
-    } else {
-        RtlDebugPrint("Unsupported pool type %d.\n", PoolType);
-        Allocation = NULL;
+        return Allocation;
     }
 
+    Allocation = NULL;
+    MmpAllocateFromPool(PoolType, Size, Tag, &Allocation, 1);
     return Allocation;
 }
 
@@ -334,29 +456,11 @@ Return Value:
 
 {
 
-    RUNLEVEL OldRunLevel;
-
-    if (PoolType == PoolTypeNonPaged) {
-        OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
-        KeAcquireSpinLock(&MmNonPagedPoolLock);
-        RtlHeapFree(&MmNonPagedPool, Allocation);
-        KeReleaseSpinLock(&MmNonPagedPoolLock);
-        KeLowerRunLevel(OldRunLevel);
-
-    } else if (PoolType == PoolTypePaged) {
+    ULONG Class;
+    PMEMORY_HEAP Heap;
+    UINTN Size;
 
-        ASSERT(KeGetRunLevel() == RunLevelLow);
-
-        if (MmPagedPoolLock != NULL) {
-            KeAcquireQueuedLock(MmPagedPoolLock);
-        }
-
-        RtlHeapFree(&MmPagedPool, Allocation);
-        if (MmPagedPoolLock != NULL) {
-            KeReleaseQueuedLock(MmPagedPoolLock);
-        }
-
-    } else {
+    if ((PoolType != PoolTypeNonPaged) && (PoolType != PoolTypePaged)) {
 
         //
         // The caller should not be freeing an unknown pool type since no
@@ -364,8 +468,38 @@ Return Value:
         //
 
         ASSERT(Allocation == NULL);
+
+        return;
     }
 
+    ASSERT((PoolType == PoolTypeNonPaged) ||
+           (KeGetRunLevel() == RunLevelLow));
+
+    //
+    // Small allocations go back into this processor's magazine. The size
+    // class comes from the usable size of the allocation, rounded down, so
+    // that the allocation is big enough for anything handed out of the class.
+    // The allocation's header can be read without the pool lock since the
+    // caller owns it.
+    //
+
+    if (MmpPoolUsesMagazines(PoolType) != FALSE) {
+        Heap = &MmNonPagedPool;
+        if (PoolType == PoolTypePaged) {
+            Heap = &MmPagedPool;
+        }
+
+        Size = RtlHeapGetAllocationSize(Heap, Allocation);
+        if ((Size >= POOL_MAGAZINE_GRANULARITY) &&
+            (Size < (POOL_MAGAZINE_MAX_SIZE + POOL_MAGAZINE_GRANULARITY))) {
+
+            Class = (Size >> POOL_MAGAZINE_GRANULARITY_SHIFT) - 1;
+            MmpPutInPoolMagazine(PoolType, Class, &Allocation, 1);
+            return;
+        }
+    }
+
+    MmpFreeToPool(PoolType, &Allocation, 1);
     return;
 }
 
@@ -420,6 +554,13 @@ Return Value:
     PagedPoolLockHeld = FALSE;
     TotalBuffer = NULL;
 
+    //
+    // Return everything sitting in the processor magazines so that the pools
+    // only count allocations that are really in use.
+    //
+
+    MmpDrainPoolMagazines();
+
     //
     // Lock non-paged pool in order to collect the current statistics.
     //
@@ -599,6 +740,7 @@ Return Value:
 
     ASSERT(KeGetRunLevel() == RunLevelLow);
 
+    MmpDrainPoolMagazines();
     OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
     KeAcquireSpinLock(&MmNonPagedPoolLock);
     RtlDebugPrint("Non-Paged Pool:\n");
@@ -653,6 +795,7 @@ Return Value:
     }
 
     Statistics->PageSize = MmPageSize();
+    MmpDrainPoolMagazines();
     OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
 
     ASSERT(OldRunLevel == RunLevelLow);
@@ -1007,6 +1150,51 @@ Return Value:
     return;
 }
 
+KSTATUS
+MmpInitializePoolMagazines (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates the pool magazines for the current processor. Until
+    this is called, allocations on the processor go straight to the pools.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PPOOL_PROCESSOR_CACHE Cache;
+    PPROCESSOR_BLOCK ProcessorBlock;
+
+    Cache = MmAllocateNonPagedPool(sizeof(POOL_PROCESSOR_CACHE),
+                                   MM_ALLOCATION_TAG);
+
+    if (Cache == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(Cache, sizeof(POOL_PROCESSOR_CACHE));
+    KeInitializeSpinLock(&(Cache->Lock));
+    ProcessorBlock = KeGetCurrentProcessorBlock();
+
+    ASSERT(ProcessorBlock->PoolCache == NULL);
+
+    ProcessorBlock->PoolCache = Cache;
+    MmPoolMagazinesInitialized = TRUE;
+    return STATUS_SUCCESS;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -1384,3 +1572,472 @@ Return Value:
     return;
 }
 
+
+BOOL
+MmpPoolUsesMagazines (
+    POOL_TYPE PoolType
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether or not small allocations from the given
+    pool should go through the per-processor magazines. Pools collecting tag
+    statistics skip the magazines, since an allocation sitting in a magazine
+    would keep counting against the tag that freed it.
+
+Arguments:
+
+    PoolType - Supplies the pool type.
+
+Return Value:
+
+    TRUE if the magazines should be used.
+
+    FALSE if allocations should go directly to the pool.
+
+--*/
+
+{
+
+    PMEMORY_HEAP Heap;
+
+    if (MmPoolMagazinesInitialized == FALSE) {
+        return FALSE;
+    }
+
+    Heap = &MmNonPagedPool;
+    if (PoolType == PoolTypePaged) {
+        Heap = &MmPagedPool;
+    }
+
+    if ((Heap->Flags & MEMORY_HEAP_FLAG_COLLECT_TAG_STATISTICS) != 0) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+PVOID
+MmpGetFromPoolMagazine (
+    POOL_TYPE PoolType,
+    ULONG Class
+    )
+
+/*++
+
+Routine Description:
+
+    This routine pops an allocation off of the current processor's magazine.
+
+Arguments:
+
+    PoolType - Supplies the pool type.
+
+    Class - Supplies the size class of the allocation.
+
+Return Value:
+
+    Returns a pointer to the allocation on success.
+
+    NULL if the magazine is empty.
+
+--*/
+
+{
+
+    PVOID Allocation;
+    PPOOL_PROCESSOR_CACHE Cache;
+    PPOOL_MAGAZINE Magazine;
+    RUNLEVEL OldRunLevel;
+
+    ASSERT(Class < POOL_MAGAZINE_CLASS_COUNT);
+
+    Allocation = NULL;
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    Cache = KeGetCurrentProcessorBlock()->PoolCache;
+    if (Cache != NULL) {
+        Magazine = &(Cache->Magazines[PoolType - PoolTypeNonPaged][Class]);
+        KeAcquireSpinLock(&(Cache->Lock));
+        if (Magazine->Count != 0) {
+            Magazine->Count -= 1;
+            Allocation = Magazine->Rounds[Magazine->Count];
+        }
+
+        KeReleaseSpinLock(&(Cache->Lock));
+    }
+
+    KeLowerRunLevel(OldRunLevel);
+    return Allocation;
+}
+
+PVOID
+MmpRefillPoolMagazine (
+    POOL_TYPE PoolType,
+    ULONG Class,
+    ULONG Tag
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates a batch of allocations from the pool with a single
+    lock acquisition, returning one and putting the rest in the current
+    processor's magazine.
+
+Arguments:
+
+    PoolType - Supplies the pool type.
+
+    Class - Supplies the size class to allocate.
+
+    Tag - Supplies the tag to allocate the batch with.
+
+Return Value:
+
+    Returns a pointer to the allocation on success.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    PVOID Batch[POOL_MAGAZINE_BATCH_SIZE];
+    ULONG Count;
+    UINTN Size;
+
+    Size = (Class + 1) << POOL_MAGAZINE_GRANULARITY_SHIFT;
+    Count = MmpAllocateFromPool(PoolType,
+                                Size,
+                                Tag,
+                                Batch,
+                                POOL_MAGAZINE_BATCH_SIZE);
+
+    if (Count == 0) {
+        return NULL;
+    }
+
+    if (Count > 1) {
+        MmpPutInPoolMagazine(PoolType, Class, &(Batch[1]), Count - 1);
+    }
+
+    return Batch[0];
+}
+
+VOID
+MmpPutInPoolMagazine (
+    POOL_TYPE PoolType,
+    ULONG Class,
+    PVOID *Allocations,
+    ULONG Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine pushes free allocations onto the current processor's
+    magazine. If the magazine is full, a batch of allocations is sent back to
+    the pool with a single lock acquisition.
+
+Arguments:
+
+    PoolType - Supplies the pool type.
+
+    Class - Supplies the size class of the allocations. Each allocation must
+        be at least as big as the class size.
+
+    Allocations - Supplies an array of allocations to put in the magazine.
+
+    Count - Supplies the number of elements in the array. This must be less
+        than the batch size.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PPOOL_PROCESSOR_CACHE Cache;
+    ULONG Index;
+    PPOOL_MAGAZINE Magazine;
+    RUNLEVEL OldRunLevel;
+    PVOID Overflow[POOL_MAGAZINE_BATCH_SIZE];
+    ULONG OverflowCount;
+
+    ASSERT((Class < POOL_MAGAZINE_CLASS_COUNT) &&
+           (Count < POOL_MAGAZINE_BATCH_SIZE));
+
+    OverflowCount = 0;
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    Cache = KeGetCurrentProcessorBlock()->PoolCache;
+    if (Cache == NULL) {
+        for (Index = 0; Index < Count; Index += 1) {
+            Overflow[Index] = Allocations[Index];
+        }
+
+        OverflowCount = Count;
+
+    } else {
+        Magazine = &(Cache->Magazines[PoolType - PoolTypeNonPaged][Class]);
+        KeAcquireSpinLock(&(Cache->Lock));
+        for (Index = 0; Index < Count; Index += 1) {
+
+            //
+            // Spill a batch off the top when the magazine fills up. Since
+            // fewer than a batch of allocations are being added, this happens
+            // at most once.
+            //
+
+            if (Magazine->Count == POOL_MAGAZINE_CAPACITY) {
+
+                ASSERT(OverflowCount == 0);
+
+                Magazine->Count -= POOL_MAGAZINE_BATCH_SIZE;
+                RtlCopyMemory(Overflow,
+                              &(Magazine->Rounds[Magazine->Count]),
+                              POOL_MAGAZINE_BATCH_SIZE * sizeof(PVOID));
+
+                OverflowCount = POOL_MAGAZINE_BATCH_SIZE;
+            }
+
+            Magazine->Rounds[Magazine->Count] = Allocations[Index];
+            Magazine->Count += 1;
+        }
+
+        KeReleaseSpinLock(&(Cache->Lock));
+    }
+
+    KeLowerRunLevel(OldRunLevel);
+    if (OverflowCount != 0) {
+        MmpFreeToPool(PoolType, Overflow, OverflowCount);
+    }
+
+    return;
+}
+
+VOID
+MmpDrainPoolMagazines (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the contents of every processor's magazines to the
+    pools. This must be called at low level.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PPOOL_PROCESSOR_CACHE Cache;
+    ULONG Class;
+    ULONG Count;
+    PPOOL_MAGAZINE Magazine;
+    RUNLEVEL OldRunLevel;
+    ULONG PoolIndex;
+    PPROCESSOR_BLOCK ProcessorBlock;
+    ULONG ProcessorCount;
+    ULONG ProcessorNumber;
+    PVOID Rounds[POOL_MAGAZINE_CAPACITY];
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    if (MmPoolMagazinesInitialized == FALSE) {
+        return;
+    }
+
+    ProcessorCount = KeGetActiveProcessorCount();
+    for (ProcessorNumber = 0;
+         ProcessorNumber < ProcessorCount;
+         ProcessorNumber += 1) {
+
+        ProcessorBlock = KeGetProcessorBlock(ProcessorNumber);
+        if ((ProcessorBlock == NULL) || (ProcessorBlock->PoolCache == NULL)) {
+            continue;
+        }
+
+        Cache = ProcessorBlock->PoolCache;
+        for (PoolIndex = 0;
+             PoolIndex < POOL_MAGAZINE_POOL_COUNT;
+             PoolIndex += 1) {
+
+            for (Class = 0; Class < POOL_MAGAZINE_CLASS_COUNT; Class += 1) {
+                Magazine = &(Cache->Magazines[PoolIndex][Class]);
+                OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+                KeAcquireSpinLock(&(Cache->Lock));
+                Count = Magazine->Count;
+                RtlCopyMemory(Rounds,
+                              Magazine->Rounds,
+                              Count * sizeof(PVOID));
+
+                Magazine->Count = 0;
+                KeReleaseSpinLock(&(Cache->Lock));
+                KeLowerRunLevel(OldRunLevel);
+                if (Count != 0) {
+                    MmpFreeToPool(PoolTypeNonPaged + PoolIndex, Rounds, Count);
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+ULONG
+MmpAllocateFromPool (
+    POOL_TYPE PoolType,
+    UINTN Size,
+    ULONG Tag,
+    PVOID *Allocations,
+    ULONG Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates one or more allocations of the same size directly
+    from a pool, acquiring the pool lock once.
+
+Arguments:
+
+    PoolType - Supplies the pool type. This must be non-paged or paged.
+
+    Size - Supplies the size of each allocation, in bytes.
+
+    Tag - Supplies the tag to associate with the allocations.
+
+    Allocations - Supplies an array where the allocations will be returned.
+
+    Count - Supplies the number of allocations to make.
+
+Return Value:
+
+    Returns the number of allocations made, which stops short at the first
+    failure.
+
+--*/
+
+{
+
+    ULONG Index;
+    RUNLEVEL OldRunLevel;
+
+    if (PoolType == PoolTypeNonPaged) {
+        OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+        KeAcquireSpinLock(&MmNonPagedPoolLock);
+        MmNonPagedPoolOldRunLevel = OldRunLevel;
+        for (Index = 0; Index < Count; Index += 1) {
+            Allocations[Index] = RtlHeapAllocate(&MmNonPagedPool, Size, Tag);
+            if (Allocations[Index] == NULL) {
+                break;
+            }
+        }
+
+        KeReleaseSpinLock(&MmNonPagedPoolLock);
+        KeLowerRunLevel(OldRunLevel);
+
+    } else {
+
+        ASSERT(PoolType == PoolTypePaged);
+        ASSERT(KeGetRunLevel() == RunLevelLow);
+
+        if (MmPagedPoolLock != NULL) {
+            KeAcquireQueuedLock(MmPagedPoolLock);
+        }
+
+        for (Index = 0; Index < Count; Index += 1) {
+            Allocations[Index] = RtlHeapAllocate(&MmPagedPool, Size, Tag);
+            if (Allocations[Index] == NULL) {
+                break;
+            }
+        }
+
+        if (MmPagedPoolLock != NULL) {
+            KeReleaseQueuedLock(MmPagedPoolLock);
+        }
+    }
+
+    return Index;
+}
+
+VOID
+MmpFreeToPool (
+    POOL_TYPE PoolType,
+    PVOID *Allocations,
+    ULONG Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees one or more allocations directly back to a pool,
+    acquiring the pool lock once.
+
+Arguments:
+
+    PoolType - Supplies the pool type. This must be non-paged or paged.
+
+    Allocations - Supplies the array of allocations to free.
+
+    Count - Supplies the number of allocations in the array.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+    RUNLEVEL OldRunLevel;
+
+    if (PoolType == PoolTypeNonPaged) {
+        OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+        KeAcquireSpinLock(&MmNonPagedPoolLock);
+        for (Index = 0; Index < Count; Index += 1) {
+            RtlHeapFree(&MmNonPagedPool, Allocations[Index]);
+        }
+
+        KeReleaseSpinLock(&MmNonPagedPoolLock);
+        KeLowerRunLevel(OldRunLevel);
+
+    } else {
+
+        ASSERT(PoolType == PoolTypePaged);
+        ASSERT(KeGetRunLevel() == RunLevelLow);
+
+        if (MmPagedPoolLock != NULL) {
+            KeAcquireQueuedLock(MmPagedPoolLock);
+        }
+
+        for (Index = 0; Index < Count; Index += 1) {
+            RtlHeapFree(&MmPagedPool, Allocations[Index]);
+        }
+
+        if (MmPagedPoolLock != NULL) {
+            KeReleaseQueuedLock(MmPagedPoolLock);
+        }
+    }
+
+    return;
+}
+
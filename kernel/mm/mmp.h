@@ -488,6 +488,54 @@ Return Value:
 
 --*/
 
+PHYSICAL_ADDRESS
+MmpAllocateZeroedPhysicalPage (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine attempts to allocate a single physical page whose contents
+    are already zero. It never waits for the page zeroing thread; callers must
+    fall back to allocating and zeroing a page themselves on failure. Like
+    pages from the normal allocator, the page starts out non-paged.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the physical address of a zeroed page on success.
+
+    INVALID_PHYSICAL_ADDRESS if no pre-zeroed pages are available.
+
+--*/
+
+KSTATUS
+MmpInitializeZeroedPageList (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates the page zeroing thread, which fills the list of
+    pre-zeroed physical pages in the background.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Status code.
+
+--*/
+
 PHYSICAL_ADDRESS
 MmpAllocateIdentityMappablePhysicalPages (
     ULONG PageCount,
@@ -2049,6 +2097,28 @@ Return Value:
 
 --*/
 
+KSTATUS
+MmpInitializePoolMagazines (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates the pool magazines for the current processor. Until
+    this is called, allocations on the processor go straight to the pools.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Status code.
+
+--*/
+
 VOID
 MmpSendTlbInvalidateIpi (
     PADDRESS_SPACE AddressSpace,
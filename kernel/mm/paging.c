@@ -75,6 +75,8 @@ Module Name:
 #define PAGE_IN_CONTEXT_FLAG_ALLOCATE_IRP        0x00000002
 #define PAGE_IN_CONTEXT_FLAG_ALLOCATE_SWAP_SPACE 0x00000004
 #define PAGE_IN_CONTEXT_FLAG_ALLOCATE_MASK       0x00000007
+#define PAGE_IN_CONTEXT_FLAG_ZERO_FILL           0x00000008
+#define PAGE_IN_CONTEXT_FLAG_PAGE_ZEROED         0x00000010
 
 //
 // ------------------------------------------------------ Data Type Definitions
@@ -2722,15 +2724,22 @@ Return Value:
 
                 OwningSection = NULL;
                 Context.Flags |= PAGE_IN_CONTEXT_FLAG_ALLOCATE_PAGE;
+                if (VirtualAddress < KERNEL_VA_START) {
+                    Context.Flags |= PAGE_IN_CONTEXT_FLAG_ZERO_FILL;
+                }
+
                 LockHeld = FALSE;
                 continue;
             }
 
             //
-            // Zero the contents if the page is getting mapped to user mode.
+            // Zero the contents if the page is getting mapped to user mode,
+            // unless it came off the pre-zeroed list.
             //
 
-            if (VirtualAddress < KERNEL_VA_START) {
+            if ((VirtualAddress < KERNEL_VA_START) &&
+                ((Context.Flags & PAGE_IN_CONTEXT_FLAG_PAGE_ZEROED) == 0)) {
+
                 MmpZeroPage(Context.PhysicalAddress);
             }
 
@@ -2907,6 +2916,7 @@ Return Value:
 
                 Context.PagingEntry = NULL;
                 Context.PhysicalAddress = INVALID_PHYSICAL_ADDRESS;
+                Context.Flags &= ~PAGE_IN_CONTEXT_FLAG_PAGE_ZEROED;
             }
         }
     }
@@ -5039,10 +5049,26 @@ Return Value:
         ASSERT(Context->PhysicalAddress == INVALID_PHYSICAL_ADDRESS);
         ASSERT(Context->PagingEntry == NULL);
 
-        Context->PhysicalAddress = MmpAllocatePhysicalPages(1, 1);
+        //
+        // If the page is just going to be zeroed, try to grab one that the
+        // page zeroing thread has already cleared.
+        //
+
+        if ((Context->Flags & PAGE_IN_CONTEXT_FLAG_ZERO_FILL) != 0) {
+            Context->PhysicalAddress = MmpAllocateZeroedPhysicalPage();
+            if (Context->PhysicalAddress != INVALID_PHYSICAL_ADDRESS) {
+                Context->Flags |= PAGE_IN_CONTEXT_FLAG_PAGE_ZEROED;
+            }
+
+            Context->Flags &= ~PAGE_IN_CONTEXT_FLAG_ZERO_FILL;
+        }
+
         if (Context->PhysicalAddress == INVALID_PHYSICAL_ADDRESS) {
-            Status = STATUS_NO_MEMORY;
-            goto AllocatePageInStructuresEnd;
+            Context->PhysicalAddress = MmpAllocatePhysicalPages(1, 1);
+            if (Context->PhysicalAddress == INVALID_PHYSICAL_ADDRESS) {
+                Status = STATUS_NO_MEMORY;
+                goto AllocatePageInStructuresEnd;
+            }
         }
 
         //
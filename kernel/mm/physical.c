@@ -101,6 +101,21 @@ Module Name:
 
 #define PAGING_EVENT_SIGNAL_PAGE_COUNT 0x10
 
+//
+// Define the maximum number of pre-zeroed pages kept on hand for the page
+// fault path, and the percentage of physical memory they may consume.
+//
+
+#define ZEROED_PAGE_LIST_CAPACITY 256
+#define ZEROED_PAGE_PERCENT 1
+
+//
+// Define the amount of time, in microseconds, the page zeroing thread backs
+// off when there is other work ready to run on its processor.
+//
+
+#define ZEROED_PAGE_BACKOFF_MICROSECONDS 10000
+
 //
 // --------------------------------------------------------------------- Macros
 //
@@ -249,6 +264,16 @@ MmpUpdatePhysicalMemoryStatistics (
     BOOL Allocation
     );
 
+VOID
+MmpZeroPageThread (
+    PVOID Parameter
+    );
+
+BOOL
+MmpReleaseZeroedPages (
+    VOID
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -368,6 +393,24 @@ UINTN MmPhysicalMemoryFreeCount;
 
 BOOL MmPhysicalPageZeroAvailable = FALSE;
 
+//
+// Store the stack of pre-zeroed physical pages, filled by the page zeroing
+// thread when the system is idle and drained by the page fault path. Pages on
+// this list are accounted as allocated, non-paged pages. The list is
+// protected by the physical page lock.
+//
+
+PHYSICAL_ADDRESS MmZeroedPages[ZEROED_PAGE_LIST_CAPACITY];
+UINTN MmZeroedPageCount;
+UINTN MmZeroedPageTarget;
+
+//
+// Store the event that wakes the page zeroing thread when the list of
+// pre-zeroed pages runs low.
+//
+
+PKEVENT MmZeroedPageEvent;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -888,6 +931,16 @@ Return Value:
     LeadingZeros = RtlCountLeadingZeros(Count);
     LastBitIndex = (sizeof(UINTN) * BITS_PER_BYTE) - LeadingZeros;
     MmPhysicalMemoryWarningCountMask = (UINTN)(1 << LastBitIndex) - 1;
+
+    //
+    // Determine how many pre-zeroed pages to keep around.
+    //
+
+    MmZeroedPageTarget = (MmTotalPhysicalPages * ZEROED_PAGE_PERCENT) / 100;
+    if (MmZeroedPageTarget > ZEROED_PAGE_LIST_CAPACITY) {
+        MmZeroedPageTarget = ZEROED_PAGE_LIST_CAPACITY;
+    }
+
     Status = STATUS_SUCCESS;
 
 InitializePhysicalPageAllocatorEnd:
@@ -1039,6 +1092,15 @@ Return Value:
             LockHeld = FALSE;
         }
 
+        //
+        // Before paging anything out, hand back any pages sitting on the
+        // pre-zeroed list and try again.
+        //
+
+        if (MmpReleaseZeroedPages() != FALSE) {
+            continue;
+        }
+
         //
         // Not enough free memory could be found laying around. Schedule the
         // paging worker to notify it that memory is a little tight. If it gets
@@ -1098,6 +1160,118 @@ Return Value:
     return WorkingAllocation;
 }
 
+KSTATUS
+MmpInitializeZeroedPageList (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates the page zeroing thread, which fills the list of
+    pre-zeroed physical pages in the background.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    if (MmZeroedPageTarget == 0) {
+        Status = STATUS_SUCCESS;
+        goto InitializeZeroedPageListEnd;
+    }
+
+    MmZeroedPageEvent = KeCreateEvent(NULL);
+    if (MmZeroedPageEvent == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto InitializeZeroedPageListEnd;
+    }
+
+    KeSignalEvent(MmZeroedPageEvent, SignalOptionSignalAll);
+    Status = PsCreateKernelThread(MmpZeroPageThread,
+                                  NULL,
+                                  "MmpZeroPageThread");
+
+    if (!KSUCCESS(Status)) {
+        goto InitializeZeroedPageListEnd;
+    }
+
+InitializeZeroedPageListEnd:
+    return Status;
+}
+
+PHYSICAL_ADDRESS
+MmpAllocateZeroedPhysicalPage (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to allocate a single physical page whose contents
+    are already zero. It never waits for the page zeroing thread; callers must
+    fall back to allocating and zeroing a page themselves on failure. Like
+    pages from the normal allocator, the page starts out non-paged.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the physical address of a zeroed page on success.
+
+    INVALID_PHYSICAL_ADDRESS if no pre-zeroed pages are available.
+
+--*/
+
+{
+
+    PHYSICAL_ADDRESS PhysicalAddress;
+    BOOL Refill;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    //
+    // Peek without the lock first so that an empty list costs nothing.
+    //
+
+    if ((MmZeroedPageEvent == NULL) || (MmZeroedPageCount == 0)) {
+        return INVALID_PHYSICAL_ADDRESS;
+    }
+
+    PhysicalAddress = INVALID_PHYSICAL_ADDRESS;
+    Refill = FALSE;
+    KeAcquireQueuedLock(MmPhysicalPageLock);
+    if (MmZeroedPageCount != 0) {
+        MmZeroedPageCount -= 1;
+        PhysicalAddress = MmZeroedPages[MmZeroedPageCount];
+        if (MmZeroedPageCount < (MmZeroedPageTarget / 2)) {
+            Refill = TRUE;
+        }
+    }
+
+    KeReleaseQueuedLock(MmPhysicalPageLock);
+    if (Refill != FALSE) {
+        KeSignalEvent(MmZeroedPageEvent, SignalOptionSignalAll);
+    }
+
+    return PhysicalAddress;
+}
+
 PHYSICAL_ADDRESS
 MmpAllocateIdentityMappablePhysicalPages (
     ULONG PageCount,
@@ -2870,3 +3044,154 @@ Return Value:
     return SignalEvent;
 }
 
+
+VOID
+MmpZeroPageThread (
+    PVOID Parameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills the list of pre-zeroed physical pages. It only does
+    work when nothing else is ready to run on its processor and physical
+    memory is not under pressure, so that the cost of zeroing is moved out
+    of the page fault path and into otherwise idle time.
+
+Arguments:
+
+    Parameter - Supplies a pointer supplied by the creator of the thread. This
+        parameter is not used.
+
+Return Value:
+
+    None. This thread never exits.
+
+--*/
+
+{
+
+    UINTN FreePages;
+    UINTN MinimumFreePages;
+    RUNLEVEL OldRunLevel;
+    PHYSICAL_ADDRESS PhysicalAddress;
+    PPROCESSOR_BLOCK ProcessorBlock;
+    UINTN ReadyCount;
+
+    while (TRUE) {
+        KeWaitForEvent(MmZeroedPageEvent, FALSE, WAIT_TIME_INDEFINITE);
+        KeSignalEvent(MmZeroedPageEvent, SignalOptionUnsignal);
+        while (MmZeroedPageCount < MmZeroedPageTarget) {
+
+            //
+            // Stop if memory is getting tight. The allocator will reclaim the
+            // list if it has to, so don't compete with it.
+            //
+
+            if (MmPhysicalMemoryWarningLevel != MemoryWarningLevelNone) {
+                break;
+            }
+
+            FreePages = MmTotalPhysicalPages - MmTotalAllocatedPhysicalPages;
+            MinimumFreePages = MmMinimumFreePhysicalPages + MmZeroedPageTarget;
+            if (FreePages <= MinimumFreePages) {
+                break;
+            }
+
+            //
+            // Back off if anything else wants this processor. The processor
+            // may change right after the check, but the answer is only a
+            // hint.
+            //
+
+            OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+            ProcessorBlock = KeGetCurrentProcessorBlock();
+            ReadyCount = ProcessorBlock->Scheduler.Group.ReadyThreadCount;
+            KeLowerRunLevel(OldRunLevel);
+            if (ReadyCount != 0) {
+                KeDelayExecution(FALSE,
+                                 FALSE,
+                                 ZEROED_PAGE_BACKOFF_MICROSECONDS);
+
+                continue;
+            }
+
+            PhysicalAddress = MmpAllocatePhysicalPages(1, 1);
+            if (PhysicalAddress == INVALID_PHYSICAL_ADDRESS) {
+                break;
+            }
+
+            MmpZeroPage(PhysicalAddress);
+            KeAcquireQueuedLock(MmPhysicalPageLock);
+            if (MmZeroedPageCount < MmZeroedPageTarget) {
+                MmZeroedPages[MmZeroedPageCount] = PhysicalAddress;
+                MmZeroedPageCount += 1;
+                PhysicalAddress = INVALID_PHYSICAL_ADDRESS;
+            }
+
+            KeReleaseQueuedLock(MmPhysicalPageLock);
+            if (PhysicalAddress != INVALID_PHYSICAL_ADDRESS) {
+                MmFreePhysicalPages(PhysicalAddress, 1);
+            }
+        }
+    }
+
+    return;
+}
+
+BOOL
+MmpReleaseZeroedPages (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns every page on the pre-zeroed list to the free pool.
+    It is called when physical memory runs out.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    TRUE if any pages were released.
+
+    FALSE if the list was already empty.
+
+--*/
+
+{
+
+    PHYSICAL_ADDRESS PhysicalAddress;
+    BOOL Released;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    Released = FALSE;
+    if ((MmZeroedPageEvent == NULL) || (MmZeroedPageCount == 0)) {
+        return Released;
+    }
+
+    while (TRUE) {
+        PhysicalAddress = INVALID_PHYSICAL_ADDRESS;
+        KeAcquireQueuedLock(MmPhysicalPageLock);
+        if (MmZeroedPageCount != 0) {
+            MmZeroedPageCount -= 1;
+            PhysicalAddress = MmZeroedPages[MmZeroedPageCount];
+        }
+
+        KeReleaseQueuedLock(MmPhysicalPageLock);
+        if (PhysicalAddress == INVALID_PHYSICAL_ADDRESS) {
+            break;
+        }
+
+        MmFreePhysicalPages(PhysicalAddress, 1);
+        Released = TRUE;
+    }
+
+    return Released;
+}
@@ -27,6 +27,7 @@ Module Name:
 
 function build() {
     sources = [
+        "dirindex.c",
         "fat.c",
         "fatcache.c",
         "fatsup.c",
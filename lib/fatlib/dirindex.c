@@ -0,0 +1,1270 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    dirindex.c
+
+Abstract:
+
+    This module implements in-memory indices of the names in large
+    directories, so that looking up a file does not require scanning every
+    entry in the directory.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    Kernel, Boot, Build
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/lib/fat/fatlib.h>
+#include <minoca/lib/fat/fat.h>
+#include "fatlibp.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the number of hash buckets a directory index starts with. This must
+// be a power of two.
+//
+
+#define FAT_DIRECTORY_INDEX_INITIAL_BUCKETS 64
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure stores a single name in a directory index.
+
+Members:
+
+    NameNext - Stores a pointer to the next entry in the same name hash bucket.
+
+    OffsetNext - Stores a pointer to the next entry in the same offset hash
+        bucket.
+
+    Hash - Stores the hash of the name.
+
+    EntryOffset - Stores the directory offset of the short entry for this
+        name.
+
+    EntryCount - Stores the number of directory entries the name occupies,
+        including its long name entries and the short entry.
+
+    NameLength - Stores the length of the name in bytes, not including the null
+        terminator.
+
+    Name - Stores the null terminated name.
+
+--*/
+
+typedef struct _FAT_DIRECTORY_INDEX_ENTRY
+    FAT_DIRECTORY_INDEX_ENTRY, *PFAT_DIRECTORY_INDEX_ENTRY;
+
+struct _FAT_DIRECTORY_INDEX_ENTRY {
+    PFAT_DIRECTORY_INDEX_ENTRY NameNext;
+    PFAT_DIRECTORY_INDEX_ENTRY OffsetNext;
+    ULONG Hash;
+    ULONG EntryOffset;
+    ULONG EntryCount;
+    ULONG NameLength;
+    CHAR Name[ANYSIZE_ARRAY];
+};
+
+/*++
+
+Structure Description:
+
+    This structure stores the index of every name in a directory. Entries are
+    hashed both by name, for lookups, and by directory offset, so they can be
+    removed when the entry is erased.
+
+Members:
+
+    TreeNode - Stores the red-black tree information.
+
+    ListEntry - Stores pointers to the next and previous indices in the
+        volume's list of indices, which is kept in most recently used order.
+
+    Cluster - Stores the starting cluster of the directory.
+
+    Size - Stores the number of bytes of memory used by the index.
+
+    Oversized - Stores a boolean indicating that the directory has too many
+        names to index within the volume's limit. Such an index has no
+        entries, and is kept only so that lookups do not keep trying to build
+        it.
+
+    BucketCount - Stores the number of buckets in each hash table. This is a
+        power of two.
+
+    EntryCount - Stores the number of names in the index.
+
+    NameBuckets - Stores a pointer to the array of name hash buckets.
+
+    OffsetBuckets - Stores a pointer to the array of offset hash buckets.
+
+--*/
+
+typedef struct _FAT_DIRECTORY_INDEX {
+    RED_BLACK_TREE_NODE TreeNode;
+    LIST_ENTRY ListEntry;
+    ULONG Cluster;
+    UINTN Size;
+    BOOL Oversized;
+    ULONG BucketCount;
+    ULONG EntryCount;
+    PFAT_DIRECTORY_INDEX_ENTRY *NameBuckets;
+    PFAT_DIRECTORY_INDEX_ENTRY *OffsetBuckets;
+} FAT_DIRECTORY_INDEX, *PFAT_DIRECTORY_INDEX;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+PFAT_DIRECTORY_INDEX
+FatpFindDirectoryIndex (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    );
+
+KSTATUS
+FatpInsertDirectoryIndexEntry (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index,
+    PCSTR Name,
+    ULONG EntryOffset,
+    ULONG EntryCount
+    );
+
+KSTATUS
+FatpResizeDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index,
+    ULONG BucketCount
+    );
+
+VOID
+FatpEvictDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    );
+
+VOID
+FatpTrimDirectoryIndices (
+    PFAT_VOLUME Volume
+    );
+
+VOID
+FatpFreeDirectoryIndexEntries (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    );
+
+VOID
+FatpFreeDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    );
+
+ULONG
+FatpHashDirectoryIndexName (
+    PCSTR Name,
+    ULONG NameLength
+    );
+
+COMPARISON_RESULT
+FatpCompareDirectoryIndexNodes (
+    PRED_BLACK_TREE Tree,
+    PRED_BLACK_TREE_NODE FirstNode,
+    PRED_BLACK_TREE_NODE SecondNode
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+VOID
+FatpInitializeDirectoryIndexTree (
+    PFAT_VOLUME Volume
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes the tree of directory indices for the given
+    volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RtlRedBlackTreeInitialize(&(Volume->DirectoryIndexTree),
+                              0,
+                              FatpCompareDirectoryIndexNodes);
+
+    INITIALIZE_LIST_HEAD(&(Volume->DirectoryIndexList));
+    Volume->DirectoryIndexSize = 0;
+    return;
+}
+
+VOID
+FatpDestroyDirectoryIndexTree (
+    PFAT_VOLUME Volume
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees every directory index on the given volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX Index;
+    PRED_BLACK_TREE_NODE Node;
+
+    //
+    // The lock isn't acquired because the volume is being destroyed, so no one
+    // should be doing any accesses.
+    //
+
+    while (TRUE) {
+        Node = RtlRedBlackTreeGetLowestNode(&(Volume->DirectoryIndexTree));
+        if (Node == NULL) {
+            break;
+        }
+
+        Index = RED_BLACK_TREE_VALUE(Node, FAT_DIRECTORY_INDEX, TreeNode);
+        FatpEvictDirectoryIndex(Volume, Index);
+    }
+
+    ASSERT(LIST_EMPTY(&(Volume->DirectoryIndexList)) != FALSE);
+    ASSERT(Volume->DirectoryIndexSize == 0);
+
+    return;
+}
+
+KSTATUS
+FatpCreateDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory
+    )
+
+/*++
+
+Routine Description:
+
+    This routine scans the given directory and builds an index of all the
+    names in it. The directory's current position is preserved. Other indices
+    are thrown away, least recently used first, to make room for it. A
+    directory too big to index within the volume's limit gets an empty index
+    marking it as such.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context for the open
+        directory.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    FAT_DIRECTORY_ENTRY Entry;
+    ULONG EntriesRead;
+    PRED_BLACK_TREE_NODE FoundNode;
+    PFAT_DIRECTORY_INDEX Index;
+    PSTR Name;
+    ULONG NameBufferSize;
+    ULONG NameSize;
+    ULONG Offset;
+    ULONG OriginalOffset;
+    KSTATUS SeekStatus;
+    KSTATUS Status;
+
+    Name = NULL;
+    NameBufferSize = FAT_MAX_LONG_FILE_LENGTH + 1;
+
+    //
+    // Don't bother if the directory already has an index, including one
+    // saying it is too big to index.
+    //
+
+    FatAcquireLock(Volume->Lock);
+    Index = FatpFindDirectoryIndex(Volume, Directory->File->SeekTable[0]);
+    FatReleaseLock(Volume->Lock);
+    if (Index != NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    Status = FatpDirectoryTell(Directory, &OriginalOffset);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    Index = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                   sizeof(FAT_DIRECTORY_INDEX));
+
+    if (Index == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CreateDirectoryIndexEnd;
+    }
+
+    RtlZeroMemory(Index, sizeof(FAT_DIRECTORY_INDEX));
+    Index->Cluster = Directory->File->SeekTable[0];
+    Index->Size = sizeof(FAT_DIRECTORY_INDEX);
+    Status = FatpResizeDirectoryIndex(Volume,
+                                      Index,
+                                      FAT_DIRECTORY_INDEX_INITIAL_BUCKETS);
+
+    if (!KSUCCESS(Status)) {
+        goto CreateDirectoryIndexEnd;
+    }
+
+    Name = FatAllocatePagedMemory(Volume->Device.DeviceToken, NameBufferSize);
+    if (Name == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CreateDirectoryIndexEnd;
+    }
+
+    //
+    // Add every name in the directory, exactly as a lookup scan would see it.
+    //
+
+    Offset = DIRECTORY_CONTENTS_OFFSET;
+    Status = FatpDirectorySeek(Directory, Offset);
+    if (!KSUCCESS(Status)) {
+        goto CreateDirectoryIndexEnd;
+    }
+
+    while (TRUE) {
+        NameSize = NameBufferSize;
+        Status = FatpReadNextDirectoryEntry(Directory,
+                                            NULL,
+                                            Name,
+                                            &NameSize,
+                                            &Entry,
+                                            &EntriesRead);
+
+        if (Status == STATUS_END_OF_FILE) {
+            break;
+
+        } else if (!KSUCCESS(Status)) {
+            goto CreateDirectoryIndexEnd;
+        }
+
+        Offset += EntriesRead;
+        Status = FatpInsertDirectoryIndexEntry(Volume,
+                                               Index,
+                                               Name,
+                                               Offset - 1,
+                                               EntriesRead);
+
+        if (!KSUCCESS(Status)) {
+            goto CreateDirectoryIndexEnd;
+        }
+
+        //
+        // If the index won't fit, throw out what has been built so far and
+        // add an empty one that just marks the directory as too big.
+        //
+
+        if (Index->Size > FAT_DIRECTORY_INDEX_MEMORY_LIMIT) {
+            FatpFreeDirectoryIndexEntries(Volume, Index);
+            Index->Oversized = TRUE;
+            break;
+        }
+    }
+
+    //
+    // Add the index to the volume, unless one beat it there, and make room
+    // for it.
+    //
+
+    FatAcquireLock(Volume->Lock);
+    FoundNode = RtlRedBlackTreeSearch(&(Volume->DirectoryIndexTree),
+                                      &(Index->TreeNode));
+
+    if (FoundNode == NULL) {
+        RtlRedBlackTreeInsert(&(Volume->DirectoryIndexTree),
+                              &(Index->TreeNode));
+
+        INSERT_AFTER(&(Index->ListEntry), &(Volume->DirectoryIndexList));
+        Volume->DirectoryIndexSize += Index->Size;
+        FatpTrimDirectoryIndices(Volume);
+        Index = NULL;
+    }
+
+    FatReleaseLock(Volume->Lock);
+    Status = STATUS_SUCCESS;
+
+CreateDirectoryIndexEnd:
+    SeekStatus = FatpDirectorySeek(Directory, OriginalOffset);
+    if ((!KSUCCESS(SeekStatus)) && (KSUCCESS(Status))) {
+        Status = SeekStatus;
+    }
+
+    if (Name != NULL) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Name);
+    }
+
+    if (Index != NULL) {
+        FatpFreeDirectoryIndex(Volume, Index);
+    }
+
+    return Status;
+}
+
+VOID
+FatpDestroyDirectoryIndex (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine throws away the index for the given directory, if there is
+    one.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX Index;
+
+    FatAcquireLock(Volume->Lock);
+    Index = FatpFindDirectoryIndex(Volume, DirectoryCluster);
+    if (Index != NULL) {
+        FatpEvictDirectoryIndex(Volume, Index);
+    }
+
+    FatReleaseLock(Volume->Lock);
+    return;
+}
+
+KSTATUS
+FatpSearchDirectoryIndex (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster,
+    PCSTR Name,
+    ULONG NameLength,
+    PULONG EntryOffset,
+    PULONG EntryCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up a name in the index for the given directory.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+    Name - Supplies the name to look up.
+
+    NameLength - Supplies the size of the name buffer in bytes, including the
+        null terminator.
+
+    EntryOffset - Supplies a pointer where the directory offset of the short
+        entry for the name will be returned on success.
+
+    EntryCount - Supplies a pointer where the number of directory entries the
+        name occupies, including its long name entries and the short entry,
+        will be returned on success.
+
+Return Value:
+
+    STATUS_SUCCESS if the name was found in the index.
+
+    STATUS_PATH_NOT_FOUND if the directory is indexed but does not contain the
+    name.
+
+    STATUS_NOT_FOUND if the directory has no index, or is too big to index.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+    ULONG Hash;
+    PFAT_DIRECTORY_INDEX Index;
+    ULONG Length;
+    KSTATUS Status;
+
+    //
+    // Like the directory scan, compare only up to the first null terminator
+    // or the end of the buffer, whichever comes first.
+    //
+
+    Length = 0;
+    while ((Length < NameLength - 1) && (Name[Length] != '\0')) {
+        Length += 1;
+    }
+
+    Hash = FatpHashDirectoryIndexName(Name, Length);
+
+    //
+    // Hold the volume lock throughout, as a lookup in another directory may
+    // evict this index.
+    //
+
+    FatAcquireLock(Volume->Lock);
+    Index = FatpFindDirectoryIndex(Volume, DirectoryCluster);
+    if (Index == NULL) {
+        Status = STATUS_NOT_FOUND;
+        goto SearchDirectoryIndexEnd;
+    }
+
+    //
+    // Move the index to the front of the list, as it was just used.
+    //
+
+    LIST_REMOVE(&(Index->ListEntry));
+    INSERT_AFTER(&(Index->ListEntry), &(Volume->DirectoryIndexList));
+    if (Index->Oversized != FALSE) {
+        Status = STATUS_NOT_FOUND;
+        goto SearchDirectoryIndexEnd;
+    }
+
+    Status = STATUS_PATH_NOT_FOUND;
+    Entry = Index->NameBuckets[Hash & (Index->BucketCount - 1)];
+    while (Entry != NULL) {
+        if ((Entry->Hash == Hash) &&
+            (Entry->NameLength == Length) &&
+            (RtlCompareMemory(Entry->Name, Name, Length) != FALSE)) {
+
+            *EntryOffset = Entry->EntryOffset;
+            *EntryCount = Entry->EntryCount;
+            Status = STATUS_SUCCESS;
+            break;
+        }
+
+        Entry = Entry->NameNext;
+    }
+
+SearchDirectoryIndexEnd:
+    FatReleaseLock(Volume->Lock);
+    return Status;
+}
+
+VOID
+FatpAddDirectoryIndexEntry (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    ULONG EntryOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a newly written directory entry to the directory's
+    index, if it has one. The name is read back from the directory so that it
+    matches what a scan would find. If the name cannot be added, the index is
+    thrown away, since an incomplete index would hide files.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context for the open
+        directory. The current position is not preserved.
+
+    EntryOffset - Supplies the directory offset of the first entry (long name
+        entry or otherwise) of the newly written file.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG DirectoryCluster;
+    FAT_DIRECTORY_ENTRY Entry;
+    ULONG EntriesRead;
+    PFAT_DIRECTORY_INDEX Index;
+    PSTR Name;
+    ULONG NameSize;
+    UINTN OldSize;
+    BOOL Oversized;
+    KSTATUS Status;
+
+    DirectoryCluster = Directory->File->SeekTable[0];
+    Oversized = FALSE;
+    FatAcquireLock(Volume->Lock);
+    Index = FatpFindDirectoryIndex(Volume, DirectoryCluster);
+    if (Index != NULL) {
+        Oversized = Index->Oversized;
+    }
+
+    FatReleaseLock(Volume->Lock);
+    if ((Index == NULL) || (Oversized != FALSE)) {
+        return;
+    }
+
+    NameSize = FAT_MAX_LONG_FILE_LENGTH + 1;
+    Name = FatAllocatePagedMemory(Volume->Device.DeviceToken, NameSize);
+    if (Name == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto AddDirectoryIndexEntryEnd;
+    }
+
+    Status = FatpDirectorySeek(Directory, EntryOffset);
+    if (!KSUCCESS(Status)) {
+        goto AddDirectoryIndexEntryEnd;
+    }
+
+    Status = FatpReadNextDirectoryEntry(Directory,
+                                        NULL,
+                                        Name,
+                                        &NameSize,
+                                        &Entry,
+                                        &EntriesRead);
+
+    if (!KSUCCESS(Status)) {
+        goto AddDirectoryIndexEntryEnd;
+    }
+
+    //
+    // The index may have been evicted while the name was being read.
+    //
+
+    FatAcquireLock(Volume->Lock);
+    Index = FatpFindDirectoryIndex(Volume, DirectoryCluster);
+    if ((Index != NULL) && (Index->Oversized == FALSE)) {
+        OldSize = Index->Size;
+        Status = FatpInsertDirectoryIndexEntry(Volume,
+                                               Index,
+                                               Name,
+                                               EntryOffset + EntriesRead - 1,
+                                               EntriesRead);
+
+        Volume->DirectoryIndexSize += Index->Size - OldSize;
+        FatpTrimDirectoryIndices(Volume);
+    }
+
+    FatReleaseLock(Volume->Lock);
+
+AddDirectoryIndexEntryEnd:
+    if (Name != NULL) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Name);
+    }
+
+    if (!KSUCCESS(Status)) {
+        FatpDestroyDirectoryIndex(Volume, DirectoryCluster);
+    }
+
+    return;
+}
+
+VOID
+FatpRemoveDirectoryIndexEntry (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster,
+    ULONG EntryOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes an erased entry from the directory's index, if it has
+    one.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+    EntryOffset - Supplies the directory offset of the short entry that was
+        erased.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN AllocationSize;
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+    PFAT_DIRECTORY_INDEX Index;
+    PFAT_DIRECTORY_INDEX_ENTRY *Previous;
+
+    FatAcquireLock(Volume->Lock);
+    Index = FatpFindDirectoryIndex(Volume, DirectoryCluster);
+    if ((Index == NULL) || (Index->Oversized != FALSE)) {
+        goto RemoveDirectoryIndexEntryEnd;
+    }
+
+    //
+    // Unlink the entry from the offset bucket, then from its name bucket.
+    //
+
+    Previous = &(Index->OffsetBuckets[EntryOffset & (Index->BucketCount - 1)]);
+    while (*Previous != NULL) {
+        if ((*Previous)->EntryOffset == EntryOffset) {
+            break;
+        }
+
+        Previous = &((*Previous)->OffsetNext);
+    }
+
+    Entry = *Previous;
+    if (Entry == NULL) {
+        goto RemoveDirectoryIndexEntryEnd;
+    }
+
+    *Previous = Entry->OffsetNext;
+    Previous = &(Index->NameBuckets[Entry->Hash & (Index->BucketCount - 1)]);
+    while (*Previous != Entry) {
+
+        ASSERT(*Previous != NULL);
+
+        Previous = &((*Previous)->NameNext);
+    }
+
+    *Previous = Entry->NameNext;
+    Index->EntryCount -= 1;
+    AllocationSize = FIELD_OFFSET(FAT_DIRECTORY_INDEX_ENTRY, Name) +
+                     Entry->NameLength + 1;
+
+    Index->Size -= AllocationSize;
+    Volume->DirectoryIndexSize -= AllocationSize;
+    FatFreePagedMemory(Volume->Device.DeviceToken, Entry);
+
+RemoveDirectoryIndexEntryEnd:
+    FatReleaseLock(Volume->Lock);
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+PFAT_DIRECTORY_INDEX
+FatpFindDirectoryIndex (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the index for the given directory. This routine assumes
+    the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+Return Value:
+
+    Returns a pointer to the directory's index, or NULL if it has none.
+
+--*/
+
+{
+
+    PRED_BLACK_TREE_NODE FoundNode;
+    FAT_DIRECTORY_INDEX Search;
+
+    Search.Cluster = DirectoryCluster;
+    FoundNode = RtlRedBlackTreeSearch(&(Volume->DirectoryIndexTree),
+                                      &(Search.TreeNode));
+
+    if (FoundNode == NULL) {
+        return NULL;
+    }
+
+    return RED_BLACK_TREE_VALUE(FoundNode, FAT_DIRECTORY_INDEX, TreeNode);
+}
+
+KSTATUS
+FatpInsertDirectoryIndexEntry (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index,
+    PCSTR Name,
+    ULONG EntryOffset,
+    ULONG EntryCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a name to a directory index, growing the hash tables if
+    they are getting full.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the directory index.
+
+    Name - Supplies a pointer to the null terminated name.
+
+    EntryOffset - Supplies the directory offset of the name's short entry.
+
+    EntryCount - Supplies the number of directory entries the name occupies,
+        including its long name entries and the short entry.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG AllocationSize;
+    ULONG Bucket;
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+    ULONG NameLength;
+    KSTATUS Status;
+
+    //
+    // Grow the tables once the average chain gets longer than one. Failing to
+    // grow just makes the chains longer.
+    //
+
+    if (Index->EntryCount >= Index->BucketCount) {
+        Status = FatpResizeDirectoryIndex(Volume,
+                                          Index,
+                                          Index->BucketCount * 2);
+
+        if (!KSUCCESS(Status)) {
+            RtlDebugPrint("FAT: Failed to grow directory index: %d\n", Status);
+        }
+    }
+
+    NameLength = RtlStringLength(Name);
+    AllocationSize = FIELD_OFFSET(FAT_DIRECTORY_INDEX_ENTRY, Name) +
+                     NameLength + 1;
+
+    Entry = FatAllocatePagedMemory(Volume->Device.DeviceToken, AllocationSize);
+    if (Entry == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Entry->Hash = FatpHashDirectoryIndexName(Name, NameLength);
+    Entry->EntryOffset = EntryOffset;
+    Entry->EntryCount = EntryCount;
+    Entry->NameLength = NameLength;
+    RtlCopyMemory(Entry->Name, Name, NameLength + 1);
+    Bucket = Entry->Hash & (Index->BucketCount - 1);
+    Entry->NameNext = Index->NameBuckets[Bucket];
+    Index->NameBuckets[Bucket] = Entry;
+    Bucket = EntryOffset & (Index->BucketCount - 1);
+    Entry->OffsetNext = Index->OffsetBuckets[Bucket];
+    Index->OffsetBuckets[Bucket] = Entry;
+    Index->EntryCount += 1;
+    Index->Size += AllocationSize;
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+FatpResizeDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index,
+    ULONG BucketCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reallocates the hash tables of a directory index and rehashes
+    every entry into them.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the directory index.
+
+    BucketCount - Supplies the new number of buckets. This must be a power of
+        two.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG AllocationSize;
+    ULONG Bucket;
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+    PFAT_DIRECTORY_INDEX_ENTRY *NameBuckets;
+    PFAT_DIRECTORY_INDEX_ENTRY NextEntry;
+    ULONG OldBucket;
+    PFAT_DIRECTORY_INDEX_ENTRY *OffsetBuckets;
+
+    ASSERT(POWER_OF_2(BucketCount) != FALSE);
+
+    //
+    // Allocate both tables at once.
+    //
+
+    AllocationSize = BucketCount * sizeof(PFAT_DIRECTORY_INDEX_ENTRY) * 2;
+    NameBuckets = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                         AllocationSize);
+
+    if (NameBuckets == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(NameBuckets, AllocationSize);
+    OffsetBuckets = NameBuckets + BucketCount;
+
+    //
+    // Every entry is on exactly one chain of each table, so walking the name
+    // chains visits each entry once.
+    //
+
+    for (OldBucket = 0; OldBucket < Index->BucketCount; OldBucket += 1) {
+        Entry = Index->NameBuckets[OldBucket];
+        while (Entry != NULL) {
+            NextEntry = Entry->NameNext;
+            Bucket = Entry->Hash & (BucketCount - 1);
+            Entry->NameNext = NameBuckets[Bucket];
+            NameBuckets[Bucket] = Entry;
+            Bucket = Entry->EntryOffset & (BucketCount - 1);
+            Entry->OffsetNext = OffsetBuckets[Bucket];
+            OffsetBuckets[Bucket] = Entry;
+            Entry = NextEntry;
+        }
+    }
+
+    if (Index->NameBuckets != NULL) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Index->NameBuckets);
+    }
+
+    Index->Size -= Index->BucketCount * sizeof(PFAT_DIRECTORY_INDEX_ENTRY) * 2;
+    Index->Size += AllocationSize;
+    Index->NameBuckets = NameBuckets;
+    Index->OffsetBuckets = OffsetBuckets;
+    Index->BucketCount = BucketCount;
+    return STATUS_SUCCESS;
+}
+
+VOID
+FatpEvictDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes a directory index from the volume and frees it. This
+    routine assumes the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the directory index.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ASSERT(Volume->DirectoryIndexSize >= Index->Size);
+
+    RtlRedBlackTreeRemove(&(Volume->DirectoryIndexTree), &(Index->TreeNode));
+    LIST_REMOVE(&(Index->ListEntry));
+    Volume->DirectoryIndexSize -= Index->Size;
+    FatpFreeDirectoryIndex(Volume, Index);
+    return;
+}
+
+VOID
+FatpTrimDirectoryIndices (
+    PFAT_VOLUME Volume
+    )
+
+/*++
+
+Routine Description:
+
+    This routine throws away the least recently used directory indices until
+    the volume's indices fit within their memory limit. This routine assumes
+    the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX Index;
+
+    while ((Volume->DirectoryIndexSize > FAT_DIRECTORY_INDEX_MEMORY_LIMIT) &&
+           (LIST_EMPTY(&(Volume->DirectoryIndexList)) == FALSE)) {
+
+        Index = LIST_VALUE(Volume->DirectoryIndexList.Previous,
+                           FAT_DIRECTORY_INDEX,
+                           ListEntry);
+
+        FatpEvictDirectoryIndex(Volume, Index);
+    }
+
+    return;
+}
+
+VOID
+FatpFreeDirectoryIndexEntries (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees all the entries and hash tables of a directory index,
+    leaving it empty. The index must not be in the volume's tree.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the directory index.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Bucket;
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+    PFAT_DIRECTORY_INDEX_ENTRY NextEntry;
+
+    for (Bucket = 0; Bucket < Index->BucketCount; Bucket += 1) {
+        Entry = Index->NameBuckets[Bucket];
+        while (Entry != NULL) {
+            NextEntry = Entry->NameNext;
+            FatFreePagedMemory(Volume->Device.DeviceToken, Entry);
+            Entry = NextEntry;
+        }
+    }
+
+    if (Index->NameBuckets != NULL) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Index->NameBuckets);
+    }
+
+    Index->NameBuckets = NULL;
+    Index->OffsetBuckets = NULL;
+    Index->BucketCount = 0;
+    Index->EntryCount = 0;
+    Index->Size = sizeof(FAT_DIRECTORY_INDEX);
+    return;
+}
+
+VOID
+FatpFreeDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees a directory index and all its entries. The index must
+    not be in the volume's tree.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the directory index.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    FatpFreeDirectoryIndexEntries(Volume, Index);
+    FatFreePagedMemory(Volume->Device.DeviceToken, Index);
+    return;
+}
+
+ULONG
+FatpHashDirectoryIndexName (
+    PCSTR Name,
+    ULONG NameLength
+    )
+
+/*++
+
+Routine Description:
+
+    This routine computes the FNV-1a hash of a file name.
+
+Arguments:
+
+    Name - Supplies a pointer to the name.
+
+    NameLength - Supplies the number of characters in the name.
+
+Return Value:
+
+    Returns the hash of the name.
+
+--*/
+
+{
+
+    ULONG Hash;
+    ULONG Index;
+
+    Hash = 2166136261UL;
+    for (Index = 0; Index < NameLength; Index += 1) {
+        Hash ^= (UCHAR)(Name[Index]);
+        Hash *= 16777619UL;
+    }
+
+    return Hash;
+}
+
+COMPARISON_RESULT
+FatpCompareDirectoryIndexNodes (
+    PRED_BLACK_TREE Tree,
+    PRED_BLACK_TREE_NODE FirstNode,
+    PRED_BLACK_TREE_NODE SecondNode
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares directory index nodes by their cluster numbers.
+
+Arguments:
+
+    Tree - Supplies a pointer to the Red-Black tree that owns both nodes.
+
+    FirstNode - Supplies a pointer to the left side of the comparison.
+
+    SecondNode - Supplies a pointer to the second side of the comparison.
+
+Return Value:
+
+    Same if the two nodes have the same value.
+
+    Ascending if the first node is less than the second node.
+
+    Descending if the second node is less than the first node.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX First;
+    PFAT_DIRECTORY_INDEX Second;
+
+    First = RED_BLACK_TREE_VALUE(FirstNode, FAT_DIRECTORY_INDEX, TreeNode);
+    Second = RED_BLACK_TREE_VALUE(SecondNode, FAT_DIRECTORY_INDEX, TreeNode);
+    if (First->Cluster > Second->Cluster) {
+        return ComparisonResultDescending;
+    }
+
+    if (First->Cluster < Second->Cluster) {
+        return ComparisonResultAscending;
+    }
+
+    return ComparisonResultSame;
+}
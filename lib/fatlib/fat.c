@@ -49,6 +49,12 @@ Module Name:
      FILE_PERMISSION_GROUP_READ | FILE_PERMISSION_GROUP_EXECUTE | \
      FILE_PERMISSION_OTHER_READ | FILE_PERMISSION_OTHER_EXECUTE)
 
+//
+// Define the number of elements the extent map of a file starts with.
+//
+
+#define FAT_FILE_INITIAL_EXTENT_CAPACITY 16
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -89,6 +95,38 @@ FatpPerformFileIo (
     PUINTN BytesCompleted
     );
 
+BOOL
+FatpLookupFileExtent (
+    PFAT_FILE File,
+    ULONG FileCluster,
+    PULONG MappedFileCluster,
+    PULONG DiskCluster
+    );
+
+VOID
+FatpExtendFileExtents (
+    PFAT_FILE File,
+    ULONG FileCluster,
+    ULONG DiskCluster
+    );
+
+VOID
+FatpTruncateFileExtents (
+    PFAT_FILE File,
+    ULONG ClusterCount
+    );
+
+VOID
+FatpValidateFileExtents (
+    PFAT_FILE File
+    );
+
+VOID
+FatpFreeFileMemory (
+    PFAT_FILE File,
+    PVOID Allocation
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -964,6 +1002,7 @@ Return Value:
                   sizeof(BLOCK_DEVICE_PARAMETERS));
 
     FatpInitializeFileMappingTree(FatVolume);
+    FatpInitializeDirectoryIndexTree(FatVolume);
     FatVolume->BlockShift =
                           RtlCountTrailingZeros32(FatVolume->Device.BlockSize);
 
@@ -1206,8 +1245,14 @@ Return Value:
     PFAT_VOLUME FatVolume;
 
     FatVolume = (PFAT_VOLUME)Volume;
+    if (FatVolume->ClusterBitmap != NULL) {
+        FatFreePagedMemory(FatVolume->Device.DeviceToken,
+                           FatVolume->ClusterBitmap);
+    }
+
     FatpDestroyFatCache(FatVolume);
     FatpDestroyFileMappingTree(FatVolume);
+    FatpDestroyDirectoryIndexTree(FatVolume);
     FatDestroyLock(FatVolume->Lock);
     FatFreeNonPagedMemory(FatVolume->Device.DeviceToken, FatVolume);
     return STATUS_SUCCESS;
@@ -1376,6 +1421,9 @@ Return Value:
     FatFile->Volume = FatVolume;
     FatFile->OpenFlags = Flags;
     FatFile->SeekTable[0] = FirstCluster;
+    FatFile->ExtentGeneration =
+          FatVolume->ExtentGeneration[FAT_EXTENT_GENERATION_INDEX(FileId)];
+
     FatFile->ScratchIoBuffer = ScratchIoBuffer;
     FatFile->ScratchIoBufferLock = ScratchIoBufferLock;
 
@@ -1453,13 +1501,11 @@ Return Value:
         FatDestroyLock(FatFile->ScratchIoBufferLock);
     }
 
-    if ((FatFile->OpenFlags & OPEN_FLAG_PAGE_FILE) != 0) {
-        FatFreeNonPagedMemory(FatFile->Volume->Device.DeviceToken, FatFile);
-
-    } else {
-        FatFreePagedMemory(FatFile->Volume->Device.DeviceToken, FatFile);
+    if (FatFile->Extents != NULL) {
+        FatpFreeFileMemory(FatFile, FatFile->Extents);
     }
 
+    FatpFreeFileMemory(FatFile, FatFile);
     return;
 }
 
@@ -2791,6 +2837,8 @@ Return Value:
     ULONGLONG DiskByteOffset;
     PFAT_FILE File;
     ULONGLONG FileByteOffset;
+    ULONG MapCluster;
+    ULONG MapFileCluster;
     ULONG PreviousCluster;
     ULONG PreviousTableIndex;
     KSTATUS Status;
@@ -2808,6 +2856,7 @@ Return Value:
     ClusterSize = Volume->ClusterSize;
     FileByteOffset = FatSeekInformation->FileByteOffset;
     Status = STATUS_SUCCESS;
+    FatpValidateFileExtents(File);
 
     //
     // If it's a directory file, then the seek offset is in terms of directory
@@ -2976,12 +3025,28 @@ Return Value:
     }
 
     //
-    // Cruise the singly linked list of clusters.
+    // Prefer the extent map if it's available. Either it covers the
+    // destination and no walking is needed, or walking from the end of it
+    // extends the map so that the next seek out here doesn't have to walk.
     //
 
     ClusterAlignedDestination = ALIGN_RANGE_DOWN(DestinationOffset,
                                                  ClusterSize);
 
+    if (FatpLookupFileExtent(File,
+                             ClusterAlignedDestination >> Volume->ClusterShift,
+                             &MapFileCluster,
+                             &MapCluster) != FALSE) {
+
+        CurrentOffset = (ULONGLONG)MapFileCluster << Volume->ClusterShift;
+        CurrentCluster = MapCluster;
+        TableIndex = FAT_SEEK_TABLE_INDEX(CurrentOffset);
+    }
+
+    //
+    // Cruise the singly linked list of clusters.
+    //
+
     PreviousCluster = CurrentCluster;
     PreviousTableIndex = TableIndex;
     CurrentWindowIndex = MAX_ULONG;
@@ -3056,9 +3121,13 @@ Return Value:
         }
 
         //
-        // Populate the seek table.
+        // Populate the extent map and seek table.
         //
 
+        FatpExtendFileExtents(File,
+                              CurrentOffset >> Volume->ClusterShift,
+                              CurrentCluster);
+
         TableIndex = FAT_SEEK_TABLE_INDEX(CurrentOffset);
         if (TableIndex != PreviousTableIndex) {
             if ((CurrentOffset & FAT_SEEK_OFFSET_MASK) == 0) {
@@ -3394,10 +3463,9 @@ Routine Description:
     Volume - Supplies a pointer to the FAT volume.
 
     FileToken - Supplies an optional pointer to an open file token for the
-        file. If this is set, then the seek table for the file will be
-        maintained. If no file is supplied or there are other open files, the
-        seek table for those files will be wrong and may cause volume
-        corruption.
+        file. If this is set, then the seek table and extent map for the file
+        will be trimmed. Any other open files throw theirs away the next time
+        they are used.
 
     FileId - Supplies the ID of the file whose contents should be deleted or
         truncated.
@@ -3422,7 +3490,9 @@ Return Value:
     PFAT_VOLUME FatVolume;
     PFAT_FILE File;
     KSTATUS FlushStatus;
+    ULONG GenerationIndex;
     ULONG NextCluster;
+    ULONG RemainingClusters;
     ULONG StartingCluster;
     KSTATUS Status;
     ULONG TableIndex;
@@ -3434,6 +3504,7 @@ Return Value:
     FatVolume = (PFAT_VOLUME)Volume;
     File = (PFAT_FILE)FileToken;
     ClusterCount = FatVolume->ClusterCount;
+    RemainingClusters = 0;
     StartingCluster = (ULONG)FileId;
     VolumeLockHeld = FALSE;
 
@@ -3448,6 +3519,7 @@ Return Value:
         // will remain in the file and make that the starting cluster.
         //
 
+        RemainingClusters = 1;
         while (FileSize > FatVolume->ClusterSize) {
             Status = FatpGetNextCluster(FatVolume,
                                         0,
@@ -3471,6 +3543,7 @@ Return Value:
             }
 
             FileSize -= FatVolume->ClusterSize;
+            RemainingClusters += 1;
         }
 
         //
@@ -3518,10 +3591,24 @@ Return Value:
     }
 
     //
-    // Clean out the seek table if a file was provided.
+    // Bump the file's generation so that every other open handle drops its
+    // seek table and extent map before using them again. Growing a file only
+    // appends to the chain, so maps covering the old end stay valid and only
+    // cutting the chain needs to do this.
+    //
+
+    GenerationIndex = FAT_EXTENT_GENERATION_INDEX(FileId);
+    FatAcquireLock(FatVolume->Lock);
+    FatVolume->ExtentGeneration[GenerationIndex] += 1;
+    FatReleaseLock(FatVolume->Lock);
+
+    //
+    // Clean out the seek table and extent map if a file was provided. That
+    // handle is brought up to date rather than rebuilt from scratch.
     //
 
     if (File != NULL) {
+        FatpValidateFileExtents(File);
         TableIndex = FAT_SEEK_TABLE_INDEX(FileSize);
         if ((TableIndex == 0) && (Truncate != FALSE)) {
             TableIndex = 1;
@@ -3529,6 +3616,18 @@ Return Value:
 
         RtlZeroMemory(&(File->SeekTable[TableIndex]),
                       (FAT_SEEK_TABLE_SIZE - TableIndex) * FAT32_CLUSTER_WIDTH);
+
+        FatpTruncateFileExtents(File, RemainingClusters);
+        File->ExtentGeneration = FatVolume->ExtentGeneration[GenerationIndex];
+    }
+
+    //
+    // If the whole file is going away and it was a directory, its index goes
+    // with it, lest a new directory reuse the cluster.
+    //
+
+    if (Truncate == FALSE) {
+        FatpDestroyDirectoryIndex(FatVolume, StartingCluster);
     }
 
     //
@@ -3777,6 +3876,7 @@ Return Value:
 
     ULONG Cluster;
     ULONG ClusterCount;
+    ULONGLONG ClustersNeeded;
     ULONGLONG CurrentSize;
     BOOL Dirty;
     PFAT_VOLUME FatVolume;
@@ -3798,8 +3898,27 @@ Return Value:
             return Status;
         }
 
+        //
+        // Grab everything still needed in one go. The following iterations
+        // just walk through the new run until it runs out.
+        //
+
         if (NextCluster >= ClusterCount) {
-            Status = FatpAllocateCluster(Volume, Cluster, &NextCluster, FALSE);
+            ClustersNeeded = FileSize - CurrentSize +
+                             FatVolume->ClusterSize - 1;
+
+            ClustersNeeded >>= FatVolume->ClusterShift;
+            if (ClustersNeeded > ClusterCount) {
+                ClustersNeeded = ClusterCount;
+            }
+
+            Status = FatpAllocateClusters(Volume,
+                                          Cluster,
+                                          ClustersNeeded,
+                                          &NextCluster,
+                                          NULL,
+                                          FALSE);
+
             if (!KSUCCESS(Status)) {
                 return Status;
             }
@@ -3893,6 +4012,7 @@ Return Value:
     ULONG ClusterCount;
     ULONG ClusterShift;
     ULONG ClusterSize;
+    UINTN ClustersNeeded;
     ULONG CurrentCluster;
     PFAT_FILE File;
     ULONGLONG FileByteOffset;
@@ -3915,6 +4035,7 @@ Return Value:
     ClusterShift = Volume->ClusterShift;
     ClusterSize = Volume->ClusterSize;
     ClusterBad = Volume->ClusterBad;
+    ClusterCount = Volume->ClusterCount;
     IoFlags |= IO_FLAG_FS_DATA;
     MaxContiguousBytes = 0;
     NewTerritory = FALSE;
@@ -3931,6 +4052,8 @@ Return Value:
         goto PerformFileIoEnd;
     }
 
+    FatpValidateFileExtents(File);
+
     //
     // If the file offset is suspiciously at 0 and the current cluster is not
     // set, then recalculate all the pointers.
@@ -4027,10 +4150,22 @@ Return Value:
             ASSERT((IoFlags & IO_FLAG_NO_ALLOCATE) == 0);
             ASSERT((File->OpenFlags & OPEN_FLAG_PAGE_FILE) == 0);
 
-            Status = FatpAllocateCluster(Volume,
-                                         FatSeekInformation->CurrentCluster,
-                                         &NewCluster,
-                                         FALSE);
+            //
+            // Allocate enough for the whole write at once so that it lands
+            // in as few runs as possible.
+            //
+
+            ClustersNeeded = (SizeInBytes + ClusterSize - 1) >> ClusterShift;
+            if (ClustersNeeded > ClusterCount) {
+                ClustersNeeded = ClusterCount;
+            }
+
+            Status = FatpAllocateClusters(Volume,
+                                          FatSeekInformation->CurrentCluster,
+                                          ClustersNeeded,
+                                          &NewCluster,
+                                          NULL,
+                                          FALSE);
 
             if (!KSUCCESS(Status)) {
                 goto PerformFileIoEnd;
@@ -4059,9 +4194,14 @@ Return Value:
         FatSeekInformation->ClusterByteOffset = 0;
 
         //
-        // Populate the seek table.
+        // Populate the extent map and seek table.
         //
 
+        FatpExtendFileExtents(File,
+                              (FatSeekInformation->FileByteOffset >>
+                               ClusterShift),
+                              FatSeekInformation->CurrentCluster);
+
         TableIndex = FAT_SEEK_TABLE_INDEX(FatSeekInformation->FileByteOffset);
         if ((FatSeekInformation->FileByteOffset & FAT_SEEK_OFFSET_MASK) == 0) {
 
@@ -4122,10 +4262,20 @@ Return Value:
                     ASSERT((IoFlags & IO_FLAG_NO_ALLOCATE) == 0);
                     ASSERT((File->OpenFlags & OPEN_FLAG_PAGE_FILE) == 0);
 
-                    Status = FatpAllocateCluster(Volume,
-                                                 CurrentCluster,
-                                                 &NewCluster,
-                                                 FALSE);
+                    ClustersNeeded = SizeInBytes - MaxContiguousBytes +
+                                     ClusterSize - 1;
+
+                    ClustersNeeded >>= ClusterShift;
+                    if (ClustersNeeded > ClusterCount) {
+                        ClustersNeeded = ClusterCount;
+                    }
+
+                    Status = FatpAllocateClusters(Volume,
+                                                  CurrentCluster,
+                                                  ClustersNeeded,
+                                                  &NewCluster,
+                                                  NULL,
+                                                  FALSE);
 
                     if (!KSUCCESS(Status)) {
                         goto PerformFileIoEnd;
@@ -4144,9 +4294,13 @@ Return Value:
                 FileByteOffset += ClusterSize;
 
                 //
-                // Populate the seek table.
+                // Populate the extent map and seek table.
                 //
 
+                FatpExtendFileExtents(File,
+                                      FileByteOffset >> ClusterShift,
+                                      CurrentCluster);
+
                 TableIndex = FAT_SEEK_TABLE_INDEX(FileByteOffset);
                 if ((FileByteOffset & FAT_SEEK_OFFSET_MASK) == 0) {
 
@@ -4475,3 +4629,327 @@ Return Value:
     return Status;
 }
 
+BOOL
+FatpLookupFileExtent (
+    PFAT_FILE File,
+    ULONG FileCluster,
+    PULONG MappedFileCluster,
+    PULONG DiskCluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up a cluster of the given file in its extent map. If
+    the map does not reach that far, the last cluster the map does cover is
+    returned instead.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    FileCluster - Supplies the index within the file of the cluster to look up.
+
+    MappedFileCluster - Supplies a pointer where the index within the file of
+        the returned cluster will be returned. This will be less than the
+        requested index if the map does not cover the requested cluster.
+
+    DiskCluster - Supplies a pointer where the cluster number corresponding to
+        the mapped file cluster will be returned.
+
+Return Value:
+
+    TRUE if a cluster was returned.
+
+    FALSE if the extent map is empty and could not be started.
+
+--*/
+
+{
+
+    PFAT_FILE_EXTENT Extent;
+    ULONG High;
+    ULONG Low;
+    ULONG Middle;
+    ULONG Offset;
+
+    //
+    // Start the map off with the first cluster, which is always known.
+    //
+
+    if (File->ExtentCount == 0) {
+        FatpExtendFileExtents(File, 0, File->SeekTable[0]);
+        if (File->ExtentCount == 0) {
+            return FALSE;
+        }
+    }
+
+    //
+    // Binary search for the last extent starting at or before the desired
+    // cluster. The first extent always starts at zero.
+    //
+
+    Low = 0;
+    High = File->ExtentCount;
+    while (High - Low > 1) {
+        Middle = Low + ((High - Low) / 2);
+        if (File->Extents[Middle].FileCluster <= FileCluster) {
+            Low = Middle;
+
+        } else {
+            High = Middle;
+        }
+    }
+
+    Extent = &(File->Extents[Low]);
+
+    ASSERT(Extent->FileCluster <= FileCluster);
+
+    Offset = FileCluster - Extent->FileCluster;
+    if (Offset >= Extent->Length) {
+
+        ASSERT(Low == File->ExtentCount - 1);
+
+        Offset = Extent->Length - 1;
+    }
+
+    *MappedFileCluster = Extent->FileCluster + Offset;
+    *DiskCluster = Extent->DiskCluster + Offset;
+    return TRUE;
+}
+
+VOID
+FatpExtendFileExtents (
+    PFAT_FILE File,
+    ULONG FileCluster,
+    ULONG DiskCluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a cluster to the end of the given file's extent map if
+    it immediately follows what the map already covers. Since the map is only
+    a cache, failure to allocate room for it is not fatal.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    FileCluster - Supplies the index within the file of the cluster.
+
+    DiskCluster - Supplies the cluster number the file cluster resides in.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN AllocationSize;
+    PFAT_FILE_EXTENT Extent;
+    ULONG NewCapacity;
+    PFAT_FILE_EXTENT NewExtents;
+    PVOID Token;
+
+    ASSERT((DiskCluster >= FAT_CLUSTER_BEGIN) &&
+           (DiskCluster < File->Volume->ClusterCount));
+
+    //
+    // Ignore clusters that aren't at the frontier of the map, and extend the
+    // last run if the new cluster is contiguous with it.
+    //
+
+    if (File->ExtentCount != 0) {
+        Extent = &(File->Extents[File->ExtentCount - 1]);
+        if (FileCluster != Extent->FileCluster + Extent->Length) {
+            return;
+        }
+
+        if (DiskCluster == Extent->DiskCluster + Extent->Length) {
+            Extent->Length += 1;
+            return;
+        }
+
+    } else if (FileCluster != 0) {
+        return;
+    }
+
+    //
+    // Expand the array if needed. Page file state must stay resident.
+    //
+
+    if (File->ExtentCount == File->ExtentCapacity) {
+        NewCapacity = File->ExtentCapacity * 2;
+        if (NewCapacity == 0) {
+            NewCapacity = FAT_FILE_INITIAL_EXTENT_CAPACITY;
+        }
+
+        AllocationSize = NewCapacity * sizeof(FAT_FILE_EXTENT);
+        Token = File->Volume->Device.DeviceToken;
+        if ((File->OpenFlags & OPEN_FLAG_PAGE_FILE) != 0) {
+            NewExtents = FatAllocateNonPagedMemory(Token, AllocationSize);
+
+        } else {
+            NewExtents = FatAllocatePagedMemory(Token, AllocationSize);
+        }
+
+        if (NewExtents == NULL) {
+            return;
+        }
+
+        if (File->Extents != NULL) {
+            RtlCopyMemory(NewExtents,
+                          File->Extents,
+                          File->ExtentCount * sizeof(FAT_FILE_EXTENT));
+
+            FatpFreeFileMemory(File, File->Extents);
+        }
+
+        File->Extents = NewExtents;
+        File->ExtentCapacity = NewCapacity;
+    }
+
+    Extent = &(File->Extents[File->ExtentCount]);
+    Extent->FileCluster = FileCluster;
+    Extent->DiskCluster = DiskCluster;
+    Extent->Length = 1;
+    File->ExtentCount += 1;
+    return;
+}
+
+VOID
+FatpTruncateFileExtents (
+    PFAT_FILE File,
+    ULONG ClusterCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine trims the given file's extent map so that it covers no more
+    than the given number of clusters at the beginning of the file.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    ClusterCount - Supplies the number of clusters remaining in the file.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_FILE_EXTENT Extent;
+
+    while (File->ExtentCount != 0) {
+        Extent = &(File->Extents[File->ExtentCount - 1]);
+        if (Extent->FileCluster < ClusterCount) {
+            if (Extent->FileCluster + Extent->Length > ClusterCount) {
+                Extent->Length = ClusterCount - Extent->FileCluster;
+            }
+
+            break;
+        }
+
+        File->ExtentCount -= 1;
+    }
+
+    return;
+}
+
+VOID
+FatpValidateFileExtents (
+    PFAT_FILE File
+    )
+
+/*++
+
+Routine Description:
+
+    This routine throws away the given file's seek table and extent map if
+    the file's clusters have been freed since they were built, which can
+    happen when the file is truncated through another handle.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Generation;
+    ULONG Index;
+
+    Index = FAT_EXTENT_GENERATION_INDEX(File->SeekTable[0]);
+    Generation = File->Volume->ExtentGeneration[Index];
+
+    if (Generation == File->ExtentGeneration) {
+        return;
+    }
+
+    //
+    // The first cluster is the file ID, and never changes.
+    //
+
+    RtlZeroMemory(&(File->SeekTable[1]),
+                  (FAT_SEEK_TABLE_SIZE - 1) * FAT32_CLUSTER_WIDTH);
+
+    File->ExtentCount = 0;
+    File->ExtentGeneration = Generation;
+    return;
+}
+
+VOID
+FatpFreeFileMemory (
+    PFAT_FILE File,
+    PVOID Allocation
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees memory associated with an open file, which comes from
+    non-paged pool for the page file and paged pool otherwise.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    Allocation - Supplies a pointer to the allocation to free.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVOID Token;
+
+    Token = File->Volume->Device.DeviceToken;
+    if ((File->OpenFlags & OPEN_FLAG_PAGE_FILE) != 0) {
+        FatFreeNonPagedMemory(Token, Allocation);
+
+    } else {
+        FatFreePagedMemory(Token, Allocation);
+    }
+
+    return;
+}
@@ -584,6 +584,24 @@ Return Value:
         ((PULONG)FatWindow)[WindowOffset] = NewValue;
     }
 
+    //
+    // Keep the cluster bitmap in sync once it has been built.
+    //
+
+    if (Volume->ClusterBitmap != NULL) {
+        if (NewValue == FAT_CLUSTER_FREE) {
+            FAT_CLUSTER_BITMAP_CLEAR(Volume->ClusterBitmap, Cluster);
+            Volume->FreeClusterCount += 1;
+
+        } else if (Original == FAT_CLUSTER_FREE) {
+            FAT_CLUSTER_BITMAP_SET(Volume->ClusterBitmap, Cluster);
+
+            ASSERT(Volume->FreeClusterCount != 0);
+
+            Volume->FreeClusterCount -= 1;
+        }
+    }
+
     //
     // Mark the region in the window that's dirty.
     //
@@ -80,6 +80,20 @@ Module Name:
 
 #define FAT_SEEK_TABLE_OFFSET(_Index) ((_Index) << FAT_SEEK_OFFSET_SHIFT)
 
+//
+// These macros test, set, and clear the bit for a cluster in the cluster
+// bitmap. A set bit means the cluster is in use.
+//
+
+#define FAT_CLUSTER_BITMAP_TEST(_Bitmap, _Cluster) \
+    (((_Bitmap)[(_Cluster) >> 5] & (1UL << ((_Cluster) & 0x1F))) != 0)
+
+#define FAT_CLUSTER_BITMAP_SET(_Bitmap, _Cluster) \
+    ((_Bitmap)[(_Cluster) >> 5] |= (1UL << ((_Cluster) & 0x1F)))
+
+#define FAT_CLUSTER_BITMAP_CLEAR(_Bitmap, _Cluster) \
+    ((_Bitmap)[(_Cluster) >> 5] &= ~(1UL << ((_Cluster) & 0x1F)))
+
 //
 // ---------------------------------------------------------------- Definitions
 //
@@ -101,6 +115,36 @@ Module Name:
 #define FAT_SEEK_OFFSET_SHIFT (32 - FAT_SEEK_TABLE_SHIFT)
 #define FAT_SEEK_OFFSET_MASK ((1UL << FAT_SEEK_OFFSET_SHIFT) - 1)
 
+//
+// Define the number of extent generation counters kept per volume. File IDs
+// hash into these, so a collision only costs an unnecessary map rebuild.
+//
+
+#define FAT_EXTENT_GENERATION_COUNT 64
+#define FAT_EXTENT_GENERATION_INDEX(_FileId) \
+    ((ULONG)(_FileId) & (FAT_EXTENT_GENERATION_COUNT - 1))
+
+//
+// Define the number of free runs to look at when trying to find one big enough
+// for an allocation before settling for the largest one seen.
+//
+
+#define FAT_FREE_RUN_SEARCH_LIMIT 64
+
+//
+// Define the number of entries a lookup has to wade through before the
+// directory is deemed big enough to be worth indexing.
+//
+
+#define FAT_DIRECTORY_INDEX_THRESHOLD 64
+
+//
+// Define the most memory the directory indices on a volume can use. Past
+// this, the least recently used indices are thrown away.
+//
+
+#define FAT_DIRECTORY_INDEX_MEMORY_LIMIT (2 * _1MB)
+
 //
 // Define bits in the encoded non-standard permissions field.
 //
@@ -256,14 +300,36 @@ Structure Description:
     FatCount - Stores the number of File Allocation Tables.
 
     Lock - Stores a pointer to the lock synchronizing global access to the
-        volume and file mapping tree.
+        volume, file mapping tree, and directory indices.
 
     FileMappingTree - Stores the tree of mappings between file IDs and
         directory entries.
 
+    DirectoryIndexTree - Stores the tree of name indices for large
+        directories, keyed by directory cluster.
+
+    DirectoryIndexList - Stores the list of directory indices, most recently
+        used first.
+
+    DirectoryIndexSize - Stores the number of bytes used by all the directory
+        indices on the volume.
+
     FatCache - Stores the File Allocation Table cache. This is used for cluster
         allocation and next cluster lookup during seek, read, and write.
 
+    ClusterBitmap - Stores an optional pointer to a bitmap with one bit per
+        cluster, set if the cluster is in use. It is built from the FAT the
+        first time a cluster is allocated, and the FAT cache keeps it up to
+        date from then on.
+
+    FreeClusterCount - Stores the number of free clusters in the volume. This
+        is only valid once the cluster bitmap has been built.
+
+    ExtentGeneration - Stores an array of counters, indexed by a hash of the
+        file ID, that are incremented whenever clusters are cut off a file.
+        Open files compare these against the value they last saw to know when
+        their seek tables and extent maps have gone stale.
+
 --*/
 
 typedef struct _FAT_VOLUME {
@@ -290,11 +356,41 @@ typedef struct _FAT_VOLUME {
     ULONG FatCount;
     PVOID Lock;
     RED_BLACK_TREE FileMappingTree;
+    RED_BLACK_TREE DirectoryIndexTree;
+    LIST_ENTRY DirectoryIndexList;
+    UINTN DirectoryIndexSize;
     FAT_CACHE FatCache;
+    PULONG ClusterBitmap;
+    ULONG FreeClusterCount;
+    ULONG ExtentGeneration[FAT_EXTENT_GENERATION_COUNT];
 } FAT_VOLUME, *PFAT_VOLUME;
 
 /*++
 
+Structure Description:
+
+    This structure defines a run of physically contiguous clusters within a
+    file.
+
+Members:
+
+    FileCluster - Stores the index within the file of the first cluster in the
+        run.
+
+    DiskCluster - Stores the cluster number of the first cluster in the run.
+
+    Length - Stores the number of clusters in the run.
+
+--*/
+
+typedef struct _FAT_FILE_EXTENT {
+    ULONG FileCluster;
+    ULONG DiskCluster;
+    ULONG Length;
+} FAT_FILE_EXTENT, *PFAT_FILE_EXTENT;
+
+/*++
+
 Structure Description:
 
     This structure defines file system state associated with an open file.
@@ -324,6 +420,19 @@ Structure Description:
         out the maximum theoretical file size of 4GB. The first value is file
         offset 0, and is always filled in.
 
+    Extents - Stores an optional pointer to the array of runs the beginning of
+        the file's cluster chain is made of, sorted by file cluster. The runs
+        are added as seeks walk the chain, and are trimmed when the file is
+        truncated through this handle.
+
+    ExtentCount - Stores the number of valid elements in the extent array.
+
+    ExtentCapacity - Stores the number of elements the extent array has room
+        for.
+
+    ExtentGeneration - Stores the volume's extent generation for this file
+        at the time the seek table and extent map were last known to be good.
+
 --*/
 
 typedef struct _FAT_FILE {
@@ -333,6 +442,10 @@ typedef struct _FAT_FILE {
     PVOID ScratchIoBufferLock;
     PFAT_IO_BUFFER ScratchIoBuffer;
     ULONG SeekTable[FAT_SEEK_TABLE_SIZE];
+    PFAT_FILE_EXTENT Extents;
+    ULONG ExtentCount;
+    ULONG ExtentCapacity;
+    ULONG ExtentGeneration;
 } FAT_FILE, *PFAT_FILE;
 
 /*++
@@ -664,6 +777,56 @@ Return Value:
 
 --*/
 
+KSTATUS
+FatpAllocateClusters (
+    PFAT_VOLUME Volume,
+    ULONG PreviousCluster,
+    ULONG Count,
+    PULONG NewCluster,
+    PULONG AllocatedCount,
+    BOOL Flush
+    );
+
+/*++
+
+Routine Description:
+
+    This routine allocates a run of contiguous free clusters, chains them
+    together, and chains the run so that the specified previous cluster
+    points to it. The run is placed right after the previous cluster if there
+    is room, so that files grow contiguously.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    PreviousCluster - Supplies the cluster that should point to the newly
+        allocated run. Specify FAT32_CLUSTER_END if no previous cluster
+        should be updated.
+
+    Count - Supplies the desired number of clusters. Fewer may be allocated
+        if there is no free run that long.
+
+    NewCluster - Supplies a pointer that will receive the first cluster of the
+        new run.
+
+    AllocatedCount - Supplies an optional pointer that receives the number of
+        clusters allocated.
+
+    Flush - Supplies a boolean indicating if the FAT cache should be flushed.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_PARAMETER if an invalid cluster was supplied.
+
+    STATUS_VOLUME_FULL if no free clusters exist.
+
+    Other error codes on device I/O errors.
+
+--*/
+
 KSTATUS
 FatpFreeClusterChain (
     PFAT_VOLUME Volume,
@@ -1325,6 +1488,213 @@ Return Value:
 
 --*/
 
+//
+// Directory name index support functions.
+//
+
+VOID
+FatpInitializeDirectoryIndexTree (
+    PFAT_VOLUME Volume
+    );
+
+/*++
+
+Routine Description:
+
+    This routine initializes the tree of directory indices for the given
+    volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+FatpDestroyDirectoryIndexTree (
+    PFAT_VOLUME Volume
+    );
+
+/*++
+
+Routine Description:
+
+    This routine frees every directory index on the given volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+KSTATUS
+FatpCreateDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory
+    );
+
+/*++
+
+Routine Description:
+
+    This routine scans the given directory and builds an index of all the
+    names in it. The directory's current position is preserved. Other indices
+    are thrown away, least recently used first, to make room for it. A
+    directory too big to index within the volume's limit gets an empty index
+    marking it as such.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context for the open
+        directory.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VOID
+FatpDestroyDirectoryIndex (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    );
+
+/*++
+
+Routine Description:
+
+    This routine throws away the index for the given directory, if there is
+    one.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+Return Value:
+
+    None.
+
+--*/
+
+KSTATUS
+FatpSearchDirectoryIndex (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster,
+    PCSTR Name,
+    ULONG NameLength,
+    PULONG EntryOffset,
+    PULONG EntryCount
+    );
+
+/*++
+
+Routine Description:
+
+    This routine looks up a name in the index for the given directory.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+    Name - Supplies the name to look up.
+
+    NameLength - Supplies the size of the name buffer in bytes, including the
+        null terminator.
+
+    EntryOffset - Supplies a pointer where the directory offset of the short
+        entry for the name will be returned on success.
+
+    EntryCount - Supplies a pointer where the number of directory entries the
+        name occupies, including its long name entries and the short entry,
+        will be returned on success.
+
+Return Value:
+
+    STATUS_SUCCESS if the name was found in the index.
+
+    STATUS_PATH_NOT_FOUND if the directory is indexed but does not contain the
+    name.
+
+    STATUS_NOT_FOUND if the directory has no index, or is too big to index.
+
+--*/
+
+VOID
+FatpAddDirectoryIndexEntry (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    ULONG EntryOffset
+    );
+
+/*++
+
+Routine Description:
+
+    This routine adds a newly written directory entry to the directory's
+    index, if it has one. The name is read back from the directory so that it
+    matches what a scan would find. If the name cannot be added, the index is
+    thrown away, since an incomplete index would hide files.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context for the open
+        directory. The current position is not preserved.
+
+    EntryOffset - Supplies the directory offset of the first entry (long name
+        entry or otherwise) of the newly written file.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+FatpRemoveDirectoryIndexEntry (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster,
+    ULONG EntryOffset
+    );
+
+/*++
+
+Routine Description:
+
+    This routine removes an erased entry from the directory's index, if it has
+    one.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+    EntryOffset - Supplies the directory offset of the short entry that was
+        erased.
+
+Return Value:
+
+    None.
+
+--*/
+
 //
 // File Allocation Table cache support functions.
 //
@@ -74,6 +74,33 @@ FatpCreateDirectoryEntriesForFile (
     PULONG EntryCount
     );
 
+KSTATUS
+FatpCreateClusterBitmap (
+    PFAT_VOLUME Volume
+    );
+
+ULONG
+FatpFindFreeClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG SearchStart,
+    ULONG Count,
+    PULONG RunLength
+    );
+
+ULONG
+FatpFindFreeCluster (
+    PULONG Bitmap,
+    ULONG Cluster,
+    ULONG End
+    );
+
+ULONG
+FatpGetFreeRunLength (
+    PULONG Bitmap,
+    ULONG Cluster,
+    ULONG Limit
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -147,7 +174,12 @@ Return Value:
 {
 
     ULONG Cluster;
+    ULONG DirectoryCluster;
     ULONG EntriesRead;
+    ULONG EntriesScanned;
+    BOOL Found;
+    ULONG IndexedCount;
+    ULONG IndexedOffset;
     BOOL IsDotEntry;
     ULONGLONG Offset;
     PSTR PotentialName;
@@ -155,40 +187,112 @@ Return Value:
     ULONG PotentialNameSize;
     KSTATUS Status;
 
+    EntriesScanned = 0;
+    Found = FALSE;
     Offset = DIRECTORY_CONTENTS_OFFSET;
     PotentialName = NULL;
+    PotentialNameBufferSize = FAT_MAX_LONG_FILE_LENGTH + 1;
     if (NameLength <= 1) {
         return STATUS_PATH_NOT_FOUND;
     }
 
     //
-    // Seek to the beginning of the directory.
+    // Allocate a buffer for the name.
     //
 
-    Status = FatpDirectorySeek(Directory, Offset);
-    if (!KSUCCESS(Status)) {
+    PotentialName = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                           PotentialNameBufferSize);
+
+    if (PotentialName == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
         goto LookupDirectoryEntryEnd;
     }
 
     //
-    // Allocate a buffer for the name.
+    // Large directories have an index of their names. Use it, but read the
+    // name back from the directory and compare it just as the scan would,
+    // throwing the index out if it doesn't match. Erased entries the index
+    // counted in front of the name may have been reused since, so read
+    // forward until the indexed short entry is reached.
     //
 
-    PotentialNameBufferSize = FAT_MAX_LONG_FILE_LENGTH + 1;
-    PotentialName = FatAllocatePagedMemory(Volume->Device.DeviceToken,
-                                           PotentialNameBufferSize);
+    DirectoryCluster = Directory->File->SeekTable[0];
+    Status = FatpSearchDirectoryIndex(Volume,
+                                      DirectoryCluster,
+                                      Name,
+                                      NameLength,
+                                      &IndexedOffset,
+                                      &IndexedCount);
 
-    if (PotentialName == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
+    if (Status == STATUS_PATH_NOT_FOUND) {
         goto LookupDirectoryEntryEnd;
     }
 
+    if (KSUCCESS(Status)) {
+
+        ASSERT((IndexedCount != 0) && (IndexedCount <= IndexedOffset + 1));
+
+        Offset = IndexedOffset - (IndexedCount - 1);
+        Status = FatpDirectorySeek(Directory, Offset);
+        if (!KSUCCESS(Status)) {
+            goto LookupDirectoryEntryEnd;
+        }
+
+        while (Offset <= IndexedOffset) {
+            PotentialNameSize = PotentialNameBufferSize;
+            Status = FatpReadNextDirectoryEntry(Directory,
+                                                NULL,
+                                                PotentialName,
+                                                &PotentialNameSize,
+                                                Entry,
+                                                &EntriesRead);
+
+            if (!KSUCCESS(Status)) {
+                break;
+            }
+
+            Offset += EntriesRead;
+        }
+
+        if ((Status != STATUS_END_OF_FILE) && (!KSUCCESS(Status))) {
+            goto LookupDirectoryEntryEnd;
+        }
+
+        if ((KSUCCESS(Status)) &&
+            (Offset == IndexedOffset + 1) &&
+            (PotentialNameSize <= NameLength) &&
+            (RtlAreStringsEqual(Name, PotentialName, NameLength - 1) !=
+             FALSE)) {
+
+            Offset = IndexedOffset;
+            Found = TRUE;
+
+        } else {
+            RtlDebugPrint("FAT: Stale index for directory 0x%x.\n",
+                          DirectoryCluster);
+
+            FatpDestroyDirectoryIndex(Volume, DirectoryCluster);
+            Offset = DIRECTORY_CONTENTS_OFFSET;
+        }
+    }
+
+    //
+    // Seek to the beginning of the directory if there's going to be a scan.
+    //
+
+    if (Found == FALSE) {
+        Status = FatpDirectorySeek(Directory, Offset);
+        if (!KSUCCESS(Status)) {
+            goto LookupDirectoryEntryEnd;
+        }
+    }
+
     //
     // Loop reading directory entries until a matching one is found or the end
     // is reached.
     //
 
-    while (TRUE) {
+    while (Found == FALSE) {
         PotentialNameSize = PotentialNameBufferSize;
         Status = FatpReadNextDirectoryEntry(Directory,
                                             NULL,
@@ -205,6 +309,7 @@ Return Value:
             goto LookupDirectoryEntryEnd;
         }
 
+        EntriesScanned += 1;
         Offset += EntriesRead;
         if (PotentialNameSize > NameLength) {
             continue;
@@ -215,44 +320,55 @@ Return Value:
             ASSERT(Offset != 0);
 
             Offset -= 1;
+            Found = TRUE;
+        }
+    }
 
-            //
-            // Set the mapping between the file and the directory, except for
-            // the . and .. entries. Also, empty files may have a cluster ID of
-            // 0, don't save those either.
-            //
+    //
+    // Set the mapping between the file and the directory, except for the .
+    // and .. entries. Also, empty files may have a cluster ID of 0, don't save
+    // those either.
+    //
 
-            IsDotEntry = FALSE;
-            if ((Name[0] == '.') &&
-                ((Name[1] == '\0') ||
-                 ((Name[1] == '.') && (Name[2] == '\0')))) {
+    IsDotEntry = FALSE;
+    if ((Name[0] == '.') &&
+        ((Name[1] == '\0') ||
+         ((Name[1] == '.') && (Name[2] == '\0')))) {
 
-                IsDotEntry = TRUE;
-            }
+        IsDotEntry = TRUE;
+    }
 
-            if (IsDotEntry == FALSE) {
-                Cluster = (Entry->ClusterHigh << 16) | Entry->ClusterLow;
-                if ((Cluster >= FAT_CLUSTER_BEGIN) &&
-                    (Cluster < Volume->ClusterBad)) {
+    if (IsDotEntry == FALSE) {
+        Cluster = (Entry->ClusterHigh << 16) | Entry->ClusterLow;
+        if ((Cluster >= FAT_CLUSTER_BEGIN) &&
+            (Cluster < Volume->ClusterBad)) {
 
-                    Status = FatpSetFileMapping(Volume,
-                                                Cluster,
-                                                Directory->File->SeekTable[0],
-                                                Offset);
+            Status = FatpSetFileMapping(Volume,
+                                        Cluster,
+                                        DirectoryCluster,
+                                        Offset);
 
-                    if (!KSUCCESS(Status)) {
-                        goto LookupDirectoryEntryEnd;
-                    }
-                }
+            if (!KSUCCESS(Status)) {
+                goto LookupDirectoryEntryEnd;
             }
-
-            break;
         }
     }
 
     Status = STATUS_SUCCESS;
 
 LookupDirectoryEntryEnd:
+
+    //
+    // If this lookup had to wade through a lot of entries, build an index so
+    // the next one doesn't.
+    //
+
+    if ((EntriesScanned >= FAT_DIRECTORY_INDEX_THRESHOLD) &&
+        ((KSUCCESS(Status)) || (Status == STATUS_PATH_NOT_FOUND))) {
+
+        FatpCreateDirectoryIndex(Volume, Directory);
+    }
+
     if (PotentialName != NULL) {
         FatFreePagedMemory(Volume->Device.DeviceToken, PotentialName);
     }
@@ -787,6 +903,7 @@ Return Value:
     }
 
     *DirectorySize = DirectoryContext.ClusterPosition.FileByteOffset;
+    FatpAddDirectoryIndexEntry(Volume, &DirectoryContext, EntryOffset);
     Status = STATUS_SUCCESS;
 
 CreateDirectoryEntryEnd:
@@ -1319,30 +1436,88 @@ Return Value:
 
 {
 
+    return FatpAllocateClusters(Volume,
+                                PreviousCluster,
+                                1,
+                                NewCluster,
+                                NULL,
+                                Flush);
+}
+
+KSTATUS
+FatpAllocateClusters (
+    PFAT_VOLUME Volume,
+    ULONG PreviousCluster,
+    ULONG Count,
+    PULONG NewCluster,
+    PULONG AllocatedCount,
+    BOOL Flush
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates a run of contiguous free clusters, chains them
+    together, and chains the run so that the specified previous cluster
+    points to it. The run is placed right after the previous cluster if there
+    is room, so that files grow contiguously.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    PreviousCluster - Supplies the cluster that should point to the newly
+        allocated run. Specify FAT32_CLUSTER_END if no previous cluster
+        should be updated.
+
+    Count - Supplies the desired number of clusters. Fewer may be allocated
+        if there is no free run that long.
+
+    NewCluster - Supplies a pointer that will receive the first cluster of the
+        new run.
+
+    AllocatedCount - Supplies an optional pointer that receives the number of
+        clusters allocated.
+
+    Flush - Supplies a boolean indicating if the FAT cache should be flushed.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_PARAMETER if an invalid cluster was supplied.
+
+    STATUS_VOLUME_FULL if no free clusters exist.
+
+    Other error codes on device I/O errors.
+
+--*/
+
+{
+
+    ULONG Allocated;
     ULONG AllocatedCluster;
+    PULONG Bitmap;
     ULONG BlockShift;
     ULONG ClusterCount;
-    ULONG ClusterEnd;
-    ULONG CurrentCluster;
+    ULONG Index;
     PFAT32_INFORMATION_SECTOR Information;
     ULONGLONG InformationBlock;
     PFAT_IO_BUFFER InformationIoBuffer;
     ULONG IoFlags;
-    ULONG SearchStart;
+    ULONG LastCluster;
+    ULONG NextCluster;
     KSTATUS Status;
-    ULONG Value;
-    PVOID Window;
-    PUSHORT Window16;
-    PULONG Window32;
-    ULONG WindowOffset;
-    ULONG WindowSize;
 
+    Allocated = 0;
     AllocatedCluster = FAT_CLUSTER_FREE;
     BlockShift = Volume->BlockShift;
     ClusterCount = Volume->ClusterCount;
     InformationIoBuffer = NULL;
     IoFlags = IO_FLAG_FS_DATA | IO_FLAG_FS_METADATA;
 
+    ASSERT(Count != 0);
     ASSERT((PreviousCluster >= Volume->ClusterBad) ||
            (PreviousCluster < ClusterCount));
 
@@ -1353,6 +1528,18 @@ Return Value:
     }
 
     FatAcquireLock(Volume->Lock);
+    if (Volume->ClusterBitmap == NULL) {
+        Status = FatpCreateClusterBitmap(Volume);
+        if (!KSUCCESS(Status)) {
+            goto AllocateClustersEnd;
+        }
+    }
+
+    if (Volume->FreeClusterCount == 0) {
+        Status = STATUS_VOLUME_FULL;
+        goto AllocateClustersEnd;
+    }
+
     if ((Volume->ClusterSearchStart < FAT_CLUSTER_BEGIN) ||
         (Volume->ClusterSearchStart >= ClusterCount)) {
 
@@ -1360,106 +1547,68 @@ Return Value:
     }
 
     //
-    // Search for a free block. Start just after the last allocated cluster.
+    // Keep the file contiguous if the cluster right after its current last
+    // cluster is free. Otherwise search for a run starting at the last
+    // allocated cluster.
     //
 
-    CurrentCluster = Volume->ClusterSearchStart;
-    ClusterEnd = ClusterCount;
-    SearchStart = CurrentCluster;
-    CurrentCluster += 1;
-    WindowSize = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, 1);
-    WindowOffset = MAX_ULONG;
-    while (CurrentCluster != SearchStart) {
+    Bitmap = Volume->ClusterBitmap;
+    if ((PreviousCluster >= FAT_CLUSTER_BEGIN) &&
+        (PreviousCluster + 1 < ClusterCount) &&
+        (!FAT_CLUSTER_BITMAP_TEST(Bitmap, PreviousCluster + 1))) {
 
-        //
-        // If this is the end of the FAT, wrap around to the beginning.
-        //
-
-        if (CurrentCluster >= ClusterEnd) {
-            CurrentCluster = FAT_CLUSTER_BEGIN;
-            WindowOffset = MAX_ULONG;
-            ClusterEnd = SearchStart;
-        }
-
-        //
-        // Read the next window if needed.
-        //
-
-        if (WindowOffset >= WindowSize) {
-            Status = FatpFatCacheGetFatWindow(Volume,
-                                              TRUE,
-                                              CurrentCluster,
-                                              &Window,
-                                              &WindowOffset);
-
-            if (!KSUCCESS(Status)) {
-                goto AllocateClusterEnd;
-            }
-        }
+        AllocatedCluster = PreviousCluster + 1;
+        Allocated = FatpGetFreeRunLength(Bitmap, AllocatedCluster, Count);
 
-        //
-        // Scan the whole window.
-        //
-
-        if (Volume->Format == Fat12Format) {
-            while (CurrentCluster < ClusterEnd) {
-                Value = FAT12_READ_CLUSTER(Window, CurrentCluster);
-                if (Value == FAT_CLUSTER_FREE) {
-                    break;
-                }
-
-                CurrentCluster += 1;
-            }
+    } else {
+        AllocatedCluster = FatpFindFreeClusterRun(Volume,
+                                                  Volume->ClusterSearchStart,
+                                                  Count,
+                                                  &Allocated);
+    }
 
-        } else if (Volume->Format == Fat16Format) {
-            Window16 = Window;
-            while ((WindowOffset < WindowSize) &&
-                   (CurrentCluster < ClusterEnd) &&
-                   (Window16[WindowOffset] != FAT_CLUSTER_FREE)) {
+    //
+    // If nothing was found, sadly return.
+    //
 
-                WindowOffset += 1;
-                CurrentCluster += 1;
-            }
+    if (AllocatedCluster == FAT_CLUSTER_FREE) {
+        Status = STATUS_VOLUME_FULL;
+        goto AllocateClustersEnd;
+    }
 
-        } else {
-            Window32 = Window;
-            while ((WindowOffset < WindowSize) &&
-                   (CurrentCluster < ClusterEnd) &&
-                   (Window32[WindowOffset] != FAT_CLUSTER_FREE)) {
+    ASSERT((Allocated != 0) && (Allocated <= Count) &&
+           (AllocatedCluster + Allocated <= ClusterCount));
 
-                WindowOffset += 1;
-                CurrentCluster += 1;
-            }
-        }
+    //
+    // Chain the run together. If that fails partway through, put back what
+    // was taken.
+    //
 
-        if ((WindowOffset >= WindowSize) || (CurrentCluster >= ClusterEnd)) {
-            continue;
+    LastCluster = AllocatedCluster + Allocated - 1;
+    for (Index = 0; Index < Allocated; Index += 1) {
+        NextCluster = AllocatedCluster + Index + 1;
+        if (Index == Allocated - 1) {
+            NextCluster = Volume->ClusterEnd;
         }
 
         Status = FatpFatCacheWriteClusterEntry(Volume,
-                                               CurrentCluster,
-                                               Volume->ClusterEnd,
+                                               AllocatedCluster + Index,
+                                               NextCluster,
                                                NULL);
 
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
-        }
-
-        //
-        // Mark a cluster as allocated now that it's been written in stone.
-        //
-
-        AllocatedCluster = CurrentCluster;
-        break;
-    }
-
-    //
-    // If nothing was found, sadly return.
-    //
+            while (Index != 0) {
+                Index -= 1;
+                FatpFatCacheWriteClusterEntry(Volume,
+                                              AllocatedCluster + Index,
+                                              FAT_CLUSTER_FREE,
+                                              NULL);
+            }
 
-    if (AllocatedCluster == FAT_CLUSTER_FREE) {
-        Status = STATUS_VOLUME_FULL;
-        goto AllocateClusterEnd;
+            Allocated = 0;
+            AllocatedCluster = FAT_CLUSTER_FREE;
+            goto AllocateClustersEnd;
+        }
     }
 
     //
@@ -1475,7 +1624,7 @@ Return Value:
 
         if (InformationIoBuffer == NULL) {
             Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto AllocateClusterEnd;
+            goto AllocateClustersEnd;
         }
 
         InformationBlock = Volume->InformationByteOffset >> BlockShift;
@@ -1487,21 +1636,24 @@ Return Value:
                                InformationIoBuffer);
 
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClustersEnd;
         }
 
         Information = FatMapIoBuffer(InformationIoBuffer);
         if (Information == NULL) {
             Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto AllocateClusterEnd;
+            goto AllocateClustersEnd;
         }
 
-        Information->LastClusterAllocated = AllocatedCluster;
+        Information->LastClusterAllocated = LastCluster;
+
+        ASSERT(Information->FreeClusters >= Allocated);
 
-        ASSERT(Information->FreeClusters != 0);
+        if (Information->FreeClusters >= Allocated) {
+            Information->FreeClusters -= Allocated;
 
-        if (Information->FreeClusters != 0) {
-            Information->FreeClusters -= 1;
+        } else {
+            Information->FreeClusters = 0;
         }
 
         Status = FatWriteDevice(Volume->Device.DeviceToken,
@@ -1512,11 +1664,11 @@ Return Value:
                                 InformationIoBuffer);
 
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClustersEnd;
         }
     }
 
-    Volume->ClusterSearchStart = AllocatedCluster;
+    Volume->ClusterSearchStart = LastCluster;
 
     //
     // Lookup the previous block and update it.
@@ -1529,26 +1681,30 @@ Return Value:
                                                NULL);
 
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClustersEnd;
         }
     }
 
     if (Flush != FALSE) {
         Status = FatpFatCacheFlush(Volume, 0);
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClustersEnd;
         }
     }
 
     Status = STATUS_SUCCESS;
 
-AllocateClusterEnd:
+AllocateClustersEnd:
     FatReleaseLock(Volume->Lock);
     if (InformationIoBuffer != NULL) {
         FatFreeIoBuffer(InformationIoBuffer);
     }
 
     *NewCluster = AllocatedCluster;
+    if (AllocatedCount != NULL) {
+        *AllocatedCount = Allocated;
+    }
+
     return Status;
 }
 
@@ -2036,6 +2192,21 @@ Return Value:
         FatpUnsetFileMapping(Directory->File->Volume, Cluster);
     }
 
+    //
+    // Keep the directory's index in sync. If it's unclear whether the entry
+    // is gone or not, throw the index away.
+    //
+
+    if (KSUCCESS(Status)) {
+        FatpRemoveDirectoryIndexEntry(Directory->File->Volume,
+                                      Directory->File->SeekTable[0],
+                                      EntryOffset);
+
+    } else {
+        FatpDestroyDirectoryIndex(Directory->File->Volume,
+                                  Directory->File->SeekTable[0]);
+    }
+
     *EntryErased = LocalEntryErased;
     return Status;
 }
@@ -4059,3 +4230,346 @@ Return Value:
     return Status;
 }
 
+
+KSTATUS
+FatpCreateClusterBitmap (
+    PFAT_VOLUME Volume
+    )
+
+/*++
+
+Routine Description:
+
+    This routine builds the bitmap of clusters in use by scanning the whole
+    FAT. This routine assumes the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PULONG Bitmap;
+    UINTN BitmapSize;
+    ULONG Cluster;
+    ULONG ClusterCount;
+    ULONG FreeCount;
+    KSTATUS Status;
+    ULONG Value;
+    PVOID Window;
+    PUSHORT Window16;
+    PULONG Window32;
+    ULONG WindowOffset;
+    ULONG WindowSize;
+
+    ASSERT(Volume->ClusterBitmap == NULL);
+
+    //
+    // Leave room for at least one bit past the last cluster. Those bits are
+    // always set, which stops free run searches at the end of the volume.
+    //
+
+    ClusterCount = Volume->ClusterCount;
+    BitmapSize = ((ClusterCount / (sizeof(ULONG) * BITS_PER_BYTE)) + 1) *
+                 sizeof(ULONG);
+
+    Bitmap = FatAllocatePagedMemory(Volume->Device.DeviceToken, BitmapSize);
+    if (Bitmap == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CreateClusterBitmapEnd;
+    }
+
+    RtlZeroMemory(Bitmap, BitmapSize);
+    FAT_CLUSTER_BITMAP_SET(Bitmap, 0);
+    FAT_CLUSTER_BITMAP_SET(Bitmap, 1);
+    for (Cluster = ClusterCount;
+         Cluster < (BitmapSize * BITS_PER_BYTE);
+         Cluster += 1) {
+
+        FAT_CLUSTER_BITMAP_SET(Bitmap, Cluster);
+    }
+
+    FreeCount = 0;
+    Cluster = FAT_CLUSTER_BEGIN;
+    WindowSize = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, 1);
+    while (Cluster < ClusterCount) {
+        Status = FatpFatCacheGetFatWindow(Volume,
+                                          TRUE,
+                                          Cluster,
+                                          &Window,
+                                          &WindowOffset);
+
+        if (!KSUCCESS(Status)) {
+            goto CreateClusterBitmapEnd;
+        }
+
+        //
+        // A FAT12 FAT always fits in a single window.
+        //
+
+        if (Volume->Format == Fat12Format) {
+            while (Cluster < ClusterCount) {
+                Value = FAT12_READ_CLUSTER(Window, Cluster);
+                if (Value == FAT_CLUSTER_FREE) {
+                    FreeCount += 1;
+
+                } else {
+                    FAT_CLUSTER_BITMAP_SET(Bitmap, Cluster);
+                }
+
+                Cluster += 1;
+            }
+
+        } else if (Volume->Format == Fat16Format) {
+            Window16 = Window;
+            while ((WindowOffset < WindowSize) && (Cluster < ClusterCount)) {
+                if (Window16[WindowOffset] == FAT_CLUSTER_FREE) {
+                    FreeCount += 1;
+
+                } else {
+                    FAT_CLUSTER_BITMAP_SET(Bitmap, Cluster);
+                }
+
+                WindowOffset += 1;
+                Cluster += 1;
+            }
+
+        } else {
+            Window32 = Window;
+            while ((WindowOffset < WindowSize) && (Cluster < ClusterCount)) {
+                if (Window32[WindowOffset] == FAT_CLUSTER_FREE) {
+                    FreeCount += 1;
+
+                } else {
+                    FAT_CLUSTER_BITMAP_SET(Bitmap, Cluster);
+                }
+
+                WindowOffset += 1;
+                Cluster += 1;
+            }
+        }
+    }
+
+    Volume->ClusterBitmap = Bitmap;
+    Volume->FreeClusterCount = FreeCount;
+    Bitmap = NULL;
+    Status = STATUS_SUCCESS;
+
+CreateClusterBitmapEnd:
+    if (Bitmap != NULL) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Bitmap);
+    }
+
+    return Status;
+}
+
+ULONG
+FatpFindFreeClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG SearchStart,
+    ULONG Count,
+    PULONG RunLength
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the first run of free clusters at least the given
+    length, starting at the given cluster and wrapping around the end of the
+    volume. If no such run turns up after a while, the longest run seen is
+    returned instead. This routine assumes the volume lock is held and the
+    cluster bitmap is built.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    SearchStart - Supplies the cluster to start searching at.
+
+    Count - Supplies the desired run length.
+
+    RunLength - Supplies a pointer where the length of the returned run will
+        be returned. This is never greater than the desired count.
+
+Return Value:
+
+    Returns the first cluster of the run.
+
+    FAT_CLUSTER_FREE if there are no free clusters.
+
+--*/
+
+{
+
+    ULONG BestCluster;
+    ULONG BestLength;
+    PULONG Bitmap;
+    ULONG Cluster;
+    ULONG End;
+    ULONG Length;
+    ULONG Pass;
+    ULONG RunsSearched;
+
+    Bitmap = Volume->ClusterBitmap;
+    BestCluster = FAT_CLUSTER_FREE;
+    BestLength = 0;
+    RunsSearched = 0;
+    Cluster = SearchStart;
+    End = Volume->ClusterCount;
+    for (Pass = 0; Pass < 2; Pass += 1) {
+        while (TRUE) {
+            Cluster = FatpFindFreeCluster(Bitmap, Cluster, End);
+            if (Cluster >= End) {
+                break;
+            }
+
+            Length = FatpGetFreeRunLength(Bitmap, Cluster, Count);
+            if (Length > BestLength) {
+                BestCluster = Cluster;
+                BestLength = Length;
+                if (Length == Count) {
+                    goto FindFreeClusterRunEnd;
+                }
+            }
+
+            RunsSearched += 1;
+            if (RunsSearched >= FAT_FREE_RUN_SEARCH_LIMIT) {
+                goto FindFreeClusterRunEnd;
+            }
+
+            Cluster += Length;
+        }
+
+        //
+        // Wrap around to the beginning.
+        //
+
+        Cluster = FAT_CLUSTER_BEGIN;
+        End = SearchStart;
+    }
+
+FindFreeClusterRunEnd:
+    *RunLength = BestLength;
+    return BestCluster;
+}
+
+ULONG
+FatpFindFreeCluster (
+    PULONG Bitmap,
+    ULONG Cluster,
+    ULONG End
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the first free cluster in the given range of the
+    cluster bitmap.
+
+Arguments:
+
+    Bitmap - Supplies a pointer to the cluster bitmap.
+
+    Cluster - Supplies the first cluster to check.
+
+    End - Supplies the cluster to stop at, exclusive.
+
+Return Value:
+
+    Returns the first free cluster in the range.
+
+    Returns the end value if there are no free clusters in the range.
+
+--*/
+
+{
+
+    ULONG Bit;
+    ULONG Word;
+
+    while (Cluster < End) {
+
+        //
+        // Treat the bits for clusters before the starting one as in use, and
+        // skip ahead a whole word at a time through full parts of the disk.
+        //
+
+        Bit = Cluster & 0x1F;
+        Word = Bitmap[Cluster >> 5] | ((1UL << Bit) - 1);
+        if (Word != MAX_ULONG) {
+            Cluster += RtlCountTrailingZeros32(~Word) - Bit;
+            break;
+        }
+
+        Cluster += 32 - Bit;
+    }
+
+    if (Cluster > End) {
+        Cluster = End;
+    }
+
+    return Cluster;
+}
+
+ULONG
+FatpGetFreeRunLength (
+    PULONG Bitmap,
+    ULONG Cluster,
+    ULONG Limit
+    )
+
+/*++
+
+Routine Description:
+
+    This routine counts the free clusters in a row starting at the given
+    cluster.
+
+Arguments:
+
+    Bitmap - Supplies a pointer to the cluster bitmap. The bitmap always has
+        at least one in-use bit after the last cluster, so the run cannot go
+        off the end of the volume.
+
+    Cluster - Supplies the first cluster of the run.
+
+    Limit - Supplies the maximum run length to report.
+
+Return Value:
+
+    Returns the number of free clusters in a row, up to the limit.
+
+--*/
+
+{
+
+    ULONG Bit;
+    ULONG Length;
+    ULONG Word;
+
+    Length = 0;
+    while (Length < Limit) {
+        Bit = (Cluster + Length) & 0x1F;
+        Word = Bitmap[(Cluster + Length) >> 5] >> Bit;
+        if (Word != 0) {
+            Length += RtlCountTrailingZeros32(Word);
+            break;
+        }
+
+        Length += 32 - Bit;
+    }
+
+    if (Length > Limit) {
+        Length = Limit;
+    }
+
+    return Length;
+}
@@ -45,6 +45,7 @@ Module Name:
 //
 
 #define OUTPUT_IMAGE    "testfat.test"
+#define BENCHMARK_IMAGE "testfatb.test"
 #define TEST_FILE_NAME  "testfile.pag"
 #define TEST_FILE_SIZE (1024 * 1024 * 8)
 #define BLOCK_ITERATIONS 10000
@@ -57,6 +58,26 @@ Module Name:
 
 #define SECTOR_SIZE            512
 
+//
+// Define the parameters of the large file write benchmark. The large file is
+// appended to in big chunks, while a second file gets a small chunk after
+// each one to keep the allocator from having the disk to itself.
+//
+
+#define BENCHMARK_DISK_SIZE (128 * 1024 * 1024)
+#define BENCHMARK_FILE_SIZE (48 * 1024 * 1024)
+#define BENCHMARK_CHUNK_SIZE (64 * 1024)
+#define BENCHMARK_SMALL_CHUNK_SIZE 4096
+#define BENCHMARK_RANDOM_READS 4096
+#define BENCHMARK_LARGE_FILE_NAME "large.bin"
+#define BENCHMARK_SMALL_FILE_NAME "small.bin"
+#define BENCHMARK_PATTERN_MULTIPLIER 2654435761UL
+#define BENCHMARK_DIRECTORY_NAME "bigdir"
+#define BENCHMARK_DIRECTORY_FILES 2000
+#define BENCHMARK_DIRECTORY_FILE_FORMAT "directory file %d.dat"
+#define BENCHMARK_DIRECTORY_RENAMED_FORMAT "renamed file %d.dat"
+#define BENCHMARK_NAME_SIZE 64
+
 //
 // Disk geometry.
 //
@@ -97,6 +118,38 @@ FormatDisk (
     PVOID *VolumeToken
     );
 
+BOOL
+RunLargeFileWriteBenchmark (
+    VOID
+    );
+
+BOOL
+RunDirectoryLookupBenchmark (
+    VOID
+    );
+
+KSTATUS
+LookupBenchmarkFile (
+    PVOID VolumeToken,
+    FILE_ID DirectoryId,
+    PSTR Format,
+    ULONG Index,
+    PFILE_PROPERTIES Properties
+    );
+
+KSTATUS
+CreateAndOpenFile (
+    PVOID VolumeToken,
+    PFILE_PROPERTIES DirectoryProperties,
+    PSTR FileName,
+    PVOID *FileToken
+    );
+
+ULONG
+GetBenchmarkValue (
+    ULONGLONG Offset
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -475,7 +528,21 @@ Return Value:
     }
 
     FatCloseFile(FileToken);
-    Result = TRUE;
+
+    //
+    // Time appending to a large file.
+    //
+
+    Result = RunLargeFileWriteBenchmark();
+    if (Result == FALSE) {
+        goto MainEnd;
+    }
+
+    //
+    // Time lookups in a big directory.
+    //
+
+    Result = RunDirectoryLookupBenchmark();
 
 MainEnd:
     if (FileIoBuffer != NULL) {
@@ -497,6 +564,973 @@ Return Value:
 // --------------------------------------------------------- Internal Functions
 //
 
+BOOL
+RunLargeFileWriteBenchmark (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine times writing a large file in big appends on a fresh volume,
+    with a small file being appended to in between. It then reads the large
+    file back to make sure it landed intact, and times reads from random
+    offsets within it. Finally it truncates and regrows the large file through
+    a second handle, and makes sure the first handle sees the new data.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    UINTN BytesCompleted;
+    PULONG Chunk;
+    PFAT_IO_BUFFER ChunkIoBuffer;
+    FILE_PROPERTIES DirectoryProperties;
+    double Elapsed;
+    struct timespec EndTime;
+    FILE *ImageFile;
+    PVOID LargeFile;
+    FILE_PROPERTIES LargeProperties;
+    FAT_SEEK_INFORMATION LargeSeek;
+    ULONGLONG Offset;
+    PVOID OtherFile;
+    FAT_SEEK_INFORMATION OtherSeek;
+    ULONG ReadIndex;
+    BOOL Result;
+    PVOID SmallFile;
+    FAT_SEEK_INFORMATION SmallSeek;
+    struct timespec StartTime;
+    KSTATUS Status;
+    PVOID VolumeToken;
+    ULONG WordIndex;
+    ULONGLONG WordOffset;
+
+    ChunkIoBuffer = NULL;
+    ImageFile = NULL;
+    LargeFile = NULL;
+    OtherFile = NULL;
+    Result = FALSE;
+    SmallFile = NULL;
+    VolumeToken = NULL;
+    ImageFile = fopen(BENCHMARK_IMAGE, "wb+");
+    if (ImageFile == NULL) {
+        printf("Unable to open output file \"%s\" for write.\n",
+               BENCHMARK_IMAGE);
+
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    Status = FormatDisk(ImageFile,
+                        SECTOR_SIZE,
+                        BENCHMARK_DISK_SIZE / SECTOR_SIZE,
+                        &VolumeToken);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Could not format benchmark image. Status = %d.\n",
+               Status);
+
+        VolumeToken = NULL;
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    RtlZeroMemory(&DirectoryProperties, sizeof(FILE_PROPERTIES));
+    Status = FatLookup(VolumeToken, TRUE, 0, NULL, 0, &DirectoryProperties);
+    if (!KSUCCESS(Status)) {
+        printf("Error: Could not look up root directory. Status = %d.\n",
+               Status);
+
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    Status = CreateAndOpenFile(VolumeToken,
+                               &DirectoryProperties,
+                               BENCHMARK_LARGE_FILE_NAME,
+                               &LargeFile);
+
+    if (!KSUCCESS(Status)) {
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    Status = CreateAndOpenFile(VolumeToken,
+                               &DirectoryProperties,
+                               BENCHMARK_SMALL_FILE_NAME,
+                               &SmallFile);
+
+    if (!KSUCCESS(Status)) {
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    ChunkIoBuffer = FatAllocateIoBuffer(NULL, BENCHMARK_CHUNK_SIZE);
+    if (ChunkIoBuffer == NULL) {
+        printf("Error: Unable to allocate benchmark buffer.\n");
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    Chunk = FatMapIoBuffer(ChunkIoBuffer);
+    if (Chunk == NULL) {
+        printf("Error: Unable to map benchmark buffer.\n");
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    VPRINT("Writing %d MB in %d KB appends.\n",
+           BENCHMARK_FILE_SIZE / (1024 * 1024),
+           BENCHMARK_CHUNK_SIZE / 1024);
+
+    RtlZeroMemory(&LargeSeek, sizeof(FAT_SEEK_INFORMATION));
+    RtlZeroMemory(&SmallSeek, sizeof(FAT_SEEK_INFORMATION));
+    clock_gettime(CLOCK_MONOTONIC, &StartTime);
+    for (Offset = 0;
+         Offset < BENCHMARK_FILE_SIZE;
+         Offset += BENCHMARK_CHUNK_SIZE) {
+
+        for (WordIndex = 0;
+             WordIndex < (BENCHMARK_CHUNK_SIZE / sizeof(ULONG));
+             WordIndex += 1) {
+
+            WordOffset = Offset + (WordIndex * sizeof(ULONG));
+            Chunk[WordIndex] = GetBenchmarkValue(WordOffset);
+        }
+
+        Status = FatWriteFile(LargeFile,
+                              &LargeSeek,
+                              ChunkIoBuffer,
+                              BENCHMARK_CHUNK_SIZE,
+                              0,
+                              NULL,
+                              &BytesCompleted);
+
+        if ((!KSUCCESS(Status)) || (BytesCompleted != BENCHMARK_CHUNK_SIZE)) {
+            printf("Error: Append at offset 0x%llx wrote %lu bytes. "
+                   "Status = %d.\n",
+                   Offset,
+                   BytesCompleted,
+                   Status);
+
+            goto RunLargeFileWriteBenchmarkEnd;
+        }
+
+        Status = FatWriteFile(SmallFile,
+                              &SmallSeek,
+                              ChunkIoBuffer,
+                              BENCHMARK_SMALL_CHUNK_SIZE,
+                              0,
+                              NULL,
+                              &BytesCompleted);
+
+        if ((!KSUCCESS(Status)) ||
+            (BytesCompleted != BENCHMARK_SMALL_CHUNK_SIZE)) {
+
+            printf("Error: Small file append wrote %lu bytes. Status = %d.\n",
+                   BytesCompleted,
+                   Status);
+
+            goto RunLargeFileWriteBenchmarkEnd;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &EndTime);
+    Elapsed = (double)(EndTime.tv_sec - StartTime.tv_sec) +
+              ((double)(EndTime.tv_nsec - StartTime.tv_nsec) / 1000000000.0);
+
+    printf("Large file write: %d MB in %.3f seconds",
+           BENCHMARK_FILE_SIZE / (1024 * 1024),
+           Elapsed);
+
+    if (Elapsed > 0) {
+        printf(", %.1f MB/s",
+               (BENCHMARK_FILE_SIZE / (1024.0 * 1024.0)) / Elapsed);
+    }
+
+    printf(".\n");
+
+    //
+    // Read the whole thing back.
+    //
+
+    Status = FatFileSeek(LargeFile,
+                         NULL,
+                         0,
+                         SeekCommandFromBeginning,
+                         0,
+                         &LargeSeek);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Could not seek to the beginning. Status = %d.\n",
+               Status);
+
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    for (Offset = 0;
+         Offset < BENCHMARK_FILE_SIZE;
+         Offset += BENCHMARK_CHUNK_SIZE) {
+
+        Status = FatReadFile(LargeFile,
+                             &LargeSeek,
+                             ChunkIoBuffer,
+                             BENCHMARK_CHUNK_SIZE,
+                             0,
+                             NULL,
+                             &BytesCompleted);
+
+        if ((!KSUCCESS(Status)) || (BytesCompleted != BENCHMARK_CHUNK_SIZE)) {
+            printf("Error: Read at offset 0x%llx got %lu bytes. "
+                   "Status = %d.\n",
+                   Offset,
+                   BytesCompleted,
+                   Status);
+
+            goto RunLargeFileWriteBenchmarkEnd;
+        }
+
+        for (WordIndex = 0;
+             WordIndex < (BENCHMARK_CHUNK_SIZE / sizeof(ULONG));
+             WordIndex += 1) {
+
+            WordOffset = Offset + (WordIndex * sizeof(ULONG));
+            if (Chunk[WordIndex] != GetBenchmarkValue(WordOffset)) {
+                printf("Error: Large file offset 0x%llx had %x in it.\n",
+                       WordOffset,
+                       Chunk[WordIndex]);
+
+                goto RunLargeFileWriteBenchmarkEnd;
+            }
+        }
+    }
+
+    //
+    // Seek around the file at random, which shouldn't require walking the
+    // cluster chain each time.
+    //
+
+    srand(1);
+    clock_gettime(CLOCK_MONOTONIC, &StartTime);
+    for (ReadIndex = 0; ReadIndex < BENCHMARK_RANDOM_READS; ReadIndex += 1) {
+        Offset = rand() % (BENCHMARK_FILE_SIZE / BENCHMARK_SMALL_CHUNK_SIZE);
+        Offset *= BENCHMARK_SMALL_CHUNK_SIZE;
+        Status = FatFileSeek(LargeFile,
+                             NULL,
+                             0,
+                             SeekCommandFromBeginning,
+                             Offset,
+                             &LargeSeek);
+
+        if (!KSUCCESS(Status)) {
+            printf("Error: Could not seek to 0x%llx. Status = %d.\n",
+                   Offset,
+                   Status);
+
+            goto RunLargeFileWriteBenchmarkEnd;
+        }
+
+        Status = FatReadFile(LargeFile,
+                             &LargeSeek,
+                             ChunkIoBuffer,
+                             BENCHMARK_SMALL_CHUNK_SIZE,
+                             0,
+                             NULL,
+                             &BytesCompleted);
+
+        if ((!KSUCCESS(Status)) ||
+            (BytesCompleted != BENCHMARK_SMALL_CHUNK_SIZE)) {
+
+            printf("Error: Random read at offset 0x%llx got %lu bytes. "
+                   "Status = %d.\n",
+                   Offset,
+                   BytesCompleted,
+                   Status);
+
+            goto RunLargeFileWriteBenchmarkEnd;
+        }
+
+        if (Chunk[0] != GetBenchmarkValue(Offset)) {
+            printf("Error: Random read at offset 0x%llx got %x.\n",
+                   Offset,
+                   Chunk[0]);
+
+            goto RunLargeFileWriteBenchmarkEnd;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &EndTime);
+    Elapsed = (double)(EndTime.tv_sec - StartTime.tv_sec) +
+              ((double)(EndTime.tv_nsec - StartTime.tv_nsec) / 1000000000.0);
+
+    printf("Large file random reads: %d reads in %.3f seconds.\n",
+           BENCHMARK_RANDOM_READS,
+           Elapsed);
+
+    //
+    // Cut the second half off through another handle, let the small file take
+    // the freed clusters, and then grow the large file back with different
+    // data. The first handle's extent map still describes the old chain, and
+    // must not be used to read the new second half.
+    //
+
+    RtlZeroMemory(&LargeProperties, sizeof(FILE_PROPERTIES));
+    Status = FatLookup(VolumeToken,
+                       FALSE,
+                       DirectoryProperties.FileId,
+                       BENCHMARK_LARGE_FILE_NAME,
+                       sizeof(BENCHMARK_LARGE_FILE_NAME),
+                       &LargeProperties);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Could not look up large file. Status = %d.\n", Status);
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    Status = FatOpenFileId(VolumeToken,
+                           LargeProperties.FileId,
+                           IO_ACCESS_READ | IO_ACCESS_WRITE,
+                           0,
+                           &OtherFile);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Could not reopen large file. Status = %d.\n", Status);
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    Status = FatDeleteFileBlocks(VolumeToken,
+                                 OtherFile,
+                                 LargeProperties.FileId,
+                                 BENCHMARK_FILE_SIZE / 2,
+                                 TRUE);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Could not truncate large file. Status = %d.\n",
+               Status);
+
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    Status = FatWriteFile(SmallFile,
+                          &SmallSeek,
+                          ChunkIoBuffer,
+                          BENCHMARK_CHUNK_SIZE,
+                          0,
+                          NULL,
+                          &BytesCompleted);
+
+    if ((!KSUCCESS(Status)) || (BytesCompleted != BENCHMARK_CHUNK_SIZE)) {
+        printf("Error: Small file append wrote %lu bytes. Status = %d.\n",
+               BytesCompleted,
+               Status);
+
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    RtlZeroMemory(&OtherSeek, sizeof(FAT_SEEK_INFORMATION));
+    Status = FatFileSeek(OtherFile,
+                         NULL,
+                         0,
+                         SeekCommandFromBeginning,
+                         BENCHMARK_FILE_SIZE / 2,
+                         &OtherSeek);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Could not seek to the truncated end. Status = %d.\n",
+               Status);
+
+        goto RunLargeFileWriteBenchmarkEnd;
+    }
+
+    for (Offset = BENCHMARK_FILE_SIZE / 2;
+         Offset < BENCHMARK_FILE_SIZE;
+         Offset += BENCHMARK_CHUNK_SIZE) {
+
+        for (WordIndex = 0;
+             WordIndex < (BENCHMARK_CHUNK_SIZE / sizeof(ULONG));
+             WordIndex += 1) {
+
+            WordOffset = Offset + (WordIndex * sizeof(ULONG));
+            Chunk[WordIndex] = ~GetBenchmarkValue(WordOffset);
+        }
+
+        Status = FatWriteFile(OtherFile,
+                              &OtherSeek,
+                              ChunkIoBuffer,
+                              BENCHMARK_CHUNK_SIZE,
+                              0,
+                              NULL,
+                              &BytesCompleted);
+
+        if ((!KSUCCESS(Status)) || (BytesCompleted != BENCHMARK_CHUNK_SIZE)) {
+            printf("Error: Regrow at offset 0x%llx wrote %lu bytes. "
+                   "Status = %d.\n",
+                   Offset,
+                   BytesCompleted,
+                   Status);
+
+            goto RunLargeFileWriteBenchmarkEnd;
+        }
+    }
+
+    for (Offset = BENCHMARK_FILE_SIZE / 2;
+         Offset < BENCHMARK_FILE_SIZE;
+         Offset += BENCHMARK_CHUNK_SIZE) {
+
+        Status = FatFileSeek(LargeFile,
+                             NULL,
+                             0,
+                             SeekCommandFromBeginning,
+                             Offset,
+                             &LargeSeek);
+
+        if (KSUCCESS(Status)) {
+            Status = FatReadFile(LargeFile,
+                                 &LargeSeek,
+                                 ChunkIoBuffer,
+                                 BENCHMARK_SMALL_CHUNK_SIZE,
+                                 0,
+                                 NULL,
+                                 &BytesCompleted);
+        }
+
+        if ((!KSUCCESS(Status)) ||
+            (BytesCompleted != BENCHMARK_SMALL_CHUNK_SIZE)) {
+
+            printf("Error: Read after regrow at 0x%llx failed. "
+                   "Status = %d.\n",
+                   Offset,
+                   Status);
+
+            goto RunLargeFileWriteBenchmarkEnd;
+        }
+
+        if (Chunk[0] != ~GetBenchmarkValue(Offset)) {
+            printf("Error: Stale read after regrow at 0x%llx got %x.\n",
+                   Offset,
+                   Chunk[0]);
+
+            goto RunLargeFileWriteBenchmarkEnd;
+        }
+    }
+
+    Result = TRUE;
+
+RunLargeFileWriteBenchmarkEnd:
+    if (ChunkIoBuffer != NULL) {
+        FatFreeIoBuffer(ChunkIoBuffer);
+    }
+
+    if (LargeFile != NULL) {
+        FatCloseFile(LargeFile);
+    }
+
+    if (OtherFile != NULL) {
+        FatCloseFile(OtherFile);
+    }
+
+    if (SmallFile != NULL) {
+        FatCloseFile(SmallFile);
+    }
+
+    if (VolumeToken != NULL) {
+        FatUnmount(VolumeToken);
+    }
+
+    if (ImageFile != NULL) {
+        fclose(ImageFile);
+    }
+
+    return Result;
+}
+
+BOOL
+RunDirectoryLookupBenchmark (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills a directory with many files and times looking them all
+    up. It then unlinks, recreates, and renames some of them to make sure
+    lookups stay correct as the directory changes.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    ULONGLONG DirectorySize;
+    FILE_PROPERTIES DirectoryProperties;
+    double Elapsed;
+    struct timespec EndTime;
+    BOOL Erased;
+    PVOID File;
+    ULONG FileIndex;
+    FILE *ImageFile;
+    CHAR Name[BENCHMARK_NAME_SIZE];
+    BOOL NewCreated;
+    FILE_PROPERTIES Properties;
+    FILE_PROPERTIES RootProperties;
+    BOOL Result;
+    struct timespec StartTime;
+    KSTATUS Status;
+    BOOL Unlinked;
+    PVOID VolumeToken;
+
+    ImageFile = NULL;
+    Result = FALSE;
+    VolumeToken = NULL;
+    ImageFile = fopen(BENCHMARK_IMAGE, "wb+");
+    if (ImageFile == NULL) {
+        printf("Unable to open output file \"%s\" for write.\n",
+               BENCHMARK_IMAGE);
+
+        goto RunDirectoryLookupBenchmarkEnd;
+    }
+
+    Status = FormatDisk(ImageFile,
+                        SECTOR_SIZE,
+                        BENCHMARK_DISK_SIZE / SECTOR_SIZE,
+                        &VolumeToken);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Could not format benchmark image. Status = %d.\n",
+               Status);
+
+        VolumeToken = NULL;
+        goto RunDirectoryLookupBenchmarkEnd;
+    }
+
+    //
+    // Create a subdirectory, since a FAT12 or FAT16 root directory can only
+    // hold a few hundred entries.
+    //
+
+    RtlZeroMemory(&RootProperties, sizeof(FILE_PROPERTIES));
+    Status = FatLookup(VolumeToken, TRUE, 0, NULL, 0, &RootProperties);
+    if (!KSUCCESS(Status)) {
+        printf("Error: Could not look up root directory. Status = %d.\n",
+               Status);
+
+        goto RunDirectoryLookupBenchmarkEnd;
+    }
+
+    RtlZeroMemory(&DirectoryProperties, sizeof(FILE_PROPERTIES));
+    DirectoryProperties.Type = IoObjectRegularDirectory;
+    DirectoryProperties.Permissions = FILE_PERMISSION_USER_READ |
+                                      FILE_PERMISSION_USER_WRITE |
+                                      FILE_PERMISSION_USER_EXECUTE;
+
+    DirectoryProperties.HardLinkCount = 1;
+    Status = FatCreate(VolumeToken,
+                       RootProperties.FileId,
+                       BENCHMARK_DIRECTORY_NAME,
+                       sizeof(BENCHMARK_DIRECTORY_NAME),
+                       &DirectorySize,
+                       &DirectoryProperties);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Could not create directory. Status = %d.\n", Status);
+        goto RunDirectoryLookupBenchmarkEnd;
+    }
+
+    VPRINT("Creating %d files.\n", BENCHMARK_DIRECTORY_FILES);
+    for (FileIndex = 0;
+         FileIndex < BENCHMARK_DIRECTORY_FILES;
+         FileIndex += 1) {
+
+        snprintf(Name,
+                 sizeof(Name),
+                 BENCHMARK_DIRECTORY_FILE_FORMAT,
+                 FileIndex);
+
+        Status = CreateAndOpenFile(VolumeToken,
+                                   &DirectoryProperties,
+                                   Name,
+                                   &File);
+
+        if (!KSUCCESS(Status)) {
+            goto RunDirectoryLookupBenchmarkEnd;
+        }
+
+        FatCloseFile(File);
+    }
+
+    //
+    // Look every file up, backwards so that a linear scan would have the
+    // most work to do.
+    //
+
+    clock_gettime(CLOCK_MONOTONIC, &StartTime);
+    FileIndex = BENCHMARK_DIRECTORY_FILES;
+    while (FileIndex != 0) {
+        FileIndex -= 1;
+        Status = LookupBenchmarkFile(VolumeToken,
+                                     DirectoryProperties.FileId,
+                                     BENCHMARK_DIRECTORY_FILE_FORMAT,
+                                     FileIndex,
+                                     &Properties);
+
+        if (!KSUCCESS(Status)) {
+            printf("Error: Lookup of file %d failed. Status = %d.\n",
+                   FileIndex,
+                   Status);
+
+            goto RunDirectoryLookupBenchmarkEnd;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &EndTime);
+    Elapsed = (double)(EndTime.tv_sec - StartTime.tv_sec) +
+              ((double)(EndTime.tv_nsec - StartTime.tv_nsec) / 1000000000.0);
+
+    printf("Directory lookups: %d lookups in %.3f seconds.\n",
+           BENCHMARK_DIRECTORY_FILES,
+           Elapsed);
+
+    //
+    // Unlink every other file, and rename every fourth one.
+    //
+
+    for (FileIndex = 0;
+         FileIndex < BENCHMARK_DIRECTORY_FILES;
+         FileIndex += 2) {
+
+        Status = LookupBenchmarkFile(VolumeToken,
+                                     DirectoryProperties.FileId,
+                                     BENCHMARK_DIRECTORY_FILE_FORMAT,
+                                     FileIndex,
+                                     &Properties);
+
+        if (!KSUCCESS(Status)) {
+            goto RunDirectoryLookupBenchmarkEnd;
+        }
+
+        snprintf(Name,
+                 sizeof(Name),
+                 BENCHMARK_DIRECTORY_FILE_FORMAT,
+                 FileIndex);
+
+        Status = FatUnlink(VolumeToken,
+                           DirectoryProperties.FileId,
+                           Name,
+                           strlen(Name) + 1,
+                           Properties.FileId,
+                           &Unlinked);
+
+        if (!KSUCCESS(Status)) {
+            printf("Error: Unlink of %s failed. Status = %d.\n",
+                   Name,
+                   Status);
+
+            goto RunDirectoryLookupBenchmarkEnd;
+        }
+
+        FatDeleteFileBlocks(VolumeToken,
+                            NULL,
+                            Properties.FileId,
+                            0,
+                            FALSE);
+
+        Status = LookupBenchmarkFile(VolumeToken,
+                                     DirectoryProperties.FileId,
+                                     BENCHMARK_DIRECTORY_FILE_FORMAT,
+                                     FileIndex + 1,
+                                     &Properties);
+
+        if ((!KSUCCESS(Status)) || ((FileIndex % 4) != 0)) {
+            continue;
+        }
+
+        snprintf(Name,
+                 sizeof(Name),
+                 BENCHMARK_DIRECTORY_RENAMED_FORMAT,
+                 FileIndex + 1);
+
+        Status = FatRename(VolumeToken,
+                           DirectoryProperties.FileId,
+                           Properties.FileId,
+                           &Erased,
+                           DirectoryProperties.FileId,
+                           &NewCreated,
+                           &DirectorySize,
+                           Name,
+                           strlen(Name) + 1);
+
+        if (!KSUCCESS(Status)) {
+            printf("Error: Rename to %s failed. Status = %d.\n",
+                   Name,
+                   Status);
+
+            goto RunDirectoryLookupBenchmarkEnd;
+        }
+    }
+
+    //
+    // Check that every file is where it should be.
+    //
+
+    for (FileIndex = 0;
+         FileIndex < BENCHMARK_DIRECTORY_FILES;
+         FileIndex += 1) {
+
+        Status = LookupBenchmarkFile(VolumeToken,
+                                     DirectoryProperties.FileId,
+                                     BENCHMARK_DIRECTORY_FILE_FORMAT,
+                                     FileIndex,
+                                     &Properties);
+
+        if (((FileIndex % 4) == 1) || ((FileIndex % 2) == 0)) {
+            if (Status != STATUS_PATH_NOT_FOUND) {
+                printf("Error: File %d should be gone. Status = %d.\n",
+                       FileIndex,
+                       Status);
+
+                goto RunDirectoryLookupBenchmarkEnd;
+            }
+
+            if ((FileIndex % 4) != 1) {
+                continue;
+            }
+
+            Status = LookupBenchmarkFile(VolumeToken,
+                                         DirectoryProperties.FileId,
+                                         BENCHMARK_DIRECTORY_RENAMED_FORMAT,
+                                         FileIndex,
+                                         &Properties);
+        }
+
+        if (!KSUCCESS(Status)) {
+            printf("Error: File %d went missing. Status = %d.\n",
+                   FileIndex,
+                   Status);
+
+            goto RunDirectoryLookupBenchmarkEnd;
+        }
+    }
+
+    //
+    // Recreate the unlinked files, which lands them in the erased slots.
+    //
+
+    for (FileIndex = 0;
+         FileIndex < BENCHMARK_DIRECTORY_FILES;
+         FileIndex += 2) {
+
+        snprintf(Name,
+                 sizeof(Name),
+                 BENCHMARK_DIRECTORY_FILE_FORMAT,
+                 FileIndex);
+
+        Status = CreateAndOpenFile(VolumeToken,
+                                   &DirectoryProperties,
+                                   Name,
+                                   &File);
+
+        if (!KSUCCESS(Status)) {
+            goto RunDirectoryLookupBenchmarkEnd;
+        }
+
+        FatCloseFile(File);
+        Status = LookupBenchmarkFile(VolumeToken,
+                                     DirectoryProperties.FileId,
+                                     BENCHMARK_DIRECTORY_FILE_FORMAT,
+                                     FileIndex,
+                                     &Properties);
+
+        if (!KSUCCESS(Status)) {
+            printf("Error: Recreated file %d not found. Status = %d.\n",
+                   FileIndex,
+                   Status);
+
+            goto RunDirectoryLookupBenchmarkEnd;
+        }
+    }
+
+    Result = TRUE;
+
+RunDirectoryLookupBenchmarkEnd:
+    if (VolumeToken != NULL) {
+        FatUnmount(VolumeToken);
+    }
+
+    if (ImageFile != NULL) {
+        fclose(ImageFile);
+    }
+
+    return Result;
+}
+
+KSTATUS
+LookupBenchmarkFile (
+    PVOID VolumeToken,
+    FILE_ID DirectoryId,
+    PSTR Format,
+    ULONG Index,
+    PFILE_PROPERTIES Properties
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up one of the files in the directory benchmark.
+
+Arguments:
+
+    VolumeToken - Supplies the token identifying the volume.
+
+    DirectoryId - Supplies the file ID of the directory to look in.
+
+    Format - Supplies the format string the file's name is made from.
+
+    Index - Supplies the index of the file, which goes into the name.
+
+    Properties - Supplies a pointer where the file properties will be
+        returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    CHAR Name[BENCHMARK_NAME_SIZE];
+
+    snprintf(Name, sizeof(Name), Format, Index);
+    return FatLookup(VolumeToken,
+                     FALSE,
+                     DirectoryId,
+                     Name,
+                     strlen(Name) + 1,
+                     Properties);
+}
+
+KSTATUS
+CreateAndOpenFile (
+    PVOID VolumeToken,
+    PFILE_PROPERTIES DirectoryProperties,
+    PSTR FileName,
+    PVOID *FileToken
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates a new file in a directory and opens it.
+
+Arguments:
+
+    VolumeToken - Supplies the token identifying the volume.
+
+    DirectoryProperties - Supplies a pointer to the properties of the
+        directory to create the file in. The size is updated if the directory
+        grows.
+
+    FileName - Supplies a pointer to the name of the file to create.
+
+    FileToken - Supplies a pointer where the open file token will be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONGLONG DirectorySize;
+    ULONGLONG NewDirectorySize;
+    FILE_PROPERTIES Properties;
+    KSTATUS Status;
+
+    RtlZeroMemory(&Properties, sizeof(FILE_PROPERTIES));
+    Properties.Type = IoObjectRegularFile;
+    Properties.Permissions = FILE_PERMISSION_USER_READ |
+                             FILE_PERMISSION_USER_WRITE;
+
+    Properties.HardLinkCount = 1;
+    Status = FatCreate(VolumeToken,
+                       DirectoryProperties->FileId,
+                       FileName,
+                       strlen(FileName) + 1,
+                       &NewDirectorySize,
+                       &Properties);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Unable to create file %s. Status %d.\n",
+               FileName,
+               Status);
+
+        return Status;
+    }
+
+    READ_INT64_SYNC(&(DirectoryProperties->FileSize), &DirectorySize);
+    if (NewDirectorySize > DirectorySize) {
+        WRITE_INT64_SYNC(&(DirectoryProperties->FileSize), NewDirectorySize);
+        FatWriteFileProperties(VolumeToken, DirectoryProperties, 0);
+    }
+
+    Status = FatOpenFileId(VolumeToken,
+                           Properties.FileId,
+                           IO_ACCESS_READ | IO_ACCESS_WRITE,
+                           OPEN_FLAG_CREATE,
+                           FileToken);
+
+    if (!KSUCCESS(Status)) {
+        printf("Error: Unable to open %s. Status %d\n", FileName, Status);
+    }
+
+    return Status;
+}
+
+ULONG
+GetBenchmarkValue (
+    ULONGLONG Offset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the pattern word written at the given offset of the
+    large benchmark file.
+
+Arguments:
+
+    Offset - Supplies the file offset of the word.
+
+Return Value:
+
+    Returns the word that belongs at that offset.
+
+--*/
+
+{
+
+    return (ULONG)(Offset * BENCHMARK_PATTERN_MULTIPLIER) ^
+           (ULONG)(Offset >> 32);
+}
+
 KSTATUS
 FormatDisk (
     FILE *File,
@@ -1825,6 +1825,113 @@ Return Value:
     return;
 }
 
+RTL_API
+UINTN
+RtlHeapGetAllocationSize (
+    PMEMORY_HEAP Heap,
+    PVOID Memory
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the usable size of an allocation made from the given
+    heap. The heap is not modified, so this routine may be called without
+    synchronizing with the heap as long as the caller owns the allocation.
+
+Arguments:
+
+    Heap - Supplies the heap to check the allocation against.
+
+    Memory - Supplies the allocation created by the heap allocation routine.
+
+Return Value:
+
+    Returns the number of bytes usable in the allocation, which is at least as
+    large as the size originally requested.
+
+    0 if the allocation was not made from the given heap.
+
+--*/
+
+{
+
+    PHEAP_CHUNK Chunk;
+    PMEMORY_HEAP FooterHeap;
+
+    if (Memory == NULL) {
+        return 0;
+    }
+
+    Chunk = HEAP_MEMORY_TO_CHUNK(Memory);
+    if (!HEAP_CHUNK_IS_IN_USE(Chunk)) {
+        return 0;
+    }
+
+    FooterHeap = HEAP_DECODE_FOOTER_MAGIC(Heap, Chunk);
+    if (FooterHeap != Heap) {
+        return 0;
+    }
+
+    return HEAP_CHUNK_SIZE(Chunk) - HEAP_OVERHEAD_FOR(Chunk);
+}
+
+RTL_API
+BOOL
+RtlHeapValidateAllocation (
+    PMEMORY_HEAP Heap,
+    PVOID Memory
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs the same checks on an allocation that freeing it
+    would, without freeing it. The heap's corruption routine is called if the
+    allocation is bad. This routine assumes the heap lock is already held.
+
+Arguments:
+
+    Heap - Supplies the heap the allocation was made from.
+
+    Memory - Supplies the allocation created by the heap allocation routine.
+
+Return Value:
+
+    TRUE if the allocation is in use and intact.
+
+    FALSE if the allocation is corrupt or has already been freed.
+
+--*/
+
+{
+
+    PHEAP_CHUNK Chunk;
+    PMEMORY_HEAP FooterMagic;
+
+    Chunk = HEAP_MEMORY_TO_CHUNK(Memory);
+    FooterMagic = HEAP_DECODE_FOOTER_MAGIC(Heap, Chunk);
+    if (FooterMagic != Heap) {
+        HEAP_HANDLE_CORRUPTION(Heap, HeapCorruptionBufferOverrun, Chunk);
+        return FALSE;
+    }
+
+    RtlpHeapCheckInUseChunk(Heap, Chunk);
+    if ((!HEAP_CHUNK_IS_IN_USE(Chunk)) || (Chunk->Tag == HEAP_FREE_MAGIC)) {
+        HEAP_HANDLE_CORRUPTION(Heap, HeapCorruptionDoubleFree, Chunk);
+        return FALSE;
+    }
+
+    if (!HEAP_OK_ADDRESS(Heap, Chunk)) {
+        HEAP_HANDLE_CORRUPTION(Heap, HeapCorruptionCorruptStructures, Chunk);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 RTL_API
 VOID
 RtlValidateHeap (
@@ -29,6 +29,7 @@ function build() {
     sources = [
         "fptest.c",
         "heaptest.c",
+        "memtest.c",
         "testrtl.c",
         "timetest.c"
     ];
@@ -241,6 +241,19 @@ Return Value:
                     Failures += 1;
                 }
 
+                if ((RtlHeapGetAllocationSize(&TestUpperHeap,
+                                              Allocations[Index]) < Size) ||
+                    (RtlHeapGetAllocationSize(&TestLowerHeap,
+                                              Allocations[Index]) != 0)) {
+
+                    printf("Error: Heap reported wrong size for allocation "
+                           "%p of size 0x%x\n",
+                           Allocations[Index],
+                           Size);
+
+                    Failures += 1;
+                }
+
                 memset(Allocations[Index], 0xAB, Size);
             }
 
@@ -0,0 +1,623 @@
+/*++
+
+Copyright (c) 2016 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    memtest.c
+
+Abstract:
+
+    This module tests the runtime library memory routines, both with and
+    without the vector implementations, and benchmarks them against each
+    other.
+
+Author:
+
+    agent 16-Oct-2026
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#define RTL_API
+
+#include <minoca/lib/types.h>
+#include <minoca/lib/status.h>
+#include <minoca/lib/rtl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the vector features this processor can use.
+//
+
+#if defined(__i386) || defined(__x86_64)
+
+#define TEST_MEMORY_FEATURES RTL_MEMORY_FEATURE_SSE2
+
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+#define TEST_MEMORY_FEATURES RTL_MEMORY_FEATURE_NEON
+
+#else
+
+#define TEST_MEMORY_FEATURES 0
+
+#endif
+
+//
+// Define the largest size for which every combination of source and
+// destination alignment is tested.
+//
+
+#define TEST_MEMORY_EXHAUSTIVE_SIZE 200
+
+//
+// Define the number of bytes of guard placed around each test buffer.
+//
+
+#define TEST_MEMORY_GUARD 32
+
+#define TEST_MEMORY_GUARD_BYTE 0xA5
+
+//
+// Define the total number of bytes each benchmark run processes.
+//
+
+#define TEST_MEMORY_BENCHMARK_BYTES (256 * 1024 * 1024)
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+typedef enum _TEST_MEMORY_ROUTINE {
+    TestMemoryCopy,
+    TestMemoryZero,
+    TestMemorySet,
+    TestMemoryCompare,
+    TestMemoryRoutineCount
+} TEST_MEMORY_ROUTINE, *PTEST_MEMORY_ROUTINE;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+ULONG
+TestMemorySize (
+    PUCHAR Source,
+    PUCHAR Destination,
+    UINTN SourceOffset,
+    UINTN DestinationOffset,
+    UINTN Size
+    );
+
+double
+TestBenchmarkMemoryRoutine (
+    TEST_MEMORY_ROUTINE Routine,
+    PUCHAR Source,
+    PUCHAR Destination,
+    UINTN Size
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Define the large sizes tested, which cover the block loops, the string
+// instructions, and the non-temporal paths.
+//
+
+UINTN TestMemoryLargeSizes[] = {
+    0x800 - 1,
+    0x800 + 3,
+    0x1000 + 13,
+    0x10000 + 7,
+    0x400000 + 64 + 5
+};
+
+//
+// Define the sizes benchmarked.
+//
+
+UINTN TestMemoryBenchmarkSizes[] = {
+    16,
+    64,
+    256,
+    1024,
+    4096,
+    0x10000,
+    0x100000,
+    0x800000
+};
+
+PSTR TestMemoryRoutineNames[TestMemoryRoutineCount] = {
+    "Copy",
+    "Zero",
+    "Set",
+    "Compare"
+};
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+ULONG
+TestMemoryRoutines (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tests the memory copy, set, zero, and compare routines over
+    a range of sizes and alignments, with and without vector features.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of tests that failed.
+
+--*/
+
+{
+
+    UINTN BufferSize;
+    PUCHAR Destination;
+    UINTN DestinationOffset;
+    ULONG Failures;
+    ULONG Features;
+    UINTN Index;
+    ULONG OriginalFeatures;
+    ULONG Pass;
+    UINTN Size;
+    PUCHAR Source;
+    UINTN SourceOffset;
+
+    Failures = 0;
+    BufferSize = TestMemoryLargeSizes[(sizeof(TestMemoryLargeSizes) /
+                                       sizeof(TestMemoryLargeSizes[0])) - 1];
+
+    BufferSize += (TEST_MEMORY_GUARD * 2) + 16;
+    Source = malloc(BufferSize);
+    Destination = malloc(BufferSize);
+    if ((Source == NULL) || (Destination == NULL)) {
+        printf("Error: Failed to allocate memory test buffers.\n");
+        Failures += 1;
+        goto TestMemoryRoutinesEnd;
+    }
+
+    OriginalFeatures = RtlSetMemoryFeatures(0);
+    for (Pass = 0; Pass < 2; Pass += 1) {
+        Features = 0;
+        if (Pass != 0) {
+            Features = TEST_MEMORY_FEATURES;
+            if (Features == 0) {
+                break;
+            }
+        }
+
+        RtlSetMemoryFeatures(Features);
+        for (Size = 0; Size <= TEST_MEMORY_EXHAUSTIVE_SIZE; Size += 1) {
+            for (SourceOffset = 0; SourceOffset < 16; SourceOffset += 1) {
+                for (DestinationOffset = 0;
+                     DestinationOffset < 16;
+                     DestinationOffset += 1) {
+
+                    Failures += TestMemorySize(Source,
+                                               Destination,
+                                               SourceOffset,
+                                               DestinationOffset,
+                                               Size);
+                }
+            }
+        }
+
+        for (Index = 0;
+             Index < sizeof(TestMemoryLargeSizes) /
+                     sizeof(TestMemoryLargeSizes[0]);
+             Index += 1) {
+
+            Size = TestMemoryLargeSizes[Index];
+            Failures += TestMemorySize(Source, Destination, 0, 0, Size);
+            Failures += TestMemorySize(Source, Destination, 3, 7, Size);
+            Failures += TestMemorySize(Source, Destination, 15, 1, Size);
+        }
+
+        //
+        // Make sure forward copies to a lower overlapping address work, as
+        // memmove relies on this.
+        //
+
+        for (Index = 0; Index < BufferSize; Index += 1) {
+            Source[Index] = (UCHAR)Index;
+        }
+
+        RtlCopyMemory(Source, Source + 5, 0x1000);
+        for (Index = 0; Index < 0x1000; Index += 1) {
+            if (Source[Index] != (UCHAR)(Index + 5)) {
+                printf("Error: Overlapping copy failed at offset 0x%lx with "
+                       "features 0x%x.\n",
+                       (long)Index,
+                       Features);
+
+                Failures += 1;
+                break;
+            }
+        }
+    }
+
+    RtlSetMemoryFeatures(OriginalFeatures);
+
+TestMemoryRoutinesEnd:
+    if (Source != NULL) {
+        free(Source);
+    }
+
+    if (Destination != NULL) {
+        free(Destination);
+    }
+
+    if (Failures != 0) {
+        printf("%d memory routine test failures.\n", Failures);
+    }
+
+    return Failures;
+}
+
+VOID
+BenchmarkMemoryRoutines (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine prints the throughput of the memory routines at a range of
+    sizes, comparing the original implementations with the vector ones.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    double Base;
+    UINTN BufferSize;
+    PUCHAR Destination;
+    UINTN Index;
+    ULONG OriginalFeatures;
+    TEST_MEMORY_ROUTINE Routine;
+    UINTN Size;
+    PUCHAR Source;
+    double Vector;
+
+    BufferSize = TestMemoryBenchmarkSizes[
+                                    (sizeof(TestMemoryBenchmarkSizes) /
+                                     sizeof(TestMemoryBenchmarkSizes[0])) - 1];
+
+    Source = malloc(BufferSize);
+    Destination = malloc(BufferSize);
+    if ((Source == NULL) || (Destination == NULL)) {
+        printf("Error: Failed to allocate benchmark buffers.\n");
+        goto BenchmarkMemoryRoutinesEnd;
+    }
+
+    memset(Source, 0x5A, BufferSize);
+    memset(Destination, 0x5A, BufferSize);
+    OriginalFeatures = RtlSetMemoryFeatures(0);
+    printf("%-8s %10s %12s %12s %8s\n",
+           "Routine",
+           "Size",
+           "Base MB/s",
+           "Vector MB/s",
+           "Speedup");
+
+    for (Routine = 0; Routine < TestMemoryRoutineCount; Routine += 1) {
+        for (Index = 0;
+             Index < sizeof(TestMemoryBenchmarkSizes) /
+                     sizeof(TestMemoryBenchmarkSizes[0]);
+             Index += 1) {
+
+            Size = TestMemoryBenchmarkSizes[Index];
+            RtlSetMemoryFeatures(0);
+            Base = TestBenchmarkMemoryRoutine(Routine,
+                                              Source,
+                                              Destination,
+                                              Size);
+
+            RtlSetMemoryFeatures(TEST_MEMORY_FEATURES);
+            Vector = TestBenchmarkMemoryRoutine(Routine,
+                                                Source,
+                                                Destination,
+                                                Size);
+
+            printf("%-8s %10ld %12.0f %12.0f %7.2fx\n",
+                   TestMemoryRoutineNames[Routine],
+                   (long)Size,
+                   Base,
+                   Vector,
+                   Vector / Base);
+        }
+    }
+
+    RtlSetMemoryFeatures(OriginalFeatures);
+
+BenchmarkMemoryRoutinesEnd:
+    if (Source != NULL) {
+        free(Source);
+    }
+
+    if (Destination != NULL) {
+        free(Destination);
+    }
+
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+ULONG
+TestMemorySize (
+    PUCHAR Source,
+    PUCHAR Destination,
+    UINTN SourceOffset,
+    UINTN DestinationOffset,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tests each memory routine on a single size and alignment.
+
+Arguments:
+
+    Source - Supplies a pointer to the source buffer, which must be big
+        enough to hold the guards, offset, and size.
+
+    Destination - Supplies a pointer to the destination buffer, which must be
+        big enough to hold the guards, offset, and size.
+
+    SourceOffset - Supplies the offset from the guard to use for the source.
+
+    DestinationOffset - Supplies the offset from the guard to use for the
+        destination.
+
+    Size - Supplies the number of bytes to operate on.
+
+Return Value:
+
+    Returns the number of failures.
+
+--*/
+
+{
+
+    PUCHAR Buffer;
+    ULONG Failures;
+    UINTN Index;
+    PVOID Result;
+    PUCHAR SourceStart;
+    UINTN Total;
+
+    Failures = 0;
+    Total = Size + (TEST_MEMORY_GUARD * 2) + 16;
+    Buffer = Destination + TEST_MEMORY_GUARD + DestinationOffset;
+    SourceStart = Source + TEST_MEMORY_GUARD + SourceOffset;
+    for (Index = 0; Index < Total; Index += 1) {
+        Source[Index] = (UCHAR)(Index * 7 + Size);
+    }
+
+    //
+    // Test copy.
+    //
+
+    memset(Destination, TEST_MEMORY_GUARD_BYTE, Total);
+    Result = RtlCopyMemory(Buffer, SourceStart, Size);
+    if (Result != Buffer) {
+        printf("Error: RtlCopyMemory returned %p instead of %p.\n",
+               Result,
+               Buffer);
+
+        Failures += 1;
+    }
+
+    for (Index = 0; Index < Total; Index += 1) {
+        if ((Destination + Index >= Buffer) &&
+            (Destination + Index < Buffer + Size)) {
+
+            if (Destination[Index] !=
+                SourceStart[Destination + Index - Buffer]) {
+
+                Failures += 1;
+                break;
+            }
+
+        } else if (Destination[Index] != TEST_MEMORY_GUARD_BYTE) {
+            Failures += 1;
+            break;
+        }
+    }
+
+    //
+    // Test compare on the freshly copied buffers, and then with a single
+    // byte changed.
+    //
+
+    if (RtlCompareMemory(Buffer, SourceStart, Size) == FALSE) {
+        Failures += 1;
+    }
+
+    if (Size != 0) {
+        Index = rand() % Size;
+        Buffer[Index] ^= 0x10;
+        if (RtlCompareMemory(Buffer, SourceStart, Size) != FALSE) {
+            Failures += 1;
+        }
+
+        Buffer[Index] ^= 0x10;
+        Buffer[Size - 1] ^= 0x01;
+        if (RtlCompareMemory(Buffer, SourceStart, Size) != FALSE) {
+            Failures += 1;
+        }
+    }
+
+    //
+    // Test zero.
+    //
+
+    memset(Destination, TEST_MEMORY_GUARD_BYTE, Total);
+    RtlZeroMemory(Buffer, Size);
+    for (Index = 0; Index < Total; Index += 1) {
+        if ((Destination + Index >= Buffer) &&
+            (Destination + Index < Buffer + Size)) {
+
+            if (Destination[Index] != 0) {
+                Failures += 1;
+                break;
+            }
+
+        } else if (Destination[Index] != TEST_MEMORY_GUARD_BYTE) {
+            Failures += 1;
+            break;
+        }
+    }
+
+    //
+    // Test set.
+    //
+
+    memset(Destination, TEST_MEMORY_GUARD_BYTE, Total);
+    RtlSetMemory(Buffer, 0x3C, Size);
+    for (Index = 0; Index < Total; Index += 1) {
+        if ((Destination + Index >= Buffer) &&
+            (Destination + Index < Buffer + Size)) {
+
+            if (Destination[Index] != 0x3C) {
+                Failures += 1;
+                break;
+            }
+
+        } else if (Destination[Index] != TEST_MEMORY_GUARD_BYTE) {
+            Failures += 1;
+            break;
+        }
+    }
+
+    if (Failures != 0) {
+        printf("Error: Memory routines failed with size 0x%lx, source "
+               "offset %d, destination offset %d.\n",
+               (long)Size,
+               (int)SourceOffset,
+               (int)DestinationOffset);
+    }
+
+    return Failures;
+}
+
+double
+TestBenchmarkMemoryRoutine (
+    TEST_MEMORY_ROUTINE Routine,
+    PUCHAR Source,
+    PUCHAR Destination,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine times a single memory routine at a single size.
+
+Arguments:
+
+    Routine - Supplies the routine to benchmark.
+
+    Source - Supplies a pointer to the source buffer.
+
+    Destination - Supplies a pointer to the destination buffer.
+
+    Size - Supplies the size to operate on.
+
+Return Value:
+
+    Returns the throughput in megabytes per second.
+
+--*/
+
+{
+
+    clock_t End;
+    UINTN Index;
+    UINTN Iterations;
+    double Seconds;
+    clock_t Start;
+
+    Iterations = TEST_MEMORY_BENCHMARK_BYTES / Size;
+    Start = clock();
+    for (Index = 0; Index < Iterations; Index += 1) {
+        switch (Routine) {
+        case TestMemoryCopy:
+            RtlCopyMemory(Destination, Source, Size);
+            break;
+
+        case TestMemoryZero:
+            RtlZeroMemory(Destination, Size);
+            break;
+
+        case TestMemorySet:
+            RtlSetMemory(Destination, 0x5A, Size);
+            break;
+
+        case TestMemoryCompare:
+            RtlCompareMemory(Destination, Source, Size);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    End = clock();
+    Seconds = (double)(End - Start) / CLOCKS_PER_SEC;
+    if (Seconds == 0) {
+        Seconds = 1.0 / CLOCKS_PER_SEC;
+    }
+
+    return ((double)Iterations * Size) / (Seconds * 1024.0 * 1024.0);
+}
+
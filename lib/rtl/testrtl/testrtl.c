@@ -418,6 +418,16 @@ TestHeaps (
     BOOL Quiet
     );
 
+ULONG
+TestMemoryRoutines (
+    VOID
+    );
+
+VOID
+BenchmarkMemoryRoutines (
+    VOID
+    );
+
 ULONG
 TestSoftFloat (
     VOID
@@ -589,10 +599,21 @@ Return Value:
     ULONG TestsFailed;
 
     srand(time(NULL));
+
+    //
+    // Just run the memory routine benchmark if requested.
+    //
+
+    if ((ArgumentCount > 1) && (strcmp(Arguments[1], "-b") == 0)) {
+        BenchmarkMemoryRoutines();
+        return 0;
+    }
+
     TestsFailed = 0;
     TestsFailed += TestSoftFloat();
     TestsFailed += TestTime();
     TestsFailed += TestHeaps(TRUE);
+    TestsFailed += TestMemoryRoutines();
 
     //
     // Test basic unsigned division.